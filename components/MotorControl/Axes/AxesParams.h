@@ -11,6 +11,8 @@
 #include "AxisParams.h"
 #include "AxesValues.h"
 #include <vector>
+#include <math.h>
+#include <string.h>
 
 #define DEBUG_AXES_PARAMS
 
@@ -116,6 +118,48 @@ public:
         return _maxJunctionDeviationMM;
     }
 
+    // Max deviation of the chord of an arc segment from the true arc
+    AxisPosDataType getArcChordToleranceMM() const
+    {
+        return _arcChordToleranceMM;
+    }
+
+    // Max deviation from a straight line of a block on a non-linear geometry (e.g. SCARA) - blocks are split
+    // adaptively to keep within this if non-zero (otherwise moves are split uniformly using the max block distance)
+    AxisPosDataType getMaxLinearDeviationMM() const
+    {
+        return _maxLinearDeviationMM;
+    }
+
+    // Input shaper for an axis - nullptr if the axis is not shaped
+    const InputShaper* getInputShaper(uint32_t axisIdx) const
+    {
+        if ((axisIdx >= _axisParams.size()) || !_axisParams[axisIdx]._inputShaper.isActive())
+            return nullptr;
+        return &_axisParams[axisIdx]._inputShaper;
+    }
+
+    // Pressure advance axis (the first axis with pressure advance set) - returns -1 if there is none
+    int getPressureAdvanceAxis(float& pressureAdvanceSecs) const
+    {
+        for (uint32_t axisIdx = 0; axisIdx < _axisParams.size(); axisIdx++)
+        {
+            if (_axisParams[axisIdx]._pressureAdvanceSecs > 0)
+            {
+                pressureAdvanceSecs = _axisParams[axisIdx]._pressureAdvanceSecs;
+                return axisIdx;
+            }
+        }
+        pressureAdvanceSecs = 0;
+        return -1;
+    }
+
+    // Max jerk (units per second cubed) - 0 if the ramp profile is trapezoidal
+    AxisAccDataType getMaxJerkUps3() const
+    {
+        return _isJerkLimited ? _maxJerkUps3 : 0;
+    }
+
     bool isPrimaryAxis(uint32_t axisIdx) const
     {
         if (axisIdx >= _axisParams.size())
@@ -123,6 +167,69 @@ public:
         return _axisParams[axisIdx]._isPrimaryAxis;
     }
 
+    // Primary axes as a mask (bit per axis) - for use with AxesValues vector operations
+    uint32_t getPrimaryAxisMask() const
+    {
+        return _primaryAxisMask;
+    }
+
+    // Max acceleration along a path with the given unit vector (primary axes) - each axis only sees its component
+    // of the path acceleration so the path can accelerate at the lowest of maxAccel / |unitVec| for the moving axes
+    // - this is bounded (the largest |unitVec| is at least 1/sqrt(number of moving axes)) and the step rate
+    //   acceleration of each axis (path acceleration * |unitVec| * steps per unit) stays within its own limit
+    AxisAccDataType getPathMaxAccelUps2(const AxesValues<AxisUnitVectorDataType>& unitVectors) const
+    {
+        AxisAccDataType pathMaxAcc = 0;
+        for (uint32_t axisIdx = 0; (axisIdx < _axisParams.size()) && (axisIdx < unitVectors.numAxes()); axisIdx++)
+        {
+            float unitVecAbs = fabsf(unitVectors.getVal(axisIdx));
+            if (!_axisParams[axisIdx]._isPrimaryAxis || (unitVecAbs < PATH_LIMIT_MIN_UNIT_VEC))
+                continue;
+            AxisAccDataType axisLimit = _axisParams[axisIdx]._maxAccelUps2 / unitVecAbs;
+            if ((pathMaxAcc == 0) || (axisLimit < pathMaxAcc))
+                pathMaxAcc = axisLimit;
+        }
+        return pathMaxAcc == 0 ? _masterAxisMaxAccUps2 : pathMaxAcc;
+    }
+
+    // Input shaper axis for a path with the given unit vector (primary axes) - all axes move in lockstep so a block
+    // can only have one shaper and the most conservative of the moving axes is used (the longest duration which is
+    // the lowest frequency) - returns -1 if no moving axis is shaped
+    int getPathInputShaperAxis(const AxesValues<AxisUnitVectorDataType>& unitVectors) const
+    {
+        int shaperAxisIdx = -1;
+        float shaperDurationSecs = 0;
+        for (uint32_t axisIdx = 0; (axisIdx < _axisParams.size()) && (axisIdx < unitVectors.numAxes()); axisIdx++)
+        {
+            const InputShaper& inputShaper = _axisParams[axisIdx]._inputShaper;
+            if (!_axisParams[axisIdx]._isPrimaryAxis || !inputShaper.isActive() ||
+                        (fabsf(unitVectors.getVal(axisIdx)) < PATH_LIMIT_MIN_UNIT_VEC))
+                continue;
+            if ((shaperAxisIdx < 0) || (inputShaper.getDurationSecs() > shaperDurationSecs))
+            {
+                shaperAxisIdx = axisIdx;
+                shaperDurationSecs = inputShaper.getDurationSecs();
+            }
+        }
+        return shaperAxisIdx;
+    }
+
+    // Max speed along a path with the given unit vector (primary axes) - projected in the same way as acceleration
+    AxisSpeedDataType getPathMaxSpeedUps(const AxesValues<AxisUnitVectorDataType>& unitVectors) const
+    {
+        AxisSpeedDataType pathMaxSpeed = 0;
+        for (uint32_t axisIdx = 0; (axisIdx < _axisParams.size()) && (axisIdx < unitVectors.numAxes()); axisIdx++)
+        {
+            float unitVecAbs = fabsf(unitVectors.getVal(axisIdx));
+            if (!_axisParams[axisIdx]._isPrimaryAxis || (unitVecAbs < PATH_LIMIT_MIN_UNIT_VEC))
+                continue;
+            AxisSpeedDataType axisLimit = _axisParams[axisIdx]._maxSpeedUps / unitVecAbs;
+            if ((pathMaxSpeed == 0) || (axisLimit < pathMaxSpeed))
+                pathMaxSpeed = axisLimit;
+        }
+        return pathMaxSpeed == 0 ? masterAxisMaxSpeed() : pathMaxSpeed;
+    }
+
     bool ptInBounds(const AxesValues<AxisPosDataType>& pt) const
     {
         bool isValid = true;
@@ -146,16 +253,27 @@ public:
         _geometry = config.getString("motion/geom", "XYZ");
         _maxBlockDistMM = config.getDouble("motion/blockDistMM", _maxBlockDistanceMM_default);
         _maxJunctionDeviationMM = config.getDouble("motion/maxJunctionDeviationMM", maxJunctionDeviationMM_default);
+        _arcChordToleranceMM = config.getDouble("motion/arcChordTolMM", arcChordToleranceMM_default);
+        _maxLinearDeviationMM = config.getDouble("motion/maxLinDevMM", maxLinearDeviationMM_default);
         _homingNeededBeforeAnyMove = config.getBool("motion/homeBeforeMove", true);
         _allowOutOfBounds = config.getBool("motion/allowOutOfBounds", false);
 
+        // Ramp profile - either trapezoidal (constant acceleration) or scurve (jerk-limited)
+        String rampProfile = config.getString("motion/rampProfile", "trapezoidal");
+        _maxJerkUps3 = config.getDouble("motion/maxJerkUps3", 0);
+        _isJerkLimited = rampProfile.equalsIgnoreCase("scurve") && (_maxJerkUps3 > 0);
+        if (rampProfile.equalsIgnoreCase("scurve") && !_isJerkLimited)
+            LOG_W(MODULE_PREFIX, "setupAxes scurve ramp profile requires maxJerkUps3 > 0 - using trapezoidal");
+
 #ifdef DEBUG_AXES_PARAMS
         // Debug
-        LOG_I(MODULE_PREFIX, "setupAxes geom %s blockDistMM %0.2f (0=no-max) homeBefMove %s jnDev %0.2fmm allowOOB %s",
+        LOG_I(MODULE_PREFIX, "setupAxes geom %s blockDistMM %0.2f (0=no-max) homeBefMove %s jnDev %0.2fmm allowOOB %s ramp %s jerk %0.2f",
                _geometry.c_str(), _maxBlockDistMM,
                _homingNeededBeforeAnyMove ? "Y" : "N",
                _maxJunctionDeviationMM,
-                _allowOutOfBounds ? "Y" : "N");
+                _allowOutOfBounds ? "Y" : "N",
+                _isJerkLimited ? "scurve" : "trapezoidal",
+                _maxJerkUps3);
 #endif
         
         // Extract sub-system elements
@@ -170,8 +288,13 @@ public:
             // Resize appropriately
             _axisParams.resize(numAxesToAdd);
             uint32_t axisIdx = 0;
+            _primaryAxisMask = 0;
             for (RaftJson axisConfig : axesVec)
             {
+                // Check axis count
+                if (axisIdx >= numAxesToAdd)
+                    break;
+
                 // Get params
                 String paramsJson = axisConfig.getString("params", "{}");
 
@@ -180,6 +303,8 @@ public:
 
                 // Find the master axis (dominant one, or first primary - or just first)
                 setMasterAxis(axisIdx);
+                if (_axisParams[axisIdx]._isPrimaryAxis)
+                    _primaryAxisMask |= 1 << axisIdx;
 
                 // Cache axis max step rate
                 for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
@@ -194,6 +319,82 @@ public:
         return true;
     }
 
+    // Serialize the parsed parameters into a binary blob (used to skip JSON parsing at boot if the config is unchanged)
+    void toBlob(std::vector<uint8_t>& blob) const
+    {
+        auto addBytes = [&blob](const void* pData, uint32_t len) {
+            const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+            blob.insert(blob.end(), pBytes, pBytes + len);
+        };
+        uint32_t geomLen = _geometry.length();
+        addBytes(&geomLen, sizeof(geomLen));
+        addBytes(_geometry.c_str(), geomLen);
+        addBytes(&_maxBlockDistMM, sizeof(_maxBlockDistMM));
+        addBytes(&_homingNeededBeforeAnyMove, sizeof(_homingNeededBeforeAnyMove));
+        addBytes(&_maxJunctionDeviationMM, sizeof(_maxJunctionDeviationMM));
+        addBytes(&_arcChordToleranceMM, sizeof(_arcChordToleranceMM));
+        addBytes(&_maxLinearDeviationMM, sizeof(_maxLinearDeviationMM));
+        addBytes(&_primaryAxisMask, sizeof(_primaryAxisMask));
+        addBytes(&_allowOutOfBounds, sizeof(_allowOutOfBounds));
+        addBytes(&_isJerkLimited, sizeof(_isJerkLimited));
+        addBytes(&_maxJerkUps3, sizeof(_maxJerkUps3));
+        addBytes(&_masterAxisIdx, sizeof(_masterAxisIdx));
+        uint32_t numAxes = _axisParams.size();
+        addBytes(&numAxes, sizeof(numAxes));
+        addBytes(_axisParams.data(), numAxes * sizeof(AxisParams));
+    }
+
+    // Restore the parameters from a blob created by toBlob - returns false (leaving the parameters cleared) if invalid
+    bool fromBlob(const uint8_t* pBlob, uint32_t blobLen, uint32_t& bytesUsed)
+    {
+        clearAxes();
+        uint32_t pos = 0;
+        auto getBytes = [&](void* pData, uint32_t len) {
+            if (pos + len > blobLen)
+                return false;
+            memcpy(pData, pBlob + pos, len);
+            pos += len;
+            return true;
+        };
+        uint32_t geomLen = 0;
+        if (!getBytes(&geomLen, sizeof(geomLen)) || (pos + geomLen > blobLen))
+            return false;
+        std::vector<char> geomChars(pBlob + pos, pBlob + pos + geomLen);
+        geomChars.push_back(0);
+        _geometry = geomChars.data();
+        pos += geomLen;
+        uint32_t numAxes = 0;
+        bool isValid = getBytes(&_maxBlockDistMM, sizeof(_maxBlockDistMM)) &&
+                getBytes(&_homingNeededBeforeAnyMove, sizeof(_homingNeededBeforeAnyMove)) &&
+                getBytes(&_maxJunctionDeviationMM, sizeof(_maxJunctionDeviationMM)) &&
+                getBytes(&_arcChordToleranceMM, sizeof(_arcChordToleranceMM)) &&
+                getBytes(&_maxLinearDeviationMM, sizeof(_maxLinearDeviationMM)) &&
+                getBytes(&_primaryAxisMask, sizeof(_primaryAxisMask)) &&
+                getBytes(&_allowOutOfBounds, sizeof(_allowOutOfBounds)) &&
+                getBytes(&_isJerkLimited, sizeof(_isJerkLimited)) &&
+                getBytes(&_maxJerkUps3, sizeof(_maxJerkUps3)) &&
+                getBytes(&_masterAxisIdx, sizeof(_masterAxisIdx)) &&
+                getBytes(&numAxes, sizeof(numAxes)) &&
+                (numAxes <= AXIS_VALUES_MAX_AXES);
+        if (isValid)
+        {
+            _axisParams.resize(numAxes);
+            isValid = getBytes(_axisParams.data(), numAxes * sizeof(AxisParams));
+        }
+        if (!isValid)
+        {
+            clearAxes();
+            return false;
+        }
+
+        // Values derived from the axis parameters
+        _masterAxisMaxAccUps2 = getMaxAccelUps2(_masterAxisIdx);
+        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
+            _maxStepRatesPerSec.setVal(i, getMaxStepRatePerSec(i, true));
+        bytesUsed = pos;
+        return true;
+    }
+
     void debugLog()
     {
         for (uint32_t axisIdx = 0; axisIdx < _axisParams.size(); axisIdx++)
@@ -241,9 +442,14 @@ public:
         return getMaxSpeedUps(0);
     }
 
+    // Unit vector components smaller than this are ignored when projecting axis limits onto a path
+    static constexpr float PATH_LIMIT_MIN_UNIT_VEC = 1e-4f;
+
     // Defaults
     static constexpr double _maxBlockDistanceMM_default = 0.0f;
     static constexpr double maxJunctionDeviationMM_default = 0.05f;
+    static constexpr double arcChordToleranceMM_default = 0.01f;
+    static constexpr double maxLinearDeviationMM_default = 0.0f;
 
 private:
 
@@ -254,8 +460,15 @@ private:
     double _maxBlockDistMM = _maxBlockDistanceMM_default;
     bool _homingNeededBeforeAnyMove = true;
     double _maxJunctionDeviationMM = maxJunctionDeviationMM_default;
+    double _arcChordToleranceMM = arcChordToleranceMM_default;
+    double _maxLinearDeviationMM = maxLinearDeviationMM_default;
+    uint32_t _primaryAxisMask = 0;
     bool _allowOutOfBounds = false;
 
+    // Ramp profile
+    bool _isJerkLimited = false;
+    AxisAccDataType _maxJerkUps3 = 0;
+
     // Axis parameters
     std::vector<AxisParams> _axisParams;
 
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <math.h>
 #include "AxesValues.h"
 
 class AxesState
@@ -21,6 +22,7 @@ public:
     {
         unitsFromOrigin.clear();
         stepsFromOrigin.clear();
+        clearStepResiduals();
         _unitsFromOriginValid = false;
     }
 
@@ -34,9 +36,23 @@ public:
     {
         this->unitsFromOrigin = unitsFromOrigin;
         if (!stepsAreRelativeToPreviousValue)
+        {
             this->stepsFromOrigin = steps;
+            clearStepResiduals();
+        }
         else
+        {
             this->stepsFromOrigin += steps;
+        }
+        _unitsFromOriginValid = true;
+    }
+
+    /// @brief Set position in units without any change in steps (the move was too short for a whole step and
+    ///        the fraction is held in the step residual)
+    /// @param unitsFromOrigin units from origin
+    void setUnitsFromOrigin(const AxesValues<AxisPosDataType>& unitsFromOrigin)
+    {
+        this->unitsFromOrigin = unitsFromOrigin;
         _unitsFromOriginValid = true;
     }
     AxesValues<AxisStepsDataType> getStepsFromOrigin() const
@@ -62,14 +78,57 @@ public:
     void setStepsFromOriginAndInvalidateUnits(const AxesValues<AxisStepsDataType>& steps)
     {
         stepsFromOrigin = steps;
+        clearStepResiduals();
         _unitsFromOriginValid = false;
     }
 
+    /// @brief Step residual - the fraction of a step by which the commanded actuator position differs from the
+    ///        steps from origin (held in fixed point so that it can be carried exactly from block to block)
+    /// @param axisIdx Axis index
+    /// @return Residual in steps
+    AxisCalcDataType getStepResidual(uint32_t axisIdx) const
+    {
+        if (axisIdx >= AXIS_VALUES_MAX_AXES)
+            return 0;
+        return AxisCalcDataType(_stepResidualsFixed[axisIdx]) / STEP_RESIDUAL_ONE;
+    }
+    void setStepResidual(uint32_t axisIdx, AxisCalcDataType residualSteps)
+    {
+        if (axisIdx >= AXIS_VALUES_MAX_AXES)
+            return;
+        AxisCalcDataType residualFixed = round(residualSteps * STEP_RESIDUAL_ONE);
+        if (residualFixed > STEP_RESIDUAL_MAX)
+            residualFixed = STEP_RESIDUAL_MAX;
+        else if (residualFixed < -STEP_RESIDUAL_MAX)
+            residualFixed = -STEP_RESIDUAL_MAX;
+        _stepResidualsFixed[axisIdx] = int32_t(residualFixed);
+    }
+    void clearStepResiduals()
+    {
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+            _stepResidualsFixed[axisIdx] = 0;
+    }
+
+    /// @brief Commanded actuator position (steps from origin plus the step residual)
+    /// @param axisIdx Axis index
+    /// @return Position in steps (including the fraction of a step)
+    AxisCalcDataType getStepsFromOriginExact(uint32_t axisIdx) const
+    {
+        return getStepsFromOrigin(axisIdx) + getStepResidual(axisIdx);
+    }
+
 private:
+    // Step residual fixed point (16 fractional bits) and limit
+    static constexpr int32_t STEP_RESIDUAL_ONE = 1 << 16;
+    static constexpr int32_t STEP_RESIDUAL_MAX = INT32_MAX;
+
     // Axis positions in axes units and steps
     AxesValues<AxisPosDataType> unitsFromOrigin;
     AxesValues<AxisStepsDataType> stepsFromOrigin;
 
+    // Step residuals (fixed point)
+    int32_t _stepResidualsFixed[AXIS_VALUES_MAX_AXES] = {};
+
     // Units from origin values validity
     bool _unitsFromOriginValid = false;
 };
@@ -13,8 +13,13 @@
 #include "RaftArduino.h"
 #include "esp_attr.h"
 
-// Max axes and endstops supported
-static const uint32_t AXIS_VALUES_MAX_AXES = 3;
+// Max axes supported - this can be increased (up to 6) with a build flag e.g. -DMOTOR_CONTROL_MAX_AXES=6
+// Storage, copies and per-axis loops in the planner and ramp generator scale with this value
+#ifndef MOTOR_CONTROL_MAX_AXES
+#define MOTOR_CONTROL_MAX_AXES 3
+#endif
+static const uint32_t AXIS_VALUES_MAX_AXES = MOTOR_CONTROL_MAX_AXES;
+static_assert((AXIS_VALUES_MAX_AXES >= 3) && (AXIS_VALUES_MAX_AXES <= 6), "MOTOR_CONTROL_MAX_AXES must be 3..6");
 
 // Data types
 typedef float AxisStepRateDataType;
@@ -34,77 +39,61 @@ typedef bool AxisSpecifiedDataType;
 
 /// @brief Templated class for axis values
 /// @tparam T Type of value
-template <typename T>
+/// @tparam N Number of axes (AXIS_VALUES_MAX_AXES unless a different size is needed)
+/// @note Values are stored packed and all loops have a compile-time count so that they are unrolled (and
+///       auto-vectorized where the target supports it) - the class is trivially copyable
+template <typename T, uint32_t N = AXIS_VALUES_MAX_AXES>
 class AxesValues
 {
 public:
+    static constexpr uint32_t NUM_AXES = N;
+
     AxesValues()
     {
         clear();
     }
-    AxesValues(const AxesValues &other)
-    {
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
-            _vals[i] = other._vals[i];
-    }
-    AxesValues& operator=(const AxesValues& other)
-    {
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
-            _vals[i] = other._vals[i];
-        return *this;
-    }
+    AxesValues(const AxesValues &other) = default;
+    AxesValues& operator=(const AxesValues& other) = default;
     AxesValues operator+(const AxesValues& other) const
     {
-        AxesValues result;
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
-            result._vals[i] = _vals[i] + other._vals[i];
+        AxesValues result(*this);
+        result += other;
         return result;
     }
     AxesValues& operator+=(const AxesValues& other)
     {
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
+        for (uint32_t i = 0; i < N; i++)
             _vals[i] += other._vals[i];
         return *this;
     }
     AxesValues operator-(const AxesValues& other) const
     {
-        AxesValues result;
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
-            result._vals[i] = _vals[i] - other._vals[i];
+        AxesValues result(*this);
+        result -= other;
         return result;
     }
     AxesValues& operator-=(const AxesValues& other)
     {
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
+        for (uint32_t i = 0; i < N; i++)
             _vals[i] -= other._vals[i];
         return *this;
     }
     AxesValues operator*(T val) const
     {
-        AxesValues result;
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
-            result._vals[i] = _vals[i] * val;
+        AxesValues result(*this);
+        result *= val;
         return result;
     }
     AxesValues& operator*=(T val)
     {
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
+        for (uint32_t i = 0; i < N; i++)
             _vals[i] *= val;
         return *this;
     }
     AxesValues operator/(T val) const
     {
-        // Check for divide by zero
-        if (val == 0)
-        {
-            AxesValues result;
-            for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
-                result._vals[i] = 0;
-            return result;
-        }
-        AxesValues result;
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
-            result._vals[i] = _vals[i] / val;
+        AxesValues result(*this);
+        result /= val;
         return result;
     }
     AxesValues& operator/=(T val)
@@ -112,23 +101,22 @@ public:
         // Check for divide by zero
         if (val == 0)
         {
-            for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
-                _vals[i] = 0;
+            clear();
             return *this;
         }
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
+        for (uint32_t i = 0; i < N; i++)
             _vals[i] /= val;
         return *this;
     }
     T& operator[](uint32_t idx) {
-        if (idx >= AXIS_VALUES_MAX_AXES) {
+        if (idx >= N) {
             static T dummy = 0;
             return dummy;
         }
         return _vals[idx];
     }
     const T& operator[](uint32_t idx) const {
-        if (idx >= AXIS_VALUES_MAX_AXES) {
+        if (idx >= N) {
             static T dummy = 0;
             return dummy;
         }
@@ -136,46 +124,59 @@ public:
     }
     uint32_t numAxes() const
     {
-        return AXIS_VALUES_MAX_AXES;
+        return N;
     }
 
     AxesValues(T x, T y)
     {
+        clear();
         _vals[0] = x;
         _vals[1] = y;
-        _vals[2] = 0;
     }
     AxesValues(T x, T y, T z)
     {
+        clear();
         _vals[0] = x;
         _vals[1] = y;
-        _vals[2] = z;
+        setVal(2, z);
     }
     void clear()
     {
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
+        for (uint32_t i = 0; i < N; i++)
             _vals[i] = 0;
     }
     void setVal(uint32_t axisIdx, T val)
     {
-        if (axisIdx < AXIS_VALUES_MAX_AXES)
+        if (axisIdx < N)
         {
             _vals[axisIdx] = val;
         }
     }
     T getVal(uint32_t axisIdx) const
     {
-        if (axisIdx < AXIS_VALUES_MAX_AXES)
+        if (axisIdx < N)
             return _vals[axisIdx];
         return 0;
     }
-    T vectorMultSum(AxesValues<T> other) const
+
+    // Dot product
+    T vectorMultSum(const AxesValues& other) const
     {
         T result = 0;
-        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
+        for (uint32_t i = 0; i < N; i++)
             result += _vals[i] * other._vals[i];
         return result;
     }
+
+    // Sum of squares (square of the vector magnitude) - optionally only for axes in a mask (bit per axis)
+    T vectorMagnitudeSq(uint32_t axisMask = 0xffffffff) const
+    {
+        T result = 0;
+        for (uint32_t i = 0; i < N; i++)
+            result += (axisMask & (1 << i)) ? _vals[i] * _vals[i] : 0;
+        return result;
+    }
+
     // Debug
     String getDebugJSON(const char* elemName, bool includeBraces = false) const
     {
@@ -185,7 +186,7 @@ public:
     String toJSON() const
     {
         String jsonStr = "[";
-        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        for (uint32_t axisIdx = 0; axisIdx < N; axisIdx++)
         {
             if (axisIdx != 0)
                 jsonStr += ",";
@@ -196,6 +197,5 @@ public:
     }
 
 private:
-    T _vals[AXIS_VALUES_MAX_AXES];
+    T _vals[N];
 };
-
@@ -6,6 +6,8 @@
 //
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <string.h>
+#include <strings.h>
 #include "AxisEndstopChecks.h"
 #include "AxesValues.h"
 
@@ -43,11 +45,16 @@ void AxisEndstopChecks::set(uint32_t axisIdx, uint32_t endStopIdx, AxisMinMaxEnu
     _uint |= (1 << MIN_MAX_VALID_BIT);
 }
 void AxisEndstopChecks::set(uint32_t axisIdx, uint32_t endStopIdx, const String& minMaxStr)
+{
+    set(axisIdx, endStopIdx, minMaxStr.c_str(), minMaxStr.length());
+}
+void AxisEndstopChecks::set(uint32_t axisIdx, uint32_t endStopIdx, const char* pMinMaxStr, uint32_t strLen)
 {
     AxisMinMaxEnum setTo = END_STOP_NONE;
     for (uint32_t i = 0; i < sizeof(AxisEndstopMinMaxEnumStrs)/sizeof(AxisEndstopMinMaxEnumStrs[0]); i++)
     {
-        if (minMaxStr.equalsIgnoreCase(AxisEndstopMinMaxEnumStrs[i]))
+        const char* pEnumStr = AxisEndstopMinMaxEnumStrs[i];
+        if ((strlen(pEnumStr) == strLen) && (strncasecmp(pMinMaxStr, pEnumStr, strLen) == 0))
         {
             setTo = (AxisMinMaxEnum)i;
             break;
@@ -84,7 +91,11 @@ void AxisEndstopChecks::all()
 }
 String AxisEndstopChecks::getStr(AxisMinMaxEnum minMax) const
 {
-    return AxisEndstopMinMaxEnumStrs[minMax];
+    return getCStr(minMax);
+}
+const char* AxisEndstopChecks::getCStr(AxisMinMaxEnum minMax)
+{
+    return AxisEndstopMinMaxEnumStrs[minMax & BITS_PER_VAL_MASK];
 }
 void AxisEndstopChecks::fromJSON(const RaftJsonIF& jsonData, const char* elemName)
 {
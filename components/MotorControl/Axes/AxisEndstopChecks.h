@@ -59,6 +59,8 @@ public:
     }
     void set(uint32_t axisIdx, uint32_t endStopIdx, AxisMinMaxEnum checkType);
     void set(uint32_t axisIdx, uint32_t endStopIdx, const String& minMaxStr);
+    // Set from a string which need not be null terminated (used by the in-place JSON parser)
+    void set(uint32_t axisIdx, uint32_t endStopIdx, const char* pMinMaxStr, uint32_t strLen);
     AxisMinMaxEnum get(uint32_t axisIdx, uint32_t endStopIdx) const;
     // Reverse endstop direction for endstops that are set
     void reverse();
@@ -77,7 +79,17 @@ public:
     {
         return _uint;
     }
+    // Raw value (used for binary serialization)
+    uint32_t getRawValue() const
+    {
+        return _uint;
+    }
+    void setRawValue(uint32_t rawValue)
+    {
+        _uint = rawValue;
+    }
     String getStr(AxisMinMaxEnum minMax) const;
+    static const char* getCStr(AxisMinMaxEnum minMax);
     void fromJSON(const RaftJsonIF& jsonData, const char* elemName);
     String toJSON(const char* elemName) const;
 
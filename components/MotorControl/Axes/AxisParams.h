@@ -12,6 +12,7 @@
 #include "Logger.h"
 #include "RaftUtils.h"
 #include "AxesValues.h"
+#include "InputShaper.h"
 
 // This class holds the parameters for a single axis of a machine which may be driven by a stepper or servo
 // The parameters are used to convert between machine units and steps using kinematics which are specific to
@@ -32,6 +33,7 @@ public:
     static constexpr AxisRPMDataType maxRPM_default = 300.0f;
     static constexpr AxisPosDataType originOffsetUnits_default = 0.0f;
     static constexpr AxisStepsDataType stepsForAxisHoming_default = 100000;
+    static constexpr float shaperDamping_default = 0.1f;
 
     // Max and min speed in units per second
     AxisSpeedDataType _maxSpeedUps;
@@ -57,6 +59,13 @@ public:
     // A servo axis is one which does not require blockwise stepping to a destination
     bool _isServoAxis;
 
+    // Input shaper (to cancel vibration at the axis resonant frequency)
+    InputShaper _inputShaper;
+
+    // Pressure advance (seconds) - for an extruder axis the position is advanced by this time multiplied by the
+    // axis velocity (0 if not an extruder axis)
+    float _pressureAdvanceSecs;
+
 public:
     AxisParams()
     {
@@ -76,6 +85,8 @@ public:
         _isPrimaryAxis = true;
         _isDominantAxis = false;
         _isServoAxis = false;
+        _inputShaper.clear();
+        _pressureAdvanceSecs = 0;
     }
 
     AxisStepsFactorDataType stepsPerUnit() const
@@ -112,6 +123,10 @@ public:
         _isDominantAxis = config.getBool("isDominantAxis", 0);
         _isPrimaryAxis = config.getBool("isPrimaryAxis", 1);
         _isServoAxis = config.getBool("isServoAxis", 0);
+        _inputShaper.setup(config.getString("shaper", "none"), 
+                    config.getDouble("shaperFreqHz", 0), 
+                    config.getDouble("shaperDamping", shaperDamping_default));
+        _pressureAdvanceSecs = config.getDouble("pressureAdvance", 0);
     }
 
     void debugLog(int axisIdx)
@@ -121,5 +136,10 @@ public:
                    axisIdx, _maxSpeedUps, _maxAccelUps2, _stepsPerRot, _unitsPerRot, _maxRPM);
         LOG_I(MODULE_PREFIX, "Axis%d params minVal %0.2f maxVal %0.2f isDominant %d isServo %d",
                    axisIdx, _minUnits, _maxUnits, _isDominantAxis, _isServoAxis);
+        if (_inputShaper.isActive())
+            LOG_I(MODULE_PREFIX, "Axis%d params shaper %s freq %0.2fHz damping %0.3f",
+                   axisIdx, _inputShaper.getTypeStr().c_str(), _inputShaper.getFreqHz(), _inputShaper.getDampingRatio());
+        if (_pressureAdvanceSecs > 0)
+            LOG_I(MODULE_PREFIX, "Axis%d params pressureAdvance %0.4fs", axisIdx, _pressureAdvanceSecs);
     }
 };
@@ -0,0 +1,189 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// InputShaper
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include "RaftArduino.h"
+
+// Input shaper - an impulse train which, when convolved with the commanded motion, cancels vibration at the
+// resonant frequency of an axis
+// Supported shapers are ZV (2 impulses), ZVD (3 impulses - more robust to frequency error) and MZV (3 impulses
+// over a shorter time than ZVD)
+// Applied to a period of constant acceleration the convolution results in a staircase acceleration at the start
+// and end of the period so the result of shaping can be expressed as acceleration levels at impulse times
+class InputShaper
+{
+public:
+    static constexpr uint32_t MAX_IMPULSES = 3;
+
+    enum ShaperType
+    {
+        SHAPER_NONE,
+        SHAPER_ZV,
+        SHAPER_ZVD,
+        SHAPER_MZV
+    };
+
+    InputShaper()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        _shaperType = SHAPER_NONE;
+        _numImpulses = 0;
+        _freqHz = 0;
+        _dampingRatio = 0;
+        for (uint32_t i = 0; i < MAX_IMPULSES; i++)
+        {
+            _impulseTimesSecs[i] = 0;
+            _impulseAmps[i] = 0;
+        }
+    }
+
+    /// @brief Setup the shaper
+    /// @param shaperType Shaper type name (zv, zvd, mzv or none)
+    /// @param freqHz Resonant frequency
+    /// @param dampingRatio Damping ratio (0 to < 1)
+    /// @return true if a shaper is active
+    bool setup(const String& shaperType, float freqHz, float dampingRatio)
+    {
+        clear();
+        if ((freqHz <= 0) || (dampingRatio < 0) || (dampingRatio >= 1))
+            return false;
+        const float pi = 3.14159265F;
+        float dampedRoot = sqrtf(1 - dampingRatio * dampingRatio);
+        float dampedPeriodSecs = 1 / (freqHz * dampedRoot);
+        if (shaperType.equalsIgnoreCase("zv"))
+        {
+            float k = expf(-dampingRatio * pi / dampedRoot);
+            setImpulse(0, 0, 1);
+            setImpulse(1, dampedPeriodSecs / 2, k);
+            _shaperType = SHAPER_ZV;
+        }
+        else if (shaperType.equalsIgnoreCase("zvd"))
+        {
+            float k = expf(-dampingRatio * pi / dampedRoot);
+            setImpulse(0, 0, 1);
+            setImpulse(1, dampedPeriodSecs / 2, 2 * k);
+            setImpulse(2, dampedPeriodSecs, k * k);
+            _shaperType = SHAPER_ZVD;
+        }
+        else if (shaperType.equalsIgnoreCase("mzv"))
+        {
+            float k = expf(-0.75F * dampingRatio * pi / dampedRoot);
+            float a1 = 1 - 1 / sqrtf(2);
+            setImpulse(0, 0, a1);
+            setImpulse(1, 0.375F * dampedPeriodSecs, (sqrtf(2) - 1) * k);
+            setImpulse(2, 0.75F * dampedPeriodSecs, a1 * k * k);
+            _shaperType = SHAPER_MZV;
+        }
+        else
+        {
+            return false;
+        }
+
+        // Normalize amplitudes
+        float ampSum = 0;
+        for (uint32_t i = 0; i < _numImpulses; i++)
+            ampSum += _impulseAmps[i];
+        for (uint32_t i = 0; i < _numImpulses; i++)
+            _impulseAmps[i] /= ampSum;
+        _freqHz = freqHz;
+        _dampingRatio = dampingRatio;
+        return true;
+    }
+
+    bool isActive() const
+    {
+        return _shaperType != SHAPER_NONE;
+    }
+    uint32_t getNumImpulses() const
+    {
+        return _numImpulses;
+    }
+    float getImpulseTimeSecs(uint32_t idx) const
+    {
+        return idx < _numImpulses ? _impulseTimesSecs[idx] : 0;
+    }
+    float getImpulseAmp(uint32_t idx) const
+    {
+        return idx < _numImpulses ? _impulseAmps[idx] : 0;
+    }
+
+    // Time from the first to the last impulse
+    float getDurationSecs() const
+    {
+        return _numImpulses > 0 ? _impulseTimesSecs[_numImpulses - 1] : 0;
+    }
+
+    // Amplitude-weighted mean impulse time (the average delay added to the motion)
+    float getCentroidSecs() const
+    {
+        float centroid = 0;
+        for (uint32_t i = 0; i < _numImpulses; i++)
+            centroid += _impulseAmps[i] * _impulseTimesSecs[i];
+        return centroid;
+    }
+
+    /// @brief Distance required for a shaped constant-acceleration change in speed
+    /// @param speed1 Speed at start of change
+    /// @param speed2 Speed at end of change
+    /// @param acceleration Acceleration
+    /// @return Distance
+    /// @note The shaped change takes the duration of the shaper longer than the unshaped change and each impulse
+    ///       contributes the unshaped distance plus the distance at the initial speed before it starts and at
+    ///       the final speed after the unshaped change ends
+    float rampDist(float speed1, float speed2, float acceleration) const
+    {
+        float unshapedDist = fabsf(speed2 * speed2 - speed1 * speed1) / 2 / acceleration;
+        float centroidSecs = getCentroidSecs();
+        return unshapedDist + speed1 * centroidSecs + speed2 * (getDurationSecs() - centroidSecs);
+    }
+
+    String getTypeStr() const
+    {
+        switch (_shaperType)
+        {
+            case SHAPER_ZV: return "zv";
+            case SHAPER_ZVD: return "zvd";
+            case SHAPER_MZV: return "mzv";
+            default: return "none";
+        }
+    }
+
+    float getFreqHz() const
+    {
+        return _freqHz;
+    }
+    float getDampingRatio() const
+    {
+        return _dampingRatio;
+    }
+
+private:
+    ShaperType _shaperType = SHAPER_NONE;
+    uint32_t _numImpulses = 0;
+    float _freqHz = 0;
+    float _dampingRatio = 0;
+    float _impulseTimesSecs[MAX_IMPULSES];
+    float _impulseAmps[MAX_IMPULSES];
+
+    void setImpulse(uint32_t idx, float timeSecs, float amp)
+    {
+        if (idx >= MAX_IMPULSES)
+            return;
+        _impulseTimesSecs[idx] = timeSecs;
+        _impulseAmps[idx] = amp;
+        if (idx >= _numImpulses)
+            _numImpulses = idx + 1;
+    }
+};
@@ -0,0 +1,77 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionArena
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+// Fixed arena for objects owned by the motion controller (stepper drivers, endstops, etc)
+// The storage is part of the owner so nothing comes from the heap when the hardware is (re)configured
+// - objects are constructed in the arena with create() and destroyed with destroy() - the space is only
+//   reclaimed by reset() which must be called after all objects in the arena have been destroyed
+// - create() returns nullptr if the arena is full and the caller can then fall back to the heap (owns() is
+//   used to find out how an object should be freed)
+template <uint32_t SizeBytes>
+class MotionArena
+{
+public:
+    // Create an object in the arena (nullptr if there is no space)
+    template <typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        uint32_t pos = (_usedBytes + alignof(T) - 1) & ~uint32_t(alignof(T) - 1);
+        if (pos + sizeof(T) > SizeBytes)
+            return nullptr;
+        _usedBytes = pos + sizeof(T);
+        if (_usedBytes > _highWaterBytes)
+            _highWaterBytes = _usedBytes;
+        return new (_mem + pos) T(std::forward<Args>(args)...);
+    }
+
+    // Destroy an object created in the arena (the space isn't reclaimed until reset)
+    template <typename T>
+    static void destroy(T* pObj)
+    {
+        if (pObj)
+            pObj->~T();
+    }
+
+    // Check if an object is in the arena
+    bool owns(const void* pObj) const
+    {
+        return (pObj >= _mem) && (pObj < _mem + SizeBytes);
+    }
+
+    // Reclaim all space (all objects in the arena must have been destroyed)
+    void reset()
+    {
+        _usedBytes = 0;
+    }
+
+    // Usage
+    uint32_t getUsedBytes() const
+    {
+        return _usedBytes;
+    }
+    uint32_t getHighWaterBytes() const
+    {
+        return _highWaterBytes;
+    }
+    static constexpr uint32_t getSizeBytes()
+    {
+        return SizeBytes;
+    }
+
+private:
+    alignas(max_align_t) uint8_t _mem[SizeBytes];
+    uint32_t _usedBytes = 0;
+    uint32_t _highWaterBytes = 0;
+};
@@ -6,124 +6,538 @@
 //
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
 #include "MotionArgs.h"
 
 // #define DEBUG_MOTION_ARGS
 
-/// @brief Get field definitions for JSON serialization
-/// @return std::vector<MotionArgs::FieldDefType>
-std::vector<MotionArgs::FieldDefType> MotionArgs::getFieldDefs()
-{
-    std::vector<FieldDefType> fieldDefs;
-    fieldDefs.push_back(FieldDefType("rel", &_isRelative, "bool"));
-    fieldDefs.push_back(FieldDefType("ramped", &_rampedMotion, "bool"));
-    fieldDefs.push_back(FieldDefType("steps", &_unitsAreSteps, "bool"));
-    fieldDefs.push_back(FieldDefType("nosplit", &_dontSplitMove, "bool"));
-    fieldDefs.push_back(FieldDefType("exDistOk", &_extrudeValid, "bool"));
-    fieldDefs.push_back(FieldDefType("speedOk", &_targetSpeedValid, "bool"));
-    fieldDefs.push_back(FieldDefType("cw", &_moveClockwise, "bool"));
-    fieldDefs.push_back(FieldDefType("rapid", &_moveRapid, "bool"));
-    fieldDefs.push_back(FieldDefType("more", &_moreMovesComing, "bool"));
-    fieldDefs.push_back(FieldDefType("homing", &_isHoming, "bool"));
-    fieldDefs.push_back(FieldDefType("idxOk", &_motionTrackingIndexValid, "bool"));
-    fieldDefs.push_back(FieldDefType("feedPerMin", &_feedrateUnitsPerMin, "bool"));
-    fieldDefs.push_back(FieldDefType("speed", &_targetSpeed, "double"));
-    fieldDefs.push_back(FieldDefType("exDist", &_extrudeDistance, "double"));
-    fieldDefs.push_back(FieldDefType("feedrate", &_feedrate, "double"));
-    fieldDefs.push_back(FieldDefType("idx", &_motionTrackingIdx, "double"));
-    fieldDefs.push_back(FieldDefType("en", &_enableMotors, "bool"));
-    fieldDefs.push_back(FieldDefType("ampsPCofMax", &_ampsPercentOfMax, "double"));
-    fieldDefs.push_back(FieldDefType("clearQ", &_preClearMotionQueue, "bool"));
-    fieldDefs.push_back(FieldDefType("stop", &_stopMotion, "bool"));
-    fieldDefs.push_back(FieldDefType("constrain", &_constrainToBounds, "bool"));
-    return fieldDefs;
-}
-
-void MotionArgs::fromJSON(const char* jsonStr)
-{
-    // Get json
-    RaftJson cmdJson(jsonStr);
-    clear();
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief In-place JSON tokenizer helpers
+/// @note These work directly on the JSON string and don't allocate - each returns a pointer to the character
+///       following the parsed element or nullptr if the JSON is malformed
+static const char* jsonSkipWS(const char* pJson)
+{
+    while (pJson && ((*pJson == ' ') || (*pJson == '\t') || (*pJson == '\r') || (*pJson == '\n')))
+        pJson++;
+    return pJson;
+}
+static const char* jsonExpect(const char* pJson, char ch)
+{
+    pJson = jsonSkipWS(pJson);
+    if (!pJson || (*pJson != ch))
+        return nullptr;
+    return jsonSkipWS(pJson + 1);
+}
+static const char* jsonGetString(const char* pJson, const char*& pStr, uint32_t& strLen)
+{
+    // String contents are returned without unescaping (field names and values used here don't need it)
+    if (!pJson || (*pJson != '"'))
+        return nullptr;
+    pStr = ++pJson;
+    while (*pJson && (*pJson != '"'))
+    {
+        if ((*pJson == '\\') && *(pJson + 1))
+            pJson++;
+        pJson++;
+    }
+    if (*pJson != '"')
+        return nullptr;
+    strLen = pJson - pStr;
+    return pJson + 1;
+}
+static bool jsonStrEquals(const char* pStr, uint32_t strLen, const char* pName)
+{
+    return (strncmp(pStr, pName, strLen) == 0) && (pName[strLen] == 0);
+}
+static const char* jsonGetNumber(const char* pJson, double& val)
+{
+    // Accepts numbers, true/false/null and numbers in quotes
+    val = 0;
+    if (!pJson)
+        return nullptr;
+    if (*pJson == '"')
+    {
+        const char* pStr = nullptr;
+        uint32_t strLen = 0;
+        const char* pNext = jsonGetString(pJson, pStr, strLen);
+        if (pNext)
+            val = strtod(pStr, nullptr);
+        return pNext;
+    }
+    if (strncmp(pJson, "true", 4) == 0)
+    {
+        val = 1;
+        return pJson + 4;
+    }
+    if (strncmp(pJson, "false", 5) == 0)
+        return pJson + 5;
+    if (strncmp(pJson, "null", 4) == 0)
+        return pJson + 4;
+    char* pEnd = nullptr;
+    val = strtod(pJson, &pEnd);
+    return pEnd == pJson ? nullptr : pEnd;
+}
+static const char* jsonSkipValue(const char* pJson, uint32_t depth = 0)
+{
+    static const uint32_t MAX_NESTING_DEPTH = 10;
+    if (!pJson || (depth > MAX_NESTING_DEPTH))
+        return nullptr;
+    if ((*pJson == '{') || (*pJson == '['))
+    {
+        bool isObject = *pJson == '{';
+        char closeCh = isObject ? '}' : ']';
+        pJson = jsonSkipWS(pJson + 1);
+        if (*pJson == closeCh)
+            return pJson + 1;
+        while (pJson)
+        {
+            if (isObject)
+            {
+                const char* pKey = nullptr;
+                uint32_t keyLen = 0;
+                pJson = jsonExpect(jsonGetString(pJson, pKey, keyLen), ':');
+            }
+            pJson = jsonSkipWS(jsonSkipValue(pJson, depth + 1));
+            if (!pJson)
+                return nullptr;
+            if (*pJson == closeCh)
+                return pJson + 1;
+            pJson = jsonExpect(pJson, ',');
+        }
+        return nullptr;
+    }
+    if (*pJson == '"')
+    {
+        const char* pStr = nullptr;
+        uint32_t strLen = 0;
+        return jsonGetString(pJson, pStr, strLen);
+    }
+    double val = 0;
+    return jsonGetNumber(pJson, val);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set a field from a value
+/// @param fieldId Field to set
+/// @param val Value (bool fields are true if non-zero)
+void MotionArgs::setField(FieldId fieldId, double val)
+{
+    bool flag = val != 0;
+    switch (fieldId)
+    {
+        case FIELD_REL: _isRelative = flag; break;
+        case FIELD_RAMPED: _rampedMotion = flag; break;
+        case FIELD_STEPS: _unitsAreSteps = flag; break;
+        case FIELD_NOSPLIT: _dontSplitMove = flag; break;
+        case FIELD_EXDIST_OK: _extrudeValid = flag; break;
+        case FIELD_SPEED_OK: _targetSpeedValid = flag; break;
+        case FIELD_CW: _moveClockwise = flag; break;
+        case FIELD_RAPID: _moveRapid = flag; break;
+        case FIELD_MORE: _moreMovesComing = flag; break;
+        case FIELD_HOMING: _isHoming = flag; break;
+        case FIELD_IDX_OK: _motionTrackingIndexValid = flag; break;
+        case FIELD_FEED_PER_MIN: _feedrateUnitsPerMin = flag; break;
+        case FIELD_SPEED: _targetSpeed = val; break;
+        case FIELD_EXDIST: _extrudeDistance = val; break;
+        case FIELD_FEEDRATE: _feedrate = val; break;
+        case FIELD_IDX: _motionTrackingIdx = val < 0 ? 0 : uint32_t(val); break;
+        case FIELD_EN: _enableMotors = flag; break;
+        case FIELD_AMPS_PC_OF_MAX: _ampsPercentOfMax = val; break;
+        case FIELD_CLEARQ: _preClearMotionQueue = flag; break;
+        case FIELD_STOP: _stopMotion = flag; break;
+        case FIELD_CONSTRAIN: _constrainToBounds = flag; break;
+        case FIELD_ARC: _isArc = flag; break;
+        case FIELD_ARC_I: _arcCentreOffsetI = val; break;
+        case FIELD_ARC_J: _arcCentreOffsetJ = val; break;
+        case FIELD_START_OK: _startTimeValid = flag; break;
+        case FIELD_START_US: _startTimeUs = val < 0 ? 0 : uint32_t(val); break;
+        case FIELD_VELOCITY: _isVelocity = flag; break;
+    }
+}
 
-    // Get field definitions
-    std::vector<FieldDefType> fieldDefs = getFieldDefs();
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get a field value
+/// @param fieldId Field to get
+/// @return Value (bool fields are 0 or 1)
+double MotionArgs::getField(FieldId fieldId) const
+{
+    switch (fieldId)
+    {
+        case FIELD_REL: return _isRelative;
+        case FIELD_RAMPED: return _rampedMotion;
+        case FIELD_STEPS: return _unitsAreSteps;
+        case FIELD_NOSPLIT: return _dontSplitMove;
+        case FIELD_EXDIST_OK: return _extrudeValid;
+        case FIELD_SPEED_OK: return _targetSpeedValid;
+        case FIELD_CW: return _moveClockwise;
+        case FIELD_RAPID: return _moveRapid;
+        case FIELD_MORE: return _moreMovesComing;
+        case FIELD_HOMING: return _isHoming;
+        case FIELD_IDX_OK: return _motionTrackingIndexValid;
+        case FIELD_FEED_PER_MIN: return _feedrateUnitsPerMin;
+        case FIELD_SPEED: return _targetSpeed;
+        case FIELD_EXDIST: return _extrudeDistance;
+        case FIELD_FEEDRATE: return _feedrate;
+        case FIELD_IDX: return _motionTrackingIdx;
+        case FIELD_EN: return _enableMotors;
+        case FIELD_AMPS_PC_OF_MAX: return _ampsPercentOfMax;
+        case FIELD_CLEARQ: return _preClearMotionQueue;
+        case FIELD_STOP: return _stopMotion;
+        case FIELD_CONSTRAIN: return _constrainToBounds;
+        case FIELD_ARC: return _isArc;
+        case FIELD_ARC_I: return _arcCentreOffsetI;
+        case FIELD_ARC_J: return _arcCentreOffsetJ;
+        case FIELD_START_OK: return _startTimeValid;
+        case FIELD_START_US: return _startTimeUs;
+        case FIELD_VELOCITY: return _isVelocity;
+    }
+    return 0;
+}
 
-    // Get fields
-    for (auto &fieldDef : fieldDefs)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set from JSON
+/// @param jsonStr JSON string (an object whose unrecognised fields are ignored)
+/// @return true if the JSON is valid
+/// @note This parses in a single pass and doesn't allocate memory so can be used for high rate streaming
+bool MotionArgs::fromJSON(const char* jsonStr)
+{
+    clear();
+    const char* pJson = jsonExpect(jsonStr, '{');
+    if (pJson && (*pJson == '}'))
+        return true;
+    while (pJson)
     {
-        // Check if value is present
-        if (!cmdJson.contains(fieldDef._name.c_str()))
-            continue;
+        // Get field name
+        const char* pName = nullptr;
+        uint32_t nameLen = 0;
+        pJson = jsonExpect(jsonGetString(pJson, pName, nameLen), ':');
+        if (!pJson)
+            break;
 
-        // Get value
-        if (fieldDef._dataType.equalsIgnoreCase("bool"))
+        // Find field
+        bool fieldFound = false;
+        for (const FieldDef& fieldDef : FIELD_DEFS)
         {
-            bool fieldVal = cmdJson.getBool(fieldDef._name.c_str(), 0);
-            *((bool*)fieldDef._pValue) = fieldVal;
+            if (jsonStrEquals(pName, nameLen, fieldDef._name))
+            {
+                double fieldVal = 0;
+                pJson = jsonGetNumber(pJson, fieldVal);
+                if (pJson)
+                    setField(fieldDef._id, fieldVal);
+                fieldFound = true;
+                break;
+            }
         }
-        else if (fieldDef._dataType.equalsIgnoreCase("double"))
+        if (!fieldFound)
         {
-            double fieldVal = cmdJson.getDouble(fieldDef._name.c_str(), 0);
-            *((double*)fieldDef._pValue) = fieldVal;
+            if (jsonStrEquals(pName, nameLen, "pos"))
+                pJson = parsePosJSON(pJson);
+            else if (jsonStrEquals(pName, nameLen, "endstops"))
+                pJson = parseEndstopsJSON(pJson);
+            else
+                pJson = jsonSkipValue(pJson);
         }
-    }
 
-    // Extract endstops
-    _endstops.fromJSON(cmdJson, "endstops");
+        // Next field
+        pJson = jsonSkipWS(pJson);
+        if (pJson && (*pJson == '}'))
+            return true;
+        pJson = jsonExpect(pJson, ',');
+    }
+#ifdef DEBUG_MOTION_ARGS
+    LOG_W(MODULE_PREFIX, "fromJSON invalid JSON %s", jsonStr ? jsonStr : "");
+#endif
+    return false;
+}
 
-    // Extract position
-    std::vector<String> posList;
-    cmdJson.getArrayElems("pos", posList);
-    _axesPos.clear();
-    for (const RaftJson pos : posList)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Parse position array in-place
+/// @param pJson Pointer to the array in the form [{"a":<axisIdx>,"p":<pos>},...]
+/// @return Pointer to the character following the array or nullptr if invalid
+const char* MotionArgs::parsePosJSON(const char* pJson)
+{
+    pJson = jsonExpect(pJson, '[');
+    if (pJson && (*pJson == ']'))
+        return pJson + 1;
+    while (pJson)
     {
-        int32_t axisIdx = pos.getLong("a", -1);
-        double axisPos = pos.getDouble("p", 0);        
+        // Axis object
+        int32_t axisIdx = -1;
+        double axisPos = 0;
+        pJson = jsonExpect(pJson, '{');
+        while (pJson && (*pJson != '}'))
+        {
+            const char* pName = nullptr;
+            uint32_t nameLen = 0;
+            pJson = jsonExpect(jsonGetString(pJson, pName, nameLen), ':');
+            if (pJson && (jsonStrEquals(pName, nameLen, "a") || jsonStrEquals(pName, nameLen, "p")))
+            {
+                double val = 0;
+                pJson = jsonGetNumber(pJson, val);
+                if (*pName == 'a')
+                    axisIdx = int32_t(val);
+                else
+                    axisPos = val;
+            }
+            else
+            {
+                pJson = jsonSkipValue(pJson);
+            }
+            pJson = jsonSkipWS(pJson);
+            if (pJson && (*pJson == ','))
+                pJson = jsonSkipWS(pJson + 1);
+        }
+        if (!pJson)
+            return nullptr;
 #ifdef DEBUG_MOTION_ARGS
-        LOG_I(MODULE_PREFIX, "fromJSON %s pos %s axisIdx: %d, axisPos: %.2f", cmdJson.getJsonDoc(), pos.getJsonDoc(), axisIdx, axisPos);
+        LOG_I(MODULE_PREFIX, "fromJSON pos axisIdx: %d, axisPos: %.2f", (int)axisIdx, axisPos);
 #endif
-        _axesPos.setVal(axisIdx, axisPos);
-        _axesSpecified.setVal(axisIdx, true);
+        if ((axisIdx >= 0) && (uint32_t(axisIdx) < AXIS_VALUES_MAX_AXES))
+        {
+            _axesPos.setVal(axisIdx, axisPos);
+            _axesSpecified.setVal(axisIdx, true);
+        }
+
+        // Next axis
+        pJson = jsonSkipWS(pJson + 1);
+        if (*pJson == ']')
+            return pJson + 1;
+        pJson = jsonExpect(pJson, ',');
     }
+    return nullptr;
 }
 
-String MotionArgs::toJSON()
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Parse endstops array in-place
+/// @param pJson Pointer to the array in the form [["<min>","<max>"],...] with one element per axis
+/// @return Pointer to the character following the array or nullptr if invalid
+const char* MotionArgs::parseEndstopsJSON(const char* pJson)
 {
-    // Get field definitions
-    std::vector<FieldDefType> fieldDefs = getFieldDefs();
-
-    // Output string
-    String jsonStr;
-
-    // Expand fields
-    for (auto &fieldDef : fieldDefs)
+    pJson = jsonExpect(pJson, '[');
+    if (pJson && (*pJson == ']'))
+        return pJson + 1;
+    uint32_t axisIdx = 0;
+    while (pJson)
     {
-        // Get value
-        if (fieldDef._dataType.equalsIgnoreCase("bool"))
+        // Endstops for axis (any not specified are set to none)
+        pJson = jsonExpect(pJson, '[');
+        uint32_t endstopIdx = 0;
+        while (pJson && (*pJson != ']'))
         {
-            jsonStr += "\"" + fieldDef._name + "\":" + String(*((bool*)fieldDef._pValue)) + ",";
-        }
-        else if (fieldDef._dataType.equalsIgnoreCase("double"))
-        {
-            jsonStr += "\"" + fieldDef._name + "\":" + String(*((double*)fieldDef._pValue)) + ",";
+            const char* pStr = nullptr;
+            uint32_t strLen = 0;
+            pJson = jsonSkipWS(jsonGetString(pJson, pStr, strLen));
+            if (pJson && (axisIdx < AxisEndstopChecks::MAX_AXIS_INDEX) && (endstopIdx < AXIS_VALUES_MAX_ENDSTOPS_PER_AXIS))
+                _endstops.set(axisIdx, endstopIdx, pStr, strLen);
+            endstopIdx++;
+            if (pJson && (*pJson == ','))
+                pJson = jsonSkipWS(pJson + 1);
         }
+        if (!pJson)
+            return nullptr;
+        for (; (axisIdx < AxisEndstopChecks::MAX_AXIS_INDEX) && (endstopIdx < AXIS_VALUES_MAX_ENDSTOPS_PER_AXIS); endstopIdx++)
+            _endstops.set(axisIdx, endstopIdx, AxisEndstopChecks::END_STOP_NONE);
+        axisIdx++;
+
+        // Next axis
+        pJson = jsonSkipWS(pJson + 1);
+        if (*pJson == ']')
+            return pJson + 1;
+        pJson = jsonExpect(pJson, ',');
     }
+    return nullptr;
+}
 
-    // Expand endstops
-    jsonStr += _endstops.toJSON("endstops");
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Write JSON into a buffer
+/// @param pBuf Buffer to write into (null terminated on success)
+/// @param bufMaxLen Size of buffer (JSON_MAX_LEN is always sufficient)
+/// @return Length of JSON written (0 if the buffer is too small)
+uint32_t MotionArgs::toJSON(char* pBuf, uint32_t bufMaxLen) const
+{
+    uint32_t len = 0;
+    auto append = [&](const char* pFormat, auto... args) {
+        if (len >= bufMaxLen)
+            return;
+        int rslt = snprintf(pBuf + len, bufMaxLen - len, pFormat, args...);
+        len = rslt < 0 ? bufMaxLen : len + rslt;
+    };
 
-    // Expand position
-    jsonStr += ",\"pos\":[";
-    bool firstAxis = true;
-    for (int32_t axisIdx = 0; axisIdx < MULTISTEPPER_MAX_AXES; axisIdx++)
+    // Fields
+    append("{");
+    for (const FieldDef& fieldDef : FIELD_DEFS)
     {
-        if (!firstAxis)
+        double fieldVal = getField(fieldDef._id);
+        switch (fieldDef._type)
         {
-            jsonStr += ",";
+            case FIELD_TYPE_BOOL: append("\"%s\":%d,", fieldDef._name, fieldVal != 0 ? 1 : 0); break;
+            case FIELD_TYPE_DOUBLE: append("\"%s\":%.3f,", fieldDef._name, fieldVal); break;
+            case FIELD_TYPE_UINT32: append("\"%s\":%u,", fieldDef._name, (unsigned)fieldVal); break;
         }
-        firstAxis = false;
-        jsonStr += "{\"a\":" + String(axisIdx) + ",\"p\":" + String(_axesPos.getVal(axisIdx)) + "}";
     }
-    jsonStr += "]";
-    return "{" + jsonStr + "}";
+
+    // Endstops
+    append("\"endstops\":[");
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        append(axisIdx == 0 ? "[" : ",[");
+        for (uint32_t endstopIdx = 0; endstopIdx < AXIS_VALUES_MAX_ENDSTOPS_PER_AXIS; endstopIdx++)
+            append(endstopIdx == 0 ? "\"%s\"" : ",\"%s\"", AxisEndstopChecks::getCStr(_endstops.get(axisIdx, endstopIdx)));
+        append("]");
+    }
+
+    // Position
+    append("],\"pos\":[");
+    for (uint32_t axisIdx = 0; axisIdx < MULTISTEPPER_MAX_AXES; axisIdx++)
+        append(axisIdx == 0 ? "{\"a\":%d,\"p\":%.3f}" : ",{\"a\":%d,\"p\":%.3f}", (int)axisIdx, (double)_axesPos.getVal(axisIdx));
+    append("]}");
+    return len < bufMaxLen ? len : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get JSON string
+/// @return JSON string (mainly for debugging - use toJSON with a buffer to avoid allocation)
+String MotionArgs::toJSON() const
+{
+    char jsonBuf[JSON_MAX_LEN];
+    if (toJSON(jsonBuf, sizeof(jsonBuf)) == 0)
+        return "{}";
+    return jsonBuf;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Big-endian helpers for binary serialization
+static inline uint32_t getBEUInt32(const uint8_t* pData)
+{
+    return (uint32_t(pData[0]) << 24) | (uint32_t(pData[1]) << 16) | (uint32_t(pData[2]) << 8) | pData[3];
+}
+static inline float getBEFloat32(const uint8_t* pData)
+{
+    uint32_t rawVal = getBEUInt32(pData);
+    float val = 0;
+    memcpy(&val, &rawVal, sizeof(val));
+    return val;
+}
+static inline void setBEUInt32(uint8_t* pBuf, uint32_t val)
+{
+    pBuf[0] = (val >> 24) & 0xff;
+    pBuf[1] = (val >> 16) & 0xff;
+    pBuf[2] = (val >> 8) & 0xff;
+    pBuf[3] = val & 0xff;
+}
+static inline void setBEFloat32(uint8_t* pBuf, float val)
+{
+    uint32_t rawVal = 0;
+    memcpy(&rawVal, &val, sizeof(rawVal));
+    setBEUInt32(pBuf, rawVal);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set from binary MoveTo record
+/// @param pData Pointer to the record
+/// @param dataLen Length of the data (must be at least MULTISTEPPER_MOVETO_RECORD_SIZE)
+/// @return true if the record is valid
+/// @note This doesn't allocate memory so can be used for high rate streaming
+bool MotionArgs::fromBinary(const uint8_t* pData, uint32_t dataLen)
+{
+    // Check length and format
+    if ((dataLen < MULTISTEPPER_MOVETO_RECORD_SIZE) || 
+                (pData[MULTISTEPPER_MOVETO_BINARY_FORMAT_POS] != MULTISTEPPER_MOTION_ARGS_BINARY_FORMAT_1))
+        return false;
+    clear();
+
+    // Flags
+    uint32_t flags = (uint32_t(pData[MULTISTEPPER_MOVETO_FLAGS_POS]) << 8) | pData[MULTISTEPPER_MOVETO_FLAGS_POS + 1];
+    _isRelative = flags & MULTISTEPPER_MOVETO_FLAG_RELATIVE;
+    _rampedMotion = flags & MULTISTEPPER_MOVETO_FLAG_RAMPED;
+    _unitsAreSteps = flags & MULTISTEPPER_MOVETO_FLAG_UNITS_STEPS;
+    _dontSplitMove = flags & MULTISTEPPER_MOVETO_FLAG_NO_SPLIT;
+    _targetSpeedValid = flags & MULTISTEPPER_MOVETO_FLAG_SPEED_VALID;
+    _moreMovesComing = flags & MULTISTEPPER_MOVETO_FLAG_MORE_MOVES;
+    _motionTrackingIndexValid = flags & MULTISTEPPER_MOVETO_FLAG_IDX_VALID;
+    _feedrateUnitsPerMin = flags & MULTISTEPPER_MOVETO_FLAG_FEED_PER_MIN;
+    _enableMotors = flags & MULTISTEPPER_MOVETO_FLAG_ENABLE_MOTORS;
+    _preClearMotionQueue = flags & MULTISTEPPER_MOVETO_FLAG_CLEAR_QUEUE;
+    _stopMotion = flags & MULTISTEPPER_MOVETO_FLAG_STOP;
+    _constrainToBounds = flags & MULTISTEPPER_MOVETO_FLAG_CONSTRAIN;
+    _isHoming = flags & MULTISTEPPER_MOVETO_FLAG_HOMING;
+    _moveRapid = flags & MULTISTEPPER_MOVETO_FLAG_RAPID;
+    _moveClockwise = flags & MULTISTEPPER_MOVETO_FLAG_CLOCKWISE;
+    _isVelocity = flags & MULTISTEPPER_MOVETO_FLAG_VELOCITY;
+
+    // Values
+    _targetSpeed = getBEFloat32(pData + MULTISTEPPER_MOVETO_SPEED_POS);
+    _feedrate = getBEFloat32(pData + MULTISTEPPER_MOVETO_FEEDRATE_POS);
+    _motionTrackingIdx = getBEUInt32(pData + MULTISTEPPER_MOVETO_TRACKING_IDX_POS);
+    _endstops.setRawValue(getBEUInt32(pData + MULTISTEPPER_MOVETO_ENDSTOPS_POS));
+
+    // Axes
+    uint32_t axesCount = pData[MULTISTEPPER_MOVETO_AXES_COUNT_POS];
+    uint32_t axesMask = pData[MULTISTEPPER_MOVETO_AXES_MASK_POS];
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        bool isSpecified = (axisIdx < axesCount) && (axisIdx < MULTISTEPPER_MAX_AXES) && 
+                    ((axesMask == 0) || (axesMask & (1 << axisIdx)));
+        _axesSpecified.setVal(axisIdx, isSpecified);
+        if (isSpecified)
+            _axesPos.setVal(axisIdx, getBEFloat32(pData + MULTISTEPPER_MOVETO_AXES_START_POS + 
+                        axisIdx * MULTISTEPPER_MOVETO_AXES_BLOCK_SIZE));
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Write binary MoveTo record
+/// @param pBuf Buffer to write to
+/// @param bufMaxLen Size of buffer
+/// @return Number of bytes written (MULTISTEPPER_MOVETO_RECORD_SIZE or 0 if the buffer is too small)
+uint32_t MotionArgs::toBinary(uint8_t* pBuf, uint32_t bufMaxLen) const
+{
+    if (bufMaxLen < MULTISTEPPER_MOVETO_RECORD_SIZE)
+        return 0;
+    memset(pBuf, 0, MULTISTEPPER_MOVETO_RECORD_SIZE);
+
+    // Format and axes
+    pBuf[MULTISTEPPER_MOVETO_BINARY_FORMAT_POS] = MULTISTEPPER_MOTION_ARGS_BINARY_FORMAT_1;
+    uint32_t axesCount = AXIS_VALUES_MAX_AXES < MULTISTEPPER_MAX_AXES ? AXIS_VALUES_MAX_AXES : MULTISTEPPER_MAX_AXES;
+    pBuf[MULTISTEPPER_MOVETO_AXES_COUNT_POS] = axesCount;
+    uint32_t axesMask = 0;
+    for (uint32_t axisIdx = 0; axisIdx < axesCount; axisIdx++)
+    {
+        if (_axesSpecified.getVal(axisIdx))
+            axesMask |= 1 << axisIdx;
+        setBEFloat32(pBuf + MULTISTEPPER_MOVETO_AXES_START_POS + axisIdx * MULTISTEPPER_MOVETO_AXES_BLOCK_SIZE,
+                    _axesPos.getVal(axisIdx));
+    }
+    // A mask of 0 means all axes so ensure at least one bit is set if no axes specified
+    pBuf[MULTISTEPPER_MOVETO_AXES_MASK_POS] = axesMask != 0 ? axesMask : 0x80;
+
+    // Flags
+    uint32_t flags = (_isRelative ? MULTISTEPPER_MOVETO_FLAG_RELATIVE : 0) |
+                (_rampedMotion ? MULTISTEPPER_MOVETO_FLAG_RAMPED : 0) |
+                (_unitsAreSteps ? MULTISTEPPER_MOVETO_FLAG_UNITS_STEPS : 0) |
+                (_dontSplitMove ? MULTISTEPPER_MOVETO_FLAG_NO_SPLIT : 0) |
+                (_targetSpeedValid ? MULTISTEPPER_MOVETO_FLAG_SPEED_VALID : 0) |
+                (_moreMovesComing ? MULTISTEPPER_MOVETO_FLAG_MORE_MOVES : 0) |
+                (_motionTrackingIndexValid ? MULTISTEPPER_MOVETO_FLAG_IDX_VALID : 0) |
+                (_feedrateUnitsPerMin ? MULTISTEPPER_MOVETO_FLAG_FEED_PER_MIN : 0) |
+                (_enableMotors ? MULTISTEPPER_MOVETO_FLAG_ENABLE_MOTORS : 0) |
+                (_preClearMotionQueue ? MULTISTEPPER_MOVETO_FLAG_CLEAR_QUEUE : 0) |
+                (_stopMotion ? MULTISTEPPER_MOVETO_FLAG_STOP : 0) |
+                (_constrainToBounds ? MULTISTEPPER_MOVETO_FLAG_CONSTRAIN : 0) |
+                (_isHoming ? MULTISTEPPER_MOVETO_FLAG_HOMING : 0) |
+                (_moveRapid ? MULTISTEPPER_MOVETO_FLAG_RAPID : 0) |
+                (_moveClockwise ? MULTISTEPPER_MOVETO_FLAG_CLOCKWISE : 0) |
+                (_isVelocity ? MULTISTEPPER_MOVETO_FLAG_VELOCITY : 0);
+    pBuf[MULTISTEPPER_MOVETO_FLAGS_POS] = (flags >> 8) & 0xff;
+    pBuf[MULTISTEPPER_MOVETO_FLAGS_POS + 1] = flags & 0xff;
+
+    // Values
+    setBEFloat32(pBuf + MULTISTEPPER_MOVETO_SPEED_POS, _targetSpeed);
+    setBEFloat32(pBuf + MULTISTEPPER_MOVETO_FEEDRATE_POS, _feedrate);
+    setBEUInt32(pBuf + MULTISTEPPER_MOVETO_TRACKING_IDX_POS, _motionTrackingIdx);
+    setBEUInt32(pBuf + MULTISTEPPER_MOVETO_ENDSTOPS_POS, _endstops.getRawValue());
+    return MULTISTEPPER_MOVETO_RECORD_SIZE;
 }
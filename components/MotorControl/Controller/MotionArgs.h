@@ -46,13 +46,20 @@ public:
         _preClearMotionQueue = false;
         _stopMotion = false; 
         _constrainToBounds = false;    
+        _isArc = false;
+        _startTimeValid = false;
+        _isVelocity = false;
 
         // Reset values to sensible levels
         _targetSpeed = 0;
         _feedrate = 100.0;
         _extrudeDistance = 1;
         _motionTrackingIdx = 0;
+        _arcCentreOffsetI = 0;
+        _arcCentreOffsetJ = 0;
+        _startTimeUs = 0;
         _axesPos.clear();
+        _axesSpecified.clear();
     }
 
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -87,7 +94,7 @@ public:
     {
         _moveRapid = flag;
     }
-    bool isMoveRapid()
+    bool isMoveRapid() const
     {
         return _moveRapid;
     }
@@ -95,7 +102,7 @@ public:
     {
         _moveClockwise = flag;
     }
-    bool isMoveClockwise()
+    bool isMoveClockwise() const
     {
         return _moveClockwise;
     }
@@ -150,6 +157,14 @@ public:
         return _axesSpecified;
     }
 
+    ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    /// @brief Get axes specified const
+    /// @return const AxesValues<AxisSpecifiedDataType>&
+    const AxesValues<AxisSpecifiedDataType>& getAxesSpecifiedConst() const
+    {
+        return _axesSpecified;
+    }
+
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
     /// @brief Set axes positions
     /// @param axisPositions AxesValues<AxisPosDataType>
@@ -219,6 +234,45 @@ public:
         return _extrudeDistance;
     }    
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    // Arc (in the plane of axes 0 and 1 - the centre is offset from the start position and the direction is
+    // set by setClockwise)
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void setArc(AxisPosDataType centreOffsetI, AxisPosDataType centreOffsetJ, bool clockwise)
+    {
+        _arcCentreOffsetI = centreOffsetI;
+        _arcCentreOffsetJ = centreOffsetJ;
+        _moveClockwise = clockwise;
+        _isArc = true;
+    }
+    bool isArc() const
+    {
+        return _isArc;
+    }
+    AxisPosDataType getArcCentreOffsetI() const
+    {
+        return _arcCentreOffsetI;
+    }
+    AxisPosDataType getArcCentreOffsetJ() const
+    {
+        return _arcCentreOffsetJ;
+    }
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    // Velocity (jog) mode - the axis values are target velocities (units or steps per second) and the axes
+    // accelerate to them and keep moving until retargeted (unspecified axes keep their targets)
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void setVelocityMode(bool flag)
+    {
+        _isVelocity = flag;
+    }
+    bool isVelocityMode() const
+    {
+        return _isVelocity;
+    }
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     // Motion tracking
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -228,6 +282,10 @@ public:
         _motionTrackingIdx = motionTrackingIdx;
         _motionTrackingIndexValid = true;
     }
+    void clearMotionTrackingIndex()
+    {
+        _motionTrackingIndexValid = false;
+    }
     bool isMotionTrackingIndexValid() const
     {
         return _motionTrackingIndexValid;
@@ -237,6 +295,29 @@ public:
         return _motionTrackingIdx;
     }
 
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    // Scheduled start time (shared timebase us - see RampGenTimebase) - the move starts from a standstill
+    // at this time
+    /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void setStartTimeUs(uint32_t startTimeUs)
+    {
+        _startTimeUs = startTimeUs;
+        _startTimeValid = true;
+    }
+    void clearStartTime()
+    {
+        _startTimeValid = false;
+    }
+    bool isStartTimeValid() const
+    {
+        return _startTimeValid;
+    }
+    uint32_t getStartTimeUs() const
+    {
+        return _startTimeUs;
+    }
+
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     // Hint that more movement is expected (allows optimization of pipeline processing)
     /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -284,8 +365,22 @@ public:
         return _endstops;
     }
 
-    void fromJSON(const char* jsonStr);
-    String toJSON();
+    // JSON serialization
+    // fromJSON parses in-place without allocating and returns false if the JSON is malformed (fields
+    // parsed before the error are retained), toJSON writes into the caller's buffer and returns the
+    // length written (0 if the buffer is too small)
+    bool fromJSON(const char* jsonStr);
+    uint32_t toJSON(char* pBuf, uint32_t bufMaxLen) const;
+    String toJSON() const;
+
+    // Max length of JSON from toJSON
+    static constexpr uint32_t JSON_MAX_LEN = 768;
+
+    // Binary serialization (MoveTo record in MULTISTEPPER_MOTION_ARGS_BINARY_FORMAT_1)
+    // fromBinary returns false if the record is invalid, toBinary returns the number of bytes written (0 if
+    // the buffer is too small)
+    bool fromBinary(const uint8_t* pData, uint32_t dataLen);
+    uint32_t toBinary(uint8_t* pBuf, uint32_t bufMaxLen) const;
 
 private:
 
@@ -309,21 +404,68 @@ private:
     bool _preClearMotionQueue = false;
     bool _stopMotion = false;
     bool _constrainToBounds = false;
-
-    // Boolean flags
-    class FieldDefType {
-    public:
-        FieldDefType(const char* name, void* pValue, const char* dataType)
-        {
-            _name = name;
-            _pValue = pValue;
-            _dataType = dataType;
-        }
-        String _name;
-        void* _pValue;
-        String _dataType;
+    bool _isArc = false;
+    bool _startTimeValid = false;
+    bool _isVelocity = false;
+
+    // Field definitions for JSON serialization
+    // Fields are accessed through setField/getField rather than by pointer since members of this packed
+    // structure may not be aligned
+    enum FieldId : uint8_t
+    {
+        FIELD_REL, FIELD_RAMPED, FIELD_STEPS, FIELD_NOSPLIT, FIELD_EXDIST_OK, FIELD_SPEED_OK, FIELD_CW,
+        FIELD_RAPID, FIELD_MORE, FIELD_HOMING, FIELD_IDX_OK, FIELD_FEED_PER_MIN, FIELD_SPEED, FIELD_EXDIST,
+        FIELD_FEEDRATE, FIELD_IDX, FIELD_EN, FIELD_AMPS_PC_OF_MAX, FIELD_CLEARQ, FIELD_STOP, FIELD_CONSTRAIN,
+        FIELD_ARC, FIELD_ARC_I, FIELD_ARC_J, FIELD_START_OK, FIELD_START_US,
+        FIELD_VELOCITY
+    };
+    enum FieldType : uint8_t
+    {
+        FIELD_TYPE_BOOL,
+        FIELD_TYPE_DOUBLE,
+        FIELD_TYPE_UINT32
     };
-    std::vector<FieldDefType> getFieldDefs();
+    struct FieldDef
+    {
+        const char* _name;
+        FieldId _id;
+        FieldType _type;
+    };
+    static constexpr FieldDef FIELD_DEFS[] = {
+        {"rel", FIELD_REL, FIELD_TYPE_BOOL},
+        {"ramped", FIELD_RAMPED, FIELD_TYPE_BOOL},
+        {"steps", FIELD_STEPS, FIELD_TYPE_BOOL},
+        {"nosplit", FIELD_NOSPLIT, FIELD_TYPE_BOOL},
+        {"exDistOk", FIELD_EXDIST_OK, FIELD_TYPE_BOOL},
+        {"speedOk", FIELD_SPEED_OK, FIELD_TYPE_BOOL},
+        {"cw", FIELD_CW, FIELD_TYPE_BOOL},
+        {"rapid", FIELD_RAPID, FIELD_TYPE_BOOL},
+        {"more", FIELD_MORE, FIELD_TYPE_BOOL},
+        {"homing", FIELD_HOMING, FIELD_TYPE_BOOL},
+        {"idxOk", FIELD_IDX_OK, FIELD_TYPE_BOOL},
+        {"feedPerMin", FIELD_FEED_PER_MIN, FIELD_TYPE_BOOL},
+        {"speed", FIELD_SPEED, FIELD_TYPE_DOUBLE},
+        {"exDist", FIELD_EXDIST, FIELD_TYPE_DOUBLE},
+        {"feedrate", FIELD_FEEDRATE, FIELD_TYPE_DOUBLE},
+        {"idx", FIELD_IDX, FIELD_TYPE_UINT32},
+        {"en", FIELD_EN, FIELD_TYPE_BOOL},
+        {"ampsPCofMax", FIELD_AMPS_PC_OF_MAX, FIELD_TYPE_DOUBLE},
+        {"clearQ", FIELD_CLEARQ, FIELD_TYPE_BOOL},
+        {"stop", FIELD_STOP, FIELD_TYPE_BOOL},
+        {"constrain", FIELD_CONSTRAIN, FIELD_TYPE_BOOL},
+        {"arc", FIELD_ARC, FIELD_TYPE_BOOL},
+        {"arcI", FIELD_ARC_I, FIELD_TYPE_DOUBLE},
+        {"arcJ", FIELD_ARC_J, FIELD_TYPE_DOUBLE},
+        {"startOk", FIELD_START_OK, FIELD_TYPE_BOOL},
+        {"startUs", FIELD_START_US, FIELD_TYPE_UINT32},
+        {"velocity", FIELD_VELOCITY, FIELD_TYPE_BOOL},
+    };
+    void setField(FieldId fieldId, double val);
+    double getField(FieldId fieldId) const;
+
+    // In-place JSON parsing helpers
+    const char* parsePosJSON(const char* pJson);
+    const char* parseEndstopsJSON(const char* pJson);
 
     // Target speed (like an absolute feedrate)
     double _targetSpeed = 0;
@@ -340,6 +482,13 @@ private:
     // Motion tracking index - used to track execution of motion requests
     uint32_t _motionTrackingIdx = 0;
 
+    // Arc centre offset from start position (axes 0 and 1)
+    AxisPosDataType _arcCentreOffsetI = 0;
+    AxisPosDataType _arcCentreOffsetJ = 0;
+
+    // Scheduled start time (shared timebase us)
+    uint32_t _startTimeUs = 0;
+
     // End stops
     AxisEndstopChecks _endstops;
 
@@ -8,6 +8,8 @@
 
 #include "MotionBlockManager.h"
 #include "RaftKinematicsSystem.h"
+#include "MotionPerfCounters.h"
+#include "RaftUtils.h"
 
 #define DEBUG_RAMPED_BLOCK
 #define DEBUG_COORD_UPDATES
@@ -18,10 +20,13 @@
 /// @param motorEnabler object to enable/disable motors
 /// @param axesParams parameters for the axes
 MotionBlockManager::MotionBlockManager(MotorEnabler& motorEnabler, AxesParams& axesParams)
-                :   _motionPlanner(axesParams),
+                :   _stagedBlockPosn(0),
+                    _motionPlanner(axesParams),
                     _motorEnabler(motorEnabler), 
                     _axesParams(axesParams)
 {
+    _stagedBlocks.resize(STAGE_LEN_DEFAULT);
+    _stagedBlockPosn.init(_stagedBlocks.size());
     clear();
 }
 
@@ -39,21 +44,47 @@ void MotionBlockManager::clear()
 {
     _numBlocks = 0;
     _nextBlockIdx = 0;
+    _isArc = false;
+    _isAdaptiveSplit = false;
+    _stagedBlockPosn.clear();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Setup
 /// @param stepGenPeriodUs Period of the step generator in microseconds
+/// @param accelTickNs Period at which acceleration is applied in nanoseconds
 /// @param motionConfig JSON configuration
-void MotionBlockManager::setup(uint32_t stepGenPeriodUs, const RaftJsonIF& motionConfig)
+void MotionBlockManager::setup(uint32_t stepGenPeriodUs, uint32_t accelTickNs, const RaftJsonIF& motionConfig)
 {
     // Motion Pipeline and Planner
-    _motionPlanner.setup(stepGenPeriodUs);
+    _motionPlanner.setup(stepGenPeriodUs, accelTickNs);
 
     // Set geometry
     if (_pRaftKinematics)
         delete _pRaftKinematics;
     _pRaftKinematics = RaftKinematicsSystem::createKinematics(motionConfig);
+
+    // Coalescing of collinear moves (only for linear geometries where the actuators moving in proportion give a
+    // straight line) - the merged length is limited to the max block distance if there is one
+    float coalesceMinCos = motionConfig.getDouble("coalesceMinCos", 0);
+    float coalesceMaxDistMM = motionConfig.getDouble("coalesceMaxMM", COALESCE_MAX_DIST_MM_DEFAULT);
+    if ((_axesParams.getMaxBlockDistMM() > 0.01f) && (coalesceMaxDistMM > _axesParams.getMaxBlockDistMM()))
+        coalesceMaxDistMM = _axesParams.getMaxBlockDistMM();
+    AxesValues<AxisPosDataType> testPt;
+    AxisDistDataType deviationMM = 0;
+    bool isLinearGeometry = _pRaftKinematics && 
+                !_pRaftKinematics->estimateLinearDeviation(testPt, testPt, _axesState, _axesParams, deviationMM);
+    if (!isLinearGeometry && (coalesceMinCos > 0))
+    {
+        LOG_W(MODULE_PREFIX, "setup coalescing not supported for non-linear geometry");
+        coalesceMinCos = 0;
+    }
+    _motionPlanner.setCoalescing(coalesceMinCos, coalesceMaxDistMM);
+
+    // Staging of split blocks (number of blocks staged ahead of the planner)
+    uint32_t stageLen = UTILS_MAX(uint32_t(motionConfig.getLong("stageLen", STAGE_LEN_DEFAULT)), 1);
+    _stagedBlocks.resize(stageLen);
+    _stagedBlockPosn.init(_stagedBlocks.size());
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -83,10 +114,27 @@ bool MotionBlockManager::addNonRampedBlock(MotionArgs& args, MotionPipelineIF& m
 bool MotionBlockManager::addRampedBlock(const MotionArgs& args, uint32_t numBlocks)
 {
     _blockMotionArgs = args;
+    _blockMotionTrackingIdxValid = args.isMotionTrackingIndexValid();
+    _isArc = false;
     _numBlocks = numBlocks;
     _nextBlockIdx = 0;
     _finalTargetPos = args.getAxesPosConst();
-    _blockMotionVector = (_finalTargetPos - _axesState.getUnitsFromOrigin()) / double(numBlocks);
+    _splitStartPos = _axesState.getUnitsFromOrigin();
+    _stagedBlockPosn.clear();
+    _stagingAxesState = _axesState;
+    _blockMotionVector = (_finalTargetPos - _splitStartPos) / double(numBlocks);
+
+    // Non-linear geometries can be split adaptively (the block count is then only an estimate)
+    _isAdaptiveSplit = false;
+    AxisDistDataType deviationMM = 0;
+    if ((_axesParams.getMaxLinearDeviationMM() > 0) && !args.dontSplitMove() && _pRaftKinematics &&
+            _pRaftKinematics->estimateLinearDeviation(_axesState.getUnitsFromOrigin(), _finalTargetPos, 
+                        _axesState, _axesParams, deviationMM))
+    {
+        _isAdaptiveSplit = true;
+        _splitCurPos = _axesState.getUnitsFromOrigin();
+        _adaptiveSplitMaxDistMM = _axesParams.getMaxBlockDistMM() > 0.01f ? _axesParams.getMaxBlockDistMM() : 0;
+    }
 
 #ifdef DEBUG_RAMPED_BLOCK
     LOG_I(MODULE_PREFIX, "addRampedBlock curUnits %s curSteps %s targetPosUnits %s numBlocks %d blockMotionVector %s)",
@@ -101,77 +149,303 @@ bool MotionBlockManager::addRampedBlock(const MotionArgs& args, uint32_t numBloc
 }
 
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add an arc which is split up into segments in the block splitter
+/// @param args Motion arguments including end position, centre offset and direction
+/// @return true if successful
+/// @note The arc is in the plane of axes 0 and 1 - other axes move linearly (helical motion). The number of
+///       segments is chosen to keep the chord within tolerance of the arc (and within the max block distance).
+///       If the end position is the start position a full circle is performed
+bool MotionBlockManager::addArcBlock(const MotionArgs& args)
+{
+    // Centre and radius
+    AxesValues<AxisPosDataType> startPos = _axesState.getUnitsFromOrigin();
+    _arcCentre[0] = startPos.getVal(0) + args.getArcCentreOffsetI();
+    _arcCentre[1] = startPos.getVal(1) + args.getArcCentreOffsetJ();
+    _arcRadiusVec[0] = -args.getArcCentreOffsetI();
+    _arcRadiusVec[1] = -args.getArcCentreOffsetJ();
+    _arcRadius = sqrtf(_arcRadiusVec[0] * _arcRadiusVec[0] + _arcRadiusVec[1] * _arcRadiusVec[1]);
+    if (_arcRadius < MotionBlock::MINIMUM_MOVE_DIST_MM)
+    {
+        LOG_W(MODULE_PREFIX, "addArcBlock radius too small %f", _arcRadius);
+        return false;
+    }
+
+    // Angle travelled (negative when clockwise)
+    const float twoPi = 2 * 3.14159265F;
+    AxesValues<AxisPosDataType> endPos = args.getAxesPosConst();
+    float endVec[2] = { endPos.getVal(0) - _arcCentre[0], endPos.getVal(1) - _arcCentre[1] };
+    float arcAngle = atan2f(_arcRadiusVec[0] * endVec[1] - _arcRadiusVec[1] * endVec[0],
+                _arcRadiusVec[0] * endVec[0] + _arcRadiusVec[1] * endVec[1]);
+    if (args.isMoveClockwise())
+    {
+        if (arcAngle >= 0)
+            arcAngle -= twoPi;
+    }
+    else if (arcAngle <= 0)
+    {
+        arcAngle += twoPi;
+    }
+
+    // Number of segments to keep chord deviation within tolerance (segment angle limited to a quarter turn)
+    float chordTol = _axesParams.getArcChordToleranceMM();
+    float segAngleMax = twoPi / 4;
+    if (chordTol < _arcRadius)
+        segAngleMax = fminf(2 * acosf(1 - chordTol / _arcRadius), segAngleMax);
+    uint32_t numSegs = uint32_t(ceilf(fabsf(arcAngle) / segAngleMax));
+    float maxBlockDistMM = _axesParams.getMaxBlockDistMM();
+    if ((maxBlockDistMM > 0.01f) && !args.dontSplitMove())
+        numSegs = UTILS_MAX(numSegs, uint32_t(ceilf(fabsf(arcAngle) * _arcRadius / maxBlockDistMM)));
+    numSegs = UTILS_MIN(UTILS_MAX(numSegs, 1), ARC_MAX_SEGMENTS);
+
+    // Incremental rotation
+    _arcStartAngle = atan2f(_arcRadiusVec[1], _arcRadiusVec[0]);
+    _arcSegAngle = arcAngle / numSegs;
+    _arcSegCos = cosf(_arcSegAngle);
+    _arcSegSin = sinf(_arcSegAngle);
+
+    // Setup the splitter - axes other than 0 and 1 move linearly
+    addRampedBlock(args, numSegs);
+    _isArc = true;
+
+#ifdef DEBUG_RAMPED_BLOCK
+    LOG_I(MODULE_PREFIX, "addArcBlock centre %.3f,%.3f radius %.3f angle %.3f numSegs %d", 
+                _arcCentre[0], _arcCentre[1], _arcRadius, arcAngle, numSegs);
+#endif
+    return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Pump the block splitter - should be called regularly 
 /// @param motionPipeline Motion pipeline to add the block to
-/// @note This is used to manage splitting of a single moveTo command into multiple blocks
-void MotionBlockManager::pumpBlockSplitter(MotionPipelineIF& motionPipeline)
+/// @param budgetUs Time budget for the call in microseconds (0 for no limit)
+/// @note This is used to manage splitting of a single moveTo command into multiple blocks - staged blocks are
+///       added to the planner while the pipeline can accept them and then further blocks are staged with the
+///       time left (when the budget runs out the rest is left for the next call but at least one block is added)
+void MotionBlockManager::pumpBlockSplitter(MotionPipelineIF& motionPipeline, uint32_t budgetUs)
 {
+    // Check if any blocks remain to be expanded out
+    if (!isBusy())
+        return;
+    uint32_t startUs = micros();
+    MotionPerfCounters::ScopedTimer perfTimer(MotionPerfCounters::TIMER_SPLITTER_PUMP);
+
     // Check if we can add anything to the pipeline
-    while (motionPipeline.canAccept())
+    if (motionPipeline.canAccept())
     {
-        // Check if any blocks remain to be expanded out
-        if (_numBlocks <= 0)
-            return;
+        // Blocks added in this pass are planned as a batch with a single recalculation at the end
+        _motionPlanner.beginBatch();
+        uint32_t numAdded = 0;
+        while (motionPipeline.canAccept())
+        {
+            // Check the time budget
+            if ((numAdded > 0) && (budgetUs != 0) && Raft::isTimeout(micros(), startUs, budgetUs))
+            {
+                _pumpBudgetHits++;
+                MotionPerfCounters::incCounter(MotionPerfCounters::COUNTER_PUMP_BUDGET_HITS);
+                break;
+            }
+
+            // Stage a block if none is ready
+            if (!_stagedBlockPosn.canGet() && !stageNextBlock())
+                break;
+
+            // Prepare add to planner
+            const StagedBlock& stagedBlock = _stagedBlocks[_stagedBlockPosn.getIdx()];
+            _blockMotionArgs.setAxesPositions(stagedBlock.dest);
+            _blockMotionArgs.setMoreMovesComing(!stagedBlock.isLast);
+
+            // Only the final block of a split move carries the motion tracking index so completion is reported once
+            if (_blockMotionTrackingIdxValid && stagedBlock.isLast)
+                _blockMotionArgs.setMotionTrackingIndex(_blockMotionArgs.getMotionTrackingIndex());
+            else
+                _blockMotionArgs.clearMotionTrackingIndex();
+
+            // Add to planner - only the first block of a split move carries the scheduled start time
+            addToPlanner(_blockMotionArgs, stagedBlock, motionPipeline);
+            _blockMotionArgs.clearStartTime();
+            _stagedBlockPosn.hasGot();
+            numAdded++;
+
+            // Enable motors
+            _motorEnabler.enableMotors(true, false);
+        }
+
+        // Recalculate the pipeline once for the whole batch
+        _motionPlanner.commitBatch(motionPipeline, _axesParams);
+    }
 
-        // Add to pipeline any blocks that are waiting to be expanded out
-        AxesValues<AxisPosDataType> nextBlockDest = _axesState.getUnitsFromOrigin() + _blockMotionVector;
+    // Stage blocks ahead of the planner with the remaining time
+    while ((_numBlocks > 0) && _stagedBlockPosn.canPut() &&
+                ((budgetUs == 0) || !Raft::isTimeout(micros(), startUs, budgetUs)))
+        stageNextBlock();
 
-        // Bump position
-        _nextBlockIdx++;
+    // Stats
+    uint32_t elapsedUs = micros() - startUs;
+    if (elapsedUs > _pumpMaxUs)
+        _pumpMaxUs = elapsedUs;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get pump stats as JSON
+/// @param motionPipeline Motion pipeline (for the time of motion queued)
+/// @param includeBraces Include braces
+/// @return JSON string
+String MotionBlockManager::getPumpStatsJSON(const MotionPipelineIF& motionPipeline, bool includeBraces) const
+{
+    String jsonStr = "\"aheadMs\":" + String(motionPipeline.getBufferedUs() / 1000) +
+                ",\"staged\":" + String(_stagedBlockPosn.count()) +
+                ",\"budgetHits\":" + String(_pumpBudgetHits) +
+                ",\"maxUs\":" + String(_pumpMaxUs);
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Stage the next block of a split move - find its destination and actuator coordinates
+/// @return true if a block was staged
+bool MotionBlockManager::stageNextBlock()
+{
+    if ((_numBlocks <= 0) || !_stagedBlockPosn.canPut())
+        return false;
+
+    // Destination of the next block
+    bool isLastAdaptiveBlock = false;
+    AxesValues<AxisPosDataType> nextBlockDest = _isAdaptiveSplit ? nextAdaptiveBlockDest(isLastAdaptiveBlock) :
+                    _splitStartPos + _blockMotionVector * AxisPosDataType(_nextBlockIdx + 1);
 
-        // Check if done, use final target coords if so to ensure cumulative errors don't creep in
-        if (_nextBlockIdx >= _numBlocks)
+    // Bump position
+    _nextBlockIdx++;
+
+    // Arcs rotate the radius vector (using the exact angle periodically to avoid accumulating errors)
+    if (_isArc)
+    {
+        if (_nextBlockIdx % ARC_CORRECTION_SEGMENTS == 0)
         {
-            _numBlocks = 0;
-            nextBlockDest = _finalTargetPos;
+            float angle = _arcStartAngle + _arcSegAngle * _nextBlockIdx;
+            _arcRadiusVec[0] = _arcRadius * cosf(angle);
+            _arcRadiusVec[1] = _arcRadius * sinf(angle);
         }
+        else
+        {
+            float rotatedX = _arcRadiusVec[0] * _arcSegCos - _arcRadiusVec[1] * _arcSegSin;
+            _arcRadiusVec[1] = _arcRadiusVec[0] * _arcSegSin + _arcRadiusVec[1] * _arcSegCos;
+            _arcRadiusVec[0] = rotatedX;
+        }
+        nextBlockDest.setVal(0, _arcCentre[0] + _arcRadiusVec[0]);
+        nextBlockDest.setVal(1, _arcCentre[1] + _arcRadiusVec[1]);
+    }
 
-        // Prepare add to planner
-        _blockMotionArgs.setAxesPositions(nextBlockDest);
-        _blockMotionArgs.setMoreMovesComing(_numBlocks != 0);
+    // Check if done, use final target coords if so to ensure cumulative errors don't creep in
+    StagedBlock& stagedBlock = _stagedBlocks[_stagedBlockPosn.putIdx()];
+    stagedBlock.isLast = _isAdaptiveSplit ? isLastAdaptiveBlock : (_nextBlockIdx >= _numBlocks);
+    if (stagedBlock.isLast)
+    {
+        _numBlocks = 0;
+        _isArc = false;
+        _isAdaptiveSplit = false;
+        nextBlockDest = _finalTargetPos;
+    }
+    stagedBlock.dest = nextBlockDest;
+
+    // Convert to actuator coordinates from the position at the end of the previous staged block and move the
+    // staging state on to the end of this block (as the planner will for the axes state)
+    uint32_t kinematicsStartUs = micros();
+    stagedBlock.kinematicsOk = _pRaftKinematics && _pRaftKinematics->ptToActuatorExact(nextBlockDest, 
+                stagedBlock.actuatorExact, 
+                _stagingAxesState, 
+                _axesParams,
+                _blockMotionArgs.constrainToBounds());
+    MotionPerfCounters::recordTime(MotionPerfCounters::TIMER_KINEMATICS_PT_TO_ACT, micros() - kinematicsStartUs);
+    if (!stagedBlock.kinematicsOk)
+        MotionPerfCounters::incCounter(MotionPerfCounters::COUNTER_KINEMATICS_FAILED);
+    if (stagedBlock.kinematicsOk)
+    {
+        AxesValues<AxisStepsDataType> stepsDelta;
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+            stepsDelta.setVal(axisIdx, AxisStepsDataType(round(stagedBlock.actuatorExact.getVal(axisIdx))) - 
+                        _stagingAxesState.getStepsFromOrigin(axisIdx));
+        _stagingAxesState.setPosition(nextBlockDest, stepsDelta, true);
+        _pRaftKinematics->correctStepOverflow(_stagingAxesState, stagedBlock.actuatorExact, _axesParams);
+    }
+    _stagedBlockPosn.hasPut();
 
 #ifdef DEBUG_BLOCK_SPLITTER
-        LOG_I(MODULE_PREFIX, "pumpBlockSplitter last %s + delta %s => dest %s (%s) nextBlockIdx %d, numBlocks %d", 
-                    _axesState.getUnitsFromOrigin().getDebugJSON("unFrOr").c_str(),
-                    _blockMotionVector.getDebugJSON("vec").c_str(),
-                    nextBlockDest.getDebugJSON("dst").c_str(),
-                    _blockMotionArgs.getAxesPos().getDebugJSON("cur").c_str(), 
-                    _nextBlockIdx,
-                    _numBlocks);
+    LOG_I(MODULE_PREFIX, "stageNextBlock delta %s => dest %s nextBlockIdx %d numBlocks %d staged %d", 
+                _blockMotionVector.getDebugJSON("vec").c_str(),
+                nextBlockDest.getDebugJSON("dst").c_str(),
+                _nextBlockIdx,
+                _numBlocks,
+                _stagedBlockPosn.count());
 #endif
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the destination of the next block when splitting adaptively
+/// @param isLastBlock Set true if this is the last block of the move
+/// @return Destination of the next block
+/// @note The block length starts at the max block distance (or the remaining distance) and is reduced using
+///       the kinematics deviation estimate (deviation scales with the square of length) until within tolerance
+AxesValues<AxisPosDataType> MotionBlockManager::nextAdaptiveBlockDest(bool& isLastBlock)
+{
+    // Remaining distance (primary axes)
+    AxesValues<AxisPosDataType> remaining = _finalTargetPos - _splitCurPos;
+    AxisPosDataType remainingDistMM = sqrtf(remaining.vectorMagnitudeSq(_axesParams.getPrimaryAxisMask()));
 
-        // Add to planner
-        addToPlanner(_blockMotionArgs, motionPipeline);
+    // Find a block length within tolerance
+    AxisPosDataType maxDeviationMM = _axesParams.getMaxLinearDeviationMM();
+    AxisPosDataType blockDistMM = remainingDistMM;
+    if ((_adaptiveSplitMaxDistMM > 0) && (blockDistMM > _adaptiveSplitMaxDistMM))
+        blockDistMM = _adaptiveSplitMaxDistMM;
+    for (uint32_t iter = 0; iter < ADAPTIVE_SPLIT_MAX_ITERATIONS; iter++)
+    {
+        if ((blockDistMM <= ADAPTIVE_SPLIT_MIN_DIST_MM) || (remainingDistMM < MotionBlock::MINIMUM_MOVE_DIST_MM))
+            break;
+        AxisDistDataType deviationMM = 0;
+        _pRaftKinematics->estimateLinearDeviation(_splitCurPos, 
+                    _splitCurPos + remaining * (blockDistMM / remainingDistMM), 
+                    _stagingAxesState, _axesParams, deviationMM);
+        if (deviationMM <= maxDeviationMM)
+            break;
+        blockDistMM = UTILS_MAX(blockDistMM * sqrtf(maxDeviationMM / deviationMM) * ADAPTIVE_SPLIT_LENGTH_MARGIN,
+                    ADAPTIVE_SPLIT_MIN_DIST_MM);
+    }
 
-        // Enable motors
-        _motorEnabler.enableMotors(true, false);
+    // Check for last block (avoiding a very short final block)
+    if (blockDistMM + ADAPTIVE_SPLIT_MIN_DIST_MM / 2 >= remainingDistMM)
+    {
+        isLastBlock = true;
+        _splitCurPos = _finalTargetPos;
+        return _finalTargetPos;
     }
+    _splitCurPos += remaining * (blockDistMM / remainingDistMM);
+    return _splitCurPos;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Add to planner
 /// @param args MotionArgs define the parameters for motion
+/// @param stagedBlock Staged block (actuator coordinates of the destination)
 /// @param motionPipeline Motion pipeline to add the block to
 /// @return true if successful
 /// @note The planner is responsible for computing suitable motion
-///       and args may be modified by this function
-bool MotionBlockManager::addToPlanner(const MotionArgs &args, MotionPipelineIF& motionPipeline)
+bool MotionBlockManager::addToPlanner(const MotionArgs &args, const StagedBlock& stagedBlock, 
+            MotionPipelineIF& motionPipeline)
 {
-    // Get kinematics
-    if (!_pRaftKinematics)
+    // Check the move was converted to actuator coordinates when staged
+    if (!stagedBlock.kinematicsOk)
     {
-        LOG_W(MODULE_PREFIX, "addToPlanner no geometry set");
+        LOG_W(MODULE_PREFIX, "addToPlanner %s", _pRaftKinematics ? "ptToActuator failed" : "no geometry set");
         return false;
     }
 
-    // Convert the move to actuator coordinates
+    // The exact actuator position is rounded to whole steps and the residual is carried to the next block
+    const AxesValues<AxisCalcDataType>& actuatorExact = stagedBlock.actuatorExact;
     AxesValues<AxisStepsDataType> actuatorCoords;
-    _pRaftKinematics->ptToActuator(args.getAxesPosConst(), 
-            actuatorCoords, 
-            _axesState, 
-            _axesParams,
-            args.constrainToBounds());
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        actuatorCoords.setVal(axisIdx, AxisStepsDataType(round(actuatorExact.getVal(axisIdx))));
 
     // Plan the move
     bool moveOk = _motionPlanner.moveToRamped(args, actuatorCoords, 
@@ -183,47 +457,43 @@ bool MotionBlockManager::addToPlanner(const MotionArgs &args, MotionPipelineIF&
             actuatorCoords.toJSON().c_str());
 #endif
 
-    // Correct overflows if necessary
-    if (moveOk)
-    {
-        // TODO check that this is already done in moveToRamped - it updates _lastCommandedAxisPos
-        // // Update axisMotion
-        // _lastCommandedAxisPos.curPosUnitsFromOrigin = args.getPointMM();
-
-        // Correct overflows
-        // TODO re-implement
-        // if (_correctStepOverflowFn)
-        // {
-        //     _correctStepOverflowFn(_lastCommandedAxesPositions, _axesParams);
-        // }            
+    // A move without whole steps still updates the commanded position (the fraction is held in the residual)
+    if (!moveOk)
+        _axesState.setUnitsFromOrigin(args.getAxesPosConst());
+
+    // Carry the sub-step residual (and correct overflows if necessary)
+    _pRaftKinematics->correctStepOverflow(_axesState, actuatorExact, _axesParams);
 #ifdef DEBUG_COORD_UPDATES
-        LOG_I(MODULE_PREFIX, "addToPlanner updatedAxisPos %s",
-            _axesState.getUnitsFromOrigin().getDebugJSON("unFrOr").c_str());
+    LOG_I(MODULE_PREFIX, "addToPlanner updatedAxisPos %s",
+        _axesState.getUnitsFromOrigin().getDebugJSON("unFrOr").c_str());
 #endif
-    }
-    else
-    {
-        LOG_W(MODULE_PREFIX, "addToPlanner moveToRamped failed");
-    }
     return moveOk;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Set current position as origin
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
+/// @brief Set the current position of an axis as its origin
+/// @param axisIdx Axis index
+/// @note The axes must be at a standstill - the position in units is then found from the actuator positions so
+///       it is valid for all axes (the step residuals of the other axes are kept)
 void MotionBlockManager::setCurPositionAsOrigin(uint32_t axisIdx)
 {
     if (axisIdx >= AXIS_VALUES_MAX_AXES)
         return;
 
-    // TODO 
-    // _lastCommandedAxesPositions.curPosUnitsFromOrigin.setVal(axisIdx, 0);
-    // _lastCommandedAxesPositions.setUnitsFromOriginValidity(true);
-    // _lastCommandedAxesPositions.curPosStepsFromOrigin.setVal(axisIdx, 0);
-// #ifdef DEBUG_COORD_UPDATES
-//         LOG_I(MODULE_PREFIX, "setCurPosAsOrigin axisIdx %d curMM %0.2f steps %d", axisIdx,
-//                     _lastCommandedAxesPositions.curPosUnitsFromOrigin.getVal(axisIdx),
-//                     _lastCommandedAxesPositions.curPosStepsFromOrigin.getVal(axisIdx));
-// #endif
+    // Actuator at zero steps from the origin
+    AxesValues<AxisStepsDataType> stepsFromOrigin = _axesState.getStepsFromOrigin();
+    stepsFromOrigin.setVal(axisIdx, 0);
+    AxesValues<AxisPosDataType> unitsFromOrigin;
+    actuatorToPt(stepsFromOrigin, unitsFromOrigin);
+
+    // Set the position keeping the residuals of the other axes
+    AxisCalcDataType stepResiduals[AXIS_VALUES_MAX_AXES];
+    for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
+        stepResiduals[i] = i == axisIdx ? 0 : _axesState.getStepResidual(i);
+    _axesState.setPosition(unitsFromOrigin, stepsFromOrigin, false);
+    for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
+        _axesState.setStepResidual(i, stepResiduals[i]);
+#ifdef DEBUG_COORD_UPDATES
+    LOG_I(MODULE_PREFIX, "setCurPosAsOrigin axisIdx %d %s", axisIdx, unitsFromOrigin.getDebugJSON("unFrOr").c_str());
+#endif
 }
@@ -13,6 +13,7 @@
 #include "MotorEnabler.h"
 #include "MotionPlanner.h"
 #include "RaftKinematics.h"
+#include "MotionRingBuffer.h"
 
 class MotionPipelineIF;
 
@@ -31,18 +32,50 @@ public:
     /// @brief Setup
     /// @param stepGenPeriodUs Period of the step generator in microseconds
     /// @param motionConfig JSON configuration
-    void setup(uint32_t stepGenPeriodUs, const RaftJsonIF& motionConfig);
+    void setup(uint32_t stepGenPeriodUs, uint32_t accelTickNs, const RaftJsonIF& motionConfig);
 
     /// @brief Pump the block splitter - should be called regularly 
     /// @param motionPipeline Motion pipeline to add the block to
+    /// @param budgetUs Time budget for the call in microseconds (0 for no limit) - work remaining when the
+    ///        budget runs out is left for the next call (at least one block is added if the pipeline can accept it)
     /// @note This is used to manage splitting of a single moveTo command into multiple blocks
-    void pumpBlockSplitter(MotionPipelineIF& motionPipeline);
+    void pumpBlockSplitter(MotionPipelineIF& motionPipeline, uint32_t budgetUs = 0);
 
     /// @brief Check if the motion block manager is busy
     /// @return true if busy
     bool isBusy() const
     {
-        return _numBlocks != 0;
+        return (_numBlocks != 0) || _stagedBlockPosn.canGet();
+    }
+
+    /// @brief Replan the pipeline from a standstill (after a feed hold)
+    /// @param motionPipeline Motion pipeline (the ramp generator must be held)
+    /// @param heldStepsDone Steps done (absolute) on each axis of the held block (if it was executing)
+    void replanFromStandstill(MotionPipelineIF& motionPipeline, const AxesValues<AxisStepsDataType>& heldStepsDone)
+    {
+        _motionPlanner.replanFromStandstill(motionPipeline, _axesParams, heldStepsDone);
+    }
+
+    /// @brief Set the feed override (applied to blocks already in the pipeline and those added later)
+    /// @param feedOverridePercent Feed override (percent of the requested speeds - limited to 10% to 200%)
+    /// @param motionPipeline Motion pipeline
+    void setFeedOverride(uint32_t feedOverridePercent, MotionPipelineIF& motionPipeline)
+    {
+        _motionPlanner.setFeedOverride(feedOverridePercent, motionPipeline, _axesParams);
+    }
+    uint32_t getFeedOverride() const
+    {
+        return _motionPlanner.getFeedOverride();
+    }
+
+    /// @brief Restart planning from a standstill at the given axes state
+    /// @param axesState State of the axes (position, validity and step residuals)
+    /// @note Used when blocks are added to the pipeline without being planned here (see MotionLibrary)
+    void restartAtStandstill(const AxesState& axesState)
+    {
+        clear();
+        _axesState = axesState;
+        _motionPlanner.restartAtStandstill();
     }
 
     /// @brief Add non-ramped motion block (used for homing, etc)
@@ -58,6 +91,11 @@ public:
     /// @return true if the block was added
     bool addRampedBlock(const MotionArgs& args, uint32_t numBlocks);
 
+    /// @brief Add an arc (which is split into segments within the chord tolerance)
+    /// @param args MotionArgs define the end position, centre offset (from the current position), direction, etc
+    /// @return true if the arc was added
+    bool addArcBlock(const MotionArgs& args);
+
     /// @brief Get current state of axes
     /// @return AxesState
     const AxesState& getAxesState() const
@@ -107,6 +145,17 @@ public:
     /// @param axisIdx Axis index
     void setCurPositionAsOrigin(uint32_t axisIdx);
 
+    /// @brief Get number of moves merged into a previous block (coalescing of collinear moves)
+    uint32_t getNumCoalesced() const
+    {
+        return _motionPlanner.getNumCoalesced();
+    }
+
+    /// @brief Get pump stats as JSON
+    /// @param motionPipeline Motion pipeline (for the time of motion queued)
+    /// @param includeBraces Include braces
+    String getPumpStatsJSON(const MotionPipelineIF& motionPipeline, bool includeBraces) const;
+
     /// @brief Check if homing needed before any move
     /// @return true if homing is needed
     bool isHomingNeededBeforeMove() const
@@ -118,6 +167,12 @@ private:
     // Debug
     static constexpr const char* MODULE_PREFIX = "MotionBlockManager";
 
+    // Default max length of a block made by coalescing collinear moves
+    static constexpr float COALESCE_MAX_DIST_MM_DEFAULT = 10.0f;
+
+    // Default for staging of split blocks
+    static constexpr uint32_t STAGE_LEN_DEFAULT = 4;
+
     // Args for motion
     MotionArgs _blockMotionArgs;
 
@@ -127,8 +182,10 @@ private:
     // State of axes (including current position and origin status)
     AxesState _axesState;
 
-    // Block motion as a vector
+    // Block motion as a vector and the start of the split move (block end points are found from the start so
+    // that rounding doesn't accumulate over the blocks)
     AxesValues<AxisPosDataType> _blockMotionVector;
+    AxesValues<AxisPosDataType> _splitStartPos;
 
     // Num blocks to split over
     uint32_t _numBlocks = 0;
@@ -136,6 +193,50 @@ private:
     // Next block to return
     uint32_t _nextBlockIdx = 0;
 
+    // Motion tracking index of the split block is valid (only the final block carries the index)
+    bool _blockMotionTrackingIdxValid = false;
+
+    // Arc state - segment end points are found by rotating the radius vector (in the plane of axes 0 and 1)
+    // by a fixed angle which is corrected using the exact angle every ARC_CORRECTION_SEGMENTS
+    static constexpr uint32_t ARC_CORRECTION_SEGMENTS = 25;
+    static constexpr uint32_t ARC_MAX_SEGMENTS = 10000;
+    bool _isArc = false;
+    AxisPosDataType _arcCentre[2] = {0, 0};
+    AxisPosDataType _arcRadiusVec[2] = {0, 0};
+    float _arcRadius = 0;
+    float _arcStartAngle = 0;
+    float _arcSegAngle = 0;
+    float _arcSegCos = 1;
+    float _arcSegSin = 0;
+
+    // Adaptive splitting (non-linear geometries) - block lengths are chosen to keep the deviation from a straight
+    // line within the configured limit (using the kinematics estimate which scales with the square of the length)
+    static constexpr AxisPosDataType ADAPTIVE_SPLIT_MIN_DIST_MM = 0.2;
+    static constexpr float ADAPTIVE_SPLIT_LENGTH_MARGIN = 0.9;
+    static constexpr uint32_t ADAPTIVE_SPLIT_MAX_ITERATIONS = 3;
+    bool _isAdaptiveSplit = false;
+    AxesValues<AxisPosDataType> _splitCurPos;
+    AxisPosDataType _adaptiveSplitMaxDistMM = 0;
+
+    // Staged blocks - the destinations of upcoming split blocks and their actuator coordinates are computed
+    // ahead of the planner (with the time left in each pump) so that when the pipeline frees several slots
+    // at once only planning is needed to fill them - the staging axes state is the state after the last block
+    // staged (the kinematics of a block depend on the position it starts from)
+    struct StagedBlock
+    {
+        AxesValues<AxisPosDataType> dest;
+        AxesValues<AxisCalcDataType> actuatorExact;
+        bool kinematicsOk = false;
+        bool isLast = false;
+    };
+    std::vector<StagedBlock> _stagedBlocks;
+    MotionRingBufferPosn _stagedBlockPosn;
+    AxesState _stagingAxesState;
+
+    // Pump stats - calls which ran out of time before the pipeline was full and the longest call
+    uint32_t _pumpBudgetHits = 0;
+    uint32_t _pumpMaxUs = 0;
+
     // Planner used to plan the pipeline of motion
     MotionPlanner _motionPlanner;
 
@@ -156,8 +257,11 @@ private:
 
     /// @brief Add to planner
     /// @param args MotionArgs define the parameters for motion
+    /// @param stagedBlock Staged block (actuator coordinates of the destination)
     /// @param motionPipeline Motion pipeline to add the block to
     /// @return true if successful
     /// @note The planner is responsible for computing suitable motion
-    bool addToPlanner(const MotionArgs &args, MotionPipelineIF& motionPipeline);
+    bool addToPlanner(const MotionArgs &args, const StagedBlock& stagedBlock, MotionPipelineIF& motionPipeline);
+    bool stageNextBlock();
+    AxesValues<AxisPosDataType> nextAdaptiveBlockDest(bool& isLastBlock);
 };
@@ -0,0 +1,139 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionConfigCache
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include "MotionConfigCache.h"
+#include "Logger.h"
+#ifdef ESP_PLATFORM
+#include "nvs.h"
+#endif
+
+// Debug
+// #define DEBUG_MOTION_CONFIG_CACHE
+
+#define MODULE_PREFIX "MotionCfgCache"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Hash of the parts of the config which the cache covers
+/// @param config Configuration (from JSON)
+/// @return FNV-1a hash of the motion and axes config
+uint32_t MotionConfigCache::getConfigHash(const RaftJsonIF& config)
+{
+    uint32_t hash = 2166136261u;
+    String sections[] = { config.getString("motion", "{}"), config.getString("axes", "[]") };
+    for (const String& section : sections)
+    {
+        const char* pStr = section.c_str();
+        for (uint32_t i = 0; i < section.length(); i++)
+            hash = (hash ^ uint8_t(pStr[i])) * 16777619u;
+    }
+    return hash;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Load the cached config
+/// @param configHash Hash of the current config
+/// @param axesParams (out) Axes parameters
+/// @param driverParams (out) Step driver parameters (one per axis)
+/// @return true if the cache is valid for the config hash
+bool MotionConfigCache::load(uint32_t configHash, AxesParams& axesParams, std::vector<StepDriverParams>& driverParams)
+{
+    _loadedFromCache = false;
+#ifdef ESP_PLATFORM
+    // Read blob
+    nvs_handle_t nvsHandle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvsHandle) != ESP_OK)
+        return false;
+    size_t blobLen = 0;
+    std::vector<uint8_t> blob;
+    esp_err_t err = nvs_get_blob(nvsHandle, NVS_KEY, nullptr, &blobLen);
+    if ((err == ESP_OK) && (blobLen >= sizeof(BlobHeader)) && (blobLen <= BLOB_MAX_LEN))
+    {
+        blob.resize(blobLen);
+        err = nvs_get_blob(nvsHandle, NVS_KEY, blob.data(), &blobLen);
+    }
+    nvs_close(nvsHandle);
+    if ((err != ESP_OK) || (blob.size() < sizeof(BlobHeader)))
+        return false;
+
+    // Check header
+    BlobHeader header;
+    memcpy(&header, blob.data(), sizeof(header));
+    if ((header.magic != BLOB_MAGIC) || (header.layoutVersion != BLOB_LAYOUT_VERSION) ||
+                (header.configHash != configHash) || (header.axisParamsSize != sizeof(AxisParams)) ||
+                (header.driverParamsSize != sizeof(StepDriverParams)) || (header.numDrivers > AXIS_VALUES_MAX_AXES))
+    {
+#ifdef DEBUG_MOTION_CONFIG_CACHE
+        LOG_I(MODULE_PREFIX, "load cache mismatch hash %08x cached %08x", configHash, header.configHash);
+#endif
+        return false;
+    }
+
+    // Axes params
+    uint32_t pos = sizeof(header);
+    uint32_t bytesUsed = 0;
+    if (!axesParams.fromBlob(blob.data() + pos, blob.size() - pos, bytesUsed))
+        return false;
+    pos += bytesUsed;
+
+    // Driver params
+    if (pos + header.numDrivers * sizeof(StepDriverParams) != blob.size())
+        return false;
+    driverParams.resize(header.numDrivers);
+    memcpy(static_cast<void*>(driverParams.data()), blob.data() + pos, header.numDrivers * sizeof(StepDriverParams));
+    _loadedFromCache = true;
+
+#ifdef DEBUG_MOTION_CONFIG_CACHE
+    LOG_I(MODULE_PREFIX, "load hash %08x len %d drivers %d", configHash, blob.size(), header.numDrivers);
+#endif
+    return true;
+#else
+    return false;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Store the config in the cache
+/// @param configHash Hash of the config the parameters were parsed from
+/// @param axesParams Axes parameters
+/// @param driverParams Step driver parameters (one per axis)
+/// @return true if stored
+bool MotionConfigCache::store(uint32_t configHash, const AxesParams& axesParams, const std::vector<StepDriverParams>& driverParams)
+{
+#ifdef ESP_PLATFORM
+    // Form blob
+    BlobHeader header = { BLOB_MAGIC, BLOB_LAYOUT_VERSION, configHash,
+                uint16_t(sizeof(AxisParams)), uint16_t(sizeof(StepDriverParams)), uint32_t(driverParams.size()) };
+    std::vector<uint8_t> blob(sizeof(header));
+    memcpy(blob.data(), &header, sizeof(header));
+    axesParams.toBlob(blob);
+    const uint8_t* pDriverBytes = reinterpret_cast<const uint8_t*>(driverParams.data());
+    blob.insert(blob.end(), pDriverBytes, pDriverBytes + driverParams.size() * sizeof(StepDriverParams));
+    if (blob.size() > BLOB_MAX_LEN)
+    {
+        LOG_W(MODULE_PREFIX, "store blob too large %d", blob.size());
+        return false;
+    }
+
+    // Write to NVS
+    nvs_handle_t nvsHandle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvsHandle) != ESP_OK)
+        return false;
+    esp_err_t err = nvs_set_blob(nvsHandle, NVS_KEY, blob.data(), blob.size());
+    if (err == ESP_OK)
+        err = nvs_commit(nvsHandle);
+    nvs_close(nvsHandle);
+
+#ifdef DEBUG_MOTION_CONFIG_CACHE
+    LOG_I(MODULE_PREFIX, "store hash %08x len %d %s", configHash, blob.size(), err == ESP_OK ? "OK" : "FAILED");
+#endif
+    return err == ESP_OK;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,61 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionConfigCache
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "RaftJsonIF.h"
+#include "AxesParams.h"
+#include "StepDriverParams.h"
+
+// Persisted (non-volatile) cache of the parsed motion configuration - the axes parameters and step driver
+// parameters are stored as a binary blob along with a hash of the JSON they were parsed from so that parsing
+// can be skipped at boot when the config hasn't changed (e.g. after a watchdog reset)
+// - the blob also records a layout version and the sizes of the stored structures so that a firmware change
+//   which alters them invalidates the cache
+// - only supported on ESP32 (NVS) - elsewhere load always fails and store does nothing
+class MotionConfigCache
+{
+public:
+    // Hash of the parts of the config which the cache covers
+    static uint32_t getConfigHash(const RaftJsonIF& config);
+
+    // Load the cached config - returns false if there is no valid cache for the config hash
+    bool load(uint32_t configHash, AxesParams& axesParams, std::vector<StepDriverParams>& driverParams);
+
+    // Store the config in the cache
+    bool store(uint32_t configHash, const AxesParams& axesParams, const std::vector<StepDriverParams>& driverParams);
+
+    // Check if the last setup used the cache
+    bool wasLoadedFromCache() const
+    {
+        return _loadedFromCache;
+    }
+
+private:
+    // Header at the start of the blob
+    struct BlobHeader
+    {
+        uint32_t magic;
+        uint32_t layoutVersion;
+        uint32_t configHash;
+        uint16_t axisParamsSize;
+        uint16_t driverParamsSize;
+        uint32_t numDrivers;
+    };
+    static const uint32_t BLOB_MAGIC = 0x4d434643;
+    static const uint32_t BLOB_LAYOUT_VERSION = 3;
+    static const uint32_t BLOB_MAX_LEN = 4000;
+
+    // NVS namespace and key
+    static constexpr const char* NVS_NAMESPACE = "motionCfg";
+    static constexpr const char* NVS_KEY = "blob";
+
+    // Loaded from cache
+    bool _loadedFromCache = false;
+};
@@ -21,11 +21,13 @@
 #define DEBUG_RAMP_SETUP_CONFIG
 // #define DEBUG_MOTION_CONTROLLER
 // #define INFO_LOG_AXES_PARAMS
+// #define DEBUG_MOTION_CONFIG_CACHE
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
 MotionController::MotionController() : 
-            _blockManager(_motorEnabler, _axesParams)
+            _blockManager(_motorEnabler, _axesParams),
+            _motionLibrary(_motorEnabler, _axesParams)
 {
 }
 
@@ -43,7 +45,8 @@ MotionController::~MotionController()
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Setup
 /// @param config Configuration (from JSON)
-void MotionController::setup(const RaftJsonIF& config)
+/// @param pSharedTimer Ramp generator timer shared with other motion controllers (nullptr if not shared)
+void MotionController::setup(const RaftJsonIF& config, RampGenTimer* pSharedTimer)
 {
     // De-init first
     deinit();
@@ -56,6 +59,7 @@ void MotionController::setup(const RaftJsonIF& config)
 
     // Setup ramp generator and pipeline
     RaftJsonPrefixed rampConfig(config, "ramp");
+    _rampGenerator.setSharedTimer(pSharedTimer);
     _rampGenerator.setup(rampConfig, _stepperDrivers, _axisEndStops);
     _rampGenerator.start();
 
@@ -65,17 +69,62 @@ void MotionController::setup(const RaftJsonIF& config)
 
     // Block manager
     RaftJsonPrefixed motionConfig(config, "motion");
-    _blockManager.setup(_rampGenerator.getPeriodUs(), motionConfig);
+    _blockManager.setup(_rampGenerator.getPeriodUs(), _rampGenerator.getAccelTickNs(), motionConfig);
+    _pumpBudgetUs = motionConfig.getLong("pumpBudgetUs", PUMP_BUDGET_US_DEFAULT);
+    _streamLowWaterMs = motionConfig.getLong("streamLowWaterMs", 0);
+    _streamWasLowWater = true;
+
+    // Library of pre-planned moves (optional)
+    RaftJsonPrefixed libraryConfig(config, "moveLibrary");
+    _motionLibrary.setup(_rampGenerator.getPeriodUs(), _rampGenerator.getAccelTickNs(), libraryConfig, motionConfig);
+
+    // Homing sequence (optional)
+    RaftJsonPrefixed homingConfig(config, "homing");
+    _motionHoming.setup(homingConfig);
+    _homingStartPending = false;
+    _homingPhaseRunning = false;
+
+    // Position journal - restore the position recorded before a warm restart (so homing isn't needed)
+    RaftJsonPrefixed journalConfig(config, "posJournal");
+    _posJournal.setup(journalConfig, MotionConfigCache::getConfigHash(config));
+    _posJournalRecordPending = false;
+    _posJournalMotorsWereEnabled = false;
+    AxesState journalAxesState;
+    AxesValues<AxisStepsDataType> journalSteps;
+    bool posRestored = _posJournal.restore(journalAxesState, journalSteps);
+    if (posRestored)
+    {
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+            _rampGenerator.setTotalStepPosition(axisIdx, journalSteps.getVal(axisIdx));
+        _blockManager.restartAtStandstill(journalAxesState);
+    }
 
-    // If no homing required then set the current position as home
-    if (!_homingNeededBeforeAnyMove)
-        setCurPositionAsOrigin(true);
+    // Encoders are referenced to the current position
+    AxesValues<AxisStepsDataType> cmdSteps;
+    _rampGenerator.getTotalStepPosition(cmdSteps);
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        _axisEncoders[axisIdx].reference(cmdSteps.getVal(axisIdx));
+
+    // If no homing required then set the current position as home (unless the position has been restored)
+    if (!_homingNeededBeforeAnyMove && !posRestored)
+        setCurPositionAsOriginNow(true);
+
+    // Planner task (optional) - started once the planning state is set up - woken by the ramp generator when the
+    // pipeline runs low
+    RaftJsonPrefixed planTaskConfig(config, "planTask");
+    if (_planTask.setup(planTaskConfig, planTaskService, this))
+        _rampGenerator.setPipelineLowWaterCB(MotionPlannerTask::wakeFromISR, &_planTask, _planTask.getLowWater(),
+                    _planTask.getLowWaterMs() * 1000);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief De-init (teardown)
 void MotionController::deinit()
 {
+    // Stop the planner task (before anything it uses is cleared)
+    _rampGenerator.setPipelineLowWaterCB(nullptr, nullptr, 0);
+    _planTask.stop();
+
     // Stop any motion
     _rampGenerator.stop();
     _motorEnabler.deinit();
@@ -83,10 +132,13 @@ void MotionController::deinit()
     // Clear block manager
     _blockManager.clear();
 
-    // Remote steppers
+    // Remote steppers (which must no longer be scheduled on the bus)
+    _busScheduler.clear();
     for (StepDriverBase*& pDriver : _stepperDrivers)
     {
-        if (pDriver)
+        if (_arena.owns(pDriver))
+            _arena.destroy(pDriver);
+        else if (pDriver)
             delete pDriver;
         pDriver = nullptr;
     }
@@ -94,10 +146,23 @@ void MotionController::deinit()
     // Remote endstops
     for (EndStops*& pEndStops : _axisEndStops)
     {
-        if (pEndStops)
+        if (_arena.owns(pEndStops))
+            _arena.destroy(pEndStops);
+        else if (pEndStops)
             delete pEndStops;
     }
     _axisEndStops.clear();
+
+    // Encoders
+    for (AxisEncoder& axisEncoder : _axisEncoders)
+        axisEncoder.clear();
+    _encoderStopAxesMask = 0;
+    _encoderCorrectAxesMask = 0;
+    _lastMotionPhase = StepDriverBase::MOTION_PHASE_IDLE;
+    _monitoredPosCacheValid = false;
+
+    // All objects in the arena have been destroyed
+    _arena.reset();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -116,6 +181,9 @@ void MotionController::loop()
             pStepDriver->loop();
     }
 
+    // Loop bus scheduler (register reads and writes for all stepper drivers)
+    _busScheduler.loop();
+
     // // Check if stop requested
     // if (_stopRequested)
     // {
@@ -138,22 +206,49 @@ void MotionController::loop()
     // motion is handled by ISR
     _rampGenerator.loop();
 
+    // Pass the motion phase to the stepper drivers (which may scale the run current for the phase)
+    StepDriverBase::MotionPhase motionPhase = _rampGenerator.getMotionPhase();
+    if (motionPhase != _lastMotionPhase)
+    {
+        _lastMotionPhase = motionPhase;
+        for (StepDriverBase* pStepDriver : _stepperDrivers)
+        {
+            if (pStepDriver)
+                pStepDriver->setMotionPhase(motionPhase);
+        }
+    }
+
+    // Check the following error of axes with encoders
+    serviceEncoders();
+
+    // Record (or invalidate) the position in the journal
+    servicePosJournal();
+
     // Process for trinamic devices
     // TODO
     // _trinamicsController.process();
 
-    // Process any split-up blocks to be added to the pipeline
-    _blockManager.pumpBlockSplitter(_rampGenerator.getMotionPipeline());
+    // Handle feed hold resume, feed override and process any split-up blocks to be added to the pipeline (done
+    // in the planner task if it is running)
+    if (!_planTask.isActive())
+    {
+        serviceFeedHold();
+        serviceFeedOverride();
+        serviceDirectMotion();
+        serviceEncoderRecovery();
+        serviceHoming();
+        _blockManager.pumpBlockSplitter(_rampGenerator.getMotionPipeline(), _pumpBudgetUs);
+    }
 
-    // Loop homing
-    // TODO
-    // _motionHoming.loop(_axesParams);
+    // Notify the streamer when the time of motion buffered falls below the low-water mark
+    bool isLowWater = streamIsLowWater();
+    if (isLowWater && !_streamWasLowWater && _pStreamLowWaterCB)
+        _pStreamLowWaterCB(_pStreamLowWaterCBArg, streamGetBufferedMs());
+    _streamWasLowWater = isLowWater;
 
-    // Ensure motors enabled when homing or moving
-    if ((_rampGenerator.getMotionPipeline().count() > 0) 
-        // TODO 2021
-        //  || _motionHoming.isHomingInProgress()
-         )
+    // Ensure motors enabled when homing or moving (including pressure advance settling)
+    if ((_rampGenerator.getMotionPipeline().count() > 0) || _rampGenerator.isPressureAdvanceSettling() ||
+                isHomingInProgress())
     {
         _motorEnabler.enableMotors(true, false);
     }
@@ -164,7 +259,9 @@ void MotionController::loop()
 /// @return true if any motion is in the pipeline
 bool MotionController::isBusy() const
 {
-    return _rampGenerator.getMotionPipelineConst().count() > 0;
+    return (_rampGenerator.getMotionPipelineConst().count() > 0) || (_planTask.getNumQueued() > 0) ||
+                _rampGenerator.isDirectMotionActive() || _rampGenerator.isPressureAdvanceSettling() ||
+                _directMotionResyncPending || isHomingInProgress();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -174,14 +271,38 @@ bool MotionController::isBusy() const
 /// @note The args may be modified so cannot be const
 bool MotionController::moveTo(MotionArgs &args)
 {
+    // Queue for the planner task if it is running - a stop or clear-queue is done immediately (with the planning
+    // lock held) and discards the commands queued ahead of it so it can't be rejected or delayed by a full queue
+    if (_planTask.isActive())
+    {
+        if (!args.isStopMotion() && !args.isClearQueue())
+            return _planTask.queueCommand(args);
+        MotionPlannerTask::ScopedLock planLock(_planTask);
+        _planTask.clearCommands();
+        return moveToNow(args);
+    }
+    return moveToNow(args);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Move to a specific location - the planning is done immediately
+/// @param args MotionArgs specify the motion to be performed
+/// @return true if the motion was successfully added to the pipeline
+bool MotionController::moveToNow(MotionArgs &args)
+{
+#ifdef DEBUG_MOTION_CONTROLLER
     LOG_I(MODULE_PREFIX, "moveTo %s args %s", 
             args.getAxesPos().getDebugJSON("axes").c_str(),
             args.toJSON().c_str());
+#endif
 
-    // Handle stop
+    // Handle stop (which also aborts homing)
     if (args.isStopMotion())
     {
         _rampGenerator.stop();
+        _homingStartPending = false;
+        _homingPhaseRunning = false;
+        _motionHoming.abort();
     }
     
     // Handle clear queue
@@ -197,6 +318,14 @@ bool MotionController::moveTo(MotionArgs &args)
         return true;
     }
 
+    // Velocity (jog) mode
+    if (args.isVelocityMode())
+        return moveToVelocity(args);
+
+    // Moves aren't accepted while a trajectory stream, velocity mode or homing is active
+    if (_rampGenerator.isDirectMotionActive() || _directMotionResyncPending || isHomingInProgress())
+        return false;
+
     // Check motion type
     if (args.isRamped())
     {
@@ -208,16 +337,351 @@ bool MotionController::moveTo(MotionArgs &args)
     return _blockManager.addNonRampedBlock(args, _rampGenerator.getMotionPipeline());
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Planner task service
+/// @param pArg MotionController
+void MotionController::planTaskService(void* pArg)
+{
+    ((MotionController*)pArg)->servicePlanTask();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Planner task service - handles queued commands and pumps the block splitter
+/// @note Called in the planner task context with the planning lock held
+void MotionController::servicePlanTask()
+{
+    // Handle queued commands (stop and clear-queue commands aren't queued - see moveTo) - a ramped move stays
+    // queued while a split-up move is still being fed to the pipeline
+    while (MotionArgs* pArgs = _planTask.peekCommand())
+    {
+        if (pArgs->isRamped() && pArgs->isEnableMotors() && _blockManager.isBusy())
+            break;
+        moveToNow(*pArgs);
+        _planTask.popCommand();
+    }
+
+    // Handle feed hold resume, feed override, the end of a trajectory stream or velocity mode and process any
+    // split-up blocks to be added to the pipeline
+    serviceFeedHold();
+    serviceFeedOverride();
+    serviceDirectMotion();
+    serviceEncoderRecovery();
+    serviceHoming();
+    _blockManager.pumpBlockSplitter(_rampGenerator.getMotionPipeline(), _pumpBudgetUs);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Pause (or resume) all motion
 /// @param pauseIt true to pause, false to resume
 void MotionController::pause(bool pauseIt)
 {
-    _rampGenerator.pause(pauseIt);
+    // Resume is deferred until the ramp generator has decelerated to a standstill and the pipeline is replanned
+    _resumeFromHoldPending = !pauseIt;
+    if (pauseIt)
+        _rampGenerator.pause(true);
     // _trinamicsController.pause(pauseIt);
     _isPaused = pauseIt;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Resume from a feed hold - the pipeline is replanned from zero speed (with the held block shortened to
+///        the steps remaining) before the ramp generator is resumed
+/// @note Called in the planning context (loop or planner task)
+void MotionController::serviceFeedHold()
+{
+    if (!_resumeFromHoldPending)
+        return;
+
+    // Wait for the deceleration to complete
+    if (_rampGenerator.isHoldDecelerating())
+        return;
+
+    // Replan if held
+    if (_rampGenerator.isHeld())
+    {
+        AxesValues<AxisStepsDataType> heldStepsDone;
+        _rampGenerator.getHeldBlockProgress(heldStepsDone);
+        _blockManager.replanFromStandstill(_rampGenerator.getMotionPipeline(), heldStepsDone);
+#ifdef DEBUG_MOTION_CONTROLLER
+        LOG_I(MODULE_PREFIX, "serviceFeedHold replanned %d blocks", _rampGenerator.getMotionPipelineConst().count());
+#endif
+    }
+    _resumeFromHoldPending = false;
+    _rampGenerator.pause(false);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set the feed override
+/// @param feedOverridePercent Percentage of the requested speeds (clamped to 10..200)
+/// @note A reduction is applied by the ramp generator immediately (including to the executing block) and the
+///       queued blocks are replanned in the planning context (loop or planner task)
+void MotionController::setFeedOverride(uint32_t feedOverridePercent)
+{
+    _rampGenerator.setFeedOverride(feedOverridePercent);
+    _feedOverridePercent = _rampGenerator.getFeedOverride();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Replan the queued blocks if the feed override has changed
+/// @note Called in the planning context (loop or planner task)
+void MotionController::serviceFeedOverride()
+{
+    uint32_t feedOverridePercent = _feedOverridePercent;
+    if (feedOverridePercent == _blockManager.getFeedOverride())
+        return;
+    _blockManager.setFeedOverride(feedOverridePercent, _rampGenerator.getMotionPipeline());
+#ifdef DEBUG_MOTION_CONTROLLER
+    LOG_I(MODULE_PREFIX, "serviceFeedOverride %d%% replanned %d blocks", feedOverridePercent, 
+                _rampGenerator.getMotionPipelineConst().count());
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start a trajectory stream
+/// @return false if streaming isn't enabled or the motion controller is busy
+bool MotionController::trajStreamStart()
+{
+    if (isBusy() || _blockManager.isBusy())
+        return false;
+    _rampGenerator.getTotalStepPosition(_directMotionStartSteps);
+    if (!_rampGenerator.getTrajStream().start())
+        return false;
+    _directMotionResyncPending = true;
+    _motorEnabler.enableMotors(true, false);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set velocity (jog) mode targets - each specified axis accelerates toward its target velocity (units
+///        per second or steps per second) and keeps running until retargeted (a zero velocity decelerates the
+///        axis to a standstill)
+/// @param args MotionArgs with the target velocity of each axis specified
+/// @return false if other motion is in progress
+/// @note Velocities are limited to each axis's maxSpeedUps and change at its maxAccUps2 - they act on the
+///       actuators directly (no kinematics) and endstops aren't checked
+bool MotionController::moveToVelocity(MotionArgs& args)
+{
+    // Velocity mode starts when nothing else is moving
+    serviceDirectMotion();
+    bool wasActive = _rampGenerator.isVelocityModeActive();
+    if (!wasActive && (isBusy() || _blockManager.isBusy()))
+        return false;
+
+    // Target velocities and accelerations in steps
+    AxesValues<AxisSpeedDataType> stepsPerSec;
+    AxesValues<AxisAccDataType> accStepsPerSec2;
+    bool unitsAreSteps = args.areUnitsSteps();
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        if (!args.getAxesSpecified().getVal(axisIdx))
+            continue;
+        double stepsPerUnit = _axesParams.getStepsPerUnit(axisIdx);
+        AxisSpeedDataType maxStepsPerSec = _axesParams.getMaxSpeedUps(axisIdx) * stepsPerUnit;
+        AxisSpeedDataType velocity = args.getAxesPos().getVal(axisIdx) * (unitsAreSteps ? 1 : stepsPerUnit);
+        stepsPerSec.setVal(axisIdx, UTILS_MAX(UTILS_MIN(velocity, maxStepsPerSec), -maxStepsPerSec));
+        accStepsPerSec2.setVal(axisIdx, _axesParams.getMaxAccelUps2(axisIdx) * stepsPerUnit);
+    }
+
+    // Set the targets (the axes state is updated when velocity mode ends)
+    if (!wasActive)
+        _rampGenerator.getTotalStepPosition(_directMotionStartSteps);
+    if (!_rampGenerator.setVelocityTargets(stepsPerSec, accStepsPerSec2, args.getAxesSpecified()))
+        return false;
+    if (_rampGenerator.isVelocityModeActive())
+    {
+        _directMotionResyncPending = true;
+        _motorEnabler.enableMotors(true, false);
+    }
+#ifdef DEBUG_MOTION_CONTROLLER
+    LOG_I(MODULE_PREFIX, "moveToVelocity %s active %d", stepsPerSec.getDebugJSON("stepsPerSec").c_str(),
+                _rampGenerator.isVelocityModeActive());
+#endif
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Update the axes state when a trajectory stream or velocity mode has ended - planning continues from a
+///        standstill at the position reached
+/// @note Called in the planning context (loop or planner task)
+void MotionController::serviceDirectMotion()
+{
+    if (!_directMotionResyncPending || _rampGenerator.isDirectMotionActive())
+        return;
+
+    // Actuator position moved by the steps done while streaming or in velocity mode
+    AxesValues<AxisStepsDataType> curSteps;
+    _rampGenerator.getTotalStepPosition(curSteps);
+    AxesState axesState = _blockManager.getAxesState();
+    AxesValues<AxisStepsDataType> stepsFromOrigin = axesState.getStepsFromOrigin();
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        stepsFromOrigin.setVal(axisIdx, stepsFromOrigin.getVal(axisIdx) + 
+                    curSteps.getVal(axisIdx) - _directMotionStartSteps.getVal(axisIdx));
+    AxesValues<AxisPosDataType> unitsFromOrigin;
+    _blockManager.actuatorToPt(stepsFromOrigin, unitsFromOrigin);
+    if (axesState.isValid())
+        axesState.setPosition(unitsFromOrigin, stepsFromOrigin, false);
+    else
+        axesState.setStepsFromOriginAndInvalidateUnits(stepsFromOrigin);
+    _blockManager.restartAtStandstill(axesState);
+    _directMotionResyncPending = false;
+#ifdef DEBUG_MOTION_CONTROLLER
+    LOG_I(MODULE_PREFIX, "serviceDirectMotion ended %s", unitsFromOrigin.getDebugJSON("pos").c_str());
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Record the position in the journal when motion completes and invalidate it while moving or when the
+///        motors are disabled
+/// @note Called from loop - the planning lock is held (if it can't be taken immediately this is tried on the next
+///       loop) so the planner task can't change the planning state while it is read
+void MotionController::servicePosJournal()
+{
+    if (!_posJournal.isEnabled())
+        return;
+    MotionPlannerTask::ScopedLock planLock(_planTask, 0);
+    if (!planLock.isLocked())
+        return;
+
+    // Invalidate if the motors have been disabled (unpowered axes may be moved)
+    bool motorsEnabled = _motorEnabler.areMotorsEnabled();
+    if (_posJournalMotorsWereEnabled && !motorsEnabled && _posJournal.invalidateWhenDisabled())
+    {
+        _posJournal.invalidate();
+        _posJournalRecordPending = false;
+    }
+    _posJournalMotorsWereEnabled = motorsEnabled;
+
+    // Invalidate while moving (a restart part way through a move loses the position) - motion is complete when all
+    // steps have been output (including those queued in a hardware pulse engine and the pressure advance settle)
+    if (isBusy() || _blockManager.isBusy() || !_rampGenerator.isOutputIdle())
+    {
+        _posJournal.invalidate();
+        _posJournalRecordPending = true;
+        return;
+    }
+
+    // Record when motion has completed (only if the position is known)
+    if (_posJournalRecordPending)
+    {
+        _posJournalRecordPending = false;
+        if (_blockManager.isAxesStateValid())
+        {
+            AxesValues<AxisStepsDataType> totalSteps;
+            _rampGenerator.getTotalStepPosition(totalSteps);
+            _posJournal.record(_blockManager.getAxesState(), totalSteps);
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check the following error (commanded less encoder position) of each axis with an encoder
+/// @note Called from loop - an axis with onErr "stop" stops motion immediately and one with onErr "correct" is
+///       corrected once motion has stopped (the stop or correction is completed in the planning context)
+void MotionController::serviceEncoders()
+{
+    AxesValues<AxisStepsDataType> cmdSteps;
+    _rampGenerator.getTotalStepPosition(cmdSteps);
+    bool isMoving = isBusy() || _blockManager.isBusy();
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        // Check the following error
+        AxisEncoder& axisEncoder = _axisEncoders[axisIdx];
+        if (!axisEncoder.isValid() || !axisEncoder.update(cmdSteps.getVal(axisIdx)))
+            continue;
+        uint32_t axisBit = 1 << axisIdx;
+        if ((_encoderStopAxesMask | _encoderCorrectAxesMask) & axisBit)
+            continue;
+
+        // Correct at a standstill (stopping if the corrections in a row run out)
+        AxisEncoder::ErrAction errAction = axisEncoder.getErrAction();
+        if (errAction == AxisEncoder::ERR_ACTION_REPORT)
+            continue;
+        if (errAction == AxisEncoder::ERR_ACTION_CORRECT)
+        {
+            if (isMoving)
+                continue;
+            if (axisEncoder.canCorrect())
+            {
+                axisEncoder.recordCorrection();
+                _encoderCorrectAxesMask = _encoderCorrectAxesMask | axisBit;
+                continue;
+            }
+        }
+
+        // Stop
+        _rampGenerator.stop();
+        axisEncoder.recordFault();
+        _encoderStopAxesMask = _encoderStopAxesMask | axisBit;
+        LOG_W(MODULE_PREFIX, "serviceEncoders axis %d following error %d steps - stopping", 
+                    axisIdx, axisEncoder.getFollowingError());
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Complete an encoder stop or correction - once at a standstill the axes state of the axes concerned is
+///        resynced to the encoder position and a correction moves back to the commanded position
+/// @note Called in the planning context (loop or planner task)
+void MotionController::serviceEncoderRecovery()
+{
+    uint32_t stopAxesMask = _encoderStopAxesMask;
+    uint32_t correctAxesMask = _encoderCorrectAxesMask;
+    if ((stopAxesMask | correctAxesMask) == 0)
+        return;
+
+    // A stop discards the move being split up - then wait for a standstill
+    if (stopAxesMask != 0)
+        _blockManager.clear();
+    if (_rampGenerator.isDirectMotionActive() || _directMotionResyncPending ||
+                (_rampGenerator.getMotionPipelineConst().count() > 0))
+        return;
+
+    // Resync the axes to the encoder position
+    AxesValues<AxisStepsDataType> cmdSteps;
+    _rampGenerator.getTotalStepPosition(cmdSteps);
+    AxesValues<AxisStepsDataType> actualSteps = cmdSteps;
+    AxesValues<AxisPosDataType> correctionSteps;
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        if (((stopAxesMask | correctAxesMask) & (1 << axisIdx)) == 0)
+            continue;
+        AxisEncoder& axisEncoder = _axisEncoders[axisIdx];
+        axisEncoder.update(cmdSteps.getVal(axisIdx));
+        int32_t followErrSteps = axisEncoder.getFollowingError();
+        actualSteps.setVal(axisIdx, cmdSteps.getVal(axisIdx) - followErrSteps);
+        _rampGenerator.setTotalStepPosition(axisIdx, actualSteps.getVal(axisIdx));
+        axisEncoder.reference(actualSteps.getVal(axisIdx));
+        if ((stopAxesMask & (1 << axisIdx)) == 0)
+            correctionSteps.setVal(axisIdx, followErrSteps);
+    }
+    AxesState commandedState = _blockManager.getAxesState();
+    AxesState actualState = commandedState;
+    AxesValues<AxisPosDataType> actualUnits;
+    _blockManager.actuatorToPt(actualSteps, actualUnits);
+    if (actualState.isValid())
+        actualState.setPosition(actualUnits, actualSteps, false);
+    else
+        actualState.setStepsFromOriginAndInvalidateUnits(actualSteps);
+    _blockManager.restartAtStandstill(actualState);
+    _encoderStopAxesMask = 0;
+    _encoderCorrectAxesMask = 0;
+
+    // Correction move (in steps) back to the commanded position - the axes state is then the commanded state
+    if (stopAxesMask == 0)
+    {
+        MotionArgs correctionArgs;
+        correctionArgs.setRamped(false);
+        correctionArgs.setRelative(true);
+        correctionArgs.setAxesPositions(correctionSteps);
+        _blockManager.addNonRampedBlock(correctionArgs, _rampGenerator.getMotionPipeline());
+        _blockManager.restartAtStandstill(commandedState);
+        _motorEnabler.enableMotors(true, false);
+    }
+#ifdef DEBUG_MOTION_CONTROLLER
+    LOG_I(MODULE_PREFIX, "serviceEncoderRecovery stopAxes 0x%x correctAxes 0x%x %s", 
+                stopAxesMask, correctAxesMask, actualSteps.getDebugJSON("actual").c_str());
+#endif
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Move to a specific location (relative or absolute) using ramped motion
 /// @param args MotionArgs specify the motion to be performed
@@ -259,11 +723,27 @@ bool MotionController::moveToRamped(MotionArgs& args)
                 args.getAxesPos().getDebugJSON("pos").c_str(), moveDistanceMM, maxBlockDistMM, numBlocks);
 #endif
 
-    // Add to the block splitter
-    _blockManager.addRampedBlock(args, numBlocks);
+    // Replay the move from the library of pre-planned moves if possible (moves not in the library are planned
+    // and added to it)
+    if (!_isPaused && _motionLibrary.replay(args, numBlocks, _blockManager, _rampGenerator.getMotionPipeline()))
+    {
+        _motorEnabler.enableMotors(true, false);
+        return true;
+    }
+
+    // Add to the block splitter (arcs are segmented according to the chord tolerance)
+    if (args.isArc())
+    {
+        if (!_blockManager.addArcBlock(args))
+            return false;
+    }
+    else
+    {
+        _blockManager.addRampedBlock(args, numBlocks);
+    }
 
     // Pump the block splitter to prime the pipeline with blocks
-    _blockManager.pumpBlockSplitter(_rampGenerator.getMotionPipeline());
+    _blockManager.pumpBlockSplitter(_rampGenerator.getMotionPipeline(), _pumpBudgetUs);
 
     // Ok
     return true;
@@ -275,6 +755,17 @@ bool MotionController::moveToRamped(MotionArgs& args)
 /// @param allAxes true to set all axes, false to set a specific axis
 /// @param axisIdx if allAxes is false, the axis to set
 void MotionController::setCurPositionAsOrigin(bool allAxes, uint32_t axisIdx)
+{
+    MotionPlannerTask::ScopedLock planLock(_planTask);
+    setCurPositionAsOriginNow(allAxes, axisIdx);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set current position of the axes as the origin
+/// @param allAxes true to set all axes, false to set a specific axis
+/// @param axisIdx if allAxes is false, the axis to set
+/// @note Called in the planning context (or with the planning lock held)
+void MotionController::setCurPositionAsOriginNow(bool allAxes, uint32_t axisIdx)
 {
     if (!allAxes && (axisIdx >= AXIS_VALUES_MAX_AXES))
         return;
@@ -282,14 +773,110 @@ void MotionController::setCurPositionAsOrigin(bool allAxes, uint32_t axisIdx)
     {
         _rampGenerator.setTotalStepPosition(i, 0);
         _blockManager.setCurPositionAsOrigin(i);
+        _axisEncoders[i].reference(0);
+        _axisEncoders[i].clearFault();
     }
+    _posJournalRecordPending = true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Go to previously set origin position
+/// @param args MotionArgs for the move (speed, feedrate, etc) - the axes specified are moved to their origin
+///        (all axes if none are specified)
 void MotionController::goToOrigin(const MotionArgs &args)
 {
-    // TODO - implement
+    // Absolute ramped move to zero on the axes specified
+    MotionArgs originArgs = args;
+    AxesValues<AxisSpecifiedDataType> axesSpecified = args.getAxesSpecifiedConst();
+    bool anySpecified = false;
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        anySpecified = anySpecified || axesSpecified.getVal(axisIdx);
+    originArgs.setAxesPositions(AxesValues<AxisPosDataType>());
+    if (anySpecified)
+        originArgs.getAxesSpecified() = axesSpecified;
+    originArgs.setRelative(false);
+    originArgs.setRamped(true);
+    originArgs.setUnitsSteps(false);
+    moveTo(originArgs);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start the configured homing sequence
+/// @return false if no homing sequence is configured or the motion controller is busy
+/// @note The sequence is run in the planning context (see serviceHoming) - moves aren't accepted until it ends
+bool MotionController::startHoming()
+{
+    if (!_motionHoming.isConfigured() || isBusy())
+        return false;
+    _homingStartPending = true;
+    _motorEnabler.enableMotors(true, false);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Run the phases of the homing sequence
+/// @note Called in the planning context - a phase is started when the motion of the previous phase has all been
+///       output and the origin of the axis is set when its latch phase ends at the endstop
+void MotionController::serviceHoming()
+{
+    // Start
+    if (_homingStartPending)
+    {
+        _homingStartPending = false;
+        _homingPhaseRunning = false;
+        _motionHoming.start();
+    }
+    if (!_motionHoming.isActive())
+        return;
+
+    // Wait until all motion has been output
+    if (_blockManager.isBusy() || !_rampGenerator.isOutputIdle())
+        return;
+
+    // Phase complete
+    if (_homingPhaseRunning)
+    {
+        _homingPhaseRunning = false;
+        const MotionHoming::Phase* pPhase = _motionHoming.getCurPhase();
+        if (!pPhase)
+            return;
+        uint32_t axisIdx = pPhase->axisIdx;
+        bool toMax = pPhase->toMax;
+
+        // The move may have ended early at the endstop so the axes state is updated from the steps moved
+        AxesValues<AxisStepsDataType> curSteps;
+        _rampGenerator.getTotalStepPosition(curSteps);
+        AxesState axesState = _homingPhaseStartState;
+        AxesValues<AxisStepsDataType> stepsFromOrigin = axesState.getStepsFromOrigin();
+        for (uint32_t i = 0; i < AXIS_VALUES_MAX_AXES; i++)
+            stepsFromOrigin.setVal(i, stepsFromOrigin.getVal(i) + curSteps.getVal(i) - _homingPhaseStartSteps.getVal(i));
+        axesState.setStepsFromOriginAndInvalidateUnits(stepsFromOrigin);
+        _blockManager.restartAtStandstill(axesState);
+
+        // Check the outcome - the ramp generator stops stepping on the tick the endstop is detected and nothing
+        // else can move the axes until the next phase is started here, so the position now is where the endstop
+        // was hit and the origin is set (actuator step count, axes state and encoder together) at that position
+        bool atEndStop = (axisIdx < _axisEndStops.size()) && _axisEndStops[axisIdx] && 
+                    _axisEndStops[axisIdx]->isAtEndStop(toMax);
+        MotionHoming::PhaseResult result = _motionHoming.phaseComplete(_rampGenerator.isEndStopReached(), atEndStop);
+        _rampGenerator.clearEndstopReached();
+        if (result == MotionHoming::PHASE_RESULT_LATCHED)
+            setCurPositionAsOriginNow(false, axisIdx);
+        if (!_motionHoming.isActive())
+            return;
+    }
+
+    // Start the next phase
+    const MotionHoming::Phase* pPhase = _motionHoming.getCurPhase();
+    if (!pPhase)
+        return;
+    _rampGenerator.getTotalStepPosition(_homingPhaseStartSteps);
+    _homingPhaseStartState = _blockManager.getAxesState();
+    _rampGenerator.clearEndstopReached();
+    MotionArgs phaseArgs = pPhase->args;
+    _blockManager.addNonRampedBlock(phaseArgs, _rampGenerator.getMotionPipeline());
+    _motorEnabler.enableMotors(true, false);
+    _homingPhaseRunning = true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -301,7 +888,7 @@ String MotionController::getDataJSON(RaftDeviceJSONLevel level) const
     String jsonBody;
     if (level >= DEVICE_JSON_LEVEL_MIN)
     {
-        jsonBody += "\"ramp\":" + _rampGenerator.getStats().getJSON();
+        jsonBody += "\"ramp\":" + _rampGenerator.getStats().getJSON(true, level == DEVICE_JSON_LEVEL_FULL);
         String driverJson;
         for (StepDriverBase* pStepDriver : _stepperDrivers)
         {
@@ -321,9 +908,21 @@ String MotionController::getDataJSON(RaftDeviceJSONLevel level) const
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Get number of queue slots available for streaming
 /// @return Number of slots
+/// @note While a split move is still being fed into the pipeline new moves are rejected so no slots are reported
 uint32_t MotionController::streamGetQueueSlots() const
 {
-    return _rampGenerator.getMotionPipelineConst().remaining();
+    if (_rampGenerator.getTrajStreamConst().isActive())
+        return trajStreamGetFreeSamples();
+    if (_blockManager.isBusy())
+        return 0;
+    uint32_t slots = _rampGenerator.getMotionPipelineConst().remaining();
+    if (_planTask.isActive())
+    {
+        // Moves queued for the planner task will take pipeline slots
+        uint32_t numQueued = _planTask.getNumQueued();
+        slots = UTILS_MIN(slots > numQueued ? slots - numQueued : 0, _planTask.getQueueSpace());
+    }
+    return slots;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -332,13 +931,23 @@ uint32_t MotionController::streamGetQueueSlots() const
 
 void MotionController::setupAxes(const RaftJsonIF& config)
 {
-    // Setup stepper driver array
+    // Setup stepper driver and endstop arrays (capacity is retained when reconfigured)
     _stepperDrivers.resize(AXIS_VALUES_MAX_AXES);
+    _axisEndStops.reserve(AXIS_VALUES_MAX_AXES);
     for (auto& pDriver : _stepperDrivers)
         pDriver = nullptr;
 
-    // Setup axes params
-    _axesParams.setupAxes(config);
+    // Setup axes params - if enabled the parsed params are restored from the persisted cache when the
+    // config is unchanged (and the cache is refreshed below if not)
+    bool useConfigCache = config.getBool("motion/cfgCache", false);
+    uint32_t configHash = useConfigCache ? MotionConfigCache::getConfigHash(config) : 0;
+    _stepDriverParams.clear();
+    bool fromCache = useConfigCache && _configCache.load(configHash, _axesParams, _stepDriverParams);
+    if (!fromCache)
+    {
+        _axesParams.setupAxes(config);
+        _stepDriverParams.clear();
+    }
 
     // Extract hardware related to axes
     std::vector<String> axesVec;
@@ -354,6 +963,14 @@ void MotionController::setupAxes(const RaftJsonIF& config)
             axisIdx++;
         }
     }
+
+    // Refresh the cache
+    if (useConfigCache && !fromCache)
+        _configCache.store(configHash, _axesParams, _stepDriverParams);
+#ifdef DEBUG_MOTION_CONFIG_CACHE
+    LOG_I(MODULE_PREFIX, "setupAxes config hash %08x %s", configHash, 
+                fromCache ? "from cache" : (useConfigCache ? "parsed (cache refreshed)" : "parsed"));
+#endif
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -370,6 +987,13 @@ void MotionController::setupAxisHardware(uint32_t axisIdx, const RaftJsonIF& con
 
     // Configure the endstops
     setupEndStops(axisIdx, axisName, "endstops", config);
+
+    // Configure the encoder (optional)
+    if (axisIdx < AXIS_VALUES_MAX_AXES)
+    {
+        RaftJsonPrefixed encoderConfig(config, "encoder");
+        _axisEncoders[axisIdx].setup(axisName, encoderConfig);
+    }
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -385,8 +1009,13 @@ void MotionController::setupStepDriver(uint32_t axisIdx, const String& axisName,
     String hwLocation = config.getString("hw", DEFAULT_HARDWARE_LOCATION);
     String driverType = config.getString("driver", DEFAULT_DRIVER_CHIP);
 
-    // Stepper parameters
-    StepDriverParams stepperParams(config);
+    // Stepper parameters (parsed unless restored from the config cache)
+    if (_stepDriverParams.size() <= axisIdx)
+    {
+        _stepDriverParams.resize(axisIdx + 1);
+        _stepDriverParams[axisIdx] = StepDriverParams(config);
+    }
+    const StepDriverParams& stepperParams = _stepDriverParams[axisIdx];
 
     // Handle location
     StepDriverBase* pStepDriver = nullptr; 
@@ -395,7 +1024,13 @@ void MotionController::setupStepDriver(uint32_t axisIdx, const String& axisName,
         // Check driver type
         if (driverType.equalsIgnoreCase("tmc2209"))
         {
-            pStepDriver = new StepDriverTMC2209();
+            pStepDriver = _arena.create<StepDriverTMC2209>();
+            if (!pStepDriver)
+            {
+                LOG_W(MODULE_PREFIX, "setupStepDriver arena full (used %d of %d bytes)", 
+                            _arena.getUsedBytes(), _arena.getSizeBytes());
+                pStepDriver = new StepDriverTMC2209();
+            }
         }
         if (pStepDriver)
         {
@@ -423,7 +1058,13 @@ void MotionController::setupStepDriver(uint32_t axisIdx, const String& axisName,
 void MotionController::setupEndStops(uint32_t axisIdx, const String& axisName, const char* jsonElem, const RaftJsonIF& mainConfig)
 {
     // Endstops
-    EndStops* pEndStops = new EndStops();
+    EndStops* pEndStops = _arena.create<EndStops>(axisIdx);
+    if (!pEndStops)
+    {
+        LOG_W(MODULE_PREFIX, "setupEndStops arena full (used %d of %d bytes)", 
+                    _arena.getUsedBytes(), _arena.getSizeBytes());
+        pEndStops = new EndStops(axisIdx);
+    }
 
     // Config
     std::vector<String> endstopVec;
@@ -442,10 +1083,24 @@ void MotionController::setupEndStops(uint32_t axisIdx, const String& axisName, c
             bool activeLevel = endstopConfig.getBool("actLvl", false);
             String inputTypeStr = endstopConfig.getString("inputType", "INPUT_PULLUP");
             int inputType = ConfigPinMap::getInputType(inputTypeStr.c_str());
+            bool useInterrupt = endstopConfig.getBool("intr", false);
+            uint32_t glitchFilterNs = endstopConfig.getLong("filterNs", 0);
+
+            // A sensorless endstop uses the DIAG pin of the axis driver (active high when StallGuard detects a stall)
+            if (endstopConfig.getBool("sensorless", false))
+            {
+                StepDriverBase* pStepDriver = axisIdx < _stepperDrivers.size() ? _stepperDrivers[axisIdx] : nullptr;
+                pin = pStepDriver ? pStepDriver->getDiagPin() : -1;
+                activeLevel = true;
+                inputType = INPUT;
+                if (pin < 0)
+                    LOG_W(MODULE_PREFIX, "setupEndStops %s sensorless endstop %s has no driver DIAG pin", 
+                                axisName.c_str(), name.c_str());
+            }
             if (pEndStops)
-                pEndStops->add(isMax, name.c_str(), pin, activeLevel, inputType);
-            LOG_I(MODULE_PREFIX, "setupEndStops isMax %d name %s pin %d, activeLevel %d, pinMode %d", 
-                        isMax, name.c_str(), pin, activeLevel, inputType);
+                pEndStops->add(isMax, name.c_str(), pin, activeLevel, inputType, useInterrupt, glitchFilterNs);
+            LOG_I(MODULE_PREFIX, "setupEndStops isMax %d name %s pin %d, activeLevel %d, pinMode %d intr %d filterNs %d", 
+                        isMax, name.c_str(), pin, activeLevel, inputType, useInterrupt, glitchFilterNs);
         }
     }
 
@@ -460,10 +1115,14 @@ void MotionController::setupEndStops(uint32_t axisIdx, const String& axisName, c
 void MotionController::setupSerialBus(RaftBus* pBus, bool useBusForDirectionReversal)
 {
     // Setup bus
+    _busScheduler.setup(pBus);
     for (StepDriverBase* pStepDriver : _stepperDrivers)
     {
         if (pStepDriver)
+        {
             pStepDriver->setupSerialBus(pBus, useBusForDirectionReversal);
+            _busScheduler.addDriver(pStepDriver);
+        }
     }
 }
 
@@ -485,14 +1144,60 @@ void MotionController::setMaxMotorCurrentAmps(uint32_t axisIdx, float maxMotorCu
 AxesValues<AxisPosDataType> MotionController::getLastMonitoredPos() const
 {
     // Get current position
+    uint32_t posSeqNum = _rampGenerator.getPosResetSeqNum();
     AxesValues<AxisStepsDataType> curActuatorPos;
     _rampGenerator.getTotalStepPosition(curActuatorPos);
+
+    // Check the cache (dashboards poll several values derived from the same step counts)
+    bool cacheHit = _monitoredPosCacheValid && (posSeqNum == _monitoredPosCacheSeqNum);
+    for (uint32_t axisIdx = 0; cacheHit && (axisIdx < AXIS_VALUES_MAX_AXES); axisIdx++)
+        cacheHit = curActuatorPos.getVal(axisIdx) == _monitoredPosCacheSteps.getVal(axisIdx);
+    if (cacheHit)
+        return _monitoredPosCache;
+
     // Use reverse kinematics to get location
     AxesValues<AxisPosDataType> lastMonitoredPos;
     _blockManager.actuatorToPt(curActuatorPos, lastMonitoredPos);
+    _monitoredPosCacheSteps = curActuatorPos;
+    _monitoredPosCache = lastMonitoredPos;
+    _monitoredPosCacheSeqNum = posSeqNum;
+    _monitoredPosCacheValid = true;
     return lastMonitoredPos;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the endstop bits
+/// @return Bit (axisIdx * 2) set if the min endstop of an axis is hit and bit (axisIdx * 2 + 1) for the max
+uint32_t MotionController::getEndStopBits() const
+{
+    AxisEndstopChecks endStopStatus;
+    _rampGenerator.getEndStopStatus(endStopStatus);
+    uint32_t endStopBits = 0;
+    for (uint32_t axisIdx = 0; axisIdx <= AxisEndstopChecks::MAX_AXIS_INDEX; axisIdx++)
+    {
+        if (endStopStatus.get(axisIdx, AxisEndstopChecks::MIN_VAL_IDX) == AxisEndstopChecks::END_STOP_HIT)
+            endStopBits |= 1 << (axisIdx * 2);
+        if (endStopStatus.get(axisIdx, AxisEndstopChecks::MAX_VAL_IDX) == AxisEndstopChecks::END_STOP_HIT)
+            endStopBits |= 1 << (axisIdx * 2 + 1);
+    }
+    return endStopBits;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the driver status word
+/// @return Status bits of each driver (StepDriverBase::STATUS_BITS_PER_DRIVER bits per axis)
+uint32_t MotionController::getDriverStatusWord() const
+{
+    uint32_t statusWord = 0;
+    for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+    {
+        if (!_stepperDrivers[axisIdx] || (axisIdx >= 32 / StepDriverBase::STATUS_BITS_PER_DRIVER))
+            continue;
+        statusWord |= _stepperDrivers[axisIdx]->getStatusBits() << (axisIdx * StepDriverBase::STATUS_BITS_PER_DRIVER);
+    }
+    return statusWord;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Get debug string
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -501,6 +1206,25 @@ String MotionController::getDebugJSON(bool includeBraces) const
 {
     String jsonStr = _rampGenerator.getDebugJSON(false) + ",";
     jsonStr += getLastMonitoredPos().getDebugJSON("pos", false);
+    if (_busScheduler.isActive())
+        jsonStr += ",\"busSched\":" + _busScheduler.getDebugJSON(true);
+    if (_planTask.isActive())
+        jsonStr += ",\"planTask\":" + _planTask.getDebugJSON(true);
+    if (_motionLibrary.isEnabled())
+        jsonStr += ",\"moveLib\":" + _motionLibrary.getDebugJSON(true);
+    if (_blockManager.getNumCoalesced() > 0)
+        jsonStr += ",\"coalesced\":" + String(_blockManager.getNumCoalesced());
+    jsonStr += ",\"pump\":" + _blockManager.getPumpStatsJSON(_rampGenerator.getMotionPipelineConst(), true);
+    if (_posJournal.isEnabled())
+        jsonStr += ",\"posJournal\":" + _posJournal.getDebugJSON(true);
+    if (_motionHoming.isConfigured())
+        jsonStr += ",\"homing\":" + _motionHoming.getDebugJSON(true);
+    if (_rampGenerator.getTrajStreamConst().isEnabled())
+        jsonStr += ",\"trajStream\":" + _rampGenerator.getTrajStreamConst().getDebugJSON(true);
+    if (_rampGenerator.isVelocityModeActive())
+        jsonStr += ",\"velMode\":1";
+    if (_rampGenerator.getTimebaseConst().isSynced())
+        jsonStr += ",\"timebase\":" + _rampGenerator.getTimebaseConst().getDebugJSON(true);
     for (StepDriverBase* pStepDriver : _stepperDrivers)
     {
         if (pStepDriver)
@@ -517,5 +1241,13 @@ String MotionController::getDebugJSON(bool includeBraces) const
             jsonStr += pEndStops->getDebugJSON(true, true);
         }
     }
+    String encodersJSON;
+    for (const AxisEncoder& axisEncoder : _axisEncoders)
+    {
+        if (axisEncoder.isValid())
+            encodersJSON += (encodersJSON.length() > 0 ? "," : "") + axisEncoder.getDebugJSON(true);
+    }
+    if (encodersJSON.length() > 0)
+        jsonStr += ",\"enc\":[" + encodersJSON + "]";
     return includeBraces ? "{" + jsonStr + "}" : jsonStr;
 }
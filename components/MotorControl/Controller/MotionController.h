@@ -15,9 +15,16 @@
 #include "RampGenerator.h"
 #include "RaftDeviceJSONLevel.h"
 #include "RaftKinematics.h"
-
-class StepDriverBase;
-class EndStops;
+#include "StepDriverBusScheduler.h"
+#include "MotionPlannerTask.h"
+#include "MotionLibrary.h"
+#include "MotionConfigCache.h"
+#include "PositionJournal.h"
+#include "MotionHoming.h"
+#include "MotionArena.h"
+#include "StepDriverTMC2209.h"
+#include "EndStops.h"
+#include "AxisEncoder.h"
 
 // #define DEBUG_MOTION_CONTROL_TIMER
 
@@ -32,7 +39,8 @@ public:
 
     /// @brief Setup the motion controller
     /// @param config JSON configuration
-    void setup(const RaftJsonIF& config);
+    /// @param pSharedTimer Ramp generator timer shared with other motion controllers (nullptr if not shared)
+    void setup(const RaftJsonIF& config, RampGenTimer* pSharedTimer = nullptr);
 
     /// @brief Deinit the motion controller
     void deinit();
@@ -47,10 +55,13 @@ public:
     /// @param args MotionArgs specify the motion to be performed
     /// @return true if the motion was successfully added to the pipeline
     /// @note The args may be modified so cannot be const
+    /// @note If the planner task is enabled the motion is queued for the task and true is returned if it was queued
     bool moveTo(MotionArgs &args);
 
     /// @brief Pause (or resume) all motion
     /// @param pauseIt true to pause, false to resume
+    /// @note Pausing is a feed hold - motion decelerates to a standstill and on resume the pipeline is
+    ///       replanned from zero speed before motion restarts
     void pause(bool pauseIt);
 
     /// @brief Check if the motion controller is paused
@@ -60,16 +71,38 @@ public:
         return _isPaused;
     }
 
+    /// @brief Set the feed override (percentage of the requested speeds)
+    /// @param feedOverridePercent Override percentage (10..200)
+    /// @note A reduction slows the executing block immediately - an increase applies from the next block
+    void setFeedOverride(uint32_t feedOverridePercent);
+
+    /// @brief Get the feed override
+    /// @return Override percentage
+    uint32_t getFeedOverride() const
+    {
+        return _feedOverridePercent;
+    }
+
     /// @brief Check if the motion controller is busy
     /// @return true if any motion is in the pipeline
     bool isBusy() const;
 
-    // Set current position as home
+    // Set current position as home (the planning lock is taken if the planner task is running)
     void setCurPositionAsOrigin(bool allAxes = true, uint32_t axisIdx = 0);
 
     // Go to previously set home position
     void goToOrigin(const MotionArgs &args);
 
+    /// @brief Start the configured homing sequence (run on the device - see MotionHoming)
+    /// @return false if no homing sequence is configured or the motion controller is busy
+    bool startHoming();
+
+    /// @brief Check if homing is in progress
+    bool isHomingInProgress() const
+    {
+        return _homingStartPending || _motionHoming.isActive();
+    }
+
     // Get last commanded position
     AxesValues<AxisPosDataType> getLastCommandedPos() const;
 
@@ -79,9 +112,63 @@ public:
     // Get data (diagnostics)
     String getDataJSON(RaftDeviceJSONLevel level) const;
 
-    // Get queue slots (buffers) available for streaming
+    // Telemetry values (see the telemetry record in MotorControlMsgFormats.h)
+    void getActuatorSteps(AxesValues<AxisStepsDataType>& actuatorSteps) const
+    {
+        _rampGenerator.getTotalStepPosition(actuatorSteps);
+    }
+    uint32_t getPipelineDepth() const
+    {
+        return _rampGenerator.getMotionPipelineConst().count();
+    }
+    uint32_t getNumAxes() const
+    {
+        uint32_t numAxes = _stepperDrivers.size();
+        while ((numAxes > 0) && !_stepperDrivers[numAxes - 1])
+            numAxes--;
+        return numAxes;
+    }
+    uint32_t getEndStopBits() const;
+    uint32_t getDriverStatusWord() const;
+
+    // Get queue slots (buffers) available for streaming (trajectory stream samples while a trajectory stream is active)
     uint32_t streamGetQueueSlots() const;
 
+    /// @brief Get the motion tracking index of the last completed move (for streaming acknowledgements)
+    /// @param motionTrackingIdx (out) motion tracking index of the last completed move
+    /// @param completedCount (out) count of completed moves which had a motion tracking index
+    /// @return false if no move with a motion tracking index has completed
+    bool streamGetLastCompleted(uint32_t& motionTrackingIdx, uint32_t& completedCount) const
+    {
+        return _rampGenerator.getLastCompletedMotionTrackingIdx(motionTrackingIdx, completedCount);
+    }
+
+    /// @brief Get the time of motion buffered in the pipeline (so a streamer can size its buffering by time)
+    /// @return Time in ms (estimated from the prepared blocks)
+    uint32_t streamGetBufferedMs() const
+    {
+        return _rampGenerator.getMotionPipelineConst().getBufferedUs() / 1000;
+    }
+
+    /// @brief Check if the time of motion buffered is below the streaming low-water mark (more moves are needed
+    ///        to avoid the motion starving)
+    /// @return false if the low-water mark isn't configured
+    bool streamIsLowWater() const
+    {
+        return (_streamLowWaterMs > 0) && (streamGetBufferedMs() < _streamLowWaterMs);
+    }
+
+    /// @brief Set the streaming low-water callback - called (from loop) when the time of motion buffered falls
+    ///        below the streaming low-water mark
+    /// @param pCB Callback (nullptr to remove) - bufferedMs is the time of motion buffered
+    /// @param pArg Argument passed to the callback
+    typedef void (*StreamLowWaterCB)(void* pArg, uint32_t bufferedMs);
+    void setStreamLowWaterCB(StreamLowWaterCB pCB, void* pArg)
+    {
+        _pStreamLowWaterCB = pCB;
+        _pStreamLowWaterCBArg = pArg;
+    }
+
     // Motor on time after move
     void setMotorOnTimeAfterMoveSecs(float motorOnTimeAfterMoveSecs)
     {
@@ -91,6 +178,65 @@ public:
     // Set max motor current (amps)
     void setMaxMotorCurrentAmps(uint32_t axisIdx, float maxMotorCurrent);
 
+    // Reset ISR stats (the ISR histogram is reported in getDataJSON at DEVICE_JSON_LEVEL_FULL)
+    void resetISRStats()
+    {
+        _rampGenerator.resetISRStats();
+    }
+
+    /// @brief Get the most recent block trace records in binary form
+    /// @param buf (out) Buffer - records are appended
+    /// @param maxRecords Maximum number of records
+    /// @param firstSeqNum (out) Sequence number of the first record returned
+    /// @param stepGenPeriodNs (out) Step generation period (ns)
+    /// @return Number of records returned
+    uint32_t getTraceBinary(std::vector<uint8_t>& buf, uint32_t maxRecords, uint32_t& firstSeqNum, uint32_t& stepGenPeriodNs) const
+    {
+        stepGenPeriodNs = _rampGenerator.getPeriodUs() * 1000;
+        return _rampGenerator.getTrace().getRecordsBinary(buf, maxRecords, firstSeqNum);
+    }
+
+    /// @brief Start a trajectory stream - samples of per-axis step deltas are output without planning
+    /// @return false if streaming isn't enabled or the motion controller is busy
+    /// @note Moves are rejected while streaming - the stream is ended with trajStreamEnd() (or a stop)
+    bool trajStreamStart();
+
+    /// @brief End the trajectory stream (streaming stops when all samples have been output and planning then
+    ///        continues from the position reached)
+    void trajStreamEnd()
+    {
+        _rampGenerator.getTrajStream().end();
+    }
+
+    /// @brief Add a sample to the trajectory stream
+    /// @param pSteps Step deltas for each axis
+    /// @param numAxes Number of axes in the sample
+    /// @return false if the stream buffer is full or a step delta exceeds the limit
+    bool trajStreamAddSample(const int16_t* pSteps, uint32_t numAxes)
+    {
+        return _rampGenerator.getTrajStream().addSample(pSteps, numAxes);
+    }
+
+    /// @brief Get the number of samples which can be added to the trajectory stream
+    uint32_t trajStreamGetFreeSamples() const
+    {
+        return _rampGenerator.getTrajStreamConst().getFreeSamples();
+    }
+
+    /// @brief Sync the shared timebase used for moves with a scheduled start time
+    /// @param sharedTimeUs Shared time now (from the controller whose time is the reference)
+    void syncTimebase(uint64_t sharedTimeUs)
+    {
+        _rampGenerator.getTimebase().syncToTime(sharedTimeUs);
+    }
+
+    /// @brief Get the shared time
+    /// @return Shared time (us)
+    uint64_t getSharedTimeUs() const
+    {
+        return _rampGenerator.getTimebaseConst().getSharedTimeUs64();
+    }
+
     // Get debug JSON
     String getDebugJSON(bool includeBraces) const;
 
@@ -98,12 +244,31 @@ private:
     // Debug
     static constexpr const char* MODULE_PREFIX = "MotionController";
 
+    // Arena for the stepper drivers and endstops of all axes (allowing for alignment) - these are constructed
+    // in place when configured so a configuration reload doesn't use the heap
+    static constexpr uint32_t ARENA_SIZE_BYTES = AXIS_VALUES_MAX_AXES *
+                (sizeof(StepDriverTMC2209) + sizeof(EndStops) + 2 * alignof(max_align_t));
+    MotionArena<ARENA_SIZE_BYTES> _arena;
+
     // Axis stepper motors
     std::vector<StepDriverBase*> _stepperDrivers;
 
+    // Parsed step driver parameters (per axis) and the persisted cache of the parsed config
+    std::vector<StepDriverParams> _stepDriverParams;
+    MotionConfigCache _configCache;
+
+    // Scheduler for register reads and writes of the stepper drivers on the serial bus
+    StepDriverBusScheduler _busScheduler;
+
     // Axis end-stops
     std::vector<EndStops*> _axisEndStops;
 
+    // Axis encoders (optional) - the following error of each axis with an encoder is checked in loop() and the
+    // action on an error (stop and resync or a correction move) is carried out in the planning context
+    AxisEncoder _axisEncoders[AXIS_VALUES_MAX_AXES];
+    volatile uint32_t _encoderStopAxesMask = 0;
+    volatile uint32_t _encoderCorrectAxesMask = 0;
+
     // Axes parameters
     AxesParams _axesParams;
 
@@ -115,13 +280,66 @@ private:
 
     // Motor enabler - handles timeout of motor movement
     MotorEnabler _motorEnabler;
+
+    // Library of pre-planned moves (replayed into the pipeline when it is empty)
+    MotionLibrary _motionLibrary;
+
+    // Optional planner task - when running it does all planning (block manager and splitter pumping) and
+    // moves are passed to it through its command queue
+    MotionPlannerTask _planTask;
+
+    // Time budget for each pump of the block splitter (so a pipeline with many free slots is filled over several
+    // calls rather than holding up the main loop)
+    uint32_t _pumpBudgetUs = PUMP_BUDGET_US_DEFAULT;
+
+    // Streaming low-water mark (time of motion buffered in ms - 0 if not used) and callback (called when the
+    // time buffered falls below the mark)
+    uint32_t _streamLowWaterMs = 0;
+    StreamLowWaterCB _pStreamLowWaterCB = nullptr;
+    void* _pStreamLowWaterCBArg = nullptr;
+    bool _streamWasLowWater = true;
     
     // Homing needed
     bool _homingNeededBeforeAnyMove = true;
 
+    // Homing sequence - started from the API context and run in the planning context (a phase is running when
+    // its move has been added) - the axes state and actuator position when the phase started
+    MotionHoming _motionHoming;
+    volatile bool _homingStartPending = false;
+    bool _homingPhaseRunning = false;
+    AxesState _homingPhaseStartState;
+    AxesValues<AxisStepsDataType> _homingPhaseStartSteps;
+
     // Pause status
     bool _isPaused = false;
 
+    // Resume from a feed hold pending (the pipeline is replanned once the ramp generator is held)
+    volatile bool _resumeFromHoldPending = false;
+
+    // Feed override (percent) - the queued blocks are replanned in the planning context when this changes
+    volatile uint32_t _feedOverridePercent = MotionBlock::FEED_OVERRIDE_PERCENT_DEFAULT;
+
+    // Motion not from the pipeline (trajectory stream or velocity mode) - the actuator position when it started
+    // (the axes state is updated from the steps moved when it ends)
+    volatile bool _directMotionResyncPending = false;
+    AxesValues<AxisStepsDataType> _directMotionStartSteps;
+
+    // Position journal (the position is restored after a warm restart) - a record is made when motion completes
+    // or the origin is set and invalidated while moving or when the motors are disabled
+    PositionJournal _posJournal;
+    bool _posJournalRecordPending = false;
+    bool _posJournalMotorsWereEnabled = false;
+
+    // Last monitored position cache - kinematics is only re-evaluated when the step counts (or the position
+    // reset sequence number) differ from those the cached position was computed from
+    mutable AxesValues<AxisStepsDataType> _monitoredPosCacheSteps;
+    mutable AxesValues<AxisPosDataType> _monitoredPosCache;
+    mutable uint32_t _monitoredPosCacheSeqNum = 0;
+    mutable bool _monitoredPosCacheValid = false;
+
+    // Motion phase last passed to the stepper drivers
+    StepDriverBase::MotionPhase _lastMotionPhase = StepDriverBase::MOTION_PHASE_IDLE;
+
     // Helpers
     void setupAxes(const RaftJsonIF& config);
     void setupAxisHardware(uint32_t axisIdx, const RaftJsonIF& config);
@@ -130,6 +348,43 @@ private:
     void setupRampGenerator(const RaftJsonIF& config);
     bool moveToNonRamped(const MotionArgs& args);
 
+    /// @brief Set velocity (jog) mode targets
+    /// @param args MotionArgs with the target velocity of each axis specified
+    /// @return false if other motion is in progress
+    bool moveToVelocity(MotionArgs& args);
+
+    /// @brief Move to a specific location - does the planning immediately (in the caller or planner task context)
+    /// @param args MotionArgs specify the motion to be performed
+    /// @return true if the motion was successfully added to the pipeline
+    bool moveToNow(MotionArgs& args);
+
+    // Planner task service (called in the planner task context)
+    static void planTaskService(void* pArg);
+    void servicePlanTask();
+
+    // Feed hold resume (called in the planning context)
+    void serviceFeedHold();
+
+    // Feed override replanning (called in the planning context)
+    void serviceFeedOverride();
+
+    // Axes state update at the end of a trajectory stream or velocity mode (called in the planning context)
+    void serviceDirectMotion();
+
+    // Encoder following error checks (called from loop) and the resulting stop or correction (called in the
+    // planning context)
+    void serviceEncoders();
+    void serviceEncoderRecovery();
+
+    // Position journal record and invalidation (called from loop - takes the planning lock)
+    void servicePosJournal();
+
+    // Set current position as home (called in the planning context)
+    void setCurPositionAsOriginNow(bool allAxes = true, uint32_t axisIdx = 0);
+
+    // Homing sequence phases (called in the planning context)
+    void serviceHoming();
+
     /// @brief Move to a specific location (relative or absolute) using ramped motion
     /// @param args MotionArgs specify the motion to be performed
     /// @return true if the motion was successfully added to the pipeline
@@ -141,4 +396,5 @@ private:
     static constexpr const char* DEFAULT_HARDWARE_LOCATION = "local";
     static constexpr double distToTravel_ignoreBelow = 0.01f;
     static constexpr uint32_t MAX_TIME_BEFORE_STOP_COMPLETE_MS = 500;
+    static constexpr uint32_t PUMP_BUDGET_US_DEFAULT = 2000;
 };
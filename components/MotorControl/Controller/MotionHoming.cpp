@@ -0,0 +1,182 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionHoming
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MotionHoming.h"
+#include "RaftJson.h"
+#include "Logger.h"
+
+// Debug
+// #define DEBUG_MOTION_HOMING
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup
+/// @param config Homing configuration (JSON) - the axes array holds the sequence (one entry per axis homed)
+/// @note Each axis entry has axis (index), toMax (home to the max endstop), seekSpeed and latchSpeed (steps per
+///       second), seekMaxSteps, backoffSteps and latchMaxSteps
+void MotionHoming::setup(const RaftJsonIF& config)
+{
+    abort();
+    _phases.clear();
+    _isHomed = false;
+
+    // Sequence
+    std::vector<String> axesVec;
+    if (!config.getArrayElems("axes", axesVec))
+        return;
+    for (RaftJson axisConfig : axesVec)
+    {
+        uint32_t axisIdx = axisConfig.getLong("axis", 0);
+        if ((axisIdx >= AXIS_VALUES_MAX_AXES) || (axisIdx > AxisEndstopChecks::MAX_AXIS_INDEX))
+        {
+            LOG_W(MODULE_PREFIX, "setup axis %d invalid", axisIdx);
+            continue;
+        }
+        bool toMax = axisConfig.getBool("toMax", false);
+        double seekSpeed = axisConfig.getDouble("seekSpeed", SEEK_SPEED_DEFAULT);
+        int32_t seekMaxSteps = abs(axisConfig.getLong("seekMaxSteps", SEEK_MAX_STEPS_DEFAULT));
+        int32_t backoffSteps = abs(axisConfig.getLong("backoffSteps", BACKOFF_STEPS_DEFAULT));
+        double latchSpeed = axisConfig.getDouble("latchSpeed", LATCH_SPEED_DEFAULT);
+        int32_t latchMaxSteps = abs(axisConfig.getLong("latchMaxSteps", LATCH_MAX_STEPS_DEFAULT));
+
+        // Phases - the back-off is at the seek speed
+        int32_t dirn = toMax ? 1 : -1;
+        addPhase(axisIdx, PHASE_SEEK, toMax, dirn * seekMaxSteps, seekSpeed);
+        addPhase(axisIdx, PHASE_BACKOFF, toMax, -dirn * backoffSteps, seekSpeed);
+        addPhase(axisIdx, PHASE_LATCH, toMax, dirn * latchMaxSteps, latchSpeed);
+        LOG_I(MODULE_PREFIX, "setup axis %d toMax %d seek %.0f steps/s max %d backoff %d latch %.0f steps/s max %d",
+                    axisIdx, toMax, seekSpeed, seekMaxSteps, backoffSteps, latchSpeed, latchMaxSteps);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start the homing sequence
+/// @return false if no sequence is configured
+bool MotionHoming::start()
+{
+    if (!isConfigured())
+        return false;
+    _isActive = true;
+    _isHomed = false;
+    _curPhaseIdx = 0;
+    _failedPhaseIdx = -1;
+#ifdef DEBUG_MOTION_HOMING
+    LOG_I(MODULE_PREFIX, "start phases %d", (int)_phases.size());
+#endif
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Abort the homing sequence
+void MotionHoming::abort()
+{
+    if (!_isActive)
+        return;
+    _isActive = false;
+    LOG_I(MODULE_PREFIX, "abort phase %d", _curPhaseIdx);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Phase complete
+/// @param endStopReached true if the motion of the phase was ended by its endstop check
+/// @param atEndStop true if the endstop of the axis is active
+/// @return PHASE_RESULT_LATCHED if the latch phase hit the endstop (the origin of the axis is then set),
+///         PHASE_RESULT_FAILED if the endstop wasn't found (or wasn't released by the back-off)
+MotionHoming::PhaseResult MotionHoming::phaseComplete(bool endStopReached, bool atEndStop)
+{
+    const Phase* pPhase = getCurPhase();
+    if (!pPhase)
+        return PHASE_RESULT_FAILED;
+
+    // The seek and latch phases must end at the endstop and the back-off must release it
+    bool phaseOk = pPhase->type == PHASE_BACKOFF ? !atEndStop : endStopReached;
+    if (!phaseOk)
+    {
+        LOG_W(MODULE_PREFIX, "phaseComplete axis %d %s failed (endstop %s)", pPhase->axisIdx,
+                    getPhaseName(pPhase->type), pPhase->type == PHASE_BACKOFF ? "not released" : "not reached");
+        _isActive = false;
+        _failedPhaseIdx = _curPhaseIdx;
+        _numFailed++;
+        return PHASE_RESULT_FAILED;
+    }
+#ifdef DEBUG_MOTION_HOMING
+    LOG_I(MODULE_PREFIX, "phaseComplete axis %d %s", pPhase->axisIdx, getPhaseName(pPhase->type));
+#endif
+
+    // Next phase
+    PhaseResult result = pPhase->type == PHASE_LATCH ? PHASE_RESULT_LATCHED : PHASE_RESULT_NEXT;
+    _curPhaseIdx++;
+    if (_curPhaseIdx >= _phases.size())
+    {
+        _isActive = false;
+        _isHomed = true;
+        _numCompleted++;
+        LOG_I(MODULE_PREFIX, "phaseComplete homing complete");
+    }
+    return result;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add a phase to the sequence
+/// @param axisIdx Axis index
+/// @param type Phase type
+/// @param toMax true if homing to the max endstop
+/// @param steps Steps to move (relative - the endstop check ends the move early)
+/// @param stepsPerSec Step rate
+void MotionHoming::addPhase(uint32_t axisIdx, PhaseType type, bool toMax, int32_t steps, double stepsPerSec)
+{
+    Phase phase;
+    phase.axisIdx = axisIdx;
+    phase.type = type;
+    phase.toMax = toMax;
+    AxesValues<AxisPosDataType> stepsToMove;
+    stepsToMove.setVal(axisIdx, steps);
+    phase.args.setRamped(false);
+    phase.args.setRelative(true);
+    phase.args.setUnitsSteps(true);
+    phase.args.setAxesPositions(stepsToMove);
+    phase.args.setTargetSpeed(stepsPerSec);
+    phase.args.setTestNoEndStops();
+    if (type != PHASE_BACKOFF)
+        phase.args.setTestEndStop(axisIdx, toMax ? AxisEndstopChecks::MAX_VAL_IDX : AxisEndstopChecks::MIN_VAL_IDX,
+                    AxisEndstopChecks::END_STOP_HIT);
+    _phases.push_back(phase);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON
+/// @param includeBraces Include braces
+/// @return JSON string
+String MotionHoming::getDebugJSON(bool includeBraces) const
+{
+    const Phase* pPhase = getCurPhase();
+    String jsonStr = "\"act\":" + String(_isActive ? 1 : 0) +
+                ",\"homed\":" + String(_isHomed ? 1 : 0) +
+                ",\"axis\":" + String(pPhase ? int(pPhase->axisIdx) : -1) +
+                ",\"phase\":\"" + String(pPhase ? getPhaseName(pPhase->type) : "") + "\"" +
+                ",\"done\":" + String(_numCompleted) +
+                ",\"fail\":" + String(_numFailed) +
+                ",\"failPhase\":" + String(_failedPhaseIdx);
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get phase name
+/// @param type Phase type
+/// @return Name
+const char* MotionHoming::getPhaseName(PhaseType type)
+{
+    switch (type)
+    {
+        case PHASE_SEEK: return "seek";
+        case PHASE_BACKOFF: return "backoff";
+        case PHASE_LATCH: return "latch";
+    }
+    return "";
+}
@@ -0,0 +1,114 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionHoming
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "RaftArduino.h"
+#include "RaftJsonIF.h"
+#include "MotionArgs.h"
+
+// Homing sequence engine - runs a configured homing sequence on the device (so homing doesn't wait on the
+// round-trip latency of a host between moves)
+// - each axis in the sequence (in config order) is homed in three phases - a fast seek towards the endstop, a
+//   back-off until the endstop is released and a slow latch back onto the endstop
+// - the moves of all phases (non-ramped step moves with endstop checks) are computed when the config is read
+// - the motion controller runs the phases in the planning context - each phase is started when the motion of the
+//   previous phase is complete and the origin of the axis is set where the latch phase hits the endstop
+class MotionHoming
+{
+public:
+    // Phases
+    enum PhaseType
+    {
+        PHASE_SEEK,
+        PHASE_BACKOFF,
+        PHASE_LATCH
+    };
+    struct Phase
+    {
+        uint32_t axisIdx = 0;
+        PhaseType type = PHASE_SEEK;
+        bool toMax = false;
+        MotionArgs args;
+    };
+
+    // Result of a phase
+    enum PhaseResult
+    {
+        PHASE_RESULT_NEXT,
+        PHASE_RESULT_LATCHED,
+        PHASE_RESULT_FAILED
+    };
+
+    // Setup (homing config JSON)
+    void setup(const RaftJsonIF& config);
+
+    // Check if a homing sequence is configured
+    bool isConfigured() const
+    {
+        return _phases.size() > 0;
+    }
+
+    // Start the sequence (returns false if no sequence is configured) and abort it
+    bool start();
+    void abort();
+
+    // Check if the sequence is running and if it has completed (since the last start)
+    bool isActive() const
+    {
+        return _isActive;
+    }
+    bool isHomed() const
+    {
+        return _isHomed;
+    }
+
+    // Phase to run (nullptr if the sequence isn't running)
+    const Phase* getCurPhase() const
+    {
+        if (!_isActive || (_curPhaseIdx >= _phases.size()))
+            return nullptr;
+        return &_phases[_curPhaseIdx];
+    }
+
+    // Phase complete (its motion has finished) - endStopReached is true if the phase was ended by its endstop check
+    // and atEndStop if the endstop of the axis is active now - the sequence stops if the phase failed
+    PhaseResult phaseComplete(bool endStopReached, bool atEndStop);
+
+    // Debug
+    String getDebugJSON(bool includeBraces) const;
+    static const char* getPhaseName(PhaseType type);
+
+private:
+    // Phases of the sequence
+    std::vector<Phase> _phases;
+
+    // State
+    bool _isActive = false;
+    bool _isHomed = false;
+    uint32_t _curPhaseIdx = 0;
+
+    // Stats
+    uint32_t _numCompleted = 0;
+    uint32_t _numFailed = 0;
+    int _failedPhaseIdx = -1;
+
+    // Helpers
+    void addPhase(uint32_t axisIdx, PhaseType type, bool toMax, int32_t steps, double stepsPerSec);
+
+    // Defaults (steps and steps per second)
+    static constexpr double SEEK_SPEED_DEFAULT = 2000;
+    static constexpr int32_t SEEK_MAX_STEPS_DEFAULT = 100000;
+    static constexpr int32_t BACKOFF_STEPS_DEFAULT = 400;
+    static constexpr double LATCH_SPEED_DEFAULT = 200;
+    static constexpr int32_t LATCH_MAX_STEPS_DEFAULT = 1000;
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "MotionHoming";
+};
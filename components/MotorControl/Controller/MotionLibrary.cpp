@@ -0,0 +1,300 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionLibrary
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include "MotionLibrary.h"
+#include "RaftUtils.h"
+#include "Logger.h"
+
+// Debug
+// #define DEBUG_MOTION_LIBRARY
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Constructor
+/// @param motorEnabler object to enable/disable motors
+/// @param axesParams parameters for the axes
+MotionLibrary::MotionLibrary(MotorEnabler& motorEnabler, AxesParams& axesParams) :
+            _planBlockManager(motorEnabler, axesParams)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup
+/// @param stepGenPeriodUs Period of the step generator in microseconds
+/// @param accelTickNs Period at which acceleration is applied in nanoseconds
+/// @param libraryConfig Library configuration (JSON)
+/// @param motionConfig Motion configuration (JSON) - used to plan moves in the same way as the live pipeline
+void MotionLibrary::setup(uint32_t stepGenPeriodUs, uint32_t accelTickNs, const RaftJsonIF& libraryConfig,
+                const RaftJsonIF& motionConfig)
+{
+    // Settings
+    _maxBlocks = libraryConfig.getLong("maxBlocks", 0);
+    _maxMoves = UTILS_MAX(libraryConfig.getLong("maxMoves", MAX_MOVES_DEFAULT), 1);
+    _maxBlocksPerMove = UTILS_MAX(libraryConfig.getLong("maxBlocksPerMove", MAX_BLOCKS_PER_MOVE_DEFAULT), 1);
+    _maxBlocksPerMove = UTILS_MIN(_maxBlocksPerMove, _maxBlocks);
+    clear();
+    _entries.shrink_to_fit();
+    _blocks.shrink_to_fit();
+    _stepSegs.shrink_to_fit();
+    if (!isEnabled())
+        return;
+
+    // Arena and entries are allocated up front
+    _entries.reserve(_maxMoves);
+    _blocks.reserve(_maxBlocks);
+    _stepSegs.reserve(_maxBlocks);
+
+    // Planning (the pipeline holds all the blocks of a move - one extra element as the ring buffer keeps a gap)
+    _planBlockManager.setup(stepGenPeriodUs, accelTickNs, motionConfig);
+    if (!_planPipeline.setup(_maxBlocksPerMove + 1))
+    {
+        LOG_E(MODULE_PREFIX, "setup failed to allocate planning pipeline len %d", _maxBlocksPerMove + 1);
+        _maxBlocks = 0;
+        return;
+    }
+    LOG_I(MODULE_PREFIX, "setup maxBlocks %d maxMoves %d maxBlocksPerMove %d", _maxBlocks, _maxMoves, _maxBlocksPerMove);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Clear all moves
+void MotionLibrary::clear()
+{
+    _entries.clear();
+    _blocks.clear();
+    _stepSegs.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Replay a ramped move into the pipeline
+/// @param args Motion args (pre-processed so that the axes positions are absolute)
+/// @param numBlocks Number of blocks to split the move into (as for MotionBlockManager::addRampedBlock)
+/// @param blockManager Block manager for the live pipeline (its axes state is updated to the end of the move)
+/// @param motionPipeline Motion pipeline (must be empty)
+/// @return false if the move can't be replayed - it must then be planned normally
+bool MotionLibrary::replay(const MotionArgs& args, uint32_t numBlocks, MotionBlockManager& blockManager,
+                MotionPipelineIF& motionPipeline)
+{
+    // Check the move can be replayed - the blocks were planned from a standstill
+    if (!isEnabled() || (motionPipeline.count() != 0) || blockManager.isBusy() ||
+                args.getEndstopCheck().any() || (numBlocks > _maxBlocksPerMove))
+        return false;
+
+    // Find the move (planning it if it isn't in the library)
+    Key key;
+    if (!makeKey(args, numBlocks, blockManager.getAxesState(), blockManager.getFeedOverride(), key))
+        return false;
+    uint32_t hash = hashKey(key);
+    const Entry* pEntry = findEntry(key, hash);
+    if (pEntry)
+    {
+        _numHits++;
+    }
+    else
+    {
+        _numMisses++;
+        pEntry = learn(args, numBlocks, blockManager, key, hash);
+        if (!pEntry)
+        {
+            _numNotStored++;
+            return false;
+        }
+    }
+    if (motionPipeline.remaining() < pEntry->_numBlocks)
+        return false;
+
+    // Copy the blocks into the pipeline - only the first block carries the scheduled start time and only the
+    // last block carries the motion tracking index
+    for (uint32_t i = 0; i < pEntry->_numBlocks; i++)
+    {
+        uint32_t blockIdx = pEntry->_firstBlockIdx + i;
+        bool isFirst = i == 0;
+        bool isLast = i + 1 == pEntry->_numBlocks;
+        if (!isFirst && !isLast)
+        {
+            motionPipeline.add(_blocks[blockIdx], _stepSegs[blockIdx]);
+            continue;
+        }
+        MotionStepSegment stepSeg = _stepSegs[blockIdx];
+        stepSeg._startTimeValid = false;
+        if (isFirst && args.isStartTimeValid())
+            stepSeg.setStartTimeUs(args.getStartTimeUs());
+        if (isLast)
+        {
+            stepSeg._motionTrackingIndexValid = false;
+            if (args.isMotionTrackingIndexValid())
+                stepSeg.setMotionTrackingIndex(args.getMotionTrackingIndex());
+        }
+        motionPipeline.add(_blocks[blockIdx], stepSeg);
+    }
+
+    // Continue planning from the end of the move
+    blockManager.restartAtStandstill(pEntry->_endState);
+
+#ifdef DEBUG_MOTION_LIBRARY
+    LOG_I(MODULE_PREFIX, "replay hash %08x blocks %d hits %d misses %d",
+                hash, pEntry->_numBlocks, _numHits, _numMisses);
+#endif
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Plan a move from a standstill and add it to the library
+/// @param args Motion args (pre-processed)
+/// @param numBlocks Number of blocks to split the move into
+/// @param blockManager Block manager for the live pipeline (the move starts from its axes state)
+/// @param key Key for the move
+/// @param hash Hash of the key
+/// @return Entry for the move or nullptr if it couldn't be planned or stored
+const MotionLibrary::Entry* MotionLibrary::learn(const MotionArgs& args, uint32_t numBlocks,
+                const MotionBlockManager& blockManager, const Key& key, uint32_t hash)
+{
+    // Plan the move into the planning pipeline
+    _planPipeline.clear();
+    _planBlockManager.restartAtStandstill(blockManager.getAxesState());
+    _planBlockManager.setFeedOverride(blockManager.getFeedOverride(), _planPipeline);
+    if (args.isArc())
+    {
+        if (!_planBlockManager.addArcBlock(args))
+            return nullptr;
+    }
+    else
+    {
+        _planBlockManager.addRampedBlock(args, numBlocks);
+    }
+    _planBlockManager.pumpBlockSplitter(_planPipeline);
+
+    // Check the whole move was planned and every block is ready to step
+    uint32_t numPlanned = _planPipeline.count();
+    if (_planBlockManager.isBusy() || (numPlanned == 0))
+    {
+        _planBlockManager.clear();
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < numPlanned; i++)
+    {
+        MotionStepSegment* pStepSeg = _planPipeline.peekStepSegNthFromGet(i);
+        if (!pStepSeg || !pStepSeg->_canExecute)
+            return nullptr;
+    }
+
+    // Make space (the library is cleared when full)
+    if ((_entries.size() >= _maxMoves) || (_blocks.size() + numPlanned > _maxBlocks))
+    {
+        clear();
+        _numClears++;
+    }
+
+    // Add to the arena
+    Entry entry;
+    entry._key = key;
+    entry._hash = hash;
+    entry._firstBlockIdx = _blocks.size();
+    entry._numBlocks = numPlanned;
+    entry._endState = _planBlockManager.getAxesState();
+    for (uint32_t i = 0; i < numPlanned; i++)
+    {
+        _blocks.push_back(*_planPipeline.peekNthFromGet(i));
+        _stepSegs.push_back(*_planPipeline.peekStepSegNthFromGet(i));
+    }
+    _entries.push_back(entry);
+    _planPipeline.clear();
+
+#ifdef DEBUG_MOTION_LIBRARY
+    LOG_I(MODULE_PREFIX, "learn hash %08x blocks %d moves %d arenaBlocks %d",
+                hash, numPlanned, _entries.size(), _blocks.size());
+#endif
+    return &_entries.back();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Make the key for a move
+/// @param args Motion args (pre-processed)
+/// @param numBlocks Number of blocks to split the move into
+/// @param axesState State of the axes at the start of the move
+/// @param feedOverridePercent Feed override
+/// @param key (out) Key
+/// @return false if the axes state isn't valid
+bool MotionLibrary::makeKey(const MotionArgs& args, uint32_t numBlocks, const AxesState& axesState,
+                uint32_t feedOverridePercent, Key& key)
+{
+    if (!axesState.isValid())
+        return false;
+    memset(&key, 0, sizeof(key));
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        key._targetPos[axisIdx] = args.getAxesPosConst().getVal(axisIdx);
+        key._startUnits[axisIdx] = axesState.getUnitsFromOrigin(axisIdx);
+        key._startSteps[axisIdx] = axesState.getStepsFromOrigin(axisIdx);
+        key._startResidual[axisIdx] = axesState.getStepResidual(axisIdx);
+        if (args.getAxesSpecifiedConst().getVal(axisIdx))
+            key._axesSpecified |= 1 << axisIdx;
+    }
+    key._targetSpeed = args.isTargetSpeedValid() ? args.getTargetSpeed() : 0;
+    key._feedrate = args.getFeedrate();
+    if (args.isArc())
+    {
+        key._arcCentreOffsetI = args.getArcCentreOffsetI();
+        key._arcCentreOffsetJ = args.getArcCentreOffsetJ();
+    }
+    key._flags = (args.isRelative() ? 0x01 : 0) |
+                (args.isTargetSpeedValid() ? 0x02 : 0) |
+                (args.isFeedrateUnitsPerMin() ? 0x04 : 0) |
+                (args.isMoveRapid() ? 0x08 : 0) |
+                (args.dontSplitMove() ? 0x10 : 0) |
+                (args.constrainToBounds() ? 0x20 : 0) |
+                (args.isArc() ? 0x40 : 0) |
+                (args.isMoveClockwise() ? 0x80 : 0);
+    key._numBlocks = numBlocks;
+    key._feedOverridePercent = feedOverridePercent;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Hash a key (FNV-1a)
+/// @param key Key
+/// @return Hash
+uint32_t MotionLibrary::hashKey(const Key& key)
+{
+    const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(&key);
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < sizeof(key); i++)
+        hash = (hash ^ pBytes[i]) * 16777619u;
+    return hash;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Find a move in the library
+/// @param key Key
+/// @param hash Hash of the key
+/// @return Entry or nullptr if not found
+const MotionLibrary::Entry* MotionLibrary::findEntry(const Key& key, uint32_t hash) const
+{
+    for (const Entry& entry : _entries)
+    {
+        if ((entry._hash == hash) && (memcmp(&entry._key, &key, sizeof(key)) == 0))
+            return &entry;
+    }
+    return nullptr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON
+/// @param includeBraces Include braces
+/// @return JSON string
+String MotionLibrary::getDebugJSON(bool includeBraces) const
+{
+    String jsonStr = "\"moves\":" + String(_entries.size()) +
+                ",\"blocks\":" + String(_blocks.size()) +
+                ",\"hits\":" + String(_numHits) +
+                ",\"misses\":" + String(_numMisses) +
+                ",\"notStored\":" + String(_numNotStored) +
+                ",\"clears\":" + String(_numClears);
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
@@ -0,0 +1,114 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionLibrary
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "RaftJsonIF.h"
+#include "AxesState.h"
+#include "MotionArgs.h"
+#include "MotionPipeline.h"
+#include "MotionBlockManager.h"
+
+// Library of pre-planned moves - repeated moves (e.g. pick-and-place cycles) are replayed from fully planned and
+// prepared blocks rather than being transformed, split and planned each time
+// - a move is keyed on the start state of the axes, the (pre-processed) motion args and the feed override
+// - a move which isn't in the library is planned from a standstill into a private pipeline (using the same
+//   kinematics, splitting and planning as the live pipeline) and the blocks are copied into a block arena
+// - moves can only be replayed into an empty pipeline (the blocks were planned from a standstill) and once
+//   replayed the next move is planned as if from a standstill (no junction speed with the replayed move)
+// - when the arena or entry table is full the library is cleared and refilled
+class MotionLibrary
+{
+public:
+    MotionLibrary(MotorEnabler& motorEnabler, AxesParams& axesParams);
+
+    // Setup - the library is only enabled if maxBlocks is non-zero in the config
+    void setup(uint32_t stepGenPeriodUs, uint32_t accelTickNs, const RaftJsonIF& libraryConfig,
+                const RaftJsonIF& motionConfig);
+
+    // Clear all moves (must be done if anything which affects planning changes - e.g. the origin)
+    void clear();
+
+    // Check if enabled
+    bool isEnabled() const
+    {
+        return _maxBlocks > 0;
+    }
+
+    // Replay a ramped move into the pipeline (planning it and adding it to the library if it isn't there)
+    // Returns false if the move can't be replayed - it must then be planned normally
+    bool replay(const MotionArgs& args, uint32_t numBlocks, MotionBlockManager& blockManager,
+                MotionPipelineIF& motionPipeline);
+
+    // Debug
+    String getDebugJSON(bool includeBraces) const;
+
+private:
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "MotionLibrary";
+
+    // Defaults
+    static constexpr uint32_t MAX_MOVES_DEFAULT = 32;
+    static constexpr uint32_t MAX_BLOCKS_PER_MOVE_DEFAULT = 64;
+
+    // Key - everything which affects the planned blocks (compared as bytes so it is cleared before filling)
+    struct Key
+    {
+        AxisPosDataType _targetPos[AXIS_VALUES_MAX_AXES];
+        AxisPosDataType _startUnits[AXIS_VALUES_MAX_AXES];
+        AxisStepsDataType _startSteps[AXIS_VALUES_MAX_AXES];
+        AxisCalcDataType _startResidual[AXIS_VALUES_MAX_AXES];
+        double _targetSpeed;
+        double _feedrate;
+        AxisPosDataType _arcCentreOffsetI;
+        AxisPosDataType _arcCentreOffsetJ;
+        uint32_t _axesSpecified;
+        uint32_t _flags;
+        uint32_t _numBlocks;
+        uint32_t _feedOverridePercent;
+    };
+
+    // Move in the library
+    struct Entry
+    {
+        Key _key;
+        uint32_t _hash = 0;
+        uint32_t _firstBlockIdx = 0;
+        uint32_t _numBlocks = 0;
+        AxesState _endState;
+    };
+
+    // Settings
+    uint32_t _maxBlocks = 0;
+    uint32_t _maxMoves = MAX_MOVES_DEFAULT;
+    uint32_t _maxBlocksPerMove = MAX_BLOCKS_PER_MOVE_DEFAULT;
+
+    // Moves and the block arena (blocks of a move are contiguous)
+    std::vector<Entry> _entries;
+    std::vector<MotionBlock> _blocks;
+    std::vector<MotionStepSegment> _stepSegs;
+
+    // Block manager and pipeline used to plan moves which aren't in the library
+    MotionBlockManager _planBlockManager;
+    MotionPipeline _planPipeline;
+
+    // Stats
+    uint32_t _numHits = 0;
+    uint32_t _numMisses = 0;
+    uint32_t _numNotStored = 0;
+    uint32_t _numClears = 0;
+
+    // Helpers
+    static bool makeKey(const MotionArgs& args, uint32_t numBlocks, const AxesState& axesState,
+                uint32_t feedOverridePercent, Key& key);
+    static uint32_t hashKey(const Key& key);
+    const Entry* findEntry(const Key& key, uint32_t hash) const;
+    const Entry* learn(const MotionArgs& args, uint32_t numBlocks, const MotionBlockManager& blockManager,
+                const Key& key, uint32_t hash);
+};
@@ -0,0 +1,184 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionPerfCounters
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MotionPerfCounters.h"
+#include "MotorControlMsgFormats.h"
+
+// Slots
+MotionPerfCounters::TimerSlot MotionPerfCounters::_timers[NUM_TIMERS];
+std::atomic<uint32_t> MotionPerfCounters::_counters[NUM_COUNTERS] = {};
+uint32_t MotionPerfCounters::_resetMs = 0;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Record a time
+/// @param timerId Timer
+/// @param elapsedUs Elapsed time in microseconds
+void MotionPerfCounters::recordTime(TimerId timerId, uint32_t elapsedUs)
+{
+    if (timerId >= NUM_TIMERS)
+        return;
+    TimerSlot& timer = _timers[timerId];
+    timer.count.fetch_add(1, std::memory_order_relaxed);
+
+    // The total (and the number of times in it) are halved if the total would overflow so the average is kept
+    uint32_t totalUs = timer.totalUs.load(std::memory_order_relaxed);
+    uint32_t totalCount = timer.totalCount.load(std::memory_order_relaxed);
+    if (totalUs > UINT32_MAX - elapsedUs)
+    {
+        totalUs /= 2;
+        totalCount /= 2;
+    }
+    timer.totalUs.store(totalUs + elapsedUs, std::memory_order_relaxed);
+    timer.totalCount.store(totalCount + 1, std::memory_order_relaxed);
+    uint32_t curUs = timer.minUs.load(std::memory_order_relaxed);
+    while ((elapsedUs < curUs) && !timer.minUs.compare_exchange_weak(curUs, elapsedUs, std::memory_order_relaxed))
+        ;
+    curUs = timer.maxUs.load(std::memory_order_relaxed);
+    while ((elapsedUs > curUs) && !timer.maxUs.compare_exchange_weak(curUs, elapsedUs, std::memory_order_relaxed))
+        ;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get timer values
+/// @param timerId Timer
+/// @param count (out) Number of times recorded
+/// @param minUs (out) Minimum time (0 if none recorded)
+/// @param maxUs (out) Maximum time
+/// @param avgUs (out) Average time
+void MotionPerfCounters::getTimer(TimerId timerId, uint32_t& count, uint32_t& minUs, uint32_t& maxUs, uint32_t& avgUs)
+{
+    count = minUs = maxUs = avgUs = 0;
+    if (timerId >= NUM_TIMERS)
+        return;
+    const TimerSlot& timer = _timers[timerId];
+    count = timer.count.load(std::memory_order_relaxed);
+    if (count == 0)
+        return;
+    minUs = timer.minUs.load(std::memory_order_relaxed);
+    maxUs = timer.maxUs.load(std::memory_order_relaxed);
+    uint32_t totalCount = timer.totalCount.load(std::memory_order_relaxed);
+    if (totalCount > 0)
+        avgUs = timer.totalUs.load(std::memory_order_relaxed) / totalCount;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Reset all counters and timers
+void MotionPerfCounters::reset()
+{
+    for (TimerSlot& timer : _timers)
+    {
+        timer.count.store(0, std::memory_order_relaxed);
+        timer.minUs.store(UINT32_MAX, std::memory_order_relaxed);
+        timer.maxUs.store(0, std::memory_order_relaxed);
+        timer.totalUs.store(0, std::memory_order_relaxed);
+        timer.totalCount.store(0, std::memory_order_relaxed);
+    }
+    for (std::atomic<uint32_t>& counter : _counters)
+        counter.store(0, std::memory_order_relaxed);
+    _resetMs = millis();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the size of the binary record
+/// @return Size in bytes
+uint32_t MotionPerfCounters::getBinarySize()
+{
+    return MULTISTEPPER_PERF_HEADER_SIZE + NUM_TIMERS * MULTISTEPPER_PERF_TIMER_SIZE +
+                NUM_COUNTERS * MULTISTEPPER_PERF_COUNTER_SIZE;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the registry in binary form (MULTISTEPPER_PERF_BINARY_FORMAT_1)
+/// @param pBuf Buffer to receive the record (must be at least getBinarySize() bytes)
+void MotionPerfCounters::getBinary(uint8_t* pBuf)
+{
+    auto putBEUint32 = [](uint8_t*& pDest, uint32_t val) {
+        for (uint32_t i = 0; i < 4; i++)
+            *pDest++ = (val >> (24 - i * 8)) & 0xff;
+    };
+
+    // Header
+    pBuf[MULTISTEPPER_PERF_FORMAT_POS] = MULTISTEPPER_PERF_BINARY_FORMAT_1;
+    pBuf[MULTISTEPPER_PERF_NUM_TIMERS_POS] = NUM_TIMERS;
+    pBuf[MULTISTEPPER_PERF_NUM_COUNTERS_POS] = NUM_COUNTERS;
+    pBuf[MULTISTEPPER_PERF_RESERVED_POS] = 0;
+    uint8_t* pDest = pBuf + MULTISTEPPER_PERF_MS_SINCE_RESET_POS;
+    putBEUint32(pDest, getMsSinceReset());
+
+    // Timers then counters
+    for (uint32_t timerIdx = 0; timerIdx < NUM_TIMERS; timerIdx++)
+    {
+        uint32_t count = 0, minUs = 0, maxUs = 0, avgUs = 0;
+        getTimer(TimerId(timerIdx), count, minUs, maxUs, avgUs);
+        putBEUint32(pDest, count);
+        putBEUint32(pDest, minUs);
+        putBEUint32(pDest, maxUs);
+        putBEUint32(pDest, avgUs);
+    }
+    for (uint32_t counterIdx = 0; counterIdx < NUM_COUNTERS; counterIdx++)
+        putBEUint32(pDest, getCounter(CounterId(counterIdx)));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the registry as JSON
+/// @param includeBraces Include braces
+/// @return JSON string - each timer is an array [count, minUs, maxUs, avgUs]
+String MotionPerfCounters::getJSON(bool includeBraces)
+{
+    String jsonStr = "\"ms\":" + String(getMsSinceReset());
+    for (uint32_t timerIdx = 0; timerIdx < NUM_TIMERS; timerIdx++)
+    {
+        uint32_t count = 0, minUs = 0, maxUs = 0, avgUs = 0;
+        getTimer(TimerId(timerIdx), count, minUs, maxUs, avgUs);
+        jsonStr += ",\"" + String(getTimerName(TimerId(timerIdx))) + "\":[" + String(count) + "," + String(minUs) +
+                    "," + String(maxUs) + "," + String(avgUs) + "]";
+    }
+    for (uint32_t counterIdx = 0; counterIdx < NUM_COUNTERS; counterIdx++)
+        jsonStr += ",\"" + String(getCounterName(CounterId(counterIdx))) + "\":" +
+                    String(getCounter(CounterId(counterIdx)));
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get timer name
+/// @param timerId Timer
+/// @return Name
+const char* MotionPerfCounters::getTimerName(TimerId timerId)
+{
+    switch (timerId)
+    {
+        case TIMER_PLANNER_RECALC: return "plan";
+        case TIMER_KINEMATICS_PT_TO_ACT: return "kin";
+        case TIMER_JSON_PARSE: return "json";
+        case TIMER_UART_TRANSACTION: return "uart";
+        case TIMER_SPLITTER_PUMP: return "pump";
+        default: break;
+    }
+    return "";
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get counter name
+/// @param counterId Counter
+/// @return Name
+const char* MotionPerfCounters::getCounterName(CounterId counterId)
+{
+    switch (counterId)
+    {
+        case COUNTER_BLOCKS_PLANNED: return "blocks";
+        case COUNTER_KINEMATICS_FAILED: return "kinFail";
+        case COUNTER_JSON_PARSE_FAILED: return "jsonFail";
+        case COUNTER_UART_READ_TIMEOUTS: return "uartTO";
+        case COUNTER_UART_CRC_ERRORS: return "uartCRC";
+        case COUNTER_PUMP_BUDGET_HITS: return "pumpBudget";
+        default: break;
+    }
+    return "";
+}
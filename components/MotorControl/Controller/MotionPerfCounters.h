@@ -0,0 +1,120 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionPerfCounters
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include "RaftArduino.h"
+#include "esp_attr.h"
+
+// Performance counters registry - a single registry (shared by all motion groups) of counters and timers at named
+// points across the motor control subsystems so performance can be compared across firmware versions
+// - slots are fixed (new slots are only ever added at the end of the lists) so the binary record
+//   (MULTISTEPPER_PERF_BINARY_FORMAT_1) can be read by index and older readers ignore slots they don't know
+// - counters are atomic and can be incremented from an ISR - timers (count, min, max and average in us) are
+//   recorded from task context only (by one task at a time for each timer)
+// - all slots are 32 bits as 64-bit atomics aren't lock-free on all targets (e.g. Xtensa)
+class MotionPerfCounters
+{
+public:
+    // Timers
+    enum TimerId
+    {
+        TIMER_PLANNER_RECALC,
+        TIMER_KINEMATICS_PT_TO_ACT,
+        TIMER_JSON_PARSE,
+        TIMER_UART_TRANSACTION,
+        TIMER_SPLITTER_PUMP,
+        NUM_TIMERS
+    };
+
+    // Counters
+    enum CounterId
+    {
+        COUNTER_BLOCKS_PLANNED,
+        COUNTER_KINEMATICS_FAILED,
+        COUNTER_JSON_PARSE_FAILED,
+        COUNTER_UART_READ_TIMEOUTS,
+        COUNTER_UART_CRC_ERRORS,
+        COUNTER_PUMP_BUDGET_HITS,
+        NUM_COUNTERS
+    };
+
+    // Increment a counter
+    static void IRAM_ATTR incCounter(CounterId counterId, uint32_t n = 1)
+    {
+        if (counterId < NUM_COUNTERS)
+            _counters[counterId].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // Record a time
+    static void recordTime(TimerId timerId, uint32_t elapsedUs);
+
+    // Timer which records the time from construction to destruction
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(TimerId timerId) : _timerId(timerId), _startUs(micros())
+        {
+        }
+        ~ScopedTimer()
+        {
+            recordTime(_timerId, micros() - _startUs);
+        }
+    private:
+        TimerId _timerId;
+        uint32_t _startUs;
+    };
+
+    // Get values
+    static uint32_t getCounter(CounterId counterId)
+    {
+        return counterId < NUM_COUNTERS ? _counters[counterId].load(std::memory_order_relaxed) : 0;
+    }
+    static void getTimer(TimerId timerId, uint32_t& count, uint32_t& minUs, uint32_t& maxUs, uint32_t& avgUs);
+    static uint32_t getMsSinceReset()
+    {
+        return millis() - _resetMs;
+    }
+
+    // Reset all counters and timers
+    static void reset();
+
+    // Get the registry in binary form (MULTISTEPPER_PERF_BINARY_FORMAT_1) and as JSON
+    static uint32_t getBinarySize();
+    static void getBinary(uint8_t* pBuf);
+    static String getJSON(bool includeBraces);
+
+    // Names (used as JSON keys)
+    static const char* getTimerName(TimerId timerId);
+    static const char* getCounterName(CounterId counterId);
+
+private:
+    // Timer slot
+    struct TimerSlot
+    {
+        constexpr TimerSlot() : count(0), minUs(UINT32_MAX), maxUs(0), totalUs(0), totalCount(0)
+        {
+        }
+        std::atomic<uint32_t> count;
+        std::atomic<uint32_t> minUs;
+        std::atomic<uint32_t> maxUs;
+        // Total time and the number of times in the total (for the average) - both are halved when the total
+        // would overflow
+        std::atomic<uint32_t> totalUs;
+        std::atomic<uint32_t> totalCount;
+    };
+
+    // Slots
+    static TimerSlot _timers[NUM_TIMERS];
+    static std::atomic<uint32_t> _counters[NUM_COUNTERS];
+
+    // Time of last reset
+    static uint32_t _resetMs;
+};
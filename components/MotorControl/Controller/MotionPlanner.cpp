@@ -8,6 +8,7 @@
 
 #include "MotionPlanner.h"
 #include "MotionArgs.h"
+#include "MotionPerfCounters.h"
 #include "RampGenerator/RampGenTimer.h"
 
 // #define DEBUG_REQUESTED_VELOCITY
@@ -17,6 +18,7 @@
 // #define DEBUG_MOTIONPLANNER_DETAILED_INFO
 // #define DEBUG_MOTIONPLANNER_BEFORE
 // #define DEBUG_MOTIONPLANNER_AFTER
+// #define DEBUG_MOTIONPLANNER_COALESCE
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
@@ -28,10 +30,13 @@ MotionPlanner::MotionPlanner(const AxesParams& axesParams) :
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Setup
 /// @param stepGenPeriodUs Step generation period in microseconds
-void MotionPlanner::setup(uint32_t stepGenPeriodUs)
+/// @param accelTickNs Period at which acceleration is applied in nanoseconds
+void MotionPlanner::setup(uint32_t stepGenPeriodUs, uint32_t accelTickNs)
 {
     _stepGenPeriodNs = stepGenPeriodUs * 1000;
-    LOG_I(MODULE_PREFIX, "setup maxJunctionDeviationMM %0.2f stepGenPeriodNs %d", _axesParams.getMaxJunctionDeviationMM(), _stepGenPeriodNs);
+    _accelTickNs = accelTickNs;
+    LOG_I(MODULE_PREFIX, "setup maxJunctionDeviationMM %0.2f stepGenPeriodNs %d accelTickNs %d", 
+                _axesParams.getMaxJunctionDeviationMM(), _stepGenPeriodNs, _accelTickNs);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -50,9 +55,11 @@ AxesValues<AxisStepsDataType> MotionPlanner::moveToNonRamped(MotionArgs &args,
 {
     // Create a block for this movement which will end up on the pipeline
     MotionBlock block;
+    MotionStepSegment stepSeg;
     block._entrySpeedMMps = 0;
     block._exitSpeedMMps = 0;
-    block.setTimerPeriodNs(_stepGenPeriodNs);
+    block._isStepwise = true;
+    block.setTimerPeriodNs(_stepGenPeriodNs, _accelTickNs);
 
     // Find if there are any steps
     bool hasSteps = false;
@@ -81,7 +88,7 @@ AxesValues<AxisStepsDataType> MotionPlanner::moveToNonRamped(MotionArgs &args,
         stepsToTarget.setVal(axisIdx, steps);
     }
 
-    block.setStepsToTarget(stepsToTarget);
+    stepSeg.setStepsToTarget(stepsToTarget);
 
     // Check there are some actual steps
     if (!hasSteps)
@@ -91,10 +98,11 @@ AxesValues<AxisStepsDataType> MotionPlanner::moveToNonRamped(MotionArgs &args,
     block._unitVecAxisWithMaxDist = 1.0;
 
     // set end-stop check requirements
-    block.setEndStopsToCheck(args.getEndstopCheck());
+    stepSeg.setEndStopsToCheck(args.getEndstopCheck());
 
     // Set numbered command index if present
-    block.setMotionTrackingIndex(args.getMotionTrackingIndex());
+    if (args.isMotionTrackingIndexValid())
+        stepSeg.setMotionTrackingIndex(args.getMotionTrackingIndex());
 
     // Compute the requestedVelocity
     AxisSpeedDataType requestedVelocity = lowestMaxStepRatePerSecForAnyAxis;
@@ -102,29 +110,30 @@ AxesValues<AxisStepsDataType> MotionPlanner::moveToNonRamped(MotionArgs &args,
         requestedVelocity = args.getTargetSpeed();
 
     // Feedrate percent (scale calculated velocities by this amount)
-    double feedrateAsRatioToMax = args.getFeedrate() / 100.0;
+    AxisSpeedDataType feedrateAsRatioToMax = AxisSpeedDataType(args.getFeedrate()) / 100.0f;
     if (args.isFeedrateUnitsPerMin())
     {
-        feedrateAsRatioToMax = 1.0;
+        feedrateAsRatioToMax = 1.0f;
         if (axesParams.masterAxisMaxSpeed() != 0)
-            feedrateAsRatioToMax = args.getFeedrate() / 60.0 / axesParams.masterAxisMaxSpeed();
+            feedrateAsRatioToMax = AxisSpeedDataType(args.getFeedrate()) / 60.0f / axesParams.masterAxisMaxSpeed();
     }
     requestedVelocity *= feedrateAsRatioToMax;
     block._requestedSpeed = requestedVelocity;
 
     // Prepare for stepping
-    if (block.prepareForStepping(axesParams, true))
+    if (block.prepareForStepping(axesParams, true, stepSeg))
     {
         // No more changes
-        block._canExecute = true;
+        stepSeg._canExecute = true;
     }
 
     // Add the block
-    motionPipeline.add(block);
+    motionPipeline.add(block, stepSeg);
+    MotionPerfCounters::incCounter(MotionPerfCounters::COUNTER_BLOCKS_PLANNED);
     _prevMotionBlockValid = true;
 
     // Return the change in actuator position
-    AxesValues<AxisStepsDataType> newStepsFromOrigin = axesState.getStepsFromOrigin() + block.getStepsToTarget();
+    AxesValues<AxisStepsDataType> newStepsFromOrigin = axesState.getStepsFromOrigin() + stepSeg.getStepsToTarget();
 
 #ifdef DEBUG_MOTIONPLANNER_INFO
     LOG_I(MODULE_PREFIX, "^^^^^^^^^^^^^^^^^^^^^^^STEPWISE^^^^^^^^^^^^^^^^^^^^^^^^");
@@ -151,42 +160,40 @@ bool MotionPlanner::moveToRamped(const MotionArgs& args,
     // Find first primary axis
     int firstPrimaryAxis = -1;
     for (int axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
         if (axesParams.isPrimaryAxis(axisIdx))
+        {
             firstPrimaryAxis = axisIdx;
+            break;
+        }
+    }
     if (firstPrimaryAxis == -1)
         firstPrimaryAxis = 0;
 
     // Find axis deltas and sum of squares of motion on primary axes
-    float deltas[AXIS_VALUES_MAX_AXES];
+    const AxesValues<AxisPosDataType>& targetAxesPos = args.getAxesPosConst();
+    AxesValues<AxisPosDataType> deltas = targetAxesPos - axesState.getUnitsFromOrigin();
+    uint32_t primaryAxisMask = axesParams.getPrimaryAxisMask();
+    float squareSum = deltas.vectorMagnitudeSq(primaryAxisMask);
     bool isAMove = false;
     bool isAPrimaryMove = false;
     int axisWithMaxMoveDist = 0;
-    float squareSum = 0;
-    AxesValues<AxisPosDataType> targetAxesPos;
     for (int axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
     {
-        // Calculate target position
-        targetAxesPos.setVal(axisIdx, args.getAxesPosConst().getVal(axisIdx));
-
-        // Calculate deltas
-        deltas[axisIdx] = targetAxesPos.getVal(axisIdx) - axesState.getUnitsFromOrigin(axisIdx);
         if (deltas[axisIdx] != 0)
         {
             isAMove = true;
-            if (axesParams.isPrimaryAxis(axisIdx))
-            {
-                squareSum += pow(deltas[axisIdx], 2);
+            if (primaryAxisMask & (1 << axisIdx))
                 isAPrimaryMove = true;
-            }
         }
 
         // Check max distance axis
-        if (fabs(deltas[axisIdx]) > fabs(deltas[axisWithMaxMoveDist]))
+        if (fabsf(deltas[axisIdx]) > fabsf(deltas[axisWithMaxMoveDist]))
             axisWithMaxMoveDist = axisIdx;
     }
 
     // Distance being moved
-    float moveDist = sqrt(squareSum);
+    float moveDist = sqrtf(squareSum);
 
     // Ignore if there is no real movement
     if (!isAMove || moveDist < MotionBlock::MINIMUM_MOVE_DIST_MM)
@@ -194,18 +201,20 @@ bool MotionPlanner::moveToRamped(const MotionArgs& args,
 
     // Create a block for this movement which will end up on the pipeline
     MotionBlock block;
+    MotionStepSegment stepSeg;
 
     // Set timing
-    block.setTimerPeriodNs(_stepGenPeriodNs);
+    block.setTimerPeriodNs(_stepGenPeriodNs, _accelTickNs);
     
     // Set flag to indicate if more moves coming
     block._blockIsFollowed = args.getMoreMovesComing();
 
     // set end-stop check requirements
-    block.setEndStopsToCheck(args.getEndstopCheck());
+    stepSeg.setEndStopsToCheck(args.getEndstopCheck());
 
     // Set motion tracking index if present
-    block.setMotionTrackingIndex(args.getMotionTrackingIndex());
+    if (args.isMotionTrackingIndexValid())
+        stepSeg.setMotionTrackingIndex(args.getMotionTrackingIndex());
 
     // Compute the requestedVelocity from the first primary axis
     AxisSpeedDataType requestedVelocity = axesParams.getMaxSpeedUps(firstPrimaryAxis);
@@ -213,12 +222,12 @@ bool MotionPlanner::moveToRamped(const MotionArgs& args,
         requestedVelocity = args.getTargetSpeed();
 
     // Feedrate percent (scale calculated velocities by this amount)
-    double feedrateAsRatioToMax = args.getFeedrate() / 100.0;
+    AxisSpeedDataType feedrateAsRatioToMax = AxisSpeedDataType(args.getFeedrate()) / 100.0f;
     if (args.isFeedrateUnitsPerMin())
     {
-        feedrateAsRatioToMax = 1.0;
+        feedrateAsRatioToMax = 1.0f;
         if (axesParams.masterAxisMaxSpeed() != 0)
-            feedrateAsRatioToMax = args.getFeedrate() / 60.0 / axesParams.masterAxisMaxSpeed();
+            feedrateAsRatioToMax = AxisSpeedDataType(args.getFeedrate()) / 60.0f / axesParams.masterAxisMaxSpeed();
     }
     requestedVelocity *= feedrateAsRatioToMax;
 
@@ -231,13 +240,20 @@ bool MotionPlanner::moveToRamped(const MotionArgs& args,
     AxesValues<AxisUnitVectorDataType> unitVectors;
     for (int axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
     {
-        if (axesParams.isPrimaryAxis(axisIdx))
+        if (primaryAxisMask & (1 << axisIdx))
         {
             // Unit vector calculation
             unitVectors.setVal(axisIdx, deltas[axisIdx] / moveDist);
         }
     }
 
+    // Limit the speed and acceleration along the path so that no axis exceeds its own limits
+    AxisSpeedDataType pathMaxSpeed = axesParams.getPathMaxSpeedUps(unitVectors);
+    if (requestedVelocity > pathMaxSpeed)
+        requestedVelocity = pathMaxSpeed;
+    block._maxAccUps2 = axesParams.getPathMaxAccelUps2(unitVectors);
+    block._inputShaperAxisIdx = axesParams.getPathInputShaperAxis(unitVectors);
+
     // Store values in the block
     block._requestedSpeed = requestedVelocity;
     block._moveDistPrimaryAxesMM = moveDist;
@@ -247,22 +263,22 @@ bool MotionPlanner::moveToRamped(const MotionArgs& args,
     AxesValues<AxisStepsDataType> stepsToPerform;
     for (int axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
     {
-        // Check if any steps to perform
-        float stepsFloat = destActuatorCoords.getVal(axisIdx) - axesState.getStepsFromOrigin(axisIdx);
-        int32_t steps = int32_t(ceilf(stepsFloat));
+        // Check if any steps to perform (the destination is in whole steps - any fraction of a step is carried
+        // in the axes state step residual)
+        int32_t steps = destActuatorCoords.getVal(axisIdx) - axesState.getStepsFromOrigin(axisIdx);
         if (steps != 0)
             hasSteps = true;
         // Value (and direction)
         stepsToPerform.setVal(axisIdx, steps);
     }
-    block.setStepsToTarget(stepsToPerform);
+    stepSeg.setStepsToTarget(stepsToPerform);
 
 #ifdef DEBUG_MOTIONPLANNER_DETAILED_INFO
     LOG_I(MODULE_PREFIX, "F %0.2f D %0.2f uX %0.2f uY %0.2f, uZ %0.2f maxStAx %d maxDAx %d %s", 
             requestedVelocity,
             moveDist, 
             unitVectors.getVal(0), unitVectors.getVal(1), unitVectors.getVal(2), 
-            block._axisIdxWithMaxSteps, axisWithMaxMoveDist,
+            stepSeg._axisIdxWithMaxSteps, axisWithMaxMoveDist,
             hasSteps ? "has steps" : "NO STEPS");
 #endif
 
@@ -270,6 +286,18 @@ bool MotionPlanner::moveToRamped(const MotionArgs& args,
     if (!hasSteps)
         return false;
 
+    // Merge with the last block in the pipeline if the move continues in the same direction
+    if (isAPrimaryMove && _prevMotionBlockValid && (_coalesceMinCosTheta > 0) && !args.isStartTimeValid() &&
+                coalesceWithLastBlock(args, stepSeg, unitVectors, moveDist, requestedVelocity, axesParams, motionPipeline))
+    {
+        if (_batchActive)
+            _batchBlockCount++;
+        else
+            recalculatePipeline(motionPipeline, axesParams);
+        axesState.setPosition(targetAxesPos, stepSeg.getStepsToTarget(), true);
+        return true;
+    }
+
     // Set the dist moved on the axis with max steps
     block._unitVecAxisWithMaxDist = unitVectors.getVal(axisWithMaxMoveDist);
 
@@ -302,15 +330,26 @@ bool MotionPlanner::moveToRamped(const MotionArgs& args,
             // Skip and use default max junction speed for 0 degree acute junction
             if (cosTheta < 0.95F)
             {
-                vmaxJunctionMMps = fmin(prevParamSpeed, block._requestedSpeed);
+                vmaxJunctionMMps = fminf(prevParamSpeed, block._requestedSpeed);
                 // Skip and avoid divide by zero for straight junctions at 180 degrees. Limit to min() of nominal speeds.
                 if (cosTheta > -0.95F)
                 {
                     // Compute maximum junction speed based on maximum acceleration and junction deviation
                     // Trig half angle identity, always positive
-                    float sinThetaD2 = sqrt(0.5F * (1.0F - cosTheta));
-                    vmaxJunctionMMps = fmin(vmaxJunctionMMps,
-                                            sqrt(axesParams.masterAxisMaxAccel() * maxJunctionDeviationMM * sinThetaD2 /
+                    // The acceleration at the junction is in the direction of the change of unit vector so limit it by
+                    // projecting the per-axis limits onto that direction
+                    AxesValues<AxisUnitVectorDataType> junctionVec = unitVectors - _prevMotionBlock._unitVectors;
+                    float junctionVecMag = sqrtf(junctionVec.vectorMagnitudeSq(primaryAxisMask));
+                    AxisAccDataType junctionAcc = block._maxAccUps2;
+                    if (junctionVecMag > 0)
+                    {
+                        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+                            junctionVec.setVal(axisIdx, junctionVec.getVal(axisIdx) / junctionVecMag);
+                        junctionAcc = axesParams.getPathMaxAccelUps2(junctionVec);
+                    }
+                    float sinThetaD2 = sqrtf(0.5F * (1.0F - cosTheta));
+                    vmaxJunctionMMps = fminf(vmaxJunctionMMps,
+                                            sqrtf(junctionAcc * maxJunctionDeviationMM * sinThetaD2 /
                                                 (1.0F - sinThetaD2)));
                 }
 
@@ -322,7 +361,20 @@ bool MotionPlanner::moveToRamped(const MotionArgs& args,
             }
         }
     }
+
+    // A block with a scheduled start time starts from a standstill (so the block before it ends at a standstill)
+    if (args.isStartTimeValid())
+    {
+        stepSeg.setStartTimeUs(args.getStartTimeUs());
+        vmaxJunctionMMps = 0;
+    }
+
     block._maxEntrySpeedMMps = vmaxJunctionMMps;
+    block._maxEntryNominalSpeedMMps = (isAPrimaryMove && _prevMotionBlockValid) ? 
+                fminf(_prevMotionBlock._maxParamSpeedMMps, block._requestedSpeed) : block._requestedSpeed;
+    if (args.isStartTimeValid())
+        block._maxEntryNominalSpeedMMps = 0;
+    block._feedOverridePercent = _feedOverridePercent;
 
 #ifdef DEBUG_MOTIONPLANNER_DETAILED_INFO
     LOG_I(MODULE_PREFIX, "PrevMoveInQueue %d, maxJunctionDeviationMM %0.2f, blockMaxEntrySpeedMMps %0.2f",
@@ -330,22 +382,131 @@ bool MotionPlanner::moveToRamped(const MotionArgs& args,
 #endif
 
     // Add the element to the pipeline and remember previous element
-    motionPipeline.add(block);
+    motionPipeline.add(block, stepSeg);
+    MotionPerfCounters::incCounter(MotionPerfCounters::COUNTER_BLOCKS_PLANNED);
     MotionBlockSequentialData prevBlockInfo;
     prevBlockInfo._maxParamSpeedMMps = block._requestedSpeed;
     prevBlockInfo._unitVectors = unitVectors;
     _prevMotionBlock = prevBlockInfo;
     _prevMotionBlockValid = true;
 
-    // Recalculate the whole queue
-    recalculatePipeline(motionPipeline, axesParams);
+    // Recalculate the whole queue (deferred until the batch is committed if a batch is active)
+    if (_batchActive)
+        _batchBlockCount++;
+    else
+        recalculatePipeline(motionPipeline, axesParams);
 
     // Update current position
-    axesState.setPosition(targetAxesPos, block.getStepsToTarget(), true);
+    axesState.setPosition(targetAxesPos, stepSeg.getStepsToTarget(), true);
+
+    return true;
+}
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Merge a move into the last block in the pipeline if possible
+/// @param args MotionArgs for the move
+/// @param stepSeg Step segment for the move (steps to target, end-stops and motion tracking set)
+/// @param unitVectors Unit vector of the move (primary axes)
+/// @param moveDist Distance of the move (primary axes)
+/// @param requestedSpeed Requested speed of the move
+/// @param axesParams Parameters for the axes
+/// @param motionPipeline Motion pipeline
+/// @return true if the move was merged (the pipeline must then be recalculated)
+/// @note The last block is only changed if the block before it hasn't started executing - so the ramp generator
+///       has to complete a whole block before it could start the block being changed
+bool MotionPlanner::coalesceWithLastBlock(const MotionArgs& args, const MotionStepSegment& stepSeg, 
+                const AxesValues<AxisUnitVectorDataType>& unitVectors, AxisDistDataType moveDist,
+                AxisSpeedDataType requestedSpeed, const AxesParams& axesParams, MotionPipelineIF& motionPipeline)
+{
+    // Check the last block (and the one before it) aren't executing
+    MotionBlock* pLastBlock = motionPipeline.peekNthFromPut(0);
+    MotionStepSegment* pLastSeg = motionPipeline.peekStepSegNthFromPut(0);
+    MotionStepSegment* pPrevSeg = motionPipeline.peekStepSegNthFromPut(1);
+    if (!pLastBlock || !pLastSeg || !pPrevSeg || pLastSeg->_isExecuting || pPrevSeg->_isExecuting || 
+                pLastBlock->_isStepwise || pLastSeg->_startTimeValid)
+        return false;
+
+    // Check direction, speed, end-stop checks and merged length
+    float cosTheta = unitVectors.vectorMultSum(_prevMotionBlock._unitVectors);
+    if ((cosTheta < _coalesceMinCosTheta) ||
+                (fabsf(pLastBlock->_requestedSpeed - requestedSpeed) > requestedSpeed * COALESCE_SPEED_TOLERANCE) ||
+                (pLastBlock->_feedOverridePercent != _feedOverridePercent) ||
+                (pLastSeg->_endStopsToCheck != stepSeg._endStopsToCheck) ||
+                (pLastBlock->_moveDistPrimaryAxesMM + moveDist > _coalesceMaxDistMM))
+        return false;
+
+    // The merged block is a straight line along the merged step vector (coalescing is only enabled for linear
+    // geometries) so find its length and direction from the merged steps
+    AxesValues<AxisStepsDataType> mergedSteps = pLastSeg->getStepsToTarget() + stepSeg.getStepsToTarget();
+    uint32_t primaryAxisMask = axesParams.getPrimaryAxisMask();
+    AxesValues<AxisDistDataType> mergedDeltas;
+    uint32_t axisWithMaxMoveDist = 0;
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        AxisDistDataType stepsPerUnit = AxisDistDataType(axesParams.getStepsPerUnit(axisIdx));
+        if (stepsPerUnit != 0)
+            mergedDeltas.setVal(axisIdx, AxisDistDataType(mergedSteps.getVal(axisIdx)) / stepsPerUnit);
+        if (fabsf(mergedDeltas.getVal(axisIdx)) > fabsf(mergedDeltas.getVal(axisWithMaxMoveDist)))
+            axisWithMaxMoveDist = axisIdx;
+    }
+    AxisDistDataType mergedDist = sqrtf(mergedDeltas.vectorMagnitudeSq(primaryAxisMask));
+    if ((mergedDist < MotionBlock::MINIMUM_MOVE_DIST_MM) || (mergedDist > _coalesceMaxDistMM))
+        return false;
+    AxesValues<AxisUnitVectorDataType> mergedVec;
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        if (primaryAxisMask & (1 << axisIdx))
+            mergedVec.setVal(axisIdx, mergedDeltas.getVal(axisIdx) / mergedDist);
+    }
+
+    // Merge steps, distance and direction
+    pLastSeg->_axisIdxWithMaxSteps = 0;
+    pLastSeg->setStepsToTarget(mergedSteps);
+    pLastBlock->_moveDistPrimaryAxesMM = mergedDist;
+    pLastBlock->_unitVecAxisWithMaxDist = mergedVec.getVal(axisWithMaxMoveDist);
+
+    // Per-axis limits along the merged direction
+    AxisSpeedDataType pathMaxSpeed = axesParams.getPathMaxSpeedUps(mergedVec);
+    if (pLastBlock->_requestedSpeed > pathMaxSpeed)
+        pLastBlock->_requestedSpeed = pathMaxSpeed;
+    pLastBlock->_maxAccUps2 = axesParams.getPathMaxAccelUps2(mergedVec);
+    pLastBlock->_inputShaperAxisIdx = axesParams.getPathInputShaperAxis(mergedVec);
+    pLastBlock->_maxEntryNominalSpeedMMps = fminf(pLastBlock->_maxEntryNominalSpeedMMps, pLastBlock->_requestedSpeed);
+    pLastBlock->_maxEntrySpeedMMps = fminf(pLastBlock->_maxEntrySpeedMMps, pLastBlock->_requestedSpeed);
+    _prevMotionBlock._unitVectors = mergedVec;
+    _prevMotionBlock._maxParamSpeedMMps = pLastBlock->_requestedSpeed;
+
+    // The merged block takes the following flag and the motion tracking index of the move (if it has one)
+    pLastBlock->_blockIsFollowed = args.getMoreMovesComing();
+    if (stepSeg.isMotionTrackingIndexValid())
+        pLastSeg->setMotionTrackingIndex(stepSeg.getMotionTrackingIndex());
+
+    // Replan the merged block
+    pLastBlock->_isPlanned = false;
+    pLastBlock->invalidatePrepared();
+    _numCoalesced++;
+
+#ifdef DEBUG_MOTIONPLANNER_COALESCE
+    LOG_I(MODULE_PREFIX, "coalesceWithLastBlock cosTheta %.6f distMM %.3f merged %s", cosTheta, 
+                pLastBlock->_moveDistPrimaryAxesMM, mergedSteps.toJSON().c_str());
+#endif
     return true;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Commit a batch of ramped blocks
+/// @param motionPipeline Motion pipeline the blocks were added to
+/// @param axesParams Parameters for the axes
+/// @note The most recently added block is the last in the pipeline so a single recalculation keeps the
+///       invariant that the last block exits at zero speed
+void MotionPlanner::commitBatch(MotionPipelineIF& motionPipeline, const AxesParams& axesParams)
+{
+    if (_batchActive && (_batchBlockCount > 0))
+        recalculatePipeline(motionPipeline, axesParams);
+    _batchActive = false;
+    _batchBlockCount = 0;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Recalculate the pipeline
 /// @param motionPipeline Pipeline to recalculate
@@ -362,8 +523,14 @@ bool MotionPlanner::moveToRamped(const MotionArgs& args,
 ///         (2) Calculate the max possible exit speed for the block using the same formula as above
 ///         (3) Set the entry speed for the next block using this exit speed
 ///       Finally prepare the block for stepper motor actuation
+///       Blocks whose entry and exit speeds can no longer change (because the block before is fixed and the
+///       exit speed is at the acceleration or junction limit) are marked as planned during the forward pass - the
+///       backward pass stops at the first planned block so these blocks are never revisited and the cost of adding
+///       a block is (amortized) constant. Step segments are only re-prepared when the speeds have changed.
 void MotionPlanner::recalculatePipeline(MotionPipelineIF& motionPipeline, const AxesParams &axesParams)
 {
+    MotionPerfCounters::ScopedTimer perfTimer(MotionPerfCounters::TIMER_PLANNER_RECALC);
+
 #ifdef DEBUG_MOTIONPLANNER_BEFORE
     LOG_I(MODULE_PREFIX, "^^^^^^^^^^^^^^^^^^^^^^^BEFORE RECALC^^^^^^^^^^^^^^^^^^^^^^^^");
     motionPipeline.debugShowBlocks(axesParams);
@@ -377,6 +544,9 @@ void MotionPlanner::recalculatePipeline(MotionPipelineIF& motionPipeline, const
     // sets the entry speed for the following block initially to 0 as this will be the speed given to exit of
     // that last block in the pipe
     float followingBlockEntrySpeed = 0;
+    // Entry speed of the earliest block to reprocess is fixed if the backward pass stopped at an executing block, 
+    // a planned block or the start of the pipeline
+    bool entrySpeedFixed = true;
     MotionBlock *pBlock = NULL;
     MotionBlock *pFollowingBlock = NULL;
     while (true)
@@ -391,25 +561,41 @@ void MotionPlanner::recalculatePipeline(MotionPipelineIF& motionPipeline, const
             break;
         }
         // Stop if this block is already executing
-        if (pBlock->_isExecuting)
+        MotionStepSegment *pStepSeg = motionPipeline.peekStepSegNthFromPut(reverseBlockIdx);
+        if (!pStepSeg || pStepSeg->_isExecuting)
         {
-            // Get the exit speed from this executing block to use as the entry speed when going forwards
+            // Get the exit speed from this executing block to use as the entry speed when going forwards (the ramp
+            // generator scales the executing block's rates down if the feed override has been reduced)
             previousBlockExitSpeed = pBlock->_exitSpeedMMps;
+            if (pStepSeg && (pStepSeg->_feedOverridePercent > _feedOverridePercent))
+                previousBlockExitSpeed = previousBlockExitSpeed * _feedOverridePercent / pStepSeg->_feedOverridePercent;
 #ifdef DEBUG_MOTIONPLANNER_DETAILED_INFO
             LOG_I(MODULE_PREFIX, "+++++ Block already executing reverse idx %d", reverseBlockIdx);
 #endif
             break;
         }
 
+        // Stop if this block is already optimally planned (entry and exit speeds can't change)
+        if (pBlock->_isPlanned)
+        {
+            previousBlockExitSpeed = pBlock->_exitSpeedMMps;
+#ifdef DEBUG_MOTIONPLANNER_DETAILED_INFO
+            LOG_I(MODULE_PREFIX, "+++++ Block already planned reverse idx %d", reverseBlockIdx);
+#endif
+            break;
+        }
+
         // If entry speed is already at the maximum entry speed then we can stop here as no further changes are
-        // going to be made by going back further
-        if ((pBlock->_entrySpeedMMps == pBlock->_maxEntrySpeedMMps) && (reverseBlockIdx > 1))
+        // going to be made by going back further - unless the block hasn't been through a forward pass yet (it
+        // was added in the same batch) in which case it must be prepared (and allowed to execute) below
+        if ((pBlock->_entrySpeedMMps == pBlock->getMaxEntrySpeed()) && (reverseBlockIdx > 1) && pBlock->isPreparedForSpeeds())
         {
 #ifdef DEBUG_MOTIONPLANNER_DETAILED_INFO
             LOG_I(MODULE_PREFIX, "+++++ Optimizing block %d, prevSpeed %f", reverseBlockIdx, pBlock->_exitSpeedMMps);
 #endif
             //Get the exit speed from this block to use as the entry speed when going forwards
             previousBlockExitSpeed = pBlock->_exitSpeedMMps;
+            entrySpeedFixed = false;
             break;
         }
 
@@ -418,9 +604,10 @@ void MotionPlanner::recalculatePipeline(MotionPipelineIF& motionPipeline, const
         {
             // Assume for now that that whole block will be deceleration and calculate the max speed we can enter to be able to slow
             // to the exit speed required
-            float maxAchievableSpeed = MotionBlock::maxAchievableSpeed(axesParams.masterAxisMaxAccel(),
-                                                                    pFollowingBlock->_exitSpeedMMps, pFollowingBlock->_moveDistPrimaryAxesMM);
-            pFollowingBlock->_entrySpeedMMps = fmin(maxAchievableSpeed, pFollowingBlock->_maxEntrySpeedMMps);
+            float maxAchievableSpeed = MotionBlock::maxAchievableSpeed(pFollowingBlock->getMaxAccel(axesParams.masterAxisMaxAccel()),
+                                                                    pFollowingBlock->_exitSpeedMMps, pFollowingBlock->_moveDistPrimaryAxesMM,
+                                                                    axesParams.getMaxJerkUps3(), pFollowingBlock->getInputShaper(axesParams));
+            pFollowingBlock->_entrySpeedMMps = fminf(maxAchievableSpeed, pFollowingBlock->getMaxEntrySpeed());
 
             // Remember entry speed (to use as exit speed in the next loop)
             followingBlockEntrySpeed = pFollowingBlock->_entrySpeedMMps;
@@ -461,9 +648,23 @@ void MotionPlanner::recalculatePipeline(MotionPipelineIF& motionPipeline, const
         pBlock->_entrySpeedMMps = previousBlockExitSpeed;
 
         // Calculate maximum speed possible for the block - based on acceleration at the best rate
-        AxisSpeedDataType maxExitSpeed = pBlock->maxAchievableSpeed(axesParams.masterAxisMaxAccel(),
-                                                        pBlock->_entrySpeedMMps, pBlock->_moveDistPrimaryAxesMM);
-        pBlock->_exitSpeedMMps = fmin(maxExitSpeed, pBlock->_exitSpeedMMps);
+        AxisSpeedDataType maxExitSpeed = pBlock->maxAchievableSpeed(pBlock->getMaxAccel(axesParams.masterAxisMaxAccel()),
+                                                        pBlock->_entrySpeedMMps, pBlock->_moveDistPrimaryAxesMM,
+                                                        axesParams.getMaxJerkUps3(), pBlock->getInputShaper(axesParams));
+        pBlock->_exitSpeedMMps = fminf(maxExitSpeed, pBlock->_exitSpeedMMps);
+
+        // Check if the block is now optimally planned - entry speed is fixed and the exit speed is limited by
+        // acceleration over the whole block or by the max entry speed of the following block - adding more blocks
+        // can only raise speeds so neither can change again
+        if (entrySpeedFixed)
+        {
+            MotionBlock *pNextBlock = reverseBlockIdx > 0 ? motionPipeline.peekNthFromPut(reverseBlockIdx - 1) : NULL;
+            if ((pBlock->_exitSpeedMMps >= maxExitSpeed) || 
+                        (pNextBlock && (pBlock->_exitSpeedMMps >= pNextBlock->getMaxEntrySpeed())))
+                pBlock->_isPlanned = true;
+            else
+                entrySpeedFixed = false;
+        }
 
         // Remember for next block
         previousBlockExitSpeed = pBlock->_exitSpeedMMps;
@@ -477,16 +678,24 @@ void MotionPlanner::recalculatePipeline(MotionPipelineIF& motionPipeline, const
         if (!pBlock)
             break;
 
-        // Prepare this block for stepping
-        if (pBlock->prepareForStepping(axesParams, false))
+        // Prepare this block for stepping (only if the speeds have changed since it was last prepared)
+        MotionStepSegment *pStepSeg = motionPipeline.peekStepSegNthFromPut(reverseBlockIdx);
+        if (!pStepSeg)
+            break;
+        if (pBlock->_isStepwise)
+            continue;
+        uint32_t prevEstDurationUs = pStepSeg->_estDurationUs;
+        if (pBlock->isPreparedForSpeeds() || pBlock->prepareForStepping(axesParams, false, *pStepSeg))
         {
+            motionPipeline.adjustBufferedUs(prevEstDurationUs, pStepSeg->_estDurationUs);
+
             // Check if the block is part of a split block and has at least one more block following it
             // in which case wait until at least two blocks are in the pipeline before locking down the
             // first so that acceleration can be allowed to happen more smoothly
             if ((!pBlock->_blockIsFollowed) || (motionPipeline.count() > 1))
             {
                 // No more changes
-                pBlock->_canExecute = true;
+                pStepSeg->_canExecute = true;
             }
         }
     }
@@ -499,6 +708,99 @@ void MotionPlanner::recalculatePipeline(MotionPipelineIF& motionPipeline, const
 #endif
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Replan the pipeline from a standstill (after a feed hold)
+/// @param motionPipeline Motion pipeline (the ramp generator must be held so no block is stepping)
+/// @param axesParams Parameters for the axes
+/// @param heldStepsDone Steps done (absolute) on each axis of the held block (if it was executing)
+/// @note The held block is shortened to the steps remaining (its distance is scaled to match) and is restarted
+///       from zero speed - all blocks are then replanned
+void MotionPlanner::replanFromStandstill(MotionPipelineIF& motionPipeline, const AxesParams& axesParams,
+                    const AxesValues<AxisStepsDataType>& heldStepsDone)
+{
+    for (uint32_t blockIdx = 0; blockIdx < motionPipeline.count(); blockIdx++)
+    {
+        MotionBlock *pBlock = motionPipeline.peekNthFromGet(blockIdx);
+        MotionStepSegment *pStepSeg = motionPipeline.peekStepSegNthFromGet(blockIdx);
+        if (!pBlock || !pStepSeg)
+            break;
+
+        // Shorten the held block to the steps remaining
+        if (pStepSeg->_isExecuting)
+        {
+            AxesValues<AxisStepsDataType> origSteps = pStepSeg->getStepsToTarget();
+            uint32_t origMaxSteps = pStepSeg->getAbsMaxStepsForAnyAxis();
+            AxesValues<AxisStepsDataType> remainingSteps;
+            for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+            {
+                AxisStepsDataType totalSteps = origSteps.getVal(axisIdx);
+                AxisStepsDataType absTotal = abs(totalSteps);
+                AxisStepsDataType absRemaining = absTotal - UTILS_MIN(absTotal, heldStepsDone.getVal(axisIdx));
+                remainingSteps.setVal(axisIdx, totalSteps < 0 ? -absRemaining : absRemaining);
+            }
+            pStepSeg->_axisIdxWithMaxSteps = 0;
+            pStepSeg->setStepsToTarget(remainingSteps);
+            if (origMaxSteps > 0)
+                pBlock->_moveDistPrimaryAxesMM = pBlock->_moveDistPrimaryAxesMM * pStepSeg->getAbsMaxStepsForAnyAxis() / origMaxSteps;
+            pStepSeg->_isExecuting = false;
+            if (pBlock->_isStepwise)
+            {
+                uint32_t prevEstDurationUs = pStepSeg->_estDurationUs;
+                pBlock->prepareForStepping(axesParams, true, *pStepSeg);
+                motionPipeline.adjustBufferedUs(prevEstDurationUs, pStepSeg->_estDurationUs);
+            }
+#ifdef DEBUG_MOTIONPLANNER_INFO
+            LOG_I(MODULE_PREFIX, "replanFromStandstill held block steps %d of %d remain distMM %.3f",
+                        pStepSeg->getAbsMaxStepsForAnyAxis(), origMaxSteps, pBlock->_moveDistPrimaryAxesMM);
+#endif
+        }
+
+        // All blocks are replanned
+        pBlock->_isPlanned = false;
+        pBlock->invalidatePrepared();
+    }
+    recalculatePipeline(motionPipeline, axesParams);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set the feed override and replan the blocks in the pipeline
+/// @param feedOverridePercent Feed override (percent of the requested speeds)
+/// @param motionPipeline Motion pipeline
+/// @param axesParams Parameters for the axes
+/// @note The blocks which aren't executing are re-prepared with their nominal (cruise) and max entry speeds scaled by
+///       the override - the executing block can't be re-prepared but if the override is reduced the ramp generator
+///       scales its rates down (and those of blocks not yet re-prepared) so the look-ahead invariants still hold
+void MotionPlanner::setFeedOverride(uint32_t feedOverridePercent, MotionPipelineIF& motionPipeline, const AxesParams& axesParams)
+{
+    feedOverridePercent = UTILS_MIN(UTILS_MAX(feedOverridePercent, MotionBlock::FEED_OVERRIDE_PERCENT_MIN), 
+                MotionBlock::FEED_OVERRIDE_PERCENT_MAX);
+    if (feedOverridePercent == _feedOverridePercent)
+        return;
+    _feedOverridePercent = feedOverridePercent;
+
+    // Invalidate the blocks which aren't executing
+    bool anyChanged = false;
+    for (uint32_t blockIdx = 0; blockIdx < motionPipeline.count(); blockIdx++)
+    {
+        MotionBlock *pBlock = motionPipeline.peekNthFromGet(blockIdx);
+        MotionStepSegment *pStepSeg = motionPipeline.peekStepSegNthFromGet(blockIdx);
+        if (!pBlock || !pStepSeg)
+            break;
+        if (pStepSeg->_isExecuting || pBlock->_isStepwise)
+            continue;
+        pBlock->_feedOverridePercent = _feedOverridePercent;
+        pBlock->_isPlanned = false;
+        pBlock->invalidatePrepared();
+        anyChanged = true;
+    }
+    if (anyChanged)
+        recalculatePipeline(motionPipeline, axesParams);
+
+#ifdef DEBUG_MOTIONPLANNER_INFO
+    LOG_I(MODULE_PREFIX, "setFeedOverride %d%% blocks %d", _feedOverridePercent, motionPipeline.count());
+#endif
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Debug show pipeline
 /// @param motionPipeline Motion pipeline to show
@@ -21,7 +21,7 @@ public:
 
     /// @brief Setup
     /// @param stepGenPeriodUs Step generation period in microseconds
-    void setup(uint32_t stepGenPeriodUs);
+    void setup(uint32_t stepGenPeriodUs, uint32_t accelTickNs);
 
     /// @brief Add a non-ramped motion block (used for homing, etc)
     /// @param args MotionArgs define the parameters for motion
@@ -49,6 +49,66 @@ public:
                     const AxesParams& axesParams,
                     MotionPipelineIF& motionPipeline);
 
+    /// @brief Set coalescing of collinear moves
+    /// @param minCosTheta Min cosine of the angle between consecutive moves for them to be merged (0 disables)
+    /// @param maxDistMM Max length of a merged block
+    /// @note A move in the same direction (within the angle), at the same speed and with the same end-stop checks
+    ///       as the last block in the pipeline is merged into that block (extending its steps and distance) rather
+    ///       than using a new block - so runs of tiny collinear segments (e.g. from CAM output) use fewer pipeline
+    ///       slots and the effective look-ahead distance is increased. The actuators move in proportion during a
+    ///       block so this must only be enabled for linear geometries
+    void setCoalescing(float minCosTheta, float maxDistMM)
+    {
+        _coalesceMinCosTheta = minCosTheta;
+        _coalesceMaxDistMM = maxDistMM;
+    }
+
+    /// @brief Get number of moves merged into a previous block
+    uint32_t getNumCoalesced() const
+    {
+        return _numCoalesced;
+    }
+
+    /// @brief Begin a batch of ramped blocks
+    /// @note Blocks added by moveToRamped() while a batch is active are not recalculated until commitBatch()
+    ///       is called - they can't be executed until then as they are not yet prepared for stepping
+    void beginBatch()
+    {
+        _batchActive = true;
+        _batchBlockCount = 0;
+    }
+
+    /// @brief Commit a batch of ramped blocks (single recalculation of the pipeline)
+    /// @param motionPipeline Motion pipeline the blocks were added to
+    /// @param axesParams Parameters for the axes
+    void commitBatch(MotionPipelineIF& motionPipeline, const AxesParams& axesParams);
+
+    /// @brief Restart planning from a standstill (the next block has no junction with the previous one)
+    void restartAtStandstill()
+    {
+        _prevMotionBlockValid = false;
+    }
+
+    /// @brief Replan the pipeline from a standstill (after a feed hold)
+    /// @param motionPipeline Motion pipeline (the ramp generator must be held so no block is stepping)
+    /// @param axesParams Parameters for the axes
+    /// @param heldStepsDone Steps done (absolute) on each axis of the held block (if it was executing)
+    void replanFromStandstill(MotionPipelineIF& motionPipeline, const AxesParams& axesParams,
+                    const AxesValues<AxisStepsDataType>& heldStepsDone);
+
+    /// @brief Set the feed override and replan the blocks in the pipeline
+    /// @param feedOverridePercent Feed override (percent of the requested speeds - limited to 10% to 200%)
+    /// @param motionPipeline Motion pipeline
+    /// @param axesParams Parameters for the axes
+    void setFeedOverride(uint32_t feedOverridePercent, MotionPipelineIF& motionPipeline, const AxesParams& axesParams);
+
+    /// @brief Get the feed override
+    /// @return Feed override (percent)
+    uint32_t getFeedOverride() const
+    {
+        return _feedOverridePercent;
+    }
+
     /// @brief Debug show pipeline contents
     /// @param motionPipeline Motion pipeline to show
     /// @param minQLen Minimum queue length to show
@@ -63,6 +123,8 @@ private:
     float _minimumPlannerSpeedMMps = 0.0f;
     // Step generation timer period ns
     uint32_t _stepGenPeriodNs = RampGenTimer::RAMP_GEN_PERIOD_US_DEFAULT * 1000;
+    // Acceleration tick period ns
+    uint32_t _accelTickNs = MotionBlock::NS_IN_A_MS;
 
     // Axes parameters
     const AxesParams& _axesParams;
@@ -77,6 +139,24 @@ private:
     bool _prevMotionBlockValid = false;
     MotionBlockSequentialData _prevMotionBlock;
 
+    // Feed override (percent) applied to blocks when they are planned
+    uint32_t _feedOverridePercent = MotionBlock::FEED_OVERRIDE_PERCENT_DEFAULT;
+
+    // Batch of blocks awaiting recalculation
+    bool _batchActive = false;
+    uint32_t _batchBlockCount = 0;
+
+    // Coalescing of collinear moves (see setCoalescing) - requested speeds within the tolerance (ratio) match
+    static constexpr float COALESCE_SPEED_TOLERANCE = 0.001f;
+    float _coalesceMinCosTheta = 0;
+    float _coalesceMaxDistMM = 0;
+    uint32_t _numCoalesced = 0;
+
     // Recalculate
     void recalculatePipeline(MotionPipelineIF& motionPipeline, const AxesParams& axesParams);
+
+    // Merge a move into the last block in the pipeline if possible
+    bool coalesceWithLastBlock(const MotionArgs& args, const MotionStepSegment& stepSeg, 
+                    const AxesValues<AxisUnitVectorDataType>& unitVectors, AxisDistDataType moveDist,
+                    AxisSpeedDataType requestedSpeed, const AxesParams& axesParams, MotionPipelineIF& motionPipeline);
 };
@@ -0,0 +1,237 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionPlannerTask
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "MotionPlannerTask.h"
+#include "RaftArduino.h"
+
+// Debug
+// #define DEBUG_PLANNER_TASK_QUEUE
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Constructor
+MotionPlannerTask::MotionPlannerTask() :
+            _cmdPosn(0),
+            _numWakes(0),
+            _numISRWakes(0)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Destructor
+MotionPlannerTask::~MotionPlannerTask()
+{
+    stop();
+    if (_planMutex)
+        vSemaphoreDelete(_planMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup
+/// @param config Configuration (from JSON)
+/// @param serviceFn Function which does the planning work (called in the task's context)
+/// @param pArg Argument for the service function
+/// @return true if the task is running
+bool MotionPlannerTask::setup(const RaftJsonIF& config, ServiceFn serviceFn, void* pArg)
+{
+    // Stop any existing task
+    stop();
+
+    // Check enabled
+    if (!config.getBool("enable", false) || !serviceFn)
+        return false;
+
+    // Settings
+    _core = config.getLong("core", PLANNER_TASK_CORE_DEFAULT);
+    _priority = config.getLong("priority", PLANNER_TASK_PRIORITY_DEFAULT);
+    _stackSize = config.getLong("stack", PLANNER_TASK_STACK_SIZE_DEFAULT);
+    _lowWater = config.getLong("lowWater", PLANNER_LOW_WATER_DEFAULT);
+    _lowWaterMs = config.getLong("lowWaterMs", 0);
+    _idleWakeMs = UTILS_MAX(config.getLong("idleWakeMs", PLANNER_IDLE_WAKE_MS_DEFAULT), 1);
+    uint32_t cmdQueueLen = UTILS_MAX(config.getLong("cmdQLen", CMD_QUEUE_LEN_DEFAULT), 1);
+
+    // Command queue
+    _cmdQueue.resize(cmdQueueLen);
+    _cmdPosn.init(cmdQueueLen);
+
+    // Planning lock
+    if (!_planMutex)
+        _planMutex = xSemaphoreCreateMutex();
+    if (!_planMutex)
+    {
+        LOG_E(MODULE_PREFIX, "setup failed to create lock");
+        return false;
+    }
+
+    // Start the task
+    _serviceFn = serviceFn;
+    _pServiceArg = pArg;
+    _stopRequested = false;
+    _taskExited = false;
+    TaskHandle_t taskHandle = nullptr;
+    BaseType_t retc = xTaskCreatePinnedToCore(taskFn, "MotionPlan", _stackSize, this, _priority, &taskHandle,
+                _core < 0 ? tskNO_AFFINITY : _core);
+    if (retc != pdPASS)
+    {
+        LOG_E(MODULE_PREFIX, "setup failed to start task (stack %d) retc %d", _stackSize, retc);
+        return false;
+    }
+    _taskHandle = taskHandle;
+    LOG_I(MODULE_PREFIX, "setup core %d priority %d stack %d lowWater %d lowWaterMs %d idleWakeMs %d cmdQLen %d",
+                _core, _priority, _stackSize, _lowWater, _lowWaterMs, _idleWakeMs, cmdQueueLen);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Stop the task and clear the command queue
+void MotionPlannerTask::stop()
+{
+    if (_taskHandle)
+    {
+        // Request stop and wait for the task to exit
+        _stopRequested = true;
+        wake();
+        uint32_t startMs = millis();
+        while (!_taskExited && !Raft::isTimeout(millis(), startMs, TASK_STOP_TIMEOUT_MS))
+            vTaskDelay(1);
+        if (!_taskExited)
+            LOG_W(MODULE_PREFIX, "stop task did not exit");
+        _taskHandle = nullptr;
+    }
+    _cmdPosn.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Take the planning lock
+/// @param timeoutMs Max time to wait (UINT32_MAX to wait indefinitely)
+/// @return true if the lock was taken (or the task isn't running)
+bool MotionPlannerTask::lock(uint32_t timeoutMs)
+{
+    if (!_taskHandle || !_planMutex)
+        return true;
+    return xSemaphoreTake(_planMutex, timeoutMs == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Release the planning lock
+void MotionPlannerTask::unlock()
+{
+    if (!_taskHandle || !_planMutex)
+        return;
+    xSemaphoreGive(_planMutex);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Queue a command for the planner task
+/// @param args Motion args
+/// @return false if the queue is full
+bool MotionPlannerTask::queueCommand(const MotionArgs& args)
+{
+    if (!_cmdPosn.canPut())
+    {
+        _numCmdsRejected++;
+#ifdef DEBUG_PLANNER_TASK_QUEUE
+        LOG_I(MODULE_PREFIX, "queueCommand queue full");
+#endif
+        return false;
+    }
+    _cmdQueue[_cmdPosn.putIdx()] = args;
+    _cmdPosn.hasPut();
+    _numCmdsQueued++;
+    wake();
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Peek a queued command (consumer side)
+/// @param N Position from the head of the queue
+/// @return Pointer to the command or nullptr if there are not enough commands queued
+MotionArgs* MotionPlannerTask::peekCommand(uint32_t N)
+{
+    int idx = _cmdPosn.canGet() ? _cmdPosn.getNthFromGet(N) : -1;
+    if (idx < 0)
+        return nullptr;
+    return &_cmdQueue[idx];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Remove the command at the head of the queue (consumer side)
+void MotionPlannerTask::popCommand()
+{
+    if (_cmdPosn.canGet())
+        _cmdPosn.hasGot();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Wake the task
+void MotionPlannerTask::wake()
+{
+    TaskHandle_t taskHandle = _taskHandle;
+    if (!taskHandle)
+        return;
+    _numWakes.fetch_add(1, std::memory_order_relaxed);
+    xTaskNotifyGive(taskHandle);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Wake the task from the ramp generator (which may be called from an ISR or a task)
+/// @param pArg MotionPlannerTask
+void IRAM_ATTR MotionPlannerTask::wakeFromISR(void* pArg)
+{
+    MotionPlannerTask* pTask = (MotionPlannerTask*)pArg;
+    if (!pTask || !pTask->_taskHandle)
+        return;
+    if (!xPortInIsrContext())
+    {
+        pTask->wake();
+        return;
+    }
+    pTask->_numISRWakes.fetch_add(1, std::memory_order_relaxed);
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(pTask->_taskHandle, &higherPriorityTaskWoken);
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Task function
+/// @param pArg MotionPlannerTask
+void MotionPlannerTask::taskFn(void* pArg)
+{
+    MotionPlannerTask* pTask = (MotionPlannerTask*)pArg;
+    while (!pTask->_stopRequested)
+    {
+        // Wait to be woken (or for the idle period)
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(pTask->_idleWakeMs));
+        if (pTask->_stopRequested)
+            break;
+
+        // Planning work (with the planning lock held)
+        if (xSemaphoreTake(pTask->_planMutex, portMAX_DELAY) != pdTRUE)
+            continue;
+        pTask->_serviceFn(pTask->_pServiceArg);
+        xSemaphoreGive(pTask->_planMutex);
+    }
+    pTask->_taskExited = true;
+    vTaskDelete(nullptr);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON
+/// @param includeBraces - include braces
+/// @return JSON string
+String MotionPlannerTask::getDebugJSON(bool includeBraces) const
+{
+    String jsonStr = "\"core\":" + String(_core) +
+                ",\"q\":" + String(getNumQueued()) +
+                ",\"cmds\":" + String(_numCmdsQueued) +
+                ",\"rej\":" + String(_numCmdsRejected) +
+                ",\"wakes\":" + String(_numWakes.load(std::memory_order_relaxed)) +
+                ",\"isrWakes\":" + String(_numISRWakes.load(std::memory_order_relaxed));
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
@@ -0,0 +1,165 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionPlannerTask
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include "RaftUtils.h"
+#include "RaftJsonIF.h"
+#include "MotionArgs.h"
+#include "MotionRingBuffer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// Optional FreeRTOS task (pinned to a core) which does the motion planning so that the pipeline is kept full
+// even when the main loop is held up (e.g. by WiFi or other SysMods)
+// - move commands are passed to the task through a single-producer/single-consumer command queue
+// - the task is woken when a command is queued and by the ramp generator ISR when the pipeline count falls
+//   below the low-water mark - it also runs periodically when idle
+// - the service function (supplied by the owner) does all the planning work in the task's context - it is called
+//   with the planning lock held so other tasks must hold the lock to change the planning state directly
+class MotionPlannerTask
+{
+public:
+    typedef void (*ServiceFn)(void* pArg);
+
+    MotionPlannerTask();
+    ~MotionPlannerTask();
+
+    // Setup - the task is only started if enabled in the config
+    // Returns true if the task is running
+    bool setup(const RaftJsonIF& config, ServiceFn serviceFn, void* pArg);
+
+    // Stop the task (waits for it to exit) and clear the command queue
+    void stop();
+
+    // Check if the task is running
+    bool isActive() const
+    {
+        return _taskHandle != nullptr;
+    }
+
+    // Pipeline low-water mark (the task is woken when the pipeline count falls below this)
+    uint32_t getLowWater() const
+    {
+        return _lowWater;
+    }
+
+    // Pipeline low-water time (the task is also woken when the time of motion buffered falls below this - 0 if
+    // only the count is used)
+    uint32_t getLowWaterMs() const
+    {
+        return _lowWaterMs;
+    }
+
+    // Planning lock (held by the task while planning) - lock() returns immediately (true) if the task isn't running
+    // as planning is then done in the caller's context
+    bool lock(uint32_t timeoutMs = UINT32_MAX);
+    void unlock();
+
+    // Planning lock held for the scope - check isLocked() if a timeout is used
+    class ScopedLock
+    {
+    public:
+        ScopedLock(MotionPlannerTask& planTask, uint32_t timeoutMs = UINT32_MAX) : 
+                    _planTask(planTask), _isLocked(planTask.lock(timeoutMs))
+        {
+        }
+        ~ScopedLock()
+        {
+            if (_isLocked)
+                _planTask.unlock();
+        }
+        bool isLocked() const
+        {
+            return _isLocked;
+        }
+    private:
+        MotionPlannerTask& _planTask;
+        bool _isLocked;
+    };
+
+    // Queue a command (producer side - must only be called from one task)
+    // Returns false if the queue is full
+    bool queueCommand(const MotionArgs& args);
+
+    // Command queue status
+    uint32_t getNumQueued() const
+    {
+        return _cmdPosn.count();
+    }
+    uint32_t getQueueSpace() const
+    {
+        return _cmdPosn.remaining();
+    }
+
+    // Consumer side (planner task or with the planning lock held) - N is the position from the head of the queue
+    MotionArgs* peekCommand(uint32_t N = 0);
+    void popCommand();
+
+    // Discard all queued commands (planning lock must be held)
+    void clearCommands()
+    {
+        _cmdPosn.clear();
+    }
+
+    // Wake the task (from a task or from an ISR)
+    void wake();
+    static void IRAM_ATTR wakeFromISR(void* pArg);
+
+    // Debug
+    String getDebugJSON(bool includeBraces) const;
+
+private:
+    // Task
+    TaskHandle_t _taskHandle = nullptr;
+    volatile bool _stopRequested = false;
+    volatile bool _taskExited = false;
+
+    // Planning lock
+    SemaphoreHandle_t _planMutex = nullptr;
+
+    // Service function
+    ServiceFn _serviceFn = nullptr;
+    void* _pServiceArg = nullptr;
+
+    // Settings
+    int _core = PLANNER_TASK_CORE_DEFAULT;
+    uint32_t _priority = PLANNER_TASK_PRIORITY_DEFAULT;
+    uint32_t _stackSize = PLANNER_TASK_STACK_SIZE_DEFAULT;
+    uint32_t _lowWater = PLANNER_LOW_WATER_DEFAULT;
+    uint32_t _lowWaterMs = 0;
+    uint32_t _idleWakeMs = PLANNER_IDLE_WAKE_MS_DEFAULT;
+
+    // Command queue
+    std::vector<MotionArgs> _cmdQueue;
+    MotionRingBufferPosn _cmdPosn;
+
+    // Stats
+    std::atomic<uint32_t> _numWakes;
+    std::atomic<uint32_t> _numISRWakes;
+    uint32_t _numCmdsQueued = 0;
+    uint32_t _numCmdsRejected = 0;
+
+    // Task function
+    static void taskFn(void* pArg);
+
+    // Consts
+    static const int PLANNER_TASK_CORE_DEFAULT = 1;
+    static const uint32_t PLANNER_TASK_PRIORITY_DEFAULT = 5;
+    static const uint32_t PLANNER_TASK_STACK_SIZE_DEFAULT = 4096;
+    static const uint32_t PLANNER_LOW_WATER_DEFAULT = 10;
+    static const uint32_t PLANNER_IDLE_WAKE_MS_DEFAULT = 10;
+    static const uint32_t CMD_QUEUE_LEN_DEFAULT = 10;
+    static const uint32_t TASK_STOP_TIMEOUT_MS = 200;
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "MotionPlanTask";
+};
@@ -0,0 +1,181 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// PositionJournal
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include "PositionJournal.h"
+#include "RaftUtils.h"
+#include "Logger.h"
+#include "esp_attr.h"
+#ifdef ESP_PLATFORM
+#include "esp_system.h"
+#endif
+
+// Debug
+// #define DEBUG_POSITION_JOURNAL
+
+#define MODULE_PREFIX "PosJournal"
+
+// Records - in RTC memory which isn't initialised on a warm restart
+#ifdef ESP_PLATFORM
+static RTC_NOINIT_ATTR PositionJournal::PositionRecord _positionRecords[PositionJournal::MAX_SLOTS];
+#else
+static PositionJournal::PositionRecord _positionRecords[PositionJournal::MAX_SLOTS];
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup
+/// @param journalConfig Journal configuration (JSON)
+/// @param configHash Hash of the axes config (a record made with a different config isn't restored)
+void PositionJournal::setup(const RaftJsonIF& journalConfig, uint32_t configHash)
+{
+    _isEnabled = journalConfig.getBool("enable", false);
+    _keepWhenDisabled = journalConfig.getBool("keepWhenDisabled", false);
+    _slotIdx = UTILS_MIN(uint32_t(journalConfig.getLong("slot", 0)), MAX_SLOTS - 1);
+    _configHash = configHash;
+    _isRecordValid = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Record the position
+/// @param axesState State of the axes (position in units and steps from origin and step residuals)
+/// @param totalSteps Actuator step counts
+void PositionJournal::record(const AxesState& axesState, const AxesValues<AxisStepsDataType>& totalSteps)
+{
+    if (!_isEnabled)
+        return;
+    PositionRecord& rec = _positionRecords[_slotIdx];
+    uint32_t writeCount = rec.checksum == calcChecksum(rec) ? rec.writeCount + 1 : 1;
+    AxesValues<AxisStepsDataType> stepsFromOrigin = axesState.getStepsFromOrigin();
+    AxesValues<AxisPosDataType> unitsFromOrigin = axesState.getUnitsFromOrigin();
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        rec.totalSteps[axisIdx] = totalSteps.getVal(axisIdx);
+        rec.stepsFromOrigin[axisIdx] = stepsFromOrigin.getVal(axisIdx);
+        rec.unitsFromOrigin[axisIdx] = unitsFromOrigin.getVal(axisIdx);
+        rec.stepResiduals[axisIdx] = axesState.getStepResidual(axisIdx);
+    }
+    rec.configHash = _configHash;
+    rec.writeCount = writeCount;
+    rec.token = VALID_TOKEN;
+    rec.checksum = calcChecksum(rec);
+    _isRecordValid = true;
+
+#ifdef DEBUG_POSITION_JOURNAL
+    LOG_I(MODULE_PREFIX, "record slot %d writes %d %s", _slotIdx, writeCount, unitsFromOrigin.getDebugJSON("pos").c_str());
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Invalidate the record
+void PositionJournal::invalidate()
+{
+    if (!_isEnabled || !_isRecordValid)
+        return;
+    PositionRecord& rec = _positionRecords[_slotIdx];
+    rec.token = 0;
+    rec.checksum = calcChecksum(rec);
+    _isRecordValid = false;
+
+#ifdef DEBUG_POSITION_JOURNAL
+    LOG_I(MODULE_PREFIX, "invalidate slot %d", _slotIdx);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Restore the position
+/// @param axesState (out) State of the axes
+/// @param totalSteps (out) Actuator step counts
+/// @return true if restored (the record is valid, made with the same config and the restart was warm)
+bool PositionJournal::restore(AxesState& axesState, AxesValues<AxisStepsDataType>& totalSteps)
+{
+    if (!_isEnabled)
+        return false;
+    PositionRecord& rec = _positionRecords[_slotIdx];
+    bool isWarm = wasWarmRestart();
+    if ((rec.token != VALID_TOKEN) || (rec.checksum != calcChecksum(rec)) || (rec.configHash != _configHash) || !isWarm)
+    {
+        LOG_I(MODULE_PREFIX, "restore slot %d not restored (%s)", _slotIdx,
+                    !isWarm ? "cold start" : (rec.configHash != _configHash) && (rec.token == VALID_TOKEN) ?
+                                "config changed" : "no valid record");
+
+        // Clear the record (it mustn't be restored by a later warm restart as the axes may have moved since)
+        rec.token = 0;
+        rec.checksum = calcChecksum(rec);
+        _isRecordValid = false;
+        return false;
+    }
+
+    // Restore
+    AxesValues<AxisStepsDataType> stepsFromOrigin;
+    AxesValues<AxisPosDataType> unitsFromOrigin;
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        totalSteps.setVal(axisIdx, rec.totalSteps[axisIdx]);
+        stepsFromOrigin.setVal(axisIdx, rec.stepsFromOrigin[axisIdx]);
+        unitsFromOrigin.setVal(axisIdx, rec.unitsFromOrigin[axisIdx]);
+    }
+    axesState.setPosition(unitsFromOrigin, stepsFromOrigin, false);
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        axesState.setStepResidual(axisIdx, rec.stepResiduals[axisIdx]);
+    _isRecordValid = true;
+    _numRestores++;
+
+    LOG_I(MODULE_PREFIX, "restore slot %d writes %d %s", _slotIdx, rec.writeCount,
+                unitsFromOrigin.getDebugJSON("pos").c_str());
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON
+/// @param includeBraces Include braces
+/// @return JSON string
+String PositionJournal::getDebugJSON(bool includeBraces) const
+{
+    String jsonStr = "\"slot\":" + String(_slotIdx) +
+                ",\"valid\":" + String(_isRecordValid ? 1 : 0) +
+                ",\"writes\":" + String(_positionRecords[_slotIdx].writeCount) +
+                ",\"restores\":" + String(_numRestores);
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Checksum of a record
+/// @param rec Record
+/// @return FNV-1a hash of the record excluding the checksum field
+uint32_t PositionJournal::calcChecksum(const PositionRecord& rec)
+{
+    const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(&rec);
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < offsetof(PositionRecord, checksum); i++)
+        hash = (hash ^ pBytes[i]) * 16777619u;
+    return hash;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if the last restart was warm
+/// @return true if RTC memory was retained and the axes were powered throughout (software, panic or watchdog reset)
+bool PositionJournal::wasWarmRestart()
+{
+#ifdef ESP_PLATFORM
+    switch (esp_reset_reason())
+    {
+        case ESP_RST_SW:
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+            return true;
+        default:
+            return false;
+    }
+#else
+    return true;
+#endif
+}
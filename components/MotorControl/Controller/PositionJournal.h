@@ -0,0 +1,93 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// PositionJournal
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "RaftJsonIF.h"
+#include "AxesState.h"
+
+// Journal of the axes position which survives a warm restart (software reset, panic or watchdog) so that the
+// position can be restored without homing
+// - the position is recorded (in RTC memory which isn't initialised on a warm restart) when motion completes
+//   and the record is invalidated when motion starts, so a restart part way through a move doesn't restore
+// - the record is also invalidated when the motors are disabled (unless keepWhenDisabled is set) as unpowered
+//   axes may be moved
+// - a record is only restored after a warm restart - the content of RTC memory is lost on power loss and
+//   brownout/power-on resets are rejected - and only if the config (axes, steps per unit, etc) is unchanged
+// - a slot index allows several motion controllers to keep separate records
+class PositionJournal
+{
+public:
+    // Setup - the journal is only enabled if enable is set in the config (configHash identifies the axes config
+    // which the recorded position relates to)
+    void setup(const RaftJsonIF& journalConfig, uint32_t configHash);
+
+    // Check if enabled
+    bool isEnabled() const
+    {
+        return _isEnabled;
+    }
+
+    // Invalidate when the motors are disabled
+    bool invalidateWhenDisabled() const
+    {
+        return !_keepWhenDisabled;
+    }
+
+    // Record the position (the axes state and the actuator step counts)
+    void record(const AxesState& axesState, const AxesValues<AxisStepsDataType>& totalSteps);
+
+    // Invalidate the record
+    void invalidate();
+
+    // Check if the record is valid
+    bool isRecordValid() const
+    {
+        return _isRecordValid;
+    }
+
+    // Restore the position - returns false if there is no valid record (or the restart wasn't warm)
+    bool restore(AxesState& axesState, AxesValues<AxisStepsDataType>& totalSteps);
+
+    // Get debug JSON
+    String getDebugJSON(bool includeBraces) const;
+
+    // Record (in RTC memory)
+    struct PositionRecord
+    {
+        uint32_t token;
+        uint32_t configHash;
+        uint32_t writeCount;
+        AxisStepsDataType totalSteps[AXIS_VALUES_MAX_AXES];
+        AxisStepsDataType stepsFromOrigin[AXIS_VALUES_MAX_AXES];
+        AxisPosDataType unitsFromOrigin[AXIS_VALUES_MAX_AXES];
+        AxisCalcDataType stepResiduals[AXIS_VALUES_MAX_AXES];
+        uint32_t checksum;
+    };
+    static const uint32_t MAX_SLOTS = 4;
+
+private:
+    // Settings
+    bool _isEnabled = false;
+    bool _keepWhenDisabled = false;
+    uint32_t _slotIdx = 0;
+    uint32_t _configHash = 0;
+
+    // State
+    bool _isRecordValid = false;
+    uint32_t _numRestores = 0;
+
+    // Token for a valid record
+    static const uint32_t VALID_TOKEN = 0x504f534a;
+
+    // Checksum of a record (excluding the checksum field)
+    static uint32_t calcChecksum(const PositionRecord& rec);
+
+    // Check if the last restart was warm (RTC memory retained and the axes powered throughout)
+    static bool wasWarmRestart();
+};
@@ -0,0 +1,238 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// AxisEncoder
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include "AxisEncoder.h"
+#include "ConfigPinMap.h"
+#include "RaftUtils.h"
+#include "Logger.h"
+#include "soc/soc_caps.h"
+#if SOC_PCNT_SUPPORTED
+#include "driver/pulse_cnt.h"
+#endif
+
+// Debug
+// #define DEBUG_AXIS_ENCODER
+
+// PCNT count limits (the count is accumulated in software when a limit is reached)
+static constexpr int PCNT_HIGH_LIMIT = 32767;
+static constexpr int PCNT_LOW_LIMIT = -32768;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Constructor
+AxisEncoder::AxisEncoder()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Destructor
+AxisEncoder::~AxisEncoder()
+{
+    clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup
+/// @param axisName Axis name (for logging)
+/// @param config Encoder config (pinA, pinB, filterNs, stepsPerCount, reverse, maxErrSteps, onErr, maxCorrections)
+/// @return true if the encoder is enabled
+bool AxisEncoder::setup(const String& axisName, const RaftJsonIF& config)
+{
+    // Clear
+    clear();
+    _axisName = axisName;
+    int pinA = ConfigPinMap::getPinFromName(config.getString("pinA", "-1").c_str());
+    int pinB = ConfigPinMap::getPinFromName(config.getString("pinB", "-1").c_str());
+    if (pinA < 0)
+        return false;
+
+    // Settings
+    uint32_t filterNs = config.getLong("filterNs", FILTER_NS_DEFAULT);
+    _stepsPerCount = config.getDouble("stepsPerCount", 1) * (config.getBool("reverse", false) ? -1 : 1);
+    _maxErrSteps = config.getLong("maxErrSteps", MAX_ERR_STEPS_DEFAULT);
+    String onErrStr = config.getString("onErr", "stop");
+    _errAction = onErrStr.equalsIgnoreCase("correct") ? ERR_ACTION_CORRECT :
+                (onErrStr.equalsIgnoreCase("report") ? ERR_ACTION_REPORT : ERR_ACTION_STOP);
+    _maxCorrections = config.getLong("maxCorrections", MAX_CORRECTIONS_DEFAULT);
+
+#if SOC_PCNT_SUPPORTED
+    // PCNT unit (the count is accumulated over the limits)
+    pcnt_unit_config_t unitConfig = {};
+    unitConfig.high_limit = PCNT_HIGH_LIMIT;
+    unitConfig.low_limit = PCNT_LOW_LIMIT;
+    unitConfig.flags.accum_count = true;
+    pcnt_unit_handle_t pcntUnit = nullptr;
+    if (pcnt_new_unit(&unitConfig, &pcntUnit) != ESP_OK)
+    {
+        LOG_W(MODULE_PREFIX, "setup %s no PCNT unit available", axisName.c_str());
+        return false;
+    }
+    _pPcntUnit = pcntUnit;
+    if (filterNs > 0)
+    {
+        pcnt_glitch_filter_config_t filterConfig = {};
+        filterConfig.max_glitch_ns = filterNs;
+        if (pcnt_unit_set_glitch_filter(pcntUnit, &filterConfig) != ESP_OK)
+            LOG_W(MODULE_PREFIX, "setup %s glitch filter %dns not set", axisName.c_str(), filterNs);
+    }
+
+    // Channels - each counts the edges of one input with the direction from the level of the other (x4 decoding)
+    // - with a single input (no pinB) the count only increases
+    pcnt_chan_config_t chanAConfig = {};
+    chanAConfig.edge_gpio_num = pinA;
+    chanAConfig.level_gpio_num = pinB;
+    pcnt_channel_handle_t pcntChanA = nullptr;
+    bool isOk = pcnt_new_channel(pcntUnit, &chanAConfig, &pcntChanA) == ESP_OK;
+    _pPcntChanA = pcntChanA;
+    if (isOk && (pinB >= 0))
+    {
+        pcnt_chan_config_t chanBConfig = {};
+        chanBConfig.edge_gpio_num = pinB;
+        chanBConfig.level_gpio_num = pinA;
+        pcnt_channel_handle_t pcntChanB = nullptr;
+        isOk = pcnt_new_channel(pcntUnit, &chanBConfig, &pcntChanB) == ESP_OK;
+        _pPcntChanB = pcntChanB;
+        if (isOk)
+        {
+            pcnt_channel_set_edge_action(pcntChanA, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE);
+            pcnt_channel_set_level_action(pcntChanA, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+            pcnt_channel_set_edge_action(pcntChanB, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE);
+            pcnt_channel_set_level_action(pcntChanB, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+        }
+    }
+    else if (isOk)
+    {
+        pcnt_channel_set_edge_action(pcntChanA, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_HOLD);
+        pcnt_channel_set_level_action(pcntChanA, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_KEEP);
+    }
+
+    // Watch points at the limits are needed for the count to be accumulated
+    isOk = isOk && (pcnt_unit_add_watch_point(pcntUnit, PCNT_HIGH_LIMIT) == ESP_OK) &&
+                (pcnt_unit_add_watch_point(pcntUnit, PCNT_LOW_LIMIT) == ESP_OK) &&
+                (pcnt_unit_enable(pcntUnit) == ESP_OK) &&
+                (pcnt_unit_clear_count(pcntUnit) == ESP_OK) &&
+                (pcnt_unit_start(pcntUnit) == ESP_OK);
+    if (!isOk)
+    {
+        LOG_W(MODULE_PREFIX, "setup %s pinA %d pinB %d PCNT setup failed", axisName.c_str(), pinA, pinB);
+        clear();
+        return false;
+    }
+#else
+    LOG_W(MODULE_PREFIX, "setup %s PCNT not supported", axisName.c_str());
+    return false;
+#endif
+
+    // Reference
+    reference(0);
+    LOG_I(MODULE_PREFIX, "setup %s pinA %d pinB %d filterNs %d stepsPerCount %.4f maxErrSteps %d onErr %s",
+                axisName.c_str(), pinA, pinB, filterNs, _stepsPerCount, _maxErrSteps, onErrStr.c_str());
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Clear
+void AxisEncoder::clear()
+{
+#if SOC_PCNT_SUPPORTED
+    if (_pPcntUnit)
+    {
+        pcnt_unit_stop((pcnt_unit_handle_t)_pPcntUnit);
+        pcnt_unit_disable((pcnt_unit_handle_t)_pPcntUnit);
+    }
+    if (_pPcntChanB)
+        pcnt_del_channel((pcnt_channel_handle_t)_pPcntChanB);
+    if (_pPcntChanA)
+        pcnt_del_channel((pcnt_channel_handle_t)_pPcntChanA);
+    if (_pPcntUnit)
+        pcnt_del_unit((pcnt_unit_handle_t)_pPcntUnit);
+#endif
+    _pPcntUnit = nullptr;
+    _pPcntChanA = nullptr;
+    _pPcntChanB = nullptr;
+    _followErrSteps = 0;
+    _isOverLimit = false;
+    _numCorrectionsInARow = 0;
+    _isFaultLatched = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Reference the encoder position to the commanded step position
+/// @param cmdSteps Commanded step position (the encoder is at this position)
+void AxisEncoder::reference(int32_t cmdSteps)
+{
+    int32_t encSteps = 0;
+    getEncoderSteps(encSteps);
+    _refOffsetSteps = cmdSteps - encSteps;
+    _followErrSteps = 0;
+    _isOverLimit = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Update the following error
+/// @param cmdSteps Commanded step position
+/// @return true if the following error is over the limit
+bool AxisEncoder::update(int32_t cmdSteps)
+{
+    int32_t encSteps = 0;
+    if (!getEncoderSteps(encSteps))
+        return false;
+    _followErrSteps = cmdSteps - (encSteps + _refOffsetSteps);
+    int32_t absErrSteps = UTILS_ABS(_followErrSteps);
+    if (absErrSteps > _peakErrSteps)
+        _peakErrSteps = absErrSteps;
+
+    // Count each time the limit is exceeded
+    bool isOverLimit = absErrSteps > _maxErrSteps;
+    if (isOverLimit && !_isOverLimit)
+    {
+        _numErrs++;
+#ifdef DEBUG_AXIS_ENCODER
+        LOG_I(MODULE_PREFIX, "update %s following error %d steps (cmd %d)", _axisName.c_str(), _followErrSteps, cmdSteps);
+#endif
+    }
+    if (!isOverLimit)
+        _numCorrectionsInARow = 0;
+    _isOverLimit = isOverLimit;
+    return isOverLimit;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the encoder position in steps
+/// @param encSteps (out) Encoder position (steps)
+/// @return false if the encoder isn't valid
+bool AxisEncoder::getEncoderSteps(int32_t& encSteps) const
+{
+#if SOC_PCNT_SUPPORTED
+    int count = 0;
+    if (!_pPcntUnit || (pcnt_unit_get_count((pcnt_unit_handle_t)_pPcntUnit, &count) != ESP_OK))
+        return false;
+    encSteps = int32_t(lround(count * _stepsPerCount));
+    return true;
+#else
+    return false;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON
+/// @param includeBraces Include braces
+/// @return JSON string
+String AxisEncoder::getDebugJSON(bool includeBraces) const
+{
+    String jsonStr = "\"n\":\"" + _axisName + "\"" +
+                ",\"err\":" + String(_followErrSteps) +
+                ",\"peak\":" + String(_peakErrSteps) +
+                ",\"errs\":" + String(_numErrs) +
+                ",\"corr\":" + String(_numCorrections) +
+                ",\"faults\":" + String(_numFaults) +
+                ",\"fault\":" + String(_isFaultLatched ? 1 : 0);
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
@@ -0,0 +1,135 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// AxisEncoder
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "RaftArduino.h"
+#include "RaftJsonIF.h"
+
+// Quadrature encoder on an axis (counted by the PCNT peripheral) used to verify the commanded step position
+// - the encoder position (converted to steps with stepsPerCount) is referenced to the commanded step position
+//   when the origin is set and the following error is the commanded position less the encoder position
+// - the error limit (maxErrSteps) should allow for the steps issued between reading the commanded position and
+//   the encoder (a few steps at full speed) as well as the encoder resolution
+// - the action taken by the motion controller when the limit is exceeded is configured with onErr:
+//   "stop" (default) stops motion and resyncs the axes state to the measured position, "correct" waits for a
+//   standstill and moves back to the commanded position (up to maxCorrections times in a row before stopping)
+//   and "report" only counts errors
+class AxisEncoder
+{
+public:
+    AxisEncoder();
+    virtual ~AxisEncoder();
+
+    // Action when the following error exceeds the limit
+    enum ErrAction
+    {
+        ERR_ACTION_STOP,
+        ERR_ACTION_CORRECT,
+        ERR_ACTION_REPORT
+    };
+
+    // Setup from the axis's encoder config (pinA and pinB are the quadrature inputs - disabled if pinA isn't set)
+    bool setup(const String& axisName, const RaftJsonIF& config);
+
+    // Clear (releases the PCNT unit)
+    void clear();
+
+    // Check if valid
+    bool isValid() const
+    {
+        return _pPcntUnit != nullptr;
+    }
+
+    // Reference the encoder position to the commanded step position
+    void reference(int32_t cmdSteps);
+
+    // Update the following error from the commanded step position - returns true if over the limit
+    bool update(int32_t cmdSteps);
+
+    // Following error (steps - from the last update)
+    int32_t getFollowingError() const
+    {
+        return _followErrSteps;
+    }
+
+    // Error action
+    ErrAction getErrAction() const
+    {
+        return _errAction;
+    }
+
+    // Corrections - the count of corrections in a row is reset when the error is back within the limit
+    bool canCorrect() const
+    {
+        return _numCorrectionsInARow < _maxCorrections;
+    }
+    void recordCorrection()
+    {
+        _numCorrectionsInARow++;
+        _numCorrections++;
+    }
+
+    // Faults (motion stopped) - latched until cleared (when the origin is set)
+    void recordFault()
+    {
+        _isFaultLatched = true;
+        _numFaults++;
+    }
+    void clearFault()
+    {
+        _isFaultLatched = false;
+    }
+    bool isFaultLatched() const
+    {
+        return _isFaultLatched;
+    }
+
+    // Debug
+    String getDebugJSON(bool includeBraces) const;
+
+private:
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "AxisEncoder";
+
+    // Defaults
+    static constexpr uint32_t FILTER_NS_DEFAULT = 1000;
+    static constexpr int32_t MAX_ERR_STEPS_DEFAULT = 32;
+    static constexpr uint32_t MAX_CORRECTIONS_DEFAULT = 3;
+
+    // PCNT unit and channels
+    void* _pPcntUnit = nullptr;
+    void* _pPcntChanA = nullptr;
+    void* _pPcntChanB = nullptr;
+
+    // Settings
+    String _axisName;
+    double _stepsPerCount = 1;
+    int32_t _maxErrSteps = MAX_ERR_STEPS_DEFAULT;
+    ErrAction _errAction = ERR_ACTION_STOP;
+    uint32_t _maxCorrections = MAX_CORRECTIONS_DEFAULT;
+
+    // Reference (commanded steps less encoder steps when referenced)
+    int32_t _refOffsetSteps = 0;
+
+    // Following error
+    int32_t _followErrSteps = 0;
+    int32_t _peakErrSteps = 0;
+    bool _isOverLimit = false;
+
+    // Stats
+    uint32_t _numErrs = 0;
+    uint32_t _numCorrectionsInARow = 0;
+    uint32_t _numCorrections = 0;
+    uint32_t _numFaults = 0;
+    bool _isFaultLatched = false;
+
+    // Helpers
+    bool getEncoderSteps(int32_t& encSteps) const;
+};
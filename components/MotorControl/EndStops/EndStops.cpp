@@ -8,11 +8,24 @@
 
 #include "EndStops.h"
 #include "RaftArduino.h"
+#include "esp_intr_alloc.h"
+#include "soc/soc_caps.h"
+#if defined(SOC_GPIO_FLEX_GLITCH_FILTER_NUM) || defined(SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER)
+#include "driver/gpio_filter.h"
+#endif
+
+// Latch bitmasks
+std::atomic<uint32_t> EndStops::_activeMask(0);
+std::atomic<uint32_t> EndStops::_latchedMask(0);
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
-EndStops::EndStops()
+/// @param axisIdx Axis index (which determines the latch bits of the endstops)
+EndStops::EndStops(uint32_t axisIdx)
 {
+    // Axis
+    _axisIdx = axisIdx;
+
     // Set initial unused value
     _maxEndStopPin = -1;
     _minEndStopPin = -1;
@@ -32,6 +45,10 @@ EndStops::~EndStops()
 /// @brief Clear endstops
 void EndStops::clear()
 {
+    // Remove interrupts
+    clearInterrupt(_maxIntr);
+    clearInterrupt(_minIntr);
+
     // Check if inputs should be restored (may have had pullup)
     if (_maxEndStopPin >= 0)
         pinMode(_maxEndStopPin, INPUT);
@@ -56,7 +73,10 @@ void EndStops::clear()
 /// @param endStopPin Pin number
 /// @param actvLevel Active level
 /// @param inputType Input type
-void EndStops::add(bool isMax, const char* name, int endStopPin, bool actvLevel, int inputType)
+/// @param useInterrupt Monitor the endstop using GPIO edge interrupts (and latch hits)
+/// @param glitchFilterNs Hardware glitch filter time (0 for none)
+void EndStops::add(bool isMax, const char* name, int endStopPin, bool actvLevel, int inputType,
+            bool useInterrupt, uint32_t glitchFilterNs)
 {
     if (isMax)
     {
@@ -67,6 +87,8 @@ void EndStops::add(bool isMax, const char* name, int endStopPin, bool actvLevel,
         if (_maxEndStopPin < 0)
             return;
         pinMode(_maxEndStopPin, inputType);
+        if (useInterrupt)
+            setupInterrupt(_maxIntr, endStopPin, actvLevel, getLatchBit(_axisIdx, true), glitchFilterNs);
     }
     else
     {
@@ -77,9 +99,124 @@ void EndStops::add(bool isMax, const char* name, int endStopPin, bool actvLevel,
         if (_minEndStopPin < 0)
             return;
         pinMode(_minEndStopPin, inputType);
+        if (useInterrupt)
+            setupInterrupt(_minIntr, endStopPin, actvLevel, getLatchBit(_axisIdx, false), glitchFilterNs);
     }
 } 
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup interrupt monitoring of an endstop
+/// @param intrInfo Interrupt info
+/// @param pin Pin number
+/// @param actvLevel Active level
+/// @param latchBit Latch bit
+/// @param glitchFilterNs Hardware glitch filter time (0 for none)
+/// @return true if interrupts are used (otherwise the endstop is polled)
+bool EndStops::setupInterrupt(InterruptInfo& intrInfo, int pin, bool actvLevel, uint32_t latchBit, uint32_t glitchFilterNs)
+{
+    // Check valid
+    clearInterrupt(intrInfo);
+    if (!GPIO_IS_VALID_GPIO(pin) || (_axisIdx >= 16))
+    {
+        LOG_W(MODULE_PREFIX, "setupInterrupt axis %d pin %d invalid - endstop will be polled", _axisIdx, pin);
+        return false;
+    }
+    intrInfo.pin = pin;
+    intrInfo.actvLevel = actvLevel;
+    intrInfo.latchBit = latchBit;
+    intrInfo.glitchFilterNs = glitchFilterNs;
+
+    // Hardware glitch filter
+    if (glitchFilterNs > 0)
+    {
+#if defined(SOC_GPIO_FLEX_GLITCH_FILTER_NUM) && (SOC_GPIO_FLEX_GLITCH_FILTER_NUM > 0)
+        gpio_flex_glitch_filter_config_t filterConfig = {};
+        filterConfig.clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT;
+        filterConfig.gpio_num = (gpio_num_t)pin;
+        filterConfig.window_width_ns = glitchFilterNs;
+        filterConfig.window_thres_ns = glitchFilterNs;
+        gpio_glitch_filter_handle_t filterHandle = nullptr;
+        if ((gpio_new_flex_glitch_filter(&filterConfig, &filterHandle) == ESP_OK) && 
+                    (gpio_glitch_filter_enable(filterHandle) == ESP_OK))
+            intrInfo.pGlitchFilter = filterHandle;
+#elif defined(SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER)
+        // Pin glitch filter has a fixed time (a few clock cycles)
+        gpio_pin_glitch_filter_config_t filterConfig = {};
+        filterConfig.clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT;
+        filterConfig.gpio_num = (gpio_num_t)pin;
+        gpio_glitch_filter_handle_t filterHandle = nullptr;
+        if ((gpio_new_pin_glitch_filter(&filterConfig, &filterHandle) == ESP_OK) && 
+                    (gpio_glitch_filter_enable(filterHandle) == ESP_OK))
+            intrInfo.pGlitchFilter = filterHandle;
+#endif
+        if (!intrInfo.pGlitchFilter)
+            LOG_W(MODULE_PREFIX, "setupInterrupt axis %d pin %d glitch filter not available", _axisIdx, pin);
+    }
+
+    // Interrupt on both edges so that the active state is tracked as well as hits latched
+    esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    if ((err != ESP_OK) && (err != ESP_ERR_INVALID_STATE))
+    {
+        LOG_W(MODULE_PREFIX, "setupInterrupt axis %d pin %d isr service failed %d - endstop will be polled", _axisIdx, pin, err);
+        return false;
+    }
+    if ((gpio_set_intr_type((gpio_num_t)pin, GPIO_INTR_ANYEDGE) != ESP_OK) ||
+                (gpio_isr_handler_add((gpio_num_t)pin, gpioISR, &intrInfo) != ESP_OK))
+    {
+        LOG_W(MODULE_PREFIX, "setupInterrupt axis %d pin %d failed - endstop will be polled", _axisIdx, pin);
+        gpio_set_intr_type((gpio_num_t)pin, GPIO_INTR_DISABLE);
+        return false;
+    }
+
+    // Initial state
+    gpioISR(&intrInfo);
+    intrInfo.isEnabled = true;
+    gpio_intr_enable((gpio_num_t)pin);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Clear interrupt monitoring of an endstop
+/// @param intrInfo Interrupt info
+void EndStops::clearInterrupt(InterruptInfo& intrInfo)
+{
+    if (intrInfo.isEnabled)
+    {
+        gpio_intr_disable((gpio_num_t)intrInfo.pin);
+        gpio_set_intr_type((gpio_num_t)intrInfo.pin, GPIO_INTR_DISABLE);
+        gpio_isr_handler_remove((gpio_num_t)intrInfo.pin);
+        intrInfo.isEnabled = false;
+    }
+#if defined(SOC_GPIO_FLEX_GLITCH_FILTER_NUM) || defined(SOC_GPIO_SUPPORT_PIN_GLITCH_FILTER)
+    if (intrInfo.pGlitchFilter)
+    {
+        gpio_glitch_filter_disable((gpio_glitch_filter_handle_t)intrInfo.pGlitchFilter);
+        gpio_del_glitch_filter((gpio_glitch_filter_handle_t)intrInfo.pGlitchFilter);
+    }
+#endif
+    intrInfo.pGlitchFilter = nullptr;
+    _activeMask.fetch_and(~intrInfo.latchBit, std::memory_order_relaxed);
+    _latchedMask.fetch_and(~intrInfo.latchBit, std::memory_order_relaxed);
+    intrInfo.latchBit = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief GPIO interrupt handler - updates the active state and latches hits
+/// @param pArg Interrupt info
+void IRAM_ATTR EndStops::gpioISR(void* pArg)
+{
+    InterruptInfo* pIntrInfo = (InterruptInfo*)pArg;
+    if ((gpio_get_level((gpio_num_t)pIntrInfo->pin) != 0) == pIntrInfo->actvLevel)
+    {
+        _activeMask.fetch_or(pIntrInfo->latchBit, std::memory_order_relaxed);
+        _latchedMask.fetch_or(pIntrInfo->latchBit, std::memory_order_relaxed);
+    }
+    else
+    {
+        _activeMask.fetch_and(~pIntrInfo->latchBit, std::memory_order_relaxed);
+    }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Loop function - called frequently
 void EndStops::loop()
@@ -92,6 +229,9 @@ void EndStops::loop()
 /// @return true if at endstop
 bool IRAM_ATTR EndStops::isAtEndStop(bool max)
 {
+    // Interrupt driven endstops have their state in the active mask
+    if (isInterruptDriven(max))
+        return (getActiveMask() & getLatchBit(_axisIdx, max)) != 0;
     if (max)
     {
         if (_maxEndStopPin < 0)
@@ -157,7 +297,8 @@ String EndStops::getDebugJSON(bool includeBraces, bool detailed) const
         retStr += "\"n\":\"" + _maxName + "\",";
         retStr += "\"p\":" + String(_maxEndStopPin) + ",";
         retStr += "\"lev\":" + String(_maxActLevel) + ",";
-        retStr += "\"type\":" + String(_maxInputType) + "},";
+        retStr += "\"type\":" + String(_maxInputType) + ",";
+        retStr += "\"intr\":" + String(_maxIntr.isEnabled ? 1 : 0) + "},";
     }
     if (_minEndStopPin >= 0)
     {
@@ -165,7 +306,8 @@ String EndStops::getDebugJSON(bool includeBraces, bool detailed) const
         retStr += "\"n\":\"" + _minName + "\",";
         retStr += "\"p\":" + String(_minEndStopPin) + ",";
         retStr += "\"lev\":" + String(_minActLevel) + ",";
-        retStr += "\"type\":" + String(_minInputType) + "},";
+        retStr += "\"type\":" + String(_minInputType) + ",";
+        retStr += "\"intr\":" + String(_minIntr.isEnabled ? 1 : 0) + "},";
     }
     if (includeBraces)
         retStr += "}";
@@ -9,20 +9,26 @@
 #pragma once
 
 #include <stdint.h>
+#include <atomic>
 #include "RaftUtils.h"
 #include "RaftArduino.h"
+#include "driver/gpio.h"
 
 class EndStops
 {
 public:
-    EndStops();
+    EndStops(uint32_t axisIdx = 0);
     virtual ~EndStops();
 
     // Clear
     void clear();
 
     // Add endstop
-    void add(bool isMax, const char* name, int endStopPin, bool actvLevel, int inputType);
+    // If useInterrupt is true the endstop is monitored by GPIO edge interrupts and hits are latched (so glitches
+    // shorter than the ramp generator tick are not missed) - glitchFilterNs enables the hardware glitch filter
+    // (where supported) which ignores pulses shorter than the given time
+    void add(bool isMax, const char* name, int endStopPin, bool actvLevel, int inputType,
+                bool useInterrupt = false, uint32_t glitchFilterNs = 0);
 
     // Loop - called frequently
     virtual void loop();
@@ -33,17 +39,49 @@ public:
     // Check if valid
     bool isValid(bool max);
 
+    // Check if interrupt driven (the hit state is in the latch bitmasks)
+    bool IRAM_ATTR isInterruptDriven(bool max) const
+    {
+        return max ? _maxIntr.isEnabled : _minIntr.isEnabled;
+    }
+
     // Get pin and level
     bool getPinAndLevel(bool max, int& pin, bool& actvLevel);
 
     // Get debug JSON
     String getDebugJSON(bool includeBraces, bool detailed) const;
-    
+
+    // Latch bitmasks shared by all interrupt-driven endstops - one bit for each end of each axis
+    // The active mask has the current state and the latched mask records hits since the latch was armed
+    static uint32_t IRAM_ATTR getLatchBit(uint32_t axisIdx, bool max)
+    {
+        return 1UL << (axisIdx * 2 + (max ? 1 : 0));
+    }
+    static uint32_t IRAM_ATTR getActiveMask()
+    {
+        return _activeMask.load(std::memory_order_relaxed);
+    }
+    static uint32_t IRAM_ATTR getLatchedMask()
+    {
+        return _latchedMask.load(std::memory_order_relaxed);
+    }
+
+    // Arm latches - the latched state of the given bits is reset to the current state (so an endstop which
+    // is already active is reported as hit)
+    static void IRAM_ATTR armLatches(uint32_t latchBits)
+    {
+        _latchedMask.fetch_and(~latchBits, std::memory_order_relaxed);
+        _latchedMask.fetch_or(_activeMask.load(std::memory_order_relaxed) & latchBits, std::memory_order_relaxed);
+    }
+
 private:
 
     // Debug
     static constexpr const char* MODULE_PREFIX = "EndStops";
 
+    // Axis
+    uint32_t _axisIdx = 0;
+
     String _maxName;
     int _maxEndStopPin;
     bool _maxActLevel;
@@ -53,4 +91,26 @@ private:
     int _minEndStopPin;
     int _minActLevel;
     int _minInputType;
+
+    // Interrupt monitoring of an endstop
+    struct InterruptInfo
+    {
+        bool isEnabled = false;
+        int pin = -1;
+        bool actvLevel = false;
+        uint32_t latchBit = 0;
+        uint32_t glitchFilterNs = 0;
+        void* pGlitchFilter = nullptr;
+    };
+    InterruptInfo _maxIntr;
+    InterruptInfo _minIntr;
+
+    // Latch bitmasks
+    static std::atomic<uint32_t> _activeMask;
+    static std::atomic<uint32_t> _latchedMask;
+
+    // Helpers
+    bool setupInterrupt(InterruptInfo& intrInfo, int pin, bool actvLevel, uint32_t latchBit, uint32_t glitchFilterNs);
+    void clearInterrupt(InterruptInfo& intrInfo);
+    static void IRAM_ATTR gpioISR(void* pArg);
 };
@@ -40,10 +40,12 @@ public:
         _arm2LenMM = AxisPosDataType(config.getDouble("arm2LenMM", 100));
         _maxRadiusMM = AxisPosDataType(config.getDouble("maxRadiusMM", _arm1LenMM + _arm2LenMM));
         _originTheta2OffsetDegrees = AxisPosDataType(config.getDouble("originTheta2OffsetDegrees", 180));
+        _incrementalIK = config.getBool("incrementalIK", false);
+        _incrementalIKMaxErrMM = float(config.getDouble("ikMaxErrMM", INCREMENTAL_IK_MAX_ERR_MM_DEFAULT));
 
 #ifdef DEBUG_KINEMATICS_SA_SCARA_SETUP
-        LOG_I(MODULE_PREFIX, "arm1LenMM %.2f arm2LenMM %.2f maxRadiusMM %.2f",
-                _arm1LenMM, _arm2LenMM, _maxRadiusMM);
+        LOG_I(MODULE_PREFIX, "arm1LenMM %.2f arm2LenMM %.2f maxRadiusMM %.2f incrementalIK %s maxErrMM %.4f",
+                _arm1LenMM, _arm2LenMM, _maxRadiusMM, _incrementalIK ? "Y" : "N", _incrementalIKMaxErrMM);
 #endif
     }
 
@@ -60,6 +62,10 @@ public:
                               const AxesParams& axesParams,
                               bool constrainToBounds) const override final
     {
+        // Incremental solution (warm-started from the previous solution) if enabled and valid
+        if (_incrementalIK && ptToActuatorIncremental(targetPt, outActuator, curAxesState, axesParams))
+            return true;
+
         // Convert the current position to angles wrapped 0..360 degrees
         AxesValues<AxisCalcDataType> curAngles;
         calculateAngles(curAxesState, curAngles, axesParams);
@@ -111,6 +117,10 @@ public:
         // Apply this to calculate required steps (relative to the current position)
         relativeAnglesToAbsoluteSteps(relativeAngleSolution, curAxesState, outActuator, axesParams);
 
+        // Seed the incremental solution
+        if (_incrementalIK)
+            seedIncrementalIK(targetPt, relativeAngleSolution, curAxesState, outActuator, axesParams);
+
         // Debug
 #ifdef DEBUG_KINEMATICS_SA_SCARA
         LOG_I(MODULE_PREFIX, "ptToActuator X %.2f (%.2f) Y %.2f (%.2f) dist %.2f abs steps %d %d minRot1 %.2f minRot2 %.2f", 
@@ -149,6 +159,48 @@ public:
         return true;        
     }
 
+    /// @brief Estimate the deviation from a straight line of a block between two points
+    /// @param startPt Start point cartesian from origin
+    /// @param endPt End point cartesian from origin
+    /// @param curAxesState Current axes state (at the start point)
+    /// @param axesParams Axes parameters
+    /// @param deviationMM Output distance of the path midpoint from the midpoint of the straight line
+    /// @return true (geometry is non-linear)
+    /// @note The mid-point deviation is the maximum for short blocks and it scales with the square of the length
+    virtual bool estimateLinearDeviation(const AxesValues<AxisPosDataType>& startPt,
+                const AxesValues<AxisPosDataType>& endPt,
+                const AxesState& curAxesState,
+                const AxesParams& axesParams,
+                AxisDistDataType& deviationMM) const override final
+    {
+        // Angles at the start point - use the solution closest to the current angles
+        AxesValues<AxisCalcDataType> curAngles;
+        calculateAngles(curAxesState, curAngles, axesParams);
+        AxesValues<AxisCalcDataType> startAngles, endAngles;
+        if (!closestSolution(startPt, curAngles, startAngles, axesParams) ||
+                !closestSolution(endPt, startAngles, endAngles, axesParams))
+        {
+            // Out of bounds or close to the origin (where the arm rotates in place) - no sensible estimate
+            // so treat as a large deviation which is handled by splitting at the minimum block length
+            deviationMM = _arm1LenMM + _arm2LenMM;
+            return true;
+        }
+
+        // Forward kinematics at the mid-point of the actuator motion
+        AxisCalcDataType midTheta1 = AxisUtils::d2r(startAngles.getVal(0) + 
+                        computeRelativeAngle(endAngles.getVal(0), startAngles.getVal(0)) / 2);
+        AxisCalcDataType midTheta2 = AxisUtils::d2r(startAngles.getVal(1) + 
+                        computeRelativeAngle(endAngles.getVal(1), startAngles.getVal(1)) / 2);
+        AxisCalcDataType midX = _arm1LenMM * cos(midTheta1) + _arm2LenMM * cos(midTheta2);
+        AxisCalcDataType midY = _arm1LenMM * sin(midTheta1) + _arm2LenMM * sin(midTheta2);
+
+        // Distance from the mid-point of the straight line
+        AxisCalcDataType errX = midX - (startPt.getVal(0) + endPt.getVal(0)) / 2;
+        AxisCalcDataType errY = midY - (startPt.getVal(1) + endPt.getVal(1)) / 2;
+        deviationMM = AxisDistDataType(sqrt(errX * errX + errY * errY));
+        return true;
+    }
+
     /// @brief Get arm lengths
     /// @param arm1LenMM Output arm 1 length in mm
     /// @param arm2LenMM Output arm 2 length in mm
@@ -172,9 +224,168 @@ public:
         return _originTheta2OffsetDegrees;
     }
 
+    /// @brief Enable/disable incremental inverse kinematics
+    /// @param enable true to warm-start from the previous solution when the target is nearby
+    /// @param maxErrMM Maximum position error of an incremental solution (otherwise the exact solution is used)
+    void setIncrementalIK(bool enable, float maxErrMM)
+    {
+        _incrementalIK = enable;
+        _incrementalIKMaxErrMM = maxErrMM;
+        _ikCache.isValid = false;
+    }
+
+    /// @brief Get count of incremental and exact solutions (since enabled)
+    /// @param incrementalCount Number of incremental solutions
+    /// @param exactCount Number of exact solutions
+    void getIncrementalIKCounts(uint32_t& incrementalCount, uint32_t& exactCount) const
+    {
+        incrementalCount = _ikCache.incrementalCount;
+        exactCount = _ikCache.exactCount;
+    }
+
 private:
     static constexpr const char *MODULE_PREFIX = "KinematicsSingleArmSCARA";
 
+    /// @brief Incremental inverse kinematics - Newton iterations on the forward kinematics starting from the
+    ///        previous solution with sin/cos of the angles updated using a polynomial rotation
+    /// @param targetPt Target point cartesian from origin
+    /// @param outActuator Output actuator in absolute steps from origin
+    /// @param curAxesState Current position (in both units and steps from origin)
+    /// @param axesParams Axes parameters
+    /// @return false if the exact solution must be used (no previous solution, the current position isn't the
+    ///         previous solution, target not close, near a singularity or out of bounds or error too large)
+    bool ptToActuatorIncremental(const AxesValues<AxisPosDataType>& targetPt,
+                              AxesValues<AxisStepsDataType>& outActuator,
+                              const AxesState& curAxesState,
+                              const AxesParams& axesParams) const
+    {
+        // Check the previous solution is where the axes are now and periodically use the exact solution
+        if (!_ikCache.isValid || 
+                (_ikCache.steps[0] != curAxesState.getStepsFromOrigin(0)) ||
+                (_ikCache.steps[1] != curAxesState.getStepsFromOrigin(1)) ||
+                (_ikCache.solnsSinceExact >= INCREMENTAL_IK_EXACT_EVERY_N))
+            return false;
+
+        // Bounds and close to origin checks (no sqrt needed)
+        float x = targetPt.getVal(0);
+        float y = targetPt.getVal(1);
+        float radiusSq = x * x + y * y;
+        float minRadius = fabsf(_arm1LenMM - _arm2LenMM);
+        float maxRadius = fminf(_arm1LenMM + _arm2LenMM, _maxRadiusMM);
+        float originTol = fmaxf(CLOSE_TO_ORIGIN_TOLERANCE_MM, minRadius);
+        if ((radiusSq <= originTol * originTol) || (radiusSq > maxRadius * maxRadius))
+            return false;
+
+        // Newton iterations
+        float sin1 = _ikCache.sinTheta[0], cos1 = _ikCache.cosTheta[0];
+        float sin2 = _ikCache.sinTheta[1], cos2 = _ikCache.cosTheta[1];
+        AxisCalcDataType theta1Rads = _ikCache.thetaRads[0];
+        AxisCalcDataType theta2Rads = _ikCache.thetaRads[1];
+        float errX = x - _ikCache.ptX;
+        float errY = y - _ikCache.ptY;
+        float maxErrSq = _incrementalIKMaxErrMM * _incrementalIKMaxErrMM;
+        bool isSolved = false;
+        for (uint32_t iter = 0; iter < INCREMENTAL_IK_MAX_ITERATIONS; iter++)
+        {
+            // Jacobian determinant is l1 * l2 * sin(theta2 - theta1) - avoid the straight arm singularity
+            float sinDiff = sin2 * cos1 - cos2 * sin1;
+            if (fabsf(sinDiff) < INCREMENTAL_IK_MIN_SIN_DIFF)
+                return false;
+
+            // Angle changes (inverse Jacobian applied to the position error)
+            float d1 = (cos2 * errX + sin2 * errY) / (_arm1LenMM * sinDiff);
+            float d2 = -(cos1 * errX + sin1 * errY) / (_arm2LenMM * sinDiff);
+            if ((fabsf(d1) > INCREMENTAL_IK_MAX_ANGLE_CHANGE_RADS) || (fabsf(d2) > INCREMENTAL_IK_MAX_ANGLE_CHANGE_RADS))
+                return false;
+            theta1Rads += d1;
+            theta2Rads += d2;
+            rotateSinCos(sin1, cos1, d1);
+            rotateSinCos(sin2, cos2, d2);
+
+            // Error from forward kinematics
+            errX = x - (_arm1LenMM * cos1 + _arm2LenMM * cos2);
+            errY = y - (_arm1LenMM * sin1 + _arm2LenMM * sin2);
+            if (errX * errX + errY * errY <= maxErrSq)
+            {
+                isSolved = true;
+                break;
+            }
+        }
+        if (!isSolved)
+            return false;
+
+        // Convert to absolute steps
+        outActuator.setVal(0, int32_t(round(AxisUtils::r2d(theta1Rads, false) * axesParams.getStepsPerRot(0) / 360)));
+        outActuator.setVal(1, int32_t(round((AxisUtils::r2d(theta2Rads, false) - _originTheta2OffsetDegrees) * axesParams.getStepsPerRot(1) / 360)));
+
+        // Update the previous solution
+        _ikCache.ptX = x - errX;
+        _ikCache.ptY = y - errY;
+        _ikCache.thetaRads[0] = theta1Rads;
+        _ikCache.thetaRads[1] = theta2Rads;
+        _ikCache.sinTheta[0] = sin1;
+        _ikCache.cosTheta[0] = cos1;
+        _ikCache.sinTheta[1] = sin2;
+        _ikCache.cosTheta[1] = cos2;
+        _ikCache.steps[0] = outActuator.getVal(0);
+        _ikCache.steps[1] = outActuator.getVal(1);
+        _ikCache.solnsSinceExact++;
+        _ikCache.incrementalCount++;
+
+#ifdef DEBUG_KINEMATICS_SA_SCARA
+        LOG_I(MODULE_PREFIX, "ptToActuatorIncremental x %.2f y %.2f theta1 %.2f theta2 %.2f steps %d %d",
+                x, y, AxisUtils::r2d(theta1Rads), AxisUtils::r2d(theta2Rads), outActuator.getVal(0), outActuator.getVal(1));
+#endif
+        return true;
+    }
+
+    /// @brief Seed the incremental inverse kinematics from an exact solution
+    /// @param targetPt Target point cartesian from origin
+    /// @param relativeAngles Solution angles relative to the current position
+    /// @param curAxesState Current position (in both units and steps from origin)
+    /// @param outActuator Solution in absolute steps from origin
+    /// @param axesParams Axes parameters
+    void seedIncrementalIK(const AxesValues<AxisPosDataType>& targetPt,
+            const AxesValues<AxisCalcDataType>& relativeAngles,
+            const AxesState& curAxesState,
+            const AxesValues<AxisStepsDataType>& outActuator,
+            const AxesParams& axesParams) const
+    {
+        // Angles are kept unwrapped (continuous with the steps from origin)
+        AxisCalcDataType theta1Degrees = AxisCalcDataType(curAxesState.getStepsFromOrigin(0)) * 360 / axesParams.getStepsPerRot(0)
+                            + relativeAngles.getVal(0);
+        AxisCalcDataType theta2Degrees = AxisCalcDataType(curAxesState.getStepsFromOrigin(1)) * 360 / axesParams.getStepsPerRot(1)
+                            + _originTheta2OffsetDegrees + relativeAngles.getVal(1);
+        _ikCache.thetaRads[0] = AxisUtils::d2r(theta1Degrees, false);
+        _ikCache.thetaRads[1] = AxisUtils::d2r(theta2Degrees, false);
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            _ikCache.sinTheta[i] = sin(_ikCache.thetaRads[i]);
+            _ikCache.cosTheta[i] = cos(_ikCache.thetaRads[i]);
+        }
+        _ikCache.ptX = _arm1LenMM * _ikCache.cosTheta[0] + _arm2LenMM * _ikCache.cosTheta[1];
+        _ikCache.ptY = _arm1LenMM * _ikCache.sinTheta[0] + _arm2LenMM * _ikCache.sinTheta[1];
+        _ikCache.steps[0] = outActuator.getVal(0);
+        _ikCache.steps[1] = outActuator.getVal(1);
+        _ikCache.solnsSinceExact = 0;
+        _ikCache.exactCount++;
+        _ikCache.isValid = true;
+    }
+
+    /// @brief Rotate sin and cos of an angle by a small angle (polynomial approximation of sin/cos of the change)
+    /// @param sinVal sin of the angle (updated)
+    /// @param cosVal cos of the angle (updated)
+    /// @param deltaRads Change in angle (small)
+    static void rotateSinCos(float& sinVal, float& cosVal, float deltaRads)
+    {
+        float deltaSq = deltaRads * deltaRads;
+        float sinDelta = deltaRads * (1 - deltaSq / 6);
+        float cosDelta = 1 - deltaSq / 2 * (1 - deltaSq / 12);
+        float newSin = sinVal * cosDelta + cosVal * sinDelta;
+        cosVal = cosVal * cosDelta - sinVal * sinDelta;
+        sinVal = newSin;
+    }
+
     /// @brief Convert from Cartesian to Polar coordinates
     /// @param targetPt Target point in Cartesian coordinates
     /// @param targetSoln1 Output solution 1 in Polar coordinates
@@ -222,6 +433,31 @@ private:
         return posValid;        
     }
 
+    /// @brief Find the inverse kinematics solution closest to reference angles
+    /// @param targetPt Target point in Cartesian coordinates
+    /// @param refAngles Reference angles in degrees
+    /// @param solnAngles Output solution angles in degrees (wrapped 0..360)
+    /// @param axesParams Axes parameters
+    /// @return false if out of bounds or close to the origin
+    bool closestSolution(const AxesValues<AxisPosDataType>& targetPt,
+            const AxesValues<AxisCalcDataType>& refAngles,
+            AxesValues<AxisCalcDataType>& solnAngles,
+            const AxesParams& axesParams) const
+    {
+        if (AxisUtils::isApprox(targetPt.getVal(0), 0, CLOSE_TO_ORIGIN_TOLERANCE_MM) && 
+                    AxisUtils::isApprox(targetPt.getVal(1), 0, CLOSE_TO_ORIGIN_TOLERANCE_MM))
+            return false;
+        AxesValues<AxisCalcDataType> soln1, soln2;
+        if (!cartesianToPolar(targetPt, soln1, soln2, axesParams))
+            return false;
+        AxisCalcDataType rot1 = fabs(computeRelativeAngle(soln1.getVal(0), refAngles.getVal(0))) + 
+                        fabs(computeRelativeAngle(soln1.getVal(1), refAngles.getVal(1)));
+        AxisCalcDataType rot2 = fabs(computeRelativeAngle(soln2.getVal(0), refAngles.getVal(0))) + 
+                        fabs(computeRelativeAngle(soln2.getVal(1), refAngles.getVal(1)));
+        solnAngles = rot1 <= rot2 ? soln1 : soln2;
+        return true;
+    }
+
     /// @brief Calculate the current axis angles
     /// @param curAxesState Current axes state (includes current position in steps from origin)
     /// @param anglesDegrees Output angles in degrees
@@ -231,8 +467,8 @@ private:
                 const AxesParams& axesParams) const
     {
         // All angles returned are in degrees anticlockwise from the x-axis
-        AxisCalcDataType theta1Degrees = AxisUtils::wrapDegrees(curAxesState.getStepsFromOrigin(0) * 360 / axesParams.getStepsPerRot(0));
-        AxisCalcDataType theta2Degrees = AxisUtils::wrapDegrees(curAxesState.getStepsFromOrigin(1) * 360 / axesParams.getStepsPerRot(1) + _originTheta2OffsetDegrees);
+        AxisCalcDataType theta1Degrees = AxisUtils::wrapDegrees(AxisCalcDataType(curAxesState.getStepsFromOrigin(0)) * 360 / axesParams.getStepsPerRot(0));
+        AxisCalcDataType theta2Degrees = AxisUtils::wrapDegrees(AxisCalcDataType(curAxesState.getStepsFromOrigin(1)) * 360 / axesParams.getStepsPerRot(1) + _originTheta2OffsetDegrees);
         anglesDegrees = { theta1Degrees, theta2Degrees };
 #ifdef DEBUG_KINEMATICS_SA_SCARA
         LOG_I(MODULE_PREFIX, "stepsToPolar ax0Steps %d ax1Steps %d a %.2fd b %.2fd",
@@ -301,4 +537,30 @@ private:
     // Tolderance for check close to origin in mm
     static constexpr AxisPosDataType CLOSE_TO_ORIGIN_TOLERANCE_MM = 1;
 
+    // Incremental inverse kinematics
+    static constexpr float INCREMENTAL_IK_MAX_ERR_MM_DEFAULT = 0.01f;
+    static constexpr uint32_t INCREMENTAL_IK_MAX_ITERATIONS = 2;
+    static constexpr uint32_t INCREMENTAL_IK_EXACT_EVERY_N = 100;
+    static constexpr float INCREMENTAL_IK_MIN_SIN_DIFF = 0.05f;
+    static constexpr float INCREMENTAL_IK_MAX_ANGLE_CHANGE_RADS = 0.05f;
+    bool _incrementalIK = false;
+    float _incrementalIKMaxErrMM = INCREMENTAL_IK_MAX_ERR_MM_DEFAULT;
+
+    // Previous solution (updated from the const conversion methods) - angles are unwrapped and
+    // in the same sense as the steps from origin
+    struct IKCache
+    {
+        bool isValid = false;
+        AxisStepsDataType steps[2] = {0, 0};
+        AxisCalcDataType thetaRads[2] = {0, 0};
+        float sinTheta[2] = {0, 0};
+        float cosTheta[2] = {1, 1};
+        float ptX = 0;
+        float ptY = 0;
+        uint32_t solnsSinceExact = 0;
+        uint32_t incrementalCount = 0;
+        uint32_t exactCount = 0;
+    };
+    mutable IKCache _ikCache;
+
 };
@@ -43,6 +43,27 @@ public:
                               const AxesState& curAxesState,
                               const AxesParams& axesParams,
                               bool constrainToBounds) const override final
+    {
+        AxesValues<AxisCalcDataType> actuatorExact;
+        if (!ptToActuatorExact(targetPt, actuatorExact, curAxesState, axesParams, constrainToBounds))
+            return false;
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+            outActuator.setVal(axisIdx, round(actuatorExact.getVal(axisIdx)));
+        return true;
+    }
+
+    /// @brief Convert a point in cartesian to actuator steps (not rounded to whole steps)
+    /// @param targetPt Target point cartesian from origin
+    /// @param outActuatorExact Output actuator in absolute steps from origin (including the fraction of a step)
+    /// @param curAxesState Current position (in both units and steps from origin)
+    /// @param axesParams Axes parameters
+    /// @param constrainToBounds Constrain out of bounds (if not constrained then return false if the point is OOB and OOB is not allowed)
+    /// @return false if out of bounds or invalid
+    virtual bool ptToActuatorExact(const AxesValues<AxisPosDataType>& targetPt,
+                              AxesValues<AxisCalcDataType>& outActuatorExact,
+                              const AxesState& curAxesState,
+                              const AxesParams& axesParams,
+                              bool constrainToBounds) const override final
     {
         // Check machine bounds
         AxesValues<AxisPosDataType> targetPtCopy = targetPt;
@@ -68,17 +89,17 @@ public:
             float axisValFromHome = targetPtCopy.getVal(axisIdx);
 
             // Convert to steps
-            outActuator.setVal(axisIdx, round(axisValFromHome * axesParams.getStepsPerUnit(axisIdx)));
+            outActuatorExact.setVal(axisIdx, axisValFromHome * axesParams.getStepsPerUnit(axisIdx));
 
             // TODO - decide if this origin steps needed
             // outActuator.setVal(axisIdx, round(axisValFromHome * axesParams.getStepsPerUnit(axisIdx) + axesParams.gethomeOffsetSteps(axisIdx)));
 
 #ifdef DEBUG_KINEMATICS_XYZ
-            LOG_I(MODULE_PREFIX, "ptToActuator axis%d %.2f(%.2f)-> %d",
+            LOG_I(MODULE_PREFIX, "ptToActuator axis%d %.2f(%.2f)-> %.3f",
                   axisIdx,
                   targetPtCopy.getVal(axisIdx),
                   targetPt.getVal(axisIdx),
-                  outActuator.getVal(axisIdx));
+                  outActuatorExact.getVal(axisIdx));
 #endif
         }
         return true;
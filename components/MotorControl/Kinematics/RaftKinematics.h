@@ -48,10 +48,62 @@ public:
                 const AxesState &curAxesState, 
                 const AxesParams &axesParams) const = 0;
 
-    // Correct step overflow (necessary in continuous rotation bots)
+    /// @brief Estimate the deviation from a straight line of a block between two points
+    /// @param startPt Start point cartesian from origin
+    /// @param endPt End point cartesian from origin
+    /// @param curAxesState Current axes state (at the start point)
+    /// @param axesParams Axes parameters
+    /// @param deviationMM Output max distance of the path from the straight line between the points
+    /// @return false if the geometry is linear (actuators moving in proportion produce a straight line)
+    /// @note The actuators move in proportion to each other during a block so on non-linear geometries the
+    ///       path between the block end points is curved - the deviation is used to split moves adaptively
+    virtual bool estimateLinearDeviation(const AxesValues<AxisPosDataType>& startPt,
+                const AxesValues<AxisPosDataType>& endPt,
+                const AxesState& curAxesState,
+                const AxesParams& axesParams,
+                AxisDistDataType& deviationMM) const
+    {
+        deviationMM = 0;
+        return false;
+    }
+
+    /// @brief Convert a point in cartesian to actuator steps (not rounded to whole steps)
+    /// @param targetPt Target point cartesian from origin
+    /// @param outActuatorExact Output actuator in absolute steps from origin (including the fraction of a step)
+    /// @param curAxesState Current position (in both units and steps from origin)
+    /// @param axesParams Axes parameters
+    /// @param constrainToBounds Constrain out of bounds (if not constrained then return false if the point is out of bounds)
+    /// @return false if out of bounds or invalid
+    /// @note The default uses ptToActuator so the fraction is zero - geometries which can provide the exact
+    ///       value should override this so that the sub-step residual is carried from block to block
+    virtual bool ptToActuatorExact(const AxesValues<AxisPosDataType>& targetPt,
+                              AxesValues<AxisCalcDataType>& outActuatorExact,
+                              const AxesState& curAxesState,
+                              const AxesParams& axesParams,
+                              bool constrainToBounds) const
+    {
+        AxesValues<AxisStepsDataType> actuator;
+        if (!ptToActuator(targetPt, actuator, curAxesState, axesParams, constrainToBounds))
+            return false;
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+            outActuatorExact.setVal(axisIdx, actuator.getVal(axisIdx));
+        return true;
+    }
+
+    /// @brief Correct step overflow - called after each block is planned (or found to have no whole steps) to
+    ///        record the part of the commanded actuator position which has not been stepped
+    /// @param curAxesState Current axes state (steps from origin are those planned) - the sub-step residual is updated
+    /// @param actuatorExact Commanded actuator position (absolute steps from origin including the fraction of a step)
+    /// @param axesParams Axes parameters
+    /// @note The residual is carried into the next block (the next block's steps are rounded from the commanded
+    ///       position rather than its fractional part being discarded) - continuous rotation geometries can
+    ///       override this to also wrap the step count
     virtual void correctStepOverflow(AxesState &curAxesState, 
+                const AxesValues<AxisCalcDataType>& actuatorExact,
                 const AxesParams &axesParams) const
     {
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+            curAxesState.setStepResidual(axisIdx, actuatorExact.getVal(axisIdx) - curAxesState.getStepsFromOrigin(axisIdx));
     }
 
     /// @brief Pre-process coordinates
@@ -10,8 +10,10 @@
 #include "RaftJsonPrefixed.h"
 #include "RaftBusSystem.h"
 #include "Logger.h"
+#include "MotionPerfCounters.h"
 
 // #define DEBUG_MOTOR_CMD_JSON
+// #define DEBUG_MOTOR_CMD_BINARY
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
@@ -26,7 +28,8 @@ MotorControl::MotorControl(const char* pClassName, const char *pDevConfigJson)
 /// @brief Destructor
 MotorControl::~MotorControl()
 {
-    // Tell motion controller to stop
+    // Tell motion controllers to stop
+    clearMotionGroups();
     _motionController.deinit();
 }
 
@@ -34,14 +37,20 @@ MotorControl::~MotorControl()
 // @brief Setup the device
 void MotorControl::setup()
 {
-    // Setup motion controller
-    _motionController.setup(deviceConfig);
+    // Setup motion controller (the timer is shared if there are other motion groups)
+    clearMotionGroups();
+    std::vector<String> groupsVec;
+    deviceConfig.getArrayElems("groups", groupsVec);
+    _motionController.setup(deviceConfig, groupsVec.size() > 0 ? &_sharedRampGenTimer : nullptr);
 
     // Setup serial bus
     String serialBusName = deviceConfig.getString("bus", "");
     _pMotorSerialBus = raftBusSystem.getBusByName(serialBusName);
     _motionController.setupSerialBus(_pMotorSerialBus, false); 
 
+    // Setup other motion groups
+    setupMotionGroups(groupsVec);
+
     // Debug
     LOG_I(MODULE_PREFIX, "setup type %s serialBusName %s%s", 
             deviceClassName.c_str(), serialBusName.c_str(),
@@ -52,8 +61,62 @@ void MotorControl::setup()
 // @brief Main loop for the device (called frequently)
 void MotorControl::loop()
 {
-    // Loop motion controller
+    // Loop motion controllers
     _motionController.loop();
+    for (MotionGroup& motionGroup : _motionGroups)
+        motionGroup.pMotionController->loop();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup motion groups (other than the main group)
+/// @param groupsVec Config of each group
+/// @note Each group's config has the same form as the device config (axes, ramp, motion, motorEn, bus) plus a
+///       name used to address the group in commands - the ramp timer settings of the main group apply to all
+void MotorControl::setupMotionGroups(const std::vector<String>& groupsVec)
+{
+    for (RaftJson groupConfig : groupsVec)
+    {
+        MotionGroup motionGroup;
+        motionGroup.name = groupConfig.getString("name", "");
+        if ((motionGroup.name.length() == 0) || getMotionGroup(motionGroup.name))
+        {
+            LOG_E(MODULE_PREFIX, "setupMotionGroups group name missing or duplicated '%s'", motionGroup.name.c_str());
+            continue;
+        }
+        motionGroup.pMotionController = new MotionController();
+        motionGroup.pMotionController->setup(groupConfig, &_sharedRampGenTimer);
+        String busName = groupConfig.getString("bus", "");
+        RaftBus* pBus = busName.length() > 0 ? raftBusSystem.getBusByName(busName) : nullptr;
+        motionGroup.pMotionController->setupSerialBus(pBus, false);
+        _motionGroups.push_back(motionGroup);
+        LOG_I(MODULE_PREFIX, "setupMotionGroups group %s busName %s%s", motionGroup.name.c_str(), 
+                busName.c_str(), (busName.length() == 0) || pBus ? "" : " (BUS INVALID)");
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Clear motion groups (other than the main group)
+void MotorControl::clearMotionGroups()
+{
+    for (MotionGroup& motionGroup : _motionGroups)
+        delete motionGroup.pMotionController;
+    _motionGroups.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get a motion group
+/// @param groupName Name of the group (empty for the main group)
+/// @return Motion controller of the group (nullptr if there is no group with the name)
+MotionController* MotorControl::getMotionGroup(const String& groupName)
+{
+    if (groupName.length() == 0)
+        return &_motionController;
+    for (MotionGroup& motionGroup : _motionGroups)
+    {
+        if (motionGroup.name.equals(groupName))
+            return motionGroup.pMotionController;
+    }
+    return nullptr;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -77,7 +140,19 @@ bool MotorControl::hasCapability(const char* pCapabilityStr) const
 String MotorControl::getDataJSON(RaftDeviceJSONLevel level) const
 {
     // Get data
-    return _motionController.getDataJSON(level);
+    String jsonStr = _motionController.getDataJSON(level);
+    if ((_motionGroups.size() == 0) || (jsonStr.length() < 2))
+        return jsonStr;
+
+    // Other motion groups
+    String groupsJson;
+    for (const MotionGroup& motionGroup : _motionGroups)
+    {
+        groupsJson += groupsJson.length() > 0 ? "," : "";
+        groupsJson += "\"" + motionGroup.name + "\":" + motionGroup.pMotionController->getDataJSON(level);
+    }
+    jsonStr = jsonStr.substring(0, jsonStr.length() - 1);
+    return jsonStr + (jsonStr.length() > 1 ? "," : "") + "\"groups\":{" + groupsJson + "}}";
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -112,6 +187,38 @@ double MotorControl::getNamedValue(const char* param, bool& isFresh) const
             return _motionController.isBusy();
             break;
         }
+        case 'q':
+        {
+            // Queue slots available for streaming
+            isFresh = true;
+            return _motionController.streamGetQueueSlots();
+        }
+        case 'm':
+        {
+            // Time of motion buffered (ms)
+            isFresh = true;
+            return _motionController.streamGetBufferedMs();
+        }
+        case 'i':
+        {
+            // Last completed motion tracking index
+            uint32_t motionTrackingIdx = 0;
+            uint32_t completedCount = 0;
+            isFresh = _motionController.streamGetLastCompleted(motionTrackingIdx, completedCount);
+            return motionTrackingIdx;
+        }
+        case 'f':
+        {
+            // Feed override (percent)
+            isFresh = true;
+            return _motionController.getFeedOverride();
+        }
+        case 't':
+        {
+            // Shared time (us) used for moves with a scheduled start time
+            isFresh = true;
+            return double(_motionController.getSharedTimeUs());
+        }
         default: { isFresh = false; return 0; }
     }
 }
@@ -124,36 +231,161 @@ double MotorControl::getNamedValue(const char* param, bool& isFresh) const
 /// @return RaftRetCode
 RaftRetCode MotorControl::getDataBinary(uint32_t formatCode, std::vector<uint8_t>& buf, uint32_t bufMaxLen) const
 {
-    return RAFT_NOT_IMPLEMENTED;
-}
-
-// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// /// @brief Send a binary command to the device
-// /// @param formatCode Format code for the command
-// /// @param pData Pointer to the data
-// /// @param dataLen Length of the data
-// /// @return RaftRetCode
-// RaftRetCode MotorControl::sendCmdBinary(uint32_t formatCode, const uint8_t* pData, uint32_t dataLen)
-// {
-//     // Check format code
-//     if (formatCode == MULTISTEPPER_CMD_BINARY_FORMAT_1)
-//     {
-//         // Check length ok
-//         if (dataLen < MULTISTEPPER_OPCODE_POS + 1)
-//             return RAFT_INVALID_DATA;
-
-//         // Check op-code
-//         switch(pData[MULTISTEPPER_OPCODE_POS])
-//         {
-//             case MULTISTEPPER_MOVETO_OPCODE:
-//             {
-//                 handleCmdBinary_MoveTo(pData + MULTISTEPPER_OPCODE_POS + 1, dataLen - MULTISTEPPER_OPCODE_POS - 1);
-//                 break;
-//             }
-//         }
-//     }
-//     return RAFT_OK;
-// }
+    // Check format code
+    if (formatCode == MULTISTEPPER_TRACE_BINARY_FORMAT_1)
+        return getTraceBinary(buf, bufMaxLen);
+    if ((formatCode == MULTISTEPPER_TELEM_BINARY_FORMAT_1) || (formatCode == MULTISTEPPER_TELEM_KEYFRAME_BINARY_FORMAT_1))
+        return getTelemetryBinary(buf, bufMaxLen, formatCode == MULTISTEPPER_TELEM_KEYFRAME_BINARY_FORMAT_1);
+    if (formatCode == MULTISTEPPER_PERF_BINARY_FORMAT_1)
+    {
+        if (bufMaxLen < MotionPerfCounters::getBinarySize())
+            return RAFT_INSUFFICIENT_RESOURCE;
+        buf.resize(MotionPerfCounters::getBinarySize());
+        MotionPerfCounters::getBinary(buf.data());
+        return RAFT_OK;
+    }
+    if (formatCode != MULTISTEPPER_STATUS_BINARY_FORMAT_1)
+        return RAFT_NOT_IMPLEMENTED;
+    if (bufMaxLen < MULTISTEPPER_STATUS_RECORD_SIZE)
+        return RAFT_INSUFFICIENT_RESOURCE;
+
+    // Get status
+    uint32_t motionTrackingIdx = 0;
+    uint32_t completedCount = 0;
+    bool idxValid = _motionController.streamGetLastCompleted(motionTrackingIdx, completedCount);
+    uint32_t freeSlots = UTILS_MIN(_motionController.streamGetQueueSlots(), 0xffff);
+    uint8_t flags = (_motionController.isBusy() ? MULTISTEPPER_STATUS_FLAG_BUSY : 0) |
+                    (_motionController.isPaused() ? MULTISTEPPER_STATUS_FLAG_PAUSED : 0) |
+                    (idxValid ? MULTISTEPPER_STATUS_FLAG_IDX_VALID : 0) |
+                    (_motionController.streamIsLowWater() ? MULTISTEPPER_STATUS_FLAG_LOW_WATER : 0);
+
+    // Form record
+    buf.resize(MULTISTEPPER_STATUS_RECORD_SIZE);
+    buf[MULTISTEPPER_STATUS_FORMAT_POS] = MULTISTEPPER_STATUS_BINARY_FORMAT_1;
+    buf[MULTISTEPPER_STATUS_FLAGS_POS] = flags;
+    buf[MULTISTEPPER_STATUS_FREE_SLOTS_POS] = (freeSlots >> 8) & 0xff;
+    buf[MULTISTEPPER_STATUS_FREE_SLOTS_POS + 1] = freeSlots & 0xff;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        buf[MULTISTEPPER_STATUS_LAST_IDX_POS + i] = (motionTrackingIdx >> (24 - i * 8)) & 0xff;
+        buf[MULTISTEPPER_STATUS_DONE_COUNT_POS + i] = (completedCount >> (24 - i * 8)) & 0xff;
+    }
+    return RAFT_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the block trace in binary form (MULTISTEPPER_TRACE_BINARY_FORMAT_1)
+/// @param buf (out) buffer to receive the binary data
+/// @param bufMaxLen maximum length of data to return
+/// @return RaftRetCode
+RaftRetCode MotorControl::getTraceBinary(std::vector<uint8_t>& buf, uint32_t bufMaxLen) const
+{
+    if (bufMaxLen < MULTISTEPPER_TRACE_HEADER_SIZE)
+        return RAFT_INSUFFICIENT_RESOURCE;
+    uint32_t maxRecords = UTILS_MIN((bufMaxLen - MULTISTEPPER_TRACE_HEADER_SIZE) / MULTISTEPPER_TRACE_RECORD_SIZE, 
+                MULTISTEPPER_TRACE_MAX_RECORDS);
+
+    // Header then records
+    buf.resize(MULTISTEPPER_TRACE_HEADER_SIZE);
+    uint32_t firstSeqNum = 0;
+    uint32_t stepGenPeriodNs = 0;
+    uint32_t numRecords = _motionController.getTraceBinary(buf, maxRecords, firstSeqNum, stepGenPeriodNs);
+    buf[MULTISTEPPER_TRACE_FORMAT_POS] = MULTISTEPPER_TRACE_BINARY_FORMAT_1;
+    buf[MULTISTEPPER_TRACE_NUM_RECORDS_POS] = numRecords;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        buf[MULTISTEPPER_TRACE_FIRST_SEQ_POS + i] = (firstSeqNum >> (24 - i * 8)) & 0xff;
+        buf[MULTISTEPPER_TRACE_STEP_GEN_PERIOD_POS + i] = (stepGenPeriodNs >> (24 - i * 8)) & 0xff;
+    }
+    return RAFT_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get a telemetry record in binary form (MULTISTEPPER_TELEM_BINARY_FORMAT_1)
+/// @param buf (out) buffer to receive the binary data
+/// @param bufMaxLen maximum length of data to return
+/// @param forceKeyframe true to return a keyframe (all fields as absolute values)
+/// @return RaftRetCode
+RaftRetCode MotorControl::getTelemetryBinary(std::vector<uint8_t>& buf, uint32_t bufMaxLen, bool forceKeyframe) const
+{
+    if (bufMaxLen < MULTISTEPPER_TELEM_RECORD_MAX_SIZE)
+        return RAFT_INSUFFICIENT_RESOURCE;
+
+    // Get values
+    uint32_t vals[MULTISTEPPER_TELEM_NUM_FIELDS] = {};
+    uint32_t numAxes = UTILS_MIN(_motionController.getNumAxes(), MULTISTEPPER_MAX_AXES);
+    AxesValues<AxisStepsDataType> actuatorSteps;
+    _motionController.getActuatorSteps(actuatorSteps);
+    for (uint32_t axisIdx = 0; axisIdx < numAxes; axisIdx++)
+        vals[MULTISTEPPER_TELEM_FIELD_AXIS_0 + axisIdx] = uint32_t(actuatorSteps.getVal(axisIdx));
+    bool idxValid = _motionController.streamGetLastCompleted(vals[MULTISTEPPER_TELEM_FIELD_LAST_IDX], 
+                vals[MULTISTEPPER_TELEM_FIELD_DONE_COUNT]);
+    vals[MULTISTEPPER_TELEM_FIELD_PIPELINE_DEPTH] = _motionController.getPipelineDepth();
+    vals[MULTISTEPPER_TELEM_FIELD_ENDSTOPS] = _motionController.getEndStopBits();
+    vals[MULTISTEPPER_TELEM_FIELD_DRIVER_STATUS] = _motionController.getDriverStatusWord();
+
+    // Keyframe
+    bool isKeyframe = forceKeyframe || (_telemRecordsSinceKeyframe >= MULTISTEPPER_TELEM_KEYFRAME_INTERVAL);
+    _telemRecordsSinceKeyframe = isKeyframe ? 1 : _telemRecordsSinceKeyframe + 1;
+
+    // Header
+    buf.resize(MULTISTEPPER_TELEM_HEADER_SIZE);
+    buf[MULTISTEPPER_TELEM_FORMAT_POS] = MULTISTEPPER_TELEM_BINARY_FORMAT_1;
+    buf[MULTISTEPPER_TELEM_FLAGS_POS] = (_motionController.isBusy() ? MULTISTEPPER_TELEM_FLAG_BUSY : 0) |
+                    (_motionController.isPaused() ? MULTISTEPPER_TELEM_FLAG_PAUSED : 0) |
+                    (idxValid ? MULTISTEPPER_TELEM_FLAG_IDX_VALID : 0) |
+                    (isKeyframe ? MULTISTEPPER_TELEM_FLAG_KEYFRAME : 0);
+    buf[MULTISTEPPER_TELEM_SEQ_POS] = _telemSeqNum++;
+    buf[MULTISTEPPER_TELEM_AXES_COUNT_POS] = numAxes;
+
+    // Fields - zigzag varints of the value or the difference from the previous value
+    uint32_t fieldsPresent = 0;
+    for (uint32_t fieldIdx = 0; fieldIdx < MULTISTEPPER_TELEM_NUM_FIELDS; fieldIdx++)
+    {
+        int32_t val = int32_t(isKeyframe ? vals[fieldIdx] : vals[fieldIdx] - _telemPrevVals[fieldIdx]);
+        _telemPrevVals[fieldIdx] = vals[fieldIdx];
+        if (!isKeyframe && (val == 0))
+            continue;
+        fieldsPresent |= 1 << fieldIdx;
+        uint32_t zigzag = (uint32_t(val) << 1) ^ uint32_t(val >> 31);
+        while (zigzag >= 0x80)
+        {
+            buf.push_back((zigzag & 0x7f) | 0x80);
+            zigzag >>= 7;
+        }
+        buf.push_back(zigzag);
+    }
+    buf[MULTISTEPPER_TELEM_FIELDS_POS] = (fieldsPresent >> 8) & 0xff;
+    buf[MULTISTEPPER_TELEM_FIELDS_POS + 1] = fieldsPresent & 0xff;
+    return RAFT_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Send a binary command to the device
+/// @param formatCode Format code for the command
+/// @param pData Pointer to the data
+/// @param dataLen Length of the data
+/// @return RaftRetCode
+RaftRetCode MotorControl::sendCmdBinary(uint32_t formatCode, const uint8_t* pData, uint32_t dataLen)
+{
+    // Check format code
+    if (formatCode != MULTISTEPPER_CMD_BINARY_FORMAT_1)
+        return RAFT_NOT_IMPLEMENTED;
+
+    // Check length ok
+    if (!pData || (dataLen < MULTISTEPPER_OPCODE_POS + 1))
+        return RAFT_INVALID_DATA;
+
+    // Check op-code
+    switch(pData[MULTISTEPPER_OPCODE_POS])
+    {
+        case MULTISTEPPER_MOVETO_OPCODE:
+            return handleCmdBinary_MoveTo(pData + MULTISTEPPER_OPCODE_POS + 1, dataLen - MULTISTEPPER_OPCODE_POS - 1);
+        case MULTISTEPPER_TRAJ_SAMPLES_OPCODE:
+            return handleCmdBinary_TrajSamples(pData + MULTISTEPPER_OPCODE_POS + 1, dataLen - MULTISTEPPER_OPCODE_POS - 1);
+    }
+    return RAFT_INVALID_OPERATION;
+}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Send a JSON command to the device
@@ -164,56 +396,153 @@ RaftRetCode MotorControl::sendCmdJSON(const char* cmdJSON)
     // Extract command from JSON
     RaftJson jsonInfo(cmdJSON);
     String cmd = jsonInfo.getString("cmd", "");
+
+    // Motion group (the main group if not specified)
+    MotionController* pMotionController = getMotionGroup(jsonInfo.getString("group", ""));
+    if (!pMotionController)
+        return RAFT_INVALID_DATA;
+
     if (cmd.equalsIgnoreCase("motion"))
     {
         MotionArgs motionArgs;
-        motionArgs.fromJSON(cmdJSON);
+        uint32_t parseStartUs = micros();
+        bool parseOk = motionArgs.fromJSON(cmdJSON);
+        MotionPerfCounters::recordTime(MotionPerfCounters::TIMER_JSON_PARSE, micros() - parseStartUs);
+        if (!parseOk)
+            MotionPerfCounters::incCounter(MotionPerfCounters::COUNTER_JSON_PARSE_FAILED);
 #ifdef DEBUG_MOTOR_CMD_JSON
         String cmdStr = motionArgs.toJSON();
         LOG_I(MODULE_PREFIX, "sendCmdJSON %s", cmdStr.c_str());
 #endif
-        _motionController.moveTo(motionArgs);
+        pMotionController->moveTo(motionArgs);
     }
     else if (cmd.equalsIgnoreCase("maxCurrent"))
     {
         float maxCurrentA = jsonInfo.getDouble("maxCurrentA", 0);
         uint32_t axisIdx = jsonInfo.getInt("axisIdx", 0);
-        _motionController.setMaxMotorCurrentAmps(axisIdx, maxCurrentA);
+        pMotionController->setMaxMotorCurrentAmps(axisIdx, maxCurrentA);
     }
     else if (cmd.equalsIgnoreCase("offAfter"))
     {
         float motorOnTimeAfterMoveSecs = jsonInfo.getDouble("offAfterS", 0);
-        _motionController.setMotorOnTimeAfterMoveSecs(motorOnTimeAfterMoveSecs);
+        pMotionController->setMotorOnTimeAfterMoveSecs(motorOnTimeAfterMoveSecs);
+    }
+    else if (cmd.equalsIgnoreCase("feedOverride"))
+    {
+        uint32_t feedOverridePercent = jsonInfo.getInt("percent", MotionBlock::FEED_OVERRIDE_PERCENT_DEFAULT);
+        pMotionController->setFeedOverride(feedOverridePercent);
+    }
+    else if (cmd.equalsIgnoreCase("timeSync"))
+    {
+        double sharedTimeUs = jsonInfo.getDouble("timeUs", -1);
+        if (sharedTimeUs < 0)
+            return RAFT_INVALID_DATA;
+        pMotionController->syncTimebase(uint64_t(sharedTimeUs));
+    }
+    else if (cmd.equalsIgnoreCase("trajStart"))
+    {
+        if (!pMotionController->trajStreamStart())
+            return RAFT_BUSY;
+    }
+    else if (cmd.equalsIgnoreCase("trajEnd"))
+    {
+        pMotionController->trajStreamEnd();
+    }
+    else if (cmd.equalsIgnoreCase("isrStatsReset"))
+    {
+        pMotionController->resetISRStats();
+    }
+    else if (cmd.equalsIgnoreCase("perfReset"))
+    {
+        MotionPerfCounters::reset();
+    }
+    else if (cmd.equalsIgnoreCase("home"))
+    {
+        if (!pMotionController->startHoming())
+            return RAFT_BUSY;
     }
     return RAFT_OK;
 }
 
-// /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// /// @brief Handle binary move-to command
-// /// @param pData Pointer to the data
-// /// @param dataLen Length of the data
-// void MotorControl::handleCmdBinary_MoveTo(const uint8_t* pData, uint32_t dataLen)
-// {
-//     // Check length ok
-//     if (dataLen < MULTISTEPPER_MOVETO_BINARY_FORMAT_POS + 1)
-//         return;
-    
-//     // Check version of args
-//     if (pData[MULTISTEPPER_MOVETO_BINARY_FORMAT_POS] != MULTISTEPPER_MOTION_ARGS_BINARY_FORMAT_1)
-//         return;
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle binary move-to command
+/// @param pData Pointer to the data (one or more MoveTo records)
+/// @param dataLen Length of the data
+/// @return RaftRetCode (RAFT_BUSY if a move could not be accepted - moves before it in the frame have been accepted)
+RaftRetCode MotorControl::handleCmdBinary_MoveTo(const uint8_t* pData, uint32_t dataLen)
+{
+    // Check length is a whole number of records
+    if ((dataLen < MULTISTEPPER_MOVETO_RECORD_SIZE) || (dataLen % MULTISTEPPER_MOVETO_RECORD_SIZE != 0))
+        return RAFT_INVALID_DATA;
 
-//     // Check args length
-//     if (dataLen < sizeof(MotionArgs))
-//         return;
+    // Handle each record
+    MotionArgs motionArgs;
+    for (uint32_t recPos = 0; recPos < dataLen; recPos += MULTISTEPPER_MOVETO_RECORD_SIZE)
+    {
+        if (!motionArgs.fromBinary(pData + recPos, dataLen - recPos))
+            return RAFT_INVALID_DATA;
+        if (!_motionController.moveTo(motionArgs))
+        {
+#ifdef DEBUG_MOTOR_CMD_BINARY
+            LOG_I(MODULE_PREFIX, "handleCmdBinary_MoveTo busy at record %d", recPos / MULTISTEPPER_MOVETO_RECORD_SIZE);
+#endif
+            return RAFT_BUSY;
+        }
+    }
+    return RAFT_OK;
+}
 
-//     // Send the request for interpretation
-//     _motionController.moveTo((const MotionArgs&)*pData);
-// }
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle binary trajectory samples command
+/// @param pData Pointer to the data (axes count then samples)
+/// @param dataLen Length of the data
+/// @return RaftRetCode (RAFT_BUSY if there isn't space for all the samples - none have been accepted)
+RaftRetCode MotorControl::handleCmdBinary_TrajSamples(const uint8_t* pData, uint32_t dataLen)
+{
+    // Check length is a whole number of samples
+    if (dataLen < MULTISTEPPER_TRAJ_SAMPLES_START_POS)
+        return RAFT_INVALID_DATA;
+    uint32_t numAxes = pData[MULTISTEPPER_TRAJ_AXES_COUNT_POS];
+    uint32_t sampleSize = numAxes * MULTISTEPPER_TRAJ_AXIS_DELTA_SIZE;
+    uint32_t samplesLen = dataLen - MULTISTEPPER_TRAJ_SAMPLES_START_POS;
+    if ((numAxes == 0) || (numAxes > MULTISTEPPER_MAX_AXES) || (samplesLen % sampleSize != 0))
+        return RAFT_INVALID_DATA;
+
+    // Check space for all samples
+    if (samplesLen / sampleSize > _motionController.trajStreamGetFreeSamples())
+        return RAFT_BUSY;
+
+    // Add each sample
+    int16_t steps[MULTISTEPPER_MAX_AXES];
+    for (uint32_t samplePos = MULTISTEPPER_TRAJ_SAMPLES_START_POS; samplePos < dataLen; samplePos += sampleSize)
+    {
+        for (uint32_t axisIdx = 0; axisIdx < numAxes; axisIdx++)
+        {
+            const uint8_t* pDelta = pData + samplePos + axisIdx * MULTISTEPPER_TRAJ_AXIS_DELTA_SIZE;
+            steps[axisIdx] = int16_t((pDelta[0] << 8) | pDelta[1]);
+        }
+        if (!_motionController.trajStreamAddSample(steps, numAxes))
+            return RAFT_INVALID_DATA;
+    }
+    return RAFT_OK;
+}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Get debug string
 /// @return Debug string
 String MotorControl::getDebugJSON(bool includeBraces) const
 {
-    return _motionController.getDebugJSON(includeBraces);
+    String jsonStr = _motionController.getDebugJSON(false);
+    if (_motionGroups.size() > 0)
+    {
+        String groupsJson;
+        for (const MotionGroup& motionGroup : _motionGroups)
+        {
+            groupsJson += groupsJson.length() > 0 ? "," : "";
+            groupsJson += "\"" + motionGroup.name + "\":" + motionGroup.pMotionController->getDebugJSON(true);
+        }
+        jsonStr += ",\"groups\":{" + groupsJson + "}";
+    }
+    jsonStr += ",\"perf\":" + MotionPerfCounters::getJSON(true);
+    return includeBraces ? "{" + jsonStr + "}" : jsonStr;
 }
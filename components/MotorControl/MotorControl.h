@@ -12,6 +12,7 @@
 #include "RaftDevice.h"
 #include "MotionController.h"
 #include "RaftBus.h"
+#include "MotorControlMsgFormats.h"
 
 class MotorControl : public RaftDevice
 {
@@ -43,8 +44,12 @@ public:
     /// @return double value
     virtual double getNamedValue(const char* pParam, bool& isFresh) const override final;
 
-    // // Send binary command
-    // virtual RaftRetCode sendCmdBinary(uint32_t formatCode, const uint8_t* pData, uint32_t dataLen) override final;
+    /// @brief Send binary command
+    /// @param formatCode Format code for the command
+    /// @param pData Pointer to the data
+    /// @param dataLen Length of the data
+    /// @return RaftRetCode
+    virtual RaftRetCode sendCmdBinary(uint32_t formatCode, const uint8_t* pData, uint32_t dataLen) override final;
 
     // Send JSON command
     virtual RaftRetCode sendCmdJSON(const char* jsonCmd) override final;
@@ -83,14 +88,39 @@ public:
     virtual String getDebugJSON(bool includeBraces) const override final;
 
 private:
-    // Motion controller
+    // Ramp generator timer shared by all motion groups (only used when motion groups are configured)
+    RampGenTimer _sharedRampGenTimer;
+
+    // Motion controller (the main motion group - configured at the top level of the device config)
     MotionController _motionController;
 
+    // Additional motion groups (configured in the "groups" array) - each has its own axes, pipeline and planner
+    // so it moves independently of the other groups - all groups share one ramp generator timer ISR
+    struct MotionGroup
+    {
+        String name;
+        MotionController* pMotionController = nullptr;
+    };
+    std::vector<MotionGroup> _motionGroups;
+    void setupMotionGroups(const std::vector<String>& groupsVec);
+    void clearMotionGroups();
+    MotionController* getMotionGroup(const String& groupName);
+
     // Motor serial bus
     RaftBus* _pMotorSerialBus = nullptr;
 
-    // // Command handlers
-    // void handleCmdBinary_MoveTo(const uint8_t* pData, uint32_t dataLen);
+    // Command handlers
+    RaftRetCode handleCmdBinary_MoveTo(const uint8_t* pData, uint32_t dataLen);
+    RaftRetCode handleCmdBinary_TrajSamples(const uint8_t* pData, uint32_t dataLen);
+
+    // Binary data
+    RaftRetCode getTraceBinary(std::vector<uint8_t>& buf, uint32_t bufMaxLen) const;
+    RaftRetCode getTelemetryBinary(std::vector<uint8_t>& buf, uint32_t bufMaxLen, bool forceKeyframe) const;
+
+    // Telemetry delta encoding state (values in the previous record returned)
+    mutable uint32_t _telemPrevVals[MULTISTEPPER_TELEM_NUM_FIELDS] = {};
+    mutable uint8_t _telemSeqNum = 0;
+    mutable uint32_t _telemRecordsSinceKeyframe = MULTISTEPPER_TELEM_KEYFRAME_INTERVAL;
 
     // Debug
     static constexpr const char* MODULE_PREFIX = "MotorControl";    
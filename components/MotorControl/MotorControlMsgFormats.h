@@ -24,3 +24,162 @@ static const uint32_t MULTISTEPPER_MOVETO_AXES_COUNT_POS = 1;
 static const uint32_t MULTISTEPPER_MOVETO_AXES_START_POS = 2;
 static const uint32_t MULTISTEPPER_MOVETO_AXES_BLOCK_SIZE = 4;
 static const uint32_t MULTISTEPPER_MAX_AXES = 5;
+
+// MoveTo record (MULTISTEPPER_MOTION_ARGS_BINARY_FORMAT_1)
+// A MoveTo command is the opcode byte followed by one or more fixed-size records (all values big-endian)
+//   0      format (MULTISTEPPER_MOTION_ARGS_BINARY_FORMAT_1)
+//   1      axes count (positions for axes >= count are ignored)
+//   2..21  axis positions (MULTISTEPPER_MAX_AXES float32 values)
+//   22..23 flags (MULTISTEPPER_MOVETO_FLAG_XXX)
+//   24     axes specified mask (0 means all axes < axes count)
+//   25     reserved
+//   26..29 target speed (float32 - valid if MULTISTEPPER_MOVETO_FLAG_SPEED_VALID)
+//   30..33 feedrate (float32 - percent or units-per-min if MULTISTEPPER_MOVETO_FLAG_FEED_PER_MIN)
+//   34..37 motion tracking index (uint32 - valid if MULTISTEPPER_MOVETO_FLAG_IDX_VALID)
+//   38..41 endstop checks (uint32 - as AxisEndstopChecks)
+static const uint32_t MULTISTEPPER_MOVETO_FLAGS_POS = MULTISTEPPER_MOVETO_AXES_START_POS + 
+            MULTISTEPPER_MAX_AXES * MULTISTEPPER_MOVETO_AXES_BLOCK_SIZE;
+static const uint32_t MULTISTEPPER_MOVETO_AXES_MASK_POS = MULTISTEPPER_MOVETO_FLAGS_POS + 2;
+static const uint32_t MULTISTEPPER_MOVETO_SPEED_POS = MULTISTEPPER_MOVETO_AXES_MASK_POS + 2;
+static const uint32_t MULTISTEPPER_MOVETO_FEEDRATE_POS = MULTISTEPPER_MOVETO_SPEED_POS + 4;
+static const uint32_t MULTISTEPPER_MOVETO_TRACKING_IDX_POS = MULTISTEPPER_MOVETO_FEEDRATE_POS + 4;
+static const uint32_t MULTISTEPPER_MOVETO_ENDSTOPS_POS = MULTISTEPPER_MOVETO_TRACKING_IDX_POS + 4;
+static const uint32_t MULTISTEPPER_MOVETO_RECORD_SIZE = MULTISTEPPER_MOVETO_ENDSTOPS_POS + 4;
+
+// MoveTo flags
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_RELATIVE = 0x0001;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_RAMPED = 0x0002;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_UNITS_STEPS = 0x0004;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_NO_SPLIT = 0x0008;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_SPEED_VALID = 0x0010;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_MORE_MOVES = 0x0020;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_IDX_VALID = 0x0040;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_FEED_PER_MIN = 0x0080;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_ENABLE_MOTORS = 0x0100;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_CLEAR_QUEUE = 0x0200;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_STOP = 0x0400;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_CONSTRAIN = 0x0800;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_HOMING = 0x1000;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_RAPID = 0x2000;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_CLOCKWISE = 0x4000;
+static const uint32_t MULTISTEPPER_MOVETO_FLAG_VELOCITY = 0x8000;
+
+// Trajectory samples (opcode MULTISTEPPER_TRAJ_SAMPLES_OPCODE) - samples are added to the trajectory stream
+// started with the JSON command trajStart and ended with trajEnd (all values big-endian)
+//   0      axes count (deltas for axes >= count are zero)
+//   1..    samples - each is axes count int16 step deltas (output evenly over the sample interval trajSampleUs)
+// The frame is rejected (busy) if there isn't space for all its samples - the free space is reported in the
+// free queue slots of the stream status record while streaming
+static const uint32_t MULTISTEPPER_TRAJ_SAMPLES_OPCODE = 1;
+static const uint32_t MULTISTEPPER_TRAJ_AXES_COUNT_POS = 0;
+static const uint32_t MULTISTEPPER_TRAJ_SAMPLES_START_POS = 1;
+static const uint32_t MULTISTEPPER_TRAJ_AXIS_DELTA_SIZE = 2;
+
+// Stream status record (returned by getDataBinary - all values big-endian)
+// Used for streaming flow control - the free slots are credits for further MoveTo records and the
+// last completed index acknowledges moves sent with a motion tracking index
+//   0      format (MULTISTEPPER_STATUS_BINARY_FORMAT_1)
+//   1      flags (MULTISTEPPER_STATUS_FLAG_XXX)
+//   2..3   free queue slots (uint16)
+//   4..7   last completed motion tracking index (uint32 - valid if MULTISTEPPER_STATUS_FLAG_IDX_VALID)
+//   8..11  count of completed moves with a motion tracking index (uint32 - wraps)
+static const uint32_t MULTISTEPPER_STATUS_BINARY_FORMAT_1 = 0;
+static const uint32_t MULTISTEPPER_STATUS_FORMAT_POS = 0;
+static const uint32_t MULTISTEPPER_STATUS_FLAGS_POS = 1;
+static const uint32_t MULTISTEPPER_STATUS_FREE_SLOTS_POS = 2;
+static const uint32_t MULTISTEPPER_STATUS_LAST_IDX_POS = 4;
+static const uint32_t MULTISTEPPER_STATUS_DONE_COUNT_POS = 8;
+static const uint32_t MULTISTEPPER_STATUS_RECORD_SIZE = 12;
+
+// Stream status flags - LOW_WATER is set when the time of motion buffered is below the streaming low-water
+// mark (motion/streamLowWaterMs) so more moves should be sent
+static const uint32_t MULTISTEPPER_STATUS_FLAG_BUSY = 0x01;
+static const uint32_t MULTISTEPPER_STATUS_FLAG_PAUSED = 0x02;
+static const uint32_t MULTISTEPPER_STATUS_FLAG_IDX_VALID = 0x04;
+static const uint32_t MULTISTEPPER_STATUS_FLAG_LOW_WATER = 0x08;
+
+// Block trace dump (returned by getDataBinary - all values big-endian)
+// The most recent block start/end events recorded by the ramp generator (see RampGenTrace.h for the record
+// format) - sequence numbers increase by one for each record so records already read can be skipped
+//   0      format (MULTISTEPPER_TRACE_BINARY_FORMAT_1)
+//   1      number of records
+//   2..5   sequence number of the first record (uint32 - wraps)
+//   6..9   step generation period (uint32 ns - step rates are steps per TTicks step generation periods)
+//   10..   records (MULTISTEPPER_TRACE_RECORD_SIZE bytes each)
+static const uint32_t MULTISTEPPER_TRACE_BINARY_FORMAT_1 = 1;
+static const uint32_t MULTISTEPPER_TRACE_FORMAT_POS = 0;
+static const uint32_t MULTISTEPPER_TRACE_NUM_RECORDS_POS = 1;
+static const uint32_t MULTISTEPPER_TRACE_FIRST_SEQ_POS = 2;
+static const uint32_t MULTISTEPPER_TRACE_STEP_GEN_PERIOD_POS = 6;
+static const uint32_t MULTISTEPPER_TRACE_HEADER_SIZE = 10;
+static const uint32_t MULTISTEPPER_TRACE_RECORD_SIZE = 16;
+static const uint32_t MULTISTEPPER_TRACE_MAX_RECORDS = 255;
+
+// Telemetry record (returned by getDataBinary - header values big-endian)
+// A compact status sample for high-rate telemetry - fields are delta-encoded against the previous record
+// returned (by any caller) so records must be read by a single consumer - a keyframe (all fields as absolute
+// values) is returned every MULTISTEPPER_TELEM_KEYFRAME_INTERVAL records and whenever format code
+// MULTISTEPPER_TELEM_KEYFRAME_BINARY_FORMAT_1 is requested - a gap in the sequence number means deltas can't
+// be applied until the next keyframe
+//   0      format (MULTISTEPPER_TELEM_BINARY_FORMAT_1)
+//   1      flags (MULTISTEPPER_TELEM_FLAG_XXX)
+//   2      sequence number (wraps)
+//   3      axes count
+//   4..5   fields present (uint16 - bit MULTISTEPPER_TELEM_FIELD_XXX set for each field in the record)
+//   6..    fields in bit order - each a zigzag-encoded LEB128 varint (1..5 bytes) of the value (keyframe) or
+//          of the signed difference from the value in the previous record - unchanged fields are omitted
+//          from records which aren't keyframes
+// Fields are
+//   MULTISTEPPER_TELEM_FIELD_AXIS_0 + axisIdx    actuator position (steps)
+//   MULTISTEPPER_TELEM_FIELD_PIPELINE_DEPTH      blocks in the pipeline
+//   MULTISTEPPER_TELEM_FIELD_LAST_IDX            last completed motion tracking index
+//   MULTISTEPPER_TELEM_FIELD_DONE_COUNT          count of completed moves with a motion tracking index
+//   MULTISTEPPER_TELEM_FIELD_ENDSTOPS            endstop hit bits (bit axisIdx*2 for min, axisIdx*2+1 for max)
+//   MULTISTEPPER_TELEM_FIELD_DRIVER_STATUS       driver status (4 bits per axis - see StepDriverBase STATUS_BIT_XXX)
+static const uint32_t MULTISTEPPER_TELEM_BINARY_FORMAT_1 = 2;
+static const uint32_t MULTISTEPPER_TELEM_KEYFRAME_BINARY_FORMAT_1 = 3;
+static const uint32_t MULTISTEPPER_TELEM_FORMAT_POS = 0;
+static const uint32_t MULTISTEPPER_TELEM_FLAGS_POS = 1;
+static const uint32_t MULTISTEPPER_TELEM_SEQ_POS = 2;
+static const uint32_t MULTISTEPPER_TELEM_AXES_COUNT_POS = 3;
+static const uint32_t MULTISTEPPER_TELEM_FIELDS_POS = 4;
+static const uint32_t MULTISTEPPER_TELEM_HEADER_SIZE = 6;
+static const uint32_t MULTISTEPPER_TELEM_VARINT_MAX_SIZE = 5;
+static const uint32_t MULTISTEPPER_TELEM_KEYFRAME_INTERVAL = 20;
+
+// Telemetry flags
+static const uint32_t MULTISTEPPER_TELEM_FLAG_BUSY = 0x01;
+static const uint32_t MULTISTEPPER_TELEM_FLAG_PAUSED = 0x02;
+static const uint32_t MULTISTEPPER_TELEM_FLAG_IDX_VALID = 0x04;
+static const uint32_t MULTISTEPPER_TELEM_FLAG_KEYFRAME = 0x08;
+
+// Telemetry fields
+static const uint32_t MULTISTEPPER_TELEM_FIELD_AXIS_0 = 0;
+static const uint32_t MULTISTEPPER_TELEM_FIELD_PIPELINE_DEPTH = MULTISTEPPER_MAX_AXES;
+static const uint32_t MULTISTEPPER_TELEM_FIELD_LAST_IDX = MULTISTEPPER_MAX_AXES + 1;
+static const uint32_t MULTISTEPPER_TELEM_FIELD_DONE_COUNT = MULTISTEPPER_MAX_AXES + 2;
+static const uint32_t MULTISTEPPER_TELEM_FIELD_ENDSTOPS = MULTISTEPPER_MAX_AXES + 3;
+static const uint32_t MULTISTEPPER_TELEM_FIELD_DRIVER_STATUS = MULTISTEPPER_MAX_AXES + 4;
+static const uint32_t MULTISTEPPER_TELEM_NUM_FIELDS = MULTISTEPPER_MAX_AXES + 5;
+static const uint32_t MULTISTEPPER_TELEM_RECORD_MAX_SIZE = MULTISTEPPER_TELEM_HEADER_SIZE + 
+            MULTISTEPPER_TELEM_NUM_FIELDS * MULTISTEPPER_TELEM_VARINT_MAX_SIZE;
+
+// Performance counters record (returned by getDataBinary - all values big-endian)
+// The performance counters registry (see MotionPerfCounters.h) - slots are only ever added at the end of the
+// timer and counter lists so readers should use the counts in the header and ignore slots they don't know
+//   0      format (MULTISTEPPER_PERF_BINARY_FORMAT_1)
+//   1      number of timers
+//   2      number of counters
+//   3      reserved
+//   4..7   time since the registry was reset (uint32 ms - wraps)
+//   8..    timers (MULTISTEPPER_PERF_TIMER_SIZE bytes each) - count, min, max and average (uint32 us each)
+//   ..     counters (uint32 each)
+static const uint32_t MULTISTEPPER_PERF_BINARY_FORMAT_1 = 4;
+static const uint32_t MULTISTEPPER_PERF_FORMAT_POS = 0;
+static const uint32_t MULTISTEPPER_PERF_NUM_TIMERS_POS = 1;
+static const uint32_t MULTISTEPPER_PERF_NUM_COUNTERS_POS = 2;
+static const uint32_t MULTISTEPPER_PERF_RESERVED_POS = 3;
+static const uint32_t MULTISTEPPER_PERF_MS_SINCE_RESET_POS = 4;
+static const uint32_t MULTISTEPPER_PERF_HEADER_SIZE = 8;
+static const uint32_t MULTISTEPPER_PERF_TIMER_SIZE = 16;
+static const uint32_t MULTISTEPPER_PERF_COUNTER_SIZE = 4;
@@ -85,6 +85,11 @@ public:
         }
     }
 
+    bool areMotorsEnabled() const
+    {
+        return _motorsAreEnabled;
+    }
+
     unsigned long getLastActiveUnixTime()
     {
         return _motorEnLastUnixTime;
@@ -13,7 +13,8 @@
 #include "RaftUtils.h"
 #include "RampGenTimer.h"
 
-// #define DEBUG_ENDSTOPS
+// Step rate conversion in prepareForStepping() relies on this
+static_assert(MotionBlock::TTICKS_VALUE == 1000000000, "TTICKS_VALUE must be the number of ns in a second");
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Constructor
@@ -22,16 +23,17 @@
 MotionBlock::MotionBlock()
 {
     clear();
-    _ticksPerSec = calcTicksPerSec(RampGenTimer::RAMP_GEN_PERIOD_US_DEFAULT * 1000);
+    _stepGenPeriodNs = RampGenTimer::RAMP_GEN_PERIOD_US_DEFAULT * 1000;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Set timer period
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void MotionBlock::setTimerPeriodNs(uint32_t stepGenPeriodNs)
+void MotionBlock::setTimerPeriodNs(uint32_t stepGenPeriodNs, uint32_t accelTickNs)
 {
-    _ticksPerSec = calcTicksPerSec(stepGenPeriodNs);
+    _stepGenPeriodNs = stepGenPeriodNs;
+    _accelTickNs = accelTickNs;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -44,52 +46,72 @@ void MotionBlock::clear()
     _requestedSpeed = 0;
     _moveDistPrimaryAxesMM = 0;
     _maxEntrySpeedMMps = 0;
+    _maxEntryNominalSpeedMMps = 0;
+    _feedOverridePercent = FEED_OVERRIDE_PERCENT_DEFAULT;
     _entrySpeedMMps = 0;
     _exitSpeedMMps = 0;
     _debugStepDistMM = 0;
-    _isExecuting = false;
-    _canExecute = false;
     _blockIsFollowed = false;
-    _axisIdxWithMaxSteps = 0;
+    _isPlanned = false;
+    _isStepwise = false;
+    _isPrepared = false;
+    _preparedEntrySpeedMMps = 0;
+    _preparedExitSpeedMMps = 0;
     _unitVecAxisWithMaxDist = 0;
-    _accStepsPerTTicksPerMS = 0;
-    _finalStepRatePerTTicks = 0;
-    _initialStepRatePerTTicks = 0;
-    _maxStepRatePerTTicks = 0;
-    _stepsBeforeDecel = 0;
-    _motionTrackingIndex = 0;
-    _endStopsToCheck.clear();
-    for (int axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
-        _stepsTotalMaybeNeg[axisIdx] = 0;
-}
-
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Command tracking
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-void MotionBlock::setMotionTrackingIndex(uint32_t motionTrackingIndex)
-{
-    _motionTrackingIndex = motionTrackingIndex;
-}
-uint32_t IRAM_ATTR MotionBlock::getMotionTrackingIndex()
-{
-    return _motionTrackingIndex;
+    _maxAccUps2 = 0;
+    _inputShaperAxisIdx = -1;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Block params
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-uint32_t MotionBlock::getExitStepRatePerTTicks()
+float MotionBlock::maxAchievableSpeed(AxisAccDataType acceleration, 
+                AxisSpeedDataType target_velocity, 
+                AxisDistDataType distance,
+                AxisAccDataType jerk,
+                const InputShaper* pShaper)
 {
-    return _finalStepRatePerTTicks;
+    float trapezoidalSpeed = sqrtf(target_velocity * target_velocity + 2.0F * acceleration * distance);
+    if (!pShaper && (jerk <= 0))
+        return trapezoidalSpeed;
+
+    // Shaped or jerk-limited speed is lower than with constant acceleration - search for the speed at which
+    // the ramp fits exactly in the distance
+    float lowSpeed = target_velocity;
+    float highSpeed = trapezoidalSpeed;
+    for (uint32_t i = 0; i < JERK_LIMITED_SEARCH_ITERATIONS; i++)
+    {
+        float midSpeed = (lowSpeed + highSpeed) / 2;
+        float rampDist = pShaper ? pShaper->rampDist(target_velocity, midSpeed, acceleration) :
+                    jerkLimitedRampDist(target_velocity, midSpeed, acceleration, jerk);
+        if (rampDist <= distance)
+            lowSpeed = midSpeed;
+        else
+            highSpeed = midSpeed;
+    }
+    return lowSpeed;
 }
 
-float MotionBlock::maxAchievableSpeed(AxisAccDataType acceleration, 
-                AxisSpeedDataType target_velocity, 
-                AxisDistDataType distance)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Distance required for a jerk-limited (S-curve) change in speed
+/// @param speed1 Speed at start of ramp
+/// @param speed2 Speed at end of ramp
+/// @param acceleration Max acceleration
+/// @param jerk Max jerk (rate of change of acceleration)
+/// @return Distance
+/// @note The ramp is symmetric (jerk up, optional constant acceleration, jerk down) so the distance is
+///       the average speed multiplied by the ramp time
+float MotionBlock::jerkLimitedRampDist(AxisSpeedDataType speed1, AxisSpeedDataType speed2,
+                AxisAccDataType acceleration, AxisAccDataType jerk)
 {
-    return sqrtf(target_velocity * target_velocity + 2.0F * acceleration * distance);
+    float speedChange = fabsf(speed2 - speed1);
+    float rampTime = 0;
+    if (speedChange >= acceleration * acceleration / jerk)
+        rampTime = speedChange / acceleration + acceleration / jerk;
+    else
+        rampTime = 2.0F * sqrtf(speedChange / jerk);
+    return (speed1 + speed2) / 2 * rampTime;
 }
 
 template<typename T>
@@ -101,18 +123,6 @@ void MotionBlock::forceInBounds(T &val, T lowBound, T highBound)
         val = highBound;
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// End-stops
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-void MotionBlock::setEndStopsToCheck(const AxisEndstopChecks &endStopCheck)
-{
-#ifdef DEBUG_ENDSTOPS
-    LOG_I(MODULE_PREFIX, "Set test endstops %x", endStopCheck.debugGetRawValue());
-#endif
-    _endStopsToCheck = endStopCheck;
-}
-
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Prepare a block for stepping
 // If the block is "stepwise" this means that there is no acceleration and deceleration - just steps
@@ -122,28 +132,31 @@ void MotionBlock::setEndStopsToCheck(const AxisEndstopChecks &endStopCheck)
 //     we now compute the stepping parameters to make motion happen
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool MotionBlock::prepareForStepping(const AxesParams &axesParams, bool isLinear)
+bool MotionBlock::prepareForStepping(const AxesParams &axesParams, bool isLinear, MotionStepSegment& stepSeg)
 {
     // If block is currently being executed don't change it
-    if (_isExecuting)
+    if (stepSeg._isExecuting)
         return false;
 
     // Find the max number of steps for any axis
-    uint32_t absMaxStepsForAnyAxis = abs(_stepsTotalMaybeNeg[_axisIdxWithMaxSteps]);
+    uint32_t axisIdxWithMaxSteps = stepSeg._axisIdxWithMaxSteps;
+    uint32_t absMaxStepsForAnyAxis = stepSeg.getAbsMaxStepsForAnyAxis();
 
     // Check if stepwise movement (see note above)
     float initialStepRatePerSec = 0;
     float finalStepRatePerSec = 0;
     float maxAccStepsPerSec2 = 0;
+    float jerkStepsPerSec3 = 0;
+    const InputShaper* pShaper = nullptr;
     float axisMaxStepRatePerSec = 0;
     uint32_t stepsDecelerating = 0; 
-    double stepDistMM = 0;
+    AxisDistDataType stepDistMM = 0;
     if (isLinear)
     {
         // requestedVelocity is in steps per second in this case
         float stepRatePerSec = _requestedSpeed;
-        if (stepRatePerSec > axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps))
-            stepRatePerSec = axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps);
+        if (stepRatePerSec > axesParams.getMaxStepRatePerSec(axisIdxWithMaxSteps))
+            stepRatePerSec = axesParams.getMaxStepRatePerSec(axisIdxWithMaxSteps);
         initialStepRatePerSec = stepRatePerSec;
         finalStepRatePerSec = stepRatePerSec;
         maxAccStepsPerSec2 = stepRatePerSec;
@@ -153,74 +166,194 @@ bool MotionBlock::prepareForStepping(const AxesParams &axesParams, bool isLinear
     else
     {
         // Get the initial step rate, final step rate and max acceleration for the axis with max steps
-        stepDistMM = fabs(_moveDistPrimaryAxesMM / _stepsTotalMaybeNeg[_axisIdxWithMaxSteps]);
-        initialStepRatePerSec = fabs(_entrySpeedMMps / stepDistMM);
-        if (initialStepRatePerSec > axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps))
-            initialStepRatePerSec = axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps);
-        finalStepRatePerSec = fabs(_exitSpeedMMps / stepDistMM);
-        if (finalStepRatePerSec > axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps))
-            finalStepRatePerSec = axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps);
-        maxAccStepsPerSec2 = fabs(axesParams.getMaxAccelUps2(_axisIdxWithMaxSteps) / stepDistMM);
-
-        // Calculate the distance decelerating and ensure within bounds
-        // Using the facts for the block ... (assuming max accleration followed by max deceleration):
-        //		Vmax * Vmax = Ventry * Ventry + 2 * Amax * Saccelerating
-        //		Vexit * Vexit = Vmax * Vmax - 2 * Amax * Sdecelerating
-        //      Stotal = Saccelerating + Sdecelerating
-        // And solving for Saccelerating (distance accelerating)
-        uint32_t stepsAccelerating = 0;
-        float stepsAcceleratingFloat =
-            ceilf((powf(finalStepRatePerSec, 2) - powf(initialStepRatePerSec, 2)) / 4 /
-                        maxAccStepsPerSec2 +
-                    absMaxStepsForAnyAxis / 2);
-        if (stepsAcceleratingFloat > 0)
-        {
-            stepsAccelerating = uint32_t(stepsAcceleratingFloat);
-            if (stepsAccelerating > absMaxStepsForAnyAxis)
-                stepsAccelerating = absMaxStepsForAnyAxis;
-        }
-
-        // Decelerating steps
-        stepsDecelerating = 0;
-
-        // Find max possible rate for axis with max steps
-        axisMaxStepRatePerSec = fabs(_requestedSpeed / stepDistMM);
-        if (axisMaxStepRatePerSec > axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps))
-            axisMaxStepRatePerSec = axesParams.getMaxStepRatePerSec(_axisIdxWithMaxSteps);
-
-        // See if max speed will be reached
-        uint32_t stepsToMaxSpeed =
-            uint32_t((powf(axisMaxStepRatePerSec, 2) - powf(initialStepRatePerSec, 2)) /
-                        2 / maxAccStepsPerSec2);
-        if (stepsAccelerating > stepsToMaxSpeed)
+        stepDistMM = fabsf(_moveDistPrimaryAxesMM / stepSeg._stepsTotalMaybeNeg[axisIdxWithMaxSteps]);
+        initialStepRatePerSec = fabsf(_entrySpeedMMps / stepDistMM);
+        if (initialStepRatePerSec > axesParams.getMaxStepRatePerSec(axisIdxWithMaxSteps))
+            initialStepRatePerSec = axesParams.getMaxStepRatePerSec(axisIdxWithMaxSteps);
+        finalStepRatePerSec = fabsf(_exitSpeedMMps / stepDistMM);
+        if (finalStepRatePerSec > axesParams.getMaxStepRatePerSec(axisIdxWithMaxSteps))
+            finalStepRatePerSec = axesParams.getMaxStepRatePerSec(axisIdxWithMaxSteps);
+        maxAccStepsPerSec2 = fabsf(getMaxAccel(axesParams.getMaxAccelUps2(axisIdxWithMaxSteps)) / stepDistMM);
+
+        // Input shaping (the shaper chosen from the moving axes when the block was planned) takes precedence over
+        // jerk limiting
+        pShaper = getInputShaper(axesParams);
+        if (!pShaper)
+            jerkStepsPerSec3 = fabsf(axesParams.getMaxJerkUps3() / stepDistMM);
+
+        // Find max possible rate for axis with max steps (the requested speed scaled by the feed override)
+        axisMaxStepRatePerSec = fabsf(getNominalSpeed() / stepDistMM);
+        if (axisMaxStepRatePerSec > axesParams.getMaxStepRatePerSec(axisIdxWithMaxSteps))
+            axisMaxStepRatePerSec = axesParams.getMaxStepRatePerSec(axisIdxWithMaxSteps);
+
+        if (pShaper || (jerkStepsPerSec3 > 0))
         {
-            // Max speed will be reached
-            stepsAccelerating = stepsToMaxSpeed;
+            // Shaped (constant acceleration convolved with the shaper impulses) or jerk-limited (7 phase S-curve - jerk up,
+            // constant acceleration, jerk down, cruise and the same for deceleration) - the acceleration and deceleration
+            // phases may be shortened if max speed isn't reached in which case search for the peak rate at which the ramps fit
+            // (there is no ramp if the rate doesn't change - a shaped ramp otherwise includes the shaper duration)
+            auto rampSteps = [&](float rate1, float rate2) {
+                if (rate1 == rate2)
+                    return 0.0F;
+                return pShaper ? pShaper->rampDist(rate1, rate2, maxAccStepsPerSec2) :
+                            jerkLimitedRampDist(rate1, rate2, maxAccStepsPerSec2, jerkStepsPerSec3);
+            };
+            float minPeakRate = UTILS_MAX(initialStepRatePerSec, finalStepRatePerSec);
+            if (axisMaxStepRatePerSec < minPeakRate)
+                axisMaxStepRatePerSec = minPeakRate;
+            if (rampSteps(initialStepRatePerSec, axisMaxStepRatePerSec) + rampSteps(axisMaxStepRatePerSec, finalStepRatePerSec) >
+                        absMaxStepsForAnyAxis)
+            {
+                float lowRate = minPeakRate;
+                float highRate = axisMaxStepRatePerSec;
+                for (uint32_t i = 0; i < JERK_LIMITED_SEARCH_ITERATIONS; i++)
+                {
+                    float midRate = (lowRate + highRate) / 2;
+                    if (rampSteps(initialStepRatePerSec, midRate) + rampSteps(midRate, finalStepRatePerSec) <= absMaxStepsForAnyAxis)
+                        lowRate = midRate;
+                    else
+                        highRate = midRate;
+                }
+                axisMaxStepRatePerSec = lowRate;
+            }
 
             // Decelerating steps
-            stepsDecelerating =
-                uint32_t((powf(axisMaxStepRatePerSec, 2) - powf(finalStepRatePerSec, 2)) /
-                            2 / maxAccStepsPerSec2);
+            stepsDecelerating = uint32_t(ceilf(rampSteps(axisMaxStepRatePerSec, finalStepRatePerSec)));
+            if (stepsDecelerating > absMaxStepsForAnyAxis)
+                stepsDecelerating = absMaxStepsForAnyAxis;
         }
         else
         {
-            // Calculate max speed that will be reached
-            axisMaxStepRatePerSec =
-                sqrtf(powf(initialStepRatePerSec, 2) + 2.0F * maxAccStepsPerSec2 * stepsAccelerating);
+            // Trapezoidal profile
+            // Calculate the distance decelerating and ensure within bounds
+            // Using the facts for the block ... (assuming max accleration followed by max deceleration):
+            //		Vmax * Vmax = Ventry * Ventry + 2 * Amax * Saccelerating
+            //		Vexit * Vexit = Vmax * Vmax - 2 * Amax * Sdecelerating
+            //      Stotal = Saccelerating + Sdecelerating
+            // And solving for Saccelerating (distance accelerating)
+            //
+            // Steps accelerating if max speed isn't reached and steps to reach max speed (compared unrounded so that
+            // a block which just fails to reach max speed isn't treated as reaching it)
+            float stepsAcceleratingFloat = (powf(finalStepRatePerSec, 2) - powf(initialStepRatePerSec, 2)) / 4 /
+                            maxAccStepsPerSec2 + absMaxStepsForAnyAxis / 2.0F;
+            float stepsToMaxSpeedFloat = (powf(axisMaxStepRatePerSec, 2) - powf(initialStepRatePerSec, 2)) /
+                            2 / maxAccStepsPerSec2;
 
             // Decelerating steps
-            stepsDecelerating = absMaxStepsForAnyAxis - stepsAccelerating;
+            stepsDecelerating = 0;
+            if (stepsAcceleratingFloat > stepsToMaxSpeedFloat)
+            {
+                // Max speed will be reached
+                stepsDecelerating =
+                    uint32_t((powf(axisMaxStepRatePerSec, 2) - powf(finalStepRatePerSec, 2)) /
+                                2 / maxAccStepsPerSec2);
+                if (stepsDecelerating > absMaxStepsForAnyAxis)
+                    stepsDecelerating = absMaxStepsForAnyAxis;
+            }
+            else
+            {
+                uint32_t stepsAccelerating = 0;
+                stepsAcceleratingFloat = ceilf(stepsAcceleratingFloat);
+                if (stepsAcceleratingFloat > 0)
+                {
+                    stepsAccelerating = uint32_t(stepsAcceleratingFloat);
+                    if (stepsAccelerating > absMaxStepsForAnyAxis)
+                        stepsAccelerating = absMaxStepsForAnyAxis;
+                }
+
+                // Calculate max speed that will be reached
+                axisMaxStepRatePerSec =
+                    sqrtf(powf(initialStepRatePerSec, 2) + 2.0F * maxAccStepsPerSec2 * stepsAccelerating);
+
+                // Decelerating steps
+                stepsDecelerating = absMaxStepsForAnyAxis - stepsAccelerating;
+            }
         }
     }
 
+    // The peak rate must never be below the minimum step rate (a zero peak rate would leave a short block
+    // stepping at whatever the ramp generator's floor happens to be)
+    if ((absMaxStepsForAnyAxis > 0) && (axisMaxStepRatePerSec < MIN_STEP_RATE_PER_SEC))
+        axisMaxStepRatePerSec = MIN_STEP_RATE_PER_SEC;
+
     // Fill in the step values for this axis
-    _initialStepRatePerTTicks = uint32_t((initialStepRatePerSec * TTICKS_VALUE) / _ticksPerSec);
-    _maxStepRatePerTTicks = uint32_t((axisMaxStepRatePerSec * TTICKS_VALUE) / _ticksPerSec);
-    _finalStepRatePerTTicks = uint32_t((finalStepRatePerSec * TTICKS_VALUE) / _ticksPerSec);
-    _accStepsPerTTicksPerMS = uint32_t((maxAccStepsPerSec2 * TTICKS_VALUE) / _ticksPerSec / 1000);
-    _stepsBeforeDecel = absMaxStepsForAnyAxis - stepsDecelerating;
+    // Since TTICKS_VALUE is the number of ns in a second, the rate per TTICKS is simply the rate per second
+    // multiplied by the step generation period in ns - this avoids double precision (software) maths
+    stepSeg._initialStepRatePerTTicks = uint32_t(initialStepRatePerSec * _stepGenPeriodNs);
+    stepSeg._maxStepRatePerTTicks = uint32_t(axisMaxStepRatePerSec * _stepGenPeriodNs);
+    // The final rate of a deceleration to a standstill is floored at the average rate of its last step - the ramp
+    // generator changes rate once per acceleration tick so its ramp can end a fraction of a step (or so) short and
+    // the remainder must not crawl at the minimum step rate (a block which exits at a junction speed ends at that
+    // speed as the next block starts at it)
+    float tailStepRatePerSec = (isLinear || (finalStepRatePerSec != 0)) ? 0 : sqrtf(maxAccStepsPerSec2 / 2);
+    stepSeg._finalStepRatePerTTicks = uint32_t(UTILS_MAX(finalStepRatePerSec, tailStepRatePerSec) * _stepGenPeriodNs);
+    // Acceleration (and jerk) are scaled to the acceleration tick period
+    float accelTickSecs = _accelTickNs / 1.0e9F;
+    stepSeg._accStepsPerTTicksPerMS = uint32_t(maxAccStepsPerSec2 * _stepGenPeriodNs * accelTickSecs);
+    stepSeg._jerkAccStepsPerTTicksPerMS = 0;
+    if (jerkStepsPerSec3 > 0)
+        stepSeg._jerkAccStepsPerTTicksPerMS = UTILS_MAX(uint32_t(jerkStepsPerSec3 * _stepGenPeriodNs * accelTickSecs * accelTickSecs), 1);
+
+    // Input shaping - impulse times in acceleration ticks and the acceleration level after each impulse
+    stepSeg._shaperNumImpulses = 0;
+    if (pShaper && (pShaper->getNumImpulses() > 1))
+    {
+        float levelSum = 0;
+        for (uint32_t i = 1; i < pShaper->getNumImpulses(); i++)
+        {
+            levelSum += pShaper->getImpulseAmp(i - 1);
+            stepSeg._shaperImpulseTicks[i - 1] = uint16_t(fminf(roundf(pShaper->getImpulseTimeSecs(i) / accelTickSecs), 0xffff));
+            stepSeg._shaperLevelsQ16[i - 1] = uint16_t(fminf(levelSum * MotionStepSegment::SHAPER_LEVEL_Q16_ONE, 0xffff));
+        }
+        stepSeg._shaperNumImpulses = pShaper->getNumImpulses();
+    }
+    stepSeg._stepsBeforeDecel = absMaxStepsForAnyAxis - stepsDecelerating;
+    stepSeg._feedOverridePercent = isLinear ? 0 : _feedOverridePercent;
+
+    // Pressure advance - applied when the extruder axis moves with other axes (not when it has the most steps
+    // as for a retraction) - advance steps = K * extruder steps per sec = K * rate * (extruder steps / max steps)
+    // / step generation period (ns)
+    float pressureAdvanceSecs = 0;
+    int paAxisIdx = axesParams.getPressureAdvanceAxis(pressureAdvanceSecs);
+    stepSeg._paAxisIdx = MotionStepSegment::PA_AXIS_NONE;
+    stepSeg._paFactorQ32 = 0;
+    if (!isLinear && (paAxisIdx >= 0) && (uint32_t(paAxisIdx) != axisIdxWithMaxSteps) && 
+                (stepSeg._stepsTotalMaybeNeg[paAxisIdx] != 0) && (absMaxStepsForAnyAxis > 0))
+    {
+        float paFactor = pressureAdvanceSecs * fabsf(stepSeg._stepsTotalMaybeNeg[paAxisIdx]) / 
+                    (float(absMaxStepsForAnyAxis) * _stepGenPeriodNs);
+        stepSeg._paFactorQ32 = uint32_t(fminf(paFactor * 4294967296.0f, 4294967295.0f));
+        stepSeg._paAxisIdx = paAxisIdx;
+    }
     _debugStepDistMM = stepDistMM;
 
+    // Estimated duration - the time of each ramp (whose steps are at the average rate of the ramp) and the time
+    // at the max rate for the remaining steps - shaped profiles are estimated as trapezoidal so are slightly longer
+    float durationSecs = 0;
+    if (axisMaxStepRatePerSec > 0)
+    {
+        auto rampSecs = [&](float rate1, float rate2) {
+            float rateChange = fabsf(rate2 - rate1);
+            if (isLinear || (maxAccStepsPerSec2 <= 0))
+                return 0.0F;
+            if (jerkStepsPerSec3 <= 0)
+                return rateChange / maxAccStepsPerSec2;
+            if (rateChange >= maxAccStepsPerSec2 * maxAccStepsPerSec2 / jerkStepsPerSec3)
+                return rateChange / maxAccStepsPerSec2 + maxAccStepsPerSec2 / jerkStepsPerSec3;
+            return 2.0F * sqrtf(rateChange / jerkStepsPerSec3);
+        };
+        float accSecs = rampSecs(initialStepRatePerSec, axisMaxStepRatePerSec);
+        float decSecs = rampSecs(axisMaxStepRatePerSec, finalStepRatePerSec);
+        float rampStepsTotal = (initialStepRatePerSec + axisMaxStepRatePerSec) / 2 * accSecs +
+                    (axisMaxStepRatePerSec + finalStepRatePerSec) / 2 * decSecs;
+        durationSecs = accSecs + decSecs + fmaxf(absMaxStepsForAnyAxis - rampStepsTotal, 0) / axisMaxStepRatePerSec;
+    }
+    stepSeg._estDurationUs = uint32_t(fminf(durationSecs * 1.0e6F, 4294967295.0F));
+
+    // Record the speeds prepared for
+    _isPrepared = true;
+    _preparedEntrySpeedMMps = _entrySpeedMMps;
+    _preparedExitSpeedMMps = _exitSpeedMMps;
     return true;
 }
 
@@ -230,7 +363,7 @@ bool MotionBlock::prepareForStepping(const AxesParams &axesParams, bool isLinear
 
 void MotionBlock::debugShowTimingConsts() const
 {
-    LOG_I(MODULE_PREFIX, "TTicksValue (accumulator) %u, TicksPerSec %0.0f", TTICKS_VALUE, _ticksPerSec);
+    LOG_I(MODULE_PREFIX, "TTicksValue (accumulator) %u, TicksPerSec %0.0f", TTICKS_VALUE, calcTicksPerSec(_stepGenPeriodNs));
 }
 
 void MotionBlock::debugShowBlkHead() const
@@ -238,23 +371,23 @@ void MotionBlock::debugShowBlkHead() const
     LOG_I(MODULE_PREFIX, "#i EntMMps ExtMMps StTot0 StTot1 StTot2 St>Dec    Init     (perTT)      Pk     (perTT)     Fin     (perTT)     Acc     (perTT) UnitVecMax   FeedRtMMps StepDistMM  MaxStepRate");
 }
 
-void MotionBlock::debugShowBlock(int elemIdx, const AxesParams &axesParams) const
+void MotionBlock::debugShowBlock(int elemIdx, const MotionStepSegment& stepSeg, const AxesParams &axesParams) const
 {
     char baseStr[100];
     snprintf(baseStr, sizeof(baseStr), "%2d%8.3f%8.3f%7d%7d%7d%7u",                 
                 elemIdx,
                 _entrySpeedMMps,
                 _exitSpeedMMps,
-                (int)_stepsTotalMaybeNeg[0],
-                (int)_stepsTotalMaybeNeg[1],
-                (int)_stepsTotalMaybeNeg[2],
-                (int)_stepsBeforeDecel);
+                (int)stepSeg._stepsTotalMaybeNeg[0],
+                (int)stepSeg._stepsTotalMaybeNeg[1],
+                (int)stepSeg._stepsTotalMaybeNeg[2],
+                (int)stepSeg._stepsBeforeDecel);
     char extStr[200];
     snprintf(extStr, sizeof(extStr), "%8.3f(%10ld)%8.3f(%10ld)%8.3f(%10ld)%8.3f(%10lu)%13.8f%11.6f%11.8f%11.3f",
-                debugStepRateToMMps(_initialStepRatePerTTicks), (long int)_initialStepRatePerTTicks,
-                debugStepRateToMMps(_maxStepRatePerTTicks), (long int)_maxStepRatePerTTicks,
-                debugStepRateToMMps(_finalStepRatePerTTicks), (long int)_finalStepRatePerTTicks,
-                debugStepRateToMMps2(_accStepsPerTTicksPerMS), (long unsigned)_accStepsPerTTicksPerMS,
+                debugStepRateToMMps(stepSeg._initialStepRatePerTTicks), (long int)stepSeg._initialStepRatePerTTicks,
+                debugStepRateToMMps(stepSeg._maxStepRatePerTTicks), (long int)stepSeg._maxStepRatePerTTicks,
+                debugStepRateToMMps(stepSeg._finalStepRatePerTTicks), (long int)stepSeg._finalStepRatePerTTicks,
+                debugStepRateToMMps2(stepSeg._accStepsPerTTicksPerMS), (long unsigned)stepSeg._accStepsPerTTicksPerMS,
                 _unitVecAxisWithMaxDist,
                 _requestedSpeed,
                 _debugStepDistMM,
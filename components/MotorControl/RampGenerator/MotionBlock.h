@@ -10,47 +10,34 @@
 
 #include <math.h>
 #include "AxesParams.h"
-#include "AxisEndstopChecks.h"
+#include "MotionStepSegment.h"
 
+// Motion block - planner data for a block in the motion pipeline
+// The data used when stepping is held in a MotionStepSegment which is stored in a parallel array
+// in the pipeline so that only the compact step data has to be in internal RAM for the ISR
 class MotionBlock
 {
 public:
     MotionBlock();
 
-    // Set timer period
-    void setTimerPeriodNs(uint32_t stepGenPeriodNs);
+    // Set timer period and the period at which acceleration is applied
+    void setTimerPeriodNs(uint32_t stepGenPeriodNs, uint32_t accelTickNs = NS_IN_A_MS);
 
     // Clear
     void clear();
 
-    // Motion tracking
-    void setMotionTrackingIndex(uint32_t motionTrackingIndex);
-    uint32_t getMotionTrackingIndex();
-
-    // Target
-    AxesValues<AxisStepsDataType> getStepsToTarget() const
-    {
-        return _stepsTotalMaybeNeg;
-    }
-    void setStepsToTarget(const AxesValues<AxisStepsDataType>& steps)
-    {
-        _stepsTotalMaybeNeg = steps;
-        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
-        {
-            int steps = _stepsTotalMaybeNeg.getVal(axisIdx);
-            if (abs(steps) > abs(_stepsTotalMaybeNeg.getVal(_axisIdxWithMaxSteps)))
-                _axisIdxWithMaxSteps = axisIdx;
-        }
-    }
-
     // Rates
-    uint32_t getExitStepRatePerTTicks();
+    // If jerk is non-zero the speed is for a jerk-limited (S-curve) change in speed and if a shaper is
+    // specified the speed is for a shaped change in speed (which takes precedence)
     static AxisSpeedDataType maxAchievableSpeed(AxisAccDataType acceleration, 
                         AxisSpeedDataType target_velocity, 
-                        AxisDistDataType distance);
+                        AxisDistDataType distance,
+                        AxisAccDataType jerk = 0,
+                        const InputShaper* pShaper = nullptr);
 
-    // End stops
-    void setEndStopsToCheck(const AxisEndstopChecks &endStopCheck);
+    // Distance required for a jerk-limited (S-curve) change in speed
+    static AxisDistDataType jerkLimitedRampDist(AxisSpeedDataType speed1, AxisSpeedDataType speed2,
+                        AxisAccDataType acceleration, AxisAccDataType jerk);
 
     // Prepare a block for stepping
     // If the block is "stepwise" this means that there is no acceleration and deceleration - just steps
@@ -58,23 +45,61 @@ public:
     // If not "stepwise" then the block's entry and exit speed are now known
     //     so the block can accelerate and decelerate as required as long as these criteria are met -
     //     we now compute the stepping parameters to make motion happen
-    bool prepareForStepping(const AxesParams &axesParams, bool isLinear);
+    // The stepping parameters are written to the step segment for this block
+    bool prepareForStepping(const AxesParams &axesParams, bool isLinear, MotionStepSegment& stepSeg);
+
+    // Check if the step segment has been prepared for the current entry and exit speeds
+    bool isPreparedForSpeeds() const
+    {
+        return _isPrepared && (_preparedEntrySpeedMMps == _entrySpeedMMps) && (_preparedExitSpeedMMps == _exitSpeedMMps);
+    }
+
+    // Invalidate the step segment preparation (e.g. when the steps to target have changed)
+    void invalidatePrepared()
+    {
+        _isPrepared = false;
+    }
+
+    // Feed override - the requested speed and the max entry speed are scaled by the override
+    AxisSpeedDataType getNominalSpeed() const
+    {
+        return _feedOverridePercent == FEED_OVERRIDE_PERCENT_DEFAULT ? _requestedSpeed :
+                    _requestedSpeed * _feedOverridePercent / FEED_OVERRIDE_PERCENT_DEFAULT;
+    }
+
+    // Max acceleration along the path for this block (the fallback is used if per-block acceleration isn't set)
+    AxisAccDataType getMaxAccel(AxisAccDataType fallbackAccUps2) const
+    {
+        return _maxAccUps2 > 0 ? _maxAccUps2 : fallbackAccUps2;
+    }
+
+    // Input shaper for this block (nullptr if the block isn't shaped)
+    const InputShaper* getInputShaper(const AxesParams& axesParams) const
+    {
+        return _inputShaperAxisIdx < 0 ? nullptr : axesParams.getInputShaper(_inputShaperAxisIdx);
+    }
+
+    AxisSpeedDataType getMaxEntrySpeed() const
+    {
+        return _feedOverridePercent == FEED_OVERRIDE_PERCENT_DEFAULT ? _maxEntrySpeedMMps :
+                    fminf(_maxEntrySpeedMMps, _maxEntryNominalSpeedMMps * _feedOverridePercent / FEED_OVERRIDE_PERCENT_DEFAULT);
+    }
 
     // Debug
     void debugShowTimingConsts() const;
     void debugShowBlkHead() const;
-    void debugShowBlock(int elemIdx, const AxesParams &axesParams) const;
-    double debugStepRateToMMps(uint32_t val) const
+    void debugShowBlock(int elemIdx, const MotionStepSegment& stepSeg, const AxesParams &axesParams) const;
+    float debugStepRateToMMps(uint32_t val) const
     {
-        return (((val * 1.0) * _ticksPerSec) / MotionBlock::TTICKS_VALUE) * _debugStepDistMM;
+        return (float(val) * calcTicksPerSec(_stepGenPeriodNs) / MotionBlock::TTICKS_VALUE) * _debugStepDistMM;
     }
-    double debugStepRateToMMps2(uint32_t val) const
+    float debugStepRateToMMps2(uint32_t val) const
     {
-        return (((val * 1.0) * 1000 * _ticksPerSec) / MotionBlock::TTICKS_VALUE) * _debugStepDistMM;
+        return (float(val) * (1.0e9F / _accelTickNs) * calcTicksPerSec(_stepGenPeriodNs) / MotionBlock::TTICKS_VALUE) * _debugStepDistMM;
     }
 
     // Minimum move distance
-    static constexpr double MINIMUM_MOVE_DIST_MM = 0.0001;
+    static constexpr AxisDistDataType MINIMUM_MOVE_DIST_MM = 0.0001F;
 
     // Number of ticks to accumulate for rate actuation
     static constexpr uint32_t TTICKS_VALUE = 1000000000l;
@@ -82,32 +107,39 @@ public:
     // Number of ns in ms
     static constexpr uint32_t NS_IN_A_MS = 1000000;
 
+    // Minimum step rate - this is to ensure that the robot never goes to 0 tick rate - which would
+    // leave it immobile forever
+    static constexpr uint32_t MIN_STEP_RATE_PER_SEC = 10;
+
+    // Feed override (percent) range
+    static constexpr uint32_t FEED_OVERRIDE_PERCENT_DEFAULT = 100;
+    static constexpr uint32_t FEED_OVERRIDE_PERCENT_MIN = 10;
+    static constexpr uint32_t FEED_OVERRIDE_PERCENT_MAX = 200;
+
+    // Iterations used when searching for jerk-limited speeds
+    static constexpr uint32_t JERK_LIMITED_SEARCH_ITERATIONS = 16;
+
     // Calculate ticks per second
-    static double calcTicksPerSec(uint32_t stepGenPeriodNs)
+    static float calcTicksPerSec(uint32_t stepGenPeriodNs)
     {
-        return 1.0e9 / stepGenPeriodNs;
+        return 1.0e9F / stepGenPeriodNs;
     }
 
-    // Calculate minimum step rate per TTICKS 
+    // Calculate minimum step rate per TTICKS
     static uint32_t calcMinStepRatePerTTicks(uint32_t stepGenPeriodNs)
     {
-        // This is to ensure that the robot never goes to 0 tick rate - which would leave it
-        // immobile forever
-        static constexpr uint32_t MIN_STEP_RATE_PER_SEC = 10;
-        return uint32_t((MIN_STEP_RATE_PER_SEC * 1.0 * MotionBlock::TTICKS_VALUE) / calcTicksPerSec(stepGenPeriodNs));
+        // TTICKS_VALUE is the number of ns in a second so the rate per TTICKS is the rate per second
+        // multiplied by the step generation period in ns (integer only)
+        return MIN_STEP_RATE_PER_SEC * stepGenPeriodNs;
     }
 
 public:
-    // Flags
-    struct
-    {
-        // Flag indicating the block is currently executing
-        volatile bool _isExecuting : 1;
-        // Flag indicating the block can start executing
-        volatile bool _canExecute : 1;
-        // Block is followed by others
-        bool _blockIsFollowed : 1;
-    };
+    // Block is followed by others
+    bool _blockIsFollowed = false;
+    // Block is optimally planned (entry and exit speeds can no longer change)
+    bool _isPlanned = false;
+    // Block is stepwise (no acceleration or deceleration)
+    bool _isStepwise = false;
 
     // Requested max speed for move - either axis units-per-sec or 
     // stepsPerSec depending if move is stepwise
@@ -116,36 +148,36 @@ public:
     AxisDistDataType _moveDistPrimaryAxesMM = 0;
     // Unit vector on axis with max movement
     AxisUnitVectorDataType _unitVecAxisWithMaxDist = 0;
+    // Max acceleration along the path (per-axis limits projected onto the unit vector) - 0 if not set
+    AxisAccDataType _maxAccUps2 = 0;
+    // Axis whose input shaper is applied to this block (the most conservative of the moving axes) - -1 if not shaped
+    int8_t _inputShaperAxisIdx = -1;
     // Computed max entry speed for a block based on max junction deviation calculation
     AxisSpeedDataType _maxEntrySpeedMMps = 0;
+    // Lower of the requested speeds of this block and the one before (the max entry speed is also limited to this
+    // scaled by the feed override)
+    AxisSpeedDataType _maxEntryNominalSpeedMMps = 0;
+    // Feed override (percent) applied to the requested speed
+    uint8_t _feedOverridePercent = FEED_OVERRIDE_PERCENT_DEFAULT;
     // Computed entry speed for this block
     AxisSpeedDataType _entrySpeedMMps = 0;
     // Computed exit speed for this block
     AxisSpeedDataType _exitSpeedMMps = 0;
-    // End-stops to test
-    AxisEndstopChecks _endStopsToCheck;
-
-    // Steps to target and before deceleration
-    AxesValues<AxisStepsDataType> _stepsTotalMaybeNeg;
-    int _axisIdxWithMaxSteps = 0;
-    uint32_t _stepsBeforeDecel = 0;
-
-    // Stepping acceleration/deceleration profile
-    uint32_t _initialStepRatePerTTicks = 0;
-    uint32_t _maxStepRatePerTTicks = 0;
-    uint32_t _finalStepRatePerTTicks = 0;
-    uint32_t _accStepsPerTTicksPerMS = 0;
-
-    // Motion tracking index - to help keep track of motion execution from other processes
-    // like homing
-    uint32_t _motionTrackingIndex = 0;
 
 private:
+    // Speeds used when the step segment was last prepared
+    bool _isPrepared = false;
+    AxisSpeedDataType _preparedEntrySpeedMMps = 0;
+    AxisSpeedDataType _preparedExitSpeedMMps = 0;
+
     // Step distance in MM
-    double _debugStepDistMM = 0;
+    AxisDistDataType _debugStepDistMM = 0;
+
+    // Step generation period ns
+    uint32_t _stepGenPeriodNs = 0;
 
-    // Ticks per second
-    double _ticksPerSec = 0;
+    // Acceleration tick period ns
+    uint32_t _accelTickNs = NS_IN_A_MS;
 
     // Helpers
     template<typename T>
@@ -6,17 +6,67 @@
 //
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <new>
+#include <stdlib.h>
 #include "MotionPipeline.h"
+#include "Logger.h"
+#include "esp_heap_caps.h"
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Peek at next item in pipeline
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-MotionBlock* IRAM_ATTR MotionPipeline::peekGet()
+MotionStepSegment* IRAM_ATTR MotionPipeline::peekGet()
 {
     // Check if queue is empty
     if (!_pipelinePosn.canGet())
         return NULL;
     // get pointer to the last item (don't remove)
-    return &(_pipeline[_pipelinePosn._getPos]);
+    return &(_stepSegs[_pipelinePosn.getIdx()]);
+}
+
+MotionStepSegment* IRAM_ATTR MotionPipeline::peekGetNext()
+{
+    // Check if there are at least two items
+    int nextPos = _pipelinePosn.getNthFromGet(1);
+    if (nextPos < 0)
+        return NULL;
+    return &(_stepSegs[nextPos]);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Allocate step segments in internal RAM (so they are never placed in PSRAM) aligned to a cache line
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool MotionPipeline::allocStepSegs(unsigned int len)
+{
+    if (len == 0)
+        return true;
+    void* pMem = heap_caps_aligned_alloc(alignof(MotionStepSegment), len * sizeof(MotionStepSegment),
+                MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!pMem)
+    {
+        LOG_E(MODULE_PREFIX, "allocStepSegs failed to allocate %d step segments", len);
+        return false;
+    }
+    _stepSegs = static_cast<MotionStepSegment*>(pMem);
+    for (unsigned int i = 0; i < len; i++)
+        new (&_stepSegs[i]) MotionStepSegment();
+    _stepSegsLen = len;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Free step segments
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MotionPipeline::freeStepSegs()
+{
+    if (!_stepSegs)
+        return;
+    for (unsigned int i = 0; i < _stepSegsLen; i++)
+        _stepSegs[i].~MotionStepSegment();
+    heap_caps_free(_stepSegs);
+    _stepSegs = nullptr;
+    _stepSegsLen = 0;
 }
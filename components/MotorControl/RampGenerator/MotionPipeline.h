@@ -6,8 +6,13 @@
 #include "MotionPipelineIF.h"
 #include "MotionRingBuffer.h"
 #include "MotionBlock.h"
+#include "MotionStepSegment.h"
 #include <vector>
+#include <atomic>
 
+// The pipeline holds two parallel arrays indexed by the same ring buffer position
+// - step segments (read by the ramp generator ISR) are allocated from internal RAM
+// - planner data (MotionBlock) is only accessed from the planner and can be in any RAM
 class MotionPipeline : public MotionPipelineIF
 {
 public:
@@ -15,19 +20,44 @@ public:
     {
     }
 
-    void setup(int pipelineSize)
+    virtual ~MotionPipeline()
     {
+        freeStepSegs();
+    }
+
+    bool setup(int pipelineSize)
+    {
+        // Keep the existing allocation if the size is unchanged (e.g. when the configuration is reloaded)
+        if ((pipelineSize > 0) && _stepSegs && (_stepSegsLen == (unsigned int)pipelineSize) && 
+                    (_pipeline.size() == (unsigned int)pipelineSize))
+        {
+            for (unsigned int i = 0; i < _stepSegsLen; i++)
+                _stepSegs[i].clear();
+            _pipelinePosn.init(pipelineSize);
+            _bufferedUs = 0;
+            return true;
+        }
+        freeStepSegs();
+        _pipelinePosn.init(0);
         _pipeline.resize(pipelineSize);
+        if (!allocStepSegs(pipelineSize))
+        {
+            _pipeline.clear();
+            return false;
+        }
         _pipelinePosn.init(pipelineSize);
+        _bufferedUs = 0;
+        return true;
     }
 
     // Clear the pipeline
     virtual void clear() override final
     {
         _pipelinePosn.clear();
+        _bufferedUs = 0;
     }
 
-    virtual unsigned int count() const override final
+    virtual unsigned int IRAM_ATTR count() const override final
     {
         return _pipelinePosn.count();
     }
@@ -42,6 +72,19 @@ public:
         return _pipelinePosn.remaining();
     }
 
+    // Time of motion buffered (us)
+    virtual uint32_t IRAM_ATTR getBufferedUs() const override final
+    {
+        return _bufferedUs.load();
+    }
+
+    // Adjust the time buffered when a block has been re-prepared (unsigned arithmetic so the order in which this
+    // and the removal of the block happen doesn't matter)
+    virtual void adjustBufferedUs(uint32_t prevEstDurationUs, uint32_t newEstDurationUs) override final
+    {
+        _bufferedUs += newEstDurationUs - prevEstDurationUs;
+    }
+
     // Check if ready to accept data
     virtual bool canAccept() const override final
     {
@@ -49,14 +92,17 @@ public:
     }
 
     // Add to pipeline
-    virtual bool add(const MotionBlock &block) override final
+    virtual bool add(const MotionBlock &block, const MotionStepSegment& stepSeg) override final
     {
         // Check if full
         if (!_pipelinePosn.canPut())
             return false;
 
-        // Add the item
-        _pipeline[_pipelinePosn._putPos] = block;
+        // Add the item - both parts must be fully copied before hasPut() publishes them to the consumer
+        unsigned int putIdx = _pipelinePosn.putIdx();
+        _pipeline[putIdx] = block;
+        _stepSegs[putIdx] = stepSeg;
+        _bufferedUs += stepSeg._estDurationUs;
         _pipelinePosn.hasPut();
         return true;
     }
@@ -67,15 +113,16 @@ public:
         return _pipelinePosn.canGet();
     }
 
-    // Get from queue
-    inline bool IRAM_ATTR get(MotionBlock &block)
+    // Get step segment from queue
+    inline bool IRAM_ATTR get(MotionStepSegment &stepSeg)
     {
         // Check if queue is empty
         if (!_pipelinePosn.canGet())
             return false;
 
         // read the item and remove
-        block = _pipeline[_pipelinePosn._getPos];
+        stepSeg = _stepSegs[_pipelinePosn.getIdx()];
+        _bufferedUs -= stepSeg._estDurationUs;
         _pipelinePosn.hasGot();
         return true;
     }
@@ -88,12 +135,16 @@ public:
             return false;
 
         // remove item
+        _bufferedUs -= _stepSegs[_pipelinePosn.getIdx()]._estDurationUs;
         _pipelinePosn.hasGot();
         return true;
     }
 
-    // Peek the block which would be got (if there is one)
-    virtual MotionBlock* peekGet() override final;
+    // Peek the step segment which would be got (if there is one)
+    virtual MotionStepSegment* peekGet() override final;
+
+    // Peek the step segment which would be got after the one returned by peekGet (if there is one)
+    MotionStepSegment* peekGetNext();
 
     // Peek from the put position
     // 0 is the last element put in the queue
@@ -108,6 +159,15 @@ public:
         return &(_pipeline[nthPos]);
     }
 
+    virtual MotionStepSegment *peekStepSegNthFromPut(unsigned int N) override final
+    {
+        // Get index
+        int nthPos = _pipelinePosn.getNthFromPut(N);
+        if (nthPos < 0)
+            return NULL;
+        return &(_stepSegs[nthPos]);
+    }
+
     const MotionBlock *peekNthFromPutConst(unsigned int N) const
     {
         // Get index
@@ -117,11 +177,20 @@ public:
         return &(_pipeline[nthPos]);
     }
 
+    const MotionStepSegment *peekStepSegNthFromPutConst(unsigned int N) const
+    {
+        // Get index
+        int nthPos = _pipelinePosn.getNthFromPut(N);
+        if (nthPos < 0)
+            return NULL;
+        return &(_stepSegs[nthPos]);
+    }
+
     // Peek from the get position
     // 0 is the element next got from the queue
     // 1 is the one got after that
     // returns NULL when nothing to peek
-    MotionBlock *peekNthFromGet(unsigned int N)
+    MotionBlock *peekNthFromGet(unsigned int N) override final
     {
         // Get index
         int nthPos = _pipelinePosn.getNthFromGet(N);
@@ -130,7 +199,16 @@ public:
         return &(_pipeline[nthPos]);
     }
 
-    const MotionBlock *peekNthFromGetConst(unsigned int N) const
+    MotionStepSegment *peekStepSegNthFromGet(unsigned int N) override final
+    {
+        // Get index
+        int nthPos = _pipelinePosn.getNthFromGet(N);
+        if (nthPos < 0)
+            return NULL;
+        return &(_stepSegs[nthPos]);
+    }
+
+    const MotionBlock *peekNthFromGetConst(unsigned int N) const override final
     {
         // Get index
         int nthPos = _pipelinePosn.getNthFromGet(N);
@@ -139,6 +217,15 @@ public:
         return &(_pipeline[nthPos]);
     }
 
+    const MotionStepSegment *peekStepSegNthFromGetConst(unsigned int N) const
+    {
+        // Get index
+        int nthPos = _pipelinePosn.getNthFromGet(N);
+        if (nthPos < 0)
+            return NULL;
+        return &(_stepSegs[nthPos]);
+    }
+
     // Debug
     void debugShowBlocks(const AxesParams &axesParams) const override final
     {
@@ -147,14 +234,15 @@ public:
         for (int i = count() - 1; i >= 0; i--)
         {
             const MotionBlock *pBlock = peekNthFromPutConst(i);
-            if (pBlock)
+            const MotionStepSegment *pStepSeg = peekStepSegNthFromPutConst(i);
+            if (pBlock && pStepSeg)
             {
                 if (!headShown)
                 {
                     pBlock->debugShowBlkHead();
                     headShown = true;
                 }
-                pBlock->debugShowBlock(elIdx++, axesParams);
+                pBlock->debugShowBlock(elIdx++, *pStepSeg, axesParams);
             }
         }
     }
@@ -166,11 +254,28 @@ public:
         if (cnt == 0)
             return;
         MotionBlock *pBlock = peekNthFromPut(cnt-1);
-        if (pBlock)
-            pBlock->debugShowBlock(0, axesParams);
+        MotionStepSegment *pStepSeg = peekStepSegNthFromPut(cnt-1);
+        if (pBlock && pStepSeg)
+            pBlock->debugShowBlock(0, *pStepSeg, axesParams);
     }
 
 private:
     MotionRingBufferPosn _pipelinePosn;
+
+    // Time of motion buffered (us) - added to when a block is added and subtracted from (in the ISR) when removed
+    std::atomic<uint32_t> _bufferedUs = 0;
+
+    // Planner data
     std::vector<MotionBlock> _pipeline;
+
+    // Step segments (internal RAM)
+    MotionStepSegment* _stepSegs = nullptr;
+    unsigned int _stepSegsLen = 0;
+
+    // Helpers
+    bool allocStepSegs(unsigned int len);
+    void freeStepSegs();
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "MotionPipeline";
 };
@@ -10,12 +10,13 @@
 
 #include "MotionPipelineIF.h"
 #include "MotionBlock.h"
+#include "MotionStepSegment.h"
 
 class MotionPipelineIF
 {
 public:
-    // Peek the block which would be got (if there is one)
-    virtual MotionBlock* peekGet() = 0;
+    // Peek the step segment which would be got (if there is one)
+    virtual MotionStepSegment* peekGet() = 0;
 
     // Remove last element from queue
     virtual bool remove() = 0;
@@ -24,16 +25,19 @@ public:
     virtual void clear() = 0;
 
     // Add
-    virtual bool add(const MotionBlock &block) = 0;
+    virtual bool add(const MotionBlock &block, const MotionStepSegment& stepSeg) = 0;
 
     // Can get
     virtual bool IRAM_ATTR canGet() = 0;
 
     // Peek Nth element from the put position
     virtual MotionBlock *peekNthFromPut(unsigned int N) = 0;
+    virtual MotionStepSegment *peekStepSegNthFromPut(unsigned int N) = 0;
 
     // Peek Nth element from the get position
     virtual MotionBlock *peekNthFromGet(unsigned int N) = 0;
+    virtual const MotionBlock *peekNthFromGetConst(unsigned int N) const = 0;
+    virtual MotionStepSegment *peekStepSegNthFromGet(unsigned int N) = 0;
 
     // Count
     virtual unsigned int count() const = 0;
@@ -44,6 +48,14 @@ public:
     // Remaining
     virtual unsigned int remaining() const = 0;
 
+    // Time of motion buffered (us) - the sum of the estimated durations of the blocks in the pipeline (including
+    // the block executing)
+    virtual uint32_t getBufferedUs() const = 0;
+
+    // Adjust the time buffered when a block in the pipeline has been re-prepared (so its estimated duration has
+    // changed) - the block must not be executing
+    virtual void adjustBufferedUs(uint32_t prevEstDurationUs, uint32_t newEstDurationUs) = 0;
+
     // Debug
     virtual void debugShowBlocks(const AxesParams &axesParams) const
     {
@@ -8,15 +8,19 @@
 
 #pragma once
 
-// Generic interrupt-safe ring buffer pointer class
-// Each pointer is only updated by one source (ISR or main thread)
+#include <atomic>
+#include "esp_attr.h"
+
+// Single-producer/single-consumer ring buffer position class
+// The put position is only updated by the producer (e.g. planner on one core) and the get position only by
+// the consumer (e.g. ramp generator ISR on the other core)
+// Positions run from 0 to 2*bufLen-1 so that a full buffer can be distinguished from an empty one without
+// wasting a slot - use putIdx() and getIdx() to index the buffer
+// Memory ordering: the producer writes the element and then calls hasPut() (release) - the consumer's canGet()
+// (acquire) then guarantees the element is fully visible - and the same in the other direction for hasGot()
 class MotionRingBufferPosn
 {
   public:
-    volatile unsigned int _putPos = 0;
-    volatile unsigned int _getPos = 0;
-    unsigned int _bufLen = 0;
-
     MotionRingBufferPosn(int maxLen)
     {
         init(maxLen);
@@ -25,14 +29,15 @@ class MotionRingBufferPosn
     void init(int maxLen)
     {
         _bufLen = maxLen;
-        _putPos = 0;
-        _getPos = 0;
+        _putPos.store(0, std::memory_order_relaxed);
+        _getPos.store(0, std::memory_order_release);
     }
 
+    // Clear - must only be called when the consumer is not active
     void clear()
     {
-        _getPos = 0;
-        _putPos = 0;
+        _getPos.store(0, std::memory_order_relaxed);
+        _putPos.store(0, std::memory_order_release);
     }
 
     int size() const
@@ -40,51 +45,45 @@ class MotionRingBufferPosn
         return _bufLen;
     }
 
+    // Producer side
     bool canPut() const
     {
-        if (_bufLen == 0)
-            return false;
-        if (_putPos == _getPos)
-            return true;
-        unsigned int gp = _getPos;
-        if (_putPos > gp)
-        {
-            if ((_putPos != _bufLen - 1) || (gp != 0))
-                return true;
-        }
-        else
-        {
-            if (gp - _putPos > 1)
-                return true;
-        }
-        return false;
+        return count() < _bufLen;
     }
 
-    inline bool IRAM_ATTR canGet() const
+    unsigned int putIdx() const
     {
-        return _putPos != _getPos;
+        return posToIdx(_putPos.load(std::memory_order_relaxed));
     }
 
     void hasPut()
     {
-        _putPos = _putPos + 1;
-        if (_putPos >= _bufLen)
-            _putPos = 0;
+        _putPos.store(nextPos(_putPos.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+
+    // Consumer side
+    inline bool IRAM_ATTR canGet() const
+    {
+        return _putPos.load(std::memory_order_acquire) != _getPos.load(std::memory_order_relaxed);
+    }
+
+    inline unsigned int IRAM_ATTR getIdx() const
+    {
+        return posToIdx(_getPos.load(std::memory_order_relaxed));
     }
 
     inline void IRAM_ATTR hasGot()
     {
-        _getPos = _getPos + 1;
-        if (_getPos >= _bufLen)
-            _getPos = 0;
+        _getPos.store(nextPos(_getPos.load(std::memory_order_relaxed)), std::memory_order_release);
     }
 
-    unsigned int count() const
+    inline unsigned int IRAM_ATTR count() const
     {
-        unsigned int getPos = _getPos;
-        if (getPos <= _putPos)
-            return _putPos - getPos;
-        return _bufLen - getPos + _putPos;
+        unsigned int getPos = _getPos.load(std::memory_order_acquire);
+        unsigned int putPos = _putPos.load(std::memory_order_acquire);
+        if (getPos <= putPos)
+            return putPos - getPos;
+        return 2 * _bufLen - getPos + putPos;
     }
 
     unsigned int remaining() const
@@ -98,16 +97,11 @@ class MotionRingBufferPosn
     // Returns -1 if invalid
     int getNthFromPut(unsigned int N) const
     {
-        if (!canGet())
-            return -1;
-        if (N >= _bufLen)
+        if (N >= count())
             return -1;
-        int nthPos = _putPos - 1 - N;
-        if (nthPos < 0)
-            nthPos += _bufLen;
-        if (((unsigned int)(nthPos + 1) == _getPos) || ((unsigned int)(nthPos + 1) == _bufLen && _getPos == 0))
-            return -1;
-        return nthPos;
+        unsigned int putIdxVal = putIdx();
+        unsigned int offset = N + 1;
+        return putIdxVal >= offset ? putIdxVal - offset : putIdxVal + _bufLen - offset;
     }
 
     // Get Nth element from the get position
@@ -116,15 +110,27 @@ class MotionRingBufferPosn
     // returns -1 if invalid
     int getNthFromGet(unsigned int N) const
     {
-        if (!canGet())
-            return -1;
-        if (N >= _bufLen)
-            return -1;
-        unsigned int nthPos = _getPos + N;
-        if (nthPos >= _bufLen)
-            nthPos -= _bufLen;
-        if (nthPos == _putPos)
+        if (N >= count())
             return -1;
-        return nthPos;
+        unsigned int nthIdx = getIdx() + N;
+        if (nthIdx >= _bufLen)
+            nthIdx -= _bufLen;
+        return nthIdx;
+    }
+
+  private:
+    std::atomic<unsigned int> _putPos = 0;
+    std::atomic<unsigned int> _getPos = 0;
+    unsigned int _bufLen = 0;
+
+    inline unsigned int IRAM_ATTR posToIdx(unsigned int pos) const
+    {
+        return pos >= _bufLen ? pos - _bufLen : pos;
+    }
+
+    inline unsigned int IRAM_ATTR nextPos(unsigned int pos) const
+    {
+        pos = pos + 1;
+        return pos >= 2 * _bufLen ? 0 : pos;
     }
 };
@@ -0,0 +1,180 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MotionStepSegment
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "esp_attr.h"
+#include "AxesValues.h"
+#include "AxisEndstopChecks.h"
+#include "InputShaper.h"
+
+// Step segment - the part of a motion block which is read by the ramp generator when stepping
+// This is kept compact and stored separately from the planner data (MotionBlock) so that the pipeline array
+// accessed from the ISR is small enough to stay in internal RAM even with a long pipeline
+// Segments are aligned to a cache line so a segment never straddles more lines than it needs to (see
+// MotionPipeline::allocStepSegs)
+class alignas(64) MotionStepSegment
+{
+public:
+    MotionStepSegment()
+    {
+        clear();
+    }
+
+    // Clear
+    void clear()
+    {
+        _isExecuting = false;
+        _canExecute = false;
+        _motionTrackingIndexValid = false;
+        _startTimeValid = false;
+        _axisIdxWithMaxSteps = 0;
+        _stepsBeforeDecel = 0;
+        _initialStepRatePerTTicks = 0;
+        _maxStepRatePerTTicks = 0;
+        _finalStepRatePerTTicks = 0;
+        _accStepsPerTTicksPerMS = 0;
+        _jerkAccStepsPerTTicksPerMS = 0;
+        _feedOverridePercent = 0;
+        _shaperNumImpulses = 0;
+        _paAxisIdx = PA_AXIS_NONE;
+        _paFactorQ32 = 0;
+        _motionTrackingIndex = 0;
+        _startTimeUs = 0;
+        _estDurationUs = 0;
+        _endStopsToCheck.clear();
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+            _stepsTotalMaybeNeg.setVal(axisIdx, 0);
+    }
+
+    // Target
+    AxesValues<AxisStepsDataType> getStepsToTarget() const
+    {
+        return _stepsTotalMaybeNeg;
+    }
+    void setStepsToTarget(const AxesValues<AxisStepsDataType>& steps)
+    {
+        _stepsTotalMaybeNeg = steps;
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        {
+            int steps = _stepsTotalMaybeNeg.getVal(axisIdx);
+            if (abs(steps) > abs(_stepsTotalMaybeNeg.getVal(_axisIdxWithMaxSteps)))
+                _axisIdxWithMaxSteps = axisIdx;
+        }
+    }
+    uint32_t getAbsMaxStepsForAnyAxis() const
+    {
+        return abs(_stepsTotalMaybeNeg.getVal(_axisIdxWithMaxSteps));
+    }
+
+    // Rates
+    uint32_t getExitStepRatePerTTicks() const
+    {
+        return _finalStepRatePerTTicks;
+    }
+
+    // End stops
+    void setEndStopsToCheck(const AxisEndstopChecks &endStopCheck)
+    {
+        _endStopsToCheck = endStopCheck;
+    }
+
+    // Motion tracking
+    void setMotionTrackingIndex(uint32_t motionTrackingIndex)
+    {
+        _motionTrackingIndex = motionTrackingIndex;
+        _motionTrackingIndexValid = true;
+    }
+    bool IRAM_ATTR isMotionTrackingIndexValid() const
+    {
+        return _motionTrackingIndexValid;
+    }
+    uint32_t IRAM_ATTR getMotionTrackingIndex() const
+    {
+        return _motionTrackingIndex;
+    }
+
+    // Scheduled start time (shared timebase - see RampGenTimebase)
+    void setStartTimeUs(uint32_t startTimeUs)
+    {
+        _startTimeUs = startTimeUs;
+        _startTimeValid = true;
+    }
+
+public:
+    // The fields read on every step generation tick come first so they share the first cache line - the fields
+    // only read when a block starts or ends follow
+
+    // Flags
+    struct
+    {
+        // Flag indicating the block is currently executing
+        volatile bool _isExecuting : 1;
+        // Flag indicating the block can start executing
+        volatile bool _canExecute : 1;
+        // Flag indicating the motion tracking index is valid (completion is reported)
+        bool _motionTrackingIndexValid : 1;
+        // Flag indicating the block has a scheduled start time
+        bool _startTimeValid : 1;
+    };
+
+    // Axis with the most steps (this axis sets the step rate)
+    uint8_t _axisIdxWithMaxSteps = 0;
+
+    // Feed override (percent) the rates were prepared with - if the override is then reduced the ramp generator
+    // scales the rates down by the ratio until the block is re-prepared (0 if the block isn't overridden)
+    uint8_t _feedOverridePercent = 0;
+
+    // Input shaping - each ramp is the constant acceleration ramp convolved with the shaper impulses - the level
+    // (sum of the impulse amplitudes in Q16) changes at each impulse time (in acceleration ticks after the first
+    // impulse) - _shaperNumImpulses is 0 if not shaped
+    static constexpr uint32_t SHAPER_LEVEL_Q16_ONE = 65536;
+    uint8_t _shaperNumImpulses = 0;
+
+    // Pressure advance - the advance (steps) of the extruder axis is the step rate (per TTicks) of the axis
+    // with max steps multiplied by the factor (Q32) - the factor is 0 and the axis PA_AXIS_NONE if not advanced
+    static constexpr uint8_t PA_AXIS_NONE = 0xff;
+    uint8_t _paAxisIdx = PA_AXIS_NONE;
+
+    // Steps to target and before deceleration
+    AxesValues<AxisStepsDataType> _stepsTotalMaybeNeg;
+    uint32_t _stepsBeforeDecel = 0;
+
+    // Stepping acceleration/deceleration profile
+    uint32_t _initialStepRatePerTTicks = 0;
+    uint32_t _maxStepRatePerTTicks = 0;
+    uint32_t _finalStepRatePerTTicks = 0;
+    // Acceleration is applied once per acceleration tick (1ms by default - see accelTickUs) so the MS in the
+    // names below is the acceleration tick
+    uint32_t _accStepsPerTTicksPerMS = 0;
+    // Change in acceleration per tick for a jerk-limited (S-curve) profile - 0 for a trapezoidal profile
+    uint32_t _jerkAccStepsPerTTicksPerMS = 0;
+
+    // Input shaping impulse times and levels
+    uint16_t _shaperImpulseTicks[InputShaper::MAX_IMPULSES - 1] = {0};
+    uint16_t _shaperLevelsQ16[InputShaper::MAX_IMPULSES - 1] = {0};
+
+    // Pressure advance factor
+    uint32_t _paFactorQ32 = 0;
+
+    // End-stops to test
+    AxisEndstopChecks _endStopsToCheck;
+
+    // Motion tracking index - to help keep track of motion execution from other processes
+    // like homing
+    uint32_t _motionTrackingIndex = 0;
+
+    // Scheduled start time (shared timebase us) - the block isn't started before this time
+    uint32_t _startTimeUs = 0;
+
+    // Estimated duration (us) of the block as prepared - the pipeline keeps the sum of these as the time of
+    // motion buffered (this is read when the block is removed so it is kept here in internal RAM)
+    uint32_t _estDurationUs = 0;
+};
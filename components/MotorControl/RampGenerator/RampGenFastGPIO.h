@@ -0,0 +1,164 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RampGenFastGPIO
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_attr.h"
+#include "driver/gpio.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include "AxesValues.h"
+
+// Direct GPIO register access for step pins
+// Pins are converted to per-axis set/clear bitmasks at setup time so that the ramp generator ISR
+// can accumulate the step pulses for all axes on a tick and apply them with a single register write
+// Axes which don't have a suitable pin are not handled here and must be stepped via the driver
+class RampGenFastGPIO
+{
+public:
+
+    /// @brief Clear all pin masks
+    void clear()
+    {
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        {
+            for (uint32_t bankIdx = 0; bankIdx < GPIO_NUM_BANKS; bankIdx++)
+                _stepMask[axisIdx][bankIdx] = 0;
+        }
+        _stepAxesMask = 0;
+        for (uint32_t bankIdx = 0; bankIdx < GPIO_NUM_BANKS; bankIdx++)
+            _activeStep[bankIdx] = 0;
+        _activeStepAxes = 0;
+        clearPending();
+    }
+
+    /// @brief Add step pin for an axis
+    /// @param axisIdx Axis index
+    /// @param pin GPIO pin number (step pins are active high)
+    /// @return true if the pin can be driven directly
+    bool addStepPin(uint32_t axisIdx, int pin)
+    {
+        if ((axisIdx >= AXIS_VALUES_MAX_AXES) || !GPIO_IS_VALID_OUTPUT_GPIO(pin))
+            return false;
+        _stepMask[axisIdx][pin / 32] = 1UL << (pin % 32);
+        _stepAxesMask |= 1UL << axisIdx;
+        return true;
+    }
+
+    /// @brief Check if the step pin for an axis is handled here
+    /// @param axisIdx Axis index
+    /// @return true if handled
+    inline bool IRAM_ATTR hasStepPin(uint32_t axisIdx) const
+    {
+        return (_stepAxesMask & (1UL << axisIdx)) != 0;
+    }
+
+    /// @brief Check if any pins are handled
+    /// @return true if any axis has a step pin handled here
+    bool isActive() const
+    {
+        return _stepAxesMask != 0;
+    }
+
+    /// @brief Queue a step for an axis (applied by applySteps())
+    /// @param axisIdx Axis index
+    inline void IRAM_ATTR queueStep(uint32_t axisIdx)
+    {
+        for (uint32_t bankIdx = 0; bankIdx < GPIO_NUM_BANKS; bankIdx++)
+            _pendingSet[bankIdx] |= _stepMask[axisIdx][bankIdx];
+        _pendingStepAxes |= 1UL << axisIdx;
+    }
+
+    /// @brief Start step pulses for all queued axes with one write per bank
+    inline void IRAM_ATTR applySteps()
+    {
+        for (uint32_t bankIdx = 0; bankIdx < GPIO_NUM_BANKS; bankIdx++)
+        {
+            if (_pendingSet[bankIdx])
+            {
+                writeSet(bankIdx, _pendingSet[bankIdx]);
+                _activeStep[bankIdx] = _pendingSet[bankIdx];
+                _pendingSet[bankIdx] = 0;
+            }
+        }
+        _activeStepAxes = _pendingStepAxes;
+        _pendingStepAxes = 0;
+    }
+
+    /// @brief End any active step pulses with one write per bank
+    /// @return bitmask of axes for which a step pulse was ended
+    inline uint32_t IRAM_ATTR endSteps()
+    {
+        uint32_t endedAxes = _activeStepAxes;
+        if (endedAxes == 0)
+            return 0;
+        for (uint32_t bankIdx = 0; bankIdx < GPIO_NUM_BANKS; bankIdx++)
+        {
+            if (_activeStep[bankIdx])
+            {
+                writeClear(bankIdx, _activeStep[bankIdx]);
+                _activeStep[bankIdx] = 0;
+            }
+        }
+        _activeStepAxes = 0;
+        return endedAxes;
+    }
+
+private:
+    // Number of 32-bit GPIO output banks
+#ifdef GPIO_OUT1_W1TS_REG
+    static constexpr uint32_t GPIO_NUM_BANKS = 2;
+#else
+    static constexpr uint32_t GPIO_NUM_BANKS = 1;
+#endif
+
+    // Per-axis pin masks
+    uint32_t _stepMask[AXIS_VALUES_MAX_AXES][GPIO_NUM_BANKS] = {};
+
+    // Bitmask of axes with step pins handled here
+    uint32_t _stepAxesMask = 0;
+
+    // Pending and active masks (only accessed from the pulse generation context)
+    uint32_t _pendingSet[GPIO_NUM_BANKS] = {};
+    uint32_t _activeStep[GPIO_NUM_BANKS] = {};
+    uint32_t _pendingStepAxes = 0;
+    uint32_t _activeStepAxes = 0;
+
+    // Write-1-to-set and write-1-to-clear for a bank (register addresses are immediates so nothing is read from flash in the ISR)
+    static inline void IRAM_ATTR writeSet(uint32_t bankIdx, uint32_t mask)
+    {
+#ifdef GPIO_OUT1_W1TS_REG
+        if (bankIdx != 0)
+        {
+            REG_WRITE(GPIO_OUT1_W1TS_REG, mask);
+            return;
+        }
+#endif
+        REG_WRITE(GPIO_OUT_W1TS_REG, mask);
+    }
+    static inline void IRAM_ATTR writeClear(uint32_t bankIdx, uint32_t mask)
+    {
+#ifdef GPIO_OUT1_W1TC_REG
+        if (bankIdx != 0)
+        {
+            REG_WRITE(GPIO_OUT1_W1TC_REG, mask);
+            return;
+        }
+#endif
+        REG_WRITE(GPIO_OUT_W1TC_REG, mask);
+    }
+
+    // Clear pending masks
+    inline void IRAM_ATTR clearPending()
+    {
+        for (uint32_t bankIdx = 0; bankIdx < GPIO_NUM_BANKS; bankIdx++)
+            _pendingSet[bankIdx] = 0;
+        _pendingStepAxes = 0;
+    }
+};
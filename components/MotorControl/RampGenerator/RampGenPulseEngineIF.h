@@ -0,0 +1,76 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RampGenPulseEngineIF
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "RaftArduino.h"
+
+// Interface to a hardware pulse engine - the ramp generator computes step times for a window of time (a chunk)
+// ahead of the output and the engine outputs them with hardware timing
+// - chunks are queued so the output continues while the next chunk is computed
+// - chunks are refilled from loop() unless the engine has its own refill context (e.g. a task woken as each
+//   chunk completes) in which case the refill function is called from there
+// - steps are only added to the axis total steps when they have been output (steps which are discarded by an
+//   abort are not counted)
+class RampGenPulseEngineIF
+{
+public:
+    virtual ~RampGenPulseEngineIF()
+    {
+    }
+
+    // Refill function (fills chunks while there is space)
+    typedef void (*RefillFn)(void* pArg);
+
+    // Start refilling chunks from the engine's own context - returns false if not supported (refill from loop())
+    virtual bool startRefill(RefillFn refillFn, void* pArg)
+    {
+        return false;
+    }
+
+    // Stop refilling from the engine's context (waits for a refill in progress to finish)
+    virtual void stopRefill()
+    {
+    }
+
+    // Request a refill (when refilling from the engine's context)
+    virtual void requestRefill()
+    {
+    }
+
+    // Check if active
+    virtual bool isActive() const = 0;
+
+    // Check if the engine outputs the direction (otherwise the direction is set by the ramp generator through
+    // the stepper drivers and can only change when the engine is idle)
+    virtual bool outputsDirection() const
+    {
+        return false;
+    }
+
+    // Chunk handling - steps are added (in time order) between beginChunk() and endChunk()
+    virtual bool canQueueChunk() const = 0;
+    virtual bool isIdle() const = 0;
+    virtual uint32_t getChunkDurationNs() const = 0;
+    virtual void beginChunk() = 0;
+    virtual void setStepTimeNs(uint64_t stepTimeNs) = 0;
+    virtual void addStep(uint32_t axisIdx, int32_t stepInc) = 0;
+    virtual bool endChunk(uint64_t chunkDurationNs) = 0;
+
+    // Output anything held back waiting for more steps (called when there are no more steps to add)
+    virtual void flush()
+    {
+    }
+
+    // Abort all queued chunks (steps which have not been output are not counted)
+    virtual void abort() = 0;
+
+    // Debug
+    virtual String getDebugJSON(bool includeBraces) const = 0;
+};
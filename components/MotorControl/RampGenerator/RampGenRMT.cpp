@@ -0,0 +1,576 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RampGenRMT
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RampGenRMT.h"
+#include "Logger.h"
+#include "RaftUtils.h"
+#include "esp_timer.h"
+
+// #define DEBUG_RMT_CHUNKS
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Constructor
+RampGenRMT::RampGenRMT() :
+        _chunkSlotPosn(0)
+{
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        _axisToChannel[axisIdx] = -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Destructor
+RampGenRMT::~RampGenRMT()
+{
+    teardown();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup
+/// @param config Configuration (ramp generator config)
+/// @param stepPins Step pin for each axis (-1 if not driven)
+/// @param minStepIntervalNs Shortest time between steps on an axis
+/// @param maxStepIntervalNs Longest time between steps on an axis (a chunk can extend to the next step)
+/// @param pAxisTotalSteps Axis total steps to update as chunks complete
+/// @return true if successful
+bool RampGenRMT::setup(const RaftJsonIF& config, const std::vector<int>& stepPins, uint32_t minStepIntervalNs,
+            uint32_t maxStepIntervalNs, volatile int32_t* pAxisTotalSteps)
+{
+    // Teardown first
+    teardown();
+
+    // Config
+    _resolutionHz = config.getLong("rmtResHz", RMT_RESOLUTION_HZ_DEFAULT);
+    uint32_t pulseNs = config.getLong("rmtPulseNs", RMT_PULSE_NS_DEFAULT);
+    _pulseTicks = UTILS_MAX(1, uint32_t((uint64_t(pulseNs) * _resolutionHz) / 1000000000ULL));
+    _chunkDurationNs = config.getLong("rmtChunkMs", RMT_CHUNK_MS_DEFAULT) * 1000000;
+    uint32_t queueDepth = config.getLong("rmtQueueDepth", RMT_CHUNK_QUEUE_DEPTH_DEFAULT);
+    if (queueDepth < 2)
+        queueDepth = 2;
+    _taskCore = config.getLong("rmtTaskCore", RMT_TASK_CORE_DEFAULT);
+    _taskPriority = config.getLong("rmtTaskPriority", RMT_TASK_PRIORITY_DEFAULT);
+    _taskStackSize = config.getLong("rmtTaskStack", RMT_TASK_STACK_SIZE_DEFAULT);
+    _pAxisTotalSteps = pAxisTotalSteps;
+
+    // Create a channel for each axis with a step pin (the channels are not moved after this as each channel is
+    // the argument of its callback)
+    _channels.reserve(AXIS_VALUES_MAX_AXES);
+    for (uint32_t axisIdx = 0; (axisIdx < stepPins.size()) && (axisIdx < AXIS_VALUES_MAX_AXES); axisIdx++)
+    {
+        if (stepPins[axisIdx] < 0)
+            continue;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+        rmt_tx_channel_config_t channelConfig = {
+            .gpio_num = (gpio_num_t)stepPins[axisIdx],
+            .clk_src = RMT_CLK_SRC_DEFAULT,
+            .resolution_hz = _resolutionHz,
+            .mem_block_symbols = RMT_MEM_BLOCK_SYMBOLS,
+            .trans_queue_depth = queueDepth,
+        };
+#pragma GCC diagnostic pop
+        AxisChannel axisChannel;
+        axisChannel.axisIdx = axisIdx;
+        axisChannel.pOwner = this;
+        if (rmt_new_tx_channel(&channelConfig, &axisChannel.handle) != ESP_OK)
+        {
+            LOG_E(MODULE_PREFIX, "setup failed to create channel for axis %d pin %d", axisIdx, stepPins[axisIdx]);
+            teardown();
+            return false;
+        }
+        _axisToChannel[axisIdx] = _channels.size();
+        _channels.push_back(axisChannel);
+    }
+    if (_channels.size() == 0)
+    {
+        LOG_W(MODULE_PREFIX, "setup no step pins");
+        return false;
+    }
+
+    // Encoder (symbols are generated in software so just copy them)
+    rmt_copy_encoder_config_t encoderConfig = {};
+    if (rmt_new_copy_encoder(&encoderConfig, &_copyEncoder) != ESP_OK)
+    {
+        LOG_E(MODULE_PREFIX, "setup failed to create encoder");
+        teardown();
+        return false;
+    }
+
+    // Completion callback on each channel - a chunk has been sent when it is complete on all channels
+    rmt_tx_event_callbacks_t txCallbacks = {
+        .on_trans_done = _staticTxDoneCB,
+    };
+    for (AxisChannel& axisChannel : _channels)
+        rmt_tx_register_event_callbacks(axisChannel.handle, &txCallbacks, &axisChannel);
+
+    // Enable channels
+    std::vector<rmt_channel_handle_t> channelHandles;
+    for (AxisChannel& axisChannel : _channels)
+    {
+        rmt_enable(axisChannel.handle);
+        channelHandles.push_back(axisChannel.handle);
+    }
+
+    // Sync manager so that chunks start at the same time on all channels
+    if (_channels.size() > 1)
+    {
+        rmt_sync_manager_config_t syncConfig = {
+            .tx_channel_array = channelHandles.data(),
+            .array_size = channelHandles.size(),
+        };
+        if (rmt_new_sync_manager(&syncConfig, &_syncManager) != ESP_OK)
+        {
+            LOG_E(MODULE_PREFIX, "setup failed to create sync manager");
+            teardown();
+            return false;
+        }
+    }
+
+    // Chunk slots - sized for steps at the maximum rate for the whole chunk and for the symbols needed for those
+    // steps (a pulse and the low time before it) and for low time up to the longest chunk
+    uint32_t maxStepsInChunk = _chunkDurationNs / UTILS_MAX(minStepIntervalNs, 1) + 2;
+    uint64_t maxChunkTicks = ((uint64_t(_chunkDurationNs) + maxStepIntervalNs) * _resolutionHz) / 1000000000ULL;
+    uint32_t maxSymbolsInChunk = 2 * maxStepsInChunk + maxChunkTicks / (2 * RMT_MAX_SYMBOL_DURATION - 1) + 2;
+    _chunkSlots.resize(queueDepth);
+    for (ChunkSlot& chunkSlot : _chunkSlots)
+    {
+        chunkSlot.channelChunks.resize(_channels.size());
+        for (ChannelChunk& channelChunk : chunkSlot.channelChunks)
+        {
+            channelChunk.stepTimesTicks.resize(maxStepsInChunk);
+            channelChunk.symbols.resize(maxSymbolsInChunk);
+        }
+    }
+    _chunkSlotPosn.init(_chunkSlots.size());
+    _chunksRetired = 0;
+    _isSetup = true;
+
+    // Debug
+    LOG_I(MODULE_PREFIX, "setup ok channels %d resolution %dHz pulse %dns chunk %dms queueDepth %d maxSteps %d maxSymbols %d",
+                (int)_channels.size(), _resolutionHz, pulseNs, _chunkDurationNs / 1000000, queueDepth,
+                maxStepsInChunk, maxSymbolsInChunk);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Teardown
+void RampGenRMT::teardown()
+{
+    stopRefill();
+    _isSetup = false;
+    if (_syncManager)
+        rmt_del_sync_manager(_syncManager);
+    _syncManager = nullptr;
+    for (AxisChannel& axisChannel : _channels)
+    {
+        if (!axisChannel.handle)
+            continue;
+        rmt_disable(axisChannel.handle);
+        rmt_del_channel(axisChannel.handle);
+    }
+    _channels.clear();
+    if (_copyEncoder)
+        rmt_del_encoder(_copyEncoder);
+    _copyEncoder = nullptr;
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        _axisToChannel[axisIdx] = -1;
+    _chunkSlots.clear();
+    _chunkSlotPosn.init(0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Begin a chunk
+/// @note canQueueChunk() must be true
+void RampGenRMT::beginChunk()
+{
+    ChunkSlot& chunkSlot = _chunkSlots[_chunkSlotPosn.putIdx()];
+    for (ChannelChunk& channelChunk : chunkSlot.channelChunks)
+    {
+        channelChunk.numSteps = 0;
+        channelChunk.numSymbols = 0;
+    }
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        chunkSlot.stepsInc[axisIdx] = 0;
+    _stepTimeNs = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add a step at the current step time
+/// @param axisIdx Axis index
+/// @param stepInc Step increment (+1 or -1 depending on direction)
+/// @note A step which doesn't fit in the chunk (only possible above the maximum step rate) is not output or counted
+void RampGenRMT::addStep(uint32_t axisIdx, int32_t stepInc)
+{
+    if ((axisIdx >= AXIS_VALUES_MAX_AXES) || (_axisToChannel[axisIdx] < 0))
+        return;
+    ChunkSlot& chunkSlot = _chunkSlots[_chunkSlotPosn.putIdx()];
+    ChannelChunk& channelChunk = chunkSlot.channelChunks[_axisToChannel[axisIdx]];
+    if (channelChunk.numSteps >= channelChunk.stepTimesTicks.size())
+    {
+        _stepsOverflowed++;
+        return;
+    }
+    channelChunk.stepTimesTicks[channelChunk.numSteps++] = uint32_t((_stepTimeNs * _resolutionHz) / 1000000000ULL);
+    chunkSlot.stepsInc[axisIdx] += stepInc;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief End a chunk - encode and transmit on all channels
+/// @param chunkDurationNs Duration of the chunk (time from start to the first step of the next chunk)
+/// @return true if transmitted
+bool RampGenRMT::endChunk(uint64_t chunkDurationNs)
+{
+    // Encode each channel
+    ChunkSlot& chunkSlot = _chunkSlots[_chunkSlotPosn.putIdx()];
+    uint32_t chunkTicks = uint32_t((chunkDurationNs * _resolutionHz) / 1000000000ULL);
+    for (ChannelChunk& channelChunk : chunkSlot.channelChunks)
+    {
+        encodeChannel(channelChunk, chunkTicks);
+        if (channelChunk.numSymbols > _maxSymbolsInChunk)
+            _maxSymbolsInChunk = channelChunk.numSymbols;
+    }
+
+    // Slot is committed before transmitting so the completion callback sees it - if no chunk is being sent then
+    // this one starts now (otherwise it starts when the previous one completes)
+    bool wasIdle = !_chunkSlotPosn.canGet();
+    _chunkSlotPosn.hasPut();
+
+    // Transmit (the sync manager starts all channels together)
+    rmt_transmit_config_t transmitConfig = {};
+    bool transmitOk = true;
+    for (uint32_t chanIdx = 0; chanIdx < _channels.size(); chanIdx++)
+    {
+        const ChannelChunk& channelChunk = chunkSlot.channelChunks[chanIdx];
+        if (rmt_transmit(_channels[chanIdx].handle, _copyEncoder, channelChunk.symbols.data(),
+                    channelChunk.numSymbols * sizeof(rmt_symbol_word_t), &transmitConfig) != ESP_OK)
+            transmitOk = false;
+    }
+    if (wasIdle)
+        _curChunkStartUs = esp_timer_get_time();
+    _chunksSent++;
+
+#ifdef DEBUG_RMT_CHUNKS
+    LOG_I(MODULE_PREFIX, "endChunk %s ticks %d symbols[0] %d steps[0] %d",
+                transmitOk ? "OK" : "FAILED", chunkTicks, chunkSlot.channelChunks[0].numSymbols,
+                chunkSlot.channelChunks[0].numSteps);
+#endif
+    return transmitOk;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start the refill task
+/// @param refillFn Function which fills chunks (called in the task's context)
+/// @param pArg Argument for the refill function
+/// @return true if the task is running
+bool RampGenRMT::startRefill(RefillFn refillFn, void* pArg)
+{
+    // Stop any existing task
+    stopRefill();
+    if (!_isSetup || !refillFn)
+        return false;
+
+    // Start the task
+    _refillFn = refillFn;
+    _pRefillArg = pArg;
+    _refillStopRequested = false;
+    _refillTaskExited = false;
+    TaskHandle_t taskHandle = nullptr;
+    BaseType_t retc = xTaskCreatePinnedToCore(refillTaskFn, "RampGenRMT", _taskStackSize, this, _taskPriority,
+                &taskHandle, _taskCore < 0 ? tskNO_AFFINITY : _taskCore);
+    if (retc != pdPASS)
+    {
+        LOG_E(MODULE_PREFIX, "startRefill failed to start task (stack %d) retc %d", _taskStackSize, retc);
+        return false;
+    }
+    _refillTaskHandle = taskHandle;
+    LOG_I(MODULE_PREFIX, "startRefill core %d priority %d stack %d", _taskCore, _taskPriority, _taskStackSize);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Stop the refill task (waits for it to exit)
+void RampGenRMT::stopRefill()
+{
+    if (!_refillTaskHandle)
+        return;
+    _refillStopRequested = true;
+    requestRefill();
+    uint32_t startMs = millis();
+    while (!_refillTaskExited && !Raft::isTimeout(millis(), startMs, RMT_TASK_STOP_TIMEOUT_MS))
+        vTaskDelay(1);
+    if (!_refillTaskExited)
+        LOG_W(MODULE_PREFIX, "stopRefill task did not exit");
+    _refillTaskHandle = nullptr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Request a refill (wakes the refill task)
+void RampGenRMT::requestRefill()
+{
+    TaskHandle_t taskHandle = _refillTaskHandle;
+    if (taskHandle)
+        xTaskNotifyGive(taskHandle);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Refill task function
+/// @param pArg RampGenRMT
+/// @note The task is woken when a chunk completes and when a refill is requested - it also runs periodically
+void RampGenRMT::refillTaskFn(void* pArg)
+{
+    RampGenRMT* pEngine = (RampGenRMT*)pArg;
+    while (!pEngine->_refillStopRequested)
+    {
+        ulTaskNotifyTake(pdTRUE, UTILS_MAX(pdMS_TO_TICKS(RMT_TASK_IDLE_WAKE_MS), 1));
+        if (pEngine->_refillStopRequested)
+            break;
+        pEngine->_refillFn(pEngine->_pRefillArg);
+    }
+    pEngine->_refillTaskExited = true;
+    vTaskDelete(nullptr);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Abort all queued chunks
+/// @note Steps of the chunk being sent which were output before the abort are added to the axis total steps (from
+///       the time the chunk started) - steps which were not output are discarded
+void RampGenRMT::abort()
+{
+    if (!_isSetup)
+        return;
+
+    // The steps output are found from the time since the chunk being sent started - so the count is exact
+    // wait until no step is close to now
+    waitClearOfSteps();
+
+    // Disabling a channel stops the output and discards its queued transactions
+    for (AxisChannel& axisChannel : _channels)
+        rmt_disable(axisChannel.handle);
+    int64_t abortUs = esp_timer_get_time();
+
+    // Count the steps output
+    bool isChunkBeingSent = true;
+    while (_chunkSlotPosn.canGet())
+    {
+        ChunkSlot& chunkSlot = _chunkSlots[_chunkSlotPosn.getIdx()];
+        uint64_t outputTicks = 0;
+        if (isChunkBeingSent && (abortUs > _curChunkStartUs))
+            outputTicks = (uint64_t(abortUs - _curChunkStartUs) * _resolutionHz) / 1000000;
+        for (uint32_t chanIdx = 0; chanIdx < _channels.size(); chanIdx++)
+        {
+            // A channel may have completed the chunk before the others
+            const ChannelChunk& channelChunk = chunkSlot.channelChunks[chanIdx];
+            bool chanChunkDone = isChunkBeingSent && (_channels[chanIdx].chunksDone != _chunksRetired);
+            uint32_t stepsOutput = 0;
+            while ((stepsOutput < channelChunk.numSteps) &&
+                        (chanChunkDone || (channelChunk.stepTimesTicks[stepsOutput] < outputTicks)))
+                stepsOutput++;
+            uint32_t axisIdx = _channels[chanIdx].axisIdx;
+            if (_pAxisTotalSteps && (stepsOutput > 0))
+            {
+                int32_t stepsInc = chunkSlot.stepsInc[axisIdx] >= 0 ? int32_t(stepsOutput) : -int32_t(stepsOutput);
+                _pAxisTotalSteps[axisIdx] = _pAxisTotalSteps[axisIdx] + stepsInc;
+            }
+            _stepsAborted += channelChunk.numSteps - stepsOutput;
+        }
+        isChunkBeingSent = false;
+        _chunkSlotPosn.hasGot();
+        _chunksAborted++;
+    }
+
+    // Restart the channels
+    for (AxisChannel& axisChannel : _channels)
+    {
+        axisChannel.chunksDone = 0;
+        rmt_enable(axisChannel.handle);
+    }
+    _chunksRetired = 0;
+    if (_syncManager)
+        rmt_sync_reset(_syncManager);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Wait until no step of the chunk being sent is within the guard time of now
+/// @note The time the chunk started is only known to the nearest us (and is late by the completion interrupt
+///       latency) so a step close to now may or may not have been output - the wait is at most a few guard times
+void RampGenRMT::waitClearOfSteps() const
+{
+    uint64_t guardTicks = (uint64_t(RMT_ABORT_GUARD_US) * _resolutionHz) / 1000000;
+    for (uint32_t waitIdx = 0; waitIdx < RMT_ABORT_MAX_WAITS; waitIdx++)
+    {
+        int64_t elapsedUs = esp_timer_get_time() - _curChunkStartUs;
+        if (!_chunkSlotPosn.canGet() || (elapsedUs < 0))
+            return;
+        uint64_t elapsedTicks = (uint64_t(elapsedUs) * _resolutionHz) / 1000000;
+
+        // Find the latest step within the guard time of now on any channel
+        const ChunkSlot& chunkSlot = _chunkSlots[_chunkSlotPosn.getIdx()];
+        uint64_t clearTicks = 0;
+        for (const ChannelChunk& channelChunk : chunkSlot.channelChunks)
+        {
+            for (uint32_t stepIdx = 0; stepIdx < channelChunk.numSteps; stepIdx++)
+            {
+                uint64_t stepTicks = channelChunk.stepTimesTicks[stepIdx];
+                if (stepTicks > elapsedTicks + guardTicks)
+                    break;
+                if (stepTicks + guardTicks >= elapsedTicks)
+                    clearTicks = UTILS_MAX(clearTicks, stepTicks + guardTicks + 1);
+            }
+        }
+        if (clearTicks == 0)
+            return;
+        delayMicroseconds(((clearTicks - elapsedTicks) * 1000000 + _resolutionHz - 1) / _resolutionHz);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Encode the step times for a channel into RMT symbols
+/// @param channelChunk Channel chunk (step times in RMT ticks from the start of the chunk) - symbols are set
+/// @param chunkTicks Chunk duration in RMT ticks
+void RampGenRMT::encodeChannel(ChannelChunk& channelChunk, uint32_t chunkTicks) const
+{
+    channelChunk.numSymbols = 0;
+    uint32_t curTicks = 0;
+    for (uint32_t stepIdx = 0; stepIdx < channelChunk.numSteps; stepIdx++)
+    {
+        // Low until the step - the pulse starts when the low time output ends (a tick early if a single tick
+        // couldn't be output) and the interval to the next step is from then so there is no drift
+        if (channelChunk.stepTimesTicks[stepIdx] > curTicks)
+            curTicks += addLowSymbols(channelChunk.stepTimesTicks[stepIdx] - curTicks, channelChunk);
+        uint32_t stepTicks = curTicks;
+
+        // Pulse - high for the pulse width (limited to half the step interval) then low for the rest of the interval
+        uint32_t nextTicks = (stepIdx + 1 < channelChunk.numSteps) ? channelChunk.stepTimesTicks[stepIdx + 1] : chunkTicks;
+        uint32_t intervalTicks = UTILS_MAX(nextTicks, stepTicks + 2) - stepTicks;
+        uint32_t highTicks = UTILS_MIN(_pulseTicks, intervalTicks / 2);
+        uint32_t lowTicks = UTILS_MIN(intervalTicks - highTicks, RMT_MAX_SYMBOL_DURATION);
+        if (channelChunk.numSymbols >= channelChunk.symbols.size())
+            break;
+        rmt_symbol_word_t& symbol = channelChunk.symbols[channelChunk.numSymbols++];
+        symbol.level0 = 1;
+        symbol.duration0 = highTicks;
+        symbol.level1 = 0;
+        symbol.duration1 = lowTicks;
+        curTicks = stepTicks + highTicks + lowTicks;
+    }
+
+    // Low for the remainder of the chunk
+    if (chunkTicks > curTicks)
+        addLowSymbols(chunkTicks - curTicks, channelChunk);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add symbols holding the output low
+/// @param lowTicks Number of RMT ticks
+/// @param channelChunk (in/out) Channel chunk to add symbols to
+/// @return Number of ticks added
+/// @note A zero duration marks the end of a transmission so a symbol is at least two ticks - the ticks are split so
+///       that a single tick isn't left over and a single tick on its own is added to the low time of the previous
+///       symbol - if there is no previous symbol it isn't added (and the caller carries it)
+uint32_t RampGenRMT::addLowSymbols(uint32_t lowTicks, ChannelChunk& channelChunk) const
+{
+    uint32_t ticksLeft = lowTicks;
+    while ((ticksLeft >= 2) && (channelChunk.numSymbols < channelChunk.symbols.size()))
+    {
+        uint32_t symbolTicks = UTILS_MIN(ticksLeft, 2 * RMT_MAX_SYMBOL_DURATION);
+        if (ticksLeft - symbolTicks == 1)
+            symbolTicks--;
+        rmt_symbol_word_t& symbol = channelChunk.symbols[channelChunk.numSymbols++];
+        symbol.level0 = 0;
+        symbol.duration0 = symbolTicks / 2;
+        symbol.level1 = 0;
+        symbol.duration1 = symbolTicks - symbolTicks / 2;
+        ticksLeft -= symbolTicks;
+    }
+    if ((ticksLeft == 1) && (channelChunk.numSymbols > 0))
+    {
+        rmt_symbol_word_t& prevSymbol = channelChunk.symbols[channelChunk.numSymbols - 1];
+        if (prevSymbol.duration1 < RMT_MAX_SYMBOL_DURATION)
+        {
+            prevSymbol.duration1 = prevSymbol.duration1 + 1;
+            ticksLeft = 0;
+        }
+        else if (channelChunk.numSymbols < channelChunk.symbols.size())
+        {
+            // Previous symbol is full so a tick is moved from it to make a two tick symbol
+            prevSymbol.duration1 = prevSymbol.duration1 - 1;
+            rmt_symbol_word_t& symbol = channelChunk.symbols[channelChunk.numSymbols++];
+            symbol.level0 = 0;
+            symbol.duration0 = 1;
+            symbol.level1 = 0;
+            symbol.duration1 = 1;
+            ticksLeft = 0;
+        }
+    }
+    return lowTicks - ticksLeft;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Transmit done callback (ISR)
+/// @return true if a higher priority task has been woken
+bool IRAM_ATTR RampGenRMT::_staticTxDoneCB(rmt_channel_handle_t txChan, const rmt_tx_done_event_data_t* eventData, void* arg)
+{
+    AxisChannel* pAxisChannel = (AxisChannel*)arg;
+    if (pAxisChannel && pAxisChannel->pOwner)
+        return pAxisChannel->pOwner->_nonStaticTxDoneCB(*pAxisChannel);
+    return false;
+}
+
+bool IRAM_ATTR RampGenRMT::_nonStaticTxDoneCB(AxisChannel& axisChannel)
+{
+    // Count the chunk sent on this channel - chunks are complete when sent on all channels
+    axisChannel.chunksDone = axisChannel.chunksDone + 1;
+    uint32_t minChunksDone = axisChannel.chunksDone;
+    for (const AxisChannel& otherChannel : _channels)
+    {
+        if (int32_t(otherChannel.chunksDone - minChunksDone) < 0)
+            minChunksDone = otherChannel.chunksDone;
+    }
+    bool chunkRetired = false;
+    while ((int32_t(minChunksDone - _chunksRetired) > 0) && _chunkSlotPosn.canGet())
+    {
+        ChunkSlot& chunkSlot = _chunkSlots[_chunkSlotPosn.getIdx()];
+        if (_pAxisTotalSteps)
+        {
+            for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+                _pAxisTotalSteps[axisIdx] = _pAxisTotalSteps[axisIdx] + chunkSlot.stepsInc[axisIdx];
+        }
+        _chunkSlotPosn.hasGot();
+        _chunksRetired = _chunksRetired + 1;
+        chunkRetired = true;
+    }
+    if (!chunkRetired)
+        return false;
+
+    // The next chunk (if queued) starts now - wake the refill task
+    _curChunkStartUs = esp_timer_get_time();
+    TaskHandle_t taskHandle = _refillTaskHandle;
+    if (!taskHandle)
+        return false;
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(taskHandle, &higherPriorityTaskWoken);
+    return higherPriorityTaskWoken == pdTRUE;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON
+/// @param includeBraces Include braces
+/// @return JSON string
+String RampGenRMT::getDebugJSON(bool includeBraces) const
+{
+    String jsonStr = "\"rmtCh\":" + String(_channels.size()) +
+                ",\"rmtSent\":" + String(_chunksSent) +
+                ",\"rmtAbort\":" + String(_chunksAborted) +
+                ",\"rmtAbortSteps\":" + String(_stepsAborted) +
+                ",\"rmtOvf\":" + String(_stepsOverflowed) +
+                ",\"rmtQ\":" + String(_chunkSlotPosn.count()) +
+                ",\"rmtMaxSym\":" + String(_maxSymbolsInChunk) +
+                ",\"rmtTask\":" + String(_refillTaskHandle ? 1 : 0);
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
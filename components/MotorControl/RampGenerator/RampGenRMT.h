@@ -0,0 +1,175 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RampGenRMT
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "RaftArduino.h"
+#include "RaftJsonIF.h"
+#include "driver/rmt_tx.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "AxesValues.h"
+#include "MotionRingBuffer.h"
+#include "RampGenPulseEngineIF.h"
+
+// Hardware step pulse engine using the RMT peripheral
+// The ramp generator computes step times for a window of time (a chunk) and this class converts them
+// into RMT symbols (one channel per axis) which are transmitted in sync on all channels
+// Step timing is therefore done by hardware and the CPU only has to refill chunks
+// - a chunk is complete when all channels have sent it - the refill task (if started) is then woken to refill
+//   (rmt_transmit() can't be called from the transmit done ISR)
+// - buffers for the step times and symbols of each chunk are allocated in setup() (sized for the maximum step
+//   rate) so no allocation is done while running
+
+class RampGenRMT : public RampGenPulseEngineIF
+{
+public:
+    RampGenRMT();
+    virtual ~RampGenRMT();
+
+    // Setup - one entry in stepPins per axis (-1 if axis not driven) - the step interval limits are used to size
+    // the chunk buffers
+    bool setup(const RaftJsonIF& config, const std::vector<int>& stepPins, uint32_t minStepIntervalNs,
+                uint32_t maxStepIntervalNs, volatile int32_t* pAxisTotalSteps);
+    void teardown();
+
+    // Check if active
+    virtual bool isActive() const override final
+    {
+        return _isSetup;
+    }
+
+    // Chunk handling
+    virtual bool canQueueChunk() const override final
+    {
+        return _chunkSlotPosn.canPut();
+    }
+    virtual bool isIdle() const override final
+    {
+        return !_chunkSlotPosn.canGet();
+    }
+    virtual uint32_t getChunkDurationNs() const override final
+    {
+        return _chunkDurationNs;
+    }
+    virtual void beginChunk() override final;
+    virtual void setStepTimeNs(uint64_t stepTimeNs) override final
+    {
+        _stepTimeNs = stepTimeNs;
+    }
+    virtual void addStep(uint32_t axisIdx, int32_t stepInc) override final;
+    virtual bool endChunk(uint64_t chunkDurationNs) override final;
+
+    // Refill task
+    virtual bool startRefill(RefillFn refillFn, void* pArg) override final;
+    virtual void stopRefill() override final;
+    virtual void requestRefill() override final;
+
+    // Abort all queued chunks - steps of the chunk being sent which were output before the abort are counted
+    virtual void abort() override final;
+
+    // Debug
+    virtual String getDebugJSON(bool includeBraces) const override final;
+
+private:
+    // Setup flag
+    bool _isSetup = false;
+
+    // Config
+    uint32_t _resolutionHz = RMT_RESOLUTION_HZ_DEFAULT;
+    uint32_t _pulseTicks = 0;
+    uint32_t _chunkDurationNs = 0;
+    int _taskCore = RMT_TASK_CORE_DEFAULT;
+    uint32_t _taskPriority = RMT_TASK_PRIORITY_DEFAULT;
+    uint32_t _taskStackSize = RMT_TASK_STACK_SIZE_DEFAULT;
+
+    // Channels (one per axis which has a valid step pin) - each counts the chunks it has sent (in its transmit
+    // done callback)
+    struct AxisChannel
+    {
+        rmt_channel_handle_t handle = nullptr;
+        uint32_t axisIdx = 0;
+        RampGenRMT* pOwner = nullptr;
+        volatile uint32_t chunksDone = 0;
+    };
+    std::vector<AxisChannel> _channels;
+    int _axisToChannel[AXIS_VALUES_MAX_AXES] = {};
+    rmt_encoder_handle_t _copyEncoder = nullptr;
+    rmt_sync_manager_handle_t _syncManager = nullptr;
+
+    // Chunk of a channel - step times and symbols are preallocated (numSteps and numSymbols are the number used)
+    struct ChannelChunk
+    {
+        std::vector<uint32_t> stepTimesTicks;
+        uint32_t numSteps = 0;
+        std::vector<rmt_symbol_word_t> symbols;
+        uint32_t numSymbols = 0;
+    };
+
+    // Chunk slots - each slot holds the chunk for each channel and must remain valid until transmitted
+    struct ChunkSlot
+    {
+        std::vector<ChannelChunk> channelChunks;
+        int32_t stepsInc[AXIS_VALUES_MAX_AXES] = {};
+    };
+    std::vector<ChunkSlot> _chunkSlots;
+    MotionRingBufferPosn _chunkSlotPosn;
+
+    // Number of chunks which have been sent on all channels (since the last abort) and the time the chunk
+    // being sent started
+    volatile uint32_t _chunksRetired = 0;
+    volatile int64_t _curChunkStartUs = 0;
+
+    // Step time for steps currently being added
+    uint64_t _stepTimeNs = 0;
+
+    // Axis total steps (updated when a chunk has been transmitted)
+    volatile int32_t* _pAxisTotalSteps = nullptr;
+
+    // Refill task
+    TaskHandle_t _refillTaskHandle = nullptr;
+    volatile bool _refillStopRequested = false;
+    volatile bool _refillTaskExited = false;
+    RefillFn _refillFn = nullptr;
+    void* _pRefillArg = nullptr;
+
+    // Stats
+    uint32_t _chunksSent = 0;
+    uint32_t _chunksAborted = 0;
+    uint32_t _stepsAborted = 0;
+    uint32_t _stepsOverflowed = 0;
+    uint32_t _maxSymbolsInChunk = 0;
+
+    // Helpers
+    void encodeChannel(ChannelChunk& channelChunk, uint32_t chunkTicks) const;
+    uint32_t addLowSymbols(uint32_t lowTicks, ChannelChunk& channelChunk) const;
+    void waitClearOfSteps() const;
+    static void refillTaskFn(void* pArg);
+    static IRAM_ATTR bool _staticTxDoneCB(rmt_channel_handle_t txChan, const rmt_tx_done_event_data_t* eventData, void* arg);
+    bool IRAM_ATTR _nonStaticTxDoneCB(AxisChannel& axisChannel);
+
+    // Consts
+    static constexpr uint32_t RMT_RESOLUTION_HZ_DEFAULT = 10000000;
+    static constexpr uint32_t RMT_PULSE_NS_DEFAULT = 1000;
+    static constexpr uint32_t RMT_CHUNK_MS_DEFAULT = 5;
+    static constexpr uint32_t RMT_CHUNK_QUEUE_DEPTH_DEFAULT = 4;
+    static constexpr uint32_t RMT_MEM_BLOCK_SYMBOLS = 64;
+    static constexpr uint32_t RMT_MAX_SYMBOL_DURATION = 32767;
+    static constexpr uint32_t RMT_ABORT_GUARD_US = 5;
+    static constexpr uint32_t RMT_ABORT_MAX_WAITS = 10;
+    static constexpr int RMT_TASK_CORE_DEFAULT = 1;
+    static constexpr uint32_t RMT_TASK_PRIORITY_DEFAULT = 10;
+    static constexpr uint32_t RMT_TASK_STACK_SIZE_DEFAULT = 4096;
+    static constexpr uint32_t RMT_TASK_IDLE_WAKE_MS = 1;
+    static constexpr uint32_t RMT_TASK_STOP_TIMEOUT_MS = 200;
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RampGenRMT";
+};
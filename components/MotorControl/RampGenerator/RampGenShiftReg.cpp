@@ -0,0 +1,437 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RampGenShiftReg
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <string.h>
+#include "RampGenShiftReg.h"
+#include "ConfigPinMap.h"
+#include "Logger.h"
+#include "RaftUtils.h"
+#ifdef ESP_PLATFORM
+#include "esp_idf_version.h"
+#endif
+
+// #define DEBUG_SHIFT_REG_BUFFERS
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Constructor
+RampGenShiftReg::RampGenShiftReg() :
+        _bufSlotPosn(0)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Destructor
+RampGenShiftReg::~RampGenShiftReg()
+{
+    teardown();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup
+/// @param config Configuration (ramp generator config)
+/// @param axisOutputs Shift register outputs of each axis
+/// @param pAxisTotalSteps Axis total steps to update as buffers are sent
+/// @return true if successful
+bool RampGenShiftReg::setup(const RaftJsonIF& config, const std::vector<AxisOutputs>& axisOutputs,
+            volatile int32_t* pAxisTotalSteps)
+{
+    // Teardown first
+    teardown();
+
+    // Pins
+    int dataPin = ConfigPinMap::getPinFromName(config.getString("srDataPin", "-1").c_str());
+    int clkPin = ConfigPinMap::getPinFromName(config.getString("srClkPin", "-1").c_str());
+    int latchPin = ConfigPinMap::getPinFromName(config.getString("srLatchPin", "-1").c_str());
+    if ((dataPin < 0) || (clkPin < 0) || (latchPin < 0))
+    {
+        LOG_W(MODULE_PREFIX, "setup pins invalid data %d clk %d latch %d", dataPin, clkPin, latchPin);
+        return false;
+    }
+
+    // Timing - a buffer holds one chunk of samples (limited by the maximum DMA buffer size)
+    uint32_t sampleUs = UTILS_MAX(1, uint32_t(config.getLong("srSampleUs", SR_SAMPLE_US_DEFAULT)));
+    uint32_t chunkUs = config.getLong("srChunkUs", SR_CHUNK_US_DEFAULT);
+    uint32_t queueDepth = UTILS_MAX(2, uint32_t(config.getLong("srQueueDepth", SR_QUEUE_DEPTH_DEFAULT)));
+    _sampleNs = sampleUs * 1000;
+    _bufSamples = UTILS_MIN(UTILS_MAX(chunkUs / sampleUs, SR_BUF_SAMPLES_MIN), SR_DMA_BUF_MAX_BYTES / SR_BYTES_PER_SAMPLE);
+    _pAxisTotalSteps = pAxisTotalSteps;
+
+    // Axis outputs
+    bool anyStepBits = false;
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        _axisOutputs[axisIdx] = axisIdx < axisOutputs.size() ? axisOutputs[axisIdx] : AxisOutputs();
+        if ((_axisOutputs[axisIdx].stepBit > 31) || (_axisOutputs[axisIdx].dirnBit > 31))
+        {
+            LOG_W(MODULE_PREFIX, "setup axis %d bits invalid step %d dirn %d", axisIdx,
+                        _axisOutputs[axisIdx].stepBit, _axisOutputs[axisIdx].dirnBit);
+            _axisOutputs[axisIdx] = AxisOutputs();
+        }
+        _axisDirnSetupSamples[axisIdx] = UTILS_MAX(1, (_axisOutputs[axisIdx].dirSetupNs + _sampleNs - 1) / _sampleNs);
+        if (_axisOutputs[axisIdx].stepBit >= 0)
+            anyStepBits = true;
+    }
+    if (!anyStepBits)
+    {
+        LOG_W(MODULE_PREFIX, "setup no step bits");
+        return false;
+    }
+
+    // I2S channel - DMA buffers for the queue and the buffer being sent (with a spare) - buffers are cleared
+    // once sent (after the sent callback) so the outputs go low when nothing is queued
+    _numDMABufs = queueDepth + 2;
+    i2s_chan_config_t chanConfig = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+    chanConfig.dma_desc_num = _numDMABufs;
+    chanConfig.dma_frame_num = _bufSamples;
+    chanConfig.auto_clear = true;
+    if (i2s_new_channel(&chanConfig, &_txHandle, nullptr) != ESP_OK)
+    {
+        LOG_E(MODULE_PREFIX, "setup failed to create I2S channel");
+        _txHandle = nullptr;
+        return false;
+    }
+
+    // Standard mode with 32 bit slots - the word select rises between the slots of a frame so it latches the
+    // word in the first slot (the same word is in both slots)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+    i2s_std_config_t stdConfig = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(1000000 / sampleUs),
+        .slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT, I2S_SLOT_MODE_STEREO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = (gpio_num_t)clkPin,
+            .ws = (gpio_num_t)latchPin,
+            .dout = (gpio_num_t)dataPin,
+            .din = I2S_GPIO_UNUSED,
+        },
+    };
+#pragma GCC diagnostic pop
+    if (i2s_channel_init_std_mode(_txHandle, &stdConfig) != ESP_OK)
+    {
+        LOG_E(MODULE_PREFIX, "setup failed to init I2S std mode");
+        teardown();
+        return false;
+    }
+
+    // Sent callback is used to track buffers that have been output
+    i2s_event_callbacks_t callbacks = {};
+    callbacks.on_sent = _staticSentCB;
+    i2s_channel_register_event_callback(_txHandle, &callbacks, this);
+    if (i2s_channel_enable(_txHandle) != ESP_OK)
+    {
+        LOG_E(MODULE_PREFIX, "setup failed to enable I2S channel");
+        teardown();
+        return false;
+    }
+
+    // Buffer slots (the queued buffers and the one being filled)
+    _bufSlots.resize(queueDepth + 1);
+    for (BufSlot& bufSlot : _bufSlots)
+        bufSlot.words.resize(_bufSamples * 2);
+    _bufSlotPosn.init(_bufSlots.size());
+    _fillSamples = 0;
+    _chunkEvents.clear();
+    resetOutputState();
+    _isSetup = true;
+
+    // Debug
+    LOG_I(MODULE_PREFIX, "setup ok data %d clk %d latch %d sample %dus bufSamples %d queueDepth %d",
+                dataPin, clkPin, latchPin, sampleUs, _bufSamples, queueDepth);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Teardown
+void RampGenShiftReg::teardown()
+{
+    _isSetup = false;
+    if (_txHandle)
+    {
+        i2s_channel_disable(_txHandle);
+        i2s_del_channel(_txHandle);
+    }
+    _txHandle = nullptr;
+    _bufSlots.clear();
+    _bufSlotPosn.init(0);
+    _fillSamples = 0;
+    _chunkEvents.clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Begin a chunk
+/// @note canQueueChunk() must be true
+void RampGenShiftReg::beginChunk()
+{
+    // When nothing is queued the outputs have gone low so restart from that state
+    if (isIdle() && _chunkEvents.empty())
+        resetOutputState();
+    _stepTimeNs = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add a step at the current step time
+/// @param axisIdx Axis index
+/// @param stepInc Step increment (+1 or -1 depending on direction)
+/// @note The direction output is changed (if required) before the step
+void RampGenShiftReg::addStep(uint32_t axisIdx, int32_t stepInc)
+{
+    if ((axisIdx >= AXIS_VALUES_MAX_AXES) || (_axisOutputs[axisIdx].stepBit < 0))
+        return;
+
+    // Sample for the step - not before the previous pulse of the axis has ended
+    int32_t stepSample = int32_t((_stepTimeNs + _chunkResidualNs) / _sampleNs);
+    int32_t earliestSample = _axisNextStepSample[axisIdx];
+
+    // Direction change - after the previous pulse and the setup time before the step
+    bool dirnPositive = stepInc > 0;
+    if ((_axisOutputs[axisIdx].dirnBit >= 0) && (dirnPositive != _axisDirnPositive[axisIdx]))
+    {
+        int32_t dirnSample = UTILS_MAX(earliestSample - 1, 0);
+        _chunkEvents.push_back({uint32_t(dirnSample), uint8_t(axisIdx), false, int8_t(dirnPositive ? 1 : 0)});
+        _axisDirnPositive[axisIdx] = dirnPositive;
+        earliestSample = UTILS_MAX(earliestSample, int32_t(dirnSample + _axisDirnSetupSamples[axisIdx]));
+    }
+    if (stepSample < earliestSample)
+    {
+        stepSample = earliestSample;
+        _stepsMoved++;
+    }
+
+    // Step (high for one sample and low for at least one)
+    _chunkEvents.push_back({uint32_t(stepSample), uint8_t(axisIdx), true, int8_t(stepInc)});
+    _axisNextStepSample[axisIdx] = stepSample + 2;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief End a chunk - generate the samples and queue any buffers filled
+/// @param chunkDurationNs Duration of the chunk (time from start to the first step of the next chunk)
+/// @return true if all buffers were queued
+bool RampGenShiftReg::endChunk(uint64_t chunkDurationNs)
+{
+    uint32_t writeFailsBefore = _writeFails;
+    uint64_t totalNs = chunkDurationNs + _chunkResidualNs;
+    generateSamples(uint32_t(totalNs / _sampleNs));
+    _chunkResidualNs = uint32_t(totalNs % _sampleNs);
+    return _writeFails == writeFailsBefore;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Queue the buffer being filled (padded with samples without steps)
+/// @note Steps moved beyond the end of the buffer are output by subsequent calls
+void RampGenShiftReg::flush()
+{
+    if (!_isSetup || !_bufSlotPosn.canPut() || ((_fillSamples == 0) && _chunkEvents.empty()))
+        return;
+    generateSamples(_bufSamples - _fillSamples);
+    _chunkResidualNs = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Abort all queued buffers
+void RampGenShiftReg::abort()
+{
+    if (!_isSetup)
+        return;
+
+    // Disabling the channel stops the output - the DMA buffers are then cleared so the outputs go low
+    i2s_channel_disable(_txHandle);
+#ifdef ESP_PLATFORM
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    std::vector<uint32_t> zeroWords(_bufSamples * 2, 0);
+    for (uint32_t bufIdx = 0; bufIdx < _numDMABufs; bufIdx++)
+    {
+        size_t bytesLoaded = 0;
+        i2s_channel_preload_data(_txHandle, zeroWords.data(), zeroWords.size() * sizeof(uint32_t), &bytesLoaded);
+    }
+#endif
+#endif
+    i2s_channel_enable(_txHandle);
+
+    // Discard queued buffers and the chunk being built
+    while (_bufSlotPosn.canGet())
+    {
+        _bufSlotPosn.hasGot();
+        _bufsAborted++;
+    }
+    _sentUnmatched = 0;
+    _fillSamples = 0;
+    _chunkEvents.clear();
+    resetOutputState();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Reset the output state to match the outputs when nothing is queued (all low)
+void RampGenShiftReg::resetOutputState()
+{
+    _dirnWord = 0;
+    _chunkResidualNs = 0;
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        // A low direction output is the positive direction if the direction is inverted
+        _axisDirnPositive[axisIdx] = _axisOutputs[axisIdx].invDirn;
+        _axisNextStepSample[axisIdx] = 1;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Generate samples from the chunk events
+/// @param numSamples Number of samples
+/// @note Events beyond the samples generated are carried forward (with sample numbers adjusted)
+void RampGenShiftReg::generateSamples(uint32_t numSamples)
+{
+    // Events in sample order (the order of events in the same sample is kept so a direction change stays
+    // ahead of its step)
+    std::stable_sort(_chunkEvents.begin(), _chunkEvents.end(),
+                [](const OutputEvent& a, const OutputEvent& b) { return a.sample < b.sample; });
+
+    // Generate
+    uint32_t eventIdx = 0;
+    uint32_t sampleIdx = 0;
+    for (; sampleIdx < numSamples; sampleIdx++)
+    {
+        if (!_bufSlotPosn.canPut())
+            break;
+        uint32_t stepWord = 0;
+        while ((eventIdx < _chunkEvents.size()) && (_chunkEvents[eventIdx].sample == sampleIdx))
+        {
+            const OutputEvent& event = _chunkEvents[eventIdx++];
+            const AxisOutputs& axisOutputs = _axisOutputs[event.axisIdx];
+            if (event.isStep)
+            {
+                stepWord |= 1u << axisOutputs.stepBit;
+                _bufSlots[_bufSlotPosn.putIdx()].stepsInc[event.axisIdx] += event.value;
+            }
+            else
+            {
+                uint32_t dirnMask = 1u << axisOutputs.dirnBit;
+                if ((event.value != 0) != axisOutputs.invDirn)
+                    _dirnWord |= dirnMask;
+                else
+                    _dirnWord &= ~dirnMask;
+            }
+        }
+        addSample(_dirnWord | stepWord);
+    }
+
+    // Carry remaining events forward
+    _chunkEvents.erase(_chunkEvents.begin(), _chunkEvents.begin() + eventIdx);
+    for (OutputEvent& event : _chunkEvents)
+        event.sample -= sampleIdx;
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        _axisNextStepSample[axisIdx] = UTILS_MAX(_axisNextStepSample[axisIdx] - int32_t(sampleIdx), 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add a sample to the buffer being filled (queued when full)
+/// @param word Output word
+void RampGenShiftReg::addSample(uint32_t word)
+{
+    BufSlot& bufSlot = _bufSlots[_bufSlotPosn.putIdx()];
+    bufSlot.words[_fillSamples * 2] = word;
+    bufSlot.words[_fillSamples * 2 + 1] = word;
+    _fillSamples++;
+    if (_fillSamples >= _bufSamples)
+        queueFillBuffer();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Queue the buffer being filled to the I2S peripheral and start filling the next
+/// @note The slot is only committed once its data has been written (a buffer takes a full buffer time to be sent
+///       so the sent callback can't miss it) - if the write fails the slot is refilled and its steps are not counted
+void RampGenShiftReg::queueFillBuffer()
+{
+    BufSlot& bufSlot = _bufSlots[_bufSlotPosn.putIdx()];
+    size_t bytesWritten = 0;
+    size_t bufBytes = bufSlot.words.size() * sizeof(uint32_t);
+    _fillSamples = 0;
+    if ((i2s_channel_write(_txHandle, bufSlot.words.data(), bufBytes, &bytesWritten, 0) != ESP_OK) ||
+                (bytesWritten != bufBytes))
+    {
+        _writeFails++;
+    }
+    else
+    {
+        _bufSlotPosn.hasPut();
+        _bufsSent++;
+    }
+
+    // Clear the step counts of the slot to fill
+    if (_bufSlotPosn.canPut())
+    {
+        BufSlot& nextSlot = _bufSlots[_bufSlotPosn.putIdx()];
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+            nextSlot.stepsInc[axisIdx] = 0;
+    }
+
+#ifdef DEBUG_SHIFT_REG_BUFFERS
+    LOG_I(MODULE_PREFIX, "queueFillBuffer written %d queued %d", bytesWritten, _bufSlotPosn.count());
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Sent callback (ISR)
+/// @note This is called for every DMA buffer sent including the cleared buffers output when nothing is queued
+///       (event data is a pointer to the pointer to the DMA buffer which is cleared after this callback)
+bool IRAM_ATTR RampGenShiftReg::_staticSentCB(i2s_chan_handle_t handle, i2s_event_data_t* event, void* userCtx)
+{
+    if (userCtx)
+    {
+        const uint32_t* pSentWords = (event && event->data) ? *(const uint32_t* const*)event->data : nullptr;
+        ((RampGenShiftReg*)userCtx)->_nonStaticSentCB(pSentWords);
+    }
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Count the steps of the oldest queued slot if the buffer sent holds its data
+/// @param pSentWords Words of the DMA buffer sent (nullptr if not known)
+/// @note Cleared buffers may be output ahead of the first slot queued after an idle period - these don't match
+///       it (a slot which matches a cleared buffer has no steps so counting it early doesn't matter) - a slot not
+///       matched within a cycle of the DMA buffers is counted anyway so the queue can't stall
+void IRAM_ATTR RampGenShiftReg::_nonStaticSentCB(const uint32_t* pSentWords)
+{
+    if (!_bufSlotPosn.canGet())
+    {
+        _sentUnmatched = 0;
+        return;
+    }
+    BufSlot& bufSlot = _bufSlots[_bufSlotPosn.getIdx()];
+    if (pSentWords && (memcmp(pSentWords, bufSlot.words.data(), bufSlot.words.size() * sizeof(uint32_t)) != 0))
+    {
+        _sentUnmatched = _sentUnmatched + 1;
+        if (_sentUnmatched <= _numDMABufs)
+            return;
+        _bufsUnmatched++;
+    }
+    _sentUnmatched = 0;
+    if (_pAxisTotalSteps)
+    {
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+            _pAxisTotalSteps[axisIdx] = _pAxisTotalSteps[axisIdx] + bufSlot.stepsInc[axisIdx];
+    }
+    _bufSlotPosn.hasGot();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON
+/// @param includeBraces Include braces
+/// @return JSON string
+String RampGenShiftReg::getDebugJSON(bool includeBraces) const
+{
+    String jsonStr = "\"srSent\":" + String(_bufsSent) +
+                ",\"srAbort\":" + String(_bufsAborted) +
+                ",\"srQ\":" + String(_bufSlotPosn.count()) +
+                ",\"srFail\":" + String(_writeFails) +
+                ",\"srMoved\":" + String(_stepsMoved) +
+                ",\"srUnmatched\":" + String(_bufsUnmatched);
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
@@ -0,0 +1,174 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RampGenShiftReg
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "RaftArduino.h"
+#include "RaftJsonIF.h"
+#include "esp_attr.h"
+#include "driver/i2s_std.h"
+#include "AxesValues.h"
+#include "MotionRingBuffer.h"
+#include "RampGenPulseEngineIF.h"
+
+// Step and direction outputs on 74HC595-style shift registers driven by the I2S peripheral
+// Each output sample is a 32-bit word (one bit per step or direction output - up to four chained 8-bit registers)
+// which is shifted out by I2S (data to DS and bit clock to SHCP) and latched by the word select (to STCP) so all
+// outputs change together at the sample rate - the number of axes is then limited by the register bits rather than
+// by GPIO pins and the CPU cost doesn't depend on the number of axes
+// - as for the RMT engine the ramp generator computes chunks of step times ahead of the output - these are
+//   converted to samples which are packed into DMA buffers and queued to the I2S peripheral
+// - a step pulse is high for one sample and then low for at least one sample (so the maximum step rate is half the
+//   sample rate) - a step is moved to the next free sample if necessary
+// - a direction output changes after the previous step pulse of the axis (the sample after its rising edge) and
+//   at least the direction setup time before the step which needs it
+// - when there is nothing queued the I2S peripheral outputs zero samples (all outputs low)
+class RampGenShiftReg : public RampGenPulseEngineIF
+{
+public:
+    RampGenShiftReg();
+    virtual ~RampGenShiftReg();
+
+    // Outputs of an axis (bit numbers in the shift register chain - -1 if not used) - bit 0 is the first output
+    // of the register nearest the data pin (the last bit shifted in) and bit 8 the first output of the next register
+    struct AxisOutputs
+    {
+        int stepBit = -1;
+        int dirnBit = -1;
+        bool invDirn = false;
+        uint32_t dirSetupNs = 0;
+    };
+
+    // Setup - one entry in axisOutputs per axis
+    bool setup(const RaftJsonIF& config, const std::vector<AxisOutputs>& axisOutputs,
+                volatile int32_t* pAxisTotalSteps);
+    void teardown();
+
+    // Check if active
+    virtual bool isActive() const override final
+    {
+        return _isSetup;
+    }
+
+    // Direction outputs are part of the sample stream
+    virtual bool outputsDirection() const override final
+    {
+        return true;
+    }
+
+    // Chunk handling
+    virtual bool canQueueChunk() const override final
+    {
+        // The buffer being filled and another (a chunk can span two buffers)
+        return _bufSlotPosn.remaining() >= 2;
+    }
+    virtual bool isIdle() const override final
+    {
+        return !_bufSlotPosn.canGet() && (_fillSamples == 0);
+    }
+    virtual uint32_t getChunkDurationNs() const override final
+    {
+        return _bufSamples * _sampleNs;
+    }
+    virtual void beginChunk() override final;
+    virtual void setStepTimeNs(uint64_t stepTimeNs) override final
+    {
+        _stepTimeNs = stepTimeNs;
+    }
+    virtual void addStep(uint32_t axisIdx, int32_t stepInc) override final;
+    virtual bool endChunk(uint64_t chunkDurationNs) override final;
+
+    // Queue the buffer being filled (padded with samples without steps)
+    virtual void flush() override final;
+
+    // Abort all queued buffers (steps in aborted buffers are not counted)
+    virtual void abort() override final;
+
+    // Debug
+    virtual String getDebugJSON(bool includeBraces) const override final;
+
+private:
+    // Setup flag
+    bool _isSetup = false;
+
+    // I2S channel
+    i2s_chan_handle_t _txHandle = nullptr;
+
+    // Config
+    uint32_t _sampleNs = 0;
+    uint32_t _bufSamples = 0;
+    uint32_t _numDMABufs = 0;
+    AxisOutputs _axisOutputs[AXIS_VALUES_MAX_AXES];
+    uint32_t _axisDirnSetupSamples[AXIS_VALUES_MAX_AXES] = {};
+
+    // Buffer slots - each holds the samples of a DMA buffer (two 32-bit words per sample as the same word is in
+    // both slots of a frame) and the steps in it - the slot at the put position is being filled
+    struct BufSlot
+    {
+        std::vector<uint32_t> words;
+        int32_t stepsInc[AXIS_VALUES_MAX_AXES] = {};
+    };
+    std::vector<BufSlot> _bufSlots;
+    MotionRingBufferPosn _bufSlotPosn;
+    uint32_t _fillSamples = 0;
+
+    // Output events of the chunk being built (sample numbers are from the start of the chunk) - events moved
+    // past the end of a chunk are carried into the next
+    struct OutputEvent
+    {
+        uint32_t sample;
+        uint8_t axisIdx;
+        bool isStep;
+        int8_t value;
+    };
+    std::vector<OutputEvent> _chunkEvents;
+
+    // State while building chunks - chunk boundaries are rounded down to whole samples and the remainder is
+    // carried into the next chunk so the output doesn't drift
+    uint64_t _stepTimeNs = 0;
+    uint32_t _chunkResidualNs = 0;
+    int32_t _axisNextStepSample[AXIS_VALUES_MAX_AXES] = {};
+    bool _axisDirnPositive[AXIS_VALUES_MAX_AXES] = {};
+
+    // Direction outputs at the end of the samples generated
+    uint32_t _dirnWord = 0;
+
+    // Axis total steps (updated when a buffer has been sent)
+    volatile int32_t* _pAxisTotalSteps = nullptr;
+
+    // Stats
+    uint32_t _bufsSent = 0;
+    uint32_t _bufsAborted = 0;
+    uint32_t _writeFails = 0;
+    uint32_t _stepsMoved = 0;
+    uint32_t _bufsUnmatched = 0;
+
+    // Buffers sent since the oldest queued slot was queued which didn't match it (idle buffers output ahead of it)
+    volatile uint32_t _sentUnmatched = 0;
+
+    // Helpers
+    void resetOutputState();
+    void generateSamples(uint32_t numSamples);
+    void addSample(uint32_t word);
+    void queueFillBuffer();
+    static IRAM_ATTR bool _staticSentCB(i2s_chan_handle_t handle, i2s_event_data_t* event, void* userCtx);
+    void IRAM_ATTR _nonStaticSentCB(const uint32_t* pSentWords);
+
+    // Consts
+    static constexpr uint32_t SR_SAMPLE_US_DEFAULT = 4;
+    static constexpr uint32_t SR_CHUNK_US_DEFAULT = 1000;
+    static constexpr uint32_t SR_QUEUE_DEPTH_DEFAULT = 4;
+    static constexpr uint32_t SR_BUF_SAMPLES_MIN = 8;
+    static constexpr uint32_t SR_DMA_BUF_MAX_BYTES = 4092;
+    static constexpr uint32_t SR_BYTES_PER_SAMPLE = 2 * sizeof(uint32_t);
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RampGenShiftReg";
+};
@@ -7,11 +7,16 @@
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
 #include "RampGenStats.h"
+#include "RaftUtils.h"
 
 String RampGenStats::getStatsStr() const
 {
-#ifndef RAMP_GEN_DETAILED_STATS
+#if RAMP_GEN_STATS_LEVEL == 0
+    return "Stats off";
+#elif !defined(RAMP_GEN_DETAILED_STATS)
     char dbg[100];
     sprintf(dbg, "ISR Avg %0.2fus Max %ldus", _isrAvgUs, (unsigned long)_isrMaxUs);
     return dbg;
@@ -35,9 +40,14 @@ String RampGenStats::getStatsStr() const
 String RampGenStats::getJSON(bool includeBraces, bool detailed) const
 {
     String jsonStr = "{";
+#if RAMP_GEN_STATS_LEVEL > 0
     jsonStr += "\"isrAvUs\":" + String(_isrAvgUs, 2) + ",";
     jsonStr += "\"isrMxUs\":" + String(_isrMaxUs) + ",";
     jsonStr += "\"isrAvOk\":" + String(_isrAvgValid ? "1" : "0");
+#ifdef RAMP_GEN_ISR_HISTOGRAM
+    if (detailed)
+        jsonStr += ",\"isrHist\":" + getISRHistogramJSON();
+#endif
 #ifdef RAMP_GEN_DETAILED_STATS
     if (detailed)
     {
@@ -51,6 +61,7 @@ String RampGenStats::getJSON(bool includeBraces, bool detailed) const
         jsonStr += "\"stpPreDec\":" + String(_stepsBeforeDecel) + ",";
         jsonStr += "\"maxStpPTTk\":" + String(_maxStepRatePerTTicks);
     }
+#endif
 #endif
     jsonStr += "}";
     return jsonStr;
@@ -61,14 +72,22 @@ RampGenStats::RampGenStats()
     clear();
 }
 
+void RampGenStats::setup(uint32_t stepGenPeriodNs)
+{
+    _cyclesPerUs = UTILS_MAX(esp_rom_get_cpu_ticks_per_us(), 1);
+    _stepGenPeriodCycles = uint32_t((uint64_t(stepGenPeriodNs) * _cyclesPerUs) / 1000);
+    clear();
+}
+
 void RampGenStats::clear()
 {
-    _isrStartUs = 0;
-    _isrAccUs = 0;
+    _isrStartCycles = 0;
+    _isrAccCycles = 0;
     _isrCount = 0;
     _isrAvgUs = 0;
     _isrAvgValid = false;
     _isrMaxUs = 0;
+    clearISRHistogram();
 #ifdef RAMP_GEN_DETAILED_STATS
     _curAccumulatorStep = 0;
     _curStepRatePerTTicks = 0;
@@ -81,28 +100,86 @@ void RampGenStats::clear()
 #endif
 }
 
-void IRAM_ATTR RampGenStats::startMotionProcessing()
+/// @brief Clear the ISR histogram
+void IRAM_ATTR RampGenStats::clearISRHistogram()
 {
-    _isrStartUs = micros();
+#ifdef RAMP_GEN_ISR_HISTOGRAM
+    for (uint32_t i = 0; i < ISR_HIST_NUM_BUCKETS; i++)
+    {
+        _isrHist.execBuckets[i] = 0;
+        _isrHist.jitterBuckets[i] = 0;
+    }
+    _isrHist.jitterMaxCycles = 0;
+    for (uint32_t i = 0; i < ISR_PATH_COUNT; i++)
+    {
+        _isrHist.pathCounts[i] = 0;
+        _isrHist.pathMaxCycles[i] = 0;
+    }
+    _isrLastEntryValid = false;
+    _isrHistResetPending = false;
+#endif
 }
 
-void IRAM_ATTR RampGenStats::endMotionProcessing()
+#ifdef RAMP_GEN_ISR_HISTOGRAM
+
+/// @brief Start of motion processing (ISR entry)
+/// @param expectedPeriods Number of step generation periods expected since the last entry (0 if not timer driven)
+void IRAM_ATTR RampGenStats::startMotionProcessing(uint32_t expectedPeriods)
 {
-    uint32_t elapsedUs = micros() - _isrStartUs;
-    // LOG_I(MODULE_PREFIX, "Elapsed uS %d", elapsedUs);
-    _isrAccUs += elapsedUs;
+    _isrStartCycles = esp_cpu_get_cycle_count();
+
+    // Handle reset request
+    if (_isrHistResetPending)
+        clearISRHistogram();
+
+    // Timer entry jitter
+    if (_isrLastEntryValid && (expectedPeriods > 0))
+    {
+        uint32_t intervalCycles = _isrStartCycles - _isrLastEntryCycles;
+        uint32_t expectedCycles = expectedPeriods * _stepGenPeriodCycles;
+        uint32_t jitterCycles = intervalCycles > expectedCycles ? intervalCycles - expectedCycles : expectedCycles - intervalCycles;
+        uint32_t bucketIdx = histBucket(jitterCycles);
+        _isrHist.jitterBuckets[bucketIdx] = _isrHist.jitterBuckets[bucketIdx] + 1;
+        if (_isrHist.jitterMaxCycles < jitterCycles)
+            _isrHist.jitterMaxCycles = jitterCycles;
+    }
+    _isrLastEntryCycles = _isrStartCycles;
+    _isrLastEntryValid = expectedPeriods > 0;
+}
+
+/// @brief End of motion processing (ISR exit)
+/// @param path Code path taken
+void IRAM_ATTR RampGenStats::endMotionProcessing(ISRPath path)
+{
+    uint32_t elapsedCycles = esp_cpu_get_cycle_count() - _isrStartCycles;
+    _isrAccCycles += elapsedCycles;
     _isrCount++;
     if (_isrCount > 1000)
     {
-        _isrAvgUs = _isrAccUs * 1.0 / _isrCount;
+        _isrAvgUs = _isrAccCycles * 1.0 / _isrCount / _cyclesPerUs;
         _isrAvgValid = true;
         _isrCount = 0;
-        _isrAccUs = 0;
+        _isrAccCycles = 0;
     }
+    uint32_t elapsedUs = elapsedCycles / _cyclesPerUs;
     if (_isrMaxUs < elapsedUs)
         _isrMaxUs = elapsedUs;
+
+    // Execution time and path
+    uint32_t bucketIdx = histBucket(elapsedCycles);
+    _isrHist.execBuckets[bucketIdx] = _isrHist.execBuckets[bucketIdx] + 1;
+    if (path < ISR_PATH_COUNT)
+    {
+        _isrHist.pathCounts[path] = _isrHist.pathCounts[path] + 1;
+        if (_isrHist.pathMaxCycles[path] < elapsedCycles)
+            _isrHist.pathMaxCycles[path] = elapsedCycles;
+    }
 }
 
+#endif
+
+#ifdef RAMP_GEN_DETAILED_STATS
+
 void IRAM_ATTR RampGenStats::update(uint32_t curAccumulatorStep, 
         uint32_t curStepRatePerTTicks,
         uint32_t curAccumulatorNS,
@@ -112,25 +189,81 @@ void IRAM_ATTR RampGenStats::update(uint32_t curAccumulatorStep,
         uint32_t stepsBeforeDecel,
         uint32_t maxStepRatePerTTicks)
 {
-#ifdef RAMP_GEN_DETAILED_STATS
+    _curAccumulatorStep = curAccumulatorStep;
     _curAccumulatorNS = curAccumulatorNS;
     _curStepRatePerTTicks = curStepRatePerTTicks;
     _axisIdxWithMaxSteps = axisIdxWithMaxSteps;
-    _accStepsPerTTicksPerMS = _accStepsPerTTicksPerMS;
-    _curStepCountMajorAxis = _curStepCountMajorAxis;
+    _accStepsPerTTicksPerMS = accStepsPerTTicksPerMS;
+    _curStepCountMajorAxis = curStepCountMajorAxis;
     _stepsBeforeDecel = stepsBeforeDecel;
     _maxStepRatePerTTicks = maxStepRatePerTTicks;
-#endif
 }
 
-void IRAM_ATTR RampGenStats::stepDirn(uint32_t axisIdx, bool dirnPositive)
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get a snapshot of the ISR histogram
+/// @param histogram (out) Histogram
+/// @note Each count is read individually while the ISR may be running so counts may differ by one or two
+void RampGenStats::getISRHistogram(ISRHistogram& histogram) const
 {
-#ifdef RAMP_GEN_DETAILED_STATS
+#ifdef RAMP_GEN_ISR_HISTOGRAM
+    for (uint32_t i = 0; i < ISR_HIST_NUM_BUCKETS; i++)
+    {
+        histogram.execBuckets[i] = _isrHist.execBuckets[i];
+        histogram.jitterBuckets[i] = _isrHist.jitterBuckets[i];
+    }
+    histogram.jitterMaxCycles = _isrHist.jitterMaxCycles;
+    for (uint32_t i = 0; i < ISR_PATH_COUNT; i++)
+    {
+        histogram.pathCounts[i] = _isrHist.pathCounts[i];
+        histogram.pathMaxCycles[i] = _isrHist.pathMaxCycles[i];
+    }
+#else
+    histogram = ISRHistogram();
 #endif
 }
 
-void IRAM_ATTR RampGenStats::stepStart(uint32_t axisIdx)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the ISR histogram as JSON
+/// @return JSON string - cycPerUs and baseCyc define the buckets, exec and jit are the bucket counts, jitMxUs is
+///         the max jitter and paths has the count and max execution time (us) for each path
+String RampGenStats::getISRHistogramJSON() const
 {
-#ifdef RAMP_GEN_DETAILED_STATS
-#endif
+    ISRHistogram histogram;
+    getISRHistogram(histogram);
+    String jsonStr = "{\"cycPerUs\":" + String(_cyclesPerUs) + ",\"baseCyc\":" + String(ISR_HIST_BASE_CYCLES);
+    jsonStr += ",\"exec\":[";
+    for (uint32_t i = 0; i < ISR_HIST_NUM_BUCKETS; i++)
+        jsonStr += (i == 0 ? "" : ",") + String(histogram.execBuckets[i]);
+    jsonStr += "],\"jit\":[";
+    for (uint32_t i = 0; i < ISR_HIST_NUM_BUCKETS; i++)
+        jsonStr += (i == 0 ? "" : ",") + String(histogram.jitterBuckets[i]);
+    jsonStr += "],\"jitMxUs\":" + String(histogram.jitterMaxCycles * 1.0 / _cyclesPerUs, 2);
+    jsonStr += ",\"paths\":{";
+    for (uint32_t i = 0; i < ISR_PATH_COUNT; i++)
+    {
+        jsonStr += (i == 0 ? "\"" : ",\"") + String(getISRPathName(i)) + "\":[" + String(histogram.pathCounts[i]) + 
+                    "," + String(histogram.pathMaxCycles[i] * 1.0 / _cyclesPerUs, 2) + "]";
+    }
+    jsonStr += "}}";
+    return jsonStr;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get ISR path name
+/// @param path Path
+/// @return Name
+const char* RampGenStats::getISRPathName(uint32_t path)
+{
+    switch (path)
+    {
+        case ISR_PATH_IDLE: return "idle";
+        case ISR_PATH_STEP_END: return "stepEnd";
+        case ISR_PATH_NEW_BLOCK: return "newBlock";
+        case ISR_PATH_END_STOP: return "endStop";
+        case ISR_PATH_MOTION: return "motion";
+        case ISR_PATH_STEP: return "step";
+        default: return "unknown";
+    }
 }
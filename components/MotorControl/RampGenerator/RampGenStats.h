@@ -10,17 +10,79 @@
 
 #include <stdint.h>
 #include "RaftArduino.h"
+#if __has_include("sdkconfig.h")
+#include "sdkconfig.h"
+#endif
 
+// Stats level - set with the RAFT_MOTOR_CONTROL_RAMP_GEN_STATS_LEVEL Kconfig option (or by defining
+// RAMP_GEN_STATS_LEVEL in the build flags)
+//   0 - off - all stats calls in the ISR compile to nothing
+//   1 - counters - ISR execution time (average and max), execution time and jitter histograms and path counts
+//   2 - full - as 1 plus the block state of the most recent ISR call
+#ifndef RAMP_GEN_STATS_LEVEL
+#ifdef CONFIG_RAFT_MOTOR_CONTROL_RAMP_GEN_STATS_LEVEL
+#define RAMP_GEN_STATS_LEVEL CONFIG_RAFT_MOTOR_CONTROL_RAMP_GEN_STATS_LEVEL
+#else
+#define RAMP_GEN_STATS_LEVEL 1
+#endif
+#endif
+#if RAMP_GEN_STATS_LEVEL >= 1
+#define RAMP_GEN_ISR_HISTOGRAM
+#endif
+#if RAMP_GEN_STATS_LEVEL >= 2
 #define RAMP_GEN_DETAILED_STATS
+#endif
 
 // Stats
 class RampGenStats
 {
 public:
+    // ISR code paths (recorded when the ISR exits)
+    enum ISRPath : uint8_t
+    {
+        ISR_PATH_IDLE,          // Paused, stopping or no block ready to execute
+        ISR_PATH_STEP_END,      // End of step pulses
+        ISR_PATH_NEW_BLOCK,     // Setup of a new block
+        ISR_PATH_END_STOP,      // End stop hit
+        ISR_PATH_MOTION,        // Block executing without a step event
+        ISR_PATH_STEP,          // Step event
+        ISR_PATH_COUNT
+    };
+
+    // ISR histogram - execution time and timer entry jitter (deviation of the interval between ISR entries
+    // from the expected interval) in log2 buckets of CPU cycles - bucket 0 is less than ISR_HIST_BASE_CYCLES
+    // and bucket N is less than ISR_HIST_BASE_CYCLES << N (the last bucket holds everything longer)
+    static constexpr uint32_t ISR_HIST_NUM_BUCKETS = 16;
+    static constexpr uint32_t ISR_HIST_BASE_SHIFT = 6;
+    static constexpr uint32_t ISR_HIST_BASE_CYCLES = 1 << ISR_HIST_BASE_SHIFT;
+    struct ISRHistogram
+    {
+        uint32_t execBuckets[ISR_HIST_NUM_BUCKETS] = {0};
+        uint32_t jitterBuckets[ISR_HIST_NUM_BUCKETS] = {0};
+        uint32_t jitterMaxCycles = 0;
+        uint32_t pathCounts[ISR_PATH_COUNT] = {0};
+        uint32_t pathMaxCycles[ISR_PATH_COUNT] = {0};
+    };
+
     RampGenStats();
+    void setup(uint32_t stepGenPeriodNs);
     void clear();
-    void startMotionProcessing();
-    void endMotionProcessing();
+
+    // ISR entry and exit (these are empty inline functions if stats are off)
+#ifdef RAMP_GEN_ISR_HISTOGRAM
+    void startMotionProcessing(uint32_t expectedPeriods);
+    void endMotionProcessing(ISRPath path);
+#else
+    inline void startMotionProcessing(uint32_t expectedPeriods)
+    {
+    }
+    inline void endMotionProcessing(ISRPath path)
+    {
+    }
+#endif
+
+    // Block state (an empty inline function unless stats are full)
+#ifdef RAMP_GEN_DETAILED_STATS
     void update(uint32_t curAccumulatorStep, 
             uint32_t curStepRatePerTTicks,
             uint32_t curAccumulatorNS,
@@ -29,19 +91,67 @@ public:
             uint32_t curStepCountMajorAxis,
             uint32_t stepsBeforeDecel,
             uint32_t maxStepRatePerTTicks);
-    void stepDirn(uint32_t axisIdx, bool dirnPositive);
-    void stepStart(uint32_t axisIdx);
+#else
+    inline void update(uint32_t curAccumulatorStep, 
+            uint32_t curStepRatePerTTicks,
+            uint32_t curAccumulatorNS,
+            int axisIdxWithMaxSteps,
+            uint32_t accStepsPerTTicksPerMS,
+            uint32_t curStepCountMajorAxis,
+            uint32_t stepsBeforeDecel,
+            uint32_t maxStepRatePerTTicks)
+    {
+    }
+#endif
+
+    // Per-axis step events (not currently recorded)
+    inline void stepDirn(uint32_t axisIdx, bool dirnPositive)
+    {
+    }
+    inline void stepStart(uint32_t axisIdx)
+    {
+    }
     String getStatsStr() const;
     String getJSON(bool includeBraces = true, bool detailed = false) const;
+
+    // ISR histogram snapshot and reset (the reset is carried out by the ISR so the histogram only has one writer)
+    void getISRHistogram(ISRHistogram& histogram) const;
+    void requestISRHistogramReset()
+    {
+#ifdef RAMP_GEN_ISR_HISTOGRAM
+        _isrHistResetPending = true;
+#endif
+    }
+    String getISRHistogramJSON() const;
+    static const char* getISRPathName(uint32_t path);
     
 private:
+    // CPU cycles
+    uint32_t _cyclesPerUs = 1;
+    uint32_t _stepGenPeriodCycles = 0;
+
     // Stats
-    uint64_t _isrStartUs = 0;
-    uint64_t _isrAccUs = 0;
+    uint32_t _isrStartCycles = 0;
+    uint64_t _isrAccCycles = 0;
     uint32_t _isrCount = 0;
     float _isrAvgUs = 0;
     bool _isrAvgValid = false;
     uint32_t _isrMaxUs = 0;
+#ifdef RAMP_GEN_ISR_HISTOGRAM
+    volatile ISRHistogram _isrHist;
+    uint32_t _isrLastEntryCycles = 0;
+    bool _isrLastEntryValid = false;
+    volatile bool _isrHistResetPending = false;
+    static inline uint32_t histBucket(uint32_t cycles)
+    {
+        uint32_t scaled = cycles >> ISR_HIST_BASE_SHIFT;
+        if (scaled == 0)
+            return 0;
+        uint32_t bucketIdx = 32 - __builtin_clz(scaled);
+        return bucketIdx < ISR_HIST_NUM_BUCKETS ? bucketIdx : ISR_HIST_NUM_BUCKETS - 1;
+    }
+#endif
+    void clearISRHistogram();
 #ifdef RAMP_GEN_DETAILED_STATS
     uint32_t _curAccumulatorStep = 0;
     uint32_t _curStepRatePerTTicks = 0;
@@ -0,0 +1,157 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RampGenTimebase
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RampGenTimebase.h"
+#include "RaftArduino.h"
+#include "RaftUtils.h"
+#include "Logger.h"
+#include "esp_intr_alloc.h"
+#include "driver/gpio.h"
+
+// Debug
+// #define DEBUG_TIMEBASE_SYNC
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Constructor
+RampGenTimebase::RampGenTimebase()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Destructor
+RampGenTimebase::~RampGenTimebase()
+{
+    teardown();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup
+/// @param config Configuration (syncPin, syncActLvl, syncPeriodUs and syncStepUs)
+void RampGenTimebase::setup(const RaftJsonIF& config)
+{
+    teardown();
+
+    // Settings
+    _syncPin = config.getLong("syncPin", -1);
+    _syncActLvl = config.getBool("syncActLvl", true);
+    _syncPeriodUs = config.getLong("syncPeriodUs", 0);
+    _syncStepUs = UTILS_MAX(config.getLong("syncStepUs", SYNC_STEP_US_DEFAULT), 1);
+    _offsetUs = 0;
+    _numSyncs = 0;
+    _lastErrUs = 0;
+    if ((_syncPin < 0) || (_syncPeriodUs == 0))
+        return;
+
+    // Sync pulse interrupt on the active edge
+    pinMode(_syncPin, INPUT);
+    esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    if ((err != ESP_OK) && (err != ESP_ERR_INVALID_STATE))
+    {
+        LOG_W(MODULE_PREFIX, "setup syncPin %d isr service failed %d", _syncPin, err);
+        return;
+    }
+    if ((gpio_set_intr_type((gpio_num_t)_syncPin, _syncActLvl ? GPIO_INTR_POSEDGE : GPIO_INTR_NEGEDGE) != ESP_OK) ||
+                (gpio_isr_handler_add((gpio_num_t)_syncPin, syncPulseISR, this) != ESP_OK))
+    {
+        LOG_W(MODULE_PREFIX, "setup syncPin %d interrupt failed", _syncPin);
+        gpio_set_intr_type((gpio_num_t)_syncPin, GPIO_INTR_DISABLE);
+        return;
+    }
+    gpio_intr_enable((gpio_num_t)_syncPin);
+    _syncIntrEnabled = true;
+    LOG_I(MODULE_PREFIX, "setup syncPin %d actLvl %d periodUs %d stepUs %d",
+                _syncPin, _syncActLvl, _syncPeriodUs, _syncStepUs);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Teardown
+void RampGenTimebase::teardown()
+{
+    if (_syncIntrEnabled)
+    {
+        gpio_intr_disable((gpio_num_t)_syncPin);
+        gpio_set_intr_type((gpio_num_t)_syncPin, GPIO_INTR_DISABLE);
+        gpio_isr_handler_remove((gpio_num_t)_syncPin);
+        _syncIntrEnabled = false;
+    }
+    _syncPulsePending = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Loop - a sync pulse marks a whole number of sync periods of shared time
+void RampGenTimebase::loop()
+{
+    if (!_syncPulsePending)
+        return;
+    int64_t pulseLocalUs = _syncPulseLocalUs;
+    _syncPulsePending = false;
+
+    // Error from the nearest sync period boundary
+    int64_t pulseSharedUs = pulseLocalUs + _offsetUs;
+    int64_t nearestUs = ((pulseSharedUs + _syncPeriodUs / 2) / _syncPeriodUs) * _syncPeriodUs;
+    applyError(int32_t(nearestUs - pulseSharedUs));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Sync to a reference shared time
+/// @param sharedTimeUs Shared time now (from the reference)
+void RampGenTimebase::syncToTime(uint64_t sharedTimeUs)
+{
+    int64_t errUs = int64_t(sharedTimeUs) - int64_t(getSharedTimeUs64());
+    if ((errUs > INT32_MAX) || (errUs < INT32_MIN))
+    {
+        // Too far out to discipline - step the offset
+        _offsetUs = int32_t(int64_t(sharedTimeUs) - esp_timer_get_time());
+        _numSyncs++;
+        _lastErrUs = 0;
+        return;
+    }
+    applyError(int32_t(errUs));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Apply a measured error to the offset
+/// @param errUs Error (reference less shared time)
+/// @note The first sync and large errors step the offset - smaller errors are halved each sync so that jitter
+///       in the sync source is filtered
+void RampGenTimebase::applyError(int32_t errUs)
+{
+    if ((_numSyncs == 0) || (errUs > _syncStepUs) || (errUs < -_syncStepUs))
+        _offsetUs = _offsetUs + errUs;
+    else
+        _offsetUs = _offsetUs + errUs / 2;
+    _lastErrUs = errUs;
+    _numSyncs++;
+#ifdef DEBUG_TIMEBASE_SYNC
+    LOG_I(MODULE_PREFIX, "applyError errUs %d offsetUs %d numSyncs %d", errUs, _offsetUs, _numSyncs);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Sync pulse interrupt handler
+/// @param pArg Timebase
+void IRAM_ATTR RampGenTimebase::syncPulseISR(void* pArg)
+{
+    RampGenTimebase* pTimebase = (RampGenTimebase*)pArg;
+    pTimebase->_syncPulseLocalUs = esp_timer_get_time();
+    pTimebase->_syncPulsePending = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON
+/// @param includeBraces Include braces
+/// @return JSON string
+String RampGenTimebase::getDebugJSON(bool includeBraces) const
+{
+    String jsonStr = "\"offsetUs\":" + String(_offsetUs) +
+                ",\"syncs\":" + String(_numSyncs) +
+                ",\"lastErrUs\":" + String(_lastErrUs);
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
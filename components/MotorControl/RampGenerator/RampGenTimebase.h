@@ -0,0 +1,89 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RampGenTimebase
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "RaftJsonIF.h"
+
+// Shared timebase for time-synchronized motion across controllers
+// The shared time (us) is the local esp_timer time plus an offset which is disciplined by either
+// - a time received over a bus (syncToTime - e.g. sent by the controller whose time is the reference)
+// - a sync pulse on a GPIO (syncPin) which occurs at every syncPeriodUs of shared time
+// Blocks with a scheduled start time aren't started by the ramp generator until the shared time is reached
+// Start times are the lower 32 bits of the shared time (comparisons are wrap-safe for up to ~35 minutes ahead)
+class RampGenTimebase
+{
+public:
+    RampGenTimebase();
+    ~RampGenTimebase();
+
+    // Setup (syncPin, syncActLvl, syncPeriodUs, syncStepUs)
+    void setup(const RaftJsonIF& config);
+    void teardown();
+
+    // Loop (handles sync pulses)
+    void loop();
+
+    // Shared time
+    uint32_t IRAM_ATTR getSharedTimeUs() const
+    {
+        return uint32_t(esp_timer_get_time()) + uint32_t(_offsetUs);
+    }
+    uint64_t getSharedTimeUs64() const
+    {
+        return uint64_t(esp_timer_get_time() + _offsetUs);
+    }
+
+    // Check if a shared time has been reached
+    bool IRAM_ATTR isTimeReached(uint32_t sharedTimeUs) const
+    {
+        return int32_t(getSharedTimeUs() - sharedTimeUs) >= 0;
+    }
+
+    // Sync to a reference shared time (the time at the moment of the call less any known latency)
+    void syncToTime(uint64_t sharedTimeUs);
+
+    // Status
+    bool isSynced() const
+    {
+        return _numSyncs > 0;
+    }
+
+    // Debug
+    String getDebugJSON(bool includeBraces) const;
+
+private:
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RampGenTimebase";
+
+    // Errors larger than this are corrected in one step (smaller errors are slewed)
+    static constexpr int32_t SYNC_STEP_US_DEFAULT = 1000;
+
+    // Offset from local time to shared time
+    volatile int32_t _offsetUs = 0;
+
+    // Sync pulse
+    int _syncPin = -1;
+    bool _syncActLvl = true;
+    uint32_t _syncPeriodUs = 0;
+    bool _syncIntrEnabled = false;
+    volatile int64_t _syncPulseLocalUs = 0;
+    volatile bool _syncPulsePending = false;
+
+    // Discipline
+    int32_t _syncStepUs = SYNC_STEP_US_DEFAULT;
+    uint32_t _numSyncs = 0;
+    int32_t _lastErrUs = 0;
+
+    // Helpers
+    void applyError(int32_t errUs);
+    static void IRAM_ATTR syncPulseISR(void* pArg);
+};
@@ -47,6 +47,8 @@ bool RampGenTimer::setup(uint32_t timerPeriodUs)
 
     _timerPeriodUs = timerPeriodUs;
     _timerIsEnabled = false;
+    _curPeriodScale = 1;
+    _elapsedPeriodScale = 1;
     
 #ifdef RAMP_GEN_USE_SEMAPHORE_FOR_LIST_ACCESS
     // Mutex controlling hook vector access
@@ -222,8 +224,8 @@ void RampGenTimer::unhookTimer(void* pObject)
         if (it->pObject == pObject)
         {
             _timerCBHooks.erase(it);
+            break;
         }
-        break;
     }
     
 #ifdef RAMP_GEN_USE_SEMAPHORE_FOR_LIST_ACCESS
@@ -243,10 +245,34 @@ void RampGenTimer::unhookTimer(void* pObject)
 
 String RampGenTimer::getDebugJSON(bool includeBraces) const
 {
-    String json = "\"ISRCount\":" + String(_timerISRCount);
+    String json = "\"ISRCount\":" + String(_timerISRCount) + ",\"periodUs\":" + String(_timerPeriodUs * _curPeriodScale);
     return includeBraces ? "{" + json + "}" : json;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set alarm period (called from the ISR - gptimer_set_alarm_action is ISR safe)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool IRAM_ATTR RampGenTimer::setAlarmPeriodScale(uint32_t periodScale)
+{
+    // Check valid
+    if (!_timerIsSetup || (periodScale == 0))
+        return false;
+
+    gptimer_alarm_config_t alarmConfig = {
+        .alarm_count = uint64_t(_timerPeriodUs) * periodScale,
+        .reload_count = 0,                  // counter will reload with 0 on alarm event
+        .flags = 
+            {
+                .auto_reload_on_alarm = true, // enable auto-reload
+            }
+    };
+    if (gptimer_set_alarm_action(_timerHandle, &alarmConfig) != ESP_OK)
+        return false;
+    _curPeriodScale = periodScale;
+    return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Timer interrupts
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -17,8 +17,8 @@
 
 // #define RAMP_GEN_USE_SEMAPHORE_FOR_LIST_ACCESS
 
-// This is intended to be used statically in the RampGenerator class
-// setup() must be called to initialise and the timer will be started by the
+// Each RampGenerator has its own timer unless a timer shared by several generators (motion groups) is set
+// setup() must be called to initialise (further calls are ignored) and the timer will be started by the
 // first RampGenerator object that calls start()
 
 typedef void (*RampGenTimerCB)(void* pObject);
@@ -38,6 +38,19 @@ public:
     bool hookTimer(RampGenTimerCB timerCB, void* pObject);
     void unhookTimer(void* pObject);
 
+    // Dynamic period - the timer period can be scaled (by an integer multiple of the configured period)
+    // Each hook should call requestPeriodScale() from its callback - the smallest scale requested by the hooks
+    // is used for the next interval - and getElapsedPeriodScale() is the scale of the interval which has just ended
+    void IRAM_ATTR requestPeriodScale(uint32_t periodScale)
+    {
+        if (periodScale < _requestedPeriodScale)
+            _requestedPeriodScale = periodScale;
+    }
+    uint32_t IRAM_ATTR getElapsedPeriodScale() const
+    {
+        return _elapsedPeriodScale;
+    }
+
     // Debug
     uint32_t getDebugISRCount();
     uint64_t getDebugRawCount();
@@ -56,6 +69,12 @@ private:
     // Timer handle
     gptimer_handle_t _timerHandle = nullptr;
 
+    // Period scale - current, requested by hooks (in the current ISR) and of the interval just ended
+    // (the requested and elapsed scales are only accessed in the ISR)
+    volatile uint32_t _curPeriodScale = 1;
+    uint32_t _requestedPeriodScale = UINT32_MAX;
+    uint32_t _elapsedPeriodScale = 1;
+
     // Debug timer count
     volatile uint32_t _timerISRCount = 0;
 
@@ -89,6 +108,10 @@ private:
         // Bump count
         _timerISRCount = _timerISRCount + 1;
 
+        // Period of the interval which has just ended
+        _elapsedPeriodScale = _curPeriodScale;
+        _requestedPeriodScale = UINT32_MAX;
+
 #ifdef RAMP_GEN_USE_SEMAPHORE_FOR_LIST_ACCESS
         // Get semaphore on hooks vector
         BaseType_t xTaskWokenBySemphoreTake = pdFALSE;
@@ -106,6 +129,10 @@ private:
             }
         }
 
+        // Change the period if requested (the counter has already been reloaded so this applies to the next interval)
+        if ((_requestedPeriodScale != UINT32_MAX) && (_requestedPeriodScale != _curPeriodScale))
+            setAlarmPeriodScale(_requestedPeriodScale);
+
 #ifdef RAMP_GEN_USE_SEMAPHORE_FOR_LIST_ACCESS
         // Release semaphore
         xSemaphoreGiveFromISR(_hookListMutex, &xTaskWokenBySemphoreGive);
@@ -121,6 +148,7 @@ private:
     }
 
     // Timer control
+    bool IRAM_ATTR setAlarmPeriodScale(uint32_t periodScale);
     void disableTimerInterrupts();
     void reenableTimerInterrupts();
     void timerReset();
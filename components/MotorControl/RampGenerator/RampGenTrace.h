@@ -0,0 +1,148 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RampGenTrace
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+// Length of the trace ring (0 to remove tracing from the build)
+#ifndef RAMP_GEN_TRACE_LEN
+#define RAMP_GEN_TRACE_LEN 64
+#endif
+
+// Block execution trace
+// A fixed-size ring of records written by the ramp generator (in the ISR) when each block starts and ends
+// The ISR is the only writer - a record is written and then the write count is published (release) and
+// readers copy records and then check the write count again to discard any which may have been overwritten
+class RampGenTrace
+{
+public:
+    // Event types
+    enum EventType : uint8_t
+    {
+        EVENT_BLOCK_START = 0,
+        EVENT_BLOCK_END = 1,
+        EVENT_BLOCK_END_STOP = 2,       // Block ended by an end stop
+        EVENT_BLOCK_CANCELLED = 3,      // Block ended by a stop request
+        EVENT_BLOCK_HELD = 4,           // Block held at a standstill by a feed hold (it restarts when resumed)
+    };
+
+    // Record flags
+    static constexpr uint8_t FLAG_IDX_VALID = 0x01;
+
+    // Binary record (all values big-endian)
+    //   0..3   time (us - lower 32 bits of esp_timer_get_time())
+    //   4..7   motion tracking index (valid if FLAG_IDX_VALID)
+    //   8..11  step rate (per TTicks) - the entry rate for a start event and the exit rate for an end event
+    //   12     event type (EVENT_XXX)
+    //   13     pipeline depth (blocks in the pipeline including this one - saturates at 255)
+    //   14     flags (FLAG_XXX)
+    //   15     axis with the most steps
+    static constexpr uint32_t BINARY_RECORD_SIZE = 16;
+
+    /// @brief Record an event
+    /// @param eventType Event type
+    /// @param motionTrackingIdx Motion tracking index
+    /// @param idxValid Motion tracking index is valid
+    /// @param stepRatePerTTicks Step rate
+    /// @param pipelineDepth Pipeline depth
+    /// @param axisIdxWithMaxSteps Axis with the most steps
+    inline void IRAM_ATTR record(EventType eventType, uint32_t motionTrackingIdx, bool idxValid,
+                uint32_t stepRatePerTTicks, uint32_t pipelineDepth, uint32_t axisIdxWithMaxSteps)
+    {
+#if RAMP_GEN_TRACE_LEN > 0
+        uint32_t writeCount = _writeCount.load(std::memory_order_relaxed);
+        TraceRecord& rec = _records[writeCount % RAMP_GEN_TRACE_LEN];
+        rec.timeUs = uint32_t(esp_timer_get_time());
+        rec.motionTrackingIdx = motionTrackingIdx;
+        rec.stepRatePerTTicks = stepRatePerTTicks;
+        rec.eventType = eventType;
+        rec.pipelineDepth = pipelineDepth < 255 ? pipelineDepth : 255;
+        rec.flags = idxValid ? FLAG_IDX_VALID : 0;
+        rec.axisIdx = axisIdxWithMaxSteps;
+        _writeCount.store(writeCount + 1, std::memory_order_release);
+#endif
+    }
+
+    /// @brief Get the count of records written (the sequence number of the next record)
+    uint32_t getWriteCount() const
+    {
+        return _writeCount.load(std::memory_order_acquire);
+    }
+
+    /// @brief Get the most recent records in binary form
+    /// @param buf (out) Buffer - records are appended
+    /// @param maxRecords Maximum number of records
+    /// @param firstSeqNum (out) Sequence number of the first record returned
+    /// @return Number of records returned
+    uint32_t getRecordsBinary(std::vector<uint8_t>& buf, uint32_t maxRecords, uint32_t& firstSeqNum) const
+    {
+#if RAMP_GEN_TRACE_LEN > 0
+        // Copy the most recent records
+        uint32_t endSeqNum = _writeCount.load(std::memory_order_acquire);
+        uint32_t numRecords = endSeqNum < RAMP_GEN_TRACE_LEN ? endSeqNum : RAMP_GEN_TRACE_LEN;
+        numRecords = numRecords < maxRecords ? numRecords : maxRecords;
+        uint32_t startSeqNum = endSeqNum - numRecords;
+        TraceRecord records[RAMP_GEN_TRACE_LEN];
+        for (uint32_t i = 0; i < numRecords; i++)
+            records[i] = _records[(startSeqNum + i) % RAMP_GEN_TRACE_LEN];
+
+        // Discard records which may have been overwritten while copying (the record being written when the
+        // count was re-read overwrites the one RAMP_GEN_TRACE_LEN before it)
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint32_t afterSeqNum = _writeCount.load(std::memory_order_acquire);
+        uint32_t firstSafeSeqNum = afterSeqNum >= RAMP_GEN_TRACE_LEN ? afterSeqNum - RAMP_GEN_TRACE_LEN + 1 : 0;
+        uint32_t numDiscard = firstSafeSeqNum > startSeqNum ? firstSafeSeqNum - startSeqNum : 0;
+        numDiscard = numDiscard < numRecords ? numDiscard : numRecords;
+
+        // Form binary records
+        firstSeqNum = startSeqNum + numDiscard;
+        for (uint32_t i = numDiscard; i < numRecords; i++)
+        {
+            const TraceRecord& rec = records[i];
+            appendBE32(buf, rec.timeUs);
+            appendBE32(buf, rec.motionTrackingIdx);
+            appendBE32(buf, rec.stepRatePerTTicks);
+            buf.push_back(rec.eventType);
+            buf.push_back(rec.pipelineDepth);
+            buf.push_back(rec.flags);
+            buf.push_back(rec.axisIdx);
+        }
+        return numRecords - numDiscard;
+#else
+        firstSeqNum = 0;
+        return 0;
+#endif
+    }
+
+private:
+    struct TraceRecord
+    {
+        uint32_t timeUs;
+        uint32_t motionTrackingIdx;
+        uint32_t stepRatePerTTicks;
+        uint8_t eventType;
+        uint8_t pipelineDepth;
+        uint8_t flags;
+        uint8_t axisIdx;
+    };
+#if RAMP_GEN_TRACE_LEN > 0
+    TraceRecord _records[RAMP_GEN_TRACE_LEN] = {};
+#endif
+    std::atomic<uint32_t> _writeCount = 0;
+
+    static void appendBE32(std::vector<uint8_t>& buf, uint32_t val)
+    {
+        for (uint32_t i = 0; i < 4; i++)
+            buf.push_back((val >> (24 - i * 8)) & 0xff);
+    }
+};
@@ -0,0 +1,105 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RampGenTrajStream
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "RampGenTrajStream.h"
+#include "RaftArduino.h"
+#include "RaftUtils.h"
+#include "Logger.h"
+
+// Debug
+// #define DEBUG_TRAJ_STREAM
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup
+/// @param config Configuration (trajBufLen and trajSampleUs)
+/// @param stepGenPeriodNs Step generation period (ns)
+void RampGenTrajStream::setup(const RaftJsonIF& config, uint32_t stepGenPeriodNs)
+{
+    // Settings
+    uint32_t bufLen = config.getLong("trajBufLen", 0);
+    uint32_t sampleUs = config.getLong("trajSampleUs", SAMPLE_US_DEFAULT);
+    _isActive = false;
+    _endPending = false;
+    _isUnderrun = false;
+    _ticksPerSample = 0;
+    _samples.clear();
+    _samples.shrink_to_fit();
+    _bufPos.init(0);
+    if ((bufLen == 0) || (stepGenPeriodNs == 0))
+        return;
+
+    // Each axis can step on at most every other step generation period
+    uint32_t ticksPerSample = (uint64_t(sampleUs) * 1000) / stepGenPeriodNs;
+    if (ticksPerSample < 2)
+    {
+        LOG_W(MODULE_PREFIX, "setup trajSampleUs %d too short for step generation period %dns", sampleUs, stepGenPeriodNs);
+        return;
+    }
+    _samples.resize(bufLen);
+    _bufPos.init(bufLen);
+    _ticksPerSample = ticksPerSample;
+    LOG_I(MODULE_PREFIX, "setup bufLen %d sampleUs %d ticksPerSample %d maxStepsPerSample %d",
+                bufLen, sampleUs, _ticksPerSample, getMaxStepsPerSample());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start streaming
+/// @return false if not enabled or already streaming
+bool RampGenTrajStream::start()
+{
+    if (!isEnabled() || _isActive)
+        return false;
+    _endPending = false;
+    _isUnderrun = false;
+    _isActive = true;
+#ifdef DEBUG_TRAJ_STREAM
+    LOG_I(MODULE_PREFIX, "start queued %d", _bufPos.count());
+#endif
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add a sample
+/// @param pSteps Step deltas for each axis
+/// @param numAxes Number of axes in the sample (axes above this don't move)
+/// @return false if the buffer is full or a step delta exceeds the limit
+bool RampGenTrajStream::addSample(const int16_t* pSteps, uint32_t numAxes)
+{
+    if (!isEnabled() || !_bufPos.canPut())
+        return false;
+    Sample& sample = _samples[_bufPos.putIdx()];
+    int32_t maxSteps = getMaxStepsPerSample();
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        int16_t steps = axisIdx < numAxes ? pSteps[axisIdx] : 0;
+        if ((steps > maxSteps) || (steps < -maxSteps))
+        {
+            _numRejected++;
+            return false;
+        }
+        sample.steps[axisIdx] = steps;
+    }
+    _bufPos.hasPut();
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON
+/// @param includeBraces Include braces
+/// @return JSON string
+String RampGenTrajStream::getDebugJSON(bool includeBraces) const
+{
+    String jsonStr = "\"active\":" + String(_isActive ? 1 : 0) +
+                ",\"queued\":" + String(_bufPos.count()) +
+                ",\"done\":" + String(_numSamplesDone) +
+                ",\"underruns\":" + String(_numUnderruns) +
+                ",\"rejected\":" + String(_numRejected);
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
@@ -0,0 +1,148 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// RampGenTrajStream
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "esp_attr.h"
+#include "RaftJsonIF.h"
+#include "AxesValues.h"
+#include "MotionRingBuffer.h"
+
+// Trajectory stream - fixed-interval samples of per-axis step deltas (e.g. from a host which has already
+// computed the velocity profile of a CAM-generated trajectory) which are output by the ramp generator without
+// any planning
+// - samples are added by the producer (addSample) and taken by the ramp generator ISR (getSample) which outputs
+//   each axis's steps evenly over the sample interval (DDA) so every sample moves exactly its step deltas
+// - the step deltas of a sample are limited to half the step generation periods in the sample interval so that
+//   there is always a step-end period between steps on an axis
+// - streaming is started when the pipeline is empty and ends when the stream has been ended and all samples
+//   have been output - if the stream runs dry before it has been ended motion stops (an underrun) until more
+//   samples arrive
+// - endstops and the feed override aren't applied to streamed motion (a pause stops motion immediately)
+class RampGenTrajStream
+{
+public:
+    RampGenTrajStream() : _bufPos(0)
+    {
+    }
+
+    // Sample
+    struct Sample
+    {
+        int16_t steps[AXIS_VALUES_MAX_AXES];
+    };
+
+    // Setup (trajBufLen samples - 0 to disable - and trajSampleUs)
+    void setup(const RaftJsonIF& config, uint32_t stepGenPeriodNs);
+
+    // Check if enabled
+    bool isEnabled() const
+    {
+        return _ticksPerSample > 0;
+    }
+
+    // Start streaming (the pipeline must be empty) - returns false if not enabled or already streaming
+    bool start();
+
+    // End the stream (streaming stops once all samples have been output)
+    void end()
+    {
+        _endPending = true;
+    }
+
+    // Check if streaming
+    bool IRAM_ATTR isActive() const
+    {
+        return _isActive;
+    }
+
+    // Add a sample (producer) - returns false if the buffer is full or a step delta exceeds the limit
+    bool addSample(const int16_t* pSteps, uint32_t numAxes);
+
+    // Samples which can be added
+    uint32_t getFreeSamples() const
+    {
+        return isEnabled() ? _bufPos.remaining() : 0;
+    }
+
+    // Step generation periods in a sample
+    uint32_t IRAM_ATTR getTicksPerSample() const
+    {
+        return _ticksPerSample;
+    }
+
+    // Max step delta on an axis in a sample
+    uint32_t getMaxStepsPerSample() const
+    {
+        return _ticksPerSample / 2;
+    }
+
+    /// @brief Get the next sample (consumer - ramp generator ISR)
+    /// @param sample (out) Sample
+    /// @return false if no sample is available (streaming ends here if the stream has been ended)
+    bool IRAM_ATTR getSample(Sample& sample)
+    {
+        if (!_bufPos.canGet())
+        {
+            if (_endPending)
+            {
+                _endPending = false;
+                _isActive = false;
+            }
+            else if (!_isUnderrun)
+            {
+                _isUnderrun = true;
+                _numUnderruns = _numUnderruns + 1;
+            }
+            return false;
+        }
+        sample = _samples[_bufPos.getIdx()];
+        _bufPos.hasGot();
+        _isUnderrun = false;
+        _numSamplesDone = _numSamplesDone + 1;
+        return true;
+    }
+
+    // Cancel streaming (consumer - ramp generator ISR - the remaining samples are discarded)
+    void IRAM_ATTR cancel()
+    {
+        while (_bufPos.canGet())
+            _bufPos.hasGot();
+        _endPending = false;
+        _isActive = false;
+    }
+
+    // Debug
+    String getDebugJSON(bool includeBraces) const;
+
+private:
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "RampGenTrajStream";
+
+    // Defaults
+    static constexpr uint32_t SAMPLE_US_DEFAULT = 1000;
+
+    // Samples and ring buffer position (single producer and the ramp generator ISR as consumer)
+    std::vector<Sample> _samples;
+    MotionRingBufferPosn _bufPos;
+
+    // Step generation periods in a sample (0 if disabled)
+    uint32_t _ticksPerSample = 0;
+
+    // State
+    volatile bool _isActive = false;
+    volatile bool _endPending = false;
+    volatile bool _isUnderrun = false;
+
+    // Stats
+    volatile uint32_t _numSamplesDone = 0;
+    volatile uint32_t _numUnderruns = 0;
+    uint32_t _numRejected = 0;
+};
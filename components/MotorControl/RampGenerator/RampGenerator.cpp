@@ -15,7 +15,6 @@
 #include "EndStops.h"
 #include "AxisEndstopChecks.h"
 
-#define RAMP_GEN_DETAILED_STATS
 // #define DEBUG_MOTION_PULSE_GEN
 // #define DEBUG_MOTION_PEEK_QUEUE
 // #define DEBUG_SETUP_NEW_BLOCK
@@ -23,7 +22,8 @@
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
-RampGenerator::RampGenerator()
+template <uint32_t NumAxes, typename DriverT>
+RampGeneratorT<NumAxes, DriverT>::RampGeneratorT()
 {
     // Init
     resetTotalStepPosition();
@@ -31,10 +31,13 @@ RampGenerator::RampGenerator()
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Destructor
-RampGenerator::~RampGenerator()
+template <uint32_t NumAxes, typename DriverT>
+RampGeneratorT<NumAxes, DriverT>::~RampGeneratorT()
 {
-    // Release timer hook
-    _rampGenTimer.unhookTimer(this);
+    // Stop refilling the pulse engine and release timer hook
+    if (_pPulseEngine)
+        _pPulseEngine->stopRefill();
+    _pRampGenTimer->unhookTimer(this);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -42,7 +45,8 @@ RampGenerator::~RampGenerator()
 /// @param config Configuration
 /// @param stepperDrivers Stepper drivers
 /// @param axisEndStops End stops
-void RampGenerator::setup(const RaftJsonIF& config,
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::setup(const RaftJsonIF& config,
             const std::vector<StepDriverBase*>& stepperDrivers,
             const std::vector<EndStops*>& axisEndStops)
 {
@@ -52,13 +56,28 @@ void RampGenerator::setup(const RaftJsonIF& config,
     // Ramp generator config
     long rampTimerUs = config.getLong("rampTimerUs", RampGenTimer::RAMP_GEN_PERIOD_US_DEFAULT);
 
+    // Pulse engine - hardware engines (rmt or shiftReg) don't use the timer (rampTimerUs still defines the units
+    // of step rates)
+    String pulseEngine = config.getString("pulseEngine", "timer");
+    if (_pPulseEngine)
+        _pPulseEngine->stopRefill();
+    _pulseEngineRefillInTask = false;
+    _pPulseEngine = nullptr;
+    if (pulseEngine.equalsIgnoreCase("rmt"))
+        _pPulseEngine = &_rmtEngine;
+    else if (pulseEngine.equalsIgnoreCase("shiftReg"))
+        _pPulseEngine = &_shiftRegEngine;
+    _usePulseEngine = _pPulseEngine != nullptr;
+    if (_usePulseEngine)
+        _useRampGenTimer = false;
+
     // Ramp generator timer
     bool timerSetupOk = false;
     if (_useRampGenTimer)
     {
         // Setup timer (the exact period may be different from the requested period)
-        timerSetupOk = _rampGenTimer.setup(rampTimerUs);
-        _stepGenPeriodNs = _rampGenTimer.getPeriodUs() * 1000;
+        timerSetupOk = _pRampGenTimer->setup(rampTimerUs);
+        _stepGenPeriodNs = _pRampGenTimer->getPeriodUs() * 1000;
         if (!timerSetupOk)
         {
             _useRampGenTimer = false;
@@ -75,39 +94,178 @@ void RampGenerator::setup(const RaftJsonIF& config,
 
     // Set timing period for step generation
     _minStepRatePerTTicks = MotionBlock::calcMinStepRatePerTTicks(_stepGenPeriodNs);
+    _stats.setup(_stepGenPeriodNs);
+
+    // Acceleration tick - finer ticks give smoother ramps at the cost of more frequent rate updates
+    // and this can't be shorter than the step generation period (0 means update every step generation period)
+    long accelTickUs = config.getLong("accelTickUs", MotionBlock::NS_IN_A_MS / 1000);
+
+    _accelTickNs = UTILS_MAX(uint32_t(accelTickUs < 0 ? 0 : accelTickUs) * 1000, _stepGenPeriodNs);
+
+    // Multi-axis step smoothing - at low step rates the step events are oversampled (by up to 2^amassMaxLevel)
+    // so that minor axes step closer to their ideal times (disabled once the drivers are set up if a hardware pulse
+    // engine is used)
+    _amassMaxLevel = UTILS_MIN(uint32_t(config.getLong("amassMaxLevel", AMASS_MAX_LEVEL_DEFAULT)), AMASS_MAX_LEVEL_LIMIT);
+
+    // Dynamic ISR rate - the timer ISR runs at up to rampTimerIdleUs when idle or moving slowly (0 to disable)
+    long rampTimerIdleUs = config.getLong("rampTimerIdleUs", RAMP_TIMER_IDLE_US_DEFAULT);
+    _isrIdlePeriodScale = 1;
+    if (_useRampGenTimer && (rampTimerIdleUs > 0) && (_stepGenPeriodNs > 0))
+        _isrIdlePeriodScale = UTILS_MAX(uint32_t(rampTimerIdleUs * 1000) / _stepGenPeriodNs, 1);
+    _isrBlockPeriodScale = 1;
 
     // Store steppers and end stops
     _stepperDrivers = stepperDrivers;
     _axisEndStops = axisEndStops;
+    _numStepperDrivers = UTILS_MIN(_stepperDrivers.size(), AXIS_VALUES_MAX_AXES);
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        _stepperDriverPtrs[axisIdx] = axisIdx < _numStepperDrivers ? static_cast<DriverT*>(_stepperDrivers[axisIdx]) : nullptr;
+
+    // Direction setup time of each driver (in step generation periods - rounded up)
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        _dirSetupNs[axisIdx] = (axisIdx < _numStepperDrivers) && _stepperDrivers[axisIdx] ? 
+                    _stepperDrivers[axisIdx]->getDirSetupNs() : 0;
+        _dirSetupPeriods[axisIdx] = _stepGenPeriodNs > 0 ? (_dirSetupNs[axisIdx] + _stepGenPeriodNs - 1) / _stepGenPeriodNs : 0;
+        _dirSetupRemainingPeriods[axisIdx] = 0;
+        _dirSetupDeferredSteps[axisIdx] = 0;
+    }
+    _dirSetupActiveMask = 0;
+
+    // A specialized ramp generator requires a driver of the specified type on every axis
+    _stepperDriversValid = true;
+    if (IS_FIXED_CONFIG)
+    {
+        for (uint32_t axisIdx = 0; axisIdx < NumAxes; axisIdx++)
+        {
+            String driverType = (axisIdx < _numStepperDrivers) && _stepperDrivers[axisIdx] ? 
+                        _stepperDrivers[axisIdx]->getDriverType() : "missing";
+            if (driverType != DriverT::DRIVER_TYPE)
+            {
+                LOG_E(MODULE_PREFIX, "setup fixed config requires %d %s drivers - axis %d is %s", 
+                            NumAxes, DriverT::DRIVER_TYPE, axisIdx, driverType.c_str());
+                _stepperDriversValid = false;
+            }
+        }
+    }
 
     // Calculate ramp gen periods
     _minStepRatePerTTicks = MotionBlock::calcMinStepRatePerTTicks(_stepGenPeriodNs);
 
-    // Hook the timer if required
+    // Hardware pulse engine
+    if (_pPulseEngine == &_rmtEngine)
+    {
+        std::vector<int> stepPins;
+        for (StepDriverBase* pDriver : _stepperDrivers)
+            stepPins.push_back(pDriver ? pDriver->getStepPin() : -1);
+        uint32_t maxStepIntervalNs = (uint64_t(_stepGenPeriodNs) * MotionBlock::TTICKS_VALUE) / _minStepRatePerTTicks;
+        _usePulseEngine = _rmtEngine.setup(config, stepPins, _stepGenPeriodNs, maxStepIntervalNs, _axisTotalSteps);
+    }
+    else if (_pPulseEngine == &_shiftRegEngine)
+    {
+        std::vector<RampGenShiftReg::AxisOutputs> axisOutputs;
+        for (StepDriverBase* pDriver : _stepperDrivers)
+        {
+            RampGenShiftReg::AxisOutputs outputs;
+            if (pDriver)
+            {
+                outputs.stepBit = pDriver->getShiftRegStepBit();
+                outputs.dirnBit = pDriver->getShiftRegDirnBit();
+                outputs.invDirn = pDriver->isDirnInverted();
+                outputs.dirSetupNs = pDriver->getDirSetupNs();
+            }
+            axisOutputs.push_back(outputs);
+        }
+        _usePulseEngine = _shiftRegEngine.setup(config, axisOutputs, _axisTotalSteps);
+    }
+    if (_pPulseEngine && !_usePulseEngine)
+    {
+        LOG_E(MODULE_PREFIX, "setup %s pulse engine failed - using software pulse generation", pulseEngine.c_str());
+        _pPulseEngine = nullptr;
+    }
+
+    // Multi-axis step smoothing is only used with software pulse generation - a hardware engine (rmt or shiftReg)
+    // times each step of every axis individually so minor axis steps are already at their own times (the drivers'
+    // microstep interpolation, e.g. TMC2209 intpol, is in the driver and is the same whichever engine is used)
+    if (_usePulseEngine)
+        _amassMaxLevel = 0;
+
+    // Direct GPIO stepping - convert step pins to register bitmasks
+    _useFastGPIO = config.getBool("fastGPIO", false) && !_usePulseEngine;
+    _fastGPIO.clear();
+    if (_useFastGPIO)
+    {
+        for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+        {
+            if (!_stepperDrivers[axisIdx])
+                continue;
+            int stepPin = _stepperDrivers[axisIdx]->getStepPin();
+            if ((stepPin >= 0) && !_fastGPIO.addStepPin(axisIdx, stepPin))
+                LOG_W(MODULE_PREFIX, "setup fastGPIO axis %d stepPin %d not supported - using driver", axisIdx, stepPin);
+        }
+        _useFastGPIO = _fastGPIO.isActive();
+    }
+
+    // Hook the timer if required (a shared timer may still have the hook from a previous setup)
     if (_useRampGenTimer)
-        _rampGenTimer.hookTimer(rampGenTimerCallback, this);
+    {
+        _pRampGenTimer->unhookTimer(this);
+        _pRampGenTimer->hookTimer(rampGenTimerCallback, this);
+    }
 
     // Setup motion pipeline
     uint32_t pipelineLen = config.getLong("pipelineLen", PIPELINE_LEN_DEFAULT);
     _motionPipeline.setup(pipelineLen);
 
+    // Stop with deceleration (otherwise the executing block is cancelled immediately)
+    _stopWithDecel = config.getBool("stopDecel", false);
+
+    // Shared timebase for blocks with a scheduled start time
+    _timebase.setup(config);
+
+    // Trajectory stream (not supported by hardware pulse engines which time each step from the block's ramp)
+    _trajStreamStarted = false;
+    _velModeActive = false;
+    _trajStream.setup(config, _usePulseEngine ? 0 : _stepGenPeriodNs);
+
+    // Hardware pulse engine chunks are refilled from the engine's task if it has one (otherwise from loop()) and
+    // are limited in duration while endstops are checked (endstops are checked as each chunk is refilled)
+    _pulseEngineEndStopChunkNs = config.getLong("endStopChunkUs", PULSE_ENGINE_END_STOP_CHUNK_US_DEFAULT) * 1000;
+    if (_usePulseEngine)
+        _pulseEngineRefillInTask = _pPulseEngine->startRefill(pulseEngineRefillCallback, this);
+
     // Debug
-    LOG_I(MODULE_PREFIX, "setup useTimerInterrupt %s stepGenPeriod %dus numStepperDrivers %d numEndStops %d pipelineLen %d", 
-                _useRampGenTimer ? "Y" : "N", 
-                _stepGenPeriodNs / 1000, _stepperDrivers.size(), _axisEndStops.size(), pipelineLen);
+    LOG_I(MODULE_PREFIX, "setup useTimerInterrupt %s pulseEngine %s fastGPIO %s stepGenPeriod %dus idlePeriod %dus accelTick %dus numStepperDrivers %d numEndStops %d pipelineLen %d", 
+                _useRampGenTimer ? "Y" : "N", _usePulseEngine ? pulseEngine.c_str() : "sw", _useFastGPIO ? "Y" : "N",
+                _stepGenPeriodNs / 1000, _stepGenPeriodNs * _isrIdlePeriodScale / 1000, _accelTickNs / 1000, _stepperDrivers.size(), _axisEndStops.size(), pipelineLen);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Loop - must be called very frequently if not using timer ISR (maybe called less frequently if using timer ISR)
-void RampGenerator::loop()
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::loop()
 {
     // Loop RampGenIO
     // TODO
     // _rampGenIO.loop();
 
+    // Shared timebase sync
+    _timebase.loop();
+
+    // Check if a hardware pulse engine is used - this needs chunks of step times refilled regularly (the engine's
+    // refill task is woken if there is something to do so a stop or new block isn't left until its next wake)
+    if (_usePulseEngine)
+    {
+        if (!_pulseEngineRefillInTask)
+            servicePulseEngine();
+        else if (_stopPending || (((_motionPipeline.count() > 0) || isPressureAdvanceSettling()) && 
+                    _pPulseEngine->canQueueChunk()))
+            _pPulseEngine->requestRefill();
+    }
+
     // Check if timer used for pulse generation - otherwise pump many times to
     // aid testing
-    if (!_useRampGenTimer)
+    else if (!_useRampGenTimer)
     {
         // Check time to generate pulses
         if (Raft::isTimeout(millis(), _nonTimerLoopLastMs, NON_TIMER_SERVICE_CALL_MIN_MS))
@@ -134,73 +292,164 @@ void RampGenerator::loop()
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief start ramp generation
-void RampGenerator::start()
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::start()
 {
+    // A specialized ramp generator can't run without the drivers it was built for
+    if (!_stepperDriversValid)
+    {
+        LOG_E(MODULE_PREFIX, "start failed - stepper drivers don't match the fixed config");
+        return;
+    }
     _rampGenEnabled = true;
     _stopPending = false;
+    _holdState = HOLD_NONE;
     pause(false);
     if (_useRampGenTimer)
-        _rampGenTimer.enable(true);
+        _pRampGenTimer->enable(true);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief stop ramp generation
-void RampGenerator::stop()
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::stop()
 {
     _stopPending = true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// @brief pause ramp generation
-void RampGenerator::pause(bool pauseIt)
+/// @brief pause ramp generation (feed hold)
+/// @param pauseIt true to decelerate to a standstill and hold, false to resume immediately
+/// @note On resume a held block continues from its current position - if the pipeline hasn't been replanned
+///       from zero speed it continues with its original profile from the minimum step rate
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::pause(bool pauseIt)
 {
-    _isPaused = pauseIt;
-    if (!_isPaused)
+    if (pauseIt)
     {
-        _endStopReached = false;
+        if (!_isPaused && (_holdState == HOLD_NONE))
+            _holdState = HOLD_DECELERATING;
+        _isPaused = true;
+        return;
     }
+    _holdState = HOLD_NONE;
+    _isPaused = false;
+    _endStopReached = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set velocity mode targets (velocity mode starts if not already active and any target is non-zero)
+/// @param stepsPerSec Target step rate of each axis (signed - steps per second)
+/// @param accStepsPerSec2 Acceleration of each axis (steps per second^2)
+/// @param axesSpecified Axes to retarget (other axes keep their targets)
+/// @return false if velocity mode can't start (the pipeline isn't empty, a trajectory stream is active or a hardware pulse engine is used)
+template <uint32_t NumAxes, typename DriverT>
+bool RampGeneratorT<NumAxes, DriverT>::setVelocityTargets(const AxesValues<AxisSpeedDataType>& stepsPerSec, 
+            const AxesValues<AxisAccDataType>& accStepsPerSec2, const AxesValues<AxisSpecifiedDataType>& axesSpecified)
+{
+    // Velocity mode starts from a standstill with nothing else generating motion
+    bool wasActive = _velModeActive;
+    if (!wasActive)
+    {
+        if (_usePulseEngine || _trajStream.isActive() || (_motionPipeline.count() > 0))
+            return false;
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        {
+            _velTargetRate[axisIdx] = 0;
+            _velCurRate[axisIdx] = 0;
+            _curAccumulatorRelative[axisIdx] = 0;
+        }
+        _curAccumulatorNS = 0;
+        _stepEndElapsedPeriods = 0;
+    }
+
+    // Targets (rates are in steps per TTicks and limited to a step every other step generation period)
+    float accelTickSecs = _accelTickNs / 1.0e9f;
+    bool anyTarget = false;
+    for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
+    {
+        if (axesSpecified.getVal(axisIdx))
+        {
+            float rate = stepsPerSec.getVal(axisIdx) * _stepGenPeriodNs;
+            rate = UTILS_MAX(UTILS_MIN(rate, float(VEL_RATE_MAX)), -float(VEL_RATE_MAX));
+            float rateChange = UTILS_ABS(accStepsPerSec2.getVal(axisIdx)) * accelTickSecs * _stepGenPeriodNs;
+            _velAccPerTick[axisIdx] = UTILS_MAX(uint32_t(UTILS_MIN(rateChange, float(VEL_RATE_MAX))), 1);
+            _velTargetRate[axisIdx] = int32_t(rate);
+        }
+        anyTarget = anyTarget || (_velTargetRate[axisIdx] != 0);
+    }
+
+    // Start velocity mode (if velocity mode ended in the ISR since the check above all rates are zero)
+    if (anyTarget)
+        _velModeActive = true;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the steps done by the block held by a feed hold
+/// @param stepsDone (out) Steps done on each axis (absolute)
+/// @return false if no block is executing
+template <uint32_t NumAxes, typename DriverT>
+bool RampGeneratorT<NumAxes, DriverT>::getHeldBlockProgress(AxesValues<AxisStepsDataType>& stepsDone) const
+{
+    const MotionStepSegment* pBlock = _motionPipeline.peekStepSegNthFromGetConst(0);
+    if (!pBlock || !pBlock->_isExecuting)
+        return false;
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        stepsDone.setVal(axisIdx, axisIdx < numStepperDrivers() ? _curStepCount[axisIdx] : 0);
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Axis position handling
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void RampGenerator::resetTotalStepPosition()
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::resetTotalStepPosition()
 {
     for (int i = 0; i < AXIS_VALUES_MAX_AXES; i++)
     {
         _axisTotalSteps[i] = 0;
         _totalStepsInc[i] = 0;
     }
+    _paAdvanceSteps = 0;
+    _paTargetSteps = 0;
+    _posResetSeqNum = _posResetSeqNum + 1;
 }
-void RampGenerator::getTotalStepPosition(AxesValues<AxisStepsDataType>& actuatorPos) const
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::getTotalStepPosition(AxesValues<AxisStepsDataType>& actuatorPos) const
 {
     for (int i = 0; i < AXIS_VALUES_MAX_AXES; i++)
     {
         actuatorPos.setVal(i, _axisTotalSteps[i]);
     }
 }
-void RampGenerator::setTotalStepPosition(int axisIdx, int32_t stepPos)
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::setTotalStepPosition(int axisIdx, int32_t stepPos)
 {
     if ((axisIdx >= 0) && (axisIdx < AXIS_VALUES_MAX_AXES))
         _axisTotalSteps[axisIdx] = stepPos;
+    _posResetSeqNum = _posResetSeqNum + 1;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // End stop handling
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void RampGenerator::clearEndstopReached()
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::clearEndstopReached()
 {
     _endStopReached = false;
 }
 
-bool RampGenerator::isEndStopReached() const
+template <uint32_t NumAxes, typename DriverT>
+bool RampGeneratorT<NumAxes, DriverT>::isEndStopReached() const
 {
     return _endStopReached;
 }
 
-void RampGenerator::getEndStopStatus(AxisEndstopChecks& axisEndStopVals) const
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::getEndStopStatus(AxisEndstopChecks& axisEndStopVals) const
 {
     // Iterate endstops
     for (int axisIdx = 0; (axisIdx < _axisEndStops.size()) && (axisIdx < AXIS_VALUES_MAX_AXES); axisIdx++)
@@ -223,23 +472,54 @@ void RampGenerator::getEndStopStatus(AxisEndstopChecks& axisEndStopVals) const
 // Tracking progress
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// int RampGenerator::getLastCompletedNumberedCmdIdx()
-// {
-//     return _lastDoneNumberedCmdIdx;
-// }
+/// @brief Get the last completed motion tracking index
+/// @param motionTrackingIdx (out) motion tracking index of the last completed block
+/// @param completedCount (out) number of blocks with a motion tracking index that have completed
+/// @return false if no block with a motion tracking index has completed
+template <uint32_t NumAxes, typename DriverT>
+bool RampGeneratorT<NumAxes, DriverT>::getLastCompletedMotionTrackingIdx(uint32_t& motionTrackingIdx, uint32_t& completedCount) const
+{
+    // Re-read if the ISR completed another block while reading
+    uint32_t countBefore = 0;
+    do {
+        countBefore = _motionTrackingDoneCount;
+        motionTrackingIdx = _lastDoneMotionTrackingIdx;
+    } while (countBefore != _motionTrackingDoneCount);
+    completedCount = countBefore;
+    return completedCount != 0;
+}
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Handle the end of a step for any axis
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool IRAM_ATTR RampGenerator::handleStepEnd()
+template <uint32_t NumAxes, typename DriverT>
+bool IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::handleStepEnd()
 {
     bool anyPinReset = false;
-    for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+
+    // End step pulses on directly driven pins with a single write
+    if (_useFastGPIO)
     {
-        if (_stepperDrivers[axisIdx])
+        uint32_t endedAxes = _fastGPIO.endSteps();
+        for (uint32_t axisIdx = 0; endedAxes != 0; axisIdx++, endedAxes >>= 1)
         {
-            if (_stepperDrivers[axisIdx]->stepEnd())
+            if (endedAxes & 1)
+            {
+                anyPinReset = true;
+                _axisTotalSteps[axisIdx] = _axisTotalSteps[axisIdx] + _totalStepsInc[axisIdx];
+            }
+        }
+    }
+
+    // End step pulses on remaining drivers
+    for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
+    {
+        if (_useFastGPIO && _fastGPIO.hasStepPin(axisIdx))
+            continue;
+        if (isDriverPresent(axisIdx))
+        {
+            if (_stepperDriverPtrs[axisIdx]->stepEnd())
             {
                 anyPinReset = true;
                 _axisTotalSteps[axisIdx] = _axisTotalSteps[axisIdx] + _totalStepsInc[axisIdx];
@@ -252,24 +532,55 @@ bool IRAM_ATTR RampGenerator::handleStepEnd()
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Setup new block
 /// @param pBlock Motion block defines all motion parameters
+/// @param isHandover true if the block starts on the tick the previous block ended (the step and acceleration
+///                   accumulators carry their remainders into this block)
 /// @note This function is called when a new block is added to the pipeline
 ///       It sets up the block for execution recording all the info needed to process the block
-void IRAM_ATTR RampGenerator::setupNewBlock(MotionBlock *pBlock)
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::setupNewBlock(MotionStepSegment *pBlock, bool isHandover)
 {
-    // Setup step counts, direction and endstops for each axis
-    _endStopCheckNum = 0;
-    for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+    // Use the staged setup if it is still valid for this block
+    if (!isStagedFor(pBlock))
+        stageBlockSetup(pBlock);
+    _stagedSetup.pBlock = nullptr;
+
+    // Multi-axis step smoothing level and ISR period scale
+    _amassLevel = _stagedSetup.amassLevel;
+    _amassEventsPerStep = 1 << _amassLevel;
+    _amassMajorEventCount = 0;
+    _amassMajorStepsScaled = _stagedSetup.amassMajorStepsScaled;
+    _isrBlockPeriodScale = _stagedSetup.isrBlockPeriodScale;
+    requestISRPeriodScale(_isrBlockPeriodScale);
+
+    // Setup step counts and direction for each axis
+    _blockDirSetupNs = 0;
+    for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
     {
-        if (!_stepperDrivers[axisIdx])
+        if (!isDriverPresent(axisIdx))
             continue;
         // Total steps
         int32_t stepsTotal = pBlock->_stepsTotalMaybeNeg[axisIdx];
         _stepsTotalAbs[axisIdx] = UTILS_ABS(stepsTotal);
         _curStepCount[axisIdx] = 0;
-        _curAccumulatorRelative[axisIdx] = 0;
-        // Set direction for the axis
-        _stepperDrivers[axisIdx]->setDirection(stepsTotal >= 0);
-        _totalStepsInc[axisIdx] = (stepsTotal >= 0) ? 1 : -1;
+        // Minor axis accumulators start half an event on so that minor axis steps occur on the nearest event to
+        // their ideal position (rather than the next one) and all axes complete on the last major axis step
+        _curAccumulatorRelative[axisIdx] = _stepsTotalAbs[axisIdx] / 2;
+        // Set direction for the axis - if it changes the steps of the axis wait for the direction setup time (the
+        // direction of an axis which doesn't move in the block is left as it is)
+        if (stepsTotal == 0)
+            continue;
+        int32_t stepsInc = (stepsTotal > 0) ? 1 : -1;
+        if ((stepsInc != _totalStepsInc[axisIdx]) && (_dirSetupNs[axisIdx] > 0))
+        {
+            _blockDirSetupNs = UTILS_MAX(_blockDirSetupNs, _dirSetupNs[axisIdx]);
+            if (!_usePulseEngine)
+            {
+                _dirSetupRemainingPeriods[axisIdx] = _dirSetupPeriods[axisIdx];
+                _dirSetupActiveMask = _dirSetupActiveMask | (1 << axisIdx);
+            }
+        }
+        _stepperDriverPtrs[axisIdx]->setDirection(stepsTotal > 0);
+        _totalStepsInc[axisIdx] = stepsInc;
 
 #ifdef DEBUG_SETUP_NEW_BLOCK
         if (!_useRampGenTimer)
@@ -281,79 +592,592 @@ void IRAM_ATTR RampGenerator::setupNewBlock(MotionBlock *pBlock)
 
         // Instrumentation
         _stats.stepDirn(axisIdx, stepsTotal >= 0);
+    }
+
+    // End stops - arm the latches of interrupt-driven endstops (an endstop already active is latched as hit
+    // immediately)
+    _endStopCheckNum = _stagedSetup.endStopCheckNum;
+    for (uint32_t checkIdx = 0; checkIdx < _stagedSetup.endStopCheckNum; checkIdx++)
+    {
+        _endStopChecks[checkIdx].axisIdx = _stagedSetup.endStopChecks[checkIdx].axisIdx;
+        _endStopChecks[checkIdx].isMax = _stagedSetup.endStopChecks[checkIdx].isMax;
+        _endStopChecks[checkIdx].checkHit = _stagedSetup.endStopChecks[checkIdx].checkHit;
+    }
+    EndStops::armLatches(_stagedSetup.latchHitMask);
+    _endStopLatchHitMask = _stagedSetup.latchHitMask;
+    _endStopLatchNotHitMask = _stagedSetup.latchNotHitMask;
+
+    // Accumulator reset - the acceleration tick accumulator starts half a tick in so that the step rate changes
+    // at the mid-points of the ideal (linear) ramp rather than lagging it by half a tick - on a handover the
+    // accumulators keep their remainders so that step and acceleration timing is continuous across the boundary
+    if (!isHandover)
+    {
+        _curAccumulatorStep = 0;
+        _curAccumulatorNS = _accelTickNs / 2;
+    }
+    _stepEndElapsedPeriods = 0;
+
+    // Rates scaled by the feed override (if reduced since the block was prepared)
+    applyFeedOverride(pBlock);
+
+    // Step rate - a feed hold deceleration continues from the same fraction of the planned rate
+    _curStepRatePerTTicks = pBlock->_initialStepRatePerTTicks;
+    if (_curRatesOverridden)
+        _curStepRatePerTTicks = (uint64_t(_curStepRatePerTTicks) * _appliedFeedOverridePercent) / pBlock->_feedOverridePercent;
+    if (_holdState == HOLD_DECELERATING)
+        _curStepRatePerTTicks = (uint64_t(_curStepRatePerTTicks) * _holdRateRatioQ16) >> 16;
+    _curAccStepsPerTTicksPerMS = 0;
+    _curRampDecelerating = false;
+
+    // Pressure advance target from the initial rate (the advance carries over from the previous block)
+    if (pBlock->_paFactorQ32 != 0)
+    {
+        _paAxisIdx = pBlock->_paAxisIdx;
+        updatePressureAdvanceTarget(pBlock);
+    }
+    _shaperPhaseTicks = 0;
+
+    // Trace
+    _trace.record(RampGenTrace::EVENT_BLOCK_START, pBlock->getMotionTrackingIndex(), pBlock->isMotionTrackingIndexValid(),
+                _curStepRatePerTTicks, _motionPipeline.count(), pBlock->_axisIdxWithMaxSteps);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Stage the setup of a block
+/// @param pBlock Motion block defines all motion parameters
+/// @note Computes the parts of the setup which don't change the state of the executing block (step smoothing
+///       level, ISR period scale and end stop checks) so that they can be applied when the block starts
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::stageBlockSetup(const MotionStepSegment *pBlock)
+{
+    // Values the setup depends on (checked when the setup is used)
+    _stagedSetup.pBlock = pBlock;
+    _stagedSetup.maxStepRatePerTTicks = pBlock->_maxStepRatePerTTicks;
+    _stagedSetup.endStopsToCheckRaw = pBlock->_endStopsToCheck.getRawValue();
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        _stagedSetup.stepsTotalMaybeNeg[axisIdx] = pBlock->_stepsTotalMaybeNeg[axisIdx];
+
+    // Multi-axis step smoothing level - the highest level for which the step event rate at
+    // the block's max step rate remains within the limit
+    uint32_t amassLevel = 0;
+    uint32_t maxStepRatePerTTicks = UTILS_MAX(pBlock->_maxStepRatePerTTicks, _minStepRatePerTTicks);
+    while ((amassLevel < _amassMaxLevel) && 
+                ((uint64_t(maxStepRatePerTTicks) << (amassLevel + 1)) <= AMASS_MAX_EVENT_RATE_PER_TTICKS))
+        amassLevel = amassLevel + 1;
+    _stagedSetup.amassLevel = amassLevel;
+    _stagedSetup.amassMajorStepsScaled = uint32_t(UTILS_ABS(pBlock->_stepsTotalMaybeNeg[pBlock->_axisIdxWithMaxSteps])) << amassLevel;
+
+    // ISR period scale - limited by the step event rate per ISR interval and by the acceleration tick
+    uint64_t maxEventRatePerTTicks = uint64_t(maxStepRatePerTTicks) << amassLevel;
+    uint32_t isrPeriodScale = UTILS_MIN(_isrIdlePeriodScale, _accelTickNs / _stepGenPeriodNs);
+    if (maxEventRatePerTTicks * isrPeriodScale > AMASS_MAX_EVENT_RATE_PER_TTICKS)
+        isrPeriodScale = uint32_t(AMASS_MAX_EVENT_RATE_PER_TTICKS / maxEventRatePerTTicks);
+    _stagedSetup.isrBlockPeriodScale = UTILS_MAX(isrPeriodScale, 1);
+
+    // End stops to check for each axis
+    uint32_t endStopCheckNum = 0;
+    uint32_t latchHitMask = 0;
+    uint32_t latchNotHitMask = 0;
+    for (uint32_t axisIdx = 0; (axisIdx < numStepperDrivers()) && pBlock->_endStopsToCheck.any(); axisIdx++)
+    {
+        if (!isDriverPresent(axisIdx))
+            continue;
+        int32_t stepsTotal = pBlock->_stepsTotalMaybeNeg[axisIdx];
 
-        // Check if any endstops to setup
-        if (pBlock->_endStopsToCheck.any())
-        { 
-            // Check if the axis is moving in a direction which might result in hitting an active end-stop
-            for (int minMaxIdx = 0; minMaxIdx < AXIS_VALUES_MAX_ENDSTOPS_PER_AXIS; minMaxIdx++)
+        // Check if the axis is moving in a direction which might result in hitting an active end-stop
+        for (uint32_t minMaxIdx = 0; minMaxIdx < AXIS_VALUES_MAX_ENDSTOPS_PER_AXIS; minMaxIdx++)
+        {
+            // See if anything to check for
+            AxisEndstopChecks::AxisMinMaxEnum minMaxType = pBlock->_endStopsToCheck.get(axisIdx, minMaxIdx);
+            if (minMaxType == AxisEndstopChecks::END_STOP_NONE)
+                continue;
+
+            // Check for towards - this is different from MAX or MIN because the axis will still move even if
+            // an endstop is hit if the movement is away from that endstop
+            if (minMaxType == AxisEndstopChecks::END_STOP_TOWARDS)
             {
-                // See if anything to check for
-                AxisEndstopChecks::AxisMinMaxEnum minMaxType = pBlock->_endStopsToCheck.get(axisIdx, minMaxIdx);
-                if (minMaxType == AxisEndstopChecks::END_STOP_NONE)
+                // Stop at max if we're heading towards max OR
+                // stop at min if we're heading towards min
+                if (!(((minMaxIdx == AxisEndstopChecks::MAX_VAL_IDX) && (stepsTotal > 0)) ||
+                        ((minMaxIdx == AxisEndstopChecks::MIN_VAL_IDX) && (stepsTotal < 0))))
                     continue;
-
-                // Check for towards - this is different from MAX or MIN because the axis will still move even if
-                // an endstop is hit if the movement is away from that endstop
-                if (minMaxType == AxisEndstopChecks::END_STOP_TOWARDS)
+            }
+            
+            // Config for end stop
+            if ((axisIdx < _axisEndStops.size()) && (_axisEndStops[axisIdx]) && (endStopCheckNum < MAX_END_STOP_CHECKS))
+            {
+                bool isMax = minMaxIdx == AxisEndstopChecks::MAX_VAL_IDX;
+                bool isValid = _axisEndStops[axisIdx]->isValid(isMax);
+                bool checkHit = minMaxType != AxisEndstopChecks::END_STOP_NOT_HIT;
+                if (isValid && _axisEndStops[axisIdx]->isInterruptDriven(isMax))
                 {
-                    // Stop at max if we're heading towards max OR
-                    // stop at min if we're heading towards min
-                    if (!(((minMaxIdx == AxisEndstopChecks::MAX_VAL_IDX) && (stepsTotal > 0)) ||
-                            ((minMaxIdx == AxisEndstopChecks::MIN_VAL_IDX) && (stepsTotal < 0))))
-                        continue;
+                    if (checkHit)
+                        latchHitMask |= EndStops::getLatchBit(axisIdx, isMax);
+                    else
+                        latchNotHitMask |= EndStops::getLatchBit(axisIdx, isMax);
                 }
-                
-                // Config for end stop
-                if ((axisIdx <= _axisEndStops.size()) && (_axisEndStops[axisIdx]))
+                else if (isValid)
                 {
-                    bool isValid = _axisEndStops[axisIdx]->isValid(minMaxIdx == AxisEndstopChecks::MAX_VAL_IDX);
-                    if (isValid)
-                    {
-                        _endStopChecks[_endStopCheckNum].axisIdx = axisIdx;
-                        _endStopChecks[_endStopCheckNum].checkHit = minMaxType != AxisEndstopChecks::END_STOP_NOT_HIT;
-                        _endStopCheckNum = _endStopCheckNum + 1;
-                    }
+                    _stagedSetup.endStopChecks[endStopCheckNum].axisIdx = axisIdx;
+                    _stagedSetup.endStopChecks[endStopCheckNum].isMax = isMax;
+                    _stagedSetup.endStopChecks[endStopCheckNum].checkHit = checkHit;
+                    endStopCheckNum = endStopCheckNum + 1;
                 }
             }
         }
     }
+    _stagedSetup.endStopCheckNum = endStopCheckNum;
+    _stagedSetup.latchHitMask = latchHitMask;
+    _stagedSetup.latchNotHitMask = latchNotHitMask;
+}
 
-    // Accumulator reset
-    _curAccumulatorStep = 0;
-    _curAccumulatorNS = 0;
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if the staged setup is valid for a block
+/// @param pBlock Motion block
+/// @return true if the setup was staged for this block and the block hasn't changed since
+template <uint32_t NumAxes, typename DriverT>
+bool IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::isStagedFor(const MotionStepSegment *pBlock) const
+{
+    if ((_stagedSetup.pBlock != pBlock) || (_stagedSetup.maxStepRatePerTTicks != pBlock->_maxStepRatePerTTicks) ||
+                (_stagedSetup.endStopsToCheckRaw != pBlock->_endStopsToCheck.getRawValue()))
+        return false;
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        if (_stagedSetup.stepsTotalMaybeNeg[axisIdx] != pBlock->_stepsTotalMaybeNeg[axisIdx])
+            return false;
+    }
+    return true;
+}
 
-    // Step rate
-    _curStepRatePerTTicks = pBlock->_initialStepRatePerTTicks;
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Stage the setup of the block following the executing block (if it can execute and isn't staged)
+/// @note Called on ticks without a step event
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::stageNextBlock()
+{
+    MotionStepSegment *pNextBlock = _motionPipeline.peekGetNext();
+    if (pNextBlock && pNextBlock->_canExecute && !isStagedFor(pNextBlock))
+        stageBlockSetup(pNextBlock);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start the next block on the tick the previous block ended (zero-gap block transition)
+/// @return true if the next block has started
+/// @note The block must be able to execute without waiting (no scheduled start time) and motion mustn't be
+///       stopping or held - a block which changes the direction of any axis also starts on a later tick so that
+///       the direction isn't changed while a step pulse is active
+template <uint32_t NumAxes, typename DriverT>
+bool IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::handoverToNextBlock()
+{
+    if (_stopPending || _isPaused || (_holdState != HOLD_NONE))
+        return false;
+    MotionStepSegment *pNextBlock = _motionPipeline.peekGet();
+    if (!pNextBlock || !pNextBlock->_canExecute || pNextBlock->_isExecuting || pNextBlock->_startTimeValid ||
+                blockChangesDirection(pNextBlock))
+        return false;
+    pNextBlock->_isExecuting = true;
+    setupNewBlock(pNextBlock, true);
+    _blockHandoverCount = _blockHandoverCount + 1;
+    return true;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Update the motion block time accumulators to handle acceleration and deceleration
 /// @param pBlock Motion block defines all motion parameters
-void IRAM_ATTR RampGenerator::updateMSAccumulator(MotionBlock *pBlock)
+/// @param elapsedNs Time since the last update (ns)
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::updateMSAccumulator(MotionStepSegment *pBlock, uint32_t elapsedNs)
 {
-    // Bump the millisec accumulator
-    _curAccumulatorNS = _curAccumulatorNS + _stepGenPeriodNs;
+    // Bump the acceleration tick accumulator (the elapsed time is never more than an acceleration tick)
+    _curAccumulatorNS = _curAccumulatorNS + elapsedNs;
 
-    // Check for millisec accumulator overflow
-    if (_curAccumulatorNS >= MotionBlock::NS_IN_A_MS)
+    // Check for acceleration tick (1ms by default)
+    if (_curAccumulatorNS >= _accelTickNs)
     {
         // Subtract from accumulator leaving remainder to combat rounding errors
-        _curAccumulatorNS = _curAccumulatorNS - MotionBlock::NS_IN_A_MS;
+        _curAccumulatorNS = _curAccumulatorNS - _accelTickNs;
 
-        // Check if decelerating
-        if (_curStepCount[pBlock->_axisIdxWithMaxSteps] > pBlock->_stepsBeforeDecel)
+        // Accelerate or decelerate
+        uint32_t prevRate = _curStepRatePerTTicks;
+        applyMSRateChange(pBlock);
+        setMotionPhaseFromRates(prevRate, _curStepRatePerTTicks);
+        updatePressureAdvanceTarget(pBlock);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Apply one acceleration tick of acceleration or deceleration to the current step rate
+/// @param pBlock Motion block defines all motion parameters
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::applyMSRateChange(MotionStepSegment *pBlock)
+{
+    // Check for a change of feed override
+    if (_appliedFeedOverridePercent != _feedOverridePercent)
+        applyFeedOverride(pBlock);
+
+    // Check for feed hold - a block which hasn't yet stepped follows its own profile until its first step so that
+    // a hold followed by a resume (and replan from standstill) always makes forward progress
+    if ((_holdState == HOLD_DECELERATING) && (_curStepCount[pBlock->_axisIdxWithMaxSteps] != 0))
+    {
+        applyMSHoldDecel(pBlock);
+        return;
+    }
+
+    // Decelerate to the max rate if it has been reduced by the feed override
+    uint32_t maxRate = UTILS_MAX(_minStepRatePerTTicks, _curMaxStepRatePerTTicks);
+    if (_curRatesOverridden && (_curStepRatePerTTicks > maxRate))
+    {
+        if (_curStepRatePerTTicks > maxRate + pBlock->_accStepsPerTTicksPerMS)
+            _curStepRatePerTTicks = _curStepRatePerTTicks - pBlock->_accStepsPerTTicksPerMS;
+        else
+            _curStepRatePerTTicks = maxRate;
+        return;
+    }
+
+    // Check for jerk-limited profile
+    if (pBlock->_jerkAccStepsPerTTicksPerMS != 0)
+    {
+        applyMSRateChangeJerkLimited(pBlock);
+        return;
+    }
+
+    // Check for input shaping
+    if (pBlock->_shaperNumImpulses > 1)
+    {
+        applyMSRateChangeShaped(pBlock);
+        return;
+    }
+
+    // Check if decelerating - the rate is clamped to the final (or max) rate so that the last tick of a ramp
+    // doesn't overshoot it
+    if (_curStepCount[pBlock->_axisIdxWithMaxSteps] > pBlock->_stepsBeforeDecel)
+    {
+        uint32_t lowRate = UTILS_MAX(_minStepRatePerTTicks, _curFinalStepRatePerTTicks);
+        if (_curStepRatePerTTicks > lowRate + pBlock->_accStepsPerTTicksPerMS)
+            _curStepRatePerTTicks = _curStepRatePerTTicks - pBlock->_accStepsPerTTicksPerMS;
+        else if (_curStepRatePerTTicks > lowRate)
+            _curStepRatePerTTicks = lowRate;
+    }
+    else if ((_curStepRatePerTTicks < _minStepRatePerTTicks) || (_curStepRatePerTTicks < _curMaxStepRatePerTTicks))
+    {
+        uint32_t highRate = UTILS_MAX(_minStepRatePerTTicks, _curMaxStepRatePerTTicks);
+        if (_curStepRatePerTTicks + pBlock->_accStepsPerTTicksPerMS < highRate)
+            _curStepRatePerTTicks = _curStepRatePerTTicks + pBlock->_accStepsPerTTicksPerMS;
+        else if (highRate < MotionBlock::TTICKS_VALUE)
+            _curStepRatePerTTicks = highRate;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Apply the feed override to the rates of the executing block
+/// @param pBlock Motion block defines all motion parameters
+/// @note If the override is lower than the one the block was prepared with the max and final rates are scaled down
+///       by the ratio (so the block never ends faster than planned) - an override higher than the one the block was
+///       prepared with is applied by the planner when it re-prepares the blocks which aren't executing
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::applyFeedOverride(MotionStepSegment *pBlock)
+{
+    uint32_t feedOverridePercent = _feedOverridePercent;
+    _appliedFeedOverridePercent = feedOverridePercent;
+    _curRatesOverridden = pBlock->_feedOverridePercent > feedOverridePercent;
+    if (!_curRatesOverridden)
+    {
+        _curMaxStepRatePerTTicks = pBlock->_maxStepRatePerTTicks;
+        _curFinalStepRatePerTTicks = pBlock->_finalStepRatePerTTicks;
+        return;
+    }
+    _curMaxStepRatePerTTicks = (uint64_t(pBlock->_maxStepRatePerTTicks) * feedOverridePercent) / pBlock->_feedOverridePercent;
+    _curFinalStepRatePerTTicks = (uint64_t(pBlock->_finalStepRatePerTTicks) * feedOverridePercent) / pBlock->_feedOverridePercent;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Apply one acceleration tick of feed hold deceleration
+/// @param pBlock Motion block defines all motion parameters
+/// @note The block's own acceleration is used (so the axis limits are respected) and the rate is never
+///       increased so it stays at or below the planned profile (which also decelerates at this rate)
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::applyMSHoldDecel(MotionStepSegment *pBlock)
+{
+    if (_curStepRatePerTTicks > _minStepRatePerTTicks + pBlock->_accStepsPerTTicksPerMS)
+        _curStepRatePerTTicks = _curStepRatePerTTicks - pBlock->_accStepsPerTTicksPerMS;
+    else
+        _curStepRatePerTTicks = _minStepRatePerTTicks;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if a feed hold deceleration is complete (and hold if so)
+/// @param pBlock Motion block being executed (nullptr if none)
+/// @return true if held
+/// @note The executing block is only held once it has stepped at least once
+template <uint32_t NumAxes, typename DriverT>
+bool IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::checkHoldComplete(MotionStepSegment *pBlock)
+{
+    if (_holdState != HOLD_DECELERATING)
+        return _holdState == HOLD_HELD;
+    if (pBlock && ((_curStepCount[pBlock->_axisIdxWithMaxSteps] == 0) || (_curStepRatePerTTicks > _minStepRatePerTTicks)))
+        return false;
+    _holdState = HOLD_HELD;
+    if (pBlock)
+        _trace.record(RampGenTrace::EVENT_BLOCK_HELD, pBlock->getMotionTrackingIndex(), pBlock->isMotionTrackingIndexValid(),
+                    _curStepRatePerTTicks, _motionPipeline.count(), pBlock->_axisIdxWithMaxSteps);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Flush the pipeline (the executing block is cancelled)
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::flushPipeline()
+{
+    MotionStepSegment *pBlock = _motionPipeline.peekGet();
+    if (pBlock && pBlock->_isExecuting)
+        endMotion(pBlock, RampGenTrace::EVENT_BLOCK_CANCELLED);
+    while (_motionPipeline.canGet())
+        _motionPipeline.remove();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Apply one acceleration tick of a jerk-limited (S-curve) acceleration or deceleration
+/// @param pBlock Motion block defines all motion parameters
+/// @note The acceleration is ramped up (or down) by the jerk each tick and starts ramping down when it is
+///       time to blend into the target rate - each phase starts from zero acceleration
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::applyMSRateChangeJerkLimited(MotionStepSegment *pBlock)
+{
+    // Check for change between acceleration and deceleration phases
+    bool isDecelerating = _curStepCount[pBlock->_axisIdxWithMaxSteps] > pBlock->_stepsBeforeDecel;
+    if (isDecelerating != _curRampDecelerating)
+    {
+        _curRampDecelerating = isDecelerating;
+        _curAccStepsPerTTicksPerMS = 0;
+    }
+
+    // Decelerate towards the final rate or accelerate towards the max rate
+    if (isDecelerating)
+    {
+        uint32_t lowRate = UTILS_MAX(_minStepRatePerTTicks, _curFinalStepRatePerTTicks);
+        if (_curStepRatePerTTicks <= lowRate)
+            return;
+        uint32_t rateChange = nextJerkLimitedRateChange(pBlock, _curStepRatePerTTicks - lowRate);
+        if (_curStepRatePerTTicks > lowRate + rateChange)
+            _curStepRatePerTTicks = _curStepRatePerTTicks - rateChange;
+        else
+            _curStepRatePerTTicks = lowRate;
+    }
+    else
+    {
+        uint32_t highRate = UTILS_MIN(UTILS_MAX(_minStepRatePerTTicks, _curMaxStepRatePerTTicks), 
+                    MotionBlock::TTICKS_VALUE - 1);
+        if (_curStepRatePerTTicks >= highRate)
+            return;
+        uint32_t rateChange = nextJerkLimitedRateChange(pBlock, highRate - _curStepRatePerTTicks);
+        if (_curStepRatePerTTicks + rateChange < highRate)
+            _curStepRatePerTTicks = _curStepRatePerTTicks + rateChange;
+        else
+            _curStepRatePerTTicks = highRate;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Apply one acceleration tick of input shaped acceleration or deceleration
+/// @param pBlock Motion block defines all motion parameters
+/// @note The rate follows the constant acceleration ramp (of the whole change to the target rate) convolved with the
+///       shaper impulses - the change after k ticks is the sum over the impulses of the impulse amplitude multiplied
+///       by the unshaped change k ticks after the impulse (limited to the whole change) so the ramp is exact however
+///       short the change is compared with the shaper duration
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::applyMSRateChangeShaped(MotionStepSegment *pBlock)
+{
+    // Target rate
+    bool isDecelerating = _curStepCount[pBlock->_axisIdxWithMaxSteps] > pBlock->_stepsBeforeDecel;
+    uint32_t targetRate = isDecelerating ? UTILS_MAX(_minStepRatePerTTicks, _curFinalStepRatePerTTicks) :
+                UTILS_MIN(UTILS_MAX(_minStepRatePerTTicks, _curMaxStepRatePerTTicks), MotionBlock::TTICKS_VALUE - 1);
+
+    // A new ramp starts from the current rate on a change between acceleration and deceleration phases, a change
+    // of target (feed override) or if the rate has been changed other than by the ramp (e.g. a feed hold)
+    if ((isDecelerating != _curRampDecelerating) || (targetRate != _shaperRampTargetRate) ||
+                (_curStepRatePerTTicks != _shaperRampRate))
+    {
+        _curRampDecelerating = isDecelerating;
+        _shaperRampTargetRate = targetRate;
+        _shaperPhaseTicks = 0;
+    }
+    if (_curStepRatePerTTicks == targetRate)
+        return;
+    if (_shaperPhaseTicks == 0)
+    {
+        _shaperRampStartRate = _curStepRatePerTTicks;
+        _shaperRampChange = targetRate > _curStepRatePerTTicks ? targetRate - _curStepRatePerTTicks :
+                    _curStepRatePerTTicks - targetRate;
+    }
+    if (_shaperPhaseTicks < UINT16_MAX)
+        _shaperPhaseTicks = _shaperPhaseTicks + 1;
+
+    // Change so far - the impulse amplitudes are the steps in the levels (the last level is full acceleration)
+    uint64_t changeQ16 = 0;
+    uint32_t prevLevelQ16 = 0;
+    for (uint32_t impulseIdx = 0; impulseIdx < pBlock->_shaperNumImpulses; impulseIdx++)
+    {
+        uint32_t impulseTicks = impulseIdx > 0 ? pBlock->_shaperImpulseTicks[impulseIdx - 1] : 0;
+        uint32_t levelQ16 = impulseIdx + 1 < pBlock->_shaperNumImpulses ? pBlock->_shaperLevelsQ16[impulseIdx] :
+                    MotionStepSegment::SHAPER_LEVEL_Q16_ONE;
+        if (_shaperPhaseTicks > impulseTicks)
+        {
+            uint64_t unshapedChange = uint64_t(pBlock->_accStepsPerTTicksPerMS) * (_shaperPhaseTicks - impulseTicks);
+            changeQ16 += UTILS_MIN(unshapedChange, uint64_t(_shaperRampChange)) * (levelQ16 - prevLevelQ16);
+        }
+        prevLevelQ16 = levelQ16;
+    }
+
+    // Apply (the target is reached once the ramp after the last impulse is complete)
+    uint32_t change = changeQ16 >> 16;
+    if (change >= _shaperRampChange)
+        _curStepRatePerTTicks = targetRate;
+    else if (_shaperRampStartRate > targetRate)
+        _curStepRatePerTTicks = _shaperRampStartRate - change;
+    else
+        _curStepRatePerTTicks = _shaperRampStartRate + change;
+    _shaperRampRate = _curStepRatePerTTicks;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the rate change for the next acceleration tick of a jerk-limited profile (and update the acceleration)
+/// @param pBlock Motion block defines all motion parameters
+/// @param rateChangeRemaining Change in rate required to reach the target rate
+/// @return Rate change for the tick
+/// @note The acceleration changes linearly over the tick so the rate change is the average of the accelerations at
+///       the start and end of the tick (using the end acceleration would run half a tick ahead of the ideal ramp)
+template <uint32_t NumAxes, typename DriverT>
+uint32_t IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::nextJerkLimitedRateChange(MotionStepSegment *pBlock, uint32_t rateChangeRemaining)
+{
+    uint32_t prevAcc = _curAccStepsPerTTicksPerMS;
+    uint32_t acc = nextJerkLimitedAcc(prevAcc, pBlock->_accStepsPerTTicksPerMS, pBlock->_jerkAccStepsPerTTicksPerMS,
+                rateChangeRemaining);
+    _curAccStepsPerTTicksPerMS = acc;
+    return (prevAcc + acc + 1) / 2;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the acceleration for the next acceleration tick of a jerk-limited profile
+/// @param curAcc Current acceleration
+/// @param maxAcc Max acceleration
+/// @param jerk Change in acceleration per tick
+/// @param rateChangeRemaining Change in rate required to reach the target rate
+/// @return Acceleration for the next ms
+template <uint32_t NumAxes, typename DriverT>
+uint32_t IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::nextJerkLimitedAcc(uint32_t curAcc, uint32_t maxAcc, uint32_t jerk, uint32_t rateChangeRemaining)
+{
+    // The rate change while reducing the acceleration to zero is curAcc * (curAcc + jerk) / (2 * jerk) so
+    // start reducing once this reaches the change remaining (multiply rather than divide as this is an ISR)
+    if (uint64_t(curAcc) * (curAcc + jerk) >= 2 * uint64_t(jerk) * rateChangeRemaining)
+        return curAcc > jerk ? curAcc - jerk : jerk;
+    return UTILS_MIN(curAcc + jerk, UTILS_MAX(maxAcc, jerk));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check endstops set up for the current block
+/// @return true if any endstop condition is met
+template <uint32_t NumAxes, typename DriverT>
+bool IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::isEndStopHit()
+{
+    // Interrupt-driven endstops - hits are latched so a pulse between ticks is not missed
+    if ((EndStops::getLatchedMask() & _endStopLatchHitMask) || (~EndStops::getActiveMask() & _endStopLatchNotHitMask))
+        return true;
+
+    // Polled endstops
+    bool endStopHit = false;
+    for (int i = 0; i < _endStopCheckNum; i++)
+    {
+        EndStops* pEndStops = _axisEndStops[_endStopChecks[i].axisIdx];
+        if (pEndStops->isAtEndStop(_endStopChecks[i].isMax) == _endStopChecks[i].checkHit)
+            endStopHit = true;
+    }
+    return endStopHit;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start a step on an axis
+/// @param axisIdx Axis index
+/// @note Directly driven pins are only queued here and are set together in handleStepMotion
+///       and with a hardware pulse engine the step is added to the current chunk at the current step time
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::stepAxis(uint32_t axisIdx)
+{
+    if (_usePulseEngine)
+        _pPulseEngine->addStep(axisIdx, _totalStepsInc[axisIdx]);
+    else if (_useFastGPIO && _fastGPIO.hasStepPin(axisIdx))
+        _fastGPIO.queueStep(axisIdx);
+    else if (isDriverPresent(axisIdx))
+        _stepperDriverPtrs[axisIdx]->stepStart();
+    _isrStepStarted = true;
+    _isrStepAxesMask = _isrStepAxesMask | (1 << axisIdx);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Step an axis unless the direction setup time of the axis is still elapsing (the step is then deferred)
+/// @param axisIdx Axis index
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::stepAxisAfterDirSetup(uint32_t axisIdx)
+{
+    if ((_dirSetupActiveMask & (1 << axisIdx)) && (_dirSetupRemainingPeriods[axisIdx] > 0))
+    {
+        _dirSetupDeferredSteps[axisIdx] = _dirSetupDeferredSteps[axisIdx] + 1;
+        return;
+    }
+    stepAxis(axisIdx);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Count down the direction setup time of axes whose direction has changed
+/// @param elapsedPeriods Step generation periods since the last call
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::updateDirSetupPeriods(uint32_t elapsedPeriods)
+{
+    for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
+    {
+        if (!(_dirSetupActiveMask & (1 << axisIdx)))
+            continue;
+        uint32_t remaining = _dirSetupRemainingPeriods[axisIdx];
+        _dirSetupRemainingPeriods[axisIdx] = remaining > elapsedPeriods ? remaining - elapsedPeriods : 0;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Output steps deferred while the direction setup time elapsed
+/// @return true if any axis still has deferred steps
+/// @note One step is output on each axis whose setup time has elapsed unless the axis has already stepped on
+///       this tick
+template <uint32_t NumAxes, typename DriverT>
+bool IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::releaseDeferredSteps()
+{
+    bool anyDeferred = false;
+    bool anyReleased = false;
+    uint32_t activeMask = _dirSetupActiveMask;
+    for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
+    {
+        uint32_t axisBit = 1 << axisIdx;
+        if (!(activeMask & axisBit) || (_dirSetupRemainingPeriods[axisIdx] > 0))
         {
-            if (_curStepRatePerTTicks > UTILS_MAX(_minStepRatePerTTicks + pBlock->_accStepsPerTTicksPerMS,
-                                                 pBlock->_finalStepRatePerTTicks + pBlock->_accStepsPerTTicksPerMS))
-                _curStepRatePerTTicks = _curStepRatePerTTicks - pBlock->_accStepsPerTTicksPerMS;
+            anyDeferred = anyDeferred || ((activeMask & axisBit) && (_dirSetupDeferredSteps[axisIdx] > 0));
+            continue;
         }
-        else if ((_curStepRatePerTTicks < _minStepRatePerTTicks) || (_curStepRatePerTTicks < pBlock->_maxStepRatePerTTicks))
+        if ((_dirSetupDeferredSteps[axisIdx] > 0) && !(_isrStepAxesMask & axisBit))
         {
-            if (_curStepRatePerTTicks + pBlock->_accStepsPerTTicksPerMS < MotionBlock::TTICKS_VALUE)
-                _curStepRatePerTTicks = _curStepRatePerTTicks + pBlock->_accStepsPerTTicksPerMS;
+            stepAxis(axisIdx);
+            _stats.stepStart(axisIdx);
+            _dirSetupDeferredSteps[axisIdx] = _dirSetupDeferredSteps[axisIdx] - 1;
+            anyReleased = true;
         }
+        if (_dirSetupDeferredSteps[axisIdx] > 0)
+            anyDeferred = true;
+        else
+            activeMask = activeMask & ~axisBit;
     }
+    _dirSetupActiveMask = activeMask;
+
+    // Start directly driven step pulses
+    if (anyReleased && _useFastGPIO)
+        _fastGPIO.applySteps();
+    return anyDeferred;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -361,29 +1185,52 @@ void IRAM_ATTR RampGenerator::updateMSAccumulator(MotionBlock *pBlock)
 /// @param pBlock Motion block defines all motion parameters
 /// @return true if any axis is still moving
 /// @note Handle the start of step on each axis
-bool IRAM_ATTR RampGenerator::handleStepMotion(MotionBlock *pBlock)
+template <uint32_t NumAxes, typename DriverT>
+bool IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::handleStepMotion(MotionStepSegment *pBlock)
 {
     // Complete Flag
     bool anyAxisMoving = false;
 
     // Axis with most steps
-    int axisIdxMaxSteps = pBlock->_axisIdxWithMaxSteps;
-    if ((axisIdxMaxSteps < 0) || (axisIdxMaxSteps >= _stepperDrivers.size()))
+    uint32_t axisIdxMaxSteps = pBlock->_axisIdxWithMaxSteps;
+    if (axisIdxMaxSteps >= numStepperDrivers())
         return false;
 
-    // Subtract from accumulator leaving remainder
-    _curAccumulatorStep = _curAccumulatorStep - MotionBlock::TTICKS_VALUE;
+    // With step smoothing the axis with the greatest step count only steps on the last of every _amassEventsPerStep
+    // events (so its steps are at the same positions as without smoothing) and the minor axes are evaluated on every
+    // event
+    _amassMajorEventCount = _amassMajorEventCount + 1;
+    bool isMajorStepEvent = _amassMajorEventCount >= _amassEventsPerStep;
+    if (isMajorStepEvent)
+        _amassMajorEventCount = 0;
+    else if (_curStepCount[axisIdxMaxSteps] < _stepsTotalAbs[axisIdxMaxSteps])
+        anyAxisMoving = true;
 
     // Step the axis with the greatest step count if needed
-    if (_curStepCount[axisIdxMaxSteps] < _stepsTotalAbs[axisIdxMaxSteps])
+    if (isMajorStepEvent && (_curStepCount[axisIdxMaxSteps] < _stepsTotalAbs[axisIdxMaxSteps]))
     {
         // Step this axis
-        if (_stepperDrivers[axisIdxMaxSteps])
-            _stepperDrivers[axisIdxMaxSteps]->stepStart();
+        stepAxisAfterDirSetup(axisIdxMaxSteps);
         _curStepCount[axisIdxMaxSteps] = _curStepCount[axisIdxMaxSteps] + 1;
         if (_curStepCount[axisIdxMaxSteps] < _stepsTotalAbs[axisIdxMaxSteps])
             anyAxisMoving = true;
 
+        // Deceleration of a trapezoidal ramp starts after this step - the acceleration tick accumulator is re-phased
+        // to half a tick (as at the start of a block) so the rate changes at the mid-points of the ideal deceleration
+        // ramp - otherwise the ramp lags the ideal by up to a tick and ends short of the block's last steps
+        if ((_curStepCount[axisIdxMaxSteps] == pBlock->_stepsBeforeDecel + 1) && (_holdState == HOLD_NONE) &&
+                    (pBlock->_jerkAccStepsPerTTicksPerMS == 0) && (pBlock->_shaperNumImpulses <= 1))
+        {
+            _curAccumulatorNS = _accelTickNs / 2;
+
+            // The ideal ramp is at the peak rate where deceleration starts but an acceleration phase which ends
+            // part way through a tick leaves the rate short of it (by up to a tick of acceleration) and the
+            // deceleration ramp would then end steps short of the end of the block
+            if ((_curStepRatePerTTicks < _curMaxStepRatePerTTicks) &&
+                        (_curStepRatePerTTicks + pBlock->_accStepsPerTTicksPerMS >= _curMaxStepRatePerTTicks))
+                _curStepRatePerTTicks = _curMaxStepRatePerTTicks;
+        }
+
         // Instrumentation
         _stats.stepStart(axisIdxMaxSteps);
 
@@ -398,22 +1245,22 @@ bool IRAM_ATTR RampGenerator::handleStepMotion(MotionBlock *pBlock)
     }
 
     // Check if other axes need stepping
-    for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+    for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
     {
-        // Skip the axis with the most steps and axes already at their target
-        if ((axisIdx == axisIdxMaxSteps) || (_curStepCount[axisIdx] == _stepsTotalAbs[axisIdx]))
+        // Skip the axis with the most steps, a pressure advance axis (stepped below) and axes already at their target
+        if ((axisIdx == axisIdxMaxSteps) || (axisIdx == uint32_t(pBlock->_paAxisIdx)) || 
+                    (_curStepCount[axisIdx] == _stepsTotalAbs[axisIdx]))
             continue;
 
         // Bump the relative accumulator
         _curAccumulatorRelative[axisIdx] = _curAccumulatorRelative[axisIdx] + _stepsTotalAbs[axisIdx];
-        if (_curAccumulatorRelative[axisIdx] >= _stepsTotalAbs[axisIdxMaxSteps])
+        if (_curAccumulatorRelative[axisIdx] >= _amassMajorStepsScaled)
         {
             // Do the remainder calculation
-            _curAccumulatorRelative[axisIdx] = _curAccumulatorRelative[axisIdx] - _stepsTotalAbs[axisIdxMaxSteps];
+            _curAccumulatorRelative[axisIdx] = _curAccumulatorRelative[axisIdx] - _amassMajorStepsScaled;
 
             // Step the axis
-            if (_stepperDrivers[axisIdx])
-                _stepperDrivers[axisIdx]->stepStart();
+            stepAxisAfterDirSetup(axisIdx);
 
 #ifdef DEBUG_MOTION_PULSE_GEN
             if (!_useRampGenTimer)
@@ -432,29 +1279,351 @@ bool IRAM_ATTR RampGenerator::handleStepMotion(MotionBlock *pBlock)
         }
     }
 
+    // Pressure advance axis
+    if ((pBlock->_paAxisIdx != MotionStepSegment::PA_AXIS_NONE) && handlePressureAdvanceStep(pBlock))
+        anyAxisMoving = true;
+
+    // Start all directly driven step pulses together
+    if (_useFastGPIO)
+        _fastGPIO.applySteps();
+
     // Return indicator of block complete
     return anyAxisMoving;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Step the pressure advance axis
+/// @param pBlock Motion block defines all motion parameters
+/// @return true if the axis has nominal steps remaining
+/// @note A nominal step is skipped if the axis is ahead of the advance target and an extra step is added (when
+///       no nominal step is due) if it is behind - the advance changes by at most one step per call
+template <uint32_t NumAxes, typename DriverT>
+bool IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::handlePressureAdvanceStep(MotionStepSegment *pBlock)
+{
+    uint32_t axisIdx = pBlock->_paAxisIdx;
+    int32_t dirn = _totalStepsInc[axisIdx];
+    int32_t aheadSteps = (_paAdvanceSteps - _paTargetSteps) * dirn;
+
+    // Nominal step (as for other minor axes)
+    bool stepDue = false;
+    if (_curStepCount[axisIdx] < _stepsTotalAbs[axisIdx])
+    {
+        _curAccumulatorRelative[axisIdx] = _curAccumulatorRelative[axisIdx] + _stepsTotalAbs[axisIdx];
+        if (_curAccumulatorRelative[axisIdx] >= _amassMajorStepsScaled)
+        {
+            _curAccumulatorRelative[axisIdx] = _curAccumulatorRelative[axisIdx] - _amassMajorStepsScaled;
+            _curStepCount[axisIdx] = _curStepCount[axisIdx] + 1;
+            stepDue = true;
+        }
+    }
+
+    // Skip, step or add a step
+    if (stepDue && (aheadSteps > 0))
+    {
+        _paAdvanceSteps = _paAdvanceSteps - dirn;
+    }
+    else if (stepDue || (aheadSteps < 0))
+    {
+        stepAxisAfterDirSetup(axisIdx);
+        _stats.stepStart(axisIdx);
+        if (!stepDue)
+            _paAdvanceSteps = _paAdvanceSteps + dirn;
+    }
+    return _curStepCount[axisIdx] < _stepsTotalAbs[axisIdx];
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Settle the pressure advance when the pipeline is empty (the axis returns to its nominal position)
+/// @note The direction is set on one call and steps follow on later calls (at most one per PA_SETTLE_STEP_NS)
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::handlePressureAdvanceSettle()
+{
+    // Step generation periods since the last call (including a step-end call which returned early)
+    uint32_t elapsedPeriods = 1 + _stepEndElapsedPeriods;
+    _stepEndElapsedPeriods = 0;
+    uint32_t axisIdx = _paAxisIdx;
+    if ((axisIdx >= numStepperDrivers()) || !isDriverPresent(axisIdx))
+    {
+        _paAdvanceSteps = 0;
+        return;
+    }
+
+    // Direction towards the nominal position
+    int32_t dirn = _paAdvanceSteps > 0 ? -1 : 1;
+    if (_totalStepsInc[axisIdx] != dirn)
+    {
+        _stepperDriverPtrs[axisIdx]->setDirection(dirn > 0);
+        _totalStepsInc[axisIdx] = dirn;
+        _stats.stepDirn(axisIdx, dirn > 0);
+        _paSettleAccumulatorNS = 0;
+    }
+    else
+    {
+        _paSettleAccumulatorNS = _paSettleAccumulatorNS + _stepGenPeriodNs * elapsedPeriods;
+        if (_paSettleAccumulatorNS >= PA_SETTLE_STEP_NS)
+        {
+            _paSettleAccumulatorNS = 0;
+            startDirectSteps(1 << axisIdx);
+            _paAdvanceSteps = _paAdvanceSteps + dirn;
+        }
+    }
+    _paTargetSteps = 0;
+    requestISRPeriodScale(1);
+    _stats.endMotionProcessing(_isrStepStarted ? RampGenStats::ISR_PATH_STEP : RampGenStats::ISR_PATH_MOTION);
+    _isrStepStarted = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle the trajectory stream
+/// @note The ISR runs at the base period while streaming - each axis's accumulator is bumped by its step delta
+///       every step generation period and the axis steps when it reaches the periods in a sample so each sample
+///       moves exactly its step deltas (the remainder carries over to the next sample)
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::handleTrajStream()
+{
+    // Start of streaming - accumulators start half a sample in so that steps are centred in the sample
+    uint32_t ticksPerSample = _trajStream.getTicksPerSample();
+    if (!_trajStreamStarted)
+    {
+        for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
+            _curAccumulatorRelative[axisIdx] = ticksPerSample / 2;
+        _trajSampleActive = false;
+        _stepEndElapsedPeriods = 0;
+        _trajStreamStarted = true;
+        _motionPhase = StepDriverBase::MOTION_PHASE_CRUISE;
+    }
+
+    // Step generation periods since the last call (including a step-end call which returned early)
+    uint32_t elapsedPeriods = 1 + _stepEndElapsedPeriods;
+    _stepEndElapsedPeriods = 0;
+
+    // Advance through the elapsed periods - steps are started together after this
+    uint32_t stepAxesMask = 0;
+    while (elapsedPeriods > 0)
+    {
+        // Start the next sample (on underrun the elapsed periods are dropped and motion stops)
+        if (!_trajSampleActive && !startTrajSample())
+            break;
+        elapsedPeriods--;
+
+        // DDA
+        for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
+        {
+            _curAccumulatorRelative[axisIdx] = _curAccumulatorRelative[axisIdx] + _stepsTotalAbs[axisIdx];
+            if (_curAccumulatorRelative[axisIdx] >= ticksPerSample)
+            {
+                _curAccumulatorRelative[axisIdx] = _curAccumulatorRelative[axisIdx] - ticksPerSample;
+                stepAxesMask |= 1 << axisIdx;
+            }
+        }
+
+        // End of sample - any periods left over are handled on the next call so that the steps of this
+        // sample are started before the directions of the next are set
+        _trajSampleTicks = _trajSampleTicks + 1;
+        if (_trajSampleTicks >= ticksPerSample)
+        {
+            _trajSampleActive = false;
+            _stepEndElapsedPeriods = elapsedPeriods;
+            break;
+        }
+    }
+
+    // Start steps
+    startDirectSteps(stepAxesMask);
+
+    // Check if streaming has ended (all samples output after the stream was ended)
+    if (!_trajStream.isActive())
+        _trajStreamStarted = false;
+
+    // Streaming runs at the base period
+    requestISRPeriodScale(1);
+    _stats.endMotionProcessing(_isrStepStarted ? RampGenStats::ISR_PATH_STEP : RampGenStats::ISR_PATH_MOTION);
+    _isrStepStarted = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle velocity (jog) mode
+/// @note On each acceleration tick the step rate of each axis moves toward its target (zero during a feed hold)
+///       by the axis's rate change per tick - an axis decelerates to a standstill before reversing - and steps
+///       are generated from the current rates with an accumulator per axis
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::handleVelocityMode()
+{
+    // Step generation periods since the last call (including a step-end call which returned early)
+    uint32_t elapsedPeriods = 1 + _stepEndElapsedPeriods;
+    _stepEndElapsedPeriods = 0;
+
+    // Acceleration tick
+    _curAccumulatorNS = _curAccumulatorNS + _stepGenPeriodNs * elapsedPeriods;
+    if (_curAccumulatorNS >= _accelTickNs)
+    {
+        _curAccumulatorNS = _curAccumulatorNS - _accelTickNs;
+        bool isHolding = _holdState == HOLD_DECELERATING;
+        uint32_t prevRateSum = 0;
+        uint32_t curRateSum = 0;
+        for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
+        {
+            int32_t curRate = _velCurRate[axisIdx];
+            prevRateSum += UTILS_ABS(curRate);
+            int32_t targetRate = isHolding ? 0 : _velTargetRate[axisIdx];
+            if (((curRate > 0) && (targetRate < 0)) || ((curRate < 0) && (targetRate > 0)))
+                targetRate = 0;
+            int32_t rateChange = _velAccPerTick[axisIdx];
+            if (curRate < targetRate)
+                curRate = UTILS_MIN(curRate + rateChange, targetRate);
+            else
+                curRate = UTILS_MAX(curRate - rateChange, targetRate);
+            _velCurRate[axisIdx] = curRate;
+            curRateSum += UTILS_ABS(curRate);
+        }
+        setMotionPhaseFromRates(prevRateSum, curRateSum);
+    }
+
+    // Accumulate steps
+    uint32_t stepAxesMask = 0;
+    bool isMoving = false;
+    for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
+    {
+        int32_t curRate = _velCurRate[axisIdx];
+        if ((curRate == 0) || !isDriverPresent(axisIdx))
+            continue;
+        isMoving = true;
+
+        // Set the direction when starting from a standstill (the first step follows on a later call)
+        int32_t stepsInc = curRate > 0 ? 1 : -1;
+        if (stepsInc != _totalStepsInc[axisIdx])
+        {
+            _stepperDriverPtrs[axisIdx]->setDirection(curRate > 0);
+            _totalStepsInc[axisIdx] = stepsInc;
+            _stats.stepDirn(axisIdx, curRate > 0);
+            continue;
+        }
+        _curAccumulatorRelative[axisIdx] = _curAccumulatorRelative[axisIdx] + uint32_t(UTILS_ABS(curRate)) * elapsedPeriods;
+        if (_curAccumulatorRelative[axisIdx] >= MotionBlock::TTICKS_VALUE)
+        {
+            _curAccumulatorRelative[axisIdx] = _curAccumulatorRelative[axisIdx] % MotionBlock::TTICKS_VALUE;
+            stepAxesMask |= 1 << axisIdx;
+        }
+    }
+
+    // Start steps
+    startDirectSteps(stepAxesMask);
+
+    // At a standstill a feed hold is complete and velocity mode ends if all targets are zero
+    if (!isMoving)
+    {
+        checkHoldComplete(nullptr);
+        bool anyTarget = false;
+        for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
+            anyTarget = anyTarget || (_velTargetRate[axisIdx] != 0);
+        if (!anyTarget)
+            _velModeActive = false;
+    }
+
+    // Velocity mode runs at the base period
+    requestISRPeriodScale(1);
+    _stats.endMotionProcessing(_isrStepStarted ? RampGenStats::ISR_PATH_STEP : RampGenStats::ISR_PATH_MOTION);
+    _isrStepStarted = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start steps on axes for motion not from the pipeline (velocity mode and trajectory stream)
+/// @param stepAxesMask Axes to step (bit per axis)
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::startDirectSteps(uint32_t stepAxesMask)
+{
+    _isrStepStarted = false;
+    for (uint32_t axisIdx = 0; stepAxesMask != 0; axisIdx++, stepAxesMask >>= 1)
+    {
+        if (stepAxesMask & 1)
+        {
+            stepAxis(axisIdx);
+            _stats.stepStart(axisIdx);
+        }
+    }
+    if (_useFastGPIO)
+        _fastGPIO.applySteps();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start the next sample of the trajectory stream
+/// @return false if no sample is available
+template <uint32_t NumAxes, typename DriverT>
+bool IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::startTrajSample()
+{
+    RampGenTrajStream::Sample sample;
+    if (!_trajStream.getSample(sample))
+        return false;
+
+    // Step deltas and directions (a direction is only changed when an axis reverses)
+    for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
+    {
+        int32_t steps = sample.steps[axisIdx];
+        _stepsTotalAbs[axisIdx] = isDriverPresent(axisIdx) ? UTILS_ABS(steps) : 0;
+        if ((steps == 0) || !isDriverPresent(axisIdx))
+            continue;
+        int32_t stepsInc = steps > 0 ? 1 : -1;
+        if (stepsInc != _totalStepsInc[axisIdx])
+        {
+            _stepperDriverPtrs[axisIdx]->setDirection(steps > 0);
+            _totalStepsInc[axisIdx] = stepsInc;
+            _stats.stepDirn(axisIdx, steps > 0);
+        }
+    }
+    _trajSampleTicks = 0;
+    _trajSampleActive = true;
+    return true;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief End motion
 /// @param pBlock Motion block defines all motion parameters
+/// @param traceEvent Event recorded in the trace (the reason the block ended)
 /// @note This function is called when a block is completed and removes the block from the pipeline
-void IRAM_ATTR RampGenerator::endMotion(MotionBlock *pBlock)
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::endMotion(MotionStepSegment *pBlock, RampGenTrace::EventType traceEvent)
 {
+    // Trace
+    _trace.record(traceEvent, pBlock->getMotionTrackingIndex(), pBlock->isMotionTrackingIndexValid(),
+                _curStepRatePerTTicks, _motionPipeline.count(), pBlock->_axisIdxWithMaxSteps);
+
+    // Check if the block has a motion tracking index - if so record its completion
+    if (pBlock->isMotionTrackingIndexValid())
+    {
+        _lastDoneMotionTrackingIdx = pBlock->getMotionTrackingIndex();
+        _motionTrackingDoneCount = _motionTrackingDoneCount + 1;
+    }
+
+    // A feed hold deceleration continues into the next block
+    if (_holdState == HOLD_DECELERATING)
+    {
+        uint32_t finalRate = UTILS_MAX(_curFinalStepRatePerTTicks, _minStepRatePerTTicks);
+        _holdRateRatioQ16 = _curStepRatePerTTicks >= finalRate ? HOLD_RATE_RATIO_Q16_ONE : 
+                    uint32_t((uint64_t(_curStepRatePerTTicks) << 16) / finalRate);
+    }
     _motionPipeline.remove();
-    // Check if this is a numbered block - if so record its completion
-    // if (pBlock->getMotionTrackingIndex() != RobotConsts::NUMBERED_COMMAND_NONE)
-    //     _lastDoneNumberedCmdIdx = pBlock->getMotionTrackingIndex();
+
+    // Steps still deferred for the direction setup time aren't output (the block has been cancelled) but the
+    // setup time continues to count down
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        _dirSetupDeferredSteps[axisIdx] = 0;
+
+    // Notify if the pipeline is running low
+    PipelineLowWaterCB pLowWaterCB = _pPipelineLowWaterCB;
+    if (pLowWaterCB && ((_motionPipeline.count() < _pipelineLowWater) || 
+                (_motionPipeline.getBufferedUs() < _pipelineLowWaterUs)))
+        pLowWaterCB(_pPipelineLowWaterCBArg);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Generate motion pulses
 /// @note This function is called from the timer ISR or from the main loop if not using a timer ISR
-void IRAM_ATTR RampGenerator::generateMotionPulses()
+template <uint32_t NumAxes, typename DriverT>
+void IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::generateMotionPulses()
 {
-    // Instrumentation code to time ISR execution (if enabled)
-    _stats.startMotionProcessing();
+    // Instrumentation code to time ISR execution (if enabled) - the timer entry jitter is measured against the
+    // period of the interval which has just ended
+    _stats.startMotionProcessing(_useRampGenTimer ? _pRampGenTimer->getElapsedPeriodScale() : 0);
 
     // Count ISR entries
     _isrCount = _isrCount + 1;
@@ -472,6 +1641,10 @@ void IRAM_ATTR RampGenerator::generateMotionPulses()
             LOG_I(MODULE_PREFIX, "generateMotionPulses stepEnd true exiting");
         }
 #endif
+        _stepEndElapsedPeriods = _stepEndElapsedPeriods + (_useRampGenTimer ?
+                    UTILS_MIN(_pRampGenTimer->getElapsedPeriodScale(), _isrBlockPeriodScale) : 1);
+        requestISRPeriodScale(_isrBlockPeriodScale);
+        _stats.endMotionProcessing(RampGenStats::ISR_PATH_STEP_END);
         return;
     }
 
@@ -484,19 +1657,56 @@ void IRAM_ATTR RampGenerator::generateMotionPulses()
             LOG_I(MODULE_PREFIX, "generateMotionPulses stopPending clearing pipeline");
         }
 #endif
+        // Streamed motion stops immediately
+        if (_trajStream.isActive())
+        {
+            _trajStream.cancel();
+            _trajStreamStarted = false;
+        }
+
+        // Velocity mode decelerates to a standstill if stopping with deceleration (the stop completes when
+        // velocity mode ends) and otherwise stops immediately
+        if (_velModeActive)
+        {
+            for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+            {
+                _velTargetRate[axisIdx] = 0;
+                if (!_stopWithDecel)
+                    _velCurRate[axisIdx] = 0;
+            }
+            if (_stopWithDecel)
+            {
+                handleVelocityMode();
+                return;
+            }
+            _velModeActive = false;
+        }
+
         // Check if a block is executing
-        MotionBlock *pBlock = _motionPipeline.peekGet();
-        if (pBlock && pBlock->_isExecuting)
+        MotionStepSegment *pBlock = _motionPipeline.peekGet();
+        bool isExecuting = pBlock && pBlock->_isExecuting;
+        if (_stopWithDecel && isExecuting && (_holdState != HOLD_HELD))
         {
-            // Cancel motion (by removing the block)
-            endMotion(pBlock);
+            // Decelerate first (the stop completes when held)
+            if (_holdState == HOLD_NONE)
+                _holdState = HOLD_DECELERATING;
+        }
+        else
+        {
+            // Cancel motion (by removing the block) and flush the pipeline if decelerated
+            if (_stopWithDecel)
+                flushPipeline();
+            else if (isExecuting)
+                endMotion(pBlock, RampGenTrace::EVENT_BLOCK_CANCELLED);
+            _holdState = _isPaused ? HOLD_HELD : HOLD_NONE;
+            _stopPending = false;
+            _stats.endMotionProcessing(RampGenStats::ISR_PATH_IDLE);
+            return;
         }
-        _stopPending = false;
-        return;
     }
 
-    // Check if paused
-    if (_isPaused)
+    // Check if paused (motion continues while a feed hold is decelerating)
+    if (_isPaused ? (_holdState != HOLD_DECELERATING) : (_holdState == HOLD_HELD))
     {
 #ifdef DEBUG_MOTION_PULSE_GEN
         if(!_useRampGenTimer)
@@ -504,13 +1714,42 @@ void IRAM_ATTR RampGenerator::generateMotionPulses()
             LOG_I(MODULE_PREFIX, "generateMotionPulses paused exiting");
         }
 #endif
+        requestISRPeriodScale(_isrIdlePeriodScale);
+        _stats.endMotionProcessing(RampGenStats::ISR_PATH_IDLE);
+        return;
+    }
+
+    // Output the trajectory stream if streaming (the pipeline is empty while streaming) - a feed hold stops
+    // streamed motion immediately
+    if (_trajStream.isActive())
+    {
+        if (!checkHoldComplete(nullptr))
+        {
+            handleTrajStream();
+            return;
+        }
+        requestISRPeriodScale(_isrIdlePeriodScale);
+        _stats.endMotionProcessing(RampGenStats::ISR_PATH_IDLE);
+        return;
+    }
+
+    // Velocity mode (the pipeline is empty while in velocity mode)
+    if (_velModeActive)
+    {
+        handleVelocityMode();
         return;
     }
 
     // Peek a MotionPipelineElem from the queue
-    MotionBlock *pBlock = _motionPipeline.peekGet();
+    MotionStepSegment *pBlock = _motionPipeline.peekGet();
+    if (!pBlock && isPressureAdvanceSettling())
+    {
+        handlePressureAdvanceSettle();
+        return;
+    }
     if (!pBlock)
     {
+        checkHoldComplete(nullptr);
 #ifdef DEBUG_MOTION_PEEK_QUEUE
         if (Raft::isTimeout(millis(), _debugLastQueuePeekMs, 1000))
         {
@@ -521,12 +1760,15 @@ void IRAM_ATTR RampGenerator::generateMotionPulses()
             _debugLastQueuePeekMs = millis();
         }
 #endif
+        requestISRPeriodScale(_isrIdlePeriodScale);
+        _stats.endMotionProcessing(RampGenStats::ISR_PATH_IDLE);
         return;
     }
 
     // Check if the element can be executed
     if (!pBlock->_canExecute)
     {
+        checkHoldComplete(nullptr);
 #ifdef DEBUG_MOTION_PEEK_QUEUE
         if (Raft::isTimeout(millis(), _debugLastQueuePeekMs, 1000))
         {
@@ -537,6 +1779,17 @@ void IRAM_ATTR RampGenerator::generateMotionPulses()
             _debugLastQueuePeekMs = millis();
         }
 #endif
+        requestISRPeriodScale(_isrIdlePeriodScale);
+        _stats.endMotionProcessing(RampGenStats::ISR_PATH_IDLE);
+        return;
+    }
+
+    // Wait for the scheduled start time of a new block (at the full ISR rate so that the start is accurate)
+    if (!pBlock->_isExecuting && pBlock->_startTimeValid && !_timebase.isTimeReached(pBlock->_startTimeUs))
+    {
+        checkHoldComplete(nullptr);
+        requestISRPeriodScale(1);
+        _stats.endMotionProcessing(RampGenStats::ISR_PATH_IDLE);
         return;
     }
 
@@ -553,24 +1806,20 @@ void IRAM_ATTR RampGenerator::generateMotionPulses()
         // Return here to reduce the maximum time this function takes
         // Assuming this function is called frequently (<50uS intervals say)
         // then it will make little difference if we return now and pick up on the next tick
+        _stats.endMotionProcessing(RampGenStats::ISR_PATH_NEW_BLOCK);
         return;
     }
 
     // Check endstops        
-    bool endStopHit = false;
-    for (int i = 0; i < _endStopCheckNum; i++)
-    {
-        EndStops* pEndStops = _axisEndStops[_endStopChecks[i].axisIdx];
-        if (pEndStops->isAtEndStop(_endStopChecks[i].isMax) == _endStopChecks[i].checkHit)
-            endStopHit = true;
-    }
+    bool endStopHit = isEndStopHit();
+    RampGenStats::ISRPath isrPath = endStopHit ? RampGenStats::ISR_PATH_END_STOP : RampGenStats::ISR_PATH_MOTION;
 
     // Handle end-stop hit
     if (endStopHit)
     {
         // Cancel motion (by removing the block) as end-stop reached
         _endStopReached = true;
-        endMotion(pBlock);
+        endMotion(pBlock, RampGenTrace::EVENT_BLOCK_END_STOP);
 
         // Only use this debugging if not driving from ISR
 #ifdef DEBUG_MOTION_PULSE_GEN
@@ -581,12 +1830,32 @@ void IRAM_ATTR RampGenerator::generateMotionPulses()
 #endif
     }
 
-    // Update the millisec accumulator - this handles the process of changing speed incrementally to
+    // Step generation periods since the last call (more than one if the ISR rate has been scaled for this block
+    // but the time spent paused is not counted) - including those of step-end calls which return early
+    uint32_t elapsedPeriods = (_useRampGenTimer ? 
+                UTILS_MIN(_pRampGenTimer->getElapsedPeriodScale(), _isrBlockPeriodScale) : 1) + _stepEndElapsedPeriods;
+    _stepEndElapsedPeriods = 0;
+
+    // Update the acceleration tick accumulator - this handles the process of changing speed incrementally to
     // implement acceleration and deceleration
-    updateMSAccumulator(pBlock);
+    updateMSAccumulator(pBlock, _stepGenPeriodNs * elapsedPeriods);
+
+    // Count down the direction setup time of axes whose direction has changed
+    _isrStepAxesMask = 0;
+    if (_dirSetupActiveMask)
+        updateDirSetupPeriods(elapsedPeriods);
+
+    // Check if a feed hold has decelerated to a standstill (the block keeps its remaining steps)
+    if (!endStopHit && checkHoldComplete(pBlock))
+    {
+        requestISRPeriodScale(_isrIdlePeriodScale);
+        _stats.endMotionProcessing(RampGenStats::ISR_PATH_IDLE);
+        return;
+    }
 
     // Bump the step accumulator
-    _curAccumulatorStep = _curAccumulatorStep + UTILS_MAX(_curStepRatePerTTicks, _minStepRatePerTTicks);
+    _curAccumulatorStep = _curAccumulatorStep + 
+                (UTILS_MAX(_curStepRatePerTTicks, _minStepRatePerTTicks) << _amassLevel) * elapsedPeriods;
 
 #ifdef RAMP_GEN_DETAILED_STATS
     _stats.update(_curAccumulatorStep, _curStepRatePerTTicks, _curAccumulatorNS,
@@ -598,6 +1867,8 @@ void IRAM_ATTR RampGenerator::generateMotionPulses()
 #endif
 
     // Check for step accumulator overflow
+    _isrStepStarted = false;
+    bool blockComplete = false;
     if (_curAccumulatorStep >= MotionBlock::TTICKS_VALUE)
     {
 #ifdef DEBUG_MOTION_PULSE_GEN
@@ -607,27 +1878,292 @@ void IRAM_ATTR RampGenerator::generateMotionPulses()
         }
 #endif
 
-        // Flag indicating this block is finished
-        bool anyAxisMoving = false;
+        // Subtract from accumulator leaving remainder
+        _curAccumulatorStep = _curAccumulatorStep - MotionBlock::TTICKS_VALUE;
+
+        // Handle a step - the block is finished if no axes are still moving
+        blockComplete = !handleStepMotion(pBlock);
+    }
+    else
+    {
+        // Stage the setup of the next block on a tick without a step event
+        stageNextBlock();
+    }
+
+    // Output steps deferred for the direction setup time (the block isn't complete until they have been output)
+    if (_dirSetupActiveMask && releaseDeferredSteps())
+        blockComplete = false;
+    if (!endStopHit && _isrStepStarted)
+        isrPath = RampGenStats::ISR_PATH_STEP;
+
+    // Check if the block is done - the next block starts on this tick if it is ready
+    if (blockComplete)
+    {
+        endMotion(pBlock);
+        if (!endStopHit)
+            handoverToNextBlock();
+    }
+
+    // Run at the base period for the step-end if a step has started
+    requestISRPeriodScale(_isrStepStarted ? 1 : _isrBlockPeriodScale);
+    _isrStepStarted = false;
+
+    // Time execution
+    _stats.endMotionProcessing(isrPath);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Service the hardware pulse engine
+/// @note Called from loop() or from the engine's refill task - fills chunks of step times while the engine has space
+///       for them
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::servicePulseEngine()
+{
+    // Check stop pending (a stop with deceleration completes when held - the chunks queued are the deceleration)
+    if (_stopPending)
+    {
+        MotionStepSegment *pBlock = _motionPipeline.peekGet();
+        bool isExecuting = pBlock && pBlock->_isExecuting;
+        if (_stopWithDecel && isExecuting && (_holdState != HOLD_HELD))
+        {
+            if (_holdState == HOLD_NONE)
+                _holdState = HOLD_DECELERATING;
+        }
+        else
+        {
+            if (_stopWithDecel)
+            {
+                flushPipeline();
+            }
+            else
+            {
+                _pPulseEngine->abort();
+                if (isExecuting)
+                    endMotion(pBlock, RampGenTrace::EVENT_BLOCK_CANCELLED);
+            }
+            _holdState = _isPaused ? HOLD_HELD : HOLD_NONE;
+            _stopPending = false;
+            return;
+        }
+    }
+
+    // Check endstops of the block being output (also when no chunk can be queued) - the queued chunks are aborted
+    MotionStepSegment *pExecBlock = _motionPipeline.peekGet();
+    if (pExecBlock && pExecBlock->_isExecuting && isEndStopHit())
+    {
+        _pPulseEngine->abort();
+        _endStopReached = true;
+        endMotion(pExecBlock, RampGenTrace::EVENT_BLOCK_END_STOP);
+    }
+
+    // Check if paused (chunks already queued will complete and a feed hold deceleration continues to be filled)
+    // (anything held back by the engine is output as no more steps will be added for now)
+    if (_isPaused ? (_holdState != HOLD_DECELERATING) : (_holdState == HOLD_HELD))
+    {
+        _pPulseEngine->flush();
+        return;
+    }
+
+    // Fill chunks while there is space
+    while (_pPulseEngine->canQueueChunk())
+    {
+        // Peek a block from the queue and check it can be executed
+        MotionStepSegment *pBlock = _motionPipeline.peekGet();
+        if (!pBlock && isPressureAdvanceSettling())
+        {
+            if (!fillPulseEngineSettleChunk())
+            {
+                _pPulseEngine->flush();
+                return;
+            }
+            continue;
+        }
+        if (!pBlock || !pBlock->_canExecute)
+        {
+            checkHoldComplete(nullptr);
+            _pPulseEngine->flush();
+            return;
+        }
 
-        // Handle a step
-        anyAxisMoving = handleStepMotion(pBlock);
+        // Setup new block - unless the engine outputs the direction, directions can only be changed when queued
+        // steps have been output (and the first step is delayed by the direction setup time) - a block with
+        // a scheduled start time waits for the shared time
+        if (!pBlock->_isExecuting)
+        {
+            bool engineOutputsDirn = _pPulseEngine->outputsDirection();
+            if (!engineOutputsDirn && !_pPulseEngine->isIdle() && blockChangesDirection(pBlock))
+            {
+                _pPulseEngine->flush();
+                return;
+            }
+            if (pBlock->_startTimeValid && !_timebase.isTimeReached(pBlock->_startTimeUs))
+            {
+                _pPulseEngine->flush();
+                return;
+            }
+            pBlock->_isExecuting = true;
+            setupNewBlock(pBlock);
+            _pulseEngineNextStepNs = engineOutputsDirn ? 0 : _blockDirSetupNs;
+        }
+
+        // Check endstops (also at the start of each chunk)
+        if (isEndStopHit())
+        {
+            _pPulseEngine->abort();
+            _endStopReached = true;
+            endMotion(pBlock, RampGenTrace::EVENT_BLOCK_END_STOP);
+            continue;
+        }
+
+        // Generate a chunk
+        fillPulseEngineChunk(pBlock);
+        if (_holdState == HOLD_HELD)
+        {
+            _pPulseEngine->flush();
+            return;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Fill a chunk of the hardware pulse engine
+/// @param pBlock Motion block defines all motion parameters
+/// @note Steps are timed directly from the step rate rather than quantised to timer ticks
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::fillPulseEngineChunk(MotionStepSegment *pBlock)
+{
+    // Shorter chunks are used while endstops are checked so the output stops soon after an endstop is hit
+    _pPulseEngine->beginChunk();
+    uint64_t chunkDurationNs = _pPulseEngine->getChunkDurationNs();
+    bool endStopsChecked = (_endStopCheckNum > 0) || (_endStopLatchHitMask != 0) || (_endStopLatchNotHitMask != 0);
+    if (endStopsChecked && (_pulseEngineEndStopChunkNs > 0))
+        chunkDurationNs = UTILS_MIN(chunkDurationNs, _pulseEngineEndStopChunkNs);
+    uint64_t stepTimeNs = _pulseEngineNextStepNs;
+    while (stepTimeNs < chunkDurationNs)
+    {
+        // Step all axes that need it at this time (the step accumulator isn't used for timing here)
+        _pPulseEngine->setStepTimeNs(stepTimeNs);
+        bool anyAxisMoving = handleStepMotion(pBlock);
+
+        // Time to the next step at the current rate and apply acceleration for each acceleration tick that passes
+        uint64_t intervalNs = stepIntervalNs();
+        _curAccumulatorNS = _curAccumulatorNS + intervalNs;
+        while (_curAccumulatorNS >= _accelTickNs)
+        {
+            _curAccumulatorNS = _curAccumulatorNS - _accelTickNs;
+            uint32_t prevRate = _curStepRatePerTTicks;
+            applyMSRateChange(pBlock);
+            setMotionPhaseFromRates(prevRate, _curStepRatePerTTicks);
+            updatePressureAdvanceTarget(pBlock);
+        }
+        stepTimeNs += intervalNs;
 
-        // Any axes still moving?
+        // Check block complete - the chunk ends when the next step would have been due
         if (!anyAxisMoving)
         {
-            // This block is done
             endMotion(pBlock);
+            _pulseEngineNextStepNs = 0;
+            _pPulseEngine->endChunk(stepTimeNs);
+            return;
+        }
+
+        // Check if a feed hold has decelerated to a standstill (the block restarts when resumed)
+        if (checkHoldComplete(pBlock))
+        {
+            _pulseEngineNextStepNs = 0;
+            _pPulseEngine->endChunk(stepTimeNs);
+            return;
         }
     }
 
-    // Time execution
-    _stats.endMotionProcessing();
+    // Carry the time of the next step into the next chunk
+    _pulseEngineNextStepNs = stepTimeNs - chunkDurationNs;
+    _pPulseEngine->endChunk(chunkDurationNs);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Fill a chunk of the hardware pulse engine with pressure advance settle steps (the pipeline is empty)
+/// @return false if the settle must wait for the engine to become idle (to change direction)
+/// @note Steps are spaced at PA_SETTLE_STEP_NS as in handlePressureAdvanceSettle
+template <uint32_t NumAxes, typename DriverT>
+bool RampGeneratorT<NumAxes, DriverT>::fillPulseEngineSettleChunk()
+{
+    uint32_t axisIdx = _paAxisIdx;
+    if ((axisIdx >= numStepperDrivers()) || !isDriverPresent(axisIdx))
+    {
+        _paAdvanceSteps = 0;
+        return true;
+    }
+
+    // Direction towards the nominal position - unless the engine outputs the direction it can only be changed
+    // when queued steps have been output (and the first step is delayed by the direction setup time)
+    int32_t dirn = _paAdvanceSteps > 0 ? -1 : 1;
+    if (_totalStepsInc[axisIdx] != dirn)
+    {
+        bool engineOutputsDirn = _pPulseEngine->outputsDirection();
+        if (!engineOutputsDirn && !_pPulseEngine->isIdle())
+            return false;
+        _stepperDriverPtrs[axisIdx]->setDirection(dirn > 0);
+        _totalStepsInc[axisIdx] = dirn;
+        _stats.stepDirn(axisIdx, dirn > 0);
+        _pulseEngineNextStepNs = engineOutputsDirn ? 0 : _dirSetupNs[axisIdx];
+    }
+
+    // Settle steps - the chunk ends when the step after the last would have been due
+    _pPulseEngine->beginChunk();
+    uint64_t chunkDurationNs = _pPulseEngine->getChunkDurationNs();
+    uint64_t stepTimeNs = _pulseEngineNextStepNs;
+    while (stepTimeNs < chunkDurationNs)
+    {
+        _pPulseEngine->setStepTimeNs(stepTimeNs);
+        startDirectSteps(1 << axisIdx);
+        _paAdvanceSteps = _paAdvanceSteps + dirn;
+        stepTimeNs += PA_SETTLE_STEP_NS;
+        if (_paAdvanceSteps == 0)
+        {
+            _paTargetSteps = 0;
+            _pulseEngineNextStepNs = 0;
+            _pPulseEngine->endChunk(stepTimeNs);
+            return true;
+        }
+    }
+    _paTargetSteps = 0;
+    _pulseEngineNextStepNs = stepTimeNs - chunkDurationNs;
+    _pPulseEngine->endChunk(chunkDurationNs);
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if a block requires the direction of any axis to change
+/// @param pBlock Motion block
+/// @return true if direction changes
+/// @note Axes which don't move in the block don't change direction
+template <uint32_t NumAxes, typename DriverT>
+bool IRAM_ATTR RampGeneratorT<NumAxes, DriverT>::blockChangesDirection(const MotionStepSegment *pBlock) const
+{
+    for (uint32_t axisIdx = 0; axisIdx < numStepperDrivers(); axisIdx++)
+    {
+        int32_t stepsTotal = pBlock->_stepsTotalMaybeNeg.getVal(axisIdx);
+        if (stepsTotal == 0)
+            continue;
+        int32_t stepsInc = (stepsTotal > 0) ? 1 : -1;
+        if (isDriverPresent(axisIdx) && (stepsInc != _totalStepsInc[axisIdx]))
+            return true;
+    }
+    return false;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Debug show stats
-void RampGenerator::debugShowStats()
+template <uint32_t NumAxes, typename DriverT>
+void RampGeneratorT<NumAxes, DriverT>::debugShowStats()
 {
     LOG_I(MODULE_PREFIX, "%s isrCount %d", _stats.getStatsStr().c_str(), _isrCount);
 }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Instantiate the generic ramp generator and the specialized one (if configured in the build)
+template class RampGeneratorT<0, StepDriverBase>;
+#ifdef RAMP_GEN_FIXED_NUM_AXES
+template class RampGeneratorT<RAMP_GEN_FIXED_NUM_AXES, RAMP_GEN_FIXED_DRIVER>;
+#endif
@@ -11,39 +11,104 @@
 #include "Logger.h"
 #include "MotionBlock.h"
 #include "RampGenStats.h"
+#include "RampGenTrace.h"
 #include "RampGenTimer.h"
 #include "MotionPipeline.h"
+#include "RampGenFastGPIO.h"
+#include "RampGenRMT.h"
+#include "RampGenShiftReg.h"
+#include "RampGenTimebase.h"
+#include "RampGenTrajStream.h"
+#include "StepDriverBase.h"
 
 class RampGenTimer;
-class StepDriverBase;
 class EndStops;
 
-class RampGenerator
+/// @brief Ramp generator
+/// @tparam NumAxes Number of axes (0 if the number of axes is determined by the stepper drivers at setup)
+/// @tparam DriverT Stepper driver type (StepDriverBase if the driver type is determined at setup)
+/// @note A specialized ramp generator (fixed number of axes and driver type) has the axis loops unrolled and
+///       the stepper driver calls inlined in the ISR - it is selected with the build flag RAMP_GEN_FIXED_NUM_AXES
+///       (and optionally RAMP_GEN_FIXED_DRIVER) for boards with a known configuration
+template <uint32_t NumAxes, typename DriverT>
+class RampGeneratorT
 {
+    static_assert(NumAxes <= AXIS_VALUES_MAX_AXES, "RampGeneratorT NumAxes exceeds AXIS_VALUES_MAX_AXES");
+
 public:
     // Constructor / destructor
-    RampGenerator();
-    virtual ~RampGenerator();
+    RampGeneratorT();
+    virtual ~RampGeneratorT();
 
     // Setup ramp generator
     void setup(const RaftJsonIF& config, 
             const std::vector<StepDriverBase*>& stepperDrivers,
             const std::vector<EndStops*>& axisEndStops);
 
+    // Set a timer shared with other ramp generators (nullptr to use this generator's own timer) - must be
+    // called before setup - the shared timer is set up by the first generator to use it (so its period is the
+    // first generator's rampTimerUs) and each generator hooks its own callback
+    void setSharedTimer(RampGenTimer* pSharedTimer)
+    {
+        RampGenTimer* pTimer = pSharedTimer ? pSharedTimer : &_ownRampGenTimer;
+        if (pTimer == _pRampGenTimer)
+            return;
+        _pRampGenTimer->unhookTimer(this);
+        _pRampGenTimer = pTimer;
+    }
+
     // Must be called frequently - if useRampGenTimer is false (in setup) then
     // this function generates stepping pulses
     void loop();
 
     // Start / stop / pause
+    // Pausing is a feed hold - motion decelerates to a standstill and the remaining steps of the executing block
+    // are kept (see isHeld() and getHeldBlockProgress()) - resuming continues the executing block from its current
+    // position (the pipeline should be replanned from zero speed first - see MotionPlanner::replanFromStandstill)
+    // Stopping cancels the executing block immediately or, if stopDecel is configured, decelerates and then flushes
+    // the pipeline
     void start();
     void stop();
     void pause(bool pauseIt);
 
+    // Feed hold status
+    bool isHoldDecelerating() const
+    {
+        return _holdState == HOLD_DECELERATING;
+    }
+    bool isHeld() const
+    {
+        return _holdState == HOLD_HELD;
+    }
+
+    // Get the steps done (on each axis) by the block held by a feed hold
+    // Returns false if no block is executing
+    bool getHeldBlockProgress(AxesValues<AxisStepsDataType>& stepsDone) const;
+
+    // Feed override (percent of the planned rates) - a reduction applies immediately (including to the executing
+    // block) and the planner must re-prepare the queued blocks for an increase (see MotionPlanner::setFeedOverride)
+    void setFeedOverride(uint32_t feedOverridePercent)
+    {
+        _feedOverridePercent = UTILS_MIN(UTILS_MAX(feedOverridePercent, MotionBlock::FEED_OVERRIDE_PERCENT_MIN), 
+                    MotionBlock::FEED_OVERRIDE_PERCENT_MAX);
+    }
+    uint32_t getFeedOverride() const
+    {
+        return _feedOverridePercent;
+    }
+
     // Access to current state
     void resetTotalStepPosition();
     void getTotalStepPosition(AxesValues<AxisStepsDataType>& actuatorPos) const;
     void setTotalStepPosition(int axisIdx, int32_t stepPos);
 
+    // Sequence number of position resets (changes when the step position is set rather than stepped - a
+    // position derived from the step counts is only valid while this is unchanged)
+    uint32_t getPosResetSeqNum() const
+    {
+        return _posResetSeqNum;
+    }
+
     // End stop handling
     void clearEndstopReached();
     void getEndStopStatus(AxisEndstopChecks& axisEndStopVals) const;
@@ -55,6 +120,12 @@ public:
         return _stepGenPeriodNs / 1000;
     }
 
+    // Get period at which acceleration is applied (ns)
+    uint32_t getAccelTickNs() const
+    {
+        return _accelTickNs;
+    }
+
     // Get motion pipeline
     MotionPipelineIF& getMotionPipeline()
     {
@@ -65,23 +136,124 @@ public:
         return _motionPipeline;
     }
 
+    // Pipeline low-water callback - called when a block completes (normally in the ISR) and the pipeline count
+    // has fallen below the low-water mark or the time of motion buffered has fallen below lowWaterUs (0 to only
+    // use the count) - e.g. to wake a planner task
+    typedef void (*PipelineLowWaterCB)(void* pArg);
+    void setPipelineLowWaterCB(PipelineLowWaterCB pCB, void* pArg, uint32_t lowWater, uint32_t lowWaterUs = 0)
+    {
+        _pPipelineLowWaterCB = nullptr;
+        _pPipelineLowWaterCBArg = pArg;
+        _pipelineLowWater = lowWater;
+        _pipelineLowWaterUs = lowWaterUs;
+        _pPipelineLowWaterCB = pCB;
+    }
+
     // Check if using timer ISR
     bool isUsingTimerISR() const
     {
         return _useRampGenTimer;
     }
 
-    // Progress
-    // int getLastCompletedNumberedCmdIdx();
+    // Check if using a hardware pulse engine
+    bool isUsingPulseEngine() const
+    {
+        return _usePulseEngine;
+    }
+
+    // Progress - last completed motion tracking index and the count of completions (which can be used to
+    // detect a new completion even if the same index is reused)
+    // Returns false if no block with a motion tracking index has completed
+    bool getLastCompletedMotionTrackingIdx(uint32_t& motionTrackingIdx, uint32_t& completedCount) const;
 
     const RampGenStats& getStats() const
     {
         return _stats;
     }
+    void resetISRStats()
+    {
+        _stats.requestISRHistogramReset();
+    }
+
+    // Shared timebase (time-synchronized motion)
+    RampGenTimebase& getTimebase()
+    {
+        return _timebase;
+    }
+    const RampGenTimebase& getTimebaseConst() const
+    {
+        return _timebase;
+    }
+
+    // Velocity (jog) mode - each axis accelerates (at its own rate) toward a target step rate and keeps running
+    // until retargeted - new targets apply from the next acceleration tick without touching the pipeline and
+    // velocity mode ends when all targets are zero and all axes have decelerated to a standstill
+    // Returns false if velocity mode can't start (the pipeline must be empty and no trajectory stream active)
+    bool setVelocityTargets(const AxesValues<AxisSpeedDataType>& stepsPerSec, 
+                const AxesValues<AxisAccDataType>& accStepsPerSec2, const AxesValues<AxisSpecifiedDataType>& axesSpecified);
+    bool isVelocityModeActive() const
+    {
+        return _velModeActive;
+    }
+
+    // Check if motion not from the pipeline (velocity mode or a trajectory stream) is active
+    bool isDirectMotionActive() const
+    {
+        return _velModeActive || _trajStream.isActive();
+    }
+
+    // Check if the pressure advance axis is away from its nominal position (it settles when the pipeline is empty)
+    bool isPressureAdvanceSettling() const
+    {
+        return _paAdvanceSteps != 0;
+    }
+
+    // Check if all motion has been output (nothing in the pipeline, no pressure advance left to settle and no steps
+    // queued in a hardware pulse engine)
+    bool isOutputIdle() const
+    {
+        return (_motionPipeline.count() == 0) && !isPressureAdvanceSettling() &&
+                    (!_usePulseEngine || _pPulseEngine->isIdle());
+    }
+
+    // Motion phase (from the step rate change on the most recent acceleration tick) - idle when nothing is
+    // executing or a feed hold is complete and cruise while pressure advance settles
+    StepDriverBase::MotionPhase getMotionPhase() const
+    {
+        if (_holdState == HOLD_HELD)
+            return StepDriverBase::MOTION_PHASE_IDLE;
+        if ((_motionPipeline.count() == 0) && !isDirectMotionActive())
+            return isPressureAdvanceSettling() ? StepDriverBase::MOTION_PHASE_CRUISE : StepDriverBase::MOTION_PHASE_IDLE;
+        return _motionPhase;
+    }
+
+    // Trajectory stream (samples output directly without planning while the pipeline is empty)
+    RampGenTrajStream& getTrajStream()
+    {
+        return _trajStream;
+    }
+    const RampGenTrajStream& getTrajStreamConst() const
+    {
+        return _trajStream;
+    }
+
+    // Block execution trace
+    const RampGenTrace& getTrace() const
+    {
+        return _trace;
+    }
+
+    // Number of blocks started on the tick the previous block ended
+    uint32_t getBlockHandoverCount() const
+    {
+        return _blockHandoverCount;
+    }
     void debugShowStats();
     String getDebugJSON(bool includeBraces) const
     {
-        return _rampGenTimer.getDebugJSON(includeBraces);
+        if (_usePulseEngine)
+            return _pPulseEngine->getDebugJSON(includeBraces);
+        return _pRampGenTimer->getDebugJSON(includeBraces);
     }
 
 private:
@@ -91,6 +263,8 @@ private:
 
     // Consts
     static constexpr uint32_t PIPELINE_LEN_DEFAULT = 100;
+    static constexpr uint32_t PULSE_ENGINE_END_STOP_CHUNK_US_DEFAULT = 500;
+    static constexpr uint32_t RAMP_TIMER_IDLE_US_DEFAULT = 1000;
     static constexpr uint32_t NON_TIMER_SERVICE_CALL_MIN_MS = 5;
 
     // If this is true nothing will move
@@ -99,6 +273,26 @@ private:
     // Stop is pending
     volatile bool _stopPending = false;
 
+    // Stop decelerates (as a feed hold) and then flushes the pipeline
+    bool _stopWithDecel = false;
+
+    // Feed hold - the executing block decelerates (at its own acceleration) to a standstill and is then held
+    enum HoldState : uint8_t
+    {
+        HOLD_NONE,
+        HOLD_DECELERATING,
+        HOLD_HELD
+    };
+    volatile HoldState _holdState = HOLD_NONE;
+    // Ratio (Q16) of the step rate to the planned final rate when a block ends during a feed hold deceleration -
+    // the next block continues the deceleration from the same fraction of its entry rate
+    uint32_t _holdRateRatioQ16 = 0;
+    static constexpr uint32_t HOLD_RATE_RATIO_Q16_ONE = 65536;
+
+    // Feed override (percent) and the override applied to the executing block
+    volatile uint32_t _feedOverridePercent = MotionBlock::FEED_OVERRIDE_PERCENT_DEFAULT;
+    volatile uint32_t _appliedFeedOverridePercent = MotionBlock::FEED_OVERRIDE_PERCENT_DEFAULT;
+
     // Steps moved in total and increment based on direction
     volatile int32_t _axisTotalSteps[AXIS_VALUES_MAX_AXES] = {0};
     volatile int32_t _totalStepsInc[AXIS_VALUES_MAX_AXES] = {0};
@@ -106,34 +300,152 @@ private:
     // Pipeline of blocks to be processed
     MotionPipeline _motionPipeline;
 
-    // Ramp generation timer
-    RampGenTimer _rampGenTimer;
+    // Ramp generation timer (this generator's own timer unless a shared timer is set)
+    RampGenTimer _ownRampGenTimer;
+    RampGenTimer* _pRampGenTimer = &_ownRampGenTimer;
     bool _useRampGenTimer = false;
     uint32_t _stepGenPeriodNs = 0;
     uint32_t _minStepRatePerTTicks = 0;
 
+    // Acceleration tick - the period at which the step rate is changed when accelerating
+    uint32_t _accelTickNs = MotionBlock::NS_IN_A_MS;
+
+    // Adaptive multi-axis step smoothing (AMASS) - the level is chosen for each block so that the step event
+    // rate (2^level events per major axis step) stays within AMASS_MAX_EVENT_RATE_PER_TTICKS (one event every
+    // 2 step generation ticks) - the cost per ISR call is unchanged
+    static constexpr uint32_t AMASS_MAX_LEVEL_DEFAULT = 3;
+    static constexpr uint32_t AMASS_MAX_LEVEL_LIMIT = 5;
+    static constexpr uint32_t AMASS_MAX_EVENT_RATE_PER_TTICKS = MotionBlock::TTICKS_VALUE / 2;
+    uint32_t _amassMaxLevel = AMASS_MAX_LEVEL_DEFAULT;
+    volatile uint32_t _amassLevel = 0;
+    volatile uint32_t _amassEventsPerStep = 1;
+    volatile uint32_t _amassMajorEventCount = 0;
+    volatile uint32_t _amassMajorStepsScaled = 0;
+
+    // Dynamic ISR rate - the timer period is scaled up (by an integer multiple of the step generation period)
+    // when idle and for slow blocks - a block's scale keeps the step event rate per ISR within the same limit
+    // as AMASS and applies acceleration at least once per ISR - the ISR runs at the base period for the
+    // step-end following a step so that step pulse widths are unchanged
+    uint32_t _isrIdlePeriodScale = 1;
+    volatile uint32_t _isrBlockPeriodScale = 1;
+    volatile bool _isrStepStarted = false;
+    inline void requestISRPeriodScale(uint32_t periodScale)
+    {
+        if (_useRampGenTimer)
+            _pRampGenTimer->requestPeriodScale(periodScale);
+    }
+
     // Non-timer loop rate
     uint32_t _nonTimerLoopLastMs = 0;
 
-    // Steppers
+    // Steppers (the pointer array is used in the ISR)
     std::vector<StepDriverBase*> _stepperDrivers;
+    DriverT* _stepperDriverPtrs[AXIS_VALUES_MAX_AXES] = {};
+    uint32_t _numStepperDrivers = 0;
+    bool _stepperDriversValid = true;
+
+    // Fixed config - number of drivers is known at compile time and all drivers are present
+    static constexpr bool IS_FIXED_CONFIG = NumAxes > 0;
+    inline uint32_t numStepperDrivers() const
+    {
+        return IS_FIXED_CONFIG ? NumAxes : _numStepperDrivers;
+    }
+    inline bool isDriverPresent(uint32_t axisIdx) const
+    {
+        return IS_FIXED_CONFIG || _stepperDriverPtrs[axisIdx];
+    }
     
+    // Direct GPIO stepping (step pins for all axes set/cleared with a single register write)
+    RampGenFastGPIO _fastGPIO;
+    bool _useFastGPIO = false;
+
+    // Hardware pulse engine (RMT or I2S shift registers) - step times are computed in loop() (or in the engine's
+    // refill task if it has one) and output by hardware - shorter chunks are used while endstops are checked
+    RampGenRMT _rmtEngine;
+    RampGenShiftReg _shiftRegEngine;
+    RampGenPulseEngineIF* _pPulseEngine = nullptr;
+    bool _usePulseEngine = false;
+    bool _pulseEngineRefillInTask = false;
+    uint64_t _pulseEngineNextStepNs = 0;
+    uint32_t _pulseEngineEndStopChunkNs = 0;
+
     // Endstops
     std::vector<EndStops*> _axisEndStops;
 
+    // Shared timebase - blocks with a scheduled start time aren't started before it
+    RampGenTimebase _timebase;
+
+    // Velocity mode - target and current step rates (signed - per TTicks) and rate change per acceleration tick
+    static constexpr int32_t VEL_RATE_MAX = MotionBlock::TTICKS_VALUE / 2;
+    volatile bool _velModeActive = false;
+    volatile int32_t _velTargetRate[AXIS_VALUES_MAX_AXES] = {0};
+    volatile int32_t _velCurRate[AXIS_VALUES_MAX_AXES] = {0};
+    volatile uint32_t _velAccPerTick[AXIS_VALUES_MAX_AXES] = {0};
+
+    // Pressure advance - the extruder axis is ahead of its nominal position by the advance steps (signed) which
+    // track a target proportional to its step rate - extra steps are added when the target is further ahead and
+    // nominal steps are skipped when it is behind so the axis doesn't reverse while moving - any advance left when
+    // the pipeline is empty is settled at PA_SETTLE_STEP_NS per step
+    static constexpr uint32_t PA_SETTLE_STEP_NS = 500000;
+    volatile int32_t _paAdvanceSteps = 0;
+    volatile int32_t _paTargetSteps = 0;
+    volatile uint32_t _paAxisIdx = MotionStepSegment::PA_AXIS_NONE;
+    uint32_t _paSettleAccumulatorNS = 0;
+    void IRAM_ATTR updatePressureAdvanceTarget(const MotionStepSegment *pBlock)
+    {
+        if (pBlock->_paFactorQ32 == 0)
+            return;
+        int32_t advanceSteps = int32_t((uint64_t(_curStepRatePerTTicks) * pBlock->_paFactorQ32) >> 32);
+        _paTargetSteps = _totalStepsInc[pBlock->_paAxisIdx] * advanceSteps;
+    }
+
+    // Position reset sequence number
+    volatile uint32_t _posResetSeqNum = 0;
+
+    // Motion phase from the most recent acceleration tick
+    volatile StepDriverBase::MotionPhase _motionPhase = StepDriverBase::MOTION_PHASE_IDLE;
+    void IRAM_ATTR setMotionPhaseFromRates(uint32_t prevRate, uint32_t curRate)
+    {
+        _motionPhase = curRate > prevRate ? StepDriverBase::MOTION_PHASE_ACCEL : 
+                    (curRate < prevRate ? StepDriverBase::MOTION_PHASE_DECEL : StepDriverBase::MOTION_PHASE_CRUISE);
+    }
+
+    // Trajectory stream - step generation periods into the sample being output
+    RampGenTrajStream _trajStream;
+    volatile bool _trajStreamStarted = false;
+    volatile uint32_t _trajSampleTicks = 0;
+    volatile bool _trajSampleActive = false;
+
     // Ramp generation enabled
     bool _rampGenEnabled = false;
-    // Last completed numbered command
-    // volatile int _lastDoneNumberedCmdIdx;
+    // Last completed motion tracking index (written by the ISR - the index is written before the count)
+    volatile uint32_t _lastDoneMotionTrackingIdx = 0;
+    volatile uint32_t _motionTrackingDoneCount = 0;
     // Steps
     volatile uint32_t _stepsTotalAbs[AXIS_VALUES_MAX_AXES] = {0};
     volatile uint32_t _curStepCount[AXIS_VALUES_MAX_AXES] = {0};
     // Current step rate (in steps per K ticks)
     volatile uint32_t _curStepRatePerTTicks = 0;
+    // Max and final step rates of the executing block (scaled down if the feed override has been reduced)
+    volatile uint32_t _curMaxStepRatePerTTicks = 0;
+    volatile uint32_t _curFinalStepRatePerTTicks = 0;
+    volatile bool _curRatesOverridden = false;
+    // Current acceleration and phase (jerk-limited profile only)
+    volatile uint32_t _curAccStepsPerTTicksPerMS = 0;
+    volatile bool _curRampDecelerating = false;
+    // Input shaping state - ticks since the ramp (acceleration or deceleration) started, the rate it started from,
+    // its target and total change and the rate it last set (the ramp restarts if any of these no longer apply)
+    volatile uint32_t _shaperPhaseTicks = 0;
+    volatile uint32_t _shaperRampStartRate = 0;
+    volatile uint32_t _shaperRampTargetRate = 0;
+    volatile uint32_t _shaperRampChange = 0;
+    volatile uint32_t _shaperRampRate = 0;
     // Accumulators for stepping and acceleration increments
     volatile uint32_t _curAccumulatorStep = 0;
     volatile uint32_t _curAccumulatorNS = 0;
     volatile uint32_t _curAccumulatorRelative[AXIS_VALUES_MAX_AXES] = {0};
+    // Step generation periods of step-end calls (which don't accumulate) to be applied on the next call
+    volatile uint32_t _stepEndElapsedPeriods = 0;
 
     // End stop handling
     volatile bool _endStopReached = false;
@@ -144,25 +456,113 @@ private:
         bool isMax;
         bool checkHit;
     };
-    volatile EndStopChecks _endStopChecks[AXIS_VALUES_MAX_AXES];
+    static constexpr uint32_t MAX_END_STOP_CHECKS = AXIS_VALUES_MAX_AXES * AXIS_VALUES_MAX_ENDSTOPS_PER_AXIS;
+    volatile EndStopChecks _endStopChecks[MAX_END_STOP_CHECKS];
+    // Interrupt-driven endstops are checked using the EndStops latch bitmasks (hit latched or not active)
+    volatile uint32_t _endStopLatchHitMask = 0;
+    volatile uint32_t _endStopLatchNotHitMask = 0;
+
+    // Setup of the block following the executing block - staged on ticks without a step event so that the
+    // block can start stepping on the tick the executing block ends (with the step and acceleration accumulators
+    // carrying their remainders across the boundary) - the planner can re-prepare a block after it is staged so
+    // the values it was staged from are checked when it is used
+    struct StagedBlockSetup
+    {
+        const MotionStepSegment* pBlock = nullptr;
+        uint32_t maxStepRatePerTTicks = 0;
+        uint32_t endStopsToCheckRaw = 0;
+        int32_t stepsTotalMaybeNeg[AXIS_VALUES_MAX_AXES] = {0};
+        uint32_t amassLevel = 0;
+        uint32_t amassMajorStepsScaled = 0;
+        uint32_t isrBlockPeriodScale = 1;
+        uint32_t endStopCheckNum = 0;
+        EndStopChecks endStopChecks[MAX_END_STOP_CHECKS];
+        uint32_t latchHitMask = 0;
+        uint32_t latchNotHitMask = 0;
+    };
+    StagedBlockSetup _stagedSetup;
+    volatile uint32_t _blockHandoverCount = 0;
+
+    // Direction setup time - when the direction of an axis changes its steps are deferred (counted but not output)
+    // until the setup time of its driver has elapsed while the other axes keep stepping - the deferred steps are
+    // then output one per tick (on ticks the axis isn't stepping) and the block isn't complete until they have been
+    // output - with the RMT engine the first step of a block which changes direction is delayed instead (and the
+    // shift register engine delays the steps itself as it outputs the direction)
+    uint32_t _dirSetupNs[AXIS_VALUES_MAX_AXES] = {0};
+    uint32_t _dirSetupPeriods[AXIS_VALUES_MAX_AXES] = {0};
+    volatile uint32_t _dirSetupRemainingPeriods[AXIS_VALUES_MAX_AXES] = {0};
+    volatile uint32_t _dirSetupDeferredSteps[AXIS_VALUES_MAX_AXES] = {0};
+    volatile uint32_t _dirSetupActiveMask = 0;
+    volatile uint32_t _blockDirSetupNs = 0;
+    // Axes stepped on the current tick
+    volatile uint32_t _isrStepAxesMask = 0;
+
+    // Pipeline low-water callback
+    volatile PipelineLowWaterCB _pPipelineLowWaterCB = nullptr;
+    void* volatile _pPipelineLowWaterCBArg = nullptr;
+    volatile uint32_t _pipelineLowWater = 0;
+    volatile uint32_t _pipelineLowWaterUs = 0;
 
     // Stats
     RampGenStats _stats;
 
+    // Block execution trace
+    RampGenTrace _trace;
+
     // Helpers
     void generateMotionPulses();
     bool handleStepEnd();
-    void setupNewBlock(MotionBlock *pBlock);
-    void updateMSAccumulator(MotionBlock *pBlock);
-    bool handleStepMotion(MotionBlock *pBlock);
-    void endMotion(MotionBlock *pBlock);
+    void setupNewBlock(MotionStepSegment *pBlock, bool isHandover = false);
+    void stageBlockSetup(const MotionStepSegment *pBlock);
+    bool isStagedFor(const MotionStepSegment *pBlock) const;
+    void stageNextBlock();
+    bool handoverToNextBlock();
+    void updateMSAccumulator(MotionStepSegment *pBlock, uint32_t elapsedNs);
+    void applyMSRateChange(MotionStepSegment *pBlock);
+    void applyFeedOverride(MotionStepSegment *pBlock);
+    void applyMSHoldDecel(MotionStepSegment *pBlock);
+    bool checkHoldComplete(MotionStepSegment *pBlock);
+    void flushPipeline();
+    void applyMSRateChangeJerkLimited(MotionStepSegment *pBlock);
+    void applyMSRateChangeShaped(MotionStepSegment *pBlock);
+    uint32_t nextJerkLimitedRateChange(MotionStepSegment *pBlock, uint32_t rateChangeRemaining);
+    static uint32_t nextJerkLimitedAcc(uint32_t curAcc, uint32_t maxAcc, uint32_t jerk, uint32_t rateChangeRemaining);
+    bool isEndStopHit();
+    bool handleStepMotion(MotionStepSegment *pBlock);
+    void handleTrajStream();
+    bool startTrajSample();
+    void handleVelocityMode();
+    void startDirectSteps(uint32_t stepAxesMask);
+    bool handlePressureAdvanceStep(MotionStepSegment *pBlock);
+    void handlePressureAdvanceSettle();
+    void stepAxis(uint32_t axisIdx);
+    void stepAxisAfterDirSetup(uint32_t axisIdx);
+    void updateDirSetupPeriods(uint32_t elapsedPeriods);
+    bool releaseDeferredSteps();
+    void endMotion(MotionStepSegment *pBlock, RampGenTrace::EventType traceEvent = RampGenTrace::EVENT_BLOCK_END);
+    void servicePulseEngine();
+    void fillPulseEngineChunk(MotionStepSegment *pBlock);
+    bool fillPulseEngineSettleChunk();
+    bool blockChangesDirection(const MotionStepSegment *pBlock) const;
+    uint64_t stepIntervalNs() const
+    {
+        return (uint64_t(_stepGenPeriodNs) * MotionBlock::TTICKS_VALUE) / UTILS_MAX(_curStepRatePerTTicks, _minStepRatePerTTicks);
+    }
 
     /// @brief Timer callback
     /// @param pObject Object to call (this class instance)
     static IRAM_ATTR void rampGenTimerCallback(void* pObject)
     {
         if (pObject)
-            ((RampGenerator*)pObject)->generateMotionPulses();
+            ((RampGeneratorT*)pObject)->generateMotionPulses();
+    }
+
+    /// @brief Pulse engine refill callback (called in the engine's refill task)
+    /// @param pObject Object to call (this class instance)
+    static void pulseEngineRefillCallback(void* pObject)
+    {
+        if (pObject)
+            ((RampGeneratorT*)pObject)->servicePulseEngine();
     }
 
     // ISR count
@@ -175,3 +575,14 @@ private:
     uint32_t _debugRampGenLoopLastMs = 0;
     uint32_t _debugRampGenLoopCount = 0;
 };
+
+// Ramp generator type used by the motion controller
+#ifdef RAMP_GEN_FIXED_NUM_AXES
+#ifndef RAMP_GEN_FIXED_DRIVER
+#define RAMP_GEN_FIXED_DRIVER StepDriverTMC2209
+#endif
+#include "StepDriverTMC2209.h"
+using RampGenerator = RampGeneratorT<RAMP_GEN_FIXED_NUM_AXES, RAMP_GEN_FIXED_DRIVER>;
+#else
+using RampGenerator = RampGeneratorT<0, StepDriverBase>;
+#endif
@@ -10,6 +10,7 @@
 #include "RaftArduino.h"
 #include "RaftBus.h"
 #include "BusRequestInfo.h"
+#include "MotionPerfCounters.h"
 
 // Warning on CRC error
 #define WARN_ON_CRC_ERROR
@@ -20,6 +21,35 @@
 // #define DEBUG_REGISTER_WRITE
 // #define DEBUG_READ_TIMEOUT
 // #define DEBUG_READ_DETAIL
+// #define DEBUG_REGISTER_VERIFY
+
+// Tables for the Trinamics CRC (generated at compile time)
+struct TrinamicsCRCTable
+{
+    uint8_t vals[256] = {};
+    constexpr TrinamicsCRCTable()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint8_t crc = i;
+            for (uint32_t j = 0; j < 8; j++)
+                crc = (crc & 0x01) ? ((crc >> 1) ^ 0xe0) : (crc >> 1);
+            vals[i] = crc;
+        }
+    }
+};
+struct ReverseBitsTable
+{
+    uint8_t vals[256] = {};
+    constexpr ReverseBitsTable()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+            for (uint32_t j = 0; j < 8; j++)
+                vals[i] |= ((i >> j) & 0x01) << (7 - j);
+    }
+};
+static constexpr TrinamicsCRCTable TRINAMICS_CRC_TABLE;
+static constexpr ReverseBitsTable REVERSE_BITS_TABLE;
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
@@ -62,6 +92,10 @@ void StepDriverBase::setupSerialBus(RaftBus* pBus, bool useBusForDirectionRevers
 /// @brief Loop - called frequently
 void StepDriverBase::loop()
 {
+    // Reads are handled by the bus scheduler if there is one
+    if (_busScheduled)
+        return;
+
     // Check if we are reading
     if (isReadInProgress())
     {
@@ -74,8 +108,8 @@ void StepDriverBase::loop()
         {
             // Read the data
             uint32_t reqLen = _readBytesToIgnore + _readBytesRequired;
-            uint8_t readData[reqLen];
-            if (_pSerialBus->rxDataGet(readData, reqLen) == reqLen)
+            uint8_t readData[TMC_READ_DATAGRAM_LEN + TMC_REPLY_DATAGRAM_LEN];
+            if ((reqLen <= sizeof(readData)) && (_pSerialBus->rxDataGet(readData, reqLen) == reqLen))
             {
                 // Clear read in progress
                 _readInProgress = false;
@@ -87,43 +121,8 @@ void StepDriverBase::loop()
                                 _name.c_str(), _readRegisterIdx, debugStr.c_str());
 #endif
 
-                // Check register index is valid
-                if (_readRegisterIdx < _driverRegisters.size())
-                {
-                    // Check the CRC
-                    uint8_t replyCRC = readData[_readBytesToIgnore + TMC_REPLY_CRC_POS];
-                    uint8_t calculatedCRC = calcTrinamicsCRC(readData + _readBytesToIgnore, TMC_REPLY_DATAGRAM_LEN-1);
-                    if (replyCRC != calculatedCRC)
-                    {
-#ifdef WARN_ON_CRC_ERROR
-                        LOG_W(MODULE_PREFIX, "loop read CRC error 0x%02x 0x%02x %s stepperAddr 0x%02x regIdx %d regAddr 0x%02x", 
-                                    replyCRC, 
-                                    calculatedCRC,
-                                    _name.c_str(),
-                                    _requestedParams.address,
-                                    _readRegisterIdx, 
-                                    _driverRegisters[_readRegisterIdx].regAddr);
-#endif
-                        _lastReadResult = READ_RESULT_CRC_ERROR;
-                        _driverRegisters[_readRegisterIdx].readValid = false;
-                    }
-                    else
-                    {
-                        // Data pointer
-                        const uint8_t* pData = readData + _readBytesToIgnore + TMC_REPLY_DATA_POS;
-                        _driverRegisters[_readRegisterIdx].regValCur = Raft::getBEUInt32AndInc(pData);
-
-#ifdef DEBUG_REGISTER_READ_VALUE
-                        LOG_I(MODULE_PREFIX, "loop read %s reg %s(0x%02x) data 0x%08x", 
-                                    _name.c_str(),
-                                    _driverRegisters[_readRegisterIdx].regName.c_str(),
-                                    _driverRegisters[_readRegisterIdx].regAddr,
-                                    _driverRegisters[_readRegisterIdx].regValCur);
-#endif
-                        _lastReadResult = READ_RESULT_OK;
-                        _driverRegisters[_readRegisterIdx].readValid = true;
-                    }
-                }
+                // Handle the reply
+                handleReadReply(_readRegisterIdx, readData + _readBytesToIgnore);
             }
         }
     }
@@ -134,8 +133,99 @@ void StepDriverBase::loop()
 #ifdef DEBUG_READ_TIMEOUT
         LOG_I(MODULE_PREFIX, "loop name %s read timed out", _name.c_str());
 #endif
-        _lastReadResult = READ_RESULT_TIMEOUT;
         _readInProgress = false;
+        handleReadReply(_readRegisterIdx, nullptr);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle a register read reply
+/// @param regIdx - index of register read
+/// @param pReply - reply datagram (TMC_REPLY_DATAGRAM_LEN bytes) or nullptr if the read timed out
+void StepDriverBase::handleReadReply(uint32_t regIdx, const uint8_t* pReply)
+{
+    // Check register index is valid
+    if (regIdx >= _driverRegisters.size())
+        return;
+
+    // A register being verified is written if the read fails or the value doesn't match
+    DriverRegisterMap& reg = _driverRegisters[regIdx];
+    bool verifyReg = reg.verifyPending;
+    reg.verifyPending = false;
+
+    // Check for timeout
+    if (!pReply)
+    {
+        _lastReadResult = READ_RESULT_TIMEOUT;
+        if (verifyReg)
+            reg.writePending = true;
+        return;
+    }
+
+    // Check the CRC (and that the reply is for the register requested)
+    uint8_t replyCRC = pReply[TMC_REPLY_CRC_POS];
+    uint8_t calculatedCRC = calcTrinamicsCRC(pReply, TMC_REPLY_DATAGRAM_LEN-1);
+    if ((replyCRC != calculatedCRC) || (pReply[TMC_REPLY_REG_ADDR_POS] != _driverRegisters[regIdx].regAddr))
+    {
+#ifdef WARN_ON_CRC_ERROR
+        LOG_W(MODULE_PREFIX, "loop read CRC error 0x%02x 0x%02x %s stepperAddr 0x%02x regIdx %d regAddr 0x%02x replyRegAddr 0x%02x", 
+                    replyCRC, 
+                    calculatedCRC,
+                    _name.c_str(),
+                    _requestedParams.address,
+                    regIdx, 
+                    _driverRegisters[regIdx].regAddr,
+                    pReply[TMC_REPLY_REG_ADDR_POS]);
+#endif
+        _lastReadResult = READ_RESULT_CRC_ERROR;
+        MotionPerfCounters::incCounter(MotionPerfCounters::COUNTER_UART_CRC_ERRORS);
+        _driverRegisters[regIdx].readValid = false;
+        if (verifyReg)
+            reg.writePending = true;
+        return;
+    }
+
+    // Data pointer
+    const uint8_t* pData = pReply + TMC_REPLY_DATA_POS;
+    _driverRegisters[regIdx].regValCur = Raft::getBEUInt32AndInc(pData);
+
+#ifdef DEBUG_REGISTER_READ_VALUE
+    LOG_I(MODULE_PREFIX, "loop read %s reg %s(0x%02x) data 0x%08x", 
+                _name.c_str(),
+                _driverRegisters[regIdx].regName.c_str(),
+                _driverRegisters[regIdx].regAddr,
+                _driverRegisters[regIdx].regValCur);
+#endif
+    _lastReadResult = READ_RESULT_OK;
+    _driverRegisters[regIdx].readValid = true;
+
+    // Check the value of a register being verified
+    if (verifyReg && ((reg.regValCur & reg.writeBitMask) != (reg.regWriteVal & reg.writeBitMask)))
+        reg.writePending = true;
+#ifdef DEBUG_REGISTER_VERIFY
+    if (verifyReg)
+        LOG_I(MODULE_PREFIX, "verify %s reg %s(0x%02x) read 0x%08x required 0x%08x %s", 
+                _name.c_str(), reg.regName.c_str(), reg.regAddr, reg.regValCur, reg.regWriteVal,
+                reg.writePending ? "WRITE" : "MATCHES");
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Replace pending writes of readable config registers with reads (the write is made only if the value
+///        read back differs from the required value)
+void StepDriverBase::verifyConfigRegsBeforeWrite()
+{
+    // Write-only drivers can't be verified
+    if (_requestedParams.writeOnly)
+        return;
+    for (DriverRegisterMap& reg : _driverRegisters)
+    {
+        if (reg.writePending && reg.isConfigReg && reg.isReadableReg)
+        {
+            reg.writePending = false;
+            reg.verifyPending = true;
+            reg.readPending = true;
+        }
     }
 }
 
@@ -163,17 +253,8 @@ void StepDriverBase::writeTrinamicsRegister(const char* pRegName, uint8_t regAdd
         return;
 
     // Form datagram
-    uint8_t datagram[] = {
-        _tmcSyncByte,
-        _requestedParams.address,
-        uint8_t(regAddr | 0x80u),
-        uint8_t((data >> 24) & 0xff),
-        uint8_t((data >> 16) & 0xff),
-        uint8_t((data >> 8) & 0xff),
-        uint8_t(data & 0xff),
-        0   // This is where the CRC will go
-    };
-    datagram[sizeof(datagram)-1] = calcTrinamicsCRC(datagram, sizeof(datagram)-1);
+    uint8_t datagram[TMC_WRITE_DATAGRAM_LEN];
+    formWriteDatagram(regAddr, data, datagram);
 
     // Form the command
     BusRequestInfo reqInfo(_name, _requestedParams.address, datagram, sizeof(datagram));
@@ -211,13 +292,8 @@ void StepDriverBase::startReadTrinamicsRegister(uint32_t readRegisterIdx)
     }
 
     // Form datagram
-    uint8_t datagram[] = {
-        _tmcSyncByte,
-        _requestedParams.address,
-        _driverRegisters[readRegisterIdx].regAddr,
-        0   // This is where the CRC will go
-    };
-    datagram[sizeof(datagram)-1] = calcTrinamicsCRC(datagram, sizeof(datagram)-1);
+    uint8_t datagram[TMC_READ_DATAGRAM_LEN];
+    formReadDatagram(_driverRegisters[readRegisterIdx].regAddr, datagram);
 
     // Form the command
     BusRequestInfo reqInfo(_name, _requestedParams.address, datagram, sizeof(datagram));
@@ -243,28 +319,112 @@ void StepDriverBase::startReadTrinamicsRegister(uint32_t readRegisterIdx)
 #endif
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Form a register write datagram
+/// @param regAddr - address of register
+/// @param data - data to write
+/// @param pDatagram - (out) datagram (TMC_WRITE_DATAGRAM_LEN bytes)
+void StepDriverBase::formWriteDatagram(uint8_t regAddr, uint32_t data, uint8_t* pDatagram) const
+{
+    pDatagram[0] = _tmcSyncByte;
+    pDatagram[1] = _requestedParams.address;
+    pDatagram[2] = uint8_t(regAddr | 0x80u);
+    pDatagram[3] = uint8_t((data >> 24) & 0xff);
+    pDatagram[4] = uint8_t((data >> 16) & 0xff);
+    pDatagram[5] = uint8_t((data >> 8) & 0xff);
+    pDatagram[6] = uint8_t(data & 0xff);
+    pDatagram[7] = calcTrinamicsCRC(pDatagram, TMC_WRITE_DATAGRAM_LEN-1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Form a register read datagram
+/// @param regAddr - address of register
+/// @param pDatagram - (out) datagram (TMC_READ_DATAGRAM_LEN bytes)
+void StepDriverBase::formReadDatagram(uint8_t regAddr, uint8_t* pDatagram) const
+{
+    pDatagram[0] = _tmcSyncByte;
+    pDatagram[1] = _requestedParams.address;
+    pDatagram[2] = regAddr;
+    pDatagram[3] = calcTrinamicsCRC(pDatagram, TMC_READ_DATAGRAM_LEN-1);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the datagram for the next pending register write (used by a bus scheduler)
+/// @param pDatagram - (out) datagram
+/// @param maxLen - max length of datagram
+/// @param datagramLen - (out) length of datagram
+/// @return true if a write is pending (and its pending flag has been cleared)
+bool StepDriverBase::busGetPendingWrite(uint8_t* pDatagram, uint32_t maxLen, uint32_t& datagramLen)
+{
+    // Check for write pending
+    int wrPendRegIdx = writePendingRegIdx();
+    if ((wrPendRegIdx < 0) || (maxLen < TMC_WRITE_DATAGRAM_LEN))
+        return false;
+
+    // Form datagram
+    DriverRegisterMap& reg = _driverRegisters[wrPendRegIdx];
+    formWriteDatagram(reg.regAddr, reg.regWriteVal, pDatagram);
+    datagramLen = TMC_WRITE_DATAGRAM_LEN;
+    if (_requestedParams.writeOnly)
+        reg.regValCur = reg.regWriteVal;
+    reg.writePending = false;
+    _lastWriteResultOk = true;
+
+#ifdef DEBUG_REGISTER_WRITE
+    LOG_I(MODULE_PREFIX, "busGetPendingWrite %s reg %s(0x%02x) value 0x%08x", 
+                    _name.c_str(), reg.regName.c_str(), reg.regAddr, reg.regWriteVal);
+#endif
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get the datagram for the next pending register read (used by a bus scheduler)
+/// @param pDatagram - (out) datagram
+/// @param maxLen - max length of datagram
+/// @param datagramLen - (out) length of datagram
+/// @param regIdx - (out) index of register to be read
+/// @return true if a read is pending (and its pending flag has been cleared)
+bool StepDriverBase::busGetPendingRead(uint8_t* pDatagram, uint32_t maxLen, uint32_t& datagramLen, uint32_t& regIdx)
+{
+    // Check for read pending
+    int rdPendRegIdx = readPendingRegIdx();
+    if ((rdPendRegIdx < 0) || (maxLen < TMC_READ_DATAGRAM_LEN))
+        return false;
+
+    // Form datagram
+    formReadDatagram(_driverRegisters[rdPendRegIdx].regAddr, pDatagram);
+    datagramLen = TMC_READ_DATAGRAM_LEN;
+    regIdx = rdPendRegIdx;
+    _driverRegisters[rdPendRegIdx].readPending = false;
+
+#ifdef DEBUG_READ_DETAIL
+    LOG_I(MODULE_PREFIX, "busGetPendingRead %s regIdx %d regAddr %d", 
+                _name.c_str(), regIdx, _driverRegisters[rdPendRegIdx].regAddr);
+#endif
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle the reply to a scheduled register read
+/// @param regIdx - index of register read
+/// @param pReply - reply datagram or nullptr if the read timed out
+/// @param replyLen - length of reply
+void StepDriverBase::busReadComplete(uint32_t regIdx, const uint8_t* pReply, uint32_t replyLen)
+{
+    handleReadReply(regIdx, (pReply && (replyLen >= TMC_REPLY_DATAGRAM_LEN)) ? pReply : nullptr);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Calculate trinamics CRC
 /// @param pData - pointer to data
 /// @param len - length of data
 /// @return CRC
-uint8_t StepDriverBase::calcTrinamicsCRC(const uint8_t* pData, uint32_t len) const
+/// @note The CRC is CRC8 (polynomial x^8+x^2+x+1) with the bits of each byte processed LSB first - this is
+///       computed a byte at a time in reflected form (polynomial 0xe0) using a table and the result is bit-reversed
+uint8_t StepDriverBase::calcTrinamicsCRC(const uint8_t* pData, uint32_t len)
 {
-    uint8_t crc = 0;
+    uint8_t crcReflected = 0;
     for (uint32_t i = 0; i < len; i++)
-    {
-        uint8_t currentByte = pData[i];
-        for (uint32_t j = 0; j < 8; j++)
-        {
-            // update CRC based result of XOR operation
-            if ((crc >> 7) ^ (currentByte & 0x01)) {
-                crc = (crc << 1) ^ 0x07;
-            } else {
-                crc = (crc << 1);
-            }
-            crc &= 0xff;
-            currentByte = currentByte >> 1;
-        }
-    }
-    return crc;
+        crcReflected = TRINAMICS_CRC_TABLE.vals[crcReflected ^ pData[i]];
+    return REVERSE_BITS_TABLE.vals[crcReflected];
 }
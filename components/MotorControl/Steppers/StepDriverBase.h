@@ -41,20 +41,71 @@ public:
     virtual void stepStart() = 0;
     virtual bool stepEnd() = 0;
 
+    // Step pin for direct GPIO stepping (-1 if the driver must be stepped via stepStart/stepEnd)
+    virtual int getStepPin() const
+    {
+        return -1;
+    }
+
     virtual uint32_t getSerialAddress() const
     {
         return _serialBusAddress;
     }
 
+    // Driver type name
+    static constexpr const char* DRIVER_TYPE = "None";
     virtual String getDriverType() const
     {
-        return "None";
+        return DRIVER_TYPE;
     }
 
     virtual void setMaxMotorCurrentAmps(float maxMotorCurrentAmps)
     {
     }
 
+    // StallGuard threshold (0 disables stall detection)
+    virtual void setStallThreshold(uint8_t stallThreshold)
+    {
+    }
+
+    // Motion phase - drivers which support it scale the run current for the phase (see StepDriverParams)
+    enum MotionPhase
+    {
+        MOTION_PHASE_IDLE,
+        MOTION_PHASE_ACCEL,
+        MOTION_PHASE_CRUISE,
+        MOTION_PHASE_DECEL
+    };
+    virtual void setMotionPhase(MotionPhase motionPhase)
+    {
+    }
+
+    // DIAG pin (which indicates a stall when StallGuard is enabled) - -1 if none
+    int getDiagPin() const
+    {
+        return _requestedParams.diagPin;
+    }
+
+    // Direction setup time (ns) - the minimum time from a direction change to the next step
+    uint32_t getDirSetupNs() const
+    {
+        return _requestedParams.dirSetupNs;
+    }
+
+    // Shift register step and direction output bits (-1 if not used) and direction inversion
+    int getShiftRegStepBit() const
+    {
+        return _requestedParams.srStepBit;
+    }
+    int getShiftRegDirnBit() const
+    {
+        return _requestedParams.srDirnBit;
+    }
+    bool isDirnInverted() const
+    {
+        return _requestedParams.invDirn;
+    }
+
     virtual String getDebugJSON(bool includeBraces, bool detailed) const
     {
         return includeBraces ? "{}" : "";
@@ -70,6 +121,50 @@ public:
         return true;
     }
 
+    // Status bits (compact driver status for binary telemetry)
+    static const uint32_t STATUS_BIT_NOT_OK = 0x01;
+    static const uint32_t STATUS_BIT_OVER_TEMP = 0x02;
+    static const uint32_t STATUS_BIT_FAULT = 0x04;
+    static const uint32_t STATUS_BIT_UNDERVOLTAGE = 0x08;
+    static const uint32_t STATUS_BITS_PER_DRIVER = 4;
+    virtual uint32_t getStatusBits() const
+    {
+        return isOperatingOk() ? 0 : STATUS_BIT_NOT_OK;
+    }
+
+    // Bus scheduling - when several drivers share a bus a StepDriverBusScheduler services register reads and
+    // writes for all of them (and the driver's own loop no longer uses the bus)
+    void setBusScheduled(bool busScheduled)
+    {
+        _busScheduled = busScheduled;
+        _readInProgress = false;
+    }
+    bool isBusScheduled() const
+    {
+        return _busScheduled;
+    }
+    bool isSingleWireReadWrite() const
+    {
+        return _singleWireReadWrite;
+    }
+
+    // Get the datagram for the next pending register write (clears the pending flag) - returns false if none
+    bool busGetPendingWrite(uint8_t* pDatagram, uint32_t maxLen, uint32_t& datagramLen);
+
+    // Get the datagram for the next pending register read (clears the pending flag) - returns false if none
+    bool busGetPendingRead(uint8_t* pDatagram, uint32_t maxLen, uint32_t& datagramLen, uint32_t& regIdx);
+
+    // Handle the reply to a scheduled register read (or a read timeout if pReply is nullptr)
+    void busReadComplete(uint32_t regIdx, const uint8_t* pReply, uint32_t replyLen);
+
+    // Calculate Trinamics CRC
+    static uint8_t calcTrinamicsCRC(const uint8_t* pData, uint32_t len);
+
+    // Datagram lengths
+    static const uint32_t TMC_WRITE_DATAGRAM_LEN = 8;
+    static const uint32_t TMC_READ_DATAGRAM_LEN = 4;
+    static const uint32_t TMC_REPLY_DATAGRAM_LEN = 8;
+
 protected:
     class DriverRegisterMap
     {
@@ -93,6 +188,7 @@ protected:
         bool writePending : 1 = false;
         bool readPending : 1 = false;
         bool readValid : 1 = false;
+        bool verifyPending : 1 = false;
     };
 
     // Write register in Trinamics driver
@@ -101,8 +197,17 @@ protected:
     // Start a read from Trinamics register
     void startReadTrinamicsRegister(uint32_t readRegisterIdx);
 
-    // Calculate Trinamics CRC
-    uint8_t calcTrinamicsCRC(const uint8_t* pData, uint32_t len) const;
+
+    // Form write and read datagrams
+    void formWriteDatagram(uint8_t regAddr, uint32_t data, uint8_t* pDatagram) const;
+    void formReadDatagram(uint8_t regAddr, uint8_t* pDatagram) const;
+
+    // Handle a register read reply (or a read timeout when pReply is nullptr)
+    void handleReadReply(uint32_t regIdx, const uint8_t* pReply);
+
+    // Replace pending writes of readable config registers with reads - the write is only made if the value
+    // read back differs (so a restart which finds the driver already configured doesn't rewrite it)
+    void verifyConfigRegsBeforeWrite();
 
     // Bus valid
     bool busValid() const
@@ -195,10 +300,13 @@ protected:
 
     // Using ISR - so avoid logging, etc
     bool _usingISR = false;
+
+    // Register reads and writes are handled by a bus scheduler
+    bool _busScheduled = false;
     
     // Consts
     static const uint32_t READ_TIMEOUT_MS = 4;
-    static const uint32_t TMC_REPLY_DATAGRAM_LEN = 8;
+    static const uint32_t TMC_REPLY_REG_ADDR_POS = 2;
     static const uint32_t TMC_REPLY_DATA_POS = 3;
     static const uint32_t TMC_REPLY_DATA_LEN = 4;
     static const uint32_t TMC_REPLY_CRC_POS = 7;
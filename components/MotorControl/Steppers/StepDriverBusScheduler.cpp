@@ -0,0 +1,237 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// StepDriverBusScheduler
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "StepDriverBusScheduler.h"
+#include "RaftArduino.h"
+#include "RaftBus.h"
+#include "BusRequestInfo.h"
+#include "MotionPerfCounters.h"
+
+// Debug
+// #define DEBUG_BUS_SCHED_WRITE
+// #define DEBUG_BUS_SCHED_READ
+// #define DEBUG_BUS_SCHED_READ_TIMEOUT
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Constructor
+StepDriverBusScheduler::StepDriverBusScheduler()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup
+/// @param pBus - bus shared by the drivers
+void StepDriverBusScheduler::setup(RaftBus* pBus)
+{
+    clear();
+    _pBus = pBus;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Clear the drivers
+void StepDriverBusScheduler::clear()
+{
+    for (StepDriverBase* pDriver : _drivers)
+        pDriver->setBusScheduled(false);
+    _drivers.clear();
+    _nextWriteDriverIdx = 0;
+    _nextReadDriverIdx = 0;
+    _rxBytesToIgnore = 0;
+    _readInProgress = false;
+    _replyLen = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add a driver
+/// @param pDriver - driver to schedule
+void StepDriverBusScheduler::addDriver(StepDriverBase* pDriver)
+{
+    if (!pDriver || !_pBus)
+        return;
+    pDriver->setBusScheduled(true);
+    _drivers.push_back(pDriver);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Loop - called frequently
+void StepDriverBusScheduler::loop()
+{
+    // Check active
+    if (!isActive())
+        return;
+
+    // Handle received data
+    serviceRx();
+
+    // Check for read timeout
+    if (_readInProgress && Raft::isTimeout(millis(), _readLastActivityMs, READ_TIMEOUT_MS))
+    {
+#ifdef DEBUG_BUS_SCHED_READ_TIMEOUT
+        LOG_I(MODULE_PREFIX, "loop read timeout driver %d regIdx %d rxBytesToIgnore %d replyLen %d",
+                    _readDriverIdx, _readRegIdx, _rxBytesToIgnore, _replyLen);
+#endif
+        _drivers[_readDriverIdx]->busReadComplete(_readRegIdx, nullptr, 0);
+        _readInProgress = false;
+        _rxBytesToIgnore = 0;
+        _pBus->rxDataClear();
+        _numReadTimeouts++;
+        MotionPerfCounters::incCounter(MotionPerfCounters::COUNTER_UART_READ_TIMEOUTS);
+    }
+
+    // Nothing can be sent until the reply to a read has been received (it would collide on a single-wire bus)
+    if (_readInProgress)
+        return;
+
+    // Writes take priority and are queued back-to-back - a read can then follow them as its reply is
+    // only collected once their echo bytes have been discarded
+    issueWrites();
+    issueRead();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle received data - echo bytes are discarded and the reply to a read is collected
+void StepDriverBusScheduler::serviceRx()
+{
+    uint8_t rxBuf[MAX_DATAGRAM_LEN];
+    while (true)
+    {
+        uint32_t bytesAvailable = _pBus->rxDataBytesAvailable();
+        if (bytesAvailable == 0)
+            return;
+
+        // Discard stray data if nothing is expected
+        if ((_rxBytesToIgnore == 0) && !_readInProgress)
+        {
+            _pBus->rxDataClear();
+            return;
+        }
+        _readLastActivityMs = millis();
+
+        // Discard echo bytes
+        if (_rxBytesToIgnore > 0)
+        {
+            uint32_t numToGet = UTILS_MIN(UTILS_MIN(bytesAvailable, _rxBytesToIgnore), sizeof(rxBuf));
+            uint32_t numGot = _pBus->rxDataGet(rxBuf, numToGet);
+            if (numGot == 0)
+                return;
+            _rxBytesToIgnore -= UTILS_MIN(numGot, _rxBytesToIgnore);
+            continue;
+        }
+
+        // Collect the reply
+        uint32_t numToGet = UTILS_MIN(bytesAvailable, sizeof(_replyBuf) - _replyLen);
+        uint32_t numGot = _pBus->rxDataGet(_replyBuf + _replyLen, numToGet);
+        if (numGot == 0)
+            return;
+        _replyLen += numGot;
+        if (_replyLen < sizeof(_replyBuf))
+            continue;
+
+#ifdef DEBUG_BUS_SCHED_READ
+        String debugStr;
+        Raft::getHexStrFromBytes(_replyBuf, _replyLen, debugStr);
+        LOG_I(MODULE_PREFIX, "serviceRx driver %d regIdx %d reply 0x%s", _readDriverIdx, _readRegIdx, debugStr.c_str());
+#endif
+        _readInProgress = false;
+        MotionPerfCounters::recordTime(MotionPerfCounters::TIMER_UART_TRANSACTION, micros() - _readStartUs);
+        _drivers[_readDriverIdx]->busReadComplete(_readRegIdx, _replyBuf, _replyLen);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Issue pending writes (round-robin across drivers)
+/// @return Number of writes issued
+uint32_t StepDriverBusScheduler::issueWrites()
+{
+    uint32_t numIssued = 0;
+    uint32_t numDriversIdle = 0;
+    while ((numIssued < MAX_WRITES_PER_LOOP) && (numDriversIdle < _drivers.size()) && _pBus->isReady())
+    {
+        StepDriverBase* pDriver = _drivers[_nextWriteDriverIdx];
+        uint8_t datagram[MAX_DATAGRAM_LEN];
+        uint32_t datagramLen = 0;
+        if (!pDriver->busGetPendingWrite(datagram, sizeof(datagram), datagramLen))
+        {
+            // Move to the next driver
+            _nextWriteDriverIdx = (_nextWriteDriverIdx + 1) % _drivers.size();
+            numDriversIdle++;
+            continue;
+        }
+
+        // Send
+        BusRequestInfo reqInfo("", pDriver->getSerialAddress(), datagram, datagramLen);
+        if (!_pBus->addRequest(reqInfo))
+            LOG_W(MODULE_PREFIX, "issueWrites addRequest failed addr 0x%02x", pDriver->getSerialAddress());
+        else if (pDriver->isSingleWireReadWrite())
+            _rxBytesToIgnore += datagramLen;
+        numIssued++;
+        numDriversIdle = 0;
+        _numWrites++;
+
+#ifdef DEBUG_BUS_SCHED_WRITE
+        LOG_I(MODULE_PREFIX, "issueWrites driver %d addr 0x%02x len %d",
+                    _nextWriteDriverIdx, pDriver->getSerialAddress(), datagramLen);
+#endif
+    }
+    return numIssued;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Issue the next pending read (round-robin across drivers)
+void StepDriverBusScheduler::issueRead()
+{
+    if (!_pBus->isReady())
+        return;
+    for (uint32_t i = 0; i < _drivers.size(); i++)
+    {
+        uint32_t driverIdx = (_nextReadDriverIdx + i) % _drivers.size();
+        StepDriverBase* pDriver = _drivers[driverIdx];
+        uint8_t datagram[MAX_DATAGRAM_LEN];
+        uint32_t datagramLen = 0;
+        uint32_t regIdx = 0;
+        if (!pDriver->busGetPendingRead(datagram, sizeof(datagram), datagramLen, regIdx))
+            continue;
+
+        // Send
+        BusRequestInfo reqInfo("", pDriver->getSerialAddress(), datagram, datagramLen);
+        if (!_pBus->addRequest(reqInfo))
+        {
+            LOG_W(MODULE_PREFIX, "issueRead addRequest failed addr 0x%02x", pDriver->getSerialAddress());
+            pDriver->busReadComplete(regIdx, nullptr, 0);
+            return;
+        }
+        if (pDriver->isSingleWireReadWrite())
+            _rxBytesToIgnore += datagramLen;
+        _readInProgress = true;
+        _readDriverIdx = driverIdx;
+        _readRegIdx = regIdx;
+        _readLastActivityMs = millis();
+        _readStartUs = micros();
+        _replyLen = 0;
+        _numReads++;
+
+        // Next read is from the following driver
+        _nextReadDriverIdx = (driverIdx + 1) % _drivers.size();
+        return;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get debug JSON
+/// @param includeBraces - include braces
+/// @return JSON string
+String StepDriverBusScheduler::getDebugJSON(bool includeBraces) const
+{
+    String jsonStr = "\"drv\":" + String(_drivers.size()) +
+                ",\"wr\":" + String(_numWrites) +
+                ",\"rd\":" + String(_numReads) +
+                ",\"rdTO\":" + String(_numReadTimeouts);
+    if (includeBraces)
+        return "{" + jsonStr + "}";
+    return jsonStr;
+}
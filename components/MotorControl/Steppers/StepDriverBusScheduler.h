@@ -0,0 +1,88 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// StepDriverBusScheduler
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "RaftUtils.h"
+#include "StepDriverBase.h"
+
+class RaftBus;
+
+// Scheduler for register reads and writes of all the stepper drivers sharing a serial bus
+// - pending writes (e.g. current changes) take priority over reads and are queued back-to-back on the bus
+// - reads are issued one at a time (on a single-wire bus a reply can't overlap another datagram) in round-robin
+//   order across drivers as soon as the previous reply is received
+// - received bytes are consumed as they arrive - the echo of each datagram sent on a single-wire bus is discarded
+//   and the reply is collected incrementally
+class StepDriverBusScheduler
+{
+public:
+    StepDriverBusScheduler();
+
+    // Setup with the bus (drivers are added separately)
+    void setup(RaftBus* pBus);
+
+    // Clear the drivers (they are no longer scheduled)
+    void clear();
+
+    // Add a driver (which must have been setup with the same bus)
+    void addDriver(StepDriverBase* pDriver);
+
+    // Loop - called frequently
+    void loop();
+
+    // Check if the scheduler is active
+    bool isActive() const
+    {
+        return _pBus && (_drivers.size() > 0);
+    }
+
+    // Debug
+    String getDebugJSON(bool includeBraces) const;
+
+private:
+    // Bus
+    RaftBus* _pBus = nullptr;
+
+    // Drivers
+    std::vector<StepDriverBase*> _drivers;
+    uint32_t _nextWriteDriverIdx = 0;
+    uint32_t _nextReadDriverIdx = 0;
+
+    // Echo bytes (of datagrams sent on a single-wire bus) still to be discarded
+    uint32_t _rxBytesToIgnore = 0;
+
+    // Read in progress - the timeout is restarted whenever bytes are received as writes queued ahead of the read
+    // delay the reply
+    bool _readInProgress = false;
+    uint32_t _readDriverIdx = 0;
+    uint32_t _readRegIdx = 0;
+    uint32_t _readLastActivityMs = 0;
+    uint32_t _readStartUs = 0;
+    uint8_t _replyBuf[StepDriverBase::TMC_REPLY_DATAGRAM_LEN] = {};
+    uint32_t _replyLen = 0;
+
+    // Stats
+    uint32_t _numWrites = 0;
+    uint32_t _numReads = 0;
+    uint32_t _numReadTimeouts = 0;
+
+    // Consts
+    static const uint32_t READ_TIMEOUT_MS = 4;
+    static const uint32_t MAX_WRITES_PER_LOOP = 8;
+    static const uint32_t MAX_DATAGRAM_LEN = 8;
+
+    // Helpers
+    void serviceRx();
+    uint32_t issueWrites();
+    void issueRead();
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "StepDrvBusSched";
+};
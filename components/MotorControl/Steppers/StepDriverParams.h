@@ -22,6 +22,7 @@ public:
     static constexpr uint32_t TOFF_VALUE_DEFAULT = 5;
     static const uint32_t PWM_FREQ_KHZ_DEFAULT = 35;
     static const uint32_t STATUS_INTERVAL_MS_DEFAULT = 100;
+    static const uint32_t STALL_TCOOLTHRS_DEFAULT = 0xfffff;
 
     enum HoldModeEnum
     {
@@ -50,6 +51,29 @@ public:
     uint8_t address = 0;
     uint32_t statusIntvMs = STATUS_INTERVAL_MS_DEFAULT;
 
+    // StallGuard (sensorless homing and stall detection) - the DIAG pin goes active when the StallGuard result
+    // falls below twice the threshold (0 disables) with the velocity above that set by stallTCoolThrs (the TSTEP
+    // value - the time between microsteps in driver clocks - below which StallGuard is enabled)
+    int diagPin = -1;
+    uint8_t stallThreshold = 0;
+    uint32_t stallTCoolThrs = STALL_TCOOLTHRS_DEFAULT;
+
+    // Motion phase current scaling - the run current is scaled by accCurFactor while accelerating or decelerating
+    // and by cruiseCurFactor at constant speed (1 disables) - the hold current is unchanged - and the driver
+    // switches to the hold current idleHoldMs after the last step (0 leaves the driver default of about 440ms)
+    float accCurFactor = 1;
+    float cruiseCurFactor = 1;
+    uint32_t idleHoldMs = 0;
+
+    // Direction setup time - the minimum time from a direction change to the next step (ns) - the steps of the
+    // axis are deferred until it has elapsed (0 if the step generation period is always long enough)
+    uint32_t dirSetupNs = 0;
+
+    // Shift register outputs (bit numbers in the shift register chain) used for step and direction when the
+    // ramp generator's pulse engine is shiftReg (-1 if not used)
+    int8_t srStepBit = -1;
+    int8_t srDirnBit = -1;
+
     StepDriverParams()
     {
     }
@@ -77,6 +101,24 @@ public:
         pwmFreqKHz = config.getDouble("pwmFreqKHz", StepDriverParams::PWM_FREQ_KHZ_DEFAULT);
         address = config.getLong("addr", 0);
 
+        // StallGuard
+        String diagPinName = config.getString("diagPin", "-1");
+        diagPin = ConfigPinMap::getPinFromName(diagPinName.c_str());
+        stallThreshold = config.getLong("stallThresh", 0);
+        stallTCoolThrs = config.getLong("stallTCoolThrs", StepDriverParams::STALL_TCOOLTHRS_DEFAULT);
+
+        // Motion phase current scaling
+        accCurFactor = config.getDouble("accCurFactor", 1);
+        cruiseCurFactor = config.getDouble("cruiseCurFactor", 1);
+        idleHoldMs = config.getLong("idleHoldMs", 0);
+
+        // Direction setup time
+        dirSetupNs = config.getLong("dirSetupNs", 0);
+
+        // Shift register outputs
+        srStepBit = config.getLong("srStepBit", -1);
+        srDirnBit = config.getLong("srDirnBit", -1);
+
         // Get status read frequency
         double statusFreqHz = config.getDouble("statusFreqHz", 1);
         statusIntvMs = statusFreqHz > 0 ? 1000.0 / statusFreqHz : 0;
@@ -118,6 +160,25 @@ public:
         jsonStr += ",\"hldF\":" + String(holdFactor, 2);
         jsonStr += ",\"hldD\":" + String(holdDelay);
         jsonStr += ",\"pwm\":" + String(pwmFreqKHz, 2);
+        if (stallThreshold > 0)
+        {
+            jsonStr += ",\"diag\":" + String(diagPin);
+            jsonStr += ",\"sgT\":" + String(stallThreshold);
+            jsonStr += ",\"sgV\":" + String(stallTCoolThrs);
+        }
+        if ((accCurFactor != 1) || (cruiseCurFactor != 1) || (idleHoldMs != 0))
+        {
+            jsonStr += ",\"aCF\":" + String(accCurFactor, 2);
+            jsonStr += ",\"cCF\":" + String(cruiseCurFactor, 2);
+            jsonStr += ",\"iHM\":" + String(idleHoldMs);
+        }
+        if (dirSetupNs != 0)
+            jsonStr += ",\"dSu\":" + String(dirSetupNs);
+        if (srStepBit >= 0)
+        {
+            jsonStr += ",\"srS\":" + String(srStepBit);
+            jsonStr += ",\"srD\":" + String(srDirnBit);
+        }
         return includeBraces ? "{" + jsonStr + "}" : jsonStr;
     }
 };
@@ -18,7 +18,6 @@
 // #define DEBUG_REGISTER_READ_PROCESS
 // #define DEBUG_REGISTER_READ_START
 // #define DEBUG_REGISTER_READ_IN_PROGRESS
-// #define DEBUG_STEPPING_ONLY_IF_NOT_ISR
 // #define DEBUG_DIRECTION_ONLY_IF_NOT_ISR
 
 // PWM frequency calculations
@@ -49,6 +48,14 @@ StepDriverTMC2209::StepDriverTMC2209()
     _driverRegisters.push_back({"PWMCONF", 0x70, 0xC10D0024, 0xc001f0ff, true, false});
     // Add DRV_STATUS register
     _driverRegisters.push_back({"DRV_STATUS", 0x6F, 0x00000000, 0xff3fffff, false, true});
+    // Add TCOOLTHRS register
+    _driverRegisters.push_back({"TCOOLTHRS", 0x14, 0x00000000, 0x000fffff, true, false});
+    // Add SGTHRS register
+    _driverRegisters.push_back({"SGTHRS", 0x40, 0x00000000, 0x000000ff, true, false});
+    // Add SG_RESULT register
+    _driverRegisters.push_back({"SG_RESULT", 0x41, 0x00000000, 0x000003ff, false, true});
+    // Add TPOWERDOWN register
+    _driverRegisters.push_back({"TPOWERDOWN", 0x11, 0x00000014, 0x000000ff, true, false});
 
     // Vars
     _dirnCurValue = false;
@@ -83,8 +90,10 @@ bool StepDriverTMC2209::setup(const String& stepperName, const StepDriverParams&
             _statusReadIntervalMs = stepperParams.statusIntvMs;
         }
 
-        // Set main registers
+        // Set main registers (config registers which can be read are only written if they don't already
+        // hold the required values - e.g. after a restart of the processor without a driver power cycle)
         setMainRegs();
+        verifyConfigRegsBeforeWrite();
     }
 
     // Setup step pin
@@ -118,6 +127,13 @@ bool StepDriverTMC2209::setup(const String& stepperName, const StepDriverParams&
 /// @brief Loop - called frequently
 void StepDriverTMC2209::loop()
 {
+    // If a bus scheduler is used it handles register reads and writes so only status and config checks are needed
+    if (_busScheduled)
+    {
+        checkStatusAndConfig();
+        return;
+    }
+
     // Loop base
     StepDriverBase::loop();
 
@@ -195,6 +211,14 @@ void StepDriverTMC2209::loop()
         return;
     }
 
+    // Status and config checks
+    checkStatusAndConfig();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if status registers should be read and if the config needs to be reset
+void StepDriverTMC2209::checkStatusAndConfig()
+{
     // Check for time to read status registers
     if ((_statusReadIntervalMs != 0) && Raft::isTimeout(millis(), _statusReadLastTimeMs, _statusReadIntervalMs))
     {
@@ -212,6 +236,8 @@ void StepDriverTMC2209::loop()
         _driverRegisters[DRIVER_REGISTER_CODE_IFCNT].readPending = true;
         _driverRegisters[DRIVER_REGISTER_CODE_DRV_STATUS].readPending = true;
         _driverRegisters[DRIVER_REGISTER_CODE_GSTAT].readPending = true;
+        if (_requestedParams.stallThreshold > 0)
+            _driverRegisters[DRIVER_REGISTER_CODE_SG_RESULT].readPending = true;
         _statusReadLastTimeMs = millis();
     }
 
@@ -402,54 +428,6 @@ void IRAM_ATTR StepDriverTMC2209::setDirection(bool dirn, bool forceSet)
     _dirnCurValue = dirn;
 }
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// @brief Start a step
-void IRAM_ATTR StepDriverTMC2209::stepStart()
-{
-    // Check hardware pin
-    if (_hwIsSetup && (_requestedParams.stepPin >= 0))
-    {
-#ifdef DEBUG_STEPPING_ONLY_IF_NOT_ISR
-        if (!_usingISR)
-        {
-            LOG_I(MODULE_PREFIX, "stepStart %s pin %d", _name.c_str(), _requestedParams.stepPin);
-        }
-#endif
-        // Set the pin value
-        digitalWrite(_requestedParams.stepPin, true);
-        _stepCurActive = true;
-    }
-    else
-    {
-#ifdef DEBUG_STEPPING_ONLY_IF_NOT_ISR
-        if (!_usingISR)
-        {
-            LOG_W(MODULE_PREFIX, "stepStart FAILED %s pin %d hwIsSetup %d", 
-                    _name.c_str(), _requestedParams.stepPin, _hwIsSetup);
-        }
-#endif
-    }
-}
-
-/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-/// @brief End a step
-bool IRAM_ATTR StepDriverTMC2209::stepEnd()
-{
-    if (_stepCurActive && (_requestedParams.stepPin >= 0))
-    {
-        _stepCurActive = false;
-        digitalWrite(_requestedParams.stepPin, false);
-#ifdef DEBUG_STEPPING_ONLY_IF_NOT_ISR
-        if (!_usingISR)
-        {
-            LOG_I(MODULE_PREFIX, "stepEnd %s pin %d", _name.c_str(), _requestedParams.stepPin);
-        }
-#endif
-        return true;
-    }
-    return false;
-}
-
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Set the max motor current
 /// @param maxMotorCurrentAmps - max motor current in Amps
@@ -465,6 +443,73 @@ void StepDriverTMC2209::setMaxMotorCurrentAmps(float maxMotorCurrentAmps)
     setMainRegs();
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set the StallGuard threshold
+/// @param stallThreshold - threshold (0 disables stall detection) - higher values are more sensitive
+void StepDriverTMC2209::setStallThreshold(uint8_t stallThreshold)
+{
+    _requestedParams.stallThreshold = stallThreshold;
+    LOG_I(MODULE_PREFIX, "setStallThreshold %s %d", _name.c_str(), stallThreshold);
+    setStallRegs();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set the StallGuard registers with stored values
+/// @note StallGuard is active when the time between microsteps (TSTEP) is below TCOOLTHRS and the DIAG output
+///       indicates a stall when SG_RESULT falls to twice SGTHRS or below
+void StepDriverTMC2209::setStallRegs()
+{
+    _driverRegisters[DRIVER_REGISTER_CODE_TCOOLTHRS].regWriteVal = 
+                (_requestedParams.stallThreshold > 0) ? (_requestedParams.stallTCoolThrs & TMC_2209_TCOOLTHRS_MASK) : 0;
+    _driverRegisters[DRIVER_REGISTER_CODE_TCOOLTHRS].writePending = true;
+    _driverRegisters[DRIVER_REGISTER_CODE_SGTHRS].regWriteVal = _requestedParams.stallThreshold;
+    _driverRegisters[DRIVER_REGISTER_CODE_SGTHRS].writePending = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set the motion phase (the run current is scaled for acceleration, deceleration and cruise)
+/// @param motionPhase - motion phase
+/// @note The register write is queued (the bus scheduler or the driver loop writes it without blocking)
+void StepDriverTMC2209::setMotionPhase(MotionPhase motionPhase)
+{
+    float curFactor = 1;
+    if ((motionPhase == MOTION_PHASE_ACCEL) || (motionPhase == MOTION_PHASE_DECEL))
+        curFactor = _requestedParams.accCurFactor;
+    else if (motionPhase == MOTION_PHASE_CRUISE)
+        curFactor = _requestedParams.cruiseCurFactor;
+    if (curFactor == _motionPhaseCurFactor)
+        return;
+    _motionPhaseCurFactor = curFactor;
+    setIHoldIRunReg();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set the IHOLD_IRUN register from the base values and the motion phase current factor
+/// @note The current is proportional to IRUN + 1 and the sense range (CHOPCONF vsense) isn't changed so a
+///       boosted run current is limited by the range chosen for the requested current
+void StepDriverTMC2209::setIHoldIRunReg()
+{
+    uint32_t irunValue = _baseIRun;
+    if (_motionPhaseCurFactor != 1)
+    {
+        int32_t scaledIRun = int32_t(lround((_baseIRun + 1) * _motionPhaseCurFactor)) - 1;
+        irunValue = UTILS_MIN(uint32_t(UTILS_MAX(scaledIRun, 0)), TMC_2209_IRUN_MAX);
+    }
+    _driverRegisters[DRIVER_REGISTER_CODE_IHOLD_IRUN].writePending = true;
+    _driverRegisters[DRIVER_REGISTER_CODE_IHOLD_IRUN].regWriteVal = 
+                (irunValue << TMC_2209_IRUN_BIT) |
+                (_baseIHold << TMC_2209_IHOLD_BIT) |
+                (_requestedParams.holdDelay << TMC_2209_IHOLD_DELAY_BIT);
+#ifdef DEBUG_IHOLD_IRUN
+    LOG_I(MODULE_PREFIX, "setIHoldIRunReg %s irunValue %d iholdValue %d factor %.2f, reg %s(0x%02x), val %08x", 
+                    _name.c_str(),
+                    irunValue, _baseIHold, _motionPhaseCurFactor,
+                    _driverRegisters[DRIVER_REGISTER_CODE_IHOLD_IRUN].regName,
+                    DRIVER_REGISTER_CODE_IHOLD_IRUN,
+                    _driverRegisters[DRIVER_REGISTER_CODE_IHOLD_IRUN].regWriteVal);
+#endif
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Set the main registers with stored values
 void StepDriverTMC2209::setMainRegs()
@@ -493,7 +538,8 @@ void StepDriverTMC2209::setMainRegs()
                 (_requestedParams.extVRef ? (1 << TMC_2209_GCONF_EXT_VREF_BIT) : 0) |
                 (_requestedParams.extMStep ? 0 : (1 << TMC_2209_GCONF_MSTEP_REG_SELECT_BIT));
 
-    // Init the CHOPCONF register
+    // Init the CHOPCONF register - interpolation (intpol) to 256 microsteps is done in the driver between step
+    // pulses so it doesn't depend on how the pulses are generated (timer ISR, RMT or shift register)
     _driverRegisters[DRIVER_REGISTER_CODE_CHOPCONF].writePending = true;
     _driverRegisters[DRIVER_REGISTER_CODE_CHOPCONF].regWriteVal =
                 (getMRESFieldValue(_requestedParams.microsteps) << TMC_2209_CHOPCONF_MRES_BIT) |
@@ -501,20 +547,19 @@ void StepDriverTMC2209::setMainRegs()
                 (_requestedParams.intpol ? (1 << TMC_2209_CHOPCONF_INTPOL_BIT) : 0) |
                 (vsenseValue ? (1 << TMC_2209_CHOPCONF_VSENSE_BIT) : 0);
 
-    // Init the IHOLD_IRUN register
-    _driverRegisters[DRIVER_REGISTER_CODE_IHOLD_IRUN].writePending = true;
-    _driverRegisters[DRIVER_REGISTER_CODE_IHOLD_IRUN].regWriteVal = 
-                (irunValue << TMC_2209_IRUN_BIT) |
-                (iholdValue << TMC_2209_IHOLD_BIT) |
-                (_requestedParams.holdDelay << TMC_2209_IHOLD_DELAY_BIT);
-#ifdef DEBUG_IHOLD_IRUN
-    LOG_I(MODULE_PREFIX, "setMainRegs %s irunValue %d iholdValue %d, reg %s(0x%02x), val %08x", 
-                    _name.c_str(),
-                    irunValue, iholdValue, 
-                    _driverRegisters[DRIVER_REGISTER_CODE_IHOLD_IRUN].regName,
-                    DRIVER_REGISTER_CODE_IHOLD_IRUN,
-                    _driverRegisters[DRIVER_REGISTER_CODE_IHOLD_IRUN].regWriteVal);
-#endif
+    // Init the IHOLD_IRUN register (the run current is scaled for the motion phase)
+    _baseIRun = irunValue;
+    _baseIHold = iholdValue;
+    setIHoldIRunReg();
+
+    // Init the TPOWERDOWN register (delay after the last step before switching to the hold current)
+    if (_requestedParams.idleHoldMs > 0)
+    {
+        uint32_t tPowerDown = uint32_t(_requestedParams.idleHoldMs / TMC_2209_TPOWERDOWN_UNIT_MS + 0.5);
+        _driverRegisters[DRIVER_REGISTER_CODE_TPOWERDOWN].regWriteVal = 
+                    UTILS_MIN(UTILS_MAX(tPowerDown, TMC_2209_TPOWERDOWN_MIN), TMC_2209_TPOWERDOWN_MAX);
+        _driverRegisters[DRIVER_REGISTER_CODE_TPOWERDOWN].writePending = true;
+    }
 
     // Calculate PWMCONF_PWM_FREQ
     double clockDiv = _requestedParams.pwmFreqKHz * 1000.0 / TMC_2209_CLOCK_FREQ_HZ;
@@ -545,6 +590,9 @@ void StepDriverTMC2209::setMainRegs()
                 (TMC_2209_PWMCONF_PWM_GRAD << TMC_2209_PWMCONF_PWM_GRAD_BIT) |
                 (TMC_2209_PWMCONF_PWM_OFS << TMC_2209_PWMCONF_PWM_OFS_BIT);
 
+    // StallGuard - the DIAG output indicates a stall when enabled by the threshold
+    setStallRegs();
+
     // Set flags to indicate that registers should be read back to confirm
     _driverRegisters[DRIVER_REGISTER_CODE_IFCNT].readPending = true;
     _driverRegisters[DRIVER_REGISTER_CODE_GCONF].readPending = true;
@@ -563,6 +611,32 @@ String StepDriverTMC2209::getDebugJSON(bool includeBraces, bool detailed) const
     return getStatusJSON(includeBraces, detailed);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get status bits (compact form of the GSTAT and DRV_STATUS values)
+/// @return Status bits (STATUS_BIT_XXX)
+uint32_t StepDriverTMC2209::getStatusBits() const
+{
+    if (!isOperatingOk())
+        return STATUS_BIT_NOT_OK;
+    uint32_t statusBits = 0;
+    uint32_t gstat = _driverRegisters[DRIVER_REGISTER_CODE_GSTAT].regValCur;
+    if (gstat & (1 << TMC_2209_GSTAT_DRV_ERR_BIT))
+        statusBits |= STATUS_BIT_FAULT;
+    if (gstat & (1 << TMC_2209_GSTAT_UV_CP_BIT))
+        statusBits |= STATUS_BIT_UNDERVOLTAGE;
+    if (_driverRegisters[DRIVER_REGISTER_CODE_DRV_STATUS].readValid)
+    {
+        uint32_t drvStatus = _driverRegisters[DRIVER_REGISTER_CODE_DRV_STATUS].regValCur;
+        if (drvStatus & ((1 << TMC_2209_DRV_STATUS_OTPW_BIT) | (1 << TMC_2209_DRV_STATUS_OT_BIT)))
+            statusBits |= STATUS_BIT_OVER_TEMP;
+        if (drvStatus & ((1 << TMC_2209_DRV_STATUS_S2GA_BIT) | (1 << TMC_2209_DRV_STATUS_S2GB_BIT) |
+                    (1 << TMC_2209_DRV_STATUS_S2VSA_BIT) | (1 << TMC_2209_DRV_STATUS_S2VSB_BIT) |
+                    (1 << TMC_2209_DRV_STATUS_OLA_BIT) | (1 << TMC_2209_DRV_STATUS_OLB_BIT)))
+            statusBits |= STATUS_BIT_FAULT;
+    }
+    return statusBits;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // @brief Get status JSON
 // @param includeBraces - include braces
@@ -587,6 +661,8 @@ String StepDriverTMC2209::getStatusJSON(bool includeBraces, bool detailed) const
     retStr += "\"rmsMax\":" + String(getMaxRMSAmps(), 2) + ",";
     retStr += "\"gStat\":" + getGSTATJson() + ",";
     retStr += "\"drvSt\":" + getDriverStatusJson();
+    if ((_requestedParams.stallThreshold > 0) && _driverRegisters[DRIVER_REGISTER_CODE_SG_RESULT].readValid)
+        retStr += ",\"sg\":" + String(_driverRegisters[DRIVER_REGISTER_CODE_SG_RESULT].regValCur);
     if (detailed)
     {
         retStr += ",\"hldF\":" + String(_requestedParams.holdFactor, 2) + ",";
@@ -8,8 +8,12 @@
 
 #pragma once
 
+#include "esp_attr.h"
 #include "StepDriverBase.h"
 
+// Debug
+// #define DEBUG_STEPPING_ONLY_IF_NOT_ISR
+
 class StepDriverTMC2209 : public StepDriverBase
 {
 public:
@@ -27,13 +31,51 @@ public:
     // Set direction
     virtual void setDirection(bool dirn, bool forceSet = false) override final;
 
-    // Start and end a single step
-    virtual void stepStart() override final;
-    virtual bool stepEnd() override final;
+    // Start and end a single step - these are defined here so that they can be inlined in the ISR by a
+    // ramp generator specialized for this driver type
+    virtual void IRAM_ATTR stepStart() override final
+    {
+        // Check hardware pin
+        if (_hwIsSetup && (_requestedParams.stepPin >= 0))
+        {
+#ifdef DEBUG_STEPPING_ONLY_IF_NOT_ISR
+            if (!_usingISR)
+            {
+                LOG_I(MODULE_PREFIX, "stepStart %s pin %d", _name.c_str(), _requestedParams.stepPin);
+            }
+#endif
+            // Set the pin value
+            digitalWrite(_requestedParams.stepPin, true);
+            _stepCurActive = true;
+        }
+    }
+    virtual bool IRAM_ATTR stepEnd() override final
+    {
+        if (_stepCurActive && (_requestedParams.stepPin >= 0))
+        {
+            _stepCurActive = false;
+            digitalWrite(_requestedParams.stepPin, false);
+#ifdef DEBUG_STEPPING_ONLY_IF_NOT_ISR
+            if (!_usingISR)
+            {
+                LOG_I(MODULE_PREFIX, "stepEnd %s pin %d", _name.c_str(), _requestedParams.stepPin);
+            }
+#endif
+            return true;
+        }
+        return false;
+    }
+
+    // Step pin for direct GPIO stepping
+    virtual int getStepPin() const override final
+    {
+        return _hwIsSetup ? _requestedParams.stepPin : -1;
+    }
 
+    static constexpr const char* DRIVER_TYPE = "TMC2209";
     virtual String getDriverType() const override final
     {
-        return "TMC2209";
+        return DRIVER_TYPE;
     }
 
     String getDebugJSON(bool includeBraces, bool detailed) const override final;
@@ -42,25 +84,41 @@ public:
 
     virtual void setMaxMotorCurrentAmps(float maxMotorCurrentAmps) override final;
 
+    virtual void setStallThreshold(uint8_t stallThreshold) override final;
+
+    virtual void setMotionPhase(MotionPhase motionPhase) override final;
+
     virtual bool isOperatingOk() const override final
     {
         return busValid() && _driverRegisters[DRIVER_REGISTER_CODE_GSTAT].readValid;
     }
 
+    virtual uint32_t getStatusBits() const override final;
+
 private:
     // Driver register codes
     // These must be in the same order as added to _driverRegisters
-    // in the base class
+    // in the constructor
     enum DriverRegisterCodes {
         DRIVER_REGISTER_CODE_GCONF,
-        DRIVER_REGISTER_CODE_IFCNT,
         DRIVER_REGISTER_CODE_GSTAT,
+        DRIVER_REGISTER_CODE_IFCNT,
         DRIVER_REGISTER_CODE_CHOPCONF,
         DRIVER_REGISTER_CODE_IHOLD_IRUN,
         DRIVER_REGISTER_CODE_PWMCONF,
         DRIVER_REGISTER_CODE_DRV_STATUS,
+        DRIVER_REGISTER_CODE_TCOOLTHRS,
+        DRIVER_REGISTER_CODE_SGTHRS,
+        DRIVER_REGISTER_CODE_SG_RESULT,
+        DRIVER_REGISTER_CODE_TPOWERDOWN,
     };
 
+    // Run and hold current register values for the requested current and the factor applied to the run current
+    // for the motion phase
+    uint32_t _baseIRun = 0;
+    uint32_t _baseIHold = 0;
+    float _motionPhaseCurFactor = 1;
+
     // Current direction and step values
     bool _dirnCurValue;
     bool _stepCurActive;
@@ -119,8 +177,9 @@ private:
             return _requestedParams.rmsAmps;
         }
 
-        // Read the IRUN value from the IHOLD_IRUN register write value (this is a read-only register)
-        uint32_t irun = (_driverRegisters[DRIVER_REGISTER_CODE_IHOLD_IRUN].regWriteVal & TMC_2209_IRUN_MASK) >> TMC_2209_IRUN_BIT;
+        // IRUN value for the requested current (the IHOLD_IRUN register is write-only and its IRUN may be
+        // scaled for the motion phase)
+        uint32_t irun = _baseIRun;
 
         // Read the vsense bit value from the CHOPCONF register
         bool vsense = (_driverRegisters[DRIVER_REGISTER_CODE_CHOPCONF].regValCur & TMC_2209_CHOPCONF_VSENSE_MASK) >> TMC_2209_CHOPCONF_VSENSE_BIT;
@@ -211,6 +270,9 @@ private:
     void convertRMSCurrentToRegs(double reqCurrentAmps, double holdFactor, 
             StepDriverParams::HoldModeEnum holdMode, bool& vsenseOut, uint32_t& irunOut, uint32_t& iholdOut) const;
     void setMainRegs();
+    void setStallRegs();
+    void setIHoldIRunReg();
+    void checkStatusAndConfig();
 
     // TMC2209 Defs
     static const uint8_t TMC_2209_SYNC_BYTE = 5;
@@ -246,6 +308,12 @@ private:
     static const uint32_t TMC_2209_IRUN_BIT = 8;
     static const uint32_t TMC_2209_IRUN_MASK = 0x1F00;
     static const uint32_t TMC_2209_IHOLD_DELAY_BIT = 16;
+    static const uint32_t TMC_2209_IRUN_MAX = 31;
+
+    // TPOWERDOWN register consts (delay in units of 2^18 clocks - the datasheet minimum is 2)
+    static constexpr double TMC_2209_TPOWERDOWN_UNIT_MS = 262144.0 * 1000.0 / TMC_2209_CLOCK_FREQ_HZ;
+    static const uint32_t TMC_2209_TPOWERDOWN_MIN = 2;
+    static const uint32_t TMC_2209_TPOWERDOWN_MAX = 255;
 
     // PWMCONF register consts
     static const uint32_t TMC_2209_PWMCONF_PWM_OFS_BIT = 0;
@@ -261,6 +329,9 @@ private:
     static const uint32_t TMC_2209_PWMCONF_PWM_OFS = 36;
     static const uint32_t TMC_2209_PWMCONF_PWM_GRAD = 0;
 
+    // TCOOLTHRS register consts
+    static const uint32_t TMC_2209_TCOOLTHRS_MASK = 0x000fffff;
+
     // DRV_STATUS register consts
     static const uint32_t TMC_2209_DRV_STATUS_OTPW_BIT = 0;
     static const uint32_t TMC_2209_DRV_STATUS_OT_BIT = 1;
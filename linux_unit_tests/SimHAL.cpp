@@ -0,0 +1,465 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SimHAL
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <deque>
+#include <vector>
+#include "SimHAL.h"
+#include "RaftArduino.h"
+#include "RaftUtils.h"
+#include "driver/gptimer.h"
+#include "driver/rmt_tx.h"
+
+// Virtual gptimer (1 count per us)
+struct gptimer_t
+{
+    gptimer_alarm_cb_t alarmCB = nullptr;
+    void* pAlarmCBArg = nullptr;
+    uint64_t alarmCount = 0;
+    uint64_t reloadTimeUs = 0;
+    bool isEnabled = false;
+    bool isRunning = false;
+};
+
+// Virtual RMT TX channel - transactions are queued and the front one is output (its symbols are stepped through
+// half by half with the time of each edge from the start of the transaction so there is no drift)
+struct rmt_channel_t
+{
+    int gpioNum = -1;
+    uint32_t resolutionHz = 1;
+    size_t queueDepth = 1;
+    bool isEnabled = false;
+    rmt_tx_done_callback_t doneCB = nullptr;
+    void* pDoneCBArg = nullptr;
+    std::deque<std::vector<rmt_symbol_word_t>> transactions;
+    uint64_t txStartNs = 0;
+    uint64_t halfStartTicks = 0;
+    uint32_t halfIdx = 0;
+    bool level = false;
+};
+
+// State
+static gptimer_t* _pTimer = nullptr;
+static uint64_t _timeNs = 0;
+static SimHAL::TimerStats _timerStats;
+static SimHAL::PostAlarmHook _pPostAlarmHook = nullptr;
+static void* _pPostAlarmHookArg = nullptr;
+static SimHAL::PinOutputHook _pPinOutputHook = nullptr;
+static void* _pPinOutputHookArg = nullptr;
+static SimHAL::PinInputHook _pPinInputHook = nullptr;
+static void* _pPinInputHookArg = nullptr;
+static std::vector<rmt_channel_t*> _rmtChannels;
+static constexpr uint64_t NO_EVENT_NS = UINT64_MAX;
+
+// RMT helpers
+static uint64_t rmtNextEventNs(uint32_t& rmtChanIdx);
+static void rmtRunEvent(rmt_channel_t* pChan);
+
+uint64_t SimHAL::getTimeUs()
+{
+    return _timeNs / 1000;
+}
+
+uint64_t SimHAL::getTimeNs()
+{
+    return _timeNs;
+}
+
+uint64_t SimHAL::runUntilUs(uint64_t timeUs)
+{
+    uint64_t numAlarms = 0;
+    uint64_t untilNs = timeUs * 1000;
+    while (true)
+    {
+        // Time of the next alarm and of the next RMT edge - the earliest is run (an alarm first if at the same time)
+        uint64_t alarmTimeNs = (isTimerRunning() && (_pTimer->alarmCount > 0)) ?
+                    (_pTimer->reloadTimeUs + _pTimer->alarmCount) * 1000 : NO_EVENT_NS;
+        uint32_t rmtChanIdx = 0;
+        uint64_t rmtTimeNs = rmtNextEventNs(rmtChanIdx);
+        if ((rmtTimeNs < alarmTimeNs) && (rmtTimeNs <= untilNs))
+        {
+            _timeNs = UTILS_MAX(_timeNs, rmtTimeNs);
+            rmtRunEvent(_rmtChannels[rmtChanIdx]);
+            continue;
+        }
+        if (alarmTimeNs > untilNs)
+            break;
+
+        // Run the alarm (auto-reload so the next interval starts now) - it may be late if time was advanced by a
+        // busy wait
+        uint64_t alarmTimeUs = alarmTimeNs / 1000;
+        _timeNs = UTILS_MAX(_timeNs, alarmTimeNs);
+        _pTimer->reloadTimeUs = alarmTimeUs;
+        gptimer_alarm_event_data_t eventData = { .count_value = _pTimer->alarmCount, .alarm_value = _pTimer->alarmCount };
+        uint64_t startNs = getHostTimeNs();
+        if (_pTimer->alarmCB)
+            _pTimer->alarmCB(_pTimer, &eventData, _pTimer->pAlarmCBArg);
+        _timerStats.callbackHostNs += getHostTimeNs() - startNs;
+        _timerStats.alarmCount++;
+        numAlarms++;
+        if (_pPostAlarmHook)
+            _pPostAlarmHook(_pPostAlarmHookArg);
+    }
+    if (untilNs > _timeNs)
+        _timeNs = untilNs;
+    return numAlarms;
+}
+
+bool SimHAL::isTimerRunning()
+{
+    return _pTimer && _pTimer->isEnabled && _pTimer->isRunning;
+}
+
+uint64_t SimHAL::getHostTimeNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const SimHAL::TimerStats& SimHAL::getTimerStats()
+{
+    return _timerStats;
+}
+
+void SimHAL::resetTimerStats()
+{
+    _timerStats = SimHAL::TimerStats();
+}
+
+void SimHAL::setPostAlarmHook(PostAlarmHook pHook, void* pArg)
+{
+    _pPostAlarmHook = pHook;
+    _pPostAlarmHookArg = pArg;
+}
+
+void SimHAL::setPinOutputHook(PinOutputHook pHook, void* pArg)
+{
+    _pPinOutputHook = pHook;
+    _pPinOutputHookArg = pArg;
+}
+
+void SimHAL::setPinInputHook(PinInputHook pHook, void* pArg)
+{
+    _pPinInputHook = pHook;
+    _pPinInputHookArg = pArg;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// gptimer
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+esp_err_t gptimer_new_timer(const gptimer_config_t* config, gptimer_handle_t* ret_timer)
+{
+    // Only one timer (and only at 1MHz) is simulated
+    if (_pTimer || !config || (config->resolution_hz != 1000000) || !ret_timer)
+        return ESP_FAIL;
+    _pTimer = new gptimer_t();
+    _pTimer->reloadTimeUs = SimHAL::getTimeUs();
+    *ret_timer = _pTimer;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_del_timer(gptimer_handle_t timer)
+{
+    if (!timer || (timer != _pTimer))
+        return ESP_FAIL;
+    delete _pTimer;
+    _pTimer = nullptr;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer, const gptimer_event_callbacks_t* cbs, void* user_data)
+{
+    if (!timer || !cbs)
+        return ESP_FAIL;
+    timer->alarmCB = cbs->on_alarm;
+    timer->pAlarmCBArg = user_data;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer, const gptimer_alarm_config_t* config)
+{
+    if (!timer)
+        return ESP_FAIL;
+    timer->alarmCount = config ? config->alarm_count : 0;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_enable(gptimer_handle_t timer)
+{
+    if (!timer)
+        return ESP_FAIL;
+    timer->isEnabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_disable(gptimer_handle_t timer)
+{
+    if (!timer)
+        return ESP_FAIL;
+    timer->isEnabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_start(gptimer_handle_t timer)
+{
+    if (!timer || !timer->isEnabled)
+        return ESP_FAIL;
+    timer->isRunning = true;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_stop(gptimer_handle_t timer)
+{
+    if (!timer)
+        return ESP_FAIL;
+    timer->isRunning = false;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_set_raw_count(gptimer_handle_t timer, uint64_t value)
+{
+    if (!timer)
+        return ESP_FAIL;
+    timer->reloadTimeUs = SimHAL::getTimeUs() - value;
+    return ESP_OK;
+}
+
+esp_err_t gptimer_get_raw_count(gptimer_handle_t timer, uint64_t* value)
+{
+    if (!timer || !value)
+        return ESP_FAIL;
+    *value = SimHAL::getTimeUs() - timer->reloadTimeUs;
+    return ESP_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RMT TX (copy encoder only - the sync manager isn't needed as transactions queued at the same virtual time
+// start together)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// @brief Set the level of a channel's output (the pin output hook is called if it changes)
+static void rmtSetLevel(rmt_channel_t* pChan, bool level)
+{
+    if (pChan->level == level)
+        return;
+    pChan->level = level;
+    if (_pPinOutputHook)
+        _pPinOutputHook(_pPinOutputHookArg, pChan->gpioNum, level);
+}
+
+/// @brief Get the duration (ticks) and level of a half symbol
+static uint32_t rmtHalfTicks(const std::vector<rmt_symbol_word_t>& symbols, uint32_t halfIdx, bool& level)
+{
+    if (halfIdx / 2 >= symbols.size())
+        return 0;
+    const rmt_symbol_word_t& symbol = symbols[halfIdx / 2];
+    level = (halfIdx % 2) ? symbol.level1 : symbol.level0;
+    return (halfIdx % 2) ? symbol.duration1 : symbol.duration0;
+}
+
+/// @brief Start outputting the front transaction of a channel (at the current time)
+static void rmtStartTransaction(rmt_channel_t* pChan)
+{
+    pChan->txStartNs = _timeNs;
+    pChan->halfStartTicks = 0;
+    pChan->halfIdx = 0;
+    bool level = false;
+    if (rmtHalfTicks(pChan->transactions.front(), 0, level) > 0)
+        rmtSetLevel(pChan, level);
+}
+
+/// @brief Get the time of the next RMT event (the end of the half symbol being output on a channel)
+/// @param rmtChanIdx (out) Index of the channel with the earliest event
+/// @return Time in ns (NO_EVENT_NS if no channel is outputting)
+static uint64_t rmtNextEventNs(uint32_t& rmtChanIdx)
+{
+    uint64_t nextNs = NO_EVENT_NS;
+    for (uint32_t chanIdx = 0; chanIdx < _rmtChannels.size(); chanIdx++)
+    {
+        rmt_channel_t* pChan = _rmtChannels[chanIdx];
+        if (!pChan->isEnabled || pChan->transactions.empty())
+            continue;
+        bool level = false;
+        uint64_t endTicks = pChan->halfStartTicks + rmtHalfTicks(pChan->transactions.front(), pChan->halfIdx, level);
+        uint64_t eventNs = pChan->txStartNs + endTicks * 1000000000ULL / pChan->resolutionHz;
+        if (eventNs < nextNs)
+        {
+            nextNs = eventNs;
+            rmtChanIdx = chanIdx;
+        }
+    }
+    return nextNs;
+}
+
+/// @brief Run the event of a channel - the half symbol being output ends (a zero duration or the end of the
+///        symbols ends the transaction and the next queued starts)
+static void rmtRunEvent(rmt_channel_t* pChan)
+{
+    const std::vector<rmt_symbol_word_t>& symbols = pChan->transactions.front();
+    bool level = false;
+    pChan->halfStartTicks += rmtHalfTicks(symbols, pChan->halfIdx, level);
+    pChan->halfIdx++;
+    if (rmtHalfTicks(symbols, pChan->halfIdx, level) > 0)
+    {
+        rmtSetLevel(pChan, level);
+        return;
+    }
+
+    // Transaction done
+    rmt_tx_done_event_data_t eventData = { .num_symbols = symbols.size() };
+    pChan->transactions.pop_front();
+    rmtSetLevel(pChan, false);
+    if (!pChan->transactions.empty())
+        rmtStartTransaction(pChan);
+    if (pChan->doneCB)
+        pChan->doneCB(pChan, &eventData, pChan->pDoneCBArg);
+}
+
+esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t* config, rmt_channel_handle_t* ret_chan)
+{
+    if (!config || !ret_chan || (config->resolution_hz == 0))
+        return ESP_FAIL;
+    rmt_channel_t* pChan = new rmt_channel_t();
+    pChan->gpioNum = config->gpio_num;
+    pChan->resolutionHz = config->resolution_hz;
+    pChan->queueDepth = UTILS_MAX(config->trans_queue_depth, 1);
+    _rmtChannels.push_back(pChan);
+    *ret_chan = pChan;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_channel(rmt_channel_handle_t channel)
+{
+    for (auto it = _rmtChannels.begin(); it != _rmtChannels.end(); it++)
+    {
+        if (*it != channel)
+            continue;
+        _rmtChannels.erase(it);
+        delete channel;
+        return ESP_OK;
+    }
+    return ESP_FAIL;
+}
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t* config, rmt_encoder_handle_t* ret_encoder)
+{
+    static int copyEncoder = 0;
+    if (!ret_encoder)
+        return ESP_FAIL;
+    *ret_encoder = (rmt_encoder_handle_t)&copyEncoder;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder)
+{
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_register_event_callbacks(rmt_channel_handle_t channel, const rmt_tx_event_callbacks_t* cbs, void* user_data)
+{
+    if (!channel || !cbs)
+        return ESP_FAIL;
+    channel->doneCB = cbs->on_trans_done;
+    channel->pDoneCBArg = user_data;
+    return ESP_OK;
+}
+
+esp_err_t rmt_enable(rmt_channel_handle_t channel)
+{
+    if (!channel)
+        return ESP_FAIL;
+    channel->isEnabled = true;
+    return ESP_OK;
+}
+
+esp_err_t rmt_disable(rmt_channel_handle_t channel)
+{
+    // Output stops immediately and queued transactions are discarded (without done callbacks)
+    if (!channel)
+        return ESP_FAIL;
+    channel->isEnabled = false;
+    channel->transactions.clear();
+    rmtSetLevel(channel, false);
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_sync_manager(const rmt_sync_manager_config_t* config, rmt_sync_manager_handle_t* ret_synchro)
+{
+    static int syncManager = 0;
+    if (!config || !ret_synchro)
+        return ESP_FAIL;
+    *ret_synchro = (rmt_sync_manager_handle_t)&syncManager;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_sync_manager(rmt_sync_manager_handle_t synchro)
+{
+    return ESP_OK;
+}
+
+esp_err_t rmt_sync_reset(rmt_sync_manager_handle_t synchro)
+{
+    return ESP_OK;
+}
+
+esp_err_t rmt_transmit(rmt_channel_handle_t channel, rmt_encoder_handle_t encoder, const void* payload,
+            size_t payload_bytes, const rmt_transmit_config_t* config)
+{
+    // The queue must have space (the driver would block)
+    if (!channel || !channel->isEnabled || !payload || (channel->transactions.size() >= channel->queueDepth))
+        return ESP_ERR_INVALID_STATE;
+    const rmt_symbol_word_t* pSymbols = (const rmt_symbol_word_t*)payload;
+    channel->transactions.emplace_back(pSymbols, pSymbols + payload_bytes / sizeof(rmt_symbol_word_t));
+    if (channel->transactions.size() == 1)
+        rmtStartTransaction(channel);
+    return ESP_OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Arduino time and pins (virtual time - input pins are read through the pin input hook)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+unsigned long millis()
+{
+    return _timeNs / 1000000;
+}
+
+unsigned long micros()
+{
+    return _timeNs / 1000;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    // Busy wait - peripherals (RMT) keep running but timer alarms are run after the wait
+    uint64_t untilNs = _timeNs + uint64_t(us) * 1000;
+    while (true)
+    {
+        uint32_t rmtChanIdx = 0;
+        uint64_t rmtTimeNs = rmtNextEventNs(rmtChanIdx);
+        if (rmtTimeNs > untilNs)
+            break;
+        _timeNs = UTILS_MAX(_timeNs, rmtTimeNs);
+        rmtRunEvent(_rmtChannels[rmtChanIdx]);
+    }
+    _timeNs = untilNs;
+}
+
+void pinMode(int pin, int mode)
+{
+}
+
+void digitalWrite(int pin, int val)
+{
+}
+
+int digitalRead(int pin)
+{
+    return (_pPinInputHook && _pPinInputHook(_pPinInputHookArg, pin)) ? 1 : 0;
+}
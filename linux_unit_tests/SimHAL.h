@@ -0,0 +1,70 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SimHAL
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+// Host hardware abstraction for the ramp simulator
+// Time is virtual - it only advances when the simulation runs the (single) gptimer so a run is deterministic
+// and independent of host speed - the gptimer alarm callback is called at each alarm with the period set by
+// gptimer_set_alarm_action (a change made in the callback applies to the next interval as on the ESP32)
+// RMT TX channels are also simulated - symbols transmitted are output in virtual time (in time order with the
+// timer alarms) as edges on their pins and the transmit done callback is called as each transaction ends
+namespace SimHAL
+{
+    /// @brief Get virtual time
+    /// @return Time in us
+    uint64_t getTimeUs();
+
+    /// @brief Get virtual time
+    /// @return Time in ns
+    uint64_t getTimeNs();
+
+    /// @brief Advance virtual time running timer alarms (ISR calls) and RMT output as they fall due
+    /// @param timeUs Virtual time to run until
+    /// @return Number of timer alarms
+    uint64_t runUntilUs(uint64_t timeUs);
+
+    /// @brief Check if the timer is running
+    bool isTimerRunning();
+
+    /// @brief Get host time (used to time the code under test)
+    uint64_t getHostTimeNs();
+    inline uint32_t getHostTimeNs32()
+    {
+        return uint32_t(getHostTimeNs());
+    }
+
+    /// @brief Timer callback stats (host execution time of the alarm callbacks)
+    struct TimerStats
+    {
+        uint64_t alarmCount = 0;
+        uint64_t callbackHostNs = 0;
+    };
+    const TimerStats& getTimerStats();
+    void resetTimerStats();
+
+    /// @brief Set a hook called after each timer alarm callback (to observe state left by the ISR)
+    /// @param pHook Hook function (or nullptr for none)
+    /// @param pArg Argument passed to the hook
+    typedef void (*PostAlarmHook)(void* pArg);
+    void setPostAlarmHook(PostAlarmHook pHook, void* pArg);
+
+    /// @brief Set a hook called when a simulated peripheral (RMT) changes the level of an output pin
+    /// @param pHook Hook function (or nullptr for none)
+    /// @param pArg Argument passed to the hook
+    typedef void (*PinOutputHook)(void* pArg, int pin, bool level);
+    void setPinOutputHook(PinOutputHook pHook, void* pArg);
+
+    /// @brief Set a hook which gives the level of pins read with digitalRead (pins read low without a hook)
+    /// @param pHook Hook function (or nullptr for none)
+    /// @param pArg Argument passed to the hook
+    typedef bool (*PinInputHook)(void* pArg, int pin);
+    void setPinInputHook(PinInputHook pHook, void* pArg);
+};
@@ -0,0 +1,339 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SimStepAnalyser
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include "SimStepAnalyser.h"
+#include "SimHAL.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Setup
+/// @param stepGenPeriodNs Step generation period
+/// @param accelTickNs Acceleration tick period
+void SimStepAnalyser::setup(uint32_t stepGenPeriodNs, uint32_t accelTickNs)
+{
+    _stepGenPeriodNs = stepGenPeriodNs;
+    _accelTickNs = accelTickNs;
+    _minRate = double(MotionBlock::calcMinStepRatePerTTicks(stepGenPeriodNs)) / stepGenPeriodNs;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add a block (called when a block is added to the pipeline - in pipeline order)
+/// @param stepSeg Step segment
+/// @param pIdealEndSteps Ideal position in steps at the end of the block (if the block ends a move) or nullptr
+void SimStepAnalyser::addBlock(const MotionStepSegment& stepSeg, const AxesValues<AxisStepsDataType>* pIdealEndSteps)
+{
+    Block block;
+    AxesValues<AxisStepsDataType> stepsToTarget = stepSeg.getStepsToTarget();
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        block.absSteps[axisIdx] = abs(stepsToTarget.getVal(axisIdx));
+    block.majorAxisIdx = stepSeg._axisIdxWithMaxSteps;
+    block.hasIdealEnd = pIdealEndSteps != nullptr;
+    if (pIdealEndSteps)
+        block.idealEndSteps = *pIdealEndSteps;
+    block.majorTimesUs.reserve(block.absSteps[block.majorAxisIdx]);
+    _blocks.push_back(block);
+    _numBlocksAdded++;
+    _results.numBlocks++;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Check for the start of execution of a block (called after each ISR)
+/// @param motionPipeline Motion pipeline
+/// @note The ISR which sets up a block doesn't step so the block starts at the time of that ISR
+void SimStepAnalyser::checkBlockStart(MotionPipelineIF& motionPipeline)
+{
+    MotionStepSegment* pStepSeg = motionPipeline.peekGet();
+    if (!pStepSeg || !pStepSeg->_isExecuting)
+        return;
+    uint64_t seqNum = _numBlocksAdded - motionPipeline.count();
+    if ((seqNum < _frontSeqNum) || (seqNum >= _frontSeqNum + _blocks.size()))
+        return;
+    Block& block = _blocks[seqNum - _frontSeqNum];
+    if (!block.isStarted)
+        startBlock(block, *pStepSeg, SimHAL::getTimeUs());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle a step
+/// @param axisIdx Axis
+/// @param dirn Direction (true for forwards)
+/// @param timeUs Time of the step
+void SimStepAnalyser::onStep(uint32_t axisIdx, bool dirn, uint64_t timeUs)
+{
+    if (axisIdx >= AXIS_VALUES_MAX_AXES)
+        return;
+
+    // Blocks are stepped in order so the step belongs to the oldest block with steps remaining on this axis
+    // (earlier blocks must then be complete)
+    while (!_blocks.empty() && _blocks.front().isComplete())
+    {
+        completeBlock(_blocks.front());
+        _blocks.pop_front();
+        _frontSeqNum++;
+    }
+    _axisPos[axisIdx] += dirn ? 1 : -1;
+    if (_blocks.empty() || (_blocks.front().stepsDone[axisIdx] >= _blocks.front().absSteps[axisIdx]))
+    {
+        _results.numUnattributedSteps++;
+        return;
+    }
+    Block& block = _blocks.front();
+    uint32_t stepNum = ++block.stepsDone[axisIdx];
+
+    // Major axis deviation from the ideal and velocity ripple
+    if (axisIdx == block.majorAxisIdx)
+    {
+        block.majorTimesUs.push_back(timeUs);
+        _results.numMajorSteps++;
+        if (block.isStarted)
+        {
+            double idealUs = block.startTimeUs + idealStepTimeUs(block, stepNum);
+            double devUs = fabs(double(timeUs) - idealUs);
+            _results.majorDevMaxUs = fmax(_results.majorDevMaxUs, devUs);
+            _results.majorDevSumSqUs += devUs * devUs;
+            if (stepNum >= 2)
+            {
+                double idealIntervalUs = idealStepTimeUs(block, stepNum) - idealStepTimeUs(block, stepNum - 1);
+                double actualIntervalUs = double(timeUs) - block.majorTimesUs[stepNum - 2];
+                if (idealIntervalUs > 0)
+                {
+                    double ripple = fabs(actualIntervalUs / idealIntervalUs - 1);
+                    _results.rippleMax = fmax(_results.rippleMax, ripple);
+                    _results.rippleSumSq += ripple * ripple;
+                    _results.numRippleIntervals++;
+                }
+            }
+        }
+    }
+    else
+    {
+        block.minorTimesUs[axisIdx].push_back(timeUs);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Complete analysis of blocks fully stepped
+void SimStepAnalyser::finish()
+{
+    while (!_blocks.empty() && _blocks.front().isComplete())
+    {
+        completeBlock(_blocks.front());
+        _blocks.pop_front();
+        _frontSeqNum++;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start a block
+/// @param block Block
+/// @param stepSeg Step segment (being executed so its parameters are final)
+/// @param timeUs Time of the ISR which set up the block
+void SimStepAnalyser::startBlock(Block& block, const MotionStepSegment& stepSeg, uint64_t timeUs)
+{
+    block.isStarted = true;
+    block.startTimeUs = timeUs;
+
+    // Rates per TTicks are steps per second multiplied by the step generation period (ns)
+    block.isTrapezoid = (stepSeg._jerkAccStepsPerTTicksPerMS == 0) && (stepSeg._shaperNumImpulses <= 1);
+    block.initialRate = double(stepSeg._initialStepRatePerTTicks) / _stepGenPeriodNs;
+    block.peakRate = double(stepSeg._maxStepRatePerTTicks) / _stepGenPeriodNs;
+    block.finalRate = double(stepSeg._finalStepRatePerTTicks) / _stepGenPeriodNs;
+    block.acc = double(stepSeg._accStepsPerTTicksPerMS) / _stepGenPeriodNs / (_accelTickNs / 1e9);
+    block.stepsBeforeDecel = stepSeg._stepsBeforeDecel;
+    if (!block.isTrapezoid)
+    {
+        buildReference(block, stepSeg);
+        if (stepSeg._jerkAccStepsPerTTicksPerMS != 0)
+            _results.numSCurveBlocks++;
+        else
+            _results.numShapedBlocks++;
+    }
+    _results.numBlocksCompared++;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Build the reference step times of a jerk-limited (S-curve) or input shaped block
+/// @param block Block (rates, acceleration and steps before deceleration set)
+/// @param stepSeg Step segment
+/// @note The block ramps from its initial rate to the peak rate and, once stepsBeforeDecel steps are done, from
+///       the rate reached to the final rate (never below the minimum rate) - each ramp is the ideal continuous one
+///       (the ramp generator approximates it once per acceleration tick):
+///       - S-curve - jerk up to the max acceleration (or less if the change is small), constant acceleration and
+///         jerk down (the same shape as MotionBlock::jerkLimitedRampDist)
+///       - input shaped - the constant acceleration ramp convolved with the shaper impulses (the amplitudes are the
+///         steps in the shaper levels and the times are those of the levels in acceleration ticks)
+void SimStepAnalyser::buildReference(Block& block, const MotionStepSegment& stepSeg) const
+{
+    double tickSecs = _accelTickNs / 1e9;
+    double acc = block.acc;
+    double jerk = double(stepSeg._jerkAccStepsPerTTicksPerMS) / _stepGenPeriodNs / tickSecs / tickSecs;
+    double impulseSecs[InputShaper::MAX_IMPULSES] = {};
+    double impulseAmps[InputShaper::MAX_IMPULSES] = {};
+    uint32_t numImpulses = jerk > 0 ? 0 : stepSeg._shaperNumImpulses;
+    double prevLevel = 0;
+    for (uint32_t impulseIdx = 0; impulseIdx < numImpulses; impulseIdx++)
+    {
+        double level = impulseIdx + 1 < numImpulses ?
+                    double(stepSeg._shaperLevelsQ16[impulseIdx]) / MotionStepSegment::SHAPER_LEVEL_Q16_ONE : 1;
+        impulseSecs[impulseIdx] = impulseIdx > 0 ? stepSeg._shaperImpulseTicks[impulseIdx - 1] * tickSecs : 0;
+        impulseAmps[impulseIdx] = level - prevLevel;
+        prevLevel = level;
+    }
+
+    // Rate change (magnitude) a time into a ramp of the given total change
+    auto rampChange = [&](double rampSecs, double totalChange) {
+        if ((rampSecs <= 0) || (acc <= 0))
+            return 0.0;
+        if (jerk > 0)
+        {
+            double peakAcc = fmin(acc, sqrt(totalChange * jerk));
+            double jerkSecs = peakAcc / jerk;
+            double totalSecs = 2 * jerkSecs + (totalChange - peakAcc * jerkSecs) / peakAcc;
+            if (rampSecs < jerkSecs)
+                return jerk * rampSecs * rampSecs / 2;
+            if (rampSecs < totalSecs - jerkSecs)
+                return peakAcc * jerkSecs / 2 + peakAcc * (rampSecs - jerkSecs);
+            if (rampSecs < totalSecs)
+                return totalChange - jerk * (totalSecs - rampSecs) * (totalSecs - rampSecs) / 2;
+            return totalChange;
+        }
+        double change = 0;
+        for (uint32_t impulseIdx = 0; impulseIdx < numImpulses; impulseIdx++)
+            change += impulseAmps[impulseIdx] * fmin(fmax(acc * (rampSecs - impulseSecs[impulseIdx]), 0), totalChange);
+        return change;
+    };
+
+    // Integrate the rate recording the time each step is reached
+    uint32_t numSteps = block.absSteps[block.majorAxisIdx];
+    block.refTimesUs.resize(numSteps);
+    double rampStartRate = fmax(block.initialRate, 0);
+    double rampTargetRate = fmax(block.peakRate, _minRate);
+    double rampStartSecs = 0;
+    bool isDecelerating = false;
+    double timeSecs = 0;
+    double pos = 0;
+    double rate = rampStartRate;
+    uint32_t stepIdx = 0;
+    while (stepIdx < numSteps)
+    {
+        if (!isDecelerating && (pos >= block.stepsBeforeDecel))
+        {
+            isDecelerating = true;
+            rampStartRate = rate;
+            rampTargetRate = fmax(block.finalRate, _minRate);
+            rampStartSecs = timeSecs;
+        }
+        double rampSecs = timeSecs + REF_STEP_SECS - rampStartSecs;
+        double change = rampChange(rampSecs, fabs(rampTargetRate - rampStartRate));
+        double nextRate = rampTargetRate >= rampStartRate ? rampStartRate + change : rampStartRate - change;
+        double nextPos = pos + (rate + nextRate) / 2 * REF_STEP_SECS;
+        while ((stepIdx < numSteps) && (nextPos >= stepIdx + 1))
+        {
+            block.refTimesUs[stepIdx] = (timeSecs + REF_STEP_SECS * (stepIdx + 1 - pos) / (nextPos - pos)) * 1e6;
+            stepIdx++;
+        }
+        timeSecs += REF_STEP_SECS;
+        pos = nextPos;
+        rate = nextRate;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Complete a block - minor axis steps are compared with the ideal time interpolated between major steps
+///        and, if the block ends a move, the position is compared with the ideal position
+/// @param block Block
+/// @note Steps of later blocks aren't counted before the block completes so the axis positions are those at its end
+void SimStepAnalyser::completeBlock(Block& block)
+{
+    if (block.hasIdealEnd)
+    {
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        {
+            int64_t posErr = llabs(_axisPos[axisIdx] - block.idealEndSteps.getVal(axisIdx));
+            _results.moveEndPosErrMaxSteps = posErr > _results.moveEndPosErrMaxSteps ? posErr : _results.moveEndPosErrMaxSteps;
+        }
+        _results.numMoveEndChecks++;
+    }
+    uint32_t majorNum = block.absSteps[block.majorAxisIdx];
+    for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+    {
+        uint32_t minorNum = block.absSteps[axisIdx];
+        if ((axisIdx == block.majorAxisIdx) || (minorNum == 0) || (block.majorTimesUs.size() != majorNum))
+            continue;
+        for (uint32_t k = 1; k <= block.minorTimesUs[axisIdx].size(); k++)
+        {
+            // Minor step k of n ideally occurs when the major axis (with M steps) has made k*M/n steps
+            double majorPos = double(k) * majorNum / minorNum;
+            uint32_t majorBelow = uint32_t(floor(majorPos));
+            if (majorBelow < 1)
+                continue;
+            double timeBelow = block.majorTimesUs[majorBelow - 1];
+            double timeAbove = majorBelow < majorNum ? block.majorTimesUs[majorBelow] : timeBelow;
+            double idealUs = timeBelow + (timeAbove - timeBelow) * (majorPos - majorBelow);
+
+            // The major axis moves between its steps as on the ideal profile (which isn't linear in time when the
+            // rate is changing) so the deviation from the ideal is interpolated rather than the time
+            if (block.isStarted && (majorBelow < majorNum))
+            {
+                double frac = majorPos - majorBelow;
+                double devBelowUs = timeBelow - block.startTimeUs - idealStepTimeUs(block, majorBelow);
+                double devAboveUs = timeAbove - block.startTimeUs - idealStepTimeUs(block, majorBelow + 1);
+                idealUs = block.startTimeUs + idealStepTimeUs(block, majorPos) + devBelowUs * (1 - frac) + devAboveUs * frac;
+            }
+            double errUs = fabs(double(block.minorTimesUs[axisIdx][k - 1]) - idealUs);
+            _results.minorErrMaxUs = fmax(_results.minorErrMaxUs, errUs);
+            _results.minorErrSumSqUs += errUs * errUs;
+            _results.numMinorSteps++;
+        }
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Ideal time of a step (from the block start) on the trapezoid defined by the block parameters (or on the
+///        reference profile if one has been built)
+/// @param block Block
+/// @param stepNum Step number (1 is the first step)
+/// @return Time in us
+/// @note As in the ramp generator the block accelerates (to the peak rate) until stepsBeforeDecel steps are done and
+///       then decelerates to the final rate (and never below the minimum rate)
+double SimStepAnalyser::idealStepTimeUs(const Block& block, double stepNum) const
+{
+    if (!block.refTimesUs.empty())
+    {
+        // Interpolated between reference steps (step 0 is at the start)
+        uint32_t stepBelow = uint32_t(fmin(floor(stepNum), block.refTimesUs.size()));
+        double timeBelow = stepBelow > 0 ? block.refTimesUs[stepBelow - 1] : 0;
+        if (stepBelow >= block.refTimesUs.size())
+            return timeBelow;
+        return timeBelow + (block.refTimesUs[stepBelow] - timeBelow) * (stepNum - stepBelow);
+    }
+
+    double v0 = fmax(block.initialRate, 0);
+    double vFinal = fmax(block.finalRate, _minRate);
+    double a = block.acc;
+    double decelStart = block.stepsBeforeDecel;
+    if (a <= 0)
+        return stepNum / fmax(v0, _minRate) * 1e6;
+
+    // Acceleration to the peak rate (limited by the start of deceleration) and cruise
+    double accDist = block.peakRate > v0 ? fmin((block.peakRate * block.peakRate - v0 * v0) / 2 / a, decelStart) : 0;
+    double cruiseRate = sqrt(v0 * v0 + 2 * a * accDist);
+    if (stepNum <= accDist)
+        return (sqrt(v0 * v0 + 2 * a * stepNum) - v0) / a * 1e6;
+    double accTime = (cruiseRate - v0) / a;
+    if ((stepNum <= decelStart) || (cruiseRate <= 0))
+        return (accTime + (stepNum - accDist) / fmax(cruiseRate, _minRate)) * 1e6;
+
+    // Deceleration to the final rate
+    double decelTimeStart = accTime + (decelStart - accDist) / cruiseRate;
+    double decelDist = cruiseRate > vFinal ? (cruiseRate * cruiseRate - vFinal * vFinal) / 2 / a : 0;
+    double distIntoDecel = stepNum - decelStart;
+    if (distIntoDecel <= decelDist)
+        return (decelTimeStart + (cruiseRate - sqrt(cruiseRate * cruiseRate - 2 * a * distIntoDecel)) / a) * 1e6;
+    return (decelTimeStart + (cruiseRate - vFinal) / a + (distIntoDecel - decelDist) / vFinal) * 1e6;
+}
@@ -0,0 +1,139 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SimStepAnalyser
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include "MotionPipelineIF.h"
+#include "SimStepDriver.h"
+
+// Step exactness analysis for the ramp simulator
+// Steps are analysed as they are generated (so runs of any length use bounded memory) against:
+// - the ideal profile computed from the parameters of the block being executed (step time deviation of the
+//   axis with most steps and velocity ripple - the ratio of each step interval to the ideal interval) - this is a
+//   trapezoid (closed form) or, for jerk-limited (S-curve) and input shaped blocks, a reference profile integrated
+//   from the continuous jerk-limited ramp or the constant acceleration ramp convolved with the shaper impulses
+// - the ideal time of minor axis steps interpolated between the major axis steps of the same block
+// - the ideal position (in steps) at the end of each move
+// Blocks are anchored at the ISR in which the ramp generator set them up so errors don't accumulate between blocks
+class SimStepAnalyser : public SimStepListener
+{
+public:
+    // Results
+    struct Results
+    {
+        uint64_t numBlocks = 0;
+        uint64_t numBlocksCompared = 0;
+        uint64_t numSCurveBlocks = 0;
+        uint64_t numShapedBlocks = 0;
+        uint64_t numMajorSteps = 0;
+        uint64_t numMinorSteps = 0;
+        uint64_t numUnattributedSteps = 0;
+        double majorDevMaxUs = 0;
+        double majorDevSumSqUs = 0;
+        double rippleMax = 0;
+        double rippleSumSq = 0;
+        uint64_t numRippleIntervals = 0;
+        double minorErrMaxUs = 0;
+        double minorErrSumSqUs = 0;
+        uint64_t numMoveEndChecks = 0;
+        int64_t moveEndPosErrMaxSteps = 0;
+    };
+
+    /// @brief Setup
+    /// @param stepGenPeriodNs Step generation period
+    /// @param accelTickNs Acceleration tick period
+    void setup(uint32_t stepGenPeriodNs, uint32_t accelTickNs);
+
+    /// @brief Add a block (called when a block is added to the pipeline - in pipeline order)
+    /// @param stepSeg Step segment
+    /// @param pIdealEndSteps Ideal position in steps at the end of the block (if the block ends a move) or nullptr
+    void addBlock(const MotionStepSegment& stepSeg, const AxesValues<AxisStepsDataType>* pIdealEndSteps);
+
+    /// @brief Check for the start of execution of a block (called after each ISR)
+    /// @param motionPipeline Motion pipeline
+    void checkBlockStart(MotionPipelineIF& motionPipeline);
+
+    /// @brief Handle a step
+    /// @param axisIdx Axis
+    /// @param dirn Direction (true for forwards)
+    /// @param timeUs Time of the step
+    virtual void onStep(uint32_t axisIdx, bool dirn, uint64_t timeUs) override;
+
+    /// @brief Complete analysis of blocks fully stepped
+    void finish();
+
+    /// @brief Get results
+    const Results& getResults() const
+    {
+        return _results;
+    }
+
+private:
+    // Block being analysed
+    struct Block
+    {
+        uint32_t absSteps[AXIS_VALUES_MAX_AXES] = {};
+        uint32_t stepsDone[AXIS_VALUES_MAX_AXES] = {};
+        uint32_t majorAxisIdx = 0;
+        bool hasIdealEnd = false;
+        AxesValues<AxisStepsDataType> idealEndSteps;
+
+        // Execution (set when the ramp generator sets up the block)
+        bool isStarted = false;
+        uint64_t startTimeUs = 0;
+
+        // Ideal profile (steps per second, steps per second squared) - a trapezoid unless the reference step
+        // times are set (S-curve or input shaped)
+        bool isTrapezoid = false;
+        double initialRate = 0;
+        double peakRate = 0;
+        double finalRate = 0;
+        double acc = 0;
+        uint32_t stepsBeforeDecel = 0;
+        std::vector<double> refTimesUs;
+
+        // Step times
+        std::vector<uint64_t> majorTimesUs;
+        std::vector<uint64_t> minorTimesUs[AXIS_VALUES_MAX_AXES];
+
+        bool isComplete() const
+        {
+            for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+                if (stepsDone[axisIdx] < absSteps[axisIdx])
+                    return false;
+            return true;
+        }
+    };
+
+    // Timing
+    uint32_t _stepGenPeriodNs = 20000;
+    uint32_t _accelTickNs = 1000000;
+    double _minRate = 10;
+
+    // Blocks added but not yet fully analysed (front is the oldest) and the sequence number of the front block
+    std::deque<Block> _blocks;
+    uint64_t _frontSeqNum = 0;
+    uint64_t _numBlocksAdded = 0;
+
+    // Axis positions
+    int64_t _axisPos[AXIS_VALUES_MAX_AXES] = {};
+
+    // Results
+    Results _results;
+
+    // Helpers
+    void startBlock(Block& block, const MotionStepSegment& stepSeg, uint64_t timeUs);
+    void completeBlock(Block& block);
+    double idealStepTimeUs(const Block& block, double stepNum) const;
+    void buildReference(Block& block, const MotionStepSegment& stepSeg) const;
+
+    // Time step used to integrate reference profiles
+    static constexpr double REF_STEP_SECS = 5e-6;
+};
@@ -0,0 +1,94 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// SimStepDriver
+//
+// Rob Dobson 2016-2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "StepDriverBase.h"
+#include "SimHAL.h"
+
+// Listener for steps (steps are passed on as they occur so that runs of any length use bounded memory)
+class SimStepListener
+{
+public:
+    virtual ~SimStepListener() {}
+    virtual void onStep(uint32_t axisIdx, bool dirn, uint64_t timeUs) = 0;
+};
+
+// Mock stepper driver for the ramp simulator - passes the (virtual) time of every step to a listener
+class SimStepDriver : public StepDriverBase
+{
+public:
+    /// @brief Set the listener for steps
+    /// @param pListener Listener (or nullptr for none)
+    /// @param axisIdx Axis index passed to the listener
+    void setListener(SimStepListener* pListener, uint32_t axisIdx)
+    {
+        _pListener = pListener;
+        _axisIdx = axisIdx;
+    }
+
+    virtual void setDirection(bool dirn, bool forceSet = false) override final
+    {
+        _dirn = dirn;
+    }
+
+    virtual void stepStart() override final
+    {
+        // A step started while the previous pulse is still active would be lost by a real driver
+        if (_stepActive)
+            _overlappingSteps++;
+        _stepActive = true;
+        _position += _dirn ? 1 : -1;
+        if (_pListener)
+            _pListener->onStep(_axisIdx, _dirn, SimHAL::getTimeUs());
+    }
+
+    virtual bool stepEnd() override final
+    {
+        bool wasActive = _stepActive;
+        _stepActive = false;
+        return wasActive;
+    }
+
+    virtual String getDriverType() const override
+    {
+        return "Sim";
+    }
+
+    /// @brief Set the step pin (for a hardware pulse engine - its pin output is passed to stepStart and stepEnd)
+    /// @param stepPin Step pin (-1 for none)
+    void setStepPin(int stepPin)
+    {
+        _stepPin = stepPin;
+    }
+    virtual int getStepPin() const override final
+    {
+        return _stepPin;
+    }
+
+    /// @brief Get position (net steps)
+    int64_t getPosition() const
+    {
+        return _position;
+    }
+
+    /// @brief Get count of steps started before the previous step ended
+    uint32_t getOverlappingSteps() const
+    {
+        return _overlappingSteps;
+    }
+
+private:
+    SimStepListener* _pListener = nullptr;
+    uint32_t _axisIdx = 0;
+    int _stepPin = -1;
+    int64_t _position = 0;
+    bool _dirn = false;
+    bool _stepActive = false;
+    uint32_t _overlappingSteps = 0;
+};
@@ -0,0 +1,122 @@
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "AxesValues.h"
+
+// Benchmark of AxesValues vector operations at 3 and 6 axes
+// Each iteration performs the per-block work of the planner (delta, distance, unit vector, dot product with the
+// previous unit vector and conversion to steps) using the vector operations and using per-axis accessors
+
+static constexpr uint32_t NUM_POINTS = 1000;
+static constexpr uint32_t NUM_RUNS = 200;
+
+/// @brief Planner style operations using AxesValues vector operations
+/// @tparam N Number of axes
+/// @param points Points
+/// @param stepsPerUnit Steps per unit for each axis
+/// @return Checksum (to prevent optimization away)
+template <uint32_t N>
+static double runVectorOps(const std::vector<AxesValues<float, N>>& points, const AxesValues<float, N>& stepsPerUnit)
+{
+    double checksum = 0;
+    AxesValues<float, N> prevUnitVec;
+    for (uint32_t i = 1; i < points.size(); i++)
+    {
+        AxesValues<float, N> deltas = points[i] - points[i - 1];
+        float dist = sqrtf(deltas.vectorMagnitudeSq());
+        AxesValues<float, N> unitVec = deltas / dist;
+        checksum += unitVec.vectorMultSum(prevUnitVec);
+        prevUnitVec = unitVec;
+        AxesValues<int32_t, N> steps;
+        for (uint32_t axisIdx = 0; axisIdx < N; axisIdx++)
+            steps[axisIdx] = int32_t(lroundf(points[i][axisIdx] * stepsPerUnit[axisIdx]));
+        checksum += steps[N - 1];
+    }
+    return checksum;
+}
+
+/// @brief Planner style operations using per-axis (bounds checked) accessors
+/// @tparam N Number of axes
+/// @param points Points
+/// @param stepsPerUnit Steps per unit for each axis
+/// @return Checksum (to prevent optimization away)
+template <uint32_t N>
+static double runAccessorOps(const std::vector<AxesValues<float, N>>& points, const AxesValues<float, N>& stepsPerUnit)
+{
+    double checksum = 0;
+    AxesValues<float, N> prevUnitVec;
+    for (uint32_t i = 1; i < points.size(); i++)
+    {
+        float deltas[N];
+        float squareSum = 0;
+        for (uint32_t axisIdx = 0; axisIdx < N; axisIdx++)
+        {
+            deltas[axisIdx] = points[i].getVal(axisIdx) - points[i - 1].getVal(axisIdx);
+            squareSum += deltas[axisIdx] * deltas[axisIdx];
+        }
+        float dist = sqrtf(squareSum);
+        AxesValues<float, N> unitVec;
+        for (uint32_t axisIdx = 0; axisIdx < N; axisIdx++)
+            unitVec.setVal(axisIdx, deltas[axisIdx] / dist);
+        float cosTheta = 0;
+        for (uint32_t axisIdx = 0; axisIdx < N; axisIdx++)
+            cosTheta += unitVec.getVal(axisIdx) * prevUnitVec.getVal(axisIdx);
+        checksum += cosTheta;
+        prevUnitVec = unitVec;
+        AxesValues<int32_t, N> steps;
+        for (uint32_t axisIdx = 0; axisIdx < N; axisIdx++)
+            steps.setVal(axisIdx, int32_t(lroundf(points[i].getVal(axisIdx) * stepsPerUnit.getVal(axisIdx))));
+        checksum += steps.getVal(N - 1);
+    }
+    return checksum;
+}
+
+/// @brief Time a function (fastest of several runs)
+/// @param fn Function
+/// @param checksum Output checksum
+/// @return ns per point
+template <typename FN>
+static double timeRuns(FN fn, double& checksum)
+{
+    uint64_t bestNs = UINT64_MAX;
+    for (uint32_t run = 0; run < NUM_RUNS; run++)
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        checksum = fn();
+        auto endTime = std::chrono::steady_clock::now();
+        bestNs = std::min(bestNs, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count());
+    }
+    return double(bestNs) / NUM_POINTS;
+}
+
+/// @brief Benchmark at N axes
+/// @tparam N Number of axes
+/// @return true if the results of both methods match
+template <uint32_t N>
+static bool benchmarkAxes()
+{
+    std::vector<AxesValues<float, N>> points(NUM_POINTS);
+    AxesValues<float, N> stepsPerUnit;
+    for (uint32_t axisIdx = 0; axisIdx < N; axisIdx++)
+        stepsPerUnit[axisIdx] = 80 + axisIdx * 20;
+    for (uint32_t i = 0; i < NUM_POINTS; i++)
+        for (uint32_t axisIdx = 0; axisIdx < N; axisIdx++)
+            points[i][axisIdx] = 50 * sinf(0.01f * i * (axisIdx + 1)) + axisIdx;
+
+    double vectorChecksum = 0, accessorChecksum = 0;
+    double vectorNs = timeRuns([&]() { return runVectorOps<N>(points, stepsPerUnit); }, vectorChecksum);
+    double accessorNs = timeRuns([&]() { return runAccessorOps<N>(points, stepsPerUnit); }, accessorChecksum);
+    bool isMatch = fabs(vectorChecksum - accessorChecksum) < 1e-3 * fabs(accessorChecksum) + 1e-3;
+    printf("AxesValues %d axes vector ops %.1f ns/pt per-axis accessors %.1f ns/pt size %d bytes %s\n",
+                (int)N, vectorNs, accessorNs, (int)sizeof(AxesValues<float, N>), isMatch ? "OK" : "MISMATCH");
+    return isMatch;
+}
+
+int main()
+{
+    bool isOk = benchmarkAxes<3>();
+    isOk = benchmarkAxes<6>() && isOk;
+    return isOk ? 0 : 1;
+}
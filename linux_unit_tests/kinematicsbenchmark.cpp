@@ -0,0 +1,120 @@
+#include <iostream>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+#include "utils.h"
+#include "RaftUtils.h"
+#include "RaftJsonPrefixed.h"
+#include "KinematicsSingleArmSCARA.h"
+
+// Benchmark of the exact and incremental inverse kinematics of KinematicsSingleArmSCARA
+// The path is a set of circles (and a spiral) split into short segments as the block splitter does
+
+/// @brief Generate test path
+/// @param maxRadiusMM Max radius of the arm
+/// @param segLenMM Segment length
+/// @return Points along the path
+static std::vector<AxesValues<AxisPosDataType>> generatePath(AxisPosDataType maxRadiusMM, AxisPosDataType segLenMM)
+{
+    std::vector<AxesValues<AxisPosDataType>> path;
+    // Circles of different radii centred on a point away from the origin
+    for (double circleRadius = 10; circleRadius < maxRadiusMM / 3; circleRadius += 10)
+    {
+        uint32_t numSegs = uint32_t(ceil(2 * M_PI * circleRadius / segLenMM));
+        for (uint32_t i = 0; i <= numSegs; i++)
+        {
+            double angle = 2 * M_PI * i / numSegs;
+            path.push_back({AxisPosDataType(maxRadiusMM / 2 + circleRadius * cos(angle)),
+                            AxisPosDataType(circleRadius * sin(angle))});
+        }
+    }
+    // Spiral out from near the origin
+    double angle = 0;
+    for (double radius = 5; radius < maxRadiusMM * 0.95; radius += segLenMM / 20)
+    {
+        angle += segLenMM / radius;
+        path.push_back({AxisPosDataType(radius * cos(angle)), AxisPosDataType(radius * sin(angle))});
+    }
+    return path;
+}
+
+/// @brief Run the path through the kinematics
+/// @param kinematics Kinematics
+/// @param axesParams Axes parameters
+/// @param path Path
+/// @param outSteps Output steps for each point
+/// @return Time taken in ns
+static uint64_t runPath(const KinematicsSingleArmSCARA& kinematics, const AxesParams& axesParams,
+            const std::vector<AxesValues<AxisPosDataType>>& path,
+            std::vector<AxesValues<AxisStepsDataType>>& outSteps)
+{
+    AxesState axesState;
+    outSteps.resize(path.size());
+    auto startTime = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < path.size(); i++)
+    {
+        if (!kinematics.ptToActuator(path[i], outSteps[i], axesState, axesParams, false))
+            continue;
+        axesState.setPosition(path[i], outSteps[i], false);
+    }
+    auto endTime = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+}
+
+int main()
+{
+    // Read JSON file testAxesDefinition.json into a string
+    std::ifstream jsonAxesDefinition("testAxesDefinition.json");
+    if (!jsonAxesDefinition.is_open())
+    {
+        std::cerr << "Failed to open JSON file" << std::endl;
+        return 1;
+    }
+    std::string jsonStr((std::istreambuf_iterator<char>(jsonAxesDefinition)), std::istreambuf_iterator<char>());
+    RaftJson config(jsonStr.c_str());
+
+    // Create AxesParams object and setup axes
+    AxesParams axesParams;
+    axesParams.setupAxes(config);
+    RaftJsonPrefixed motionConfig(config, "motion");
+
+    // Exact and incremental kinematics
+    KinematicsSingleArmSCARA exactKinematics(motionConfig);
+    exactKinematics.setIncrementalIK(false, 0);
+    KinematicsSingleArmSCARA incrementalKinematics(motionConfig);
+    const float maxErrMM = 0.01f;
+    incrementalKinematics.setIncrementalIK(true, maxErrMM);
+
+    // Path
+    std::vector<AxesValues<AxisPosDataType>> path = generatePath(exactKinematics.getMaxRadiusMM(), 1.0);
+
+    // Run several times and use the fastest
+    const uint32_t NUM_RUNS = 10;
+    uint64_t exactNs = UINT64_MAX, incrementalNs = UINT64_MAX;
+    std::vector<AxesValues<AxisStepsDataType>> exactSteps, incrementalSteps;
+    for (uint32_t run = 0; run < NUM_RUNS; run++)
+    {
+        exactNs = std::min(exactNs, runPath(exactKinematics, axesParams, path, exactSteps));
+        incrementalNs = std::min(incrementalNs, runPath(incrementalKinematics, axesParams, path, incrementalSteps));
+    }
+
+    // Compare
+    int32_t maxStepDiff = 0;
+    for (uint32_t i = 0; i < path.size(); i++)
+        for (uint32_t axisIdx = 0; axisIdx < 2; axisIdx++)
+            maxStepDiff = std::max(maxStepDiff, abs(exactSteps[i].getVal(axisIdx) - incrementalSteps[i].getVal(axisIdx)));
+    uint32_t incrementalCount = 0, exactCount = 0;
+    incrementalKinematics.getIncrementalIKCounts(incrementalCount, exactCount);
+
+    printf("SCARA IK benchmark %d points maxErrMM %.3f\n", (int)path.size(), maxErrMM);
+    printf("  exact       %.1f ns/pt\n", double(exactNs) / path.size());
+    printf("  incremental %.1f ns/pt (%.2fx) incremental solns %d exact solns %d\n",
+                double(incrementalNs) / path.size(), double(exactNs) / incrementalNs,
+                incrementalCount, exactCount);
+    printf("  max step difference %d\n", maxStepDiff);
+
+    // Rounding at a step boundary can differ by one step but no more
+    return maxStepDiff <= 1 ? 0 : 1;
+}
@@ -0,0 +1,920 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "RaftJsonPrefixed.h"
+#include "AxesParams.h"
+#include "EndStops.h"
+#include "MotionArgs.h"
+#include "MotionBlockManager.h"
+#include "MotionPipeline.h"
+#include "MotionPlanner.h"
+#include "MotorEnabler.h"
+#include "RampGenerator.h"
+#include "SimHAL.h"
+#include "SimStepDriver.h"
+#include "SimStepAnalyser.h"
+
+// Deterministic host simulation of the motion pipeline
+// Moves from a G-code-like file (or a stream of random short moves) are planned by the real MotionBlockManager and
+// MotionPlanner and stepped by the real RampGenerator (driven by a virtual gptimer) into mock step drivers
+// Reports planning throughput, host time per ISR call (tick) and the step exactness (see SimStepAnalyser) of the
+// generated steps - the run fails if any step doesn't belong to a planned block, the final or move end positions
+// differ from those planned or ideal, or an error exceeds a limit given on the command line
+// Usage: rampsim [moveFile] [configFile] [--blocks N] [--seed S] [--maxDevUs X] [--maxDevRmsUs X]
+//                [--maxRippleRms X] [--maxMinorErrUs X] [--holdEveryMs N] [--overrideEveryMs N] [--trajSamples N]
+//                [--jogs N] [--coalesce] [--endStop]
+//   moveFile and configFile default to testMoves.gcode and testRampSimConfig.json
+//   --blocks N runs N random short moves (0.05 to 1 units at random feedrates) instead of the move file
+//   --holdEveryMs N does a feed hold (pause, decelerate, replan and resume) every N ms of motion - the steps
+//                   no longer follow the planned profiles so only the final position is checked
+//   --overrideEveryMs N changes the feed override (cycling through 10% to 200%) every N ms of motion - as with
+//                   feed holds only the final position is checked
+//   --trajSamples N streams N samples of random step deltas (ramp/trajBufLen must be set) after the moves - the
+//                   final position and step spacing are checked
+//   --jogs N retargets velocity (jog) mode N times (random velocities every 20ms) then stops it - the final
+//                   position (against the ramp generator's step position) and step spacing are checked
+//   --coalesce checks the planner's coalescing of collinear moves (a merge and a refused merge) before the moves
+//   --endStop moves X towards an endstop which is hit part way after the moves - the steps counted by the ramp
+//             generator must match the steps output and X must stop soon after the endstop is hit
+//   with pressure advance configured only the final position (after the advance has settled) is checked
+//   with a hardware pulse engine (ramp/pulseEngine rmt) the RMT peripheral is simulated (see SimHAL) - the steps
+//   aren't on ramp timer ticks so only the final position is checked
+
+static constexpr uint32_t LOOP_INTERVAL_US = 1000;
+static constexpr uint64_t MAX_SIM_TIME_US = 7 * 24 * 3600ULL * 1000000;
+
+/// @brief Limits on step exactness (negative values are not checked)
+struct SimLimits
+{
+    double maxDevUs = -1;
+    double maxDevRmsUs = -1;
+    double maxRippleRms = -1;
+    double maxMinorErrUs = -1;
+};
+
+/// @brief Feed hold and feed override test settings
+struct SimHolds
+{
+    uint32_t holdEveryMs = 0;
+    uint32_t overrideEveryMs = 0;
+    bool isActive() const
+    {
+        return (holdEveryMs > 0) || (overrideEveryMs > 0);
+    }
+};
+
+/// @brief Simulation of the motion controller main loop (this mirrors MotionController moveTo/loop)
+class RampSim
+{
+public:
+    RampSim() : _blockManager(_motorEnabler, _axesParams)
+    {
+    }
+
+    ~RampSim()
+    {
+        _rampGenerator.stop();
+        SimHAL::setPostAlarmHook(nullptr, nullptr);
+        SimHAL::setPinOutputHook(nullptr, nullptr);
+        SimHAL::setPinInputHook(nullptr, nullptr);
+    }
+
+    bool setup(const RaftJsonIF& config, const SimHolds& holds)
+    {
+        _holds = holds;
+        _axesParams.setupAxes(config);
+        std::vector<String> axesVec;
+        config.getArrayElems("axes", axesVec);
+        for (uint32_t axisIdx = 0; (axisIdx < axesVec.size()) && (axisIdx < AXIS_VALUES_MAX_AXES); axisIdx++)
+        {
+            _simDrivers[axisIdx].setListener(&_analyser, axisIdx);
+            _stepperDrivers.push_back(&_simDrivers[axisIdx]);
+        }
+
+        // With a hardware pulse engine the steps are output on the drivers' step pins by the simulated peripheral
+        RaftJsonPrefixed rampConfig(config, "ramp");
+        if (!rampConfig.getString("pulseEngine", "timer").equalsIgnoreCase("timer"))
+        {
+            for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+                _simDrivers[axisIdx].setStepPin(SIM_STEP_PIN_BASE + axisIdx);
+            SimHAL::setPinOutputHook(pinOutputHook, this);
+        }
+
+        // Endstop at the max end of X (only hit during runEndStopMove)
+        _xEndStops.add(true, "simXMax", SIM_END_STOP_PIN, true, INPUT);
+        _axisEndStops.push_back(&_xEndStops);
+        SimHAL::setPinInputHook(pinInputHook, this);
+
+        _rampGenerator.setup(rampConfig, _stepperDrivers, _axisEndStops);
+        if (!_rampGenerator.isUsingTimerISR() && !_rampGenerator.isUsingPulseEngine())
+        {
+            LOG_E(MODULE_PREFIX, "setup ramp timer or pulse engine not in use (ramp/rampTimerEn or ramp/pulseEngine must be set)");
+            return false;
+        }
+        _analyser.setup(_rampGenerator.getPeriodUs() * 1000, _rampGenerator.getAccelTickNs());
+        SimHAL::setPostAlarmHook(postAlarmHook, this);
+        _rampGenerator.start();
+        _motorEnabler.setup(RaftJsonPrefixed(config, "motorEn"));
+        _blockManager.setup(_rampGenerator.getPeriodUs(), _rampGenerator.getAccelTickNs(), RaftJsonPrefixed(config, "motion"));
+        for (uint32_t axisIdx = 0; axisIdx < AXIS_VALUES_MAX_AXES; axisIdx++)
+        {
+            _rampGenerator.setTotalStepPosition(axisIdx, 0);
+            _blockManager.setCurPositionAsOrigin(axisIdx);
+        }
+        _rampGenerator.pause(false);
+        float pressureAdvanceSecs = 0;
+        _pressureAdvanceActive = _axesParams.getPressureAdvanceAxis(pressureAdvanceSecs) >= 0;
+        return true;
+    }
+
+    /// @brief Run a move (waits for the block splitter to accept it)
+    bool moveTo(MotionArgs& args)
+    {
+        while (_blockManager.isBusy())
+        {
+            if (!runLoopInterval())
+                return false;
+        }
+
+        // Plan (as MotionController::moveToRamped - the args are modified by pre-processing so keep the move requested)
+        MotionArgs argsRequested = args;
+        uint64_t startNs = SimHAL::getHostTimeNs();
+        AxisPosDataType moveDistanceMM = _blockManager.preProcessCoords(args);
+        uint32_t numBlocks = 1;
+        double maxBlockDistMM = _axesParams.getMaxBlockDistMM();
+        if (maxBlockDistMM > 0.01f && !args.dontSplitMove())
+            numBlocks = int(ceil(moveDistanceMM / maxBlockDistMM));
+        if (numBlocks == 0)
+            numBlocks = 1;
+        bool rslt = args.isArc() ? _blockManager.addArcBlock(args) : _blockManager.addRampedBlock(args, numBlocks);
+        _planHostNs += SimHAL::getHostTimeNs() - startNs;
+        if (rslt)
+        {
+            updateIdealEnd(argsRequested);
+            pumpBlockSplitter();
+        }
+        return rslt;
+    }
+
+    /// @brief Run until all motion is complete (including the pressure advance settle)
+    bool runToCompletion()
+    {
+        while (_blockManager.isBusy() || !_rampGenerator.isOutputIdle())
+        {
+            if (!runLoopInterval())
+                return false;
+        }
+        return true;
+    }
+
+    /// @brief Stream trajectory samples of random step deltas (mirrors MotionController trajStreamStart/End)
+    /// @param numSamples Number of samples
+    /// @param seed Random seed
+    bool runTrajStream(uint32_t numSamples, uint32_t seed)
+    {
+        RampGenTrajStream& trajStream = _rampGenerator.getTrajStream();
+        if (!trajStream.start())
+        {
+            LOG_E(MODULE_PREFIX, "runTrajStream stream not enabled (ramp/trajBufLen must be set)");
+            return false;
+        }
+        std::mt19937 rng(seed);
+        int32_t maxSteps = trajStream.getMaxStepsPerSample();
+        std::uniform_int_distribution<int32_t> stepsDist(-maxSteps, maxSteps);
+        for (uint32_t sampleIdx = 0; sampleIdx < numSamples; sampleIdx++)
+        {
+            int16_t steps[AXIS_VALUES_MAX_AXES] = {};
+            for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+            {
+                steps[axisIdx] = stepsDist(rng);
+                _trajSteps[axisIdx] += steps[axisIdx];
+            }
+            while (!trajStream.addSample(steps, _stepperDrivers.size()))
+            {
+                if (!runLoopInterval())
+                    return false;
+            }
+            _numTrajSamples++;
+        }
+        trajStream.end();
+        while (trajStream.isActive())
+        {
+            if (!runLoopInterval())
+                return false;
+        }
+        return true;
+    }
+
+    /// @brief Check coalescing of collinear moves in the planner (a merge and a refused merge)
+    /// @note Uses a separate planner and pipeline (nothing is stepped) with coalescing enabled - X and Y must be
+    ///       primary axes with the same steps per unit
+    bool checkCoalescing()
+    {
+        MotionPipeline motionPipeline;
+        motionPipeline.setup(10);
+        MotionPlanner motionPlanner(_axesParams);
+        motionPlanner.setup(_rampGenerator.getPeriodUs(), _rampGenerator.getAccelTickNs());
+        motionPlanner.setCoalescing(0.99f, 100);
+        AxesState axesState;
+
+        // Two moves along X (the first move can't be merged as the block before it may be executing), a move
+        // slightly off the X axis which is merged and a move along Y which is refused
+        static constexpr double MOVES_XY[][2] = { { 1, 0 }, { 2, 0 }, { 3, 0.1 }, { 3, 1.1 } };
+        static constexpr uint32_t EXPECTED_BLOCKS[] = { 1, 2, 2, 3 };
+        static constexpr uint32_t EXPECTED_COALESCED[] = { 0, 0, 1, 1 };
+        bool isOk = true;
+        for (uint32_t moveIdx = 0; moveIdx < sizeof(MOVES_XY) / sizeof(MOVES_XY[0]); moveIdx++)
+        {
+            MotionArgs args;
+            AxesValues<AxisStepsDataType> destActuatorCoords;
+            for (uint32_t axisIdx = 0; axisIdx < 2; axisIdx++)
+            {
+                args.getAxesPos().setVal(axisIdx, MOVES_XY[moveIdx][axisIdx]);
+                args.getAxesSpecified().setVal(axisIdx, true);
+                destActuatorCoords.setVal(axisIdx, 
+                            AxisStepsDataType(lround(MOVES_XY[moveIdx][axisIdx] * _axesParams.getStepsPerUnit(axisIdx))));
+            }
+            args.setFeedratePercent(100);
+            args.setMoreMovesComing(true);
+            motionPlanner.moveToRamped(args, destActuatorCoords, axesState, _axesParams, motionPipeline);
+            if ((motionPipeline.count() != EXPECTED_BLOCKS[moveIdx]) ||
+                        (motionPlanner.getNumCoalesced() != EXPECTED_COALESCED[moveIdx]))
+            {
+                LOG_E(MODULE_PREFIX, "checkCoalescing move %d blocks %d coalesced %d expected %d %d", moveIdx,
+                            motionPipeline.count(), motionPlanner.getNumCoalesced(), EXPECTED_BLOCKS[moveIdx],
+                            EXPECTED_COALESCED[moveIdx]);
+                isOk = false;
+            }
+        }
+
+        // The merged block (second from the end) goes from (1,0) to (3,0.1) - its direction, length and limits
+        // are those of the merged step vector and it isn't changed by the refused move
+        const MotionBlock* pMerged = motionPipeline.peekNthFromPut(1);
+        const MotionStepSegment* pMergedSeg = motionPipeline.peekStepSegNthFromPut(1);
+        AxesValues<AxisUnitVectorDataType> unitVec;
+        double lenMM = sqrt(2.0 * 2.0 + 0.1 * 0.1);
+        unitVec.setVal(0, 2.0 / lenMM);
+        unitVec.setVal(1, 0.1 / lenMM);
+        double maxAccUps2 = _axesParams.getPathMaxAccelUps2(unitVec);
+        double requestedSpeed = std::min(double(_axesParams.getMaxSpeedUps(0)), double(_axesParams.getPathMaxSpeedUps(unitVec)));
+        if (!pMerged || !pMergedSeg ||
+                    (pMergedSeg->getStepsToTarget().getVal(0) != lround(2.0 * _axesParams.getStepsPerUnit(0))) ||
+                    (pMergedSeg->getStepsToTarget().getVal(1) != lround(0.1 * _axesParams.getStepsPerUnit(1))) ||
+                    (fabs(pMerged->_moveDistPrimaryAxesMM - lenMM) > 1e-4) ||
+                    (fabs(pMerged->_unitVecAxisWithMaxDist - unitVec.getVal(0)) > 1e-5) ||
+                    (fabs(pMerged->_maxAccUps2 - maxAccUps2) > maxAccUps2 * 1e-5) ||
+                    (fabs(pMerged->_requestedSpeed - requestedSpeed) > requestedSpeed * 1e-5))
+        {
+            LOG_E(MODULE_PREFIX, "checkCoalescing merged block wrong steps %s dist %.6f unitVecMax %.6f acc %.3f speed %.3f",
+                        pMergedSeg ? pMergedSeg->getStepsToTarget().toJSON().c_str() : "",
+                        pMerged ? pMerged->_moveDistPrimaryAxesMM : 0, pMerged ? pMerged->_unitVecAxisWithMaxDist : 0,
+                        pMerged ? pMerged->_maxAccUps2 : 0, pMerged ? pMerged->_requestedSpeed : 0);
+            isOk = false;
+        }
+        printf("RampSim coalescing %s\n", isOk ? "OK" : "FAILED");
+        return isOk;
+    }
+
+    /// @brief Jog with random velocity targets (mirrors MotionController moveToVelocity)
+    /// @param numJogs Number of velocity retargets (velocity mode is stopped with zero targets after these)
+    /// @param seed Random seed
+    bool runJogs(uint32_t numJogs, uint32_t seed)
+    {
+        AxesValues<AxisStepsDataType> startSteps;
+        _rampGenerator.getTotalStepPosition(startSteps);
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<double> velDist(-1.2, 1.2);
+        for (uint32_t jogIdx = 0; jogIdx <= numJogs; jogIdx++)
+        {
+            // Velocities beyond maxSpeedUps are clamped (as in the motion controller)
+            AxesValues<AxisSpeedDataType> stepsPerSec;
+            AxesValues<AxisAccDataType> accStepsPerSec2;
+            AxesValues<AxisSpecifiedDataType> axesSpecified;
+            for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+            {
+                double stepsPerUnit = _axesParams.getStepsPerUnit(axisIdx);
+                double maxStepsPerSec = _axesParams.getMaxSpeedUps(axisIdx) * stepsPerUnit;
+                double velocity = jogIdx < numJogs ? velDist(rng) * maxStepsPerSec : 0;
+                stepsPerSec.setVal(axisIdx, UTILS_MAX(UTILS_MIN(velocity, maxStepsPerSec), -maxStepsPerSec));
+                accStepsPerSec2.setVal(axisIdx, _axesParams.getMaxAccelUps2(axisIdx) * stepsPerUnit);
+                axesSpecified.setVal(axisIdx, true);
+            }
+            if (!_rampGenerator.setVelocityTargets(stepsPerSec, accStepsPerSec2, axesSpecified))
+            {
+                LOG_E(MODULE_PREFIX, "runJogs velocity mode didn't start");
+                return false;
+            }
+            for (uint32_t i = 0; i < JOG_INTERVAL_MS * 1000 / LOOP_INTERVAL_US; i++)
+            {
+                if (!runLoopInterval())
+                    return false;
+            }
+            if (jogIdx < numJogs)
+                _numJogs++;
+        }
+        while (_rampGenerator.isVelocityModeActive())
+        {
+            if (!runLoopInterval())
+                return false;
+        }
+
+        // Steps moved while jogging
+        AxesValues<AxisStepsDataType> endSteps;
+        _rampGenerator.getTotalStepPosition(endSteps);
+        for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+            _trajSteps[axisIdx] += endSteps.getVal(axisIdx) - startSteps.getVal(axisIdx);
+        return true;
+    }
+
+    /// @brief Move X towards an endstop which is hit part way (as a homing move) - the block is ended when the
+    ///        endstop is hit and the steps counted by the ramp generator must match the steps output
+    bool runEndStopMove()
+    {
+        // Endstop is hit half way along the move
+        AxesValues<AxisStepsDataType> startSteps;
+        _rampGenerator.getTotalStepPosition(startSteps);
+        AxesValues<AxisStepsDataType> plannedStartSteps = _blockManager.getAxesState().getStepsFromOrigin();
+        int64_t startOutputSteps[AXIS_VALUES_MAX_AXES] = {};
+        for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+            startOutputSteps[axisIdx] = _simDrivers[axisIdx].getPosition();
+        double stepsPerUnit = _axesParams.getStepsPerUnit(0);
+        _endStopHitPos = startOutputSteps[0] + llround(END_STOP_MOVE_UNITS / 2 * stepsPerUnit);
+        _endStopArmed = true;
+        _numEndStopMoves++;
+
+        // Move
+        MotionArgs args;
+        args.setRelative(true);
+        args.getAxesPos().setVal(0, END_STOP_MOVE_UNITS);
+        args.getAxesSpecified().setVal(0, true);
+        args.setFeedratePercent(100);
+        args.setTestEndStop(0, AxisEndstopChecks::MAX_VAL_IDX, AxisEndstopChecks::END_STOP_HIT);
+        if (!moveTo(args) || !runToCompletion())
+            return false;
+        _endStopArmed = false;
+
+        // Check the endstop ended the move, the steps counted and the overshoot (the ISR checks endstops every
+        // tick - a pulse engine checks them as chunks are refilled from the main loop)
+        AxesValues<AxisStepsDataType> endSteps;
+        _rampGenerator.getTotalStepPosition(endSteps);
+        AxesValues<AxisStepsDataType> plannedEndSteps = _blockManager.getAxesState().getStepsFromOrigin();
+        bool isOk = _rampGenerator.isEndStopReached();
+        for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+        {
+            int64_t countedSteps = endSteps.getVal(axisIdx) - startSteps.getVal(axisIdx);
+            int64_t outputSteps = _simDrivers[axisIdx].getPosition() - startOutputSteps[axisIdx];
+            if (countedSteps != outputSteps)
+            {
+                printf("Endstop move axis %d steps counted %lld output %lld MISMATCH\n", (int)axisIdx,
+                            (long long)countedSteps, (long long)outputSteps);
+                isOk = false;
+            }
+
+            // Later checks are against the steps counted (the planner's position is the end of the whole move)
+            _trajSteps[axisIdx] += countedSteps - (plannedEndSteps.getVal(axisIdx) - plannedStartSteps.getVal(axisIdx));
+        }
+        int64_t overshootSteps = _simDrivers[0].getPosition() - _endStopHitPos;
+        int64_t maxOvershootSteps = _rampGenerator.isUsingPulseEngine() ?
+                    llround(_axesParams.getMaxSpeedUps(0) * stepsPerUnit * LOOP_INTERVAL_US / 1e6) + 1 : 1;
+        if ((overshootSteps < 0) || (overshootSteps > maxOvershootSteps))
+            isOk = false;
+        printf("RampSim endstop %s overshoot %lld steps (max %lld) %s\n", _rampGenerator.isEndStopReached() ? "hit" : "NOT HIT",
+                    (long long)overshootSteps, (long long)maxOvershootSteps, isOk ? "OK" : "FAILED");
+        _rampGenerator.clearEndstopReached();
+        if (!isOk)
+            _endStopFailures++;
+        return true;
+    }
+
+    /// @brief Report results
+    /// @return true if the steps generated match the planned steps
+    bool report(uint32_t numMoves, const SimLimits& limits)
+    {
+        // Feed holds, overrides, trajectory streams and pressure advance
+        if (isFinalPosOnly())
+            return reportHolds(numMoves);
+
+        // Check the steps generated against the planned position
+        bool isOk = true;
+        AxesValues<AxisStepsDataType> plannedSteps = _blockManager.getAxesState().getStepsFromOrigin();
+        for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+        {
+            if (_simDrivers[axisIdx].getPosition() != plannedSteps.getVal(axisIdx))
+            {
+                printf("Axis %d steps %lld planned %d MISMATCH\n", (int)axisIdx,
+                            (long long)_simDrivers[axisIdx].getPosition(), (int)plannedSteps.getVal(axisIdx));
+                isOk = false;
+            }
+            if (_simDrivers[axisIdx].getOverlappingSteps() != 0)
+            {
+                printf("Axis %d overlapping steps %d\n", (int)axisIdx, (int)_simDrivers[axisIdx].getOverlappingSteps());
+                isOk = false;
+            }
+        }
+
+        // Step exactness
+        _analyser.finish();
+        const SimStepAnalyser::Results& exact = _analyser.getResults();
+        if (exact.numUnattributedSteps != 0)
+        {
+            printf("Steps not in a planned block %llu\n", (unsigned long long)exact.numUnattributedSteps);
+            isOk = false;
+        }
+        if (exact.moveEndPosErrMaxSteps != 0)
+        {
+            printf("Move end position error %lld steps\n", (long long)exact.moveEndPosErrMaxSteps);
+            isOk = false;
+        }
+        double devRmsUs = exact.numMajorSteps > 0 ? sqrt(exact.majorDevSumSqUs / exact.numMajorSteps) : 0;
+        double rippleRms = exact.numRippleIntervals > 0 ? sqrt(exact.rippleSumSq / exact.numRippleIntervals) : 0;
+        double minorErrRmsUs = exact.numMinorSteps > 0 ? sqrt(exact.minorErrSumSqUs / exact.numMinorSteps) : 0;
+        if (((limits.maxDevUs >= 0) && (exact.majorDevMaxUs > limits.maxDevUs)) ||
+                    ((limits.maxDevRmsUs >= 0) && (devRmsUs > limits.maxDevRmsUs)) ||
+                    ((limits.maxRippleRms >= 0) && (rippleRms > limits.maxRippleRms)) ||
+                    ((limits.maxMinorErrUs >= 0) && (exact.minorErrMaxUs > limits.maxMinorErrUs)))
+        {
+            printf("Step exactness limit exceeded\n");
+            isOk = false;
+        }
+
+        // Results
+        const SimHAL::TimerStats& timerStats = SimHAL::getTimerStats();
+        uint64_t numBlocks = exact.numBlocks;
+        printf("RampSim moves %d blocks %llu simTime %.3fs\n", (int)numMoves, (unsigned long long)numBlocks, SimHAL::getTimeUs() / 1e6);
+        printf("RampSim planning %.0f blocks/s (%.2f us/block)\n",
+                    _planHostNs > 0 ? numBlocks * 1e9 / _planHostNs : 0.0,
+                    numBlocks > 0 ? _planHostNs / 1e3 / numBlocks : 0.0);
+        printf("RampSim ISR %.1f ns/tick (%llu ticks)\n",
+                    timerStats.alarmCount > 0 ? double(timerStats.callbackHostNs) / timerStats.alarmCount : 0.0,
+                    (unsigned long long)timerStats.alarmCount);
+        printf("RampSim step deviation from ideal profile max %.1fus rms %.2fus (%llu steps, %llu of %llu blocks, %llu s-curve, %llu shaped)\n",
+                    exact.majorDevMaxUs, devRmsUs, (unsigned long long)exact.numMajorSteps, (unsigned long long)exact.numBlocksCompared,
+                    (unsigned long long)numBlocks, (unsigned long long)exact.numSCurveBlocks, (unsigned long long)exact.numShapedBlocks);
+        printf("RampSim velocity ripple max %.1f%% rms %.2f%% (%llu intervals)\n", exact.rippleMax * 100,
+                    rippleRms * 100, (unsigned long long)exact.numRippleIntervals);
+        printf("RampSim step timing error minor axes max %.1fus rms %.2fus (%llu steps)\n", exact.minorErrMaxUs,
+                    minorErrRmsUs, (unsigned long long)exact.numMinorSteps);
+        printf("RampSim move end position error max %lld steps (%llu moves)\n", (long long)exact.moveEndPosErrMaxSteps,
+                    (unsigned long long)exact.numMoveEndChecks);
+        printf("RampSim %s\n", _rampGenerator.getStats().getISRHistogramJSON().c_str());
+        printf("RampSim %s\n", isOk ? "OK" : "FAILED");
+        return isOk;
+    }
+
+private:
+    static constexpr const char* MODULE_PREFIX = "RampSim";
+
+    // Feed holds (the next hold is started after holdEveryMs of motion)
+    SimHolds _holds;
+    uint64_t _nextHoldUs = 0;
+    bool _resumeFromHoldPending = false;
+    uint32_t _numHolds = 0;
+
+    // Feed overrides (the override is changed after overrideEveryMs of motion)
+    static constexpr uint32_t FEED_OVERRIDE_SEQUENCE[] = { 50, 150, 10, 200, 75, 100 };
+    uint64_t _nextOverrideUs = 0;
+    uint32_t _numOverrides = 0;
+
+    // Trajectory stream samples and jogs and the steps streamed or jogged on each axis
+    static constexpr uint32_t JOG_INTERVAL_MS = 20;
+    uint32_t _numTrajSamples = 0;
+    uint32_t _numJogs = 0;
+    int64_t _trajSteps[AXIS_VALUES_MAX_AXES] = {};
+
+    // Motion controller parts
+    AxesParams _axesParams;
+    MotorEnabler _motorEnabler;
+    MotionBlockManager _blockManager;
+    RampGenerator _rampGenerator;
+    SimStepDriver _simDrivers[AXIS_VALUES_MAX_AXES];
+    std::vector<StepDriverBase*> _stepperDrivers;
+    std::vector<EndStops*> _axisEndStops;
+
+    // Step exactness analysis
+    SimStepAnalyser _analyser;
+
+    // Ideal position (units) at the end of the most recent move and whether it applies to a block still to be added
+    double _idealPos[AXIS_VALUES_MAX_AXES] = {};
+    bool _idealEndPending = false;
+
+    // Host time spent planning
+    uint64_t _planHostNs = 0;
+
+    // Pressure advance configured (the steps of its axis don't follow the planned profiles)
+    bool _pressureAdvanceActive = false;
+
+    // Endstop moves - the endstop (at the max end of X) is hit when X reaches the hit position while armed
+    static constexpr int SIM_STEP_PIN_BASE = 10;
+    static constexpr int SIM_END_STOP_PIN = 40;
+    static constexpr double END_STOP_MOVE_UNITS = 100;
+    EndStops _xEndStops;
+    bool _endStopArmed = false;
+    int64_t _endStopHitPos = 0;
+    uint32_t _numEndStopMoves = 0;
+    uint32_t _endStopFailures = 0;
+
+    /// @brief Check if only the final position is checked (the steps don't follow the planned profiles or aren't
+    ///        on ramp timer ticks)
+    bool isFinalPosOnly() const
+    {
+        return _holds.isActive() || (_numTrajSamples > 0) || (_numJogs > 0) || _pressureAdvanceActive ||
+                    (_numEndStopMoves > 0) || _rampGenerator.isUsingPulseEngine();
+    }
+
+    /// @brief Run the timer for a loop interval and then the main loop work
+    bool runLoopInterval()
+    {
+        if (SimHAL::getTimeUs() > MAX_SIM_TIME_US)
+        {
+            LOG_E(MODULE_PREFIX, "runLoopInterval simulation time limit reached");
+            return false;
+        }
+        SimHAL::runUntilUs(SimHAL::getTimeUs() + LOOP_INTERVAL_US);
+        _rampGenerator.loop();
+        serviceFeedHold();
+        serviceFeedOverride();
+        pumpBlockSplitter();
+        return true;
+    }
+
+    /// @brief Start and resume feed holds (mirrors MotionController pause and serviceFeedHold) - not during an
+    ///        endstop move (resuming clears the endstop reached flag)
+    void serviceFeedHold()
+    {
+        if ((_holds.holdEveryMs == 0) || _endStopArmed)
+            return;
+        if (!_resumeFromHoldPending)
+        {
+            if (_rampGenerator.getMotionPipelineConst().count() == 0)
+                return;
+            if (_nextHoldUs == 0)
+                _nextHoldUs = SimHAL::getTimeUs() + _holds.holdEveryMs * 1000ULL;
+            if (SimHAL::getTimeUs() < _nextHoldUs)
+                return;
+            _rampGenerator.pause(true);
+            _resumeFromHoldPending = true;
+            return;
+        }
+        if (_rampGenerator.isHoldDecelerating())
+            return;
+        if (_rampGenerator.isHeld())
+        {
+            AxesValues<AxisStepsDataType> heldStepsDone;
+            _rampGenerator.getHeldBlockProgress(heldStepsDone);
+            _blockManager.replanFromStandstill(_rampGenerator.getMotionPipeline(), heldStepsDone);
+            _numHolds++;
+        }
+        _resumeFromHoldPending = false;
+        _rampGenerator.pause(false);
+        _nextHoldUs = SimHAL::getTimeUs() + _holds.holdEveryMs * 1000ULL;
+    }
+
+    /// @brief Change the feed override (mirrors MotionController setFeedOverride and serviceFeedOverride)
+    void serviceFeedOverride()
+    {
+        if ((_holds.overrideEveryMs == 0) || (_rampGenerator.getMotionPipelineConst().count() == 0))
+            return;
+        if (_nextOverrideUs == 0)
+            _nextOverrideUs = SimHAL::getTimeUs() + _holds.overrideEveryMs * 1000ULL;
+        if (SimHAL::getTimeUs() < _nextOverrideUs)
+            return;
+        uint32_t numInSequence = sizeof(FEED_OVERRIDE_SEQUENCE) / sizeof(FEED_OVERRIDE_SEQUENCE[0]);
+        uint32_t feedOverridePercent = FEED_OVERRIDE_SEQUENCE[_numOverrides % numInSequence];
+        _rampGenerator.setFeedOverride(feedOverridePercent);
+        _blockManager.setFeedOverride(feedOverridePercent, _rampGenerator.getMotionPipeline());
+        _numOverrides++;
+        _nextOverrideUs = SimHAL::getTimeUs() + _holds.overrideEveryMs * 1000ULL;
+    }
+
+    /// @brief Report results of a run with feed holds, overrides, a trajectory stream or pressure advance (only the
+    ///        final position is checked - and the step spacing for a trajectory stream)
+    bool reportHolds(uint32_t numMoves)
+    {
+        bool isOk = true;
+        AxesValues<AxisStepsDataType> plannedSteps = _blockManager.getAxesState().getStepsFromOrigin();
+        for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+        {
+            int64_t expectedSteps = plannedSteps.getVal(axisIdx) + _trajSteps[axisIdx];
+            if (_simDrivers[axisIdx].getPosition() != expectedSteps)
+            {
+                printf("Axis %d steps %lld planned %lld MISMATCH\n", (int)axisIdx,
+                            (long long)_simDrivers[axisIdx].getPosition(), (long long)expectedSteps);
+                isOk = false;
+            }
+            if (((_numTrajSamples > 0) || (_numJogs > 0)) && (_simDrivers[axisIdx].getOverlappingSteps() != 0))
+            {
+                printf("Axis %d overlapping steps %d\n", (int)axisIdx, (int)_simDrivers[axisIdx].getOverlappingSteps());
+                isOk = false;
+            }
+        }
+        if (_endStopFailures > 0)
+            isOk = false;
+        printf("RampSim moves %d holds %d overrides %d trajSamples %d jogs %d endStopMoves %d pressureAdvance %s simTime %.3fs\n",
+                    (int)numMoves, (int)_numHolds, (int)_numOverrides, (int)_numTrajSamples, (int)_numJogs,
+                    (int)_numEndStopMoves, _pressureAdvanceActive ? "on" : "off", SimHAL::getTimeUs() / 1e6);
+        if (_rampGenerator.isUsingPulseEngine())
+            printf("RampSim pulse engine %s\n", _rampGenerator.getDebugJSON(true).c_str());
+        printf("RampSim %s\n", isOk ? "OK" : "FAILED");
+        return isOk;
+    }
+
+    /// @brief Pump the block splitter and pass blocks added to the pipeline to the analyser
+    void pumpBlockSplitter()
+    {
+        MotionPipelineIF& motionPipeline = _rampGenerator.getMotionPipeline();
+        uint32_t countBefore = motionPipeline.count();
+        uint64_t startNs = SimHAL::getHostTimeNs();
+        _blockManager.pumpBlockSplitter(motionPipeline);
+        _planHostNs += SimHAL::getHostTimeNs() - startNs;
+
+        // The ISR doesn't run during the pump so the new blocks are the most recently put - the last block of a
+        // move has been added when the splitter is no longer busy
+        uint32_t countAfter = motionPipeline.count();
+        bool moveEnded = _idealEndPending && !_blockManager.isBusy();
+        AxesValues<AxisStepsDataType> idealEndSteps;
+        for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+            idealEndSteps.setVal(axisIdx, llround(_idealPos[axisIdx] * _axesParams.getStepsPerUnit(axisIdx)));
+        for (uint32_t i = countAfter; i > countBefore; i--)
+        {
+            MotionStepSegment* pStepSeg = motionPipeline.peekStepSegNthFromPut(i - countBefore - 1);
+            if (pStepSeg)
+                _analyser.addBlock(*pStepSeg, (moveEnded && (i == countBefore + 1)) ? &idealEndSteps : nullptr);
+        }
+        if (moveEnded)
+            _idealEndPending = false;
+    }
+
+    /// @brief Update the ideal position at the end of a move
+    /// @param args Motion args of the move (as requested)
+    void updateIdealEnd(MotionArgs& args)
+    {
+        for (uint32_t axisIdx = 0; axisIdx < _stepperDrivers.size(); axisIdx++)
+        {
+            if (!args.getAxesSpecified().getVal(axisIdx))
+                continue;
+            double pos = args.getAxesPosConst().getVal(axisIdx);
+            _idealPos[axisIdx] = args.isRelative() ? _idealPos[axisIdx] + pos : pos;
+        }
+        _idealEndPending = true;
+    }
+
+    /// @brief Pass the step pin output of a hardware pulse engine to the drivers
+    static void pinOutputHook(void* pArg, int pin, bool level)
+    {
+        RampSim* pSim = (RampSim*)pArg;
+        uint32_t axisIdx = pin - SIM_STEP_PIN_BASE;
+        if ((pin < SIM_STEP_PIN_BASE) || (axisIdx >= pSim->_stepperDrivers.size()))
+            return;
+        if (level)
+            pSim->_simDrivers[axisIdx].stepStart();
+        else
+            pSim->_simDrivers[axisIdx].stepEnd();
+    }
+
+    /// @brief Read the endstop pin
+    static bool pinInputHook(void* pArg, int pin)
+    {
+        RampSim* pSim = (RampSim*)pArg;
+        return (pin == SIM_END_STOP_PIN) && pSim->_endStopArmed && (pSim->_simDrivers[0].getPosition() >= pSim->_endStopHitPos);
+    }
+
+    /// @brief Called after each ISR call to let the analyser capture the start of each block
+    static void postAlarmHook(void* pArg)
+    {
+        if (((RampSim*)pArg)->isFinalPosOnly())
+            return;
+        ((RampSim*)pArg)->_analyser.checkBlockStart(((RampSim*)pArg)->_rampGenerator.getMotionPipeline());
+    }
+};
+
+/// @brief Parse a G-code-like move line (G0/G1 linear, G2/G3 arcs with I J, G90/G91 absolute/relative)
+/// @param line Line
+/// @param args (out) Motion args
+/// @param isRelative (in/out) Relative mode
+/// @param feedrateUnitsPerMin (in/out) Modal feedrate
+/// @return true if the line is a move
+static bool parseMoveLine(const std::string& line, MotionArgs& args, bool& isRelative, double& feedrateUnitsPerMin)
+{
+    std::istringstream words(line.substr(0, line.find(';')));
+    std::string word;
+    int gCode = -1;
+    double arcI = 0, arcJ = 0;
+    static const char* AXIS_LETTERS = "XYZ";
+    args.clear();
+    while (words >> word)
+    {
+        char letter = toupper(word[0]);
+        double val = atof(word.c_str() + 1);
+        const char* pAxis = strchr(AXIS_LETTERS, letter);
+        if (letter == 'G')
+            gCode = int(val);
+        else if (letter == 'F')
+            feedrateUnitsPerMin = val;
+        else if (letter == 'I')
+            arcI = val;
+        else if (letter == 'J')
+            arcJ = val;
+        else if (pAxis && *pAxis)
+        {
+            args.getAxesPos().setVal(pAxis - AXIS_LETTERS, val);
+            args.getAxesSpecified().setVal(pAxis - AXIS_LETTERS, true);
+        }
+    }
+    if ((gCode == 90) || (gCode == 91))
+        isRelative = gCode == 91;
+    if ((gCode < 0) || (gCode > 3))
+        return false;
+    args.setRelative(isRelative);
+    if (gCode == 0)
+        args.setFeedratePercent(100);
+    else if (feedrateUnitsPerMin > 0)
+        args.setFeedrateUnitsPerMin(feedrateUnitsPerMin);
+    if (gCode >= 2)
+        args.setArc(arcI, arcJ, gCode == 2);
+    return true;
+}
+
+/// @brief Generator of random short moves (absolute) within a box
+class RandomMoves
+{
+public:
+    RandomMoves(uint32_t seed) : _rng(seed)
+    {
+    }
+
+    /// @brief Get the next move
+    /// @param args (out) Motion args
+    void getNext(MotionArgs& args)
+    {
+        // Segment of 0.05 to 1 units in a random direction (reflected at the box edges) with coordinates
+        // rounded to 3 decimal places - occasionally a move of Z
+        std::uniform_real_distribution<double> lenDist(0.05, 1.0), angleDist(0, 2 * M_PI), feedDist(600, 9000);
+        double len = lenDist(_rng);
+        args.clear();
+        if (std::uniform_int_distribution<uint32_t>(0, 49)(_rng) == 0)
+        {
+            _pos[2] = moveInBox(_pos[2], std::uniform_int_distribution<uint32_t>(0, 1)(_rng) ? len : -len, BOX_SIZE_Z);
+        }
+        else
+        {
+            double angle = angleDist(_rng);
+            _pos[0] = moveInBox(_pos[0], len * cos(angle), BOX_SIZE_XY);
+            _pos[1] = moveInBox(_pos[1], len * sin(angle), BOX_SIZE_XY);
+        }
+        for (uint32_t axisIdx = 0; axisIdx < 3; axisIdx++)
+        {
+            args.getAxesPos().setVal(axisIdx, _pos[axisIdx]);
+            args.getAxesSpecified().setVal(axisIdx, true);
+        }
+        args.setRelative(false);
+        args.setFeedrateUnitsPerMin(round(feedDist(_rng)));
+    }
+
+private:
+    static constexpr double BOX_SIZE_XY = 100;
+    static constexpr double BOX_SIZE_Z = 5;
+    std::mt19937 _rng;
+    double _pos[3] = {};
+    static double moveInBox(double pos, double delta, double boxSize)
+    {
+        if ((pos + delta < 0) || (pos + delta > boxSize))
+            delta = -delta;
+        return round((pos + delta) * 1000) / 1000;
+    }
+};
+
+int main(int argc, char** argv)
+{
+    // Args
+    std::vector<const char*> fileNames;
+    uint64_t numRandomMoves = 0;
+    uint32_t seed = 1;
+    SimLimits limits;
+    SimHolds holds;
+    uint32_t numTrajSamples = 0;
+    uint32_t numJogs = 0;
+    bool checkCoalescing = false;
+    bool runEndStopMove = false;
+    for (int argIdx = 1; argIdx < argc; argIdx++)
+    {
+        const char* pArg = argv[argIdx];
+        bool hasVal = argIdx + 1 < argc;
+        if ((strcmp(pArg, "--blocks") == 0) && hasVal)
+            numRandomMoves = strtoull(argv[++argIdx], nullptr, 10);
+        else if ((strcmp(pArg, "--seed") == 0) && hasVal)
+            seed = strtoul(argv[++argIdx], nullptr, 10);
+        else if ((strcmp(pArg, "--maxDevUs") == 0) && hasVal)
+            limits.maxDevUs = atof(argv[++argIdx]);
+        else if ((strcmp(pArg, "--maxDevRmsUs") == 0) && hasVal)
+            limits.maxDevRmsUs = atof(argv[++argIdx]);
+        else if ((strcmp(pArg, "--maxRippleRms") == 0) && hasVal)
+            limits.maxRippleRms = atof(argv[++argIdx]);
+        else if ((strcmp(pArg, "--maxMinorErrUs") == 0) && hasVal)
+            limits.maxMinorErrUs = atof(argv[++argIdx]);
+        else if ((strcmp(pArg, "--holdEveryMs") == 0) && hasVal)
+            holds.holdEveryMs = strtoul(argv[++argIdx], nullptr, 10);
+        else if ((strcmp(pArg, "--overrideEveryMs") == 0) && hasVal)
+            holds.overrideEveryMs = strtoul(argv[++argIdx], nullptr, 10);
+        else if ((strcmp(pArg, "--trajSamples") == 0) && hasVal)
+            numTrajSamples = strtoul(argv[++argIdx], nullptr, 10);
+        else if ((strcmp(pArg, "--jogs") == 0) && hasVal)
+            numJogs = strtoul(argv[++argIdx], nullptr, 10);
+        else if (strcmp(pArg, "--coalesce") == 0)
+            checkCoalescing = true;
+        else if (strcmp(pArg, "--endStop") == 0)
+            runEndStopMove = true;
+        else if (strncmp(pArg, "--", 2) == 0)
+        {
+            std::cerr << "Unknown option " << pArg << std::endl;
+            return 1;
+        }
+        else
+            fileNames.push_back(pArg);
+    }
+    const char* moveFileName = fileNames.size() > 0 ? fileNames[0] : "testMoves.gcode";
+    const char* configFileName = fileNames.size() > 1 ? fileNames[1] : "testRampSimConfig.json";
+
+    // Config
+    std::ifstream configFile(configFileName);
+    if (!configFile.is_open())
+    {
+        std::cerr << "Failed to open config file " << configFileName << std::endl;
+        return 1;
+    }
+    std::string configStr((std::istreambuf_iterator<char>(configFile)), std::istreambuf_iterator<char>());
+    RaftJson config(configStr.c_str());
+
+    // Setup
+    RampSim rampSim;
+    if (!rampSim.setup(config, holds))
+        return 1;
+    if (checkCoalescing && !rampSim.checkCoalescing())
+        return 1;
+
+    // Random moves
+    uint32_t numMoves = 0;
+    if (numRandomMoves > 0)
+    {
+        RandomMoves randomMoves(seed);
+        for (uint64_t moveIdx = 0; moveIdx < numRandomMoves; moveIdx++)
+        {
+            MotionArgs args;
+            randomMoves.getNext(args);
+            args.setMoreMovesComing(true);
+            if (!rampSim.moveTo(args))
+            {
+                std::cerr << "Random move failed " << moveIdx << std::endl;
+                return 1;
+            }
+            numMoves++;
+        }
+    }
+    else
+    {
+        // Moves from file
+        std::ifstream moveFile(moveFileName);
+        if (!moveFile.is_open())
+        {
+            std::cerr << "Failed to open move file " << moveFileName << std::endl;
+            return 1;
+        }
+        std::string line;
+        bool isRelative = false;
+        double feedrateUnitsPerMin = 0;
+        while (std::getline(moveFile, line))
+        {
+            MotionArgs args;
+            if (!parseMoveLine(line, args, isRelative, feedrateUnitsPerMin))
+                continue;
+            args.setMoreMovesComing(true);
+            if (!rampSim.moveTo(args))
+            {
+                std::cerr << "Move failed " << line << std::endl;
+                return 1;
+            }
+            numMoves++;
+        }
+    }
+    if (!rampSim.runToCompletion())
+        return 1;
+
+    // Trajectory stream
+    if ((numTrajSamples > 0) && !rampSim.runTrajStream(numTrajSamples, seed))
+        return 1;
+
+    // Jogs
+    if ((numJogs > 0) && !rampSim.runJogs(numJogs, seed))
+        return 1;
+
+    // Endstop move
+    if (runEndStopMove && !rampSim.runEndStopMove())
+        return 1;
+    return rampSim.report(numMoves, limits) ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+// Host stand-in for ConfigPinMap (pins are numbers on the host - names are not mapped)
+
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include "RaftArduino.h"
+#include "RaftJsonIF.h"
+
+class ConfigPinMap
+{
+public:
+    static int getPinFromName(const char* pinName)
+    {
+        if (!pinName || (pinName[0] < '0') || (pinName[0] > '9'))
+            return -1;
+        return atoi(pinName);
+    }
+    static int getInputType(const char* inputTypeStr)
+    {
+        if (inputTypeStr && (strcasecmp(inputTypeStr, "INPUT_PULLUP") == 0))
+            return INPUT_PULLUP;
+        if (inputTypeStr && (strcasecmp(inputTypeStr, "INPUT_PULLDOWN") == 0))
+            return INPUT_PULLDOWN;
+        return INPUT;
+    }
+};
@@ -0,0 +1,22 @@
+// Host stand-in for the ESP-IDF GPIO driver (there are no GPIOs on the host)
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+
+#define GPIO_IS_VALID_GPIO(gpio_num) ((gpio_num) >= 0 && (gpio_num) < 48)
+#define GPIO_IS_VALID_OUTPUT_GPIO(gpio_num) GPIO_IS_VALID_GPIO(gpio_num)
+
+// Interrupts are not supported on the host (interrupt-driven endstops fall back to polling)
+typedef enum { GPIO_INTR_DISABLE = 0, GPIO_INTR_POSEDGE = 1, GPIO_INTR_NEGEDGE = 2, GPIO_INTR_ANYEDGE = 3 } gpio_int_type_t;
+typedef void (*gpio_isr_t)(void* arg);
+inline esp_err_t gpio_install_isr_service(int intr_alloc_flags) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t gpio_intr_enable(gpio_num_t gpio_num) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t gpio_intr_disable(gpio_num_t gpio_num) { return ESP_ERR_NOT_SUPPORTED; }
+inline int gpio_get_level(gpio_num_t gpio_num) { return 0; }
@@ -0,0 +1,85 @@
+// Host stand-in for the ESP-IDF I2S standard mode driver (all functions fail so the shift register pulse engine is
+// never used on the host)
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+typedef struct i2s_channel_obj_t* i2s_chan_handle_t;
+
+typedef enum { I2S_NUM_0 = 0, I2S_NUM_AUTO = 2 } i2s_port_t;
+typedef enum { I2S_ROLE_MASTER = 0, I2S_ROLE_SLAVE = 1 } i2s_role_t;
+typedef enum { I2S_DATA_BIT_WIDTH_16BIT = 16, I2S_DATA_BIT_WIDTH_32BIT = 32 } i2s_data_bit_width_t;
+typedef enum { I2S_SLOT_MODE_MONO = 1, I2S_SLOT_MODE_STEREO = 2 } i2s_slot_mode_t;
+
+#define I2S_GPIO_UNUSED ((gpio_num_t)-1)
+
+typedef struct
+{
+    i2s_port_t id;
+    i2s_role_t role;
+    uint32_t dma_desc_num;
+    uint32_t dma_frame_num;
+    bool auto_clear;
+    int intr_priority;
+} i2s_chan_config_t;
+
+#define I2S_CHANNEL_DEFAULT_CONFIG(i2s_num, i2s_role) { i2s_num, i2s_role, 6, 240, false, 0 }
+
+typedef struct
+{
+    uint32_t sample_rate_hz;
+} i2s_std_clk_config_t;
+
+#define I2S_STD_CLK_DEFAULT_CONFIG(rate) { rate }
+
+typedef struct
+{
+    i2s_data_bit_width_t data_bit_width;
+    i2s_slot_mode_t slot_mode;
+} i2s_std_slot_config_t;
+
+#define I2S_STD_MSB_SLOT_DEFAULT_CONFIG(bits_per_sample, mono_or_stereo) { bits_per_sample, mono_or_stereo }
+
+typedef struct
+{
+    gpio_num_t mclk;
+    gpio_num_t bclk;
+    gpio_num_t ws;
+    gpio_num_t dout;
+    gpio_num_t din;
+} i2s_std_gpio_config_t;
+
+typedef struct
+{
+    i2s_std_clk_config_t clk_cfg;
+    i2s_std_slot_config_t slot_cfg;
+    i2s_std_gpio_config_t gpio_cfg;
+} i2s_std_config_t;
+
+typedef struct
+{
+    void* data;
+    size_t size;
+} i2s_event_data_t;
+
+typedef bool (*i2s_isr_callback_t)(i2s_chan_handle_t handle, i2s_event_data_t* event, void* user_ctx);
+
+typedef struct
+{
+    i2s_isr_callback_t on_recv;
+    i2s_isr_callback_t on_recv_q_ovf;
+    i2s_isr_callback_t on_sent;
+    i2s_isr_callback_t on_send_q_ovf;
+} i2s_event_callbacks_t;
+
+inline esp_err_t i2s_new_channel(const i2s_chan_config_t*, i2s_chan_handle_t*, i2s_chan_handle_t*) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t i2s_del_channel(i2s_chan_handle_t) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t, const i2s_std_config_t*) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t, const i2s_event_callbacks_t*, void*) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t i2s_channel_enable(i2s_chan_handle_t) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t i2s_channel_disable(i2s_chan_handle_t) { return ESP_ERR_NOT_SUPPORTED; }
+inline esp_err_t i2s_channel_write(i2s_chan_handle_t, const void*, size_t, size_t*, uint32_t) { return ESP_ERR_NOT_SUPPORTED; }
@@ -0,0 +1,9 @@
+// Host stand-in for ESP-IDF esp_cpu.h - the cycle count is host time in ns so that execution time
+// measurements (e.g. the ramp generator ISR histograms) are of the host code
+
+#pragma once
+
+#include <stdint.h>
+#include "SimHAL.h"
+
+inline uint32_t esp_cpu_get_cycle_count() { return SimHAL::getHostTimeNs32(); }
@@ -0,0 +1,17 @@
+// Host stand-in for ESP-IDF esp_heap_caps.h (all memory is the same on the host)
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+
+inline void* heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+inline void* heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t)
+{
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+inline void heap_caps_free(void* ptr) { free(ptr); }
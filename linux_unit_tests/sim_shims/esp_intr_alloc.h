@@ -0,0 +1,5 @@
+// Host stand-in for ESP-IDF esp_intr_alloc.h
+
+#pragma once
+
+#define ESP_INTR_FLAG_IRAM (1<<10)
@@ -0,0 +1,7 @@
+// Host stand-in for ESP-IDF esp_rom_sys.h (esp_cpu_get_cycle_count() counts host ns)
+
+#pragma once
+
+#include <stdint.h>
+
+inline uint32_t esp_rom_get_cpu_ticks_per_us() { return 1000; }
@@ -0,0 +1,8 @@
+// Host stand-in for ESP-IDF esp_timer.h (virtual time from SimHAL)
+
+#pragma once
+
+#include <stdint.h>
+#include "SimHAL.h"
+
+inline int64_t esp_timer_get_time() { return int64_t(SimHAL::getTimeUs()); }
@@ -0,0 +1,12 @@
+// Host stand-in for FreeRTOS semphr.h
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { static int mutexPlaceholder = 0; return &mutexPlaceholder; }
+inline void vSemaphoreDelete(SemaphoreHandle_t) {}
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t, BaseType_t* pWoken) { if (pWoken) *pWoken = pdFALSE; return pdTRUE; }
+inline BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t, BaseType_t* pWoken) { if (pWoken) *pWoken = pdFALSE; return pdTRUE; }
@@ -0,0 +1,7 @@
+// Host stand-in for ESP-IDF gpio_reg.h
+
+#pragma once
+
+#define GPIO_OUT_W1TS_REG 0
+#define GPIO_OUT_W1TC_REG 0
+#define GPIO_IN_REG 0
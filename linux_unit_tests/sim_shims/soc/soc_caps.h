@@ -0,0 +1,3 @@
+// Host stand-in for ESP-IDF soc/soc_caps.h (no GPIO glitch filters)
+
+#pragma once
@@ -0,0 +1,139 @@
+; Ramp simulator test moves (mm and mm/min - G0 is a rapid move at the maximum speed)
+G90
+G0 X10 Y10
+G1 X60 Y10 F6000
+G1 X60 Y40
+G1 X10 Y40
+G1 X10 Y10
+; Short segments around a circle (as produced by a slicer)
+G1 X34.984 Y25.628 F3000
+G1 X34.934 Y26.254 F3000
+G1 X34.852 Y26.877 F3000
+G1 X34.738 Y27.495 F3000
+G1 X34.591 Y28.106 F3000
+G1 X34.413 Y28.708 F3000
+G1 X34.203 Y29.300 F3000
+G1 X33.963 Y29.881 F3000
+G1 X33.692 Y30.448 F3000
+G1 X33.392 Y31.000 F3000
+G1 X33.064 Y31.536 F3000
+G1 X32.708 Y32.053 F3000
+G1 X32.326 Y32.552 F3000
+G1 X31.918 Y33.030 F3000
+G1 X31.485 Y33.485 F3000
+G1 X31.030 Y33.918 F3000
+G1 X30.552 Y34.326 F3000
+G1 X30.053 Y34.708 F3000
+G1 X29.536 Y35.064 F3000
+G1 X29.000 Y35.392 F3000
+G1 X28.448 Y35.692 F3000
+G1 X27.881 Y35.963 F3000
+G1 X27.300 Y36.203 F3000
+G1 X26.708 Y36.413 F3000
+G1 X26.106 Y36.591 F3000
+G1 X25.495 Y36.738 F3000
+G1 X24.877 Y36.852 F3000
+G1 X24.254 Y36.934 F3000
+G1 X23.628 Y36.984 F3000
+G1 X23.000 Y37.000 F3000
+G1 X22.372 Y36.984 F3000
+G1 X21.746 Y36.934 F3000
+G1 X21.123 Y36.852 F3000
+G1 X20.505 Y36.738 F3000
+G1 X19.894 Y36.591 F3000
+G1 X19.292 Y36.413 F3000
+G1 X18.700 Y36.203 F3000
+G1 X18.119 Y35.963 F3000
+G1 X17.552 Y35.692 F3000
+G1 X17.000 Y35.392 F3000
+G1 X16.464 Y35.064 F3000
+G1 X15.947 Y34.708 F3000
+G1 X15.448 Y34.326 F3000
+G1 X14.970 Y33.918 F3000
+G1 X14.515 Y33.485 F3000
+G1 X14.082 Y33.030 F3000
+G1 X13.674 Y32.552 F3000
+G1 X13.292 Y32.053 F3000
+G1 X12.936 Y31.536 F3000
+G1 X12.608 Y31.000 F3000
+G1 X12.308 Y30.448 F3000
+G1 X12.037 Y29.881 F3000
+G1 X11.797 Y29.300 F3000
+G1 X11.587 Y28.708 F3000
+G1 X11.409 Y28.106 F3000
+G1 X11.262 Y27.495 F3000
+G1 X11.148 Y26.877 F3000
+G1 X11.066 Y26.254 F3000
+G1 X11.016 Y25.628 F3000
+G1 X11.000 Y25.000 F3000
+G1 X11.016 Y24.372 F3000
+G1 X11.066 Y23.746 F3000
+G1 X11.148 Y23.123 F3000
+G1 X11.262 Y22.505 F3000
+G1 X11.409 Y21.894 F3000
+G1 X11.587 Y21.292 F3000
+G1 X11.797 Y20.700 F3000
+G1 X12.037 Y20.119 F3000
+G1 X12.308 Y19.552 F3000
+G1 X12.608 Y19.000 F3000
+G1 X12.936 Y18.464 F3000
+G1 X13.292 Y17.947 F3000
+G1 X13.674 Y17.448 F3000
+G1 X14.082 Y16.970 F3000
+G1 X14.515 Y16.515 F3000
+G1 X14.970 Y16.082 F3000
+G1 X15.448 Y15.674 F3000
+G1 X15.947 Y15.292 F3000
+G1 X16.464 Y14.936 F3000
+G1 X17.000 Y14.608 F3000
+G1 X17.552 Y14.308 F3000
+G1 X18.119 Y14.037 F3000
+G1 X18.700 Y13.797 F3000
+G1 X19.292 Y13.587 F3000
+G1 X19.894 Y13.409 F3000
+G1 X20.505 Y13.262 F3000
+G1 X21.123 Y13.148 F3000
+G1 X21.746 Y13.066 F3000
+G1 X22.372 Y13.016 F3000
+G1 X23.000 Y13.000 F3000
+G1 X23.628 Y13.016 F3000
+G1 X24.254 Y13.066 F3000
+G1 X24.877 Y13.148 F3000
+G1 X25.495 Y13.262 F3000
+G1 X26.106 Y13.409 F3000
+G1 X26.708 Y13.587 F3000
+G1 X27.300 Y13.797 F3000
+G1 X27.881 Y14.037 F3000
+G1 X28.448 Y14.308 F3000
+G1 X29.000 Y14.608 F3000
+G1 X29.536 Y14.936 F3000
+G1 X30.053 Y15.292 F3000
+G1 X30.552 Y15.674 F3000
+G1 X31.030 Y16.082 F3000
+G1 X31.485 Y16.515 F3000
+G1 X31.918 Y16.970 F3000
+G1 X32.326 Y17.448 F3000
+G1 X32.708 Y17.947 F3000
+G1 X33.064 Y18.464 F3000
+G1 X33.392 Y19.000 F3000
+G1 X33.692 Y19.552 F3000
+G1 X33.963 Y20.119 F3000
+G1 X34.203 Y20.700 F3000
+G1 X34.413 Y21.292 F3000
+G1 X34.591 Y21.894 F3000
+G1 X34.738 Y22.505 F3000
+G1 X34.852 Y23.123 F3000
+G1 X34.934 Y23.746 F3000
+G1 X34.984 Y24.372 F3000
+G1 X35.000 Y25.000 F3000
+; Arcs
+G0 X20 Y25
+G2 X50 Y25 I15 J0 F4000
+G3 X20 Y25 I-15 J0
+; Relative moves including a slow shallow line and a Z move
+G91
+G1 X30 Y1 F300
+G1 Z2 F300
+G1 X-30 Y-1 Z-2 F2400
+G90
+G0 X0 Y0
@@ -64,3 +64,47 @@ TEST_CASE("test_RampGenTimer", "[RampGenTimer]")
     // Unattach hook
     rampGenTimer.unhookTimer((void*)&rampGenTimerCallback);
 }
+
+static RampGenTimer* pScaledTimer = nullptr;
+static volatile uint32_t scaledTimerPeriodScale = 1;
+static volatile int scaledTimerCount = 0;
+void IRAM_ATTR rampGenScaledTimerCallback(void* pObject)
+{
+    scaledTimerCount = scaledTimerCount + 1;
+    if (pScaledTimer)
+        pScaledTimer->requestPeriodScale(scaledTimerPeriodScale);
+}
+
+TEST_CASE("test_RampGenTimer_periodScale", "[RampGenTimer]")
+{
+    // Debug
+    LOG_I(MODULE_PREFIX, "RampGenTimer period scale Test");
+
+    RampGenTimer rampGenTimer;
+    const int timerPeriodUs = 100;
+    rampGenTimer.setup(timerPeriodUs);
+    pScaledTimer = &rampGenTimer;
+    rampGenTimer.hookTimer(rampGenScaledTimerCallback, (void*)&rampGenScaledTimerCallback);
+    rampGenTimer.enable(true);
+
+    // Check the callback rate at several period scales
+    const int timePeriodForTestLoopMs = 100;
+    for (uint32_t periodScale : {1, 4, 10, 1})
+    {
+        scaledTimerPeriodScale = periodScale;
+        delay(timePeriodForTestLoopMs);
+        int startCount = scaledTimerCount;
+        delay(timePeriodForTestLoopMs);
+        int callbackCount = scaledTimerCount - startCount;
+        const int expectedCount = (timePeriodForTestLoopMs*1000) / (timerPeriodUs * periodScale);
+        const int errorMargin = expectedCount / 10 + 1;
+        LOG_I(MODULE_PREFIX, "periodScale %d callbackCount %d expected %d errorMargin %d", 
+                    periodScale, callbackCount, expectedCount, errorMargin);
+        TEST_ASSERT_INT_WITHIN(errorMargin, expectedCount, callbackCount);
+        TEST_ASSERT_EQUAL_UINT32(periodScale, rampGenTimer.getElapsedPeriodScale());
+    }
+
+    // Unattach hook
+    rampGenTimer.unhookTimer((void*)&rampGenScaledTimerCallback);
+    pScaledTimer = nullptr;
+}
@@ -11,6 +11,7 @@
 #include "RaftUtils.h"
 #include "RaftArduino.h"
 #include "StepDriverTMC2209.h"
+#include "StepDriverBusScheduler.h"
 #include "RaftBusSystem.h"
 #include "BusSerial.h"
 #include "RaftJson.h"
@@ -65,6 +66,42 @@ void busOperationStatusCB(RaftBus& bus, BusOperationStatus busOperationStatus)
     LOG_I(MODULE_PREFIX, "busOperationStatusCB");
 }
 
+// Bitwise Trinamics CRC (as given in the TMC2209 datasheet) to check the table-driven version against
+static uint8_t refTrinamicsCRC(const uint8_t* pData, uint32_t len)
+{
+    uint8_t crc = 0;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        uint8_t currentByte = pData[i];
+        for (uint32_t j = 0; j < 8; j++)
+        {
+            if ((crc >> 7) ^ (currentByte & 0x01))
+                crc = (crc << 1) ^ 0x07;
+            else
+                crc = (crc << 1);
+            currentByte = currentByte >> 1;
+        }
+    }
+    return crc;
+}
+
+TEST_CASE("test_TMC2209_CRC", "[TMC2209Test]")
+{
+    // Datagrams of all lengths with pseudo-random content
+    uint32_t seed = 12345;
+    for (uint32_t testIdx = 0; testIdx < 1000; testIdx++)
+    {
+        uint8_t datagram[StepDriverBase::TMC_WRITE_DATAGRAM_LEN];
+        uint32_t len = 1 + testIdx % sizeof(datagram);
+        for (uint32_t i = 0; i < len; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            datagram[i] = seed >> 16;
+        }
+        TEST_ASSERT_EQUAL_UINT8(refTrinamicsCRC(datagram, len), StepDriverBase::calcTrinamicsCRC(datagram, len));
+    }
+}
+
 TEST_CASE("test_TMC2209", "[TMC2209Test]")
 {
     // Debug
@@ -115,6 +152,70 @@ TEST_CASE("test_TMC2209", "[TMC2209Test]")
         delay(1);
     }
 
+    delete pStepper1;
+    delete pStepper2;
+}
+
+TEST_CASE("test_TMC2209_bus_scheduler", "[TMC2209Test]")
+{
+    // Debug
+    LOG_I(MODULE_PREFIX, "TMC2209 Bus Scheduler Test");
+
+    // Serial bus (registered by the previous test if run in the same session)
+    RaftBus* pMotorSerialBus = raftBusSystem.getBusByName("SERA");
+    if (pMotorSerialBus == NULL)
+    {
+        raftBusSystem.registerBus("serial", BusSerial::createFn);
+        raftBusSystem.setup("buses", 
+                RaftJson(R"({"buses":{"buslist":[{"type":"serial","name":"SERA","uartNum":2,"rxPin":5,"txPin":47,"baudRate":115200}]}})"),
+                busStatusCB, busOperationStatusCB);
+        pMotorSerialBus = raftBusSystem.getBusByName("SERA");
+    }
+    if (pMotorSerialBus == NULL)
+    {
+        LOG_E(MODULE_PREFIX, "Failed to get serial bus");
+        return;
+    }
+
+    // Steppers sharing the bus
+    StepDriverBase* pSteppers[] = { new StepDriverTMC2209(), new StepDriverTMC2209() };
+    StepDriverBusScheduler busScheduler;
+    busScheduler.setup(pMotorSerialBus);
+    StepDriverParams stepperParams;
+    stepperParams.rmsAmps = 0.1;
+    stepperParams.microsteps = 16;
+    for (uint32_t i = 0; i < sizeof(pSteppers)/sizeof(pSteppers[0]); i++)
+    {
+        pSteppers[i]->setupSerialBus(pMotorSerialBus, false);
+        stepperParams.stepPin = 15 + i * 2;
+        stepperParams.dirnPin = 16 + i * 2;
+        stepperParams.address = i;
+        pSteppers[i]->setup("Ax" + String(i + 1), stepperParams, false);
+        busScheduler.addDriver(pSteppers[i]);
+    }
+
+    // Config writes and the first status reads for all drivers should complete within tens of ms
+    uint32_t startMs = millis();
+    bool allOk = false;
+    while (!Raft::isTimeout(millis(), startMs, 100))
+    {
+        for (StepDriverBase* pStepper : pSteppers)
+            pStepper->loop();
+        busScheduler.loop();
+        allOk = true;
+        for (StepDriverBase* pStepper : pSteppers)
+            allOk &= pStepper->isOperatingOk();
+        if (allOk)
+            break;
+    }
+    LOG_I(MODULE_PREFIX, "bus scheduler %s after %dms %s", allOk ? "OK" : "FAILED", 
+                (int)(millis() - startMs), busScheduler.getDebugJSON(true).c_str());
+    TEST_ASSERT_MESSAGE(allOk, "Bus scheduler didn't read the status of all drivers");
+
+    busScheduler.clear();
+    for (StepDriverBase* pStepper : pSteppers)
+        delete pStepper;
+
 //     // End stops
 //     std::vector<EndStops*> endStops;
 
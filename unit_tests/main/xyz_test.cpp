@@ -128,3 +128,32 @@ TEST_CASE("XYZ test 1", "[Geometry]")
     testPtToActuator(pRaftKinematics, axesParams, testPts, sizeof(testPts) / sizeof(TestGeomPt));
 
 }
+
+TEST_CASE("XYZ step residual carry", "[Geometry]")
+{
+    LOG_I(MODULE_PREFIX, "XYZ step residual carry");
+
+    // Default axes (one step per unit)
+    AxesParams axesParams;
+    RaftJson config(R"({"geom": "XYZ"})");
+    RaftKinematics* pRaftKinematics = RaftKinematicsSystem::createKinematics(config);
+    TEST_ASSERT_MESSAGE(pRaftKinematics != nullptr, "createKinematics failed");
+
+    // Moves of less than a step - the steps follow the commanded position and the residual holds the fraction
+    AxesState axesState;
+    for (int moveIdx = 1; moveIdx <= 10; moveIdx++)
+    {
+        AxesValues<AxisPosDataType> pt(moveIdx * 0.3, 0, 0);
+        AxesValues<AxisCalcDataType> actuatorExact;
+        TEST_ASSERT_MESSAGE(pRaftKinematics->ptToActuatorExact(pt, actuatorExact, axesState, axesParams, false),
+                    "ptToActuatorExact failed");
+        AxesValues<AxisStepsDataType> steps;
+        steps.setVal(0, round(actuatorExact.getVal(0)));
+        axesState.setPosition(pt, steps, false);
+        pRaftKinematics->correctStepOverflow(axesState, actuatorExact, axesParams);
+        TEST_ASSERT_MESSAGE(fabs(axesState.getStepsFromOriginExact(0) - moveIdx * 0.3) < 0.0001, "Exact position incorrect");
+        TEST_ASSERT_MESSAGE(fabs(axesState.getStepResidual(0)) <= 0.5, "Residual out of range");
+    }
+    TEST_ASSERT_MESSAGE(axesState.getStepsFromOrigin(0) == 3, "Steps incorrect");
+    delete pRaftKinematics;
+}